@@ -0,0 +1,2949 @@
+/*****************************************************************************
+* main.cpp
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+
+//
+// Benchmarks of the portable pixel kernels.
+// Builds without the DirectX headers, e.g. on Linux:
+//   g++ -O2 -std=c++11 -I dxgi_desktop_capture dxgi_capture_bench/main.cpp -o dxgi_capture_bench -pthread
+//
+// usage: dxgi_capture_bench [group [threads]] [-time msec] [-repeat n] [-out results.csv]
+//                           [-baseline results.csv] [-threshold percent]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DXGICaptureBlend.h"
+#include "DXGICaptureCopy.h"
+#include "DXGICaptureBmp.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureCursorShape.h"
+#include "DXGICaptureDelta.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICaptureMetrics.h"
+#include "DXGICapturePointer.h"
+#include "DXGICaptureQoi.h"
+#include "DXGICaptureRegion.h"
+#include "DXGICaptureRender.h"
+#include "DXGICaptureRotate.h"
+#include "DXGICaptureScale.h"
+#include "DXGICaptureSnapshot.h"
+#include "DXGICaptureStagingRing.h"
+#include "DXGICaptureStripEncoder.h"
+#include "DXGICaptureSyntheticSource.h"
+#include "DXGICaptureTileHash.h"
+#include "DXGICaptureYuv.h"
+
+#if defined(_WIN32)
+#include "DXGICaptureHelper.h"
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "windowscodecs.lib")
+#endif
+
+static const char* simdLevelName(tagSimdLevel level)
+{
+	switch (level)
+	{
+	case tagSimdLevel_Scalar: return "scalar";
+	case tagSimdLevel_SSE2:   return "sse2";
+	case tagSimdLevel_AVX2:   return "avx2";
+	case tagSimdLevel_NEON:   return "neon";
+	default:                  return "auto";
+	}
+}
+
+// minimum run time of a measurement (-time) and the number of measurements (-repeat)
+static double g_BenchMsec = 200.0;
+static UINT g_BenchRepeat = 1;
+
+//
+// Runs fn until at least minMsec (default: -time) elapsed, returns nanoseconds per call.
+// With -repeat the fastest of the measurements is returned (less noise for -baseline).
+//
+template <typename TFunc>
+static double benchRun(TFunc fn, double minMsec = 0.0)
+{
+	typedef std::chrono::steady_clock clock_type;
+
+	if (minMsec <= 0.0) {
+		minMsec = g_BenchMsec;
+	}
+
+	// warm up
+	fn();
+
+	double bestNs = 0.0;
+	for (UINT r = 0; r < g_BenchRepeat; ++r)
+	{
+		UINT64 nIterations = 0;
+		UINT64 nBatch = 1;
+		clock_type::time_point start = clock_type::now();
+		double elapsedNs = 0.0;
+		for (;;)
+		{
+			for (UINT64 i = 0; i < nBatch; ++i) {
+				fn();
+			}
+			nIterations += nBatch;
+			elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+			if (elapsedNs >= minMsec * 1000000.0) {
+				break;
+			}
+			nBatch *= 2;
+		}
+
+		double ns = elapsedNs / (double)nIterations;
+		if ((r == 0) || (ns < bestNs)) {
+			bestNs = ns;
+		}
+	}
+
+	return bestNs;
+}
+
+//
+// Measured results of the run, written as csv (-out) and compared with a stored run (-baseline).
+// A result is identified by group, name, size and variant; its value is ns per call (lower is better).
+//
+struct tagBenchResult
+{
+	std::string Key;     /* group,name,width,height,variant */
+	double Ns;
+};
+
+static std::vector<tagBenchResult> g_Results;
+// mismatches of the equivalence checks, a run with mismatches exits with code 3
+static UINT g_CheckFailures = 0;
+
+static void recordResult(const char *group, const char *name, INT width, INT height, const char *variant, double ns)
+{
+	char key[256];
+	sprintf(key, "%.63s,%.63s,%d,%d,%.63s", group, name, width, height, variant);
+	tagBenchResult result;
+	result.Key = key;
+	result.Ns  = ns;
+	g_Results.push_back(result);
+}
+
+static void printResult(const char *group, const char *name, INT width, INT height, const char *variant, double nsPerCall)
+{
+	recordResult(group, name, width, height, variant, nsPerCall);
+	double mpixPerSec = ((double)width * height) / nsPerCall * 1000.0;
+	printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns %10.1f Mpix/s\n", group, name, width, height, variant, nsPerCall, mpixPerSec);
+}
+
+// results that do not scale with the pixels of width x height
+static void printTime(const char *group, const char *name, INT width, INT height, const char *variant, double nsPerCall)
+{
+	recordResult(group, name, width, height, variant, nsPerCall);
+	printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns\n", group, name, width, height, variant, nsPerCall);
+}
+
+static void fillRandom(std::vector<UINT> &buffer, UINT seed)
+{
+	for (size_t i = 0; i < buffer.size(); ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		buffer[i] = seed;
+	}
+}
+
+static const tagSimdLevel g_SimdLevels[] =
+{
+	tagSimdLevel_Scalar,
+	tagSimdLevel_SSE2,
+	tagSimdLevel_AVX2,
+	tagSimdLevel_NEON,
+};
+
+static std::vector<tagSimdLevel> availableSimdLevels()
+{
+	std::vector<tagSimdLevel> levels;
+	for (size_t i = 0; i < sizeof(g_SimdLevels) / sizeof(g_SimdLevels[0]); ++i) {
+		if (DXGICaptureCpu::ResolveSimdLevel(g_SimdLevels[i]) == g_SimdLevels[i]) {
+			levels.push_back(g_SimdLevels[i]);
+		}
+	}
+	return levels;
+}
+
+//
+// Every SIMD level against the scalar blend on odd widths and padded pitches,
+// with transparent, opaque, partial and mixed cursor alpha; the padding must
+// stay untouched.
+//
+static void checkBlend()
+{
+	const INT sizes[][2] = { { 1, 1 }, { 2, 3 }, { 3, 5 }, { 5, 2 }, { 7, 7 }, { 9, 4 }, { 15, 3 }, { 17, 9 }, { 31, 5 }, { 33, 33 }, { 67, 13 } };
+	const char *alphaNames[] = { "alpha 0", "alpha 255", "alpha partial", "alpha mixed" };
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+	UINT cases = 0, mismatches = 0;
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width  = sizes[s][0];
+		const INT height = sizes[s][1];
+		const INT srcPitch = width + 3;
+		const INT dstPitch = width + 5;
+		std::vector<UINT> surface((size_t)dstPitch * height);
+		fillRandom(surface, 60 + (UINT)s);
+
+		for (UINT a = 0; a < sizeof(alphaNames) / sizeof(alphaNames[0]); ++a)
+		{
+			std::vector<UINT> cursor((size_t)srcPitch * height);
+			fillRandom(cursor, 70 + (UINT)s * 4 + a);
+			for (size_t i = 0; i < cursor.size(); ++i)
+			{
+				UINT alpha = cursor[i] >> 24;
+				switch (a)
+				{
+				case 0:  alpha = 0; break;
+				case 1:  alpha = 255; break;
+				case 2:  alpha = 1 + (alpha % 254); break;
+				default: alpha = (i % 3 == 0) ? 0 : ((i % 3 == 1) ? 255 : alpha); break;
+				}
+				cursor[i] = (cursor[i] & 0x00FFFFFF) | (alpha << 24);
+			}
+
+			std::vector<UINT> ref(surface);
+			DXGICaptureBlend::AlphaBlend((BYTE*)ref.data(), dstPitch * 4, (const BYTE*)cursor.data(), srcPitch * 4, width, height, tagSimdLevel_Scalar);
+
+			for (size_t l = 0; l < levels.size(); ++l)
+			{
+				if (levels[l] == tagSimdLevel_Scalar) {
+					continue;
+				}
+				std::vector<UINT> dst(surface);
+				DXGICaptureBlend::AlphaBlend((BYTE*)dst.data(), dstPitch * 4, (const BYTE*)cursor.data(), srcPitch * 4, width, height, levels[l]);
+				++cases;
+				if (dst != ref)
+				{
+					++mismatches;
+					printf("blend    mismatch: %dx%d %s %s\n", width, height, alphaNames[a], simdLevelName(levels[l]));
+				}
+			}
+		}
+	}
+	g_CheckFailures += mismatches;
+	printf("blend    check: %u cases, %u mismatches %s\n", cases, mismatches, (mismatches == 0) ? "ok" : "MISMATCH");
+}
+
+static void benchBlend()
+{
+	checkBlend();
+
+	const INT sizes[] = { 32, 64, 128, 256 };
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		INT size = sizes[s];
+		std::vector<UINT> cursor((size_t)size * size);
+		std::vector<UINT> surface((size_t)size * size);
+		fillRandom(cursor, 1);
+		fillRandom(surface, 2);
+
+		for (size_t l = 0; l < levels.size(); ++l)
+		{
+			tagSimdLevel level = levels[l];
+			double ns = benchRun([&]() {
+				DXGICaptureBlend::AlphaBlend((BYTE*)surface.data(), size * 4, (const BYTE*)cursor.data(), size * 4, size, size, level);
+			});
+			printResult("blend", "cursor", size, size, simdLevelName(level), ns);
+		}
+	}
+}
+
+//
+// The former monochrome and masked color expansion of ProcessMouseMask
+//
+static void legacyExpandMonochrome(const BYTE *pShape, INT shapePitch, INT width, INT height, UINT *InitBuffer32)
+{
+	for (INT Row = 0; Row < height; ++Row)
+	{
+		BYTE Mask = 0x80;
+		for (INT Col = 0; Col < width; ++Col)
+		{
+			BYTE XorMask = pShape[(Col / 8) + ((Row + height) * shapePitch)] & Mask;
+			InitBuffer32[(Row * width) + Col] = (XorMask) ? 0xFFFFFFFF : 0x00000000;
+			Mask = (Mask == 0x01) ? 0x80 : (Mask >> 1);
+		}
+	}
+}
+
+static void legacyExpandMaskedColor(const UINT *ShapeBuffer32, INT shapePitch, INT width, INT height, UINT *InitBuffer32)
+{
+	for (INT Row = 0; Row < height; ++Row)
+	{
+		for (INT Col = 0; Col < width; ++Col)
+		{
+			InitBuffer32[(Row * width) + Col] = ShapeBuffer32[Col + (Row * (shapePitch / sizeof(UINT)))] | 0xFF000000;
+		}
+	}
+}
+
+//
+// Equivalence check of the AND/XOR expansion against the former expansion: the
+// XOR plane must hold the color of the legacy pixel (monochrome: white where the
+// XOR bit is set, masked color: the shape color) without alpha, the AND plane the
+// AND bit / mask high bit per pixel. Every SIMD level runs over random masks, odd
+// widths and padded pitches; the padding must stay untouched and the composition
+// must match (Dst & And) ^ Xor per pixel.
+//
+static BOOL checkPlane(const std::vector<UINT> &plane, const std::vector<UINT> &ref, INT width, INT height, INT pitch)
+{
+	for (INT y = 0; y < height; ++y)
+	{
+		for (INT x = 0; x < pitch; ++x)
+		{
+			// the padding of a row keeps its fill value
+			const UINT expected = (x < width) ? ref[(size_t)y * width + x] : 0xA5A5A5A5;
+			if (plane[(size_t)y * pitch + x] != expected) {
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+static void checkCursorShape()
+{
+	const INT sizes[][2] = { { 1, 1 }, { 3, 5 }, { 7, 9 }, { 9, 7 }, { 31, 17 }, { 33, 32 }, { 63, 3 }, { 64, 64 }, { 127, 29 }, { 130, 33 } };
+	const INT padding[] = { 0, 1, 5 }; // extra bytes per shape row, extra pixels per plane row
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+	UINT cases = 0, mismatches = 0;
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		for (size_t p = 0; p < sizeof(padding) / sizeof(padding[0]); ++p)
+		{
+			const INT width      = sizes[s][0];
+			const INT height     = sizes[s][1];
+			const INT monoPitch  = (width + 7) / 8 + padding[p];
+			const INT colorPitch = (width + padding[p]) * 4;
+			const INT planePitch = width + padding[p];
+			const UINT seed      = (UINT)(s * 16 + p);
+
+			// random AND + XOR mask rows, random colors and mask bytes
+			std::vector<UINT> monoShape(((size_t)monoPitch * height * 2 + 3) / 4);
+			std::vector<UINT> colorShape((size_t)colorPitch / 4 * height);
+			fillRandom(monoShape, 100 + seed);
+			fillRandom(colorShape, 200 + seed);
+			const BYTE *pMono = (const BYTE*)monoShape.data();
+
+			// references: the legacy expansion for the color, the mask bits for the AND plane
+			std::vector<UINT> legacy((size_t)width * height);
+			std::vector<UINT> refMonoAnd((size_t)width * height), refMonoXor((size_t)width * height);
+			std::vector<UINT> refMaskedAnd((size_t)width * height), refMaskedXor((size_t)width * height);
+			legacyExpandMonochrome(pMono, monoPitch, width, height, legacy.data());
+			for (INT y = 0; y < height; ++y)
+			{
+				for (INT x = 0; x < width; ++x)
+				{
+					const size_t i = (size_t)y * width + x;
+					const BOOL bAnd = (pMono[(size_t)y * monoPitch + x / 8] & (0x80 >> (x % 8))) != 0;
+					refMonoAnd[i] = bAnd ? 0xFFFFFFFF : 0xFF000000;
+					refMonoXor[i] = legacy[i] & 0x00FFFFFF;
+				}
+			}
+			legacyExpandMaskedColor(colorShape.data(), colorPitch, width, height, legacy.data());
+			for (INT y = 0; y < height; ++y)
+			{
+				for (INT x = 0; x < width; ++x)
+				{
+					const size_t i = (size_t)y * width + x;
+					const UINT uiShape = colorShape[(size_t)y * (colorPitch / 4) + x];
+					refMaskedAnd[i] = (uiShape & 0x80000000) ? 0xFFFFFFFF : 0xFF000000;
+					refMaskedXor[i] = legacy[i] & 0x00FFFFFF;
+				}
+			}
+
+			std::vector<UINT> surface((size_t)planePitch * height), refSurface((size_t)width * height);
+			fillRandom(surface, 300 + seed);
+
+			for (size_t l = 0; l < levels.size(); ++l)
+			{
+				const tagSimdLevel level = levels[l];
+				std::vector<UINT> andPlane((size_t)planePitch * height, 0xA5A5A5A5);
+				std::vector<UINT> xorPlane((size_t)planePitch * height, 0xA5A5A5A5);
+
+				DXGICaptureCursorShape::ExpandMonochrome(pMono, monoPitch, width, height,
+					(BYTE*)andPlane.data(), planePitch * 4, (BYTE*)xorPlane.data(), planePitch * 4, level);
+				BOOL bSame = checkPlane(andPlane, refMonoAnd, width, height, planePitch) && checkPlane(xorPlane, refMonoXor, width, height, planePitch);
+				++cases;
+				if (!bSame)
+				{
+					++mismatches;
+					printf("shape    monochrome mismatch: %dx%d pitch %d %s\n", width, height, monoPitch, simdLevelName(level));
+				}
+
+				std::fill(andPlane.begin(), andPlane.end(), 0xA5A5A5A5);
+				std::fill(xorPlane.begin(), xorPlane.end(), 0xA5A5A5A5);
+				DXGICaptureCursorShape::ExpandMaskedColor((const BYTE*)colorShape.data(), colorPitch, width, height,
+					(BYTE*)andPlane.data(), planePitch * 4, (BYTE*)xorPlane.data(), planePitch * 4, level);
+				bSame = checkPlane(andPlane, refMaskedAnd, width, height, planePitch) && checkPlane(xorPlane, refMaskedXor, width, height, planePitch);
+				++cases;
+				if (!bSame)
+				{
+					++mismatches;
+					printf("shape    masked mismatch: %dx%d pitch %d %s\n", width, height, colorPitch, simdLevelName(level));
+				}
+
+				// composition of the masked planes over a random surface
+				std::vector<UINT> dst(surface);
+				for (INT y = 0; y < height; ++y)
+				{
+					for (INT x = 0; x < width; ++x)
+					{
+						const size_t i = (size_t)y * width + x;
+						refSurface[i] = (surface[(size_t)y * planePitch + x] & refMaskedAnd[i]) ^ refMaskedXor[i];
+					}
+				}
+				DXGICaptureCursorShape::ComposeMask((BYTE*)dst.data(), planePitch * 4, (const BYTE*)andPlane.data(), planePitch * 4,
+					(const BYTE*)xorPlane.data(), planePitch * 4, width, height, level);
+				bSame = TRUE;
+				for (INT y = 0; bSame && (y < height); ++y)
+				{
+					for (INT x = 0; x < planePitch; ++x)
+					{
+						const UINT expected = (x < width) ? refSurface[(size_t)y * width + x] : surface[(size_t)y * planePitch + x];
+						if (dst[(size_t)y * planePitch + x] != expected)
+						{
+							bSame = FALSE;
+							break;
+						}
+					}
+				}
+				++cases;
+				if (!bSame)
+				{
+					++mismatches;
+					printf("shape    compose-mask mismatch: %dx%d pitch %d %s\n", width, height, planePitch * 4, simdLevelName(level));
+				}
+			}
+		}
+	}
+	g_CheckFailures += mismatches;
+	printf("shape    check: %u cases, %u mismatches %s\n", cases, mismatches, (mismatches == 0) ? "ok" : "MISMATCH");
+}
+
+static void benchCursorShape()
+{
+	checkCursorShape();
+
+	const INT sizes[] = { 32, 64, 128, 256 };
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		INT size = sizes[s];
+		INT monoPitch = (size + 7) / 8;
+		std::vector<UINT> monoShape(((size_t)monoPitch * size * 2 + 3) / 4);
+		std::vector<UINT> colorShape((size_t)size * size);
+		std::vector<UINT> andPlane((size_t)size * size);
+		std::vector<UINT> xorPlane((size_t)size * size);
+		std::vector<UINT> surface((size_t)size * size);
+		fillRandom(monoShape, 4);
+		fillRandom(colorShape, 5);
+		fillRandom(surface, 6);
+
+		double ns = benchRun([&]() {
+			legacyExpandMonochrome((const BYTE*)monoShape.data(), monoPitch, size, size, xorPlane.data());
+		});
+		printResult("shape", "legacy-monochrome", size, size, "scalar", ns);
+
+		ns = benchRun([&]() {
+			legacyExpandMaskedColor(colorShape.data(), size * 4, size, size, xorPlane.data());
+		});
+		printResult("shape", "legacy-masked", size, size, "scalar", ns);
+
+		for (size_t l = 0; l < levels.size(); ++l)
+		{
+			tagSimdLevel level = levels[l];
+			ns = benchRun([&]() {
+				DXGICaptureCursorShape::ExpandMonochrome((const BYTE*)monoShape.data(), monoPitch, size, size, (BYTE*)andPlane.data(), size * 4, (BYTE*)xorPlane.data(), size * 4, level);
+			});
+			printResult("shape", "monochrome", size, size, simdLevelName(level), ns);
+
+			ns = benchRun([&]() {
+				DXGICaptureCursorShape::ExpandMaskedColor((const BYTE*)colorShape.data(), size * 4, size, size, (BYTE*)andPlane.data(), size * 4, (BYTE*)xorPlane.data(), size * 4, level);
+			});
+			printResult("shape", "masked", size, size, simdLevelName(level), ns);
+
+			ns = benchRun([&]() {
+				DXGICaptureCursorShape::ComposeMask((BYTE*)surface.data(), size * 4, (const BYTE*)andPlane.data(), size * 4, (const BYTE*)xorPlane.data(), size * 4, size, size, level);
+			});
+			printResult("shape", "compose-mask", size, size, simdLevelName(level), ns);
+		}
+	}
+}
+
+//
+// Cursor shape replay, the shape types match DXGI_OUTDUPL_POINTER_SHAPE_TYPE
+//
+enum { SHAPE_MONOCHROME = 1, SHAPE_COLOR = 2, SHAPE_MASKED_COLOR = 4 };
+
+struct tagBenchShape
+{
+	UINT Type;
+	INT Width;
+	INT Height;          /* monochrome: AND + XOR mask rows */
+	INT Pitch;
+	std::vector<UINT> Data;
+};
+
+struct tagBenchMouseEvent
+{
+	INT ShapeIdx;        /* -1: no new shape */
+	INT X;
+	INT Y;
+};
+
+//
+// Same processing as DXGICaptureHelper::ProcessMouseShape: expand + rotate,
+// AND + XOR planes for the masked shapes
+//
+static void processBenchShape(const tagBenchShape &shape, INT degrees, BYTE **ppBuffer, UINT *pBufferSize, std::vector<BYTE> &rotateBuffer, INT *pWidth, INT *pHeight)
+{
+	INT width  = shape.Width;
+	INT height = (shape.Type == SHAPE_MONOCHROME) ? shape.Height / 2 : shape.Height;
+	INT pitch  = width * 4;
+	INT planes = (shape.Type == SHAPE_COLOR) ? 1 : 2;
+	UINT size  = (UINT)(planes * height * pitch);
+
+	if (*pBufferSize < size)
+	{
+		delete[] *ppBuffer;
+		*ppBuffer = new BYTE[size];
+		*pBufferSize = size;
+	}
+
+	BYTE *pBuffer = *ppBuffer;
+	const BYTE *pShape = (const BYTE*)shape.Data.data();
+	switch (shape.Type)
+	{
+	case SHAPE_COLOR:
+		memcpy(pBuffer, pShape, size);
+		break;
+	case SHAPE_MONOCHROME:
+		DXGICaptureCursorShape::ExpandMonochrome(pShape, shape.Pitch, width, height, pBuffer, pitch, pBuffer + height * pitch, pitch);
+		break;
+	default:
+		DXGICaptureCursorShape::ExpandMaskedColor(pShape, shape.Pitch, width, height, pBuffer, pitch, pBuffer + height * pitch, pitch);
+		break;
+	}
+
+	*pWidth  = width;
+	*pHeight = height;
+	if (degrees == 0) {
+		return;
+	}
+
+	INT rotatedWidth, rotatedHeight;
+	DXGICaptureRotate::GetRotatedSize(width, height, degrees, &rotatedWidth, &rotatedHeight);
+	rotateBuffer.resize(size);
+	for (INT plane = 0; plane < planes; ++plane) {
+		DXGICaptureRotate::Rotate(pBuffer + plane * height * pitch, pitch, width, height, rotateBuffer.data() + plane * height * pitch, rotatedWidth * 4, degrees);
+	}
+	memcpy(pBuffer, rotateBuffer.data(), size);
+	*pWidth  = rotatedWidth;
+	*pHeight = rotatedHeight;
+}
+
+static void drawBenchShape(UINT type, const BYTE *pShape, INT width, INT height, INT x, INT y, std::vector<UINT> &surface, INT surfWidth, INT surfHeight)
+{
+	x = std::max(0, std::min(x, surfWidth - width));
+	y = std::max(0, std::min(y, surfHeight - height));
+	BYTE *pDst = (BYTE*)(surface.data() + (size_t)y * surfWidth + x);
+	if (type == SHAPE_COLOR) {
+		DXGICaptureBlend::AlphaBlend(pDst, surfWidth * 4, pShape, width * 4, width, height);
+	}
+	else {
+		DXGICaptureCursorShape::ComposeMask(pDst, surfWidth * 4, pShape, width * 4, pShape + height * width * 4, width * 4, width, height);
+	}
+}
+
+//
+// A recorded-like session: pointer moves every frame, the shape changes between
+// a handful of cursors (arrow, i-beam, hand, resize, ...) every few dozen frames
+//
+static void makeMouseSession(std::vector<tagBenchShape> &shapes, std::vector<tagBenchMouseEvent> &events, INT frames, INT surfWidth, INT surfHeight)
+{
+	const UINT types[]  = { SHAPE_COLOR, SHAPE_MONOCHROME, SHAPE_COLOR, SHAPE_MASKED_COLOR, SHAPE_MONOCHROME, SHAPE_COLOR };
+	const INT  sizes[]  = { 32, 32, 48, 32, 64, 128 };
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+	{
+		tagBenchShape shape;
+		shape.Type   = types[i];
+		shape.Width  = sizes[i];
+		shape.Height = (types[i] == SHAPE_MONOCHROME) ? sizes[i] * 2 : sizes[i];
+		shape.Pitch  = (types[i] == SHAPE_MONOCHROME) ? (sizes[i] + 7) / 8 : sizes[i] * 4;
+		shape.Data.resize(((size_t)shape.Pitch * shape.Height + 3) / 4);
+		fillRandom(shape.Data, 10 + (UINT)i);
+		shapes.push_back(shape);
+	}
+
+	UINT seed = 7;
+	INT x = surfWidth / 2, y = surfHeight / 2;
+	INT nextChange = 0;
+	for (INT f = 0; f < frames; ++f)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		tagBenchMouseEvent ev;
+		ev.ShapeIdx = -1;
+		if (f == nextChange)
+		{
+			// mostly the arrow and the i-beam, sometimes the others
+			UINT r = (seed >> 8) % 10;
+			ev.ShapeIdx = (r < 4) ? 0 : ((r < 7) ? 1 : (INT)(2 + (r % 4)));
+			nextChange = f + 20 + (INT)((seed >> 16) % 100);
+		}
+		x = std::max(0, std::min(surfWidth - 1, x + (INT)((seed >> 4) % 41) - 20));
+		y = std::max(0, std::min(surfHeight - 1, y + (INT)((seed >> 12) % 41) - 20));
+		ev.X = x;
+		ev.Y = y;
+		events.push_back(ev);
+	}
+}
+
+static void benchCursorCache()
+{
+	const INT surfWidth = 1920, surfHeight = 1080, frames = 5000;
+	const INT degrees[] = { 0, 90 };
+
+	std::vector<tagBenchShape> shapes;
+	std::vector<tagBenchMouseEvent> events;
+	makeMouseSession(shapes, events, frames, surfWidth, surfHeight);
+
+	std::vector<UINT> surface((size_t)surfWidth * surfHeight);
+	std::vector<BYTE> rotateBuffer;
+	fillRandom(surface, 20);
+
+	for (size_t d = 0; d < sizeof(degrees) / sizeof(degrees[0]); ++d)
+	{
+		INT rotation = degrees[d];
+
+		// process the shape on every frame
+		BYTE *pBuffer = nullptr;
+		UINT bufferSize = 0;
+		double ns = benchRun([&]() {
+			INT current = 0;
+			for (size_t f = 0; f < events.size(); ++f)
+			{
+				if (events[f].ShapeIdx >= 0) {
+					current = events[f].ShapeIdx;
+				}
+				INT width, height;
+				processBenchShape(shapes[current], rotation, &pBuffer, &bufferSize, rotateBuffer, &width, &height);
+				drawBenchShape(shapes[current].Type, pBuffer, width, height, events[f].X, events[f].Y, surface, surfWidth, surfHeight);
+			}
+		});
+		delete[] pBuffer;
+		char variant[16];
+		sprintf(variant, "rot-%d", rotation);
+		recordResult("cursor", "replay-uncached", surfWidth, surfHeight, variant, ns / frames);
+		printf("%-8s %-18s %5d frames rot %-3d %10.1f ns/frame\n", "cursor", "replay-uncached", frames, rotation, ns / frames);
+
+		// hash new shapes only, process on cache misses (every replay starts with an empty cache)
+		tagCursorCacheStats stats;
+		ns = benchRun([&]() {
+			CDXGICursorCache cache;
+			INT current = 0;
+			UINT64 hash = 0;
+			for (size_t f = 0; f < events.size(); ++f)
+			{
+				const tagBenchShape *pShape = &shapes[current];
+				if (events[f].ShapeIdx >= 0)
+				{
+					current = events[f].ShapeIdx;
+					pShape = &shapes[current];
+					hash = CDXGICursorCache::HashBytes((const BYTE*)pShape->Data.data(), (UINT)(pShape->Pitch * pShape->Height), 0);
+				}
+				UINT64 key = CDXGICursorCache::MakeKey(hash, pShape->Type, pShape->Width, pShape->Height, pShape->Pitch, rotation);
+				tagCursorCacheEntry *pEntry = cache.Find(key);
+				if (nullptr == pEntry)
+				{
+					pEntry = cache.Insert(key);
+					processBenchShape(*pShape, rotation, &pEntry->Buffer, &pEntry->BufferSize, rotateBuffer, &pEntry->Width, &pEntry->Height);
+					pEntry->Pitch = pEntry->Width * 4;
+				}
+				drawBenchShape(pShape->Type, pEntry->Buffer, pEntry->Width, pEntry->Height, events[f].X, events[f].Y, surface, surfWidth, surfHeight);
+			}
+			cache.GetStats(&stats);
+		});
+
+		recordResult("cursor", "replay-cached", surfWidth, surfHeight, variant, ns / frames);
+		printf("%-8s %-18s %5d frames rot %-3d %10.1f ns/frame    hits %llu misses %llu\n", "cursor", "replay-cached", frames, rotation, ns / frames,
+			(unsigned long long)stats.Hits, (unsigned long long)stats.Misses);
+	}
+}
+
+//
+// Synthetic dirty/move rect streams of a 1080p desktop
+//   typing: a few small glyph rects + caret
+//   scroll: the text area moves up by a line, the uncovered strip is dirty
+//   video : a 640x360 window changes every frame
+//
+struct tagBenchRectFrame
+{
+	std::vector<tagFrameMoveRect> Moves;
+	std::vector<tagFrameRect> Dirty;
+};
+
+static tagFrameRect makeRect(LONG left, LONG top, LONG width, LONG height)
+{
+	tagFrameRect rc = { left, top, left + width, top + height };
+	return rc;
+}
+
+static void makeRectStream(const char *pszWorkload, std::vector<tagBenchRectFrame> &frames, INT count)
+{
+	UINT seed = 11;
+	for (INT f = 0; f < count; ++f)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		tagBenchRectFrame frame;
+		if (strcmp(pszWorkload, "typing") == 0)
+		{
+			LONG x = 200 + (LONG)((f * 9) % 1400);
+			LONG y = 300 + (LONG)(((f * 9) / 1400) * 20 % 600);
+			frame.Dirty.push_back(makeRect(x, y, 9, 18));
+			frame.Dirty.push_back(makeRect(x + 9, y, 2, 18));         // caret
+			if ((seed >> 24) < 32) {
+				frame.Dirty.push_back(makeRect(1700, 1040, 200, 40)); // clock, tray
+			}
+		}
+		else if (strcmp(pszWorkload, "scroll") == 0)
+		{
+			tagFrameMoveRect move;
+			move.SrcX = 100;
+			move.SrcY = 120 + 20;
+			move.Dst  = makeRect(100, 120, 1400, 900 - 20);
+			frame.Moves.push_back(move);
+			frame.Dirty.push_back(makeRect(100, 120 + 900 - 20, 1400, 20));
+			frame.Dirty.push_back(makeRect(1500, 120 + (LONG)((f * 7) % 880), 16, 20)); // scroll bar
+		}
+		else
+		{
+			// video window, decoders report it in a few tiles
+			for (LONG ty = 0; ty < 360; ty += 120) {
+				for (LONG tx = 0; tx < 640; tx += 160) {
+					frame.Dirty.push_back(makeRect(400 + tx, 300 + ty, 160, 120));
+				}
+			}
+		}
+		frames.push_back(frame);
+	}
+}
+
+//
+// Check of the rect engine against naive references on random frames:
+//   MergeRects     : the merged rects lie in the frame and cover every pixel of the clipped input rects
+//   ApplyMoves     : per pixel copy from a copy of the frame taken before each move (overlapping moves)
+//   ApplyDirtyRects: the updated frame equals the new desktop image, which is the old one
+//                    with the moves applied and new pixels under the dirty rects
+//
+static LONG randomRange(UINT *pSeed, LONG lo, LONG hi)
+{
+	*pSeed = *pSeed * 1664525u + 1013904223u;
+	return lo + (LONG)((*pSeed >> 8) % (UINT)(hi - lo + 1));
+}
+
+static void checkDirtyRects()
+{
+	const INT sizes[][2] = { { 1, 1 }, { 7, 5 }, { 67, 45 }, { 200, 113 }, { 333, 190 } };
+	const INT iterations = 200;
+	UINT cases = 0, mismatches[3] = { 0, 0, 0 };
+	UINT seed = 60;
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width  = sizes[s][0];
+		const INT height = sizes[s][1];
+		const INT pitch  = width * 4;
+
+		for (INT it = 0; it < iterations; ++it)
+		{
+			std::vector<UINT> frame((size_t)width * height);
+			fillRandom(frame, seed++);
+
+			// random moves: scroll like small offsets (overlapping) and far ones, partly outside the frame
+			std::vector<tagFrameMoveRect> moves((size_t)randomRange(&seed, 0, 3));
+			for (size_t m = 0; m < moves.size(); ++m)
+			{
+				const LONG w = randomRange(&seed, 0, width), h = randomRange(&seed, 0, height);
+				moves[m].Dst  = makeRect(randomRange(&seed, -2, width), randomRange(&seed, -2, height), w, h);
+				const BOOL bNear = randomRange(&seed, 0, 1) != 0;
+				moves[m].SrcX = moves[m].Dst.Left + (bNear ? randomRange(&seed, -3, 3) : randomRange(&seed, -width, width));
+				moves[m].SrcY = moves[m].Dst.Top + (bNear ? randomRange(&seed, -3, 3) : randomRange(&seed, -height, height));
+			}
+
+			// random dirty rects, some empty or outside the frame
+			std::vector<tagFrameRect> dirty((size_t)randomRange(&seed, 0, 12));
+			for (size_t d = 0; d < dirty.size(); ++d) {
+				dirty[d] = makeRect(randomRange(&seed, -4, width + 2), randomRange(&seed, -4, height + 2),
+					randomRange(&seed, 0, width / 3 + 2), randomRange(&seed, 0, height / 3 + 2));
+			}
+
+			// reference moves: every pixel from a copy of the frame before the move
+			std::vector<UINT> moved(frame);
+			UINT64 refMovedBytes = 0;
+			for (size_t m = 0; m < moves.size(); ++m)
+			{
+				const std::vector<UINT> before(moved);
+				const tagFrameMoveRect &mv = moves[m];
+				for (LONG y = mv.Dst.Top; y < mv.Dst.Bottom; ++y)
+				{
+					for (LONG x = mv.Dst.Left; x < mv.Dst.Right; ++x)
+					{
+						const LONG sx = mv.SrcX + (x - mv.Dst.Left), sy = mv.SrcY + (y - mv.Dst.Top);
+						if ((x >= 0) && (y >= 0) && (x < width) && (y < height) && (sx >= 0) && (sy >= 0) && (sx < width) && (sy < height))
+						{
+							moved[(size_t)y * width + x] = before[(size_t)sy * width + sx];
+							refMovedBytes += 4;
+						}
+					}
+				}
+			}
+
+			// the new desktop image and the pixels the dirty rects cover
+			std::vector<UINT> desktop(moved);
+			std::vector<BYTE> covered((size_t)width * height, 0);
+			UINT newPixel = seed;
+			for (size_t d = 0; d < dirty.size(); ++d)
+			{
+				for (LONG y = std::max((LONG)0, dirty[d].Top); y < std::min((LONG)height, dirty[d].Bottom); ++y)
+				{
+					for (LONG x = std::max((LONG)0, dirty[d].Left); x < std::min((LONG)width, dirty[d].Right); ++x)
+					{
+						newPixel = newPixel * 1664525u + 1013904223u;
+						desktop[(size_t)y * width + x] = newPixel;
+						covered[(size_t)y * width + x] = 1;
+					}
+				}
+			}
+
+			std::vector<tagFrameRect> merged(dirty);
+			const UINT count = merged.empty() ? 0 : DXGICaptureDirtyRects::MergeRects(&merged[0], (UINT)merged.size(), width, height);
+			BOOL bMergeOk = (count <= dirty.size());
+			std::vector<BYTE> mergedCover((size_t)width * height, 0);
+			for (UINT i = 0; bMergeOk && (i < count); ++i)
+			{
+				const tagFrameRect &rc = merged[i];
+				bMergeOk = !DXGICaptureDirtyRects::IsRectEmpty(rc) && (rc.Left >= 0) && (rc.Top >= 0) && (rc.Right <= width) && (rc.Bottom <= height);
+				for (LONG y = rc.Top; bMergeOk && (y < rc.Bottom); ++y) {
+					for (LONG x = rc.Left; x < rc.Right; ++x) {
+						mergedCover[(size_t)y * width + x] = 1;
+					}
+				}
+			}
+			for (size_t i = 0; bMergeOk && (i < covered.size()); ++i) {
+				bMergeOk = !covered[i] || mergedCover[i];
+			}
+
+			const UINT64 movedBytes = moves.empty() ? 0 : DXGICaptureDirtyRects::ApplyMoves((BYTE*)frame.data(), pitch, width, height, &moves[0], (UINT)moves.size());
+			const BOOL bMoveOk = (frame == moved) && (movedBytes == refMovedBytes);
+
+			if (count > 0) {
+				DXGICaptureDirtyRects::ApplyDirtyRects((BYTE*)frame.data(), pitch, (const BYTE*)desktop.data(), pitch, &merged[0], count);
+			}
+			const BOOL bUpdateOk = (frame == desktop);
+
+			++cases;
+			if (!bMergeOk || !bMoveOk || !bUpdateOk)
+			{
+				mismatches[0] += bMergeOk ? 0 : 1;
+				mismatches[1] += bMoveOk ? 0 : 1;
+				mismatches[2] += bUpdateOk ? 0 : 1;
+				printf("dirty    mismatch: %dx%d case %d, %u moves, %u dirty rects:%s%s%s\n", width, height, it, (UINT)moves.size(), (UINT)dirty.size(),
+					bMergeOk ? "" : " merge", bMoveOk ? "" : " moves", bUpdateOk ? "" : " update");
+			}
+		}
+	}
+
+	const UINT total = mismatches[0] + mismatches[1] + mismatches[2];
+	g_CheckFailures += total;
+	printf("dirty    check: %u cases, %u merge, %u move, %u update mismatches %s\n", cases, mismatches[0], mismatches[1], mismatches[2],
+		(total == 0) ? "ok" : "MISMATCH");
+}
+
+static void benchDirtyRects()
+{
+	checkDirtyRects();
+
+	const INT width = 1920, height = 1080, pitch = width * 4, frames = 200;
+	const char *workloads[] = { "typing", "scroll", "video" };
+
+	std::vector<UINT> desktop((size_t)width * height);
+	std::vector<UINT> frame((size_t)width * height);
+	fillRandom(desktop, 30);
+
+	for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w)
+	{
+		std::vector<tagBenchRectFrame> stream;
+		makeRectStream(workloads[w], stream, frames);
+
+		double ns = benchRun([&]() {
+			for (size_t f = 0; f < stream.size(); ++f) {
+				memcpy(frame.data(), desktop.data(), (size_t)pitch * height);
+			}
+		});
+		recordResult("dirty", workloads[w], width, height, "full-copy", ns / frames);
+		printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns/frame %6.2f%% bytes\n", "dirty", workloads[w], width, height, "full-copy", ns / frames, 100.0);
+
+		UINT64 bytesTouched = 0;
+		ns = benchRun([&]() {
+			bytesTouched = 0;
+			std::vector<tagFrameRect> dirty;
+			for (size_t f = 0; f < stream.size(); ++f)
+			{
+				const tagBenchRectFrame &rects = stream[f];
+				dirty = rects.Dirty;
+				UINT count = DXGICaptureDirtyRects::MergeRects(dirty.data(), (UINT)dirty.size(), width, height);
+				bytesTouched += DXGICaptureDirtyRects::ApplyMoves((BYTE*)frame.data(), pitch, width, height, rects.Moves.data(), (UINT)rects.Moves.size());
+				bytesTouched += DXGICaptureDirtyRects::ApplyDirtyRects((BYTE*)frame.data(), pitch, (const BYTE*)desktop.data(), pitch, dirty.data(), count);
+			}
+		});
+		recordResult("dirty", workloads[w], width, height, "incremental", ns / frames);
+		printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns/frame %6.2f%% bytes\n", "dirty", workloads[w], width, height, "incremental", ns / frames,
+			bytesTouched * 100.0 / ((double)pitch * height * frames));
+	}
+}
+
+//
+// The former in-place cycle following rotation of ProcessMouseMask (-90 degree)
+//
+static void legacyRotateInPlace(UINT *InitBuffer32, UINT width, UINT height)
+{
+	for (UINT i = 0; i < width; i++)
+	{
+		for (UINT j = 0; j < height; j++)
+		{
+			UINT I = j;
+			UINT J = width - 1 - i;
+			while ((i*height + j) > (I*width + J))
+			{
+				UINT p = I*width + J;
+				UINT tmp_i = p / height;
+				UINT tmp_j = p % height;
+				I = tmp_j;
+				J = width - 1 - tmp_i;
+			}
+			std::swap(*(InitBuffer32 + (i*height + j)), *(InitBuffer32 + (I*width + J)));
+		}
+	}
+}
+
+//
+// Every SIMD level against the scalar rotation (90, 180, 270) on odd sizes and
+// padded pitches; the scalar result is checked against the mapping per pixel.
+//
+static void checkRotate()
+{
+	const INT sizes[][2] = { { 1, 1 }, { 3, 7 }, { 5, 4 }, { 17, 9 }, { 33, 65 }, { 67, 31 }, { 129, 127 }, { 1023, 577 } };
+	const INT degrees[] = { 90, 180, 270 };
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+	UINT cases = 0, mismatches = 0;
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width  = sizes[s][0];
+		const INT height = sizes[s][1];
+		const INT srcPitch = width + 3;
+		std::vector<UINT> src((size_t)srcPitch * height);
+		fillRandom(src, 50 + (UINT)s);
+
+		for (size_t d = 0; d < sizeof(degrees) / sizeof(degrees[0]); ++d)
+		{
+			INT dstWidth, dstHeight;
+			DXGICaptureRotate::GetRotatedSize(width, height, degrees[d], &dstWidth, &dstHeight);
+			const INT dstPitch = dstWidth + 5;
+
+			std::vector<UINT> ref((size_t)dstPitch * dstHeight, 0xA5A5A5A5);
+			DXGICaptureRotate::Rotate((const BYTE*)src.data(), srcPitch * 4, width, height, (BYTE*)ref.data(), dstPitch * 4, degrees[d], tagSimdLevel_Scalar);
+
+			BOOL bSame = TRUE;
+			for (INT y = 0; bSame && (y < height); ++y)
+			{
+				for (INT x = 0; x < width; ++x)
+				{
+					INT dx = x, dy = y;
+					switch (degrees[d])
+					{
+					case 90:  dx = height - 1 - y; dy = x; break;
+					case 180: dx = width - 1 - x;  dy = height - 1 - y; break;
+					default:  dx = y;              dy = width - 1 - x; break;
+					}
+					if (ref[(size_t)dy * dstPitch + dx] != src[(size_t)y * srcPitch + x])
+					{
+						bSame = FALSE;
+						break;
+					}
+				}
+			}
+			++cases;
+			if (!bSame)
+			{
+				++mismatches;
+				printf("rotate   mismatch: %dx%d rot %d scalar\n", width, height, degrees[d]);
+			}
+
+			for (size_t l = 0; l < levels.size(); ++l)
+			{
+				if (levels[l] == tagSimdLevel_Scalar) {
+					continue;
+				}
+				std::vector<UINT> dst((size_t)dstPitch * dstHeight, 0xA5A5A5A5);
+				DXGICaptureRotate::Rotate((const BYTE*)src.data(), srcPitch * 4, width, height, (BYTE*)dst.data(), dstPitch * 4, degrees[d], levels[l]);
+				++cases;
+				if (dst != ref)
+				{
+					++mismatches;
+					printf("rotate   mismatch: %dx%d rot %d %s\n", width, height, degrees[d], simdLevelName(levels[l]));
+				}
+			}
+		}
+	}
+	g_CheckFailures += mismatches;
+	printf("rotate   check: %u cases, %u mismatches %s\n", cases, mismatches, (mismatches == 0) ? "ok" : "MISMATCH");
+}
+
+static void benchRotate()
+{
+	checkRotate();
+
+	const INT sizes[][2] = { { 32, 32 }, { 64, 64 }, { 256, 256 }, { 3840, 2160 } };
+	const INT degrees[] = { 90, 180, 270 };
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		INT width  = sizes[s][0];
+		INT height = sizes[s][1];
+		std::vector<UINT> src((size_t)width * height);
+		std::vector<UINT> dst((size_t)width * height);
+		fillRandom(src, 3);
+
+		if (width <= 256)
+		{
+			double ns = benchRun([&]() {
+				legacyRotateInPlace(src.data(), (UINT)width, (UINT)height);
+			});
+			printResult("rotate", "legacy-inplace-270", width, height, "scalar", ns);
+		}
+
+		for (size_t d = 0; d < sizeof(degrees) / sizeof(degrees[0]); ++d)
+		{
+			INT dstWidth, dstHeight;
+			DXGICaptureRotate::GetRotatedSize(width, height, degrees[d], &dstWidth, &dstHeight);
+
+			for (size_t l = 0; l < levels.size(); ++l)
+			{
+				tagSimdLevel level = levels[l];
+				double ns = benchRun([&]() {
+					DXGICaptureRotate::Rotate((const BYTE*)src.data(), width * 4, width, height, (BYTE*)dst.data(), dstWidth * 4, degrees[d], level);
+				});
+
+				char name[32];
+				sprintf(name, "tiled-%d", degrees[d]);
+				printResult("rotate", name, width, height, simdLevelName(level), ns);
+			}
+		}
+	}
+}
+
+//
+// Output renderer: the single pass right angle renderer against the generic
+// affine one. Golden check: both must be pixel-identical for every size mode,
+// rotation mode and display rotation.
+//
+static void benchRender()
+{
+	const INT goldenSizes[][4] = { { 37, 21, 16, 9 }, { 640, 480, 1000, 333 }, { 1920, 1080, 1280, 720 }, { 1366, 768, 1081, 1921 } };
+	const INT modes[] = { tagFrameSizeMode_Normal, tagFrameSizeMode_StretchImage, tagFrameSizeMode_AutoSize, tagFrameSizeMode_CenterImage, tagFrameSizeMode_Zoom };
+	const INT rotations[] = { tagFrameRotationMode_Auto, tagFrameRotationMode_Identity, tagFrameRotationMode_90, tagFrameRotationMode_180, tagFrameRotationMode_270 };
+	UINT cases = 0, mismatches = 0;
+
+	for (size_t s = 0; s < sizeof(goldenSizes) / sizeof(goldenSizes[0]); ++s)
+	{
+		for (INT display = 0; display < 360; display += 90)
+		{
+			for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+			{
+				for (size_t r = 0; r < sizeof(rotations) / sizeof(rotations[0]); ++r)
+				{
+					tagFrameGeometry geometry;
+					memset(&geometry, 0, sizeof(geometry));
+					geometry.RotationMode      = (tagFrameRotationMode)rotations[r];
+					geometry.SizeMode          = (tagFrameSizeMode)modes[m];
+					geometry.OutputSize.Width  = goldenSizes[s][2];
+					geometry.OutputSize.Height = goldenSizes[s][3];
+					geometry.ScaleX            = 1.0f;
+					geometry.ScaleY            = 1.0f;
+					DXGICaptureRender::CalculateGeometry(goldenSizes[s][0], goldenSizes[s][1], display, &geometry);
+
+					const INT width  = geometry.SrcBounds.Width;
+					const INT height = geometry.SrcBounds.Height;
+					std::vector<UINT> src((size_t)width * height);
+					fillRandom(src, (UINT)(s + 7));
+
+					const INT outWidth  = geometry.OutputSize.Width;
+					const INT outHeight = geometry.OutputSize.Height;
+					std::vector<UINT> ref((size_t)outWidth * outHeight, 0x12345678);
+					std::vector<UINT> dst((size_t)outWidth * outHeight, 0x87654321);
+					DXGICaptureRender::RenderAffine((const BYTE*)src.data(), width * 4, width, height, &geometry, (BYTE*)ref.data(), outWidth * 4);
+					DXGICaptureRender::Render((const BYTE*)src.data(), width * 4, width, height, &geometry, (BYTE*)dst.data(), outWidth * 4);
+
+					++cases;
+					if (dst != ref)
+					{
+						++mismatches;
+						printf("render   golden mismatch: %dx%d display %d, size mode %d, rotation mode %d -> %dx%d\n",
+							width, height, display, modes[m], rotations[r], outWidth, outHeight);
+					}
+				}
+			}
+		}
+	}
+	g_CheckFailures += mismatches;
+	printf("render   golden: %u cases, %u mismatches\n", cases, mismatches);
+
+	// 4K desktop: unscaled (AutoSize) and letterboxed (Zoom 1280x720) outputs
+	const INT width = 3840, height = 2160;
+	std::vector<UINT> src((size_t)width * height);
+	fillRandom(src, 9);
+
+	for (INT m = 0; m < 2; ++m)
+	{
+		for (size_t r = 1; r < sizeof(rotations) / sizeof(rotations[0]); ++r)
+		{
+			tagFrameGeometry geometry;
+			memset(&geometry, 0, sizeof(geometry));
+			geometry.RotationMode      = (tagFrameRotationMode)rotations[r];
+			geometry.SizeMode          = (m == 0) ? tagFrameSizeMode_AutoSize : tagFrameSizeMode_Zoom;
+			geometry.OutputSize.Width  = 1280;
+			geometry.OutputSize.Height = 720;
+			geometry.ScaleX            = 1.0f;
+			geometry.ScaleY            = 1.0f;
+			DXGICaptureRender::CalculateGeometry(width, height, 0, &geometry);
+
+			const INT outWidth  = geometry.OutputSize.Width;
+			const INT outHeight = geometry.OutputSize.Height;
+			std::vector<UINT> dst((size_t)outWidth * outHeight);
+
+			char name[32];
+			sprintf(name, "%s-%d", (m == 0) ? "auto" : "zoom", (INT)geometry.RotationDegrees);
+
+			double ns = benchRun([&]() {
+				DXGICaptureRender::RenderAffine((const BYTE*)src.data(), width * 4, width, height, &geometry, (BYTE*)dst.data(), outWidth * 4);
+			});
+			printResult("render", name, width, height, "affine", ns);
+
+			ns = benchRun([&]() {
+				DXGICaptureRender::Render((const BYTE*)src.data(), width * 4, width, height, &geometry, (BYTE*)dst.data(), outWidth * 4);
+			});
+			printResult("render", name, width, height, "fused", ns);
+		}
+	}
+}
+
+//
+// Stretch downscales: the cpu renderer (bilinear, the transform of the D2D1
+// path) against the scaler filters. The SIMD levels must match the scalar output.
+//
+static void benchScale()
+{
+	const INT sizes[][4] = { { 3840, 2160, 1280, 720 }, { 2560, 1440, 1920, 1080 } };
+	const tagFrameScaleFilter filters[] = { tagFrameScaleFilter_Nearest, tagFrameScaleFilter_Bilinear, tagFrameScaleFilter_Box };
+	const char *filterNames[] = { "nearest", "bilinear", "box" };
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		INT width  = sizes[s][0];
+		INT height = sizes[s][1];
+		std::vector<UINT> src((size_t)width * height);
+		fillRandom(src, 5);
+
+		tagFrameGeometry geometry;
+		memset(&geometry, 0, sizeof(geometry));
+		geometry.RotationMode      = tagFrameRotationMode_Auto;
+		geometry.SizeMode          = tagFrameSizeMode_StretchImage;
+		geometry.OutputSize.Width  = sizes[s][2];
+		geometry.OutputSize.Height = sizes[s][3];
+		geometry.ScaleX            = 1.0f;
+		geometry.ScaleY            = 1.0f;
+		DXGICaptureRender::CalculateGeometry(width, height, 0, &geometry);
+
+		const INT outWidth  = geometry.OutputSize.Width;
+		const INT outHeight = geometry.OutputSize.Height;
+		std::vector<UINT> dst((size_t)outWidth * outHeight);
+		std::vector<UINT> ref((size_t)outWidth * outHeight);
+
+		double ns = benchRun([&]() {
+			DXGICaptureRender::Render((const BYTE*)src.data(), width * 4, width, height, &geometry, (BYTE*)dst.data(), outWidth * 4);
+		});
+		char name[32];
+		sprintf(name, "render-%dx%d", outWidth, outHeight);
+		printResult("scale", name, width, height, "scalar", ns);
+
+		for (size_t f = 0; f < sizeof(filters) / sizeof(filters[0]); ++f)
+		{
+			CDXGICaptureScaler scaler;
+			if (FAILED(scaler.SetConfig(&geometry, width, height, filters[f]))) {
+				continue;
+			}
+			scaler.Scale((const BYTE*)src.data(), width * 4, (BYTE*)ref.data(), outWidth * 4, tagSimdLevel_Scalar);
+
+			for (size_t l = 0; l < levels.size(); ++l)
+			{
+				tagSimdLevel level = levels[l];
+				ns = benchRun([&]() {
+					scaler.Scale((const BYTE*)src.data(), width * 4, (BYTE*)dst.data(), outWidth * 4, level);
+				});
+
+				if (scaler.GetFactor() > 0) {
+					sprintf(name, "%s-%dx", filterNames[f], scaler.GetFactor());
+				}
+				else {
+					sprintf(name, "%s-%dx%d", filterNames[f], outWidth, outHeight);
+				}
+				printResult("scale", name, width, height, simdLevelName(level), ns);
+
+				if (dst != ref) {
+					printf("scale    %s %s: output differs from the scalar version\n", name, simdLevelName(level));
+				}
+			}
+		}
+	}
+}
+
+//
+// Staging device without a gpu: a virtual clock (usec), the copies are executed
+// one after the other and take copyUsec each, mapping an unfinished slot waits
+// (stalls) until its copy is done. Every slot remembers which frame it holds.
+//
+class CMockStagingDevice : public IDXGICaptureStagingDevice
+{
+public:
+	INT64  Now;
+	INT64  CopyUsec;
+	INT64  GpuFreeTime;
+	INT64  StallUsec;
+	UINT64 SourceFrame;     // frame number of the acquired image
+	BOOL   SourceHeld;
+	BOOL   Error;
+	INT64  SlotDone[DXGICAPTURE_STAGING_MAX_DEPTH];
+	UINT64 SlotFrame[DXGICAPTURE_STAGING_MAX_DEPTH];
+	BOOL   SlotMapped[DXGICAPTURE_STAGING_MAX_DEPTH];
+
+	CMockStagingDevice(INT64 copyUsec)
+		: Now(0), CopyUsec(copyUsec), GpuFreeTime(0), StallUsec(0), SourceFrame(0), SourceHeld(FALSE), Error(FALSE)
+	{
+		memset(SlotDone, 0, sizeof(SlotDone));
+		memset(SlotFrame, 0, sizeof(SlotFrame));
+		memset(SlotMapped, 0, sizeof(SlotMapped));
+	}
+
+	virtual HRESULT CopyToSlot(UINT uiSlot)
+	{
+		if (!SourceHeld || SlotMapped[uiSlot]) {
+			Error = TRUE;
+		}
+		INT64 start = (GpuFreeTime > Now) ? GpuFreeTime : Now;
+		GpuFreeTime = start + CopyUsec;
+		SlotDone[uiSlot]  = GpuFreeTime;
+		SlotFrame[uiSlot] = SourceFrame;
+		return S_OK;
+	}
+
+	virtual HRESULT ReleaseSource()
+	{
+		SourceHeld = FALSE;
+		return S_OK;
+	}
+
+	virtual HRESULT IsSlotReady(UINT uiSlot)
+	{
+		return (Now >= SlotDone[uiSlot]) ? S_OK : S_FALSE;
+	}
+
+	virtual HRESULT MapSlot(UINT uiSlot, BYTE **ppData, INT *pPitch)
+	{
+		if (Now < SlotDone[uiSlot])
+		{
+			StallUsec += SlotDone[uiSlot] - Now;
+			Now = SlotDone[uiSlot];
+		}
+		SlotMapped[uiSlot] = TRUE;
+		*ppData = (BYTE*)&SlotFrame[uiSlot];
+		*pPitch = (INT)sizeof(UINT64);
+		return S_OK;
+	}
+
+	virtual HRESULT UnmapSlot(UINT uiSlot)
+	{
+		SlotMapped[uiSlot] = FALSE;
+		return S_OK;
+	}
+};
+
+//
+// Replays a 60 fps capture through the ring like CDXGICapture::renderStagedFrame:
+// submit every new image, process the oldest slot when the ring is full, drain at the end.
+// Checks the retrieve order, the slot contents and the ring depth.
+//
+static void benchStagingRing()
+{
+	const INT frames = 600;
+	const INT64 frameUsec = 16667;
+	const INT64 copyUsecs[] = { 2000, 6000 };   // readback of ~1080p and ~4K
+	const INT64 processUsec = 5000;             // mouse, bitmap update and encode
+
+	for (size_t c = 0; c < sizeof(copyUsecs) / sizeof(copyUsecs[0]); ++c)
+	{
+		for (UINT depth = DXGICAPTURE_STAGING_MIN_DEPTH; depth <= DXGICAPTURE_STAGING_MAX_DEPTH; ++depth)
+		{
+			CMockStagingDevice device(copyUsecs[c]);
+			CDXGICaptureStagingRing ring;
+			ring.Initialize(&device, depth);
+
+			BOOL bOrderOk = TRUE;
+			UINT64 ullExpected = 1;
+			INT64 llBusyUsec = 0;
+
+			for (INT f = 0; f <= frames; ++f)
+			{
+				BOOL bDrain = (f == frames);
+				if (!bDrain)
+				{
+					if (device.Now < f * frameUsec) {
+						device.Now = f * frameUsec;
+					}
+					device.SourceFrame = (UINT64)f + 1;
+					device.SourceHeld  = TRUE;
+					if (FAILED(ring.Submit(device.SourceFrame, device.Now, nullptr)) || device.SourceHeld) {
+						bOrderOk = FALSE;
+					}
+				}
+
+				while (ring.IsFull() || (bDrain && !ring.IsEmpty()))
+				{
+					INT64 llStart = device.Now;
+					tagStagingFrame frame;
+					if (ring.MapOldest(device.Now, &frame) != S_OK) {
+						bOrderOk = FALSE;
+						break;
+					}
+					if ((frame.FrameNumber != ullExpected) || (*(const UINT64*)frame.Data != frame.FrameNumber)) {
+						bOrderOk = FALSE;
+					}
+					ullExpected++;
+					device.Now += processUsec;
+					ring.UnmapOldest(&frame);
+					llBusyUsec += device.Now - llStart;
+				}
+			}
+
+			tagStagingRingStats stats;
+			ring.GetStats(&stats);
+			bOrderOk = bOrderOk && !device.Error && (ullExpected == (UINT64)frames + 1) &&
+				(stats.Retrieved == (UINT64)frames) && (stats.MaxInFlight <= depth);
+
+			char name[32];
+			sprintf(name, "copy-%lldus", (long long)copyUsecs[c]);
+			printf("%-8s %-18s depth %u  stall %7.1f us/frame  busy %7.1f us/frame  latency %.2f frames %6.2f ms  stalls %4llu  in-flight %u  %s\n",
+				"ring", name, depth,
+				device.StallUsec / (double)frames,
+				llBusyUsec / (double)frames,
+				stats.TotalLatencyFrames / (double)stats.Retrieved,
+				stats.TotalLatencyUsec / (double)stats.Retrieved / 1000.0,
+				(unsigned long long)stats.Stalls, stats.MaxInFlight,
+				bOrderOk ? "order ok" : "ORDER FAILED");
+		}
+	}
+
+	// cost of the scheduling itself
+	for (UINT depth = DXGICAPTURE_STAGING_MIN_DEPTH; depth <= DXGICAPTURE_STAGING_MAX_DEPTH; ++depth)
+	{
+		CMockStagingDevice device(0);
+		CDXGICaptureStagingRing ring;
+		ring.Initialize(&device, depth);
+		double ns = benchRun([&]() {
+			device.SourceHeld = TRUE;
+			ring.Submit(device.SourceFrame++, 0, nullptr);
+			if (ring.IsFull())
+			{
+				tagStagingFrame frame;
+				ring.MapOldest(0, &frame);
+				ring.UnmapOldest(&frame);
+			}
+		});
+		char variant[16];
+		sprintf(variant, "depth-%u", depth);
+		recordResult("ring", "scheduler", 0, 0, variant, ns);
+		printf("%-8s %-18s depth %u  %10.1f ns/frame\n", "ring", "scheduler", depth, ns);
+	}
+}
+
+//
+// Desktop like image: gradient background, windows with title bars, text lines and a photo
+//
+static void fillScreenContent(std::vector<BYTE> &image, INT width, INT height, UINT seed)
+{
+	image.resize((size_t)width * height * 4);
+	UINT *pPixels = (UINT*)image.data();
+	for (INT y = 0; y < height; ++y)
+	{
+		for (INT x = 0; x < width; ++x) {
+			pPixels[(size_t)y * width + x] = 0xFF000000u | ((UINT)(40 + y * 80 / height) << 16) | ((UINT)(60 + x * 60 / width) << 8) | 0x90;
+		}
+	}
+
+	for (INT w = 0; w < 12; ++w)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		INT ww = width / 6 + (INT)(seed % (UINT)(width / 4));
+		INT wh = height / 4 + (INT)((seed >> 8) % (UINT)(height / 3));
+		INT wx = (INT)((seed >> 4) % (UINT)(width - ww));
+		INT wy = (INT)((seed >> 12) % (UINT)(height - wh));
+		BOOL bPhoto = ((w % 4) == 3);
+		for (INT y = wy; y < wy + wh; ++y)
+		{
+			UINT *pRow = pPixels + (size_t)y * width;
+			for (INT x = wx; x < wx + ww; ++x)
+			{
+				INT cx = x - wx;
+				INT cy = y - wy;
+				UINT c = 0xFFF3F3F3u;
+				if (cy < 30) {
+					c = 0xFF2B579Au;                                    // title bar
+				}
+				else if (bPhoto)
+				{
+					UINT v = (UINT)(cx * 7 + cy * 13) ^ ((UINT)(cx * cy) >> 6);
+					v = (v * 2654435761u) >> 28;                        // texture
+					c = 0xFF000000u | (((cx + v * 4) & 0xFF) << 16) | (((cy + v * 3) & 0xFF) << 8) | ((cx ^ cy) & 0xFF);
+				}
+				else if (((cy - 40) % 20 < 12) && (cx > 10) && (cx < ww - 10))
+				{
+					// text line: glyphs of 8 pixels with a pseudo random pattern
+					UINT g = (UINT)(cx / 8) * 31u + (UINT)(cy / 20) * 17u + seed;
+					UINT bits = (g * 2654435761u) >> ((cx + cy) % 24);
+					if (bits & 1) {
+						c = 0xFF202020u;
+					}
+				}
+				pRow[x] = c;
+			}
+		}
+	}
+}
+
+//
+// Strip encoders from 1 to maxThreads threads, every thread count has to produce the same output
+//
+static void benchEncode(UINT maxThreads)
+{
+	static const struct { tagStripImageFormat format; const char *name; } s_formats[] = {
+		{ tagStripImageFormat_Png,  "png" },
+		{ tagStripImageFormat_Jpeg, "jpeg" },
+		{ tagStripImageFormat_Tiff, "tiff" },
+	};
+	const INT sizes[][2] = { { 1920, 1080 }, { 7680, 2160 } };
+
+	std::vector<UINT> threads;
+	for (UINT t = 1; t < maxThreads; t *= 2) {
+		threads.push_back(t);
+	}
+	threads.push_back(maxThreads);
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width = sizes[s][0];
+		const INT height = sizes[s][1];
+		std::vector<BYTE> image;
+		fillScreenContent(image, width, height, 7);
+
+		for (size_t f = 0; f < sizeof(s_formats) / sizeof(s_formats[0]); ++f)
+		{
+			tagFrameBufferInfo reference;
+			memset(&reference, 0, sizeof(reference));
+			UINT referenceSize = 0;
+			double singleNs = 0.0;
+
+			for (size_t t = 0; t < threads.size(); ++t)
+			{
+				tagFrameBufferInfo output;
+				memset(&output, 0, sizeof(output));
+				UINT size = 0;
+				HRESULT hr = S_OK;
+				double ns = benchRun([&]() {
+					hr = DXGICaptureStripEncoder::Encode(s_formats[f].format, image.data(), width * 4, width, height, threads[t], &output, &size);
+				});
+
+				BOOL bSame = TRUE;
+				if (t == 0)
+				{
+					DXGICaptureFrameBuffer::Resize(&reference, size);
+					memcpy(reference.Buffer, output.Buffer, size);
+					referenceSize = size;
+					singleNs = ns;
+				}
+				else {
+					bSame = (size == referenceSize) && (memcmp(output.Buffer, reference.Buffer, size) == 0);
+				}
+
+				char variant[32];
+				sprintf(variant, "%u-thread", threads[t]);
+				recordResult("encode", s_formats[f].name, width, height, variant, ns);
+				printf("%-8s %-18s %5dx%-5d %-10s %8.2f ms %8.1f MB/s  x%.2f  ratio %5.2f  %s\n",
+					"encode", s_formats[f].name, width, height, variant, ns / 1000000.0,
+					((double)width * height * 4) / ns * 1000.0,
+					singleNs / ns,
+					(size > 0) ? ((double)width * height * 4) / size : 0.0,
+					FAILED(hr) ? "FAILED" : (bSame ? "same output" : "OUTPUT DIFFERS"));
+
+				DXGICaptureFrameBuffer::Free(&output);
+			}
+			DXGICaptureFrameBuffer::Free(&reference);
+		}
+	}
+}
+
+#if defined(_WIN32)
+//
+// WIC factory for the png encoder of CDXGICapture::SaveFrameToFile, nullptr if WIC is not available
+//
+static IWICImagingFactory* createWICFactory()
+{
+	IWICImagingFactory *pFactory = nullptr;
+	if (FAILED(CoInitializeEx(NULL, COINIT_MULTITHREADED)) ||
+		FAILED(CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&pFactory))))
+	{
+		return nullptr;
+	}
+	return pFactory;
+}
+#endif
+
+static void printCodecResult(const char *name, INT width, INT height, double ns, UINT size, const char *check)
+{
+	recordResult("qoi", name, width, height, "-", ns);
+	double bytes = (double)width * height * 4;
+	printf("%-8s %-18s %5dx%-5d %8.2f ms %8.1f MB/s  ratio %5.2f  %s\n",
+		"qoi", name, width, height, ns / 1000000.0, bytes / ns * 1000.0, (size > 0) ? bytes / size : 0.0, check);
+}
+
+//
+// QOI encode/decode against bmp, the strip png encoder and the WIC png encoder (Windows)
+//
+static void benchQoi()
+{
+	const INT sizes[][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 2160 } };
+
+#if defined(_WIN32)
+	IWICImagingFactory *pWICFactory = createWICFactory();
+#endif
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width = sizes[s][0];
+		const INT height = sizes[s][1];
+		std::vector<BYTE> image;
+		fillScreenContent(image, width, height, 11);
+
+		tagFrameBufferInfo output;
+		tagFrameBufferInfo decoded;
+		memset(&output, 0, sizeof(output));
+		memset(&decoded, 0, sizeof(decoded));
+		UINT size = 0;
+
+		double ns = benchRun([&]() {
+			DXGICaptureBmp::Encode(image.data(), width * 4, width, height, &output, &size);
+		});
+		printCodecResult("bmp", width, height, ns, size, "");
+
+		ns = benchRun([&]() {
+			DXGICaptureQoi::Encode(image.data(), width * 4, width, height, &output, &size);
+		});
+		const UINT qoiSize = size;
+		INT decodedWidth = 0;
+		INT decodedHeight = 0;
+		HRESULT hr = DXGICaptureQoi::Decode(output.Buffer, qoiSize, &decoded, &decodedWidth, &decodedHeight);
+		BOOL bSame = SUCCEEDED(hr) && (decodedWidth == width) && (decodedHeight == height) &&
+			(memcmp(decoded.Buffer, image.data(), image.size()) == 0);
+		printCodecResult("qoi-encode", width, height, ns, qoiSize, bSame ? "lossless" : "ROUNDTRIP FAILED");
+
+		ns = benchRun([&]() {
+			DXGICaptureQoi::Decode(output.Buffer, qoiSize, &decoded, &decodedWidth, &decodedHeight);
+		});
+		printCodecResult("qoi-decode", width, height, ns, qoiSize, "");
+
+		ns = benchRun([&]() {
+			DXGICaptureStripEncoder::Encode(tagStripImageFormat_Png, image.data(), width * 4, width, height, 1, &output, &size);
+		});
+		printCodecResult("png-strips-1", width, height, ns, size, "");
+
+		UINT threads = DXGICaptureParallel::GetThreadCount();
+		if (threads > 1)
+		{
+			ns = benchRun([&]() {
+				DXGICaptureStripEncoder::Encode(tagStripImageFormat_Png, image.data(), width * 4, width, height, threads, &output, &size);
+			});
+			char name[32];
+			sprintf(name, "png-strips-%u", threads);
+			printCodecResult(name, width, height, ns, size, "");
+		}
+
+#if defined(_WIN32)
+		if (nullptr != pWICFactory)
+		{
+			hr = S_OK;
+			ns = benchRun([&]() {
+				hr = DXGICaptureHelper::EncodeBufferToMemory(pWICFactory, image.data(), width, height, width * 4, GUID_ContainerFormatPng, &output, &size);
+			});
+			printCodecResult("png-wic", width, height, ns, size, FAILED(hr) ? "FAILED" : "");
+		}
+#endif
+
+		DXGICaptureFrameBuffer::Free(&output);
+		DXGICaptureFrameBuffer::Free(&decoded);
+	}
+
+#if defined(_WIN32)
+	if (nullptr != pWICFactory) {
+		pWICFactory->Release();
+	}
+#endif
+}
+
+//
+// Delta recording of synthetic desktop sessions: encode/decode throughput and
+// compression ratio per workload (keyframe every 60 frames or above 50% dirty)
+//
+static void benchDelta()
+{
+	typedef std::chrono::steady_clock clock_type;
+
+	static const struct
+	{
+		const char             *name;
+		tagSyntheticWorkload    workload;
+		INT                     changePercent;
+	} s_workloads[] = {
+		{ "idle",   tagSyntheticWorkload_Static, 0 },
+		{ "typing", tagSyntheticWorkload_Typing, 1 },
+		{ "scroll", tagSyntheticWorkload_Scroll, 3 },
+		{ "video",  tagSyntheticWorkload_Video,  20 },
+	};
+	const INT sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	const INT frames = 120;
+	const INT keyframeInterval = 60;
+
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width = sizes[s][0];
+		const INT height = sizes[s][1];
+		const INT pitch = width * 4;
+
+		for (size_t w = 0; w < sizeof(s_workloads) / sizeof(s_workloads[0]); ++w)
+		{
+			for (size_t l = 0; l < levels.size(); ++l)
+			{
+				tagSyntheticSourceConfig config;
+				memset(&config, 0, sizeof(config));
+				config.Width         = width;
+				config.Height        = height;
+				config.Workload      = s_workloads[w].workload;
+				config.ChangePercent = s_workloads[w].changePercent;
+				config.FrameRate     = 60;
+				config.Seed          = 5;
+				CDXGISyntheticSource source;
+				source.Initialize(&config);
+
+				std::vector<BYTE> previous((size_t)pitch * height);
+				std::vector<BYTE> decoded((size_t)pitch * height);
+				tagFrameBufferInfo encoded;
+				memset(&encoded, 0, sizeof(encoded));
+
+				double encodeNs = 0.0, decodeNs = 0.0;
+				UINT64 storedBytes = 0;
+				INT keyframes = 0;
+				BOOL bSame = TRUE;
+				for (INT i = 0; i < frames; ++i)
+				{
+					tagCaptureSourceFrame frame;
+					source.AcquireFrame(0, &frame);
+
+					UINT64 dirtyArea = 0;
+					for (UINT r = 0; r < frame.DirtyRectCount; ++r) {
+						dirtyArea += (UINT64)(frame.DirtyRects[r].Right - frame.DirtyRects[r].Left) * (frame.DirtyRects[r].Bottom - frame.DirtyRects[r].Top);
+					}
+					BOOL bKeyframe = ((i % keyframeInterval) == 0) || (dirtyArea * 2 > (UINT64)width * height);
+					keyframes += bKeyframe ? 1 : 0;
+
+					UINT size = 0;
+					clock_type::time_point t0 = clock_type::now();
+					if (!bKeyframe) {
+						DXGICaptureDirtyRects::ApplyMoves(&previous[0], pitch, width, height, frame.MoveRects, frame.MoveRectCount);
+					}
+					DXGICaptureDelta::Encode(frame.Data, frame.Pitch, bKeyframe ? nullptr : &previous[0], pitch, width, height, &encoded, &size, nullptr, levels[l]);
+					if (bKeyframe) {
+						memcpy(&previous[0], frame.Data, previous.size());
+					}
+					clock_type::time_point t1 = clock_type::now();
+					if (!bKeyframe) {
+						DXGICaptureDirtyRects::ApplyMoves(&decoded[0], pitch, width, height, frame.MoveRects, frame.MoveRectCount);
+					}
+					HRESULT hr = DXGICaptureDelta::Decode(encoded.Buffer, size, bKeyframe, &decoded[0], pitch, width, height);
+					clock_type::time_point t2 = clock_type::now();
+
+					encodeNs += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+					decodeNs += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+					storedBytes += size;
+					if (FAILED(hr) || (memcmp(&decoded[0], frame.Data, decoded.size()) != 0)) {
+						bSame = FALSE;
+					}
+					source.ReleaseFrame();
+				}
+				DXGICaptureFrameBuffer::Free(&encoded);
+
+				double rawBytes = (double)pitch * height * frames;
+				char name[64];
+				sprintf(name, "%s-encode", s_workloads[w].name);
+				recordResult("delta", name, width, height, simdLevelName(levels[l]), encodeNs / frames);
+				sprintf(name, "%s-decode", s_workloads[w].name);
+				recordResult("delta", name, width, height, simdLevelName(levels[l]), decodeNs / frames);
+				printf("%-8s %-18s %5dx%-5d %-10s encode %8.1f MB/s  decode %8.1f MB/s  ratio %8.2f  keyframes %3d  %s\n",
+					"delta", s_workloads[w].name, width, height, simdLevelName(levels[l]),
+					rawBytes / encodeNs * 1000.0, rawBytes / decodeNs * 1000.0, rawBytes / (double)storedBytes, keyframes,
+					bSame ? "lossless" : "ROUNDTRIP FAILED");
+			}
+		}
+	}
+}
+
+//
+// Tile hasher of the change map: throughput per simd level in frames per second,
+// every level has to produce the hashes of the scalar code and a single changed
+// pixel has to change exactly one tile
+//
+static void benchTileHash()
+{
+	const INT sizes[][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width = sizes[s][0];
+		const INT height = sizes[s][1];
+		const INT pitch = width * 4;
+		const double frameBytes = (double)pitch * height;
+
+		std::vector<BYTE> image;
+		fillScreenContent(image, width, height, 11);
+
+		CDXGITileHasher reference;
+		reference.Initialize(width, height);
+		reference.Update(&image[0], pitch, tagSimdLevel_Scalar);
+
+		for (size_t l = 0; l < levels.size(); ++l)
+		{
+			CDXGITileHasher hasher;
+			hasher.Initialize(width, height);
+			double ns = benchRun([&]() { hasher.Update(&image[0], pitch, levels[l]); });
+
+			// the pixel is restored for the next level
+			BYTE *pPixel = &image[((size_t)(height / 2) * width + width / 3) * 4];
+			*pPixel ^= 0x01;
+			HRESULT hr = hasher.Update(&image[0], pitch, levels[l]);
+			BOOL bOneTile = (hr == S_OK) && (hasher.GetChangedTileCount() == 1) &&
+				hasher.IsTileChanged((UINT)(width / 3) / DXGICAPTURE_TILE_SIZE, (UINT)(height / 2) / DXGICAPTURE_TILE_SIZE);
+			*pPixel ^= 0x01;
+			hr = hasher.Update(&image[0], pitch, levels[l]);
+			BOOL bSame = (hasher.GetFrameHash() == reference.GetFrameHash()) && bOneTile && (hasher.GetChangedTileCount() == 1);
+			hr = hasher.Update(&image[0], pitch, levels[l]);
+			bSame = bSame && (hr == S_FALSE);
+
+			recordResult("tilehash", "frame", width, height, simdLevelName(levels[l]), ns);
+			printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns %10.1f MB/s %8.1f fps  %s\n",
+				"tilehash", "frame", width, height, simdLevelName(levels[l]),
+				ns, frameBytes / ns * 1000.0, 1000000000.0 / ns, bSame ? "ok" : "MISMATCH");
+		}
+
+		// lower bound: compare with the previous frame
+		std::vector<BYTE> previous(image);
+		double ns = benchRun([&]() {
+			volatile int r = memcmp(&image[0], &previous[0], image.size());
+			(void)r;
+		});
+		recordResult("tilehash", "memcmp", width, height, "-", ns);
+		printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns %10.1f MB/s %8.1f fps\n",
+			"tilehash", "memcmp", width, height, "-", ns, frameBytes / ns * 1000.0, 1000000000.0 / ns);
+	}
+}
+
+static void benchCopy()
+{
+	const INT sizes[][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width = sizes[s][0];
+		const INT height = sizes[s][1];
+		const INT pitch = width * 4;
+		const double frameBytes = (double)pitch * height;
+
+		// the mapped staging texture has a padded pitch
+		const INT srcPitch = pitch + 256;
+		std::vector<UINT> pixels((size_t)srcPitch / 4 * height);
+		fillRandom(pixels, 21);
+		const BYTE *pSrc = (const BYTE*)&pixels[0];
+		std::vector<BYTE> dst((size_t)pitch * height);
+		std::vector<BYTE> reference((size_t)pitch * height);
+		for (INT y = 0; y < height; ++y) {
+			memcpy(&reference[(size_t)y * pitch], pSrc + (size_t)y * srcPitch, pitch);
+		}
+
+		double ns = benchRun([&]() {
+			for (INT y = 0; y < height; ++y) {
+				memcpy(&dst[(size_t)y * pitch], pSrc + (size_t)y * srcPitch, pitch);
+			}
+		});
+		recordResult("copy", "memcpy", width, height, "-", ns);
+		printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns %10.1f MB/s %8.1f fps\n",
+			"copy", "memcpy", width, height, "-", ns, frameBytes / ns * 1000.0, 1000000000.0 / ns);
+
+		for (size_t l = 0; l < levels.size(); ++l)
+		{
+			for (int opaque = 0; opaque < 2; ++opaque)
+			{
+				tagFrameCopyStats stats;
+				memset(&stats, 0, sizeof(stats));
+				ns = benchRun([&]() {
+					DXGICaptureCopy::CopyPixels(pSrc, srcPitch, &dst[0], pitch, width, height, opaque, levels[l], &stats);
+				});
+
+				BOOL bSame = TRUE;
+				for (size_t i = 0; bSame && (i < dst.size()); i += 4)
+				{
+					UINT a = *(const UINT*)&dst[i];
+					UINT b = *(const UINT*)&reference[i] | (opaque ? 0xFF000000 : 0);
+					bSame = (a == b);
+				}
+
+				recordResult("copy", opaque ? "opaque" : "pixels", width, height, simdLevelName(levels[l]), ns);
+				printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns %10.1f MB/s %8.1f fps  %s%s\n",
+					"copy", opaque ? "opaque" : "pixels", width, height, simdLevelName(levels[l]),
+					ns, frameBytes / ns * 1000.0, 1000000000.0 / ns,
+					(stats.BytesStreamed > 0) ? "streamed " : "", bSame ? "ok" : "MISMATCH");
+			}
+		}
+
+#if defined(DXGICAPTURE_HAVE_X86)
+		// the same copy with regular stores, for the gain of the non-temporal stores
+		ns = benchRun([&]() {
+			for (INT y = 0; y < height; ++y) {
+				DXGICaptureCopy::CopyRowSSE2(pSrc + (size_t)y * srcPitch, &dst[(size_t)y * pitch], width, FALSE, FALSE);
+			}
+		});
+		recordResult("copy", "cached stores", width, height, simdLevelName(tagSimdLevel_SSE2), ns);
+		printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns %10.1f MB/s %8.1f fps\n",
+			"copy", "cached stores", width, height, simdLevelName(tagSimdLevel_SSE2), ns, frameBytes / ns * 1000.0, 1000000000.0 / ns);
+#endif
+	}
+}
+
+// plain double precision conversion of the standard (Kr/Kb, offsets, 2x2 average)
+static void convertYuvReference(const BYTE *pSrc, INT pitch, const tagYuvImage *pImage, std::vector<double> &ref)
+{
+	const double kr = (pImage->Matrix == tagYuvMatrix_BT709) ? 0.2126 : 0.299;
+	const double kb = (pImage->Matrix == tagYuvMatrix_BT709) ? 0.0722 : 0.114;
+	const double kg = 1.0 - kr - kb;
+	const BOOL full = (pImage->Range == tagYuvRange_Full);
+	const double ys = full ? 1.0 : 219.0 / 255.0;
+	const double cs = full ? 1.0 : 224.0 / 255.0;
+	const double yo = full ? 0.0 : 16.0;
+	const INT w = pImage->Width;
+	const INT h = pImage->Height;
+	const INT cw = (w + 1) / 2;
+	const INT ch = (h + 1) / 2;
+
+	ref.assign((size_t)w * h + 2 * (size_t)cw * ch, 0.0);
+	for (INT y = 0; y < h; ++y)
+	{
+		for (INT x = 0; x < w; ++x)
+		{
+			const BYTE *p = pSrc + (size_t)y * pitch + (size_t)x * 4;
+			ref[(size_t)y * w + x] = yo + ys * (kr * p[2] + kg * p[1] + kb * p[0]);
+		}
+	}
+	for (INT y = 0; y < ch; ++y)
+	{
+		for (INT x = 0; x < cw; ++x)
+		{
+			double b = 0.0, g = 0.0, rr = 0.0;
+			for (INT dy = 0; dy < 2; ++dy)
+			{
+				for (INT dx = 0; dx < 2; ++dx)
+				{
+					INT sx = std::min(2 * x + dx, w - 1);
+					INT sy = std::min(2 * y + dy, h - 1);
+					const BYTE *p = pSrc + (size_t)sy * pitch + (size_t)sx * 4;
+					b += p[0] / 4.0;
+					g += p[1] / 4.0;
+					rr += p[2] / 4.0;
+				}
+			}
+			double luma = kr * rr + kg * g + kb * b;
+			ref[(size_t)w * h + (size_t)y * cw + x] = 128.0 + cs * 0.5 * (b - luma) / (1.0 - kb);
+			ref[(size_t)w * h + (size_t)cw * ch + (size_t)y * cw + x] = 128.0 + cs * 0.5 * (rr - luma) / (1.0 - kr);
+		}
+	}
+}
+
+// largest difference of the image to the reference, -1.0 if a sample of pCompare differs
+static double compareYuv(const tagYuvImage *pImage, const std::vector<double> &ref, const tagYuvImage *pCompare)
+{
+	const INT w = pImage->Width;
+	const INT h = pImage->Height;
+	const INT cw = (w + 1) / 2;
+	const INT ch = (h + 1) / 2;
+	const INT step = (pImage->Format == tagYuvFormat_NV12) ? 2 : 1;
+
+	double maxError = 0.0;
+	for (INT y = 0; y < h; ++y)
+	{
+		for (INT x = 0; x < w; ++x)
+		{
+			BYTE v = pImage->Planes[0][(size_t)y * pImage->Pitches[0] + x];
+			if ((nullptr != pCompare) && (v != pCompare->Planes[0][(size_t)y * pCompare->Pitches[0] + x])) {
+				return -1.0;
+			}
+			maxError = std::max(maxError, fabs(v - std::min(255.0, std::max(0.0, ref[(size_t)y * w + x]))));
+		}
+	}
+	for (INT y = 0; y < ch; ++y)
+	{
+		for (INT x = 0; x < cw; ++x)
+		{
+			for (INT c = 0; c < 2; ++c)
+			{
+				const BYTE *pPlane = (step == 2) ? (pImage->Planes[1] + c) : pImage->Planes[1 + c];
+				const BYTE *pOther = (nullptr == pCompare) ? nullptr : ((step == 2) ? (pCompare->Planes[1] + c) : pCompare->Planes[1 + c]);
+				size_t offset = (size_t)y * pImage->Pitches[1 + ((step == 2) ? 0 : c)] + (size_t)x * step;
+				if ((nullptr != pOther) && (pPlane[offset] != pOther[offset])) {
+					return -1.0;
+				}
+				double expected = ref[(size_t)w * h + (size_t)c * cw * ch + (size_t)y * cw + x];
+				maxError = std::max(maxError, fabs(pPlane[offset] - std::min(255.0, std::max(0.0, expected))));
+			}
+		}
+	}
+	return maxError;
+}
+
+static void benchYuv()
+{
+	static const char *s_pszFormats[] = { "none", "nv12", "i420" };
+	std::vector<tagSimdLevel> levels = availableSimdLevels();
+
+	// accuracy on random pixels with odd sizes (edge blocks), every variant against the
+	// double precision reference and bit-exact against the scalar code
+	{
+		const INT width = 1023;
+		const INT height = 577;
+		std::vector<UINT> pixels((size_t)width * height);
+		fillRandom(pixels, 31);
+		const BYTE *pSrc = (const BYTE*)&pixels[0];
+		const UINT size = DXGICaptureYuv::GetImageSize(tagYuvFormat_I420, width, height);
+		std::vector<BYTE> scalarBuffer(size);
+		std::vector<BYTE> buffer(size);
+		std::vector<double> ref;
+
+		for (UINT format = tagYuvFormat_NV12; format <= tagYuvFormat_I420; ++format)
+		{
+			for (UINT matrix = tagYuvMatrix_BT601; matrix <= tagYuvMatrix_BT709; ++matrix)
+			{
+				for (UINT range = tagYuvRange_Limited; range <= tagYuvRange_Full; ++range)
+				{
+					tagYuvImage scalarImage;
+					DXGICaptureYuv::SetupImage((tagYuvFormat)format, (tagYuvMatrix)matrix, (tagYuvRange)range, width, height, &scalarBuffer[0], size, &scalarImage);
+					DXGICaptureYuv::Convert(pSrc, width * 4, &scalarImage, tagSimdLevel_Scalar);
+					convertYuvReference(pSrc, width * 4, &scalarImage, ref);
+
+					for (size_t l = 0; l < levels.size(); ++l)
+					{
+						tagYuvImage image;
+						DXGICaptureYuv::SetupImage((tagYuvFormat)format, (tagYuvMatrix)matrix, (tagYuvRange)range, width, height, &buffer[0], size, &image);
+						DXGICaptureYuv::Convert(pSrc, width * 4, &image, levels[l]);
+						double maxError = compareYuv(&image, ref, &scalarImage);
+
+						char szName[64];
+						sprintf(szName, "%s %s %s", s_pszFormats[format], matrix ? "709" : "601", range ? "full" : "limited");
+						if (maxError < 0.0) {
+							printf("%-8s %-18s %5dx%-5d %-10s max error -    MISMATCH (scalar)\n", "yuv", szName, width, height, simdLevelName(levels[l]));
+						}
+						else {
+							printf("%-8s %-18s %5dx%-5d %-10s max error %.3f  %s\n", "yuv", szName, width, height, simdLevelName(levels[l]),
+								maxError, (maxError <= 1.0) ? "ok" : "INACCURATE");
+						}
+					}
+				}
+			}
+		}
+	}
+
+	const INT sizes[][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width = sizes[s][0];
+		const INT height = sizes[s][1];
+		const double frameBytes = (double)width * height * 4;
+
+		std::vector<BYTE> image;
+		fillScreenContent(image, width, height, 7);
+		std::vector<BYTE> buffer(DXGICaptureYuv::GetImageSize(tagYuvFormat_I420, width, height));
+
+		for (UINT format = tagYuvFormat_NV12; format <= tagYuvFormat_I420; ++format)
+		{
+			tagYuvImage yuv;
+			DXGICaptureYuv::SetupImage((tagYuvFormat)format, tagYuvMatrix_BT709, tagYuvRange_Limited, width, height, &buffer[0], (UINT)buffer.size(), &yuv);
+			for (size_t l = 0; l < levels.size(); ++l)
+			{
+				double ns = benchRun([&]() {
+					DXGICaptureYuv::Convert(&image[0], width * 4, &yuv, levels[l]);
+				});
+				recordResult("yuv", s_pszFormats[format], width, height, simdLevelName(levels[l]), ns);
+				printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns %10.1f MB/s %8.1f fps\n",
+					"yuv", s_pszFormats[format], width, height, simdLevelName(levels[l]), ns, frameBytes / ns * 1000.0, 1000000000.0 / ns);
+			}
+		}
+	}
+}
+
+struct tagBenchPointer
+{
+	const char *Name;
+	tagCapturePointer Pointer;
+	std::vector<UINT> Shape;
+};
+
+static void makeBenchPointer(UINT type, INT size, tagBenchPointer *pPointer)
+{
+	const INT height = (type == DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME) ? size * 2 : size;
+	const INT pitch  = (type == DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME) ? (size + 7) / 8 : size * 4;
+	pPointer->Shape.resize(((size_t)pitch * height + 3) / 4);
+	fillRandom(pPointer->Shape, 30 + type);
+
+	switch (type)
+	{
+	case DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME: pPointer->Name = "monochrome"; break;
+	case DXGICAPTURE_POINTER_SHAPE_TYPE_COLOR:      pPointer->Name = "color";      break;
+	default:                                        pPointer->Name = "masked";     break;
+	}
+
+	tagCapturePointer *p = &pPointer->Pointer;
+	memset(p, 0, sizeof(tagCapturePointer));
+	p->Visible   = TRUE;
+	p->Type      = type;
+	p->Width     = (UINT)size;
+	p->Height    = (UINT)height;
+	p->Pitch     = (UINT)pitch;
+	p->ShapeSize = (UINT)(pitch * height);
+	p->Shape     = (const BYTE*)pPointer->Shape.data();
+	p->ShapeHash = CDXGICursorCache::HashBytes(p->Shape, p->ShapeSize, 0);
+}
+
+//
+// Pointer clipping check: region frames draw the pointer on a surface of the region
+// size, which can be smaller than the pointer. Every shape type and rotation is drawn
+// across the edges of small surfaces that sit in a guard border, and compared with
+// the same drawing on a surface large enough to hold the whole pointer; the kept
+// background must restore the surface.
+//
+static void checkPointerClip()
+{
+	const UINT types[] = { DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME, DXGICAPTURE_POINTER_SHAPE_TYPE_COLOR, DXGICAPTURE_POINTER_SHAPE_TYPE_MASKED_COLOR };
+	const INT surfSizes[][2] = { { 1, 1 }, { 16, 16 }, { 37, 21 }, { 21, 37 }, { 100, 100 } };
+	const INT rotations[] = { 0, 90, 180, 270 };
+	const INT shapeSize = 32, guard = 8, margin = shapeSize + guard;
+	const UINT guardValue = 0xDEADBEEF;
+	UINT cases = 0, mismatches = 0;
+
+	for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+	{
+		tagBenchPointer pointer;
+		makeBenchPointer(types[t], shapeSize, &pointer);
+
+		for (size_t s = 0; s < sizeof(surfSizes) / sizeof(surfSizes[0]); ++s)
+		{
+			for (size_t r = 0; r < sizeof(rotations) / sizeof(rotations[0]); ++r)
+			{
+				// the surface is the desktop as acquired, the pointer is in desktop coordinates
+				const INT rotation    = rotations[r];
+				const INT surfWidth   = surfSizes[s][0];
+				const INT surfHeight  = surfSizes[s][1];
+				const BOOL bSwap      = (rotation == 90) || (rotation == 270);
+				const INT deskWidth   = bSwap ? surfHeight : surfWidth;
+				const INT deskHeight  = bSwap ? surfWidth : surfHeight;
+				const INT guardWidth  = surfWidth + 2 * guard;
+				const INT refWidth    = surfWidth + 2 * margin;
+				const INT refHeight   = surfHeight + 2 * margin;
+
+				std::vector<UINT> content((size_t)surfWidth * surfHeight);
+				fillRandom(content, 40 + (UINT)s);
+
+				CDXGICursorCache cache;
+				tagFrameBufferInfo rotateBuffer, background;
+				memset(&rotateBuffer, 0, sizeof(rotateBuffer));
+				memset(&background, 0, sizeof(background));
+
+				for (INT y = -shapeSize - 3; y <= deskHeight + 3; y += 3)
+				{
+					for (INT x = -shapeSize - 3; x <= deskWidth + 3; x += 3)
+					{
+						std::vector<UINT> surface((size_t)guardWidth * (surfHeight + 2 * guard), guardValue);
+						std::vector<UINT> ref((size_t)refWidth * refHeight, 0);
+						for (INT row = 0; row < surfHeight; ++row)
+						{
+							memcpy(&surface[(size_t)(row + guard) * guardWidth + guard], &content[(size_t)row * surfWidth], surfWidth * 4);
+							memcpy(&ref[(size_t)(row + margin) * refWidth + margin], &content[(size_t)row * surfWidth], surfWidth * 4);
+						}
+						BYTE *pSurface = (BYTE*)&surface[(size_t)guard * guardWidth + guard];
+
+						// the reference desktop is larger by the margin on every side, the pointer is never clipped
+						tagCapturePointer refPointer = pointer.Pointer;
+						refPointer.X = x + margin;
+						refPointer.Y = y + margin;
+						DXGICapturePointer::Draw(&refPointer, deskWidth + 2 * margin, deskHeight + 2 * margin, rotation, &cache, &rotateBuffer,
+							(BYTE*)&ref[0], refWidth * 4, refWidth, refHeight);
+
+						tagCapturePointer clipPointer = pointer.Pointer;
+						clipPointer.X = x;
+						clipPointer.Y = y;
+						HRESULT hr = DXGICapturePointer::Draw(&clipPointer, deskWidth, deskHeight, rotation, &cache, &rotateBuffer,
+							pSurface, guardWidth * 4, surfWidth, surfHeight, &background);
+
+						BOOL bSame = SUCCEEDED(hr);
+						for (INT row = 0; bSame && (row < surfHeight + 2 * guard); ++row)
+						{
+							for (INT col = 0; col < guardWidth; ++col)
+							{
+								const BOOL bInside = (row >= guard) && (row < guard + surfHeight) && (col >= guard) && (col < guard + surfWidth);
+								const UINT expected = bInside
+									? ref[(size_t)(row - guard + margin) * refWidth + (col - guard + margin)]
+									: guardValue;
+								if (surface[(size_t)row * guardWidth + col] != expected)
+								{
+									bSame = FALSE;
+									break;
+								}
+							}
+						}
+
+						// restoring the kept background gives the surface back
+						if (bSame && (hr == S_OK) && (background.Bounds.Width > 0))
+						{
+							tagFrameRect rcMouse = { background.Bounds.X, background.Bounds.Y,
+								background.Bounds.X + background.Bounds.Width, background.Bounds.Y + background.Bounds.Height };
+							DXGICaptureDirtyRects::CopyBackground(pSurface, guardWidth * 4, background.Buffer, rcMouse, FALSE);
+							for (INT row = 0; bSame && (row < surfHeight); ++row) {
+								bSame = memcmp(&surface[(size_t)(row + guard) * guardWidth + guard], &content[(size_t)row * surfWidth], surfWidth * 4) == 0;
+							}
+						}
+
+						++cases;
+						if (!bSame)
+						{
+							++mismatches;
+							printf("region   pointer clip mismatch: %s %dx%d rot %d at (%d, %d)\n",
+								pointer.Name, surfWidth, surfHeight, rotation, x, y);
+						}
+					}
+				}
+
+				DXGICaptureFrameBuffer::Free(&rotateBuffer);
+				DXGICaptureFrameBuffer::Free(&background);
+			}
+		}
+	}
+	g_CheckFailures += mismatches;
+	printf("region   pointer clip: %u cases, %u mismatches %s\n", cases, mismatches, (mismatches == 0) ? "ok" : "MISMATCH");
+}
+
+//
+// Source crop regions: full update and render of a region frame from one acquired
+// desktop image. The cost follows the region area, not the desktop size; the
+// batch rows cut the same total area into 4 regions of a single acquired frame.
+//
+static void benchRegion()
+{
+	checkPointerClip();
+
+	const INT sizes[][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+	const INT sides[] = { 10, 25, 50, 100 }; // percent of the desktop width and height
+	const INT rotations[] = { 0, 90 };
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const INT width = sizes[s][0];
+		const INT height = sizes[s][1];
+		const INT pitch = width * 4;
+
+		std::vector<UINT> pixels((size_t)width * height);
+		fillRandom(pixels, 33);
+
+		tagCaptureSourceFrame frame;
+		memset(&frame, 0, sizeof(frame));
+		frame.Data  = (const BYTE*)&pixels[0];
+		frame.Pitch = pitch;
+
+		for (size_t r = 0; r < sizeof(rotations) / sizeof(rotations[0]); ++r)
+		{
+			tagCaptureSourceDesc desc;
+			desc.Width           = width;
+			desc.Height          = height;
+			desc.RotationDegrees = rotations[r];
+			desc.DesktopWidth    = (rotations[r] == 90) ? height : width;
+			desc.DesktopHeight   = (rotations[r] == 90) ? width : height;
+
+			tagScreenCaptureFilterConfig config;
+			memset(&config, 0, sizeof(config));
+			config.RotationMode = tagFrameRotationMode_Auto;
+			config.SizeMode     = tagFrameSizeMode_AutoSize;
+
+			for (size_t a = 0; a < sizeof(sides) / sizeof(sides[0]); ++a)
+			{
+				for (INT batch = 1; batch <= 4; batch += 3)
+				{
+					// batch regions: a 2x2 grid of half sized regions with the same total area
+					const INT regionWidth  = desc.DesktopWidth * sides[a] / 100 / ((batch > 1) ? 2 : 1);
+					const INT regionHeight = desc.DesktopHeight * sides[a] / 100 / ((batch > 1) ? 2 : 1);
+					if ((regionWidth < 1) || (regionHeight < 1)) {
+						continue;
+					}
+
+					CDXGICaptureRegionFrame regions[4];
+					HRESULT hr = S_OK;
+					for (INT i = 0; SUCCEEDED(hr) && (i < batch); ++i)
+					{
+						tagFrameBounds region = {
+							(desc.DesktopWidth - regionWidth * ((batch > 1) ? 2 : 1)) / 2 + (i % 2) * regionWidth,
+							(desc.DesktopHeight - regionHeight * ((batch > 1) ? 2 : 1)) / 2 + (i / 2) * regionHeight,
+							regionWidth,
+							regionHeight };
+						hr = regions[i].Initialize(&region, &desc, &config);
+					}
+					if (FAILED(hr))
+					{
+						printf("%-8s region init failed 0x%08X\n", "region", (UINT)hr);
+						continue;
+					}
+
+					CDXGICursorCache cursorCache;
+					tagFrameUpdateStats updateStats;
+					tagFrameCopyStats copyStats;
+					double ns = benchRun([&]() {
+						for (INT i = 0; i < batch; ++i)
+						{
+							regions[i].Update(&frame, FALSE, nullptr, &cursorCache, &updateStats, &copyStats);
+							regions[i].Render(&copyStats);
+						}
+					});
+
+					memset(&updateStats, 0, sizeof(updateStats));
+					memset(&copyStats, 0, sizeof(copyStats));
+					for (INT i = 0; i < batch; ++i) {
+						regions[i].Update(&frame, FALSE, nullptr, &cursorCache, &updateStats, &copyStats);
+					}
+
+					char szName[32], szVariant[16];
+					sprintf(szName, "%dx %d%% area", batch, sides[a] * sides[a] / 100);
+					sprintf(szVariant, "rot %d", rotations[r]);
+					recordResult("region", szName, width, height, szVariant, ns);
+					printf("%-8s %-18s %5dx%-5d %-10s %12.1f ns %10.2f MB copied %8.1f fps\n",
+						"region", szName, width, height, szVariant, ns, updateStats.BytesCopied / 1048576.0, 1000000000.0 / ns);
+				}
+			}
+		}
+	}
+}
+
+//
+// The helpers of DXGICaptureHelper (CalculateRendererInfo, ResizeFrameBuffer,
+// ProcessMouseShape, ProcessMouseMask, DrawMouse and the encoders) on 1080p,
+// 1440p, 4K and 8K desktops. The helpers only translate the DXGI structs and
+// map the texture, the measured code is their portable part.
+//
+static const INT g_HelperSizes[][2] = { { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }, { 7680, 4320 } };
+static const INT g_HelperRotations[] = { 0, 90, 180, 270 };
+
+static void benchHelpers()
+{
+	const UINT types[] = { DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME, DXGICAPTURE_POINTER_SHAPE_TYPE_COLOR, DXGICAPTURE_POINTER_SHAPE_TYPE_MASKED_COLOR };
+	const INT shapeSizes[] = { 32, 128 };
+	const size_t typeCount = sizeof(types) / sizeof(types[0]);
+	const size_t rotationCount = sizeof(g_HelperRotations) / sizeof(g_HelperRotations[0]);
+	char name[64], variant[32];
+
+	// ProcessMouseShape: a new shape (cache miss), does not depend on the desktop size
+	for (size_t s = 0; s < sizeof(shapeSizes) / sizeof(shapeSizes[0]); ++s)
+	{
+		tagBenchPointer pointers[3];
+		for (size_t t = 0; t < typeCount; ++t)
+		{
+			makeBenchPointer(types[t], shapeSizes[s], &pointers[t]);
+			for (size_t r = 0; r < rotationCount; ++r)
+			{
+				tagFrameBufferInfo buffer, rotateBuffer;
+				memset(&buffer, 0, sizeof(buffer));
+				memset(&rotateBuffer, 0, sizeof(rotateBuffer));
+				const INT degrees = DXGICapturePointer::GetRotateDegrees(g_HelperRotations[r]);
+				double ns = benchRun([&]() {
+					DXGICapturePointer::ProcessShape(&pointers[t].Pointer, degrees, &buffer, &rotateBuffer);
+				});
+				sprintf(name, "shape-%s", pointers[t].Name);
+				sprintf(variant, "rot-%d", g_HelperRotations[r]);
+				printResult("helper", name, shapeSizes[s], shapeSizes[s], variant, ns);
+				DXGICaptureFrameBuffer::Free(&buffer);
+				DXGICaptureFrameBuffer::Free(&rotateBuffer);
+			}
+		}
+	}
+
+	for (size_t s = 0; s < sizeof(g_HelperSizes) / sizeof(g_HelperSizes[0]); ++s)
+	{
+		const INT width  = g_HelperSizes[s][0];
+		const INT height = g_HelperSizes[s][1];
+
+		// CalculateRendererInfo: the whole desktop and a region, auto size
+		for (size_t r = 0; r < rotationCount; ++r)
+		{
+			for (INT bRegion = 0; bRegion < 2; ++bRegion)
+			{
+				tagFrameBounds region = { 0, 0, 0, 0 };
+				if (bRegion)
+				{
+					region.X      = width / 4;
+					region.Y      = height / 4;
+					region.Width  = width / 2;
+					region.Height = height / 2;
+				}
+				tagFrameGeometry geometry;
+				tagFrameRect rcCopy;
+				HRESULT hr = S_OK;
+				double ns = benchRun([&]() {
+					memset(&geometry, 0, sizeof(geometry));
+					geometry.RotationMode = tagFrameRotationMode_Auto;
+					geometry.SizeMode     = tagFrameSizeMode_AutoSize;
+					geometry.ScaleX       = 1.0f;
+					geometry.ScaleY       = 1.0f;
+					hr = DXGICaptureRegion::CalculateCopyGeometry(&region, width, height, g_HelperRotations[r], &geometry, &rcCopy);
+				});
+				sprintf(variant, "rot-%d", g_HelperRotations[r]);
+				printTime("helper", bRegion ? "renderer-info-roi" : "renderer-info", width, height, variant, ns);
+				if (FAILED(hr)) {
+					printf("helper   renderer-info %dx%d rot %d failed 0x%08X\n", width, height, g_HelperRotations[r], (UINT)hr);
+				}
+			}
+		}
+
+		// ResizeFrameBuffer: a new frame buffer, and the common case of a buffer that is large enough
+		const UINT frameSize = (UINT)width * height * 4;
+		tagFrameBufferInfo frame;
+		memset(&frame, 0, sizeof(frame));
+		double ns = benchRun([&]() {
+			DXGICaptureFrameBuffer::Free(&frame);
+			DXGICaptureFrameBuffer::Resize(&frame, frameSize);
+		});
+		printTime("helper", "resize-grow", width, height, "-", ns);
+		ns = benchRun([&]() {
+			DXGICaptureFrameBuffer::Resize(&frame, frameSize);
+		});
+		printTime("helper", "resize-keep", width, height, "-", ns);
+		DXGICaptureFrameBuffer::Free(&frame);
+
+		// ProcessMouseMask and DrawMouse of every shape type and display rotation,
+		// the pointer in the middle of the desktop (a cached shape, as in a capture)
+		std::vector<UINT> surface((size_t)width * height);
+		fillRandom(surface, 31);
+		tagBenchPointer pointers[3];
+		for (size_t t = 0; t < typeCount; ++t)
+		{
+			makeBenchPointer(types[t], 32, &pointers[t]);
+			pointers[t].Pointer.X = width / 2;
+			pointers[t].Pointer.Y = height / 2;
+
+			for (size_t r = 0; r < rotationCount; ++r)
+			{
+				const INT rotation = g_HelperRotations[r];
+				const INT surfWidth  = ((rotation == 90) || (rotation == 270)) ? height : width;
+				const INT surfHeight = ((rotation == 90) || (rotation == 270)) ? width : height;
+
+				CDXGICursorCache cache;
+				tagFrameBufferInfo rotateBuffer, background, mouseShape;
+				memset(&rotateBuffer, 0, sizeof(rotateBuffer));
+				memset(&background, 0, sizeof(background));
+
+				ns = benchRun([&]() {
+					DXGICapturePointer::ProcessMask(&pointers[t].Pointer, width, height, rotation, &cache, &rotateBuffer, &mouseShape);
+				});
+				sprintf(name, "mask-%s", pointers[t].Name);
+				sprintf(variant, "rot-%d", rotation);
+				printTime("helper", name, width, height, variant, ns);
+
+				ns = benchRun([&]() {
+					DXGICapturePointer::Draw(&pointers[t].Pointer, width, height, rotation, &cache, &rotateBuffer,
+						(BYTE*)surface.data(), surfWidth * 4, surfWidth, surfHeight);
+				});
+				sprintf(name, "draw-%s", pointers[t].Name);
+				printTime("helper", name, width, height, variant, ns);
+
+				// incremental update: the pixels under the pointer are kept
+				ns = benchRun([&]() {
+					DXGICapturePointer::Draw(&pointers[t].Pointer, width, height, rotation, &cache, &rotateBuffer,
+						(BYTE*)surface.data(), surfWidth * 4, surfWidth, surfHeight, &background);
+				});
+				sprintf(name, "draw-%s-bg", pointers[t].Name);
+				printTime("helper", name, width, height, variant, ns);
+
+				DXGICaptureFrameBuffer::Free(&rotateBuffer);
+				DXGICaptureFrameBuffer::Free(&background);
+			}
+		}
+
+		// the encoders of SaveFrameToFile / EncodeFrame without WIC
+		std::vector<BYTE> image;
+		fillScreenContent(image, width, height, 13);
+		tagFrameBufferInfo output;
+		memset(&output, 0, sizeof(output));
+		UINT size = 0;
+
+		ns = benchRun([&]() {
+			DXGICaptureBmp::Encode(image.data(), width * 4, width, height, &output, &size);
+		});
+		printResult("helper", "encode-bmp", width, height, "-", ns);
+
+		ns = benchRun([&]() {
+			DXGICaptureQoi::Encode(image.data(), width * 4, width, height, &output, &size);
+		});
+		printResult("helper", "encode-qoi", width, height, "-", ns);
+
+		static const struct { tagStripImageFormat format; const char *name; } s_formats[] = {
+			{ tagStripImageFormat_Png,  "encode-png" },
+			{ tagStripImageFormat_Jpeg, "encode-jpeg" },
+			{ tagStripImageFormat_Tiff, "encode-tiff" },
+		};
+		const UINT threads = DXGICaptureParallel::GetThreadCount();
+		sprintf(variant, "%u-thread", threads);
+		for (size_t f = 0; f < sizeof(s_formats) / sizeof(s_formats[0]); ++f)
+		{
+			ns = benchRun([&]() {
+				DXGICaptureStripEncoder::Encode(s_formats[f].format, image.data(), width * 4, width, height, threads, &output, &size);
+			});
+			printResult("helper", s_formats[f].name, width, height, variant, ns);
+		}
+		DXGICaptureFrameBuffer::Free(&output);
+	}
+}
+
+//
+// Cost of the capture metrics: a recorded latency, a whole frame (a clock read
+// per stage), recording from several threads into one histogram, and a
+// snapshot/json export. The histogram check records known values.
+//
+static void benchMetrics()
+{
+	typedef CDXGICaptureMetrics::clock_type clock_type;
+
+	CDXGICaptureMetrics metrics;
+	UINT64 ullValue = 1;
+	double ns = benchRun([&]() {
+		ullValue = (ullValue * 6364136223846793005ULL + 1442695040888963407ULL);
+		metrics.Record(tagCaptureStage_Copy, (ullValue >> 40) & 0xFFFFFF);
+	});
+	recordResult("metrics", "record", 0, 0, "1-thread", ns);
+	printf("%-8s %-18s %11s %-10s %12.1f ns\n", "metrics", "record", "-", "1-thread", ns);
+
+	tagCaptureFrameTimes times;
+	ns = benchRun([&]() {
+		clock_type::time_point tick = clock_type::now();
+		CDXGICaptureMetrics::ResetFrameTimes(&times);
+		metrics.RecordAcquire(CDXGICaptureMetrics::Lap(&tick), FALSE, 1);
+		CDXGICaptureMetrics::AddFrameTime(&times, tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
+		CDXGICaptureMetrics::AddFrameTime(&times, tagCaptureStage_CursorFetch, CDXGICaptureMetrics::Lap(&tick));
+		CDXGICaptureMetrics::AddFrameTime(&times, tagCaptureStage_CursorComposite, CDXGICaptureMetrics::Lap(&tick));
+		CDXGICaptureMetrics::AddFrameTime(&times, tagCaptureStage_Render, CDXGICaptureMetrics::Lap(&tick));
+		metrics.RecordFrame(&times, 0);
+	});
+	recordResult("metrics", "frame", 0, 0, "5 stages", ns);
+	printf("%-8s %-18s %11s %-10s %12.1f ns\n", "metrics", "frame", "-", "5 stages", ns);
+
+	const UINT threadCounts[] = { 2, 4, 8 };
+	for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t)
+	{
+		const UINT threads = threadCounts[t];
+		const UINT records = 1000000;
+		std::vector<std::thread> workers;
+		clock_type::time_point start = clock_type::now();
+		for (UINT i = 0; i < threads; ++i)
+		{
+			workers.push_back(std::thread([&metrics, i]() {
+				for (UINT r = 0; r < records; ++r) {
+					metrics.Record(tagCaptureStage_Encode, 1000 + ((r * 7919u + i) & 0xFFFF));
+				}
+			}));
+		}
+		for (size_t i = 0; i < workers.size(); ++i) {
+			workers[i].join();
+		}
+		ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count() / records;
+
+		char variant[32];
+		sprintf(variant, "%u-thread", threads);
+		recordResult("metrics", "record shared", 0, 0, variant, ns);
+		printf("%-8s %-18s %11s %-10s %12.1f ns\n", "metrics", "record shared", "-", variant, ns);
+	}
+
+	tagCaptureMetricsSnapshot snapshot;
+	ns = benchRun([&]() { metrics.GetSnapshot(&snapshot); });
+	recordResult("metrics", "snapshot", 0, 0, "-", ns);
+	printf("%-8s %-18s %11s %-10s %12.1f ns\n", "metrics", "snapshot", "-", "-", ns);
+
+	std::string json;
+	ns = benchRun([&]() { metrics.ExportJson(&json); });
+	recordResult("metrics", "json", 0, 0, "-", ns);
+	printf("%-8s %-18s %11s %-10s %12.1f ns %8u bytes\n", "metrics", "json", "-", "-", ns, (UINT)json.size());
+
+	// 1..1000 usec: the percentiles are within a bucket (1/32) of the exact ones
+	CDXGICaptureMetrics check;
+	for (UINT64 v = 1; v <= 1000; ++v) {
+		check.Record(tagCaptureStage_Render, v * 1000);
+	}
+	tagLatencySummary summary;
+	check.GetHistogram(tagCaptureStage_Render)->GetSummary(&summary);
+	BOOL bOk = (summary.Count == 1000) && (summary.MinNsec == 1000) && (summary.MaxNsec == 1000000) && (summary.MeanNsec == 500500) &&
+		(summary.P50Nsec >= 500000) && (summary.P50Nsec <= 500000 + 500000 / 32) &&
+		(summary.P99Nsec >= 990000) && (summary.P99Nsec <= 1000000);
+	printf("%-8s %-18s %11s %-10s p50 %.1f usec, p99 %.1f usec  %s\n", "metrics", "percentiles", "-", "-",
+		summary.P50Nsec / 1000.0, summary.P99Nsec / 1000.0, bOk ? "ok" : "MISMATCH");
+	g_CheckFailures += bOk ? 0 : 1;
+
+	// the wait of a timeout goes to the timeout total, not to the acquire histogram
+	check.RecordAcquire(2000, TRUE, 0);
+	check.RecordAcquire(3000, TRUE, 0);
+	check.RecordAcquire(7000, FALSE, 3);
+	check.GetSnapshot(&snapshot);
+	bOk = (snapshot.Timeouts == 2) && (snapshot.TimeoutWaitNsec == 5000) && (snapshot.DroppedFrames == 2) &&
+		(snapshot.Stages[tagCaptureStage_AcquireWait].Count == 1) && (snapshot.Stages[tagCaptureStage_AcquireWait].MaxNsec == 7000);
+	printf("%-8s %-18s %11s %-10s %llu timeouts, %llu nsec waited  %s\n", "metrics", "timeouts", "-", "-",
+		(unsigned long long)snapshot.Timeouts, (unsigned long long)snapshot.TimeoutWaitNsec, bOk ? "ok" : "MISMATCH");
+	g_CheckFailures += bOk ? 0 : 1;
+}
+
+//
+// Monitor info polling against a capture thread. The capture thread holds its
+// lock for every frame (a 1 msec acquire wait and a 0.5 msec copy) and
+// reconfigures every 50 frames; N reader threads poll the monitor infos every
+// 100 usec, either under the same lock (the former getters) or from the
+// published snapshot.
+// Every snapshot holds one generation in all fields, a reader that saw a torn
+// or freed snapshot counts an error.
+//
+typedef struct tagBenchMonitorInfo_s
+{
+	INT            Idx;
+	wchar_t        DisplayName[64];
+	INT            RotationDegrees;
+	tagFrameBounds Bounds;
+} tagBenchMonitorInfo;
+
+typedef struct tagBenchMonitorSnapshot_s
+{
+	UINT64              Generation;
+	UINT                Count;
+	tagBenchMonitorInfo Monitors[4];
+} tagBenchMonitorSnapshot;
+
+static void makeMonitorSnapshot(UINT64 generation, tagBenchMonitorSnapshot *pSnapshot)
+{
+	memset(pSnapshot, 0, sizeof(*pSnapshot));
+	pSnapshot->Generation = generation;
+	pSnapshot->Count = 4;
+	for (UINT i = 0; i < 4; ++i)
+	{
+		tagBenchMonitorInfo *pInfo = &pSnapshot->Monitors[i];
+		pInfo->Idx             = (INT)i;
+		pInfo->RotationDegrees = (INT)(generation % 4) * 90;
+		pInfo->Bounds.X        = (LONG)(i * 1920);
+		pInfo->Bounds.Y        = 0;
+		pInfo->Bounds.Width    = 1920;
+		pInfo->Bounds.Height   = (LONG)(1080 + generation % 64);
+		pInfo->DisplayName[0]  = (wchar_t)('A' + i);
+	}
+}
+
+static BOOL checkMonitorInfo(const tagBenchMonitorSnapshot *pSnapshot, const tagBenchMonitorInfo &info)
+{
+	return (info.RotationDegrees == (INT)(pSnapshot->Generation % 4) * 90) && (info.Bounds.Height == (LONG)(1080 + pSnapshot->Generation % 64));
+}
+
+static UINT64 mergedPercentile(const CDXGILatencyHistogram *pHistograms, UINT uiCount, double fraction)
+{
+	UINT64 ullTotal = 0;
+	for (UINT h = 0; h < uiCount; ++h) {
+		for (UINT i = 0; i < DXGICAPTURE_HISTOGRAM_BUCKETS; ++i) {
+			ullTotal += pHistograms[h].GetBucketCount(i);
+		}
+	}
+	const UINT64 ullRank = (UINT64)(fraction * (double)ullTotal);
+	UINT64 ullSeen = 0;
+	for (UINT i = 0; i < DXGICAPTURE_HISTOGRAM_BUCKETS; ++i)
+	{
+		for (UINT h = 0; h < uiCount; ++h) {
+			ullSeen += pHistograms[h].GetBucketCount(i);
+		}
+		if ((ullSeen > 0) && (ullSeen >= ullRank)) {
+			return CDXGILatencyHistogram::GetBucketUpperBound(i);
+		}
+	}
+	return 0;
+}
+
+static void benchSnapshot()
+{
+	typedef std::chrono::steady_clock clock_type;
+	const UINT readerCounts[] = { 1, 2, 4, 8 };
+	const INT64 acquireUsec = 1000, copyUsec = 500, pollUsec = 100;
+
+	for (size_t c = 0; c < sizeof(readerCounts) / sizeof(readerCounts[0]); ++c)
+	{
+		const UINT readers = readerCounts[c];
+		for (INT bSnapshot = 0; bSnapshot < 2; ++bSnapshot)
+		{
+			std::mutex captureLock;
+			tagBenchMonitorSnapshot locked;
+			makeMonitorSnapshot(0, &locked);
+			CDXGICaptureSnapshot<tagBenchMonitorSnapshot> snapshot;
+			snapshot.Publish(locked);
+
+			std::atomic<BOOL> bStop(FALSE);
+			std::atomic<UINT64> ullErrors(0);
+			std::atomic<UINT64> ullReads(0);
+			UINT64 ullFrames = 0, ullPublishes = 0;
+			double publishNs = 0.0;
+			CDXGILatencyHistogram *pHistograms = new CDXGILatencyHistogram[readers];
+
+			std::vector<std::thread> workers;
+			for (UINT r = 0; r < readers; ++r)
+			{
+				workers.push_back(std::thread([&, r]() {
+					UINT64 ullCount = 0;
+					tagBenchMonitorInfo info;
+					while (!bStop.load(std::memory_order_relaxed))
+					{
+						const INT idx = (INT)((ullCount + r) % 4);
+						clock_type::time_point start = clock_type::now();
+						BOOL bOk = FALSE;
+						if (bSnapshot)
+						{
+							CDXGICaptureSnapshot<tagBenchMonitorSnapshot>::CReader reader(snapshot);
+							const tagBenchMonitorSnapshot *pSnapshot = reader.Get();
+							info = pSnapshot->Monitors[idx];
+							bOk = checkMonitorInfo(pSnapshot, info);
+						}
+						else
+						{
+							std::lock_guard<std::mutex> lock(captureLock);
+							info = locked.Monitors[idx];
+							bOk = checkMonitorInfo(&locked, info);
+						}
+						pHistograms[r].Record((UINT64)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+						if (!bOk) {
+							ullErrors.fetch_add(1);
+						}
+						++ullCount;
+						std::this_thread::sleep_for(std::chrono::microseconds(pollUsec));
+					}
+					ullReads.fetch_add(ullCount);
+				}));
+			}
+
+			// the capture thread: a frame under the lock, a reconfiguration every 50 frames
+			clock_type::time_point start = clock_type::now();
+			while (std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now() - start).count() < (INT64)(g_BenchMsec * 2))
+			{
+				std::lock_guard<std::mutex> lock(captureLock);
+				std::this_thread::sleep_for(std::chrono::microseconds(acquireUsec));
+				clock_type::time_point copyStart = clock_type::now();
+				while (std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - copyStart).count() < copyUsec) {
+				}
+				if ((++ullFrames % 50) == 0)
+				{
+					++ullPublishes;
+					makeMonitorSnapshot(ullPublishes, &locked);
+					clock_type::time_point publishStart = clock_type::now();
+					snapshot.Publish(locked);
+					publishNs += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - publishStart).count();
+				}
+			}
+			const double elapsedSec = (double)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count() / 1000000.0;
+			bStop.store(TRUE);
+			for (size_t i = 0; i < workers.size(); ++i) {
+				workers[i].join();
+			}
+
+			// percentiles are bucket upper bounds, clamped to the max
+			double maxNs = 0.0;
+			for (UINT r = 0; r < readers; ++r)
+			{
+				tagLatencySummary summary;
+				pHistograms[r].GetSummary(&summary);
+				maxNs = std::max(maxNs, (double)summary.MaxNsec);
+			}
+			const double p50 = std::min(maxNs, (double)mergedPercentile(pHistograms, readers, 0.50));
+			const double p99 = std::min(maxNs, (double)mergedPercentile(pHistograms, readers, 0.99));
+			const double p999 = std::min(maxNs, (double)mergedPercentile(pHistograms, readers, 0.999));
+			delete[] pHistograms;
+
+			const char *pszName = bSnapshot ? "snapshot" : "lock";
+			char variant[32], name[32];
+			sprintf(variant, "%u-reader", readers);
+			sprintf(name, "%s-p50", pszName);
+			recordResult("snapshot", name, 0, 0, variant, p50);
+			sprintf(name, "%s-p99", pszName);
+			recordResult("snapshot", name, 0, 0, variant, p99);
+			printf("%-8s %-18s %11s %-10s p50 %8.2f us  p99 %8.2f us  p99.9 %8.2f us  max %8.2f us  %8.0f reads/s  %4llu frames  publish %6.1f us  %s\n",
+				"snapshot", pszName, "-", variant, p50 / 1000.0, p99 / 1000.0, p999 / 1000.0, maxNs / 1000.0, (double)ullReads.load() / elapsedSec,
+				(unsigned long long)ullFrames, (ullPublishes > 0) ? publishNs / (double)ullPublishes / 1000.0 : 0.0,
+				(ullErrors.load() == 0) ? "ok" : "TORN READS");
+		}
+	}
+}
+
+//
+// Writes the results as csv: group,name,width,height,variant,ns
+//
+static BOOL writeResults(const char *pszFile)
+{
+	FILE *fp = fopen(pszFile, "w");
+	if (nullptr == fp)
+	{
+		printf("cannot write %s\n", pszFile);
+		return FALSE;
+	}
+	fprintf(fp, "group,name,width,height,variant,ns\n");
+	for (size_t i = 0; i < g_Results.size(); ++i) {
+		fprintf(fp, "%s,%.1f\n", g_Results[i].Key.c_str(), g_Results[i].Ns);
+	}
+	fclose(fp);
+	return TRUE;
+}
+
+//
+// Compares the results with a csv of an earlier run (-out). A result slower than
+// the baseline by more than thresholdPct percent is a regression.
+// Returns the number of regressions, -1 if the baseline cannot be read.
+//
+static INT compareResults(const char *pszFile, double thresholdPct)
+{
+	FILE *fp = fopen(pszFile, "r");
+	if (nullptr == fp)
+	{
+		printf("cannot read baseline %s\n", pszFile);
+		return -1;
+	}
+
+	std::map<std::string, double> baseline;
+	char line[512];
+	while (nullptr != fgets(line, sizeof(line), fp))
+	{
+		// key up to the last comma, ns after it
+		char *pComma = strrchr(line, ',');
+		if ((nullptr == pComma) || (strncmp(line, "group,", 6) == 0)) {
+			continue;
+		}
+		*pComma = '\0';
+		baseline[line] = atof(pComma + 1);
+	}
+	fclose(fp);
+
+	printf("\ncompare with %s, threshold %.1f%%\n", pszFile, thresholdPct);
+
+	INT nRegressions = 0, nFaster = 0, nCompared = 0, nMissing = 0;
+	for (size_t i = 0; i < g_Results.size(); ++i)
+	{
+		std::map<std::string, double>::const_iterator it = baseline.find(g_Results[i].Key);
+		if ((it == baseline.end()) || (it->second <= 0.0))
+		{
+			++nMissing;
+			continue;
+		}
+
+		++nCompared;
+		const double changePct = (g_Results[i].Ns / it->second - 1.0) * 100.0;
+		if (changePct > thresholdPct) {
+			++nRegressions;
+		}
+		else if (changePct < -thresholdPct) {
+			++nFaster;
+		}
+		else {
+			continue;
+		}
+		printf("%-56s %12.1f ns  baseline %12.1f ns  %+7.1f%%  %s\n", g_Results[i].Key.c_str(), g_Results[i].Ns, it->second, changePct,
+			(changePct > thresholdPct) ? "REGRESSION" : "faster");
+	}
+
+	printf("compared %d results: %d regressions, %d faster, %d not in the baseline\n", nCompared, nRegressions, nFaster, nMissing);
+	return nRegressions;
+}
+
+int main(int argc, char* argv[])
+{
+	const char *pszFilter = nullptr;
+	const char *pszThreads = nullptr;
+	const char *pszOut = nullptr;
+	const char *pszBaseline = nullptr;
+	double thresholdPct = 10.0;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if ((argv[i][0] == '-') && (i + 1 < argc))
+		{
+			const char *pszValue = argv[++i];
+			if (strcmp(argv[i - 1], "-time") == 0) {
+				g_BenchMsec = std::max(1.0, atof(pszValue));
+			}
+			else if (strcmp(argv[i - 1], "-repeat") == 0) {
+				g_BenchRepeat = (UINT)std::max(1, atoi(pszValue));
+			}
+			else if (strcmp(argv[i - 1], "-out") == 0) {
+				pszOut = pszValue;
+			}
+			else if (strcmp(argv[i - 1], "-baseline") == 0) {
+				pszBaseline = pszValue;
+			}
+			else if (strcmp(argv[i - 1], "-threshold") == 0) {
+				thresholdPct = atof(pszValue);
+			}
+			else {
+				printf("unknown option %s\n", argv[i - 1]);
+				return 1;
+			}
+		}
+		else if (nullptr == pszFilter) {
+			pszFilter = argv[i];
+		}
+		else {
+			pszThreads = argv[i];
+		}
+	}
+
+	printf("cpu simd level: %s\n\n", simdLevelName(DXGICaptureCpu::GetSimdLevel()));
+
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "blend") == 0)) {
+		benchBlend();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "shape") == 0)) {
+		benchCursorShape();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "cursor") == 0)) {
+		benchCursorCache();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "dirty") == 0)) {
+		benchDirtyRects();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "rotate") == 0)) {
+		benchRotate();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "render") == 0)) {
+		benchRender();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "scale") == 0)) {
+		benchScale();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "ring") == 0)) {
+		benchStagingRing();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "delta") == 0)) {
+		benchDelta();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "copy") == 0)) {
+		benchCopy();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "region") == 0)) {
+		benchRegion();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "yuv") == 0)) {
+		benchYuv();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "tilehash") == 0)) {
+		benchTileHash();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "qoi") == 0)) {
+		benchQoi();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "helper") == 0)) {
+		benchHelpers();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "snapshot") == 0)) {
+		benchSnapshot();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "metrics") == 0)) {
+		benchMetrics();
+	}
+	if ((nullptr == pszFilter) || (strcmp(pszFilter, "encode") == 0)) {
+		// optional thread limit, e.g. "encode 16"
+		UINT maxThreads = (nullptr != pszThreads) ? (UINT)atoi(pszThreads) : DXGICaptureParallel::GetThreadCount();
+		benchEncode((maxThreads > 0) ? maxThreads : 1);
+	}
+
+	if ((nullptr != pszOut) && !writeResults(pszOut)) {
+		return 1;
+	}
+	if (nullptr != pszBaseline)
+	{
+		// exit code 2: regressions past the threshold
+		INT nRegressions = compareResults(pszBaseline, thresholdPct);
+		if (nRegressions != 0) {
+			return (nRegressions < 0) ? 1 : 2;
+		}
+	}
+	if (g_CheckFailures > 0)
+	{
+		// exit code 3: a kernel differs from its reference
+		printf("%u check mismatches\n", g_CheckFailures);
+		return 3;
+	}
+
+	return 0;
+}
@@ -0,0 +1,1567 @@
+/*****************************************************************************
+* main.cpp
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+
+//
+// End-to-end benchmark of the capture pipeline on a synthetic desktop or a
+// recorded session: source -> incremental update -> pointer -> render -> encode -> file.
+// Builds without the DirectX headers, e.g. on Linux:
+//   g++ -O2 -std=c++11 -I dxgi_desktop_capture dxgi_capture_e2e/main.cpp -o dxgi_capture_e2e -pthread
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "CmdParser.h"
+#include "DXGICaptureBmp.h"
+#include "DXGICaptureCanvas.h"
+#include "DXGICaptureEncoderPool.h"
+#include "DXGICaptureMetrics.h"
+#include "DXGICapturePipeline.h"
+#include "DXGICaptureQoi.h"
+#include "DXGICaptureRecording.h"
+#include "DXGICaptureReplaySource.h"
+#include "DXGICaptureSession.h"
+#include "DXGICaptureStream.h"
+#include "DXGICaptureSyntheticSource.h"
+
+int show_help(const void *optsctx, const void *optctx);
+
+//
+// struct tagResolution_s
+//
+typedef struct tagResolution_s
+{
+	const char *name;
+	INT         width;
+	INT         height;
+} tagResolution;
+
+static const tagResolution g_Resolutions[] =
+{
+	{ "1080p", 1920, 1080 },
+	{ "1440p", 2560, 1440 },
+	{ "4k",    3840, 2160 },
+	{ "5k",    5120, 2880 },
+	{ "8k",    7680, 4320 },
+};
+
+static bool parse_resolution(const char *psz, INT *pWidth, INT *pHeight)
+{
+	for (size_t i = 0; i < sizeof(g_Resolutions) / sizeof(g_Resolutions[0]); ++i)
+	{
+		if (strcmp(psz, g_Resolutions[i].name) == 0)
+		{
+			*pWidth  = g_Resolutions[i].width;
+			*pHeight = g_Resolutions[i].height;
+			return true;
+		}
+	}
+
+	int w = 0, h = 0;
+	if ((sscanf(psz, "%dx%d", &w, &h) == 2) && (w > 0) && (h > 0) && (w <= 16384) && (h <= 16384))
+	{
+		*pWidth  = w;
+		*pHeight = h;
+		return true;
+	}
+	return false;
+}
+
+//
+// Output image formats of the -e option
+//
+static const char* g_ImageExtensions[] = { nullptr, "bmp", "qoi" };
+
+static HRESULT encode_image(int format, const BYTE *pSrc, INT nPitch, INT nWidth, INT nHeight, tagFrameBufferInfo *pOutput, UINT *pRetSize)
+{
+	if (format == 2) {
+		return DXGICaptureQoi::Encode(pSrc, nPitch, nWidth, nHeight, pOutput, pRetSize);
+	}
+	return DXGICaptureBmp::Encode(pSrc, nPitch, nWidth, nHeight, pOutput, pRetSize);
+}
+
+//
+// class CImageFileEncoder
+//
+// Encodes the frames of the encoder pool to bmp or qoi, the ordered writes go
+// to <prefix>_NNNNNN.<ext> (or are only counted without a prefix). The
+// encodes and the writes are recorded into the metrics, if any.
+//
+class CImageFileEncoder : public IDXGICaptureEncoder
+{
+private:
+	const char          *m_pszOutputPrefix;
+	int                  m_format;
+	CDXGICaptureMetrics *m_pMetrics;
+
+public:
+	UINT64      BytesEncoded;
+	UINT64      BytesWritten;
+
+	CImageFileEncoder(const char *pszOutputPrefix, int format, CDXGICaptureMetrics *pMetrics = nullptr)
+		: m_pszOutputPrefix(pszOutputPrefix)
+		, m_format(format)
+		, m_pMetrics(pMetrics)
+		, BytesEncoded(0)
+		, BytesWritten(0)
+	{
+	}
+
+	virtual HRESULT Encode(_In_ const CDXGICaptureFrame *pFrame, _Inout_ tagFrameBufferInfo *pOutput, _Out_ UINT *pRetSize)
+	{
+		CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+		HRESULT hr = encode_image(m_format, pFrame->GetBuffer(), pFrame->GetPitch(), pFrame->GetWidth(), pFrame->GetHeight(), pOutput, pRetSize);
+		if (SUCCEEDED(hr) && (nullptr != m_pMetrics)) {
+			m_pMetrics->RecordEncode(CDXGICaptureMetrics::Lap(&tick), *pRetSize);
+		}
+		return hr;
+	}
+
+	virtual HRESULT Write(_In_ const CDXGICaptureFrame * /*pFrame*/, _In_ UINT64 ullSequence, _In_reads_bytes_(uiSize) const BYTE *pData, _In_ UINT uiSize)
+	{
+		BytesEncoded += uiSize;
+		if (nullptr == m_pszOutputPrefix) {
+			return S_OK;
+		}
+
+		CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+		char szFileName[1024];
+		sprintf(szFileName, "%s_%06d.%s", m_pszOutputPrefix, (int)ullSequence + 1, g_ImageExtensions[m_format]);
+		FILE *fp = fopen(szFileName, "wb");
+		if (nullptr == fp)
+		{
+			printf("Error: Could not open '%s'.\n", szFileName);
+			return E_FAIL;
+		}
+		size_t written = fwrite(pData, 1, uiSize, fp);
+		fclose(fp);
+		BytesWritten += written;
+		if (nullptr != m_pMetrics) {
+			m_pMetrics->RecordWrite(CDXGICaptureMetrics::Lap(&tick), written);
+		}
+		return (written == uiSize) ? S_OK : E_FAIL;
+	}
+};
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	size_t idx = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+//
+// Multi-monitor run (-mon): paced synthetic monitors on their own threads,
+// composed into the virtual desktop canvas. Layout 2: a second monitor left
+// of the primary (negative origin), layout 3: also a portrait monitor (display
+// rotation 90) right of the primary, above the top edge, at half the rate.
+//
+static int run_canvas(int layout, const tagSyntheticSourceConfig *pSourceConfig, int frameCount, int showCursor, int encode, const char *pszOutputPrefix)
+{
+	typedef std::chrono::steady_clock clock_type;
+
+	const INT w = pSourceConfig->Width, h = pSourceConfig->Height;
+	CDXGISyntheticSource sources[3];
+	tagCanvasMonitor monitors[3];
+	UINT uiCount = (layout >= 3) ? 3 : 2;
+	for (UINT i = 0; i < uiCount; ++i)
+	{
+		tagSyntheticSourceConfig sourceConfig = *pSourceConfig;
+		sourceConfig.Seed            = pSourceConfig->Seed + i;
+		sourceConfig.Paced           = 1;
+		sourceConfig.RotationDegrees = 0;
+		sourceConfig.ShowPointer     = (i == 0) ? showCursor : 0;
+		if (i == 2)
+		{
+			sourceConfig.RotationDegrees = 90;
+			sourceConfig.FrameRate       = (pSourceConfig->FrameRate > 1) ? (pSourceConfig->FrameRate / 2) : 1;
+		}
+		HRESULT hr = sources[i].Initialize(&sourceConfig);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGISyntheticSource::Initialize failed.\n", hr);
+			return -1;
+		}
+
+		tagCaptureSourceDesc desc;
+		sources[i].GetDesc(&desc);
+		monitors[i].Source        = &sources[i];
+		monitors[i].Bounds.X      = (i == 0) ? 0 : ((i == 1) ? -desc.DesktopWidth : w);
+		monitors[i].Bounds.Y      = (i == 2) ? (h - desc.DesktopHeight) : 0;
+		monitors[i].Bounds.Width  = desc.DesktopWidth;
+		monitors[i].Bounds.Height = desc.DesktopHeight;
+	}
+
+	tagCanvasConfig canvasConfig;
+	canvasConfig.SyncWindowUsec  = DXGICAPTURE_CANVAS_DEFAULT_SYNC_WINDOW;
+	canvasConfig.ShowPointer     = showCursor;
+	canvasConfig.BackgroundColor = 0xFF000000u;
+
+	CDXGICaptureCanvas canvas;
+	HRESULT hr = canvas.Initialize(monitors, uiCount, &canvasConfig);
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGICaptureCanvas::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	const tagFrameBounds *pDesktop = canvas.GetDesktopBounds();
+	printf("canvas %dx%d at (%d, %d), %u monitors:", (int)pDesktop->Width, (int)pDesktop->Height, (int)pDesktop->X, (int)pDesktop->Y, uiCount);
+	for (UINT i = 0; i < uiCount; ++i) {
+		printf(" %dx%d at (%d, %d)", (int)monitors[i].Bounds.Width, (int)monitors[i].Bounds.Height, (int)monitors[i].Bounds.X, (int)monitors[i].Bounds.Y);
+	}
+	printf("\n");
+
+	tagFrameBufferInfo encoded;
+	memset(&encoded, 0, sizeof(encoded));
+	UINT64 bytesEncoded = 0;
+	UINT64 updates[3] = { 0, 0, 0 };
+	int frames = 0;
+
+	hr = canvas.Start();
+	clock_type::time_point start = clock_type::now();
+	while (SUCCEEDED(hr) && (frames < frameCount))
+	{
+		BOOL bTimeout = FALSE;
+		hr = canvas.ProcessFrame(1000, &bTimeout);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGICaptureCanvas::ProcessFrame failed.\n", hr);
+			break;
+		}
+		if (bTimeout)
+		{
+			printf("Error: No monitor image within 1 sec.\n");
+			hr = E_FAIL;
+			break;
+		}
+		++frames;
+		for (UINT i = 0; i < uiCount; ++i) {
+			updates[i] += canvas.IsMonitorUpdated(i) ? 1 : 0;
+		}
+
+		if (encode)
+		{
+			const tagFrameBufferInfo *pCanvas = canvas.GetCanvas();
+			UINT uiSize = 0;
+			hr = encode_image(encode, pCanvas->Buffer, pCanvas->Pitch, pCanvas->Bounds.Width, pCanvas->Bounds.Height, &encoded, &uiSize);
+			if (FAILED(hr))
+			{
+				printf("Error[0x%08X]: %s encode failed.\n", hr, g_ImageExtensions[encode]);
+				break;
+			}
+			bytesEncoded += uiSize;
+
+			if (nullptr != pszOutputPrefix)
+			{
+				char szFileName[1024];
+				sprintf(szFileName, "%s_%06d.%s", pszOutputPrefix, frames, g_ImageExtensions[encode]);
+				FILE *fp = fopen(szFileName, "wb");
+				if ((nullptr == fp) || (fwrite(encoded.Buffer, 1, uiSize, fp) != uiSize))
+				{
+					printf("Error: Could not write '%s'.\n", szFileName);
+					hr = E_FAIL;
+				}
+				if (nullptr != fp) {
+					fclose(fp);
+				}
+			}
+		}
+	}
+	double elapsedSec = (double)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count() / 1000000.0;
+
+	// the last images of every monitor, then the canvas must equal the upright monitor images
+	canvas.Stop();
+	if (SUCCEEDED(hr)) {
+		hr = canvas.ProcessFrame(0, nullptr);
+	}
+	UINT64 mismatched = 0;
+	tagFrameBufferInfo upright;
+	memset(&upright, 0, sizeof(upright));
+	for (UINT i = 0; SUCCEEDED(hr) && (i < uiCount); ++i)
+	{
+		tagCaptureSourceDesc desc;
+		sources[i].GetDesc(&desc);
+		hr = DXGICaptureFrameBuffer::Resize(&upright, (UINT)(desc.DesktopWidth * desc.DesktopHeight * 4));
+		if (FAILED(hr)) {
+			break;
+		}
+		DXGICaptureRotate::Rotate(sources[i].GetImage(), sources[i].GetPitch(), desc.Width, desc.Height,
+			upright.Buffer, desc.DesktopWidth * 4, desc.RotationDegrees);
+
+		const tagFrameBufferInfo *pCanvas = canvas.GetCanvas();
+		const tagFrameBounds *pBounds = canvas.GetMonitorBounds(i);
+		for (INT y = 0; y < desc.DesktopHeight; ++y)
+		{
+			const UINT *pExpected = (const UINT*)(upright.Buffer + (size_t)y * desc.DesktopWidth * 4);
+			const UINT *pActual = (const UINT*)(pCanvas->Buffer + (size_t)(pBounds->Y + y) * pCanvas->Pitch) + pBounds->X;
+			for (INT x = 0; x < desc.DesktopWidth; ++x) {
+				mismatched += (pExpected[x] != pActual[x]) ? 1 : 0;
+			}
+		}
+	}
+	DXGICaptureFrameBuffer::Free(&upright);
+	DXGICaptureFrameBuffer::Free(&encoded);
+	if (FAILED(hr) || (frames == 0)) {
+		return -1;
+	}
+
+	tagCanvasStats stats;
+	canvas.GetStats(&stats);
+	printf("frames          : %d\n", frames);
+	printf("elapsed         : %.3f sec\n", elapsedSec);
+	printf("fps             : %.1f\n", frames / elapsedSec);
+	printf("monitor images  :");
+	for (UINT i = 0; i < uiCount; ++i) {
+		printf(" %llu", (unsigned long long)updates[i]);
+	}
+	printf(" (%llu partial frames)\n", (unsigned long long)stats.PartialFrames);
+	printf("skew (msec)     : avg %.3f, max %.3f over %llu frames with several monitors\n",
+		(stats.SkewFrames > 0) ? stats.TotalSkewUsec / 1000.0 / (double)stats.SkewFrames : 0.0, stats.MaxSkewUsec / 1000.0,
+		(unsigned long long)stats.SkewFrames);
+	printf("bytes copied    : %.2f MB per frame (%.1f%% of the canvas)\n",
+		stats.BytesCopied / 1048576.0 / (double)stats.Frames, (stats.BytesTotal > 0) ? (100.0 * stats.BytesCopied / stats.BytesTotal) : 0.0);
+	printf("bytes encoded   : %.1f MB\n", bytesEncoded / 1048576.0);
+	printf("canvas check    : %llu pixels differ from the monitor images%s\n", (unsigned long long)mismatched,
+		showCursor ? " (pointer included)" : "");
+	return (showCursor || (mismatched == 0)) ? 0 : -1;
+}
+
+//
+// class CSessionSubscriber
+//
+// Subscriber of the fan-out run: hashes every output image by its frame
+// number, optionally encodes it to <prefix>_<name>_NNNNNN.<ext>, and can
+// take its time like a slow consumer (OCR).
+//
+class CSessionSubscriber : public IDXGICaptureSubscriber
+{
+private:
+	const char         *m_pszName;
+	const char         *m_pszOutputPrefix;
+	int                 m_format;
+	int                 m_delayMsec;
+	CDXGITileHasher     m_hasher;
+	tagFrameBufferInfo  m_encoded;
+
+public:
+	std::vector<std::pair<UINT64, UINT64> > Hashes; /* frame number, output hash */
+	UINT64              BytesEncoded;
+	UINT64              YuvFrames;
+
+	CSessionSubscriber(const char *pszName, const char *pszOutputPrefix, int format, int delayMsec)
+		: m_pszName(pszName)
+		, m_pszOutputPrefix(pszOutputPrefix)
+		, m_format(format)
+		, m_delayMsec(delayMsec)
+		, BytesEncoded(0)
+		, YuvFrames(0)
+	{
+		memset(&m_encoded, 0, sizeof(m_encoded));
+	}
+
+	virtual ~CSessionSubscriber()
+	{
+		DXGICaptureFrameBuffer::Free(&m_encoded);
+	}
+
+	inline const char* GetName() const { return m_pszName; }
+
+	virtual HRESULT OnFrame(_In_ CDXGICaptureFrame *pFrame)
+	{
+		HRESULT hr = S_OK;
+		if (!m_hasher.IsValid() || (m_hasher.GetWidth() != pFrame->GetWidth()) || (m_hasher.GetHeight() != pFrame->GetHeight())) {
+			hr = m_hasher.Initialize(pFrame->GetWidth(), pFrame->GetHeight());
+		}
+		if (SUCCEEDED(hr)) {
+			hr = m_hasher.Update(pFrame->GetBuffer(), pFrame->GetPitch());
+		}
+		CHECK_HR_RETURN(hr);
+		Hashes.push_back(std::make_pair(pFrame->GetFrameNumber(), m_hasher.GetFrameHash()));
+		YuvFrames += (pFrame->GetYuvImage()->Format != tagYuvFormat_None) ? 1 : 0;
+
+		if (m_format)
+		{
+			UINT uiSize = 0;
+			hr = encode_image(m_format, pFrame->GetBuffer(), pFrame->GetPitch(), pFrame->GetWidth(), pFrame->GetHeight(), &m_encoded, &uiSize);
+			CHECK_HR_RETURN(hr);
+			BytesEncoded += uiSize;
+
+			if (nullptr != m_pszOutputPrefix)
+			{
+				char szFileName[1024];
+				sprintf(szFileName, "%s_%s_%06d.%s", m_pszOutputPrefix, m_pszName, (int)pFrame->GetFrameNumber(), g_ImageExtensions[m_format]);
+				FILE *fp = fopen(szFileName, "wb");
+				if ((nullptr == fp) || (fwrite(m_encoded.Buffer, 1, uiSize, fp) != uiSize)) {
+					hr = E_FAIL;
+				}
+				if (nullptr != fp) {
+					fclose(fp);
+				}
+				CHECK_HR_RETURN(hr);
+			}
+		}
+
+		if (m_delayMsec > 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(m_delayMsec));
+		}
+		return S_OK;
+	}
+};
+
+//
+// Fan-out run (-subs): one synthetic desktop shared by three subscribers of a
+// capture session, an archive (the output of the command line, every frame,
+// encoded), a 320x180 live preview at 15 fps and a slow I420 sampler at 2 fps
+// that takes 250 msec per frame (-pace 1: in real time). Afterwards every subscriber output is checked
+// against a pipeline with the same output config on an identical source.
+//
+static int run_session(const tagScreenCaptureFilterConfig *pConfig, const tagSyntheticSourceConfig *pSourceConfig, int frameCount, int pace, int encode, const char *pszOutputPrefix)
+{
+	typedef std::chrono::steady_clock clock_type;
+
+	// the references run unpaced, the images are the same
+	tagSyntheticSourceConfig sourceConfig = *pSourceConfig;
+	sourceConfig.Paced = pace;
+
+	CDXGISyntheticSource source;
+	HRESULT hr = source.Initialize(&sourceConfig);
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGISyntheticSource::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	tagSessionConfig sessionConfig;
+	sessionConfig.ShowPointer = pConfig->ShowCursor;
+	sessionConfig.Incremental = pConfig->Incremental;
+
+	CDXGICaptureSession session;
+	hr = session.Initialize(&source, &sessionConfig);
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGICaptureSession::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	const UINT uiCount = 3;
+	CSessionSubscriber archive("archive", pszOutputPrefix, encode, 0);
+	CSessionSubscriber preview("preview", nullptr, 0, 0);
+	CSessionSubscriber sampler("sampler", nullptr, 0, 250);
+	CSessionSubscriber *subscribers[uiCount] = { &archive, &preview, &sampler };
+	tagSubscriberConfig subscriberConfigs[uiCount];
+	memset(subscriberConfigs, 0, sizeof(subscriberConfigs));
+
+	subscriberConfigs[0].Filter     = *pConfig;
+	subscriberConfigs[0].QueueDepth = 4;
+
+	tagScreenCaptureFilterConfig &previewFilter = subscriberConfigs[1].Filter;
+	previewFilter.SizeMode          = tagFrameSizeMode_Zoom;
+	previewFilter.OutputSize.Width  = 320;
+	previewFilter.OutputSize.Height = 180;
+	previewFilter.ScaleFilter       = tagFrameScaleFilter_Bilinear;
+	subscriberConfigs[1].MaxFps     = 15;
+	subscriberConfigs[1].QueueDepth = 1;
+
+	subscriberConfigs[2].Filter.SizeMode  = tagFrameSizeMode_AutoSize;
+	subscriberConfigs[2].Filter.YuvFormat = tagYuvFormat_I420;
+	subscriberConfigs[2].MaxFps           = 2;
+	subscriberConfigs[2].QueueDepth       = 1;
+
+	UINT ids[uiCount];
+	for (UINT i = 0; SUCCEEDED(hr) && (i < uiCount); ++i) {
+		hr = session.Subscribe(subscribers[i], &subscriberConfigs[i], &ids[i]);
+	}
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGICaptureSession::Subscribe failed.\n", hr);
+		return -1;
+	}
+
+	printf("desktop %dx%d rot %d, workload %d, change %d%%, incremental %d, cursor %d, %u subscribers:",
+		pSourceConfig->Width, pSourceConfig->Height, pSourceConfig->RotationDegrees, (int)pSourceConfig->Workload,
+		pSourceConfig->ChangePercent, pConfig->Incremental, pConfig->ShowCursor, uiCount);
+	for (UINT i = 0; i < uiCount; ++i)
+	{
+		tagFrameSize size = { 0, 0 };
+		BOOL bPassthrough = FALSE;
+		session.GetSubscriberOutput(ids[i], &size, &bPassthrough);
+		printf(" %s %dx%d%s", subscribers[i]->GetName(), (int)size.Width, (int)size.Height, bPassthrough ? " (passthrough)" : "");
+	}
+	printf("\n");
+
+	// the session is driven from this thread, the subscribers run on their own
+	clock_type::time_point start = clock_type::now();
+	for (int i = 0; SUCCEEDED(hr) && (i < frameCount); ++i) {
+		hr = session.ProcessFrame(1000, nullptr);
+	}
+	double captureSec = (double)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count() / 1000000.0;
+	session.Flush();
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGICaptureSession::ProcessFrame failed.\n", hr);
+		return -1;
+	}
+
+	tagSessionStats sessionStats;
+	session.GetStats(&sessionStats);
+	tagSubscriberStats stats[uiCount];
+	for (UINT i = 0; i < uiCount; ++i) {
+		session.GetSubscriberStats(ids[i], &stats[i]);
+	}
+	session.Terminate();
+
+	printf("frames          : %llu in %.3f sec (%.1f fps), %llu published, %llu full copies\n",
+		(unsigned long long)sessionStats.Frames, captureSec, sessionStats.Frames / captureSec,
+		(unsigned long long)sessionStats.Published, (unsigned long long)sessionStats.FullCopies);
+	printf("shared frames   : %.2f MB copied per frame, compose avg %.3f msec, %llu deliveries\n",
+		sessionStats.BytesCopied / 1048576.0 / (double)sessionStats.Frames,
+		sessionStats.ComposeUsec / 1000.0 / (double)sessionStats.Frames, (unsigned long long)sessionStats.Deliveries);
+
+	// the same outputs from a pipeline per subscriber on an identical source
+	UINT64 mismatched = 0, checked = 0;
+	for (UINT i = 0; i < uiCount; ++i)
+	{
+		const tagSubscriberStats &s = stats[i];
+		printf("%-16s: %llu delivered, %llu skipped (rate), %llu dropped (slow), %llu failed, render avg %.3f msec, latency avg %.3f max %.3f msec\n",
+			subscribers[i]->GetName(), (unsigned long long)s.Delivered, (unsigned long long)s.Skipped, (unsigned long long)s.Dropped,
+			(unsigned long long)s.Failed, (s.Rendered > 0) ? s.RenderUsec / 1000.0 / (double)s.Rendered : 0.0,
+			(s.Delivered > 0) ? s.TotalLatencyUsec / 1000.0 / (double)s.Delivered : 0.0, s.MaxLatencyUsec / 1000.0);
+
+		tagScreenCaptureFilterConfig referenceConfig = subscriberConfigs[i].Filter;
+		referenceConfig.ShowCursor    = pConfig->ShowCursor;
+		referenceConfig.Incremental   = pConfig->Incremental;
+		referenceConfig.SkipUnchanged = 0;
+		referenceConfig.YuvFormat     = tagYuvFormat_None;
+		referenceConfig.RegionCount   = 0;
+
+		CDXGISyntheticSource referenceSource;
+		CDXGICapturePipeline reference;
+		hr = referenceSource.Initialize(pSourceConfig);
+		if (SUCCEEDED(hr)) {
+			hr = reference.Initialize(&referenceSource, &referenceConfig);
+		}
+
+		std::vector<std::pair<UINT64, UINT64> > &hashes = subscribers[i]->Hashes;
+		size_t next = 0;
+		CDXGITileHasher hasher;
+		for (int f = 0; SUCCEEDED(hr) && (f < frameCount) && (next < hashes.size()); ++f)
+		{
+			hr = reference.ProcessFrame(0, nullptr);
+			if (FAILED(hr) || (reference.GetFrameNumber() != hashes[next].first)) {
+				continue;
+			}
+			const tagFrameBufferInfo *pOutput = reference.GetOutputFrame();
+			if (!hasher.IsValid()) {
+				hr = hasher.Initialize(pOutput->Bounds.Width, pOutput->Bounds.Height);
+			}
+			if (SUCCEEDED(hr)) {
+				hr = hasher.Update(pOutput->Buffer, pOutput->Pitch);
+			}
+			mismatched += (SUCCEEDED(hr) && (hasher.GetFrameHash() == hashes[next].second)) ? 0 : 1;
+			checked++;
+			next++;
+		}
+		mismatched += hashes.size() - next;
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: Reference pipeline of '%s' failed.\n", hr, subscribers[i]->GetName());
+			return -1;
+		}
+	}
+
+	printf("bytes encoded   : %.1f MB\n", archive.BytesEncoded / 1048576.0);
+	printf("yuv frames      : %llu of the sampler\n", (unsigned long long)sampler.YuvFrames);
+	printf("session check   : %llu of %llu subscriber outputs differ from the pipeline outputs\n",
+		(unsigned long long)mismatched, (unsigned long long)checked);
+	return (mismatched == 0) ? 0 : -1;
+}
+
+//
+// Region run (-roi): the regions of one synthetic desktop rendered by one
+// pipeline, every region output is encoded. A second pipeline renders the whole
+// desktop from an identical source; with the auto size output (upright desktop)
+// every region output must equal its part of the whole output.
+//
+static int run_regions(const tagScreenCaptureFilterConfig *pConfig, const tagSyntheticSourceConfig *pSourceConfig, int frameCount, int encode, const char *pszOutputPrefix)
+{
+	typedef std::chrono::steady_clock clock_type;
+
+	CDXGISyntheticSource regionSource, desktopSource;
+	HRESULT hr = regionSource.Initialize(pSourceConfig);
+	if (SUCCEEDED(hr)) {
+		hr = desktopSource.Initialize(pSourceConfig);
+	}
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGISyntheticSource::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	tagScreenCaptureFilterConfig desktopConfig = *pConfig;
+	desktopConfig.RegionCount = 0;
+
+	CDXGICapturePipeline regionPipeline, desktopPipeline;
+	hr = regionPipeline.Initialize(&regionSource, pConfig);
+	if (SUCCEEDED(hr)) {
+		hr = desktopPipeline.Initialize(&desktopSource, &desktopConfig);
+	}
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGICapturePipeline::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	const BOOL bCheck = (pConfig->SizeMode == tagFrameSizeMode_AutoSize) && (pConfig->RotationMode == tagFrameRotationMode_Auto);
+	const UINT uiRegionCount = regionPipeline.GetRegionCount();
+	UINT64 ullRegionArea = 0;
+	printf("desktop %dx%d rot %d, %u regions:", pSourceConfig->Width, pSourceConfig->Height, pSourceConfig->RotationDegrees, uiRegionCount);
+	for (UINT r = 0; r < uiRegionCount; ++r)
+	{
+		const tagFrameBounds *pRegion = regionPipeline.GetRegion(r)->GetRegion();
+		const tagFrameBufferInfo *pOutput = regionPipeline.GetRegionOutput(r);
+		printf(" %dx%d at (%d, %d) -> %dx%d", (int)pRegion->Width, (int)pRegion->Height, (int)pRegion->X, (int)pRegion->Y,
+			(int)pOutput->Bounds.Width, (int)pOutput->Bounds.Height);
+		ullRegionArea += (UINT64)pRegion->Width * pRegion->Height;
+	}
+	printf("\n");
+
+	tagFrameBufferInfo encoded;
+	memset(&encoded, 0, sizeof(encoded));
+	std::vector<double> latencies, desktopLatencies;
+	latencies.reserve((size_t)frameCount);
+	desktopLatencies.reserve((size_t)frameCount);
+	UINT64 bytesCopied = 0, desktopBytesCopied = 0;
+	UINT64 bytesEncoded = 0;
+	UINT64 mismatched = 0;
+
+	for (int i = 0; SUCCEEDED(hr) && (i < frameCount); ++i)
+	{
+		clock_type::time_point frameStart = clock_type::now();
+		hr = regionPipeline.ProcessFrame(0, nullptr);
+		for (UINT r = 0; SUCCEEDED(hr) && encode && (r < uiRegionCount); ++r)
+		{
+			const tagFrameBufferInfo *pOutput = regionPipeline.GetRegionOutput(r);
+			UINT uiSize = 0;
+			hr = encode_image(encode, pOutput->Buffer, pOutput->Pitch, pOutput->Bounds.Width, pOutput->Bounds.Height, &encoded, &uiSize);
+			bytesEncoded += uiSize;
+
+			if (SUCCEEDED(hr) && (nullptr != pszOutputPrefix))
+			{
+				char szFileName[1024];
+				sprintf(szFileName, "%s_r%u_%06d.%s", pszOutputPrefix, r + 1, i + 1, g_ImageExtensions[encode]);
+				FILE *fp = fopen(szFileName, "wb");
+				if ((nullptr == fp) || (fwrite(encoded.Buffer, 1, uiSize, fp) != uiSize))
+				{
+					printf("Error: Could not write '%s'.\n", szFileName);
+					hr = E_FAIL;
+				}
+				if (nullptr != fp) {
+					fclose(fp);
+				}
+			}
+		}
+		latencies.push_back((double)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - frameStart).count() / 1000.0);
+
+		frameStart = clock_type::now();
+		if (SUCCEEDED(hr)) {
+			hr = desktopPipeline.ProcessFrame(0, nullptr);
+		}
+		desktopLatencies.push_back((double)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - frameStart).count() / 1000.0);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: Region capture failed.\n", hr);
+			break;
+		}
+
+		tagFrameUpdateStats stats;
+		regionPipeline.GetFrameUpdateStats(&stats);
+		bytesCopied += stats.BytesCopied;
+		desktopPipeline.GetFrameUpdateStats(&stats);
+		desktopBytesCopied += stats.BytesCopied;
+
+		const tagFrameBufferInfo *pDesktop = desktopPipeline.GetOutputFrame();
+		for (UINT r = 0; bCheck && (r < uiRegionCount); ++r)
+		{
+			const tagFrameBounds *pRegion = regionPipeline.GetRegion(r)->GetRegion();
+			const tagFrameBufferInfo *pOutput = regionPipeline.GetRegionOutput(r);
+			for (INT y = 0; y < pRegion->Height; ++y)
+			{
+				const UINT *pExpected = (const UINT*)(pDesktop->Buffer + (size_t)(pRegion->Y + y) * pDesktop->Pitch) + pRegion->X;
+				const UINT *pActual = (const UINT*)(pOutput->Buffer + (size_t)y * pOutput->Pitch);
+				for (INT x = 0; x < pRegion->Width; ++x) {
+					mismatched += (pExpected[x] != pActual[x]) ? 1 : 0;
+				}
+			}
+		}
+	}
+	DXGICaptureFrameBuffer::Free(&encoded);
+	if (FAILED(hr) || latencies.empty()) {
+		return -1;
+	}
+
+	const double frames = (double)latencies.size();
+	double total = 0.0, desktopTotal = 0.0;
+	for (size_t i = 0; i < latencies.size(); ++i)
+	{
+		total += latencies[i];
+		desktopTotal += desktopLatencies[i];
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	printf("frames          : %u\n", (UINT)latencies.size());
+	printf("region area     : %.1f%% of the desktop\n", 100.0 * ullRegionArea / ((double)pSourceConfig->Width * pSourceConfig->Height));
+	printf("latency (msec)  : avg %.3f, p50 %.3f, p99 %.3f (whole desktop avg %.3f, without encode)\n",
+		total / frames, percentile(latencies, 0.50), percentile(latencies, 0.99), desktopTotal / frames);
+	printf("bytes copied    : %.2f MB per frame (whole desktop %.2f MB)\n", bytesCopied / 1048576.0 / frames, desktopBytesCopied / 1048576.0 / frames);
+	printf("bytes encoded   : %.1f MB\n", bytesEncoded / 1048576.0);
+	if (bCheck) {
+		printf("region check    : %llu pixels differ from the whole desktop output\n", (unsigned long long)mismatched);
+	}
+	return (mismatched == 0) ? 0 : -1;
+}
+
+int main(int argc, char* argv[])
+{
+	typedef std::chrono::steady_clock clock_type;
+
+	tagScreenCaptureFilterConfig config;
+	memset(&config, 0, sizeof(config));
+	config.ShowCursor = 1;
+	config.SizeMode   = tagFrameSizeMode_AutoSize;
+
+	tagSyntheticSourceConfig sourceConfig;
+	memset(&sourceConfig, 0, sizeof(sourceConfig));
+	sourceConfig.Workload             = tagSyntheticWorkload_Typing;
+	sourceConfig.ChangePercent        = 5;
+	sourceConfig.FrameRate            = 60;
+	sourceConfig.Seed                 = 1;
+	sourceConfig.ShowPointer          = 1;
+	sourceConfig.PointerShapeInterval = 60;
+
+	char *pszResolution = (char*)"1080p";
+	char *pszOutputPrefix = nullptr;
+	int frameCount = 300;
+	int workload = (int)sourceConfig.Workload;
+	int displayRotation = 0;
+	int encode = 1;
+	int encodeWorkers = 0;
+	int encodeQueueDepth = DXGICAPTURE_ENCODER_DEFAULT_QUEUE_DEPTH;
+	int backpressure = (int)tagEncodeBackpressure_Block;
+	char *pszRecordPath = nullptr;
+	char *pszReplayPath = nullptr;
+	int recordCompression = (int)tagRecordingCompression_None;
+	int segmentSizeMB = (int)(DXGICAPTURE_RECORDING_DEFAULT_SEGMENT_SIZE >> 20);
+	int keyframeInterval = DXGICAPTURE_RECORDING_DEFAULT_KEYFRAME_INTERVAL;
+	int keyframePercent = DXGICAPTURE_RECORDING_DEFAULT_KEYFRAME_PERCENT;
+	char *pszStreamPath = nullptr;
+	int streamFormat = (int)tagStreamFormat_Y4M;
+	int pace = 0;
+	int monitorLayout = 1;
+	char *pszRegions = nullptr;
+	int subscribers = 0;
+	char *pszMetricsPath = nullptr;
+
+	// set all command options
+	tagOption options[] =
+	{
+		{
+			"h",
+			OPT_EXIT,
+			0,
+			0,
+			{ (void*)show_help },
+			"show help",
+			nullptr
+		},
+		{
+			"res",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszResolution },
+			"desktop resolution. Default is '1080p' (1080p, 1440p, 4k, 5k, 8k or WxH)",
+			"resolution"
+		},
+		{
+			"n",
+			OPT_INT,
+			1,
+			(int)0xFFFFFF,
+			{ (void*)&frameCount },
+			"number of frames. Default is '300'",
+			"frames"
+		},
+		{
+			"w",
+			OPT_INT,
+			(int)tagSyntheticWorkload_Static,
+			(int)tagSyntheticWorkload_Video,
+			{ (void*)&workload },
+			"desktop workload. Default is '1' (0:Static, 1:Typing, 2:Scroll, 3:Video)",
+			"workload"
+		},
+		{
+			"p",
+			OPT_INT,
+			0,
+			100,
+			{ (void*)&(sourceConfig.ChangePercent) },
+			"changed area per frame in percent. Default is '5'",
+			"percent"
+		},
+		{
+			"fps",
+			OPT_INT,
+			1,
+			1000,
+			{ (void*)&(sourceConfig.FrameRate) },
+			"frame rate of the source timestamps. Default is '60'",
+			"rate"
+		},
+		{
+			"seed",
+			OPT_INT,
+			0,
+			(int)0x7FFFFFFF,
+			{ (void*)&(sourceConfig.Seed) },
+			"seed of the synthetic desktop. Default is '1'",
+			"seed"
+		},
+		{
+			"dr",
+			OPT_INT,
+			0,
+			3,
+			{ (void*)&displayRotation },
+			"display rotation. Default is '0' (0:Identity, 1:90, 2:180, 3:270)",
+			"rotation"
+		},
+		{
+			"ps",
+			OPT_INT,
+			0,
+			(int)0xFFFFFF,
+			{ (void*)&(sourceConfig.PointerShapeInterval) },
+			"frames between pointer shape changes. Default is '60' (0: never)",
+			"frames"
+		},
+		{
+			"c",
+			OPT_BOOL,
+			0,
+			1,
+			{ (void*)&(config.ShowCursor) },
+			"show cursor visible in output image. Default is '1' (0:false, 1:true)",
+			"show_cursor"
+		},
+		{
+			"s",
+			OPT_INT,
+			(int)tagFrameSizeMode_Normal,
+			(int)tagFrameSizeMode_Zoom,
+			{ (void*)&(config.SizeMode) },
+			"force image size mode. Default is '2' (0:Normal, 1:Stretch, 2:Auto, 3:Center, 4:Zoom)",
+			"size_mode"
+		},
+		{
+			"r",
+			OPT_INT,
+			(int)tagFrameRotationMode_Auto,
+			(int)tagFrameRotationMode_270,
+			{ (void*)&(config.RotationMode) },
+			"force image rotation mode. Default is '0' (0:Auto, 1:Identity, 2:90, 3:180, 4:270)",
+			"rotation_mode"
+		},
+		{
+			"x",
+			OPT_INT,
+			0,
+			(int)0xFFFF,
+			{ (void*)&(config.OutputSize.Width) },
+			"force output image width",
+			"image_width"
+		},
+		{
+			"y",
+			OPT_INT,
+			0,
+			(int)0xFFFF,
+			{ (void*)&(config.OutputSize.Height) },
+			"force output image height",
+			"image_height"
+		},
+		{
+			"sf",
+			OPT_INT,
+			(int)tagFrameScaleFilter_Default,
+			(int)tagFrameScaleFilter_Box,
+			{ (void*)&(config.ScaleFilter) },
+			"cpu scale filter of the output. Default is '0' (0:Render, 1:Nearest, 2:Bilinear, 3:Box)",
+			"filter"
+		},
+		{
+			"inc",
+			OPT_BOOL,
+			0,
+			1,
+			{ (void*)&(config.Incremental) },
+			"update frames from the dirty/move rects. Default is '0' (0:false, 1:true)",
+			nullptr
+		},
+		{
+			"skip",
+			OPT_BOOL,
+			0,
+			1,
+			{ (void*)&(config.SkipUnchanged) },
+			"do not encode output images that equal the last one (64x64 tile hashes). Default is '0' (0:false, 1:true)",
+			nullptr
+		},
+		{
+			"yuv",
+			OPT_INT,
+			(int)tagYuvFormat_None,
+			(int)tagYuvFormat_I420,
+			{ (void*)&(config.YuvFormat) },
+			"convert the output images to planar YUV. Default is '0' (0:none, 1:NV12, 2:I420)",
+			"format"
+		},
+		{
+			"ym",
+			OPT_INT,
+			(int)tagYuvMatrix_BT601,
+			(int)tagYuvMatrix_BT709,
+			{ (void*)&(config.YuvMatrix) },
+			"YUV matrix. Default is '0' (0:BT.601, 1:BT.709)",
+			"matrix"
+		},
+		{
+			"yr",
+			OPT_INT,
+			(int)tagYuvRange_Limited,
+			(int)tagYuvRange_Full,
+			{ (void*)&(config.YuvRange) },
+			"YUV range. Default is '0' (0:limited, 1:full)",
+			"range"
+		},
+		{
+			"e",
+			OPT_INT,
+			0,
+			2,
+			{ (void*)&encode },
+			"encode the output images. Default is '1' (0:none, 1:bmp, 2:qoi)",
+			"format"
+		},
+		{
+			"ew",
+			OPT_INT,
+			0,
+			DXGICAPTURE_ENCODER_MAX_WORKERS,
+			{ (void*)&encodeWorkers },
+			"encoder workers. Default is '0' (0: encode on the capture thread)",
+			"workers"
+		},
+		{
+			"eq",
+			OPT_INT,
+			1,
+			DXGICAPTURE_ENCODER_MAX_QUEUE_DEPTH,
+			{ (void*)&encodeQueueDepth },
+			"frames queued for the encoder workers. Default is '8'",
+			"depth"
+		},
+		{
+			"bp",
+			OPT_INT,
+			(int)tagEncodeBackpressure_Block,
+			(int)tagEncodeBackpressure_DropNewest,
+			{ (void*)&backpressure },
+			"backpressure of a full encoder queue. Default is '0' (0:Block, 1:DropOldest, 2:DropNewest)",
+			"policy"
+		},
+		{
+			"o",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszOutputPrefix },
+			"write the encoded images to <prefix>_NNNNNN.<bmp|qoi>. Default is none (encoded in memory only)",
+			"prefix"
+		},
+		{
+			"stream",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszStreamPath },
+			"stream the output images to a pipe or file instead of encoding them ('-': stdout, the report goes to stderr)",
+			"path"
+		},
+		{
+			"of",
+			OPT_INT,
+			(int)tagStreamFormat_Y4M,
+			(int)tagStreamFormat_RawBgra,
+			{ (void*)&streamFormat },
+			"format of the stream. Default is '0' (0:y4m, 1:rawvideo yuv (-yuv), 2:rawvideo bgra)",
+			"format"
+		},
+		{
+			"pace",
+			OPT_BOOL,
+			0,
+			1,
+			{ (void*)&pace },
+			"capture in real time at the frame rate of -fps instead of as fast as possible. Default is '0' (0:false, 1:true)",
+			nullptr
+		},
+		{
+			"mon",
+			OPT_INT,
+			1,
+			3,
+			{ (void*)&monitorLayout },
+			"monitors composed into one canvas, each captured on its own thread in real time. Default is '1' (2: left + primary, 3: also a portrait monitor)",
+			"layout"
+		},
+		{
+			"roi",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszRegions },
+			"render only the regions 'x,y,w,h[;x,y,w,h...]' (desktop coordinates, up to 8), each one encoded, checked against the whole desktop output",
+			"regions"
+		},
+		{
+			"subs",
+			OPT_BOOL,
+			0,
+			1,
+			{ (void*)&subscribers },
+			"fan-out session: archive (this output, every frame), 320x180 preview at 15 fps and a slow I420 sampler at 2 fps on one source, checked against pipelines",
+			nullptr
+		},
+		{
+			"rec",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszRecordPath },
+			"record the source frames to <base>.NNNN.dxr",
+			"base"
+		},
+		{
+			"rc",
+			OPT_INT,
+			(int)tagRecordingCompression_None,
+			(int)tagRecordingCompression_Delta,
+			{ (void*)&recordCompression },
+			"compression of the recorded images. Default is '0' (0:None, 1:Qoi, 2:Delta)",
+			"compression"
+		},
+		{
+			"ki",
+			OPT_INT,
+			1,
+			(int)0xFFFFFF,
+			{ (void*)&keyframeInterval },
+			"delta recording: frames between keyframes. Default is '120'",
+			"frames"
+		},
+		{
+			"kp",
+			OPT_INT,
+			1,
+			100,
+			{ (void*)&keyframePercent },
+			"delta recording: changed area in percent that forces a keyframe. Default is '50'",
+			"percent"
+		},
+		{
+			"seg",
+			OPT_INT,
+			1,
+			(int)0xFFFFF,
+			{ (void*)&segmentSizeMB },
+			"preallocated size of a recording segment in MB. Default is '512'",
+			"size"
+		},
+		{
+			"play",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszReplayPath },
+			"replay the recording <base>.NNNN.dxr (looped) instead of the synthetic desktop",
+			"base"
+		},
+		{
+			"metrics",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszMetricsPath },
+			"write the stage latency histograms and the frame counters of the run as json",
+			"file"
+		},
+		{ NULL, OPT_INVALID, 0, 0, { NULL }, NULL, NULL },
+	};
+
+	int lresult = CmdParser::ParseOptions(argc, argv, options);
+	if (lresult != 0) {
+		return (lresult > 0) ? 0 : lresult;
+	}
+
+	HRESULT hr = S_OK;
+	if (!parse_resolution(pszResolution, &sourceConfig.Width, &sourceConfig.Height))
+	{
+		printf("Error: Invalid resolution '%s'.\n", pszResolution);
+		return -1;
+	}
+	if ((nullptr != pszOutputPrefix) && (strlen(pszOutputPrefix) > 900))
+	{
+		printf("Error: Output prefix is too long.\n");
+		return -1;
+	}
+	sourceConfig.Workload        = (tagSyntheticWorkload)workload;
+	sourceConfig.RotationDegrees = displayRotation * 90;
+
+	if (monitorLayout > 1) {
+		return run_canvas(monitorLayout, &sourceConfig, frameCount, config.ShowCursor, encode, pszOutputPrefix);
+	}
+
+	if (subscribers) {
+		return run_session(&config, &sourceConfig, frameCount, pace, encode, pszOutputPrefix);
+	}
+
+	if (nullptr != pszRegions)
+	{
+		const char *psz = pszRegions;
+		while ((nullptr != psz) && (*psz != '\0') && (config.RegionCount < DXGICAPTURE_MAX_REGIONS))
+		{
+			int x = 0, y = 0, w = 0, h = 0;
+			if (sscanf(psz, "%d,%d,%d,%d", &x, &y, &w, &h) != 4) {
+				break;
+			}
+			tagFrameBounds &region = config.Regions[config.RegionCount++];
+			region.X      = x;
+			region.Y      = y;
+			region.Width  = w;
+			region.Height = h;
+			psz = strchr(psz, ';');
+			psz = (nullptr != psz) ? (psz + 1) : nullptr;
+		}
+		if ((config.RegionCount == 0) || ((nullptr != psz) && (*psz != '\0')))
+		{
+			printf("Error: Invalid regions '%s'.\n", pszRegions);
+			return -1;
+		}
+		return run_regions(&config, &sourceConfig, frameCount, encode, pszOutputPrefix);
+	}
+
+	// opened first, the report of a stream on stdout goes to stderr; the stream
+	// takes the place of the encoder, its frames are converted by the pool frames
+	CDXGIStreamOutput streamOutput;
+	tagYuvFormat streamYuvFormat = tagYuvFormat_None;
+	if (nullptr != pszStreamPath)
+	{
+		hr = streamOutput.Open(pszStreamPath);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: Could not open the stream '%s'.\n", hr, pszStreamPath);
+			return -1;
+		}
+		streamYuvFormat  = CDXGIStreamEncoder::GetRequiredYuvFormat((tagStreamFormat)streamFormat, config.YuvFormat);
+		config.YuvFormat = tagYuvFormat_None;
+		encode           = 1;
+		encodeWorkers    = 1;
+	}
+
+	CDXGISyntheticSource syntheticSource;
+	CDXGIReplaySource replaySource;
+	CDXGIRecordingSource recordingSource;
+	CDXGICapturePipeline pipeline;
+	IDXGICaptureSource *pSource = nullptr;
+
+	if (nullptr != pszReplayPath)
+	{
+		hr = replaySource.Open(pszReplayPath, TRUE);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGIReplaySource::Open '%s' failed.\n", hr, pszReplayPath);
+			return -1;
+		}
+		const CDXGIRecordingReader *pReader = replaySource.GetReader();
+		const tagCaptureSourceDesc *pDesc = pReader->GetDesc();
+		sourceConfig.Width           = pDesc->Width;
+		sourceConfig.Height          = pDesc->Height;
+		sourceConfig.RotationDegrees = pDesc->RotationDegrees;
+		printf("replay %llu frames in %u segments (%u recovered), compression %d\n",
+			(unsigned long long)pReader->GetFrameCount(), pReader->GetSegmentCount(), pReader->GetRecoveredSegmentCount(), (int)pReader->GetCompression());
+		pSource = &replaySource;
+	}
+	else
+	{
+		hr = syntheticSource.Initialize(&sourceConfig);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGISyntheticSource::Initialize failed.\n", hr);
+			return -1;
+		}
+		pSource = &syntheticSource;
+	}
+
+	if (nullptr != pszRecordPath)
+	{
+		tagRecordingConfig recordingConfig;
+		recordingConfig.SegmentSize      = (UINT64)segmentSizeMB << 20;
+		recordingConfig.Compression      = (tagRecordingCompression)recordCompression;
+		recordingConfig.KeyframeInterval = (UINT)keyframeInterval;
+		recordingConfig.KeyframePercent  = (UINT)keyframePercent;
+		hr = recordingSource.Initialize(pSource, pszRecordPath, &recordingConfig);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGIRecordingSource::Initialize failed.\n", hr);
+			return -1;
+		}
+		pSource = &recordingSource;
+	}
+
+	hr = pipeline.Initialize(pSource, &config);
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGICapturePipeline::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	const tagFrameGeometry *pGeometry = pipeline.GetGeometry();
+	const CDXGICaptureScaler *pScaler = pipeline.GetScaler();
+	printf("desktop %dx%d rot %d, workload %d, change %d%%, output %dx%d, incremental %d, cursor %d, scaler %d (factor %d)\n",
+		sourceConfig.Width, sourceConfig.Height, sourceConfig.RotationDegrees, workload, sourceConfig.ChangePercent,
+		(int)pGeometry->OutputSize.Width, (int)pGeometry->OutputSize.Height, config.Incremental, config.ShowCursor,
+		(int)pScaler->GetFilter(), pScaler->GetFactor());
+
+	tagFrameBufferInfo encoded;
+	memset(&encoded, 0, sizeof(encoded));
+
+	// cheap enough to stay attached, the json is only written with -metrics
+	CDXGICaptureMetrics metrics;
+	pipeline.SetMetrics(&metrics);
+
+	CImageFileEncoder fileEncoder(pszOutputPrefix, encode, &metrics);
+	CDXGIStreamEncoder streamEncoder(&streamOutput, (tagStreamFormat)streamFormat, (UINT)sourceConfig.FrameRate);
+	CDXGICaptureEncoderPool encoderPool;
+	CDXGICaptureFramePool *pFramePool = nullptr;
+	if (encode && (encodeWorkers > 0))
+	{
+		IDXGICaptureEncoder *pEncoder = streamOutput.IsOpen() ? (IDXGICaptureEncoder*)&streamEncoder : (IDXGICaptureEncoder*)&fileEncoder;
+		hr = encoderPool.Initialize(pEncoder, (UINT)encodeWorkers, (UINT)encodeQueueDepth, (tagEncodeBackpressure)backpressure);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGICaptureEncoderPool::Initialize failed.\n", hr);
+			return -1;
+		}
+		pFramePool = CDXGICaptureFramePool::Create((UINT)(encodeWorkers + encodeQueueDepth + 1));
+		if (nullptr == pFramePool)
+		{
+			printf("Error: Out of memory.\n");
+			return -1;
+		}
+	}
+
+	std::vector<double> latencies;
+	latencies.reserve((size_t)frameCount);
+	UINT64 bytesTouched = 0;
+	UINT64 frameCopies = 0;
+	UINT64 bytesCopied = 0;
+	UINT64 bytesStreamed = 0;
+	UINT64 bytesEncoded = 0;
+	UINT64 bytesWritten = 0;
+	int framesEncoded = 0;
+	int framesSkipped = 0;
+
+	clock_type::time_point start = clock_type::now();
+	for (int i = 0; i < frameCount; ++i)
+	{
+		if (pace && (sourceConfig.FrameRate > 0)) {
+			std::this_thread::sleep_until(start + std::chrono::microseconds((INT64)i * 1000000 / sourceConfig.FrameRate));
+		}
+		clock_type::time_point frameStart = clock_type::now();
+
+		hr = pipeline.ProcessFrame(0, nullptr);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGICapturePipeline::ProcessFrame failed.\n", hr);
+			break;
+		}
+
+		tagFrameUpdateStats stats;
+		pipeline.GetFrameUpdateStats(&stats);
+		bytesTouched += stats.BytesTouched;
+
+		tagFrameCopyStats copyStats;
+		pipeline.GetFrameCopyStats(&copyStats);
+
+		if (encode && !pipeline.IsOutputChanged()) {
+			++framesSkipped;
+		}
+		else if (nullptr != pFramePool)
+		{
+			// the output frame is reused, the pool encodes a copy
+			const tagFrameBufferInfo *pOutput = pipeline.GetOutputFrame();
+			CDXGICaptureFrame *pFrame = pFramePool->AcquireFrame(pOutput->Bounds.Width, pOutput->Bounds.Height, pOutput->Pitch);
+			if (nullptr == pFrame)
+			{
+				hr = E_OUTOFMEMORY;
+				printf("Error: Out of memory.\n");
+				break;
+			}
+			DXGICaptureCopy::CopyPixels(pOutput->Buffer, pOutput->Pitch, pFrame->GetBuffer(), pOutput->Pitch,
+				pOutput->Bounds.Width, pOutput->Bounds.Height, FALSE, tagSimdLevel_Auto, &copyStats);
+			pFrame->SetFrameInfo(pipeline.GetFrameNumber(), pipeline.GetTimestamp());
+			if (streamYuvFormat != tagYuvFormat_None) {
+				hr = pFrame->ConvertToYuv(streamYuvFormat, config.YuvMatrix, config.YuvRange);
+			}
+			if (FAILED(hr))
+			{
+				pFrame->Release();
+				printf("Error[0x%08X]: CDXGICaptureFrame::ConvertToYuv failed.\n", hr);
+				break;
+			}
+
+			hr = encoderPool.Submit(pFrame);
+			pFrame->Release();
+			if (hr == DXGICAPTURE_E_BROKEN_PIPE)
+			{
+				printf("the reader closed the stream\n");
+				hr = S_OK;
+				break;
+			}
+			if (FAILED(hr))
+			{
+				printf("Error[0x%08X]: CDXGICaptureEncoderPool::Submit failed.\n", hr);
+				break;
+			}
+		}
+		else if (encode)
+		{
+			const tagFrameBufferInfo *pOutput = pipeline.GetOutputFrame();
+			UINT uiSize = 0;
+			CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+			hr = encode_image(encode, pOutput->Buffer, pOutput->Pitch, pOutput->Bounds.Width, pOutput->Bounds.Height, &encoded, &uiSize);
+			if (FAILED(hr))
+			{
+				printf("Error[0x%08X]: %s encode failed.\n", hr, g_ImageExtensions[encode]);
+				break;
+			}
+			metrics.RecordEncode(CDXGICaptureMetrics::Lap(&tick), uiSize);
+			bytesEncoded += uiSize;
+			++framesEncoded;
+
+			if (nullptr != pszOutputPrefix)
+			{
+				char szFileName[1024];
+				sprintf(szFileName, "%s_%06d.%s", pszOutputPrefix, framesEncoded, g_ImageExtensions[encode]);
+				FILE *fp = fopen(szFileName, "wb");
+				if (nullptr == fp)
+				{
+					printf("Error: Could not open '%s'.\n", szFileName);
+					hr = E_FAIL;
+					break;
+				}
+				size_t written = fwrite(encoded.Buffer, 1, uiSize, fp);
+				fclose(fp);
+				bytesWritten += written;
+				metrics.RecordWrite(CDXGICaptureMetrics::Lap(&tick), written);
+			}
+		}
+
+		frameCopies   += copyStats.Copies;
+		bytesCopied   += copyStats.BytesCopied;
+		bytesStreamed += copyStats.BytesStreamed;
+
+		latencies.push_back((double)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - frameStart).count() / 1000.0);
+	}
+	double captureSec = (double)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count() / 1000000.0;
+
+	// the queued frames are still encoded and written
+	if (nullptr != pFramePool)
+	{
+		HRESULT hrPool = encoderPool.Terminate();
+		if (hrPool == DXGICAPTURE_E_BROKEN_PIPE) {
+			hrPool = S_OK; // reported by Submit
+		}
+		if (SUCCEEDED(hr) && FAILED(hrPool))
+		{
+			printf("Error[0x%08X]: CDXGICaptureEncoderPool encode failed.\n", hrPool);
+			hr = hrPool;
+		}
+		pFramePool->Release();
+		bytesEncoded = fileEncoder.BytesEncoded;
+		bytesWritten = fileEncoder.BytesWritten;
+	}
+	streamOutput.Close();
+	double elapsedSec = (double)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count() / 1000000.0;
+
+	tagRecordingStats recordingStats;
+	memset(&recordingStats, 0, sizeof(recordingStats));
+	if (nullptr != pszRecordPath)
+	{
+		HRESULT hrRecord = recordingSource.Close();
+		if (SUCCEEDED(hr) && FAILED(hrRecord))
+		{
+			printf("Error[0x%08X]: CDXGIRecordingSource::Close failed.\n", hrRecord);
+			hr = hrRecord;
+		}
+		recordingSource.GetStats(&recordingStats);
+	}
+
+	DXGICaptureFrameBuffer::Free(&encoded);
+
+	if (latencies.empty()) {
+		return -1;
+	}
+
+	double total = 0.0;
+	for (size_t i = 0; i < latencies.size(); ++i) {
+		total += latencies[i];
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	printf("frames          : %u\n", (UINT)latencies.size());
+	printf("elapsed         : %.3f sec (capture %.3f sec)\n", elapsedSec, captureSec);
+	printf("fps             : %.1f (capture %.1f)\n", latencies.size() / elapsedSec, latencies.size() / captureSec);
+	printf("latency (msec)  : avg %.3f, p50 %.3f, p99 %.3f, max %.3f\n",
+		total / latencies.size(), percentile(latencies, 0.50), percentile(latencies, 0.99), latencies.back());
+	printf("bytes touched   : %.1f MB (%.1f%% of full copies)\n",
+		bytesTouched / 1048576.0, 100.0 * bytesTouched / ((double)sourceConfig.Width * sourceConfig.Height * 4 * latencies.size()));
+	printf("frame copies    : %.2f per frame, %.1f MB per frame (%.1f%% streamed)%s\n",
+		frameCopies / (double)latencies.size(), bytesCopied / 1048576.0 / latencies.size(),
+		(bytesCopied > 0) ? (100.0 * bytesStreamed / bytesCopied) : 0.0, pipeline.IsPassthrough() ? ", passthrough" : "");
+	printf("bytes encoded   : %.1f MB\n", bytesEncoded / 1048576.0);
+	printf("bytes written   : %.1f MB\n", bytesWritten / 1048576.0);
+	if (config.SkipUnchanged)
+	{
+		tagTileHashStats hashStats;
+		pipeline.GetTileHasher()->GetStats(&hashStats);
+		printf("unchanged       : %d frames not encoded, %llu of %llu tiles changed, hash %.3f msec per frame\n",
+			framesSkipped, (unsigned long long)hashStats.TilesChanged, (unsigned long long)hashStats.TilesHashed,
+			(hashStats.Frames > 0) ? hashStats.HashUsec / 1000.0 / (double)hashStats.Frames : 0.0);
+	}
+	if (config.YuvFormat != tagYuvFormat_None)
+	{
+		static const char *s_pszYuvFormats[] = { "none", "NV12", "I420" };
+		tagYuvConvertStats yuvStats;
+		pipeline.GetYuvConvertStats(&yuvStats);
+		printf("yuv             : %s %s %s range, %llu frames converted, %.3f msec per frame\n",
+			s_pszYuvFormats[config.YuvFormat], (config.YuvMatrix == tagYuvMatrix_BT709) ? "BT.709" : "BT.601",
+			(config.YuvRange == tagYuvRange_Full) ? "full" : "limited", (unsigned long long)yuvStats.Frames,
+			(yuvStats.Frames > 0) ? yuvStats.ConvertUsec / 1000.0 / (double)yuvStats.Frames : 0.0);
+	}
+	if (nullptr != pszRecordPath)
+	{
+		printf("recording       : %llu frames (%llu keyframes), %u segments, %.1f MB stored (ratio %.2f)\n",
+			(unsigned long long)recordingStats.Frames, (unsigned long long)recordingStats.Keyframes, recordingStats.Segments,
+			recordingStats.StoredBytes / 1048576.0, (recordingStats.StoredBytes > 0) ? (double)recordingStats.RawBytes / recordingStats.StoredBytes : 0.0);
+	}
+
+	if (nullptr != pFramePool)
+	{
+		tagEncoderPoolStats poolStats;
+		encoderPool.GetStats(&poolStats);
+		printf("encoder pool    : %u workers, %u slots, max queued %u, written %llu, dropped oldest %llu, dropped newest %llu, failed %llu\n",
+			poolStats.Workers, poolStats.Slots, poolStats.MaxQueueDepth, (unsigned long long)poolStats.Written,
+			(unsigned long long)poolStats.DroppedOldest, (unsigned long long)poolStats.DroppedNewest, (unsigned long long)poolStats.Failed);
+		printf("encoder blocked : %llu submits, %.3f msec\n", (unsigned long long)poolStats.Blocked, poolStats.BlockedUsec / 1000.0);
+		for (UINT i = 0; i < poolStats.Workers; ++i)
+		{
+			tagEncoderWorkerStats workerStats;
+			if (SUCCEEDED(encoderPool.GetWorkerStats(i, &workerStats)))
+			{
+				printf("encoder worker %-2u: %llu frames, encode %.3f msec, write %.3f msec, utilisation %.1f%%\n",
+					i, (unsigned long long)workerStats.Frames, workerStats.EncodeUsec / 1000.0, workerStats.WriteUsec / 1000.0,
+					(workerStats.ElapsedUsec > 0) ? (100.0 * (workerStats.EncodeUsec + workerStats.WriteUsec) / workerStats.ElapsedUsec) : 0.0);
+			}
+		}
+	}
+
+	if (nullptr != pszStreamPath)
+	{
+		tagStreamOutputStats streamStats;
+		streamOutput.GetStats(&streamStats);
+		printf("stream          : %llu frames, %.1f MB, %.1f MB/s, %.2f writes per frame, write %.3f msec per frame (max %.3f)\n",
+			(unsigned long long)streamStats.Frames, streamStats.BytesWritten / 1048576.0, streamStats.BytesWritten / 1048576.0 / elapsedSec,
+			(streamStats.Frames > 0) ? (streamStats.WriteCalls / (double)streamStats.Frames) : 0.0,
+			(streamStats.Frames > 0) ? (streamStats.WriteUsec / 1000.0 / (double)streamStats.Frames) : 0.0, streamStats.MaxWriteUsec / 1000.0);
+	}
+
+	tagCaptureMetricsSnapshot snapshot;
+	metrics.GetSnapshot(&snapshot);
+	for (UINT i = 0; i < (UINT)tagCaptureStage_Count; ++i)
+	{
+		const tagLatencySummary *pStage = &snapshot.Stages[i];
+		if (pStage->Count > 0)
+		{
+			printf("%-16s: %llu, msec p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+				CDXGICaptureMetrics::GetStageName((tagCaptureStage)i), (unsigned long long)pStage->Count,
+				pStage->P50Nsec / 1000000.0, pStage->P90Nsec / 1000000.0, pStage->P99Nsec / 1000000.0,
+				pStage->P999Nsec / 1000000.0, pStage->MaxNsec / 1000000.0);
+		}
+	}
+	printf("allocations     : %llu (%.1f MB), %.3f per frame, in %llu frames (max %llu in one frame)\n",
+		(unsigned long long)snapshot.Allocations, snapshot.AllocatedBytes / 1048576.0,
+		(snapshot.Frames > 0) ? (snapshot.Allocations / (double)snapshot.Frames) : 0.0,
+		(unsigned long long)snapshot.FramesWithAllocations, (unsigned long long)snapshot.MaxFrameAllocations);
+	printf("dropped frames  : %llu desktop updates not acquired\n", (unsigned long long)snapshot.DroppedFrames);
+	if (nullptr != pszMetricsPath)
+	{
+		HRESULT hrMetrics = metrics.SaveJson(pszMetricsPath);
+		if (FAILED(hrMetrics))
+		{
+			printf("Error[0x%08X]: Could not write the metrics '%s'.\n", hrMetrics, pszMetricsPath);
+			hr = hrMetrics;
+		}
+	}
+
+	return FAILED(hr) ? -1 : 0;
+}
+
+int show_help(const void *optsctx, const void *optctx)
+{
+	const tagOption *options = (const tagOption*)optsctx;
+	const tagOption *option = (const tagOption*)optctx;
+	const tagOption *po;
+
+	printf("usage: dxgi_capture_e2e [options]\n\n");
+	for (po = options; po->name; po++) {
+		printf("-%-5s %-14s %s\n", po->name, po->argname ? po->argname : "", po->help);
+	}
+	printf("\n");
+
+	return ((nullptr == option) || (option->flag & OPT_EXIT)) ? 1 : 0;
+}
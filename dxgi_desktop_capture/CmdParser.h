@@ -19,7 +19,13 @@
 #define __CMDPARSER_3F7DEA1C881045E999A7A5FC5384A8A0_H__
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
 #include <tchar.h>
+#else
+typedef char _TCHAR;
+#endif
 
 typedef struct tagOption_s
 {
@@ -88,9 +94,9 @@ public:
 			}
 			name = nullptr;
 
-			// next argument
+			// next argument, a single '-' is a value (stdout)
 			arg = argv[argindex];
-			if (nullptr != arg && arg[0] == '-') {
+			if (nullptr != arg && arg[0] == '-' && arg[1] != '\0') {
 				continue;
 			}
 			argindex++;
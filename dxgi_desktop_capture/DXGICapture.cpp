@@ -18,6 +18,7 @@
 #include "DXGICaptureHelper.h"
 
 #include <chrono>
+#include <thread>
 
 #pragma comment(lib, "D3D11.lib")
 #pragma comment(lib, "d2d1.lib")
@@ -52,12 +53,34 @@ const UINT g_NumFeatureLevels = ARRAYSIZE(g_FeatureLevels);
 CDXGICapture::CDXGICapture()
 	: m_csLock()
 	, m_bInitialized(FALSE)
+	, m_cursorCache()
 	, m_lD3DFeatureLevel(D3D_FEATURE_LEVEL_INVALID)
+	, m_bCopyTextureValid(FALSE)
+	, m_bCpuRender(FALSE)
+	, m_bPassthrough(FALSE)
+	, m_pRenderedFrame(nullptr)
+	, m_bStopCapture(FALSE)
+	, m_bCaptureRunning(FALSE)
+	, m_hrCaptureResult(S_OK)
+	, m_pfnFrameCallback(nullptr)
+	, m_pFrameCallbackContext(nullptr)
+	, m_uiTargetFps(0)
+	, m_pFramePool(nullptr)
+	, m_ullLastSavedHash(0)
+	, m_guidLastSavedFormat(GUID_NULL)
 {
 	RtlZeroMemory(&m_rendererInfo, sizeof(m_rendererInfo));
 	RtlZeroMemory(&m_mouseInfo, sizeof(m_mouseInfo));
-	RtlZeroMemory(&m_tempMouseBuffer, sizeof(m_tempMouseBuffer));
+	RtlZeroMemory(&m_tempMouseRotateBuffer, sizeof(m_tempMouseRotateBuffer));
 	RtlZeroMemory(&m_desktopOutputDesc, sizeof(m_desktopOutputDesc));
+	RtlZeroMemory(&m_frameMetadataBuffer, sizeof(m_frameMetadataBuffer));
+	RtlZeroMemory(&m_mouseBackground, sizeof(m_mouseBackground));
+	RtlZeroMemory(&m_frameUpdateStats, sizeof(m_frameUpdateStats));
+	RtlZeroMemory(&m_frameGeometry, sizeof(m_frameGeometry));
+	RtlZeroMemory(&m_frameCopyStats, sizeof(m_frameCopyStats));
+	RtlZeroMemory(m_stagingMousePosition, sizeof(m_stagingMousePosition));
+	RtlZeroMemory(m_stagingMouseVisible, sizeof(m_stagingMouseVisible));
+	CDXGICaptureMetrics::ResetFrameTimes(&m_frameTimes);
 }
 
 CDXGICapture::~CDXGICapture()
@@ -65,9 +88,10 @@ CDXGICapture::~CDXGICapture()
 	this->Terminate();
 }
 
-HRESULT CDXGICapture::loadMonitorInfos(ID3D11Device *pDevice)
+HRESULT CDXGICapture::loadMonitorInfos(ID3D11Device *pDevice, std::vector<tagDublicatorMonitorInfo> *pMonitorInfos)
 {
 	CHECK_POINTER(pDevice);
+	CHECK_POINTER(pMonitorInfos);
 
 	HRESULT hr = S_OK;
 	CComPtr<ID3D11Device> ipDevice(pDevice);
@@ -100,19 +124,13 @@ HRESULT CDXGICapture::loadMonitorInfos(ID3D11Device *pDevice)
 				continue;
 			}
 
-			tagDublicatorMonitorInfo *pInfo;
-			pInfo = new (std::nothrow) tagDublicatorMonitorInfo;
-			if (nullptr == pInfo) {
-				return E_OUTOFMEMORY;
-			}
-			
-			hr = DXGICaptureHelper::ConvertDxgiOutputToMonitorInfo(&DesktopDesc, i, pInfo);
+			tagDublicatorMonitorInfo Info;
+			hr = DXGICaptureHelper::ConvertDxgiOutputToMonitorInfo(&DesktopDesc, i, &Info);
 			if (FAILED(hr)) {
-				delete pInfo;
 				continue;
 			}
 
-			m_monitorInfos.push_back(pInfo);
+			pMonitorInfos->push_back(Info);
 		}
 	}
 
@@ -122,23 +140,6 @@ HRESULT CDXGICapture::loadMonitorInfos(ID3D11Device *pDevice)
 	return S_OK;
 }
 
-void CDXGICapture::freeMonitorInfos()
-{
-	size_t nCount = m_monitorInfos.size();
-	if (nCount == 0) {
-		return;
-	}
-	DublicatorMonitorInfoVec::iterator it = m_monitorInfos.begin();
-	DublicatorMonitorInfoVec::iterator end = m_monitorInfos.end();
-	for (size_t i = 0; (i < nCount) && (it != end); i++, it++) {
-		tagDublicatorMonitorInfo *pInfo = *it;
-		if (nullptr != pInfo) {
-			delete pInfo;
-		}
-	}
-	m_monitorInfos.clear();
-}
-
 HRESULT CDXGICapture::createDeviceResource(
 	const tagScreenCaptureFilterConfig *pConfig, 
 	const tagDublicatorMonitorInfo *pSelectedMonitorInfo
@@ -154,6 +155,7 @@ HRESULT CDXGICapture::createDeviceResource(
 	CComPtr<IWICImagingFactory>     ipWICImageFactory;
 	CComPtr<IWICBitmap>             ipWICOutputBitmap;
 	CComPtr<ID2D1RenderTarget>      ipD2D1RenderTarget;
+	CComPtr<ID2D1Bitmap>            ipD2D1SourceBitmap;
 	DXGI_OUTPUT_DESC                dgixOutputDesc;
 	tagRendererInfo                 rendererInfo;
 
@@ -166,6 +168,17 @@ HRESULT CDXGICapture::createDeviceResource(
 	rendererInfo.RotationMode  = pConfig->RotationMode;
 	rendererInfo.SizeMode      = pConfig->SizeMode;
 	rendererInfo.OutputSize    = pConfig->OutputSize;
+	rendererInfo.Incremental   = pConfig->Incremental;
+	rendererInfo.StagingDepth  = pConfig->StagingDepth;
+	rendererInfo.ScaleFilter   = pConfig->ScaleFilter;
+	rendererInfo.EncodeThreads = pConfig->EncodeThreads;
+	rendererInfo.SkipUnchanged = pConfig->SkipUnchanged;
+	rendererInfo.YuvFormat     = pConfig->YuvFormat;
+	rendererInfo.YuvMatrix     = pConfig->YuvMatrix;
+	rendererInfo.YuvRange      = pConfig->YuvRange;
+	if (pConfig->RegionCount > 0) {
+		rendererInfo.Region    = pConfig->Regions[0];
+	}
 	// default
 	rendererInfo.ScaleX        = 1.0f;
 	rendererInfo.ScaleY        = 1.0f;
@@ -199,6 +212,16 @@ HRESULT CDXGICapture::createDeviceResource(
 			break;
 		}
 
+		// a single region, batches of regions are rendered by CDXGICapturePipeline
+		if (pConfig->RegionCount > 1) {
+			hr = E_INVALIDARG;
+			break;
+		}
+		hr = DXGICaptureRegion::Validate(pConfig,
+			(INT)(dgixOutputDesc.DesktopCoordinates.right - dgixOutputDesc.DesktopCoordinates.left),
+			(INT)(dgixOutputDesc.DesktopCoordinates.bottom - dgixOutputDesc.DesktopCoordinates.top));
+		CHECK_HR_BREAK(hr);
+
 		// QI for Output 1
 		CComPtr<IDXGIOutput1> ipDxgiOutput1;
 		hr = ipDxgiOutput->QueryInterface(IID_PPV_ARGS(&ipDxgiOutput1));
@@ -304,14 +327,48 @@ HRESULT CDXGICapture::createDeviceResource(
 			);
 		CHECK_HR_BREAK(hr);
 
+		// create D2D1 source bitmap, it is updated from the copy texture on every frame
+		hr = DXGICaptureHelper::CreateBitmap(ipD2D1RenderTarget, ipCopyTexture2D, &ipD2D1SourceBitmap);
+		CHECK_HR_BREAK(hr);
+
 #pragma endregion </For_2D_operations>
 
+		// Readback ring of the continuous capture, the copy texture is its first slot.
+		// The incremental update needs the single persistent copy texture.
+		if (rendererInfo.StagingDepth <= 0) {
+			rendererInfo.StagingDepth = DXGICAPTURE_STAGING_DEFAULT_DEPTH;
+		}
+		if (rendererInfo.StagingDepth > DXGICAPTURE_STAGING_MAX_DEPTH) {
+			rendererInfo.StagingDepth = DXGICAPTURE_STAGING_MAX_DEPTH;
+		}
+		if (rendererInfo.Incremental) {
+			rendererInfo.StagingDepth = 1;
+		}
+
+		if (rendererInfo.StagingDepth > 1)
+		{
+			hr = m_stagingTextures.Initialize(m_ipD3D11Device, m_ipD3D11DeviceContext, ipDxgiOutputDuplication, ipCopyTexture2D, (UINT)rendererInfo.StagingDepth,
+				(rendererInfo.Region.Width > 0) ? &rendererInfo.CopyBounds : nullptr);
+			CHECK_HR_BREAK(hr);
+
+			hr = m_stagingRing.Initialize(&m_stagingTextures, (UINT)rendererInfo.StagingDepth);
+			CHECK_HR_BREAK(hr);
+		}
+
 	} while (false);
 
+	if (FAILED(hr))
+	{
+		// no half configured readback, the capture is not configured
+		m_stagingRing.Reset();
+		m_stagingTextures.Terminate();
+	}
+
 	if (SUCCEEDED(hr))
 	{
 		// copy output parameters
 		memcpy_s((void*)&m_rendererInfo, sizeof(m_rendererInfo), (const void*)&rendererInfo, sizeof(m_rendererInfo));
+		CHECK_HR_RETURN(m_rendererSnapshot.Publish(m_rendererInfo));
 
 		// set parameters
 		m_desktopOutputDesc       = dgixOutputDesc;
@@ -324,13 +381,41 @@ HRESULT CDXGICapture::createDeviceResource(
 		m_ipWICImageFactory       = ipWICImageFactory;
 		m_ipWICOutputBitmap       = ipWICOutputBitmap;
 		m_ipD2D1RenderTarget      = ipD2D1RenderTarget;
+		m_ipD2D1SourceBitmap      = ipD2D1SourceBitmap;
+
+		// filter tables of the cpu scaler, rotated outputs take the single pass renderer.
+		// An output that equals the desktop image is not drawn at all.
+		m_scaler.Reset();
+		DXGICaptureHelper::GetFrameGeometry(&m_rendererInfo, &m_frameGeometry);
+		m_bPassthrough = DXGICaptureRender::IsPassthrough(&m_frameGeometry, m_rendererInfo.SrcBounds.Width, m_rendererInfo.SrcBounds.Height);
+		m_bCpuRender = !m_bPassthrough && (m_rendererInfo.ScaleFilter != tagFrameScaleFilter_Default);
+		if (m_bCpuRender) {
+			m_scaler.SetConfig(&m_frameGeometry, m_rendererInfo.SrcBounds.Width, m_rendererInfo.SrcBounds.Height, m_rendererInfo.ScaleFilter);
+		}
 	}
 
-	return S_OK;
+	return hr;
 }
 
 void CDXGICapture::terminateDeviceResource()
 {
+	m_stagingRing.Reset();
+	m_stagingTextures.Terminate();
+	m_scaler.Reset();
+	m_bCpuRender = FALSE;
+	m_bPassthrough = FALSE;
+	if (nullptr != m_pRenderedFrame)
+	{
+		m_pRenderedFrame->Release();
+		m_pRenderedFrame = nullptr;
+	}
+	RtlZeroMemory(&m_frameCopyStats, sizeof(m_frameCopyStats));
+
+	m_tileHasher.Reset();
+	m_ullLastSavedHash    = 0;
+	m_guidLastSavedFormat = GUID_NULL;
+	m_lastSavedFileName.clear();
+
 	m_ipDxgiOutputDuplication = nullptr;
 	m_ipCopyTexture2D         = nullptr;
 
@@ -339,9 +424,11 @@ void CDXGICapture::terminateDeviceResource()
 	m_ipWICImageFactory       = nullptr;
 	m_ipWICOutputBitmap       = nullptr;
 	m_ipD2D1RenderTarget      = nullptr;
+	m_ipD2D1SourceBitmap      = nullptr;
 
 	// clear config parameters
 	RtlZeroMemory(&m_rendererInfo, sizeof(m_rendererInfo));
+	m_rendererSnapshot.Clear();
 
 	// clear mouse information parameters
 	if (m_mouseInfo.PtrShapeBuffer != nullptr) {
@@ -350,15 +437,33 @@ void CDXGICapture::terminateDeviceResource()
 	}
 	RtlZeroMemory(&m_mouseInfo, sizeof(m_mouseInfo));
 
-	// clear temp temp buffer
-	if (m_tempMouseBuffer.Buffer != nullptr) {
-		delete[] m_tempMouseBuffer.Buffer;
-		m_tempMouseBuffer.Buffer = nullptr;
+	// clear processed mouse shapes
+	m_cursorCache.Clear();
+
+	// clear temp rotate buffer
+	if (m_tempMouseRotateBuffer.Buffer != nullptr) {
+		delete[] m_tempMouseRotateBuffer.Buffer;
+		m_tempMouseRotateBuffer.Buffer = nullptr;
 	}
-	RtlZeroMemory(&m_tempMouseBuffer, sizeof(m_tempMouseBuffer));
+	RtlZeroMemory(&m_tempMouseRotateBuffer, sizeof(m_tempMouseRotateBuffer));
 
 	// clear desktop output desc
 	RtlZeroMemory(&m_desktopOutputDesc, sizeof(m_desktopOutputDesc));
+
+	// clear incremental update buffers
+	m_bCopyTextureValid = FALSE;
+	if (m_frameMetadataBuffer.Buffer != nullptr) {
+		delete[] m_frameMetadataBuffer.Buffer;
+		m_frameMetadataBuffer.Buffer = nullptr;
+	}
+	RtlZeroMemory(&m_frameMetadataBuffer, sizeof(m_frameMetadataBuffer));
+	if (m_mouseBackground.Buffer != nullptr) {
+		delete[] m_mouseBackground.Buffer;
+		m_mouseBackground.Buffer = nullptr;
+	}
+	RtlZeroMemory(&m_mouseBackground, sizeof(m_mouseBackground));
+	RtlZeroMemory(&m_frameUpdateStats, sizeof(m_frameUpdateStats));
+	m_regionRects.clear();
 }
 
 HRESULT CDXGICapture::Initialize()
@@ -414,7 +519,9 @@ HRESULT CDXGICapture::Initialize()
 	}
 
 	// load all monitor informations
-	hr = loadMonitorInfos(ipDevice);
+	tagCaptureDeviceSnapshot deviceSnapshot;
+	deviceSnapshot.FeatureLevel = lFeatureLevel;
+	hr = loadMonitorInfos(ipDevice, &deviceSnapshot.MonitorInfos);
 	if (FAILED(hr)) {
 		return hr;
 	}
@@ -424,6 +531,16 @@ HRESULT CDXGICapture::Initialize()
 	m_ipD3D11Device        = ipDevice;
 	m_ipD3D11DeviceContext = ipDeviceContext;
 
+	// published last, IsInitialized reads the snapshot without the lock
+	hr = m_deviceSnapshot.Publish(deviceSnapshot);
+	if (FAILED(hr))
+	{
+		m_ipD3D11Device        = nullptr;
+		m_ipD3D11DeviceContext = nullptr;
+		m_lD3DFeatureLevel     = D3D_FEATURE_LEVEL_INVALID;
+		return hr;
+	}
+
 	m_bInitialized = TRUE;
 
 	return S_OK;
@@ -431,19 +548,28 @@ HRESULT CDXGICapture::Initialize()
 
 HRESULT CDXGICapture::Terminate()
 {
+	// the capture thread takes the lock, stop it first
+	this->StopCapture();
+
 	AUTOLOCK();
 	if (!m_bInitialized) {
 		return S_FALSE; // already terminated
 	}
 
+	// cleared first, IsInitialized reads the snapshot without the lock
+	m_deviceSnapshot.Clear();
+
 	this->terminateDeviceResource();
 
+	if (nullptr != m_pFramePool) {
+		m_pFramePool->Release(); // frames still held by the consumer keep the pool alive
+		m_pFramePool = nullptr;
+	}
+
 	m_ipD3D11Device = nullptr;
 	m_ipD3D11DeviceContext = nullptr;
 	m_lD3DFeatureLevel = D3D_FEATURE_LEVEL_INVALID;
 
-	freeMonitorInfos();
-
 	m_bInitialized = FALSE;
 	return S_OK;
 }
@@ -459,18 +585,20 @@ HRESULT CDXGICapture::SetConfig(const tagScreenCaptureFilterConfig *pConfig)
 		return E_INVALIDARG;
 	}
 
+	if (m_bCaptureRunning) {
+		return HRESULT_FROM_WIN32(ERROR_BUSY); // stop the capture first
+	}
+
 	// terminate old resources
 	this->terminateDeviceResource();
 
-	HRESULT hr = S_OK;
-	const tagDublicatorMonitorInfo *pSelectedMonitorInfo = nullptr;
-
-	pSelectedMonitorInfo = this->FindDublicatorMonitorInfo(pConfig->MonitorIdx);
-	if (nullptr == pSelectedMonitorInfo) {
+	tagDublicatorMonitorInfo selectedMonitorInfo;
+	HRESULT hr = this->FindDublicatorMonitorInfo(pConfig->MonitorIdx, &selectedMonitorInfo);
+	if (hr != S_OK) {
 		return E_INVALIDARG;
 	}
 
-	hr = this->createDeviceResource(pConfig, pSelectedMonitorInfo);
+	hr = this->createDeviceResource(pConfig, &selectedMonitorInfo);
 	if (FAILED(hr)) {
 		return hr;
 	}
@@ -483,105 +611,335 @@ HRESULT CDXGICapture::SetConfig(const tagScreenCaptureFilterConfig &config)
 	return this->SetConfig(&config);
 }
 
-BOOL CDXGICapture::IsInitialized() const
+HRESULT CDXGICapture::ReleaseDuplication()
 {
 	AUTOLOCK();
-	return m_bInitialized;
+	if (!m_bInitialized) {
+		return D2DERR_NOT_INITIALIZED;
+	}
+
+	if (m_bCaptureRunning) {
+		return HRESULT_FROM_WIN32(ERROR_BUSY); // stop the capture first
+	}
+
+	// the staging textures hold the duplication too
+	m_stagingRing.Reset();
+	m_stagingTextures.Terminate();
+	m_bCopyTextureValid = FALSE;
+	m_ipDxgiOutputDuplication = nullptr;
+	return S_OK;
+}
+
+BOOL CDXGICapture::IsInitialized() const
+{
+	return m_deviceSnapshot.IsPublished();
 }
 
 D3D_FEATURE_LEVEL CDXGICapture::GetD3DFeatureLevel() const
 {
-	AUTOLOCK();
-	return m_lD3DFeatureLevel;
+	CDXGICaptureSnapshot<tagCaptureDeviceSnapshot>::CReader reader(m_deviceSnapshot);
+	return (nullptr != reader.Get()) ? reader.Get()->FeatureLevel : D3D_FEATURE_LEVEL_INVALID;
 }
 
 int CDXGICapture::GetDublicatorMonitorInfoCount() const
 {
-	AUTOLOCK();
-	return (int)m_monitorInfos.size();
+	CDXGICaptureSnapshot<tagCaptureDeviceSnapshot>::CReader reader(m_deviceSnapshot);
+	return (nullptr != reader.Get()) ? (int)reader.Get()->MonitorInfos.size() : 0;
 }
 
-const tagDublicatorMonitorInfo* CDXGICapture::GetDublicatorMonitorInfo(int index) const
+//
+// The snapshot may be deleted once the reader has left (Terminate on another
+// thread), so the infos are copied out while it is held
+//
+HRESULT CDXGICapture::GetDublicatorMonitorInfo(_In_ int index, _Out_ tagDublicatorMonitorInfo *pInfo) const
 {
-	AUTOLOCK();
+	CHECK_POINTER_EX(pInfo, E_INVALIDARG);
 
-	size_t nCount = m_monitorInfos.size();
-	if ((index < 0) || (index >= (int)nCount)) {
-		return nullptr;
+	CDXGICaptureSnapshot<tagCaptureDeviceSnapshot>::CReader reader(m_deviceSnapshot);
+	const tagCaptureDeviceSnapshot *pSnapshot = reader.Get();
+	if ((nullptr == pSnapshot) || (index < 0) || (index >= (int)pSnapshot->MonitorInfos.size())) {
+		return S_FALSE;
 	}
 
-	return m_monitorInfos[index];
+	*pInfo = pSnapshot->MonitorInfos[index];
+	return S_OK;
 } // GetDublicatorMonitorInfo
 
-const tagDublicatorMonitorInfo* CDXGICapture::FindDublicatorMonitorInfo(int monitorIdx) const
+HRESULT CDXGICapture::FindDublicatorMonitorInfo(_In_ int monitorIdx, _Out_ tagDublicatorMonitorInfo *pInfo) const
 {
-	AUTOLOCK();
+	CHECK_POINTER_EX(pInfo, E_INVALIDARG);
 
-	size_t nCount = m_monitorInfos.size();
-	if (nCount == 0) {
-		return nullptr;
+	CDXGICaptureSnapshot<tagCaptureDeviceSnapshot>::CReader reader(m_deviceSnapshot);
+	const tagCaptureDeviceSnapshot *pSnapshot = reader.Get();
+	if (nullptr == pSnapshot) {
+		return S_FALSE;
 	}
-	DublicatorMonitorInfoVec::const_iterator it = m_monitorInfos.begin();
-	DublicatorMonitorInfoVec::const_iterator end = m_monitorInfos.end();
-	for (size_t i = 0; (i < nCount) && (it != end); i++, it++) {
-		tagDublicatorMonitorInfo *pInfo = *it;
-		if (monitorIdx == pInfo->Idx) {
-			return pInfo;
+
+	for (size_t i = 0; i < pSnapshot->MonitorInfos.size(); ++i)
+	{
+		if (monitorIdx == pSnapshot->MonitorInfos[i].Idx)
+		{
+			*pInfo = pSnapshot->MonitorInfos[i];
+			return S_OK;
 		}
 	}
 
-	return nullptr;
+	return S_FALSE;
 } // FindDublicatorMonitorInfo
 
+HRESULT CDXGICapture::GetRendererInfo(_Out_ tagRendererInfo *pInfo) const
+{
+	return m_rendererSnapshot.Get(pInfo);
+}
+
 //
 // CaptureToFile
 //
-HRESULT CDXGICapture::CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ BOOL *pRetIsTimeout /*= NULL*/, _Out_opt_ UINT *pRetRenderDuration /*= NULL*/)
+HRESULT CDXGICapture::GetCursorCacheStats(_Out_ tagCursorCacheStats *pStats) const
 {
 	AUTOLOCK();
+	CHECK_POINTER_EX(pStats, E_INVALIDARG);
 
-	if (nullptr != pRetIsTimeout) {
-		*pRetIsTimeout = FALSE;
-	}
+	m_cursorCache.GetStats(pStats);
+	return S_OK;
+}
 
-	if (nullptr != pRetRenderDuration) {
-		*pRetRenderDuration = 0xFFFFFFFF;
+HRESULT CDXGICapture::ResetCursorCacheStats()
+{
+	AUTOLOCK();
+	m_cursorCache.ResetStats();
+	return S_OK;
+}
+
+HRESULT CDXGICapture::GetFrameUpdateStats(_Out_ tagFrameUpdateStats *pStats) const
+{
+	AUTOLOCK();
+	CHECK_POINTER_EX(pStats, E_INVALIDARG);
+
+	*pStats = m_frameUpdateStats;
+	return S_OK;
+}
+
+HRESULT CDXGICapture::GetFrameCopyStats(_Out_ tagFrameCopyStats *pStats) const
+{
+	AUTOLOCK();
+	CHECK_POINTER_EX(pStats, E_INVALIDARG);
+
+	*pStats = m_frameCopyStats;
+	return S_OK;
+}
+
+HRESULT CDXGICapture::GetStagingRingStats(_Out_ tagStagingRingStats *pStats) const
+{
+	AUTOLOCK();
+	CHECK_POINTER_EX(pStats, E_INVALIDARG);
+
+	m_stagingRing.GetStats(pStats);
+	return S_OK;
+}
+
+HRESULT CDXGICapture::GetChangedTiles(_Out_ tagTileChangeInfo *pInfo, _Out_writes_opt_(uiBitmapWords) UINT64 *pBitmap, _In_ UINT uiBitmapWords) const
+{
+	AUTOLOCK();
+	CHECK_POINTER_EX(pInfo, E_INVALIDARG);
+	RtlZeroMemory(pInfo, sizeof(*pInfo));
+
+	if (!m_tileHasher.IsValid()) {
+		return E_NOT_VALID_STATE; // SkipUnchanged is off or no image was captured yet
 	}
 
-	if (!m_bInitialized) {
-		return D2DERR_NOT_INITIALIZED;
+	m_tileHasher.GetChangeInfo(pInfo);
+	if (nullptr == pBitmap) {
+		return S_OK;
+	}
+	if (uiBitmapWords < pInfo->BitmapWords) {
+		return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
 	}
 
-	CHECK_POINTER_EX(m_ipDxgiOutputDuplication, E_INVALIDARG);
-	CHECK_POINTER_EX(lpcwOutputFileName, E_INVALIDARG);
+	memcpy(pBitmap, m_tileHasher.GetChangedBitmap(), pInfo->BitmapWords * sizeof(UINT64));
+	return S_OK;
+}
+
+HRESULT CDXGICapture::GetTileHashStats(_Out_ tagTileHashStats *pStats) const
+{
+	AUTOLOCK();
+	CHECK_POINTER_EX(pStats, E_INVALIDARG);
+
+	m_tileHasher.GetStats(pStats);
+	return S_OK;
+}
+
+CDXGICaptureMetrics* CDXGICapture::GetMetrics()
+{
+	return &m_metrics;
+}
+
+HRESULT CDXGICapture::ExportMetricsJson(_Out_ std::string *pJson) const
+{
+	CHECK_POINTER_EX(pJson, E_INVALIDARG);
+	return m_metrics.ExportJson(pJson);
+}
+
+//
+// Brings the copy texture up to date with the acquired desktop image.
+// Incremental mode: the mouse background is restored, the move rects are applied
+// on the cpu and only the dirty rects are copied, otherwise the whole image is copied.
+// With a region the copy texture holds only the region: the full copy is the region
+// box, and the dirty rects and move destinations inside it are copied on the gpu.
+//
+HRESULT CDXGICapture::updateCopyTexture(const DXGI_OUTDUPL_FRAME_INFO *pFrameInfo, ID3D11Texture2D *pAcquiredDesktopImage)
+{
+	AUTOLOCK();
+	CHECK_POINTER_EX(pFrameInfo, E_INVALIDARG);
+	CHECK_POINTER_EX(pAcquiredDesktopImage, E_INVALIDARG);
 
 	HRESULT hr = S_OK;
 
-	hr = DXGICaptureHelper::IsRendererInfoValid(&m_rendererInfo);
-	if (FAILED(hr)) {
-		return hr;
+	D3D11_TEXTURE2D_DESC desc;
+	m_ipCopyTexture2D->GetDesc(&desc);
+
+	RtlZeroMemory(&m_frameUpdateStats, sizeof(m_frameUpdateStats));
+	m_frameUpdateStats.BytesTotal = (UINT64)desc.Width * desc.Height * 4;
+
+	const BOOL bRegion = (m_rendererInfo.Region.Width > 0);
+	const D3D11_BOX boxRegion = {
+		(UINT)m_rendererInfo.CopyBounds.X,
+		(UINT)m_rendererInfo.CopyBounds.Y,
+		0,
+		(UINT)(m_rendererInfo.CopyBounds.X + m_rendererInfo.CopyBounds.Width),
+		(UINT)(m_rendererInfo.CopyBounds.Y + m_rendererInfo.CopyBounds.Height),
+		1 };
+
+	// the rects are in the orientation of the acquired image, only identity is handled
+	BOOL bIncremental = m_rendererInfo.Incremental && m_bCopyTextureValid &&
+		((m_desktopOutputDesc.Rotation == DXGI_MODE_ROTATION_IDENTITY) || (m_desktopOutputDesc.Rotation == DXGI_MODE_ROTATION_UNSPECIFIED));
+
+	tagFrameMoveRect *pMoveRects  = nullptr;
+	tagFrameRect     *pDirtyRects = nullptr;
+	UINT             uiMoveCount  = 0;
+	UINT             uiDirtyCount = 0;
+
+	if (bIncremental)
+	{
+		hr = DXGICaptureHelper::GetFrameMetadata(m_ipDxgiOutputDuplication, pFrameInfo, &m_frameMetadataBuffer, &pMoveRects, &uiMoveCount, &pDirtyRects, &uiDirtyCount);
+		if (FAILED(hr)) {
+			bIncremental = FALSE; // fall back to a full copy
+		}
 	}
 
-	// is valid?
-	hr = DXGICaptureHelper::GetContainerFormatByFileName(lpcwOutputFileName);
-	if (FAILED(hr)) {
-		return hr;
+	if (!bIncremental)
+	{
+		// Copy needed full part of desktop image
+		if (bRegion) {
+			m_ipD3D11DeviceContext->CopySubresourceRegion(m_ipCopyTexture2D, 0, 0, 0, 0, pAcquiredDesktopImage, 0, &boxRegion);
+		}
+		else {
+			m_ipD3D11DeviceContext->CopyResource(m_ipCopyTexture2D, pAcquiredDesktopImage);
+		}
+
+		m_frameUpdateStats.FullUpdate   = TRUE;
+		m_frameUpdateStats.BytesCopied  = m_frameUpdateStats.BytesTotal;
+		m_frameUpdateStats.BytesTouched = m_frameUpdateStats.BytesTotal;
+
+		m_bCopyTextureValid = TRUE;
+		m_mouseBackground.Bounds.Width = 0;
+		return S_OK;
+	}
+
+	m_frameUpdateStats.MoveRectCount  = uiMoveCount;
+	if (bRegion)
+	{
+		// the move sources may lie outside of the region, the destinations are copied like dirty rects
+		const tagFrameRect rcRegion = { (LONG)boxRegion.left, (LONG)boxRegion.top, (LONG)boxRegion.right, (LONG)boxRegion.bottom };
+		m_regionRects.clear();
+		DXGICaptureRegion::ClipRects(pDirtyRects, uiDirtyCount, rcRegion, &m_regionRects);
+		for (UINT i = 0; i < uiMoveCount; ++i) {
+			DXGICaptureRegion::ClipRects(&pMoveRects[i].Dst, 1, rcRegion, &m_regionRects);
+		}
+		pMoveRects   = nullptr;
+		uiMoveCount  = 0;
+		pDirtyRects  = m_regionRects.empty() ? nullptr : &m_regionRects[0];
+		uiDirtyCount = (UINT)m_regionRects.size();
+	}
+
+	uiDirtyCount = (uiDirtyCount > 0) ? DXGICaptureDirtyRects::MergeRects(pDirtyRects, uiDirtyCount, (INT)desc.Width, (INT)desc.Height) : 0;
+
+	m_frameUpdateStats.DirtyRectCount = uiDirtyCount;
+
+	// restore the pixels under the last drawn mouse, then apply the moves (cpu side)
+	if ((m_mouseBackground.Bounds.Width > 0) || (uiMoveCount > 0))
+	{
+		CComPtr<IDXGISurface> ipCopySurface;
+		hr = m_ipCopyTexture2D->QueryInterface(__uuidof(IDXGISurface), (void **)&ipCopySurface);
+		CHECK_HR_RETURN(hr);
+
+		DXGI_MAPPED_RECT MappedSurface;
+		hr = ipCopySurface->Map(&MappedSurface, DXGI_MAP_READ | DXGI_MAP_WRITE);
+		CHECK_HR_RETURN(hr);
+
+		if (m_mouseBackground.Bounds.Width > 0)
+		{
+			tagFrameRect rcMouse = {
+				m_mouseBackground.Bounds.X,
+				m_mouseBackground.Bounds.Y,
+				m_mouseBackground.Bounds.X + m_mouseBackground.Bounds.Width,
+				m_mouseBackground.Bounds.Y + m_mouseBackground.Bounds.Height };
+			m_frameUpdateStats.BytesTouched += DXGICaptureDirtyRects::CopyBackground(MappedSurface.pBits, MappedSurface.Pitch, m_mouseBackground.Buffer, rcMouse, FALSE);
+			m_mouseBackground.Bounds.Width = 0;
+		}
+
+		m_frameUpdateStats.BytesMoved = DXGICaptureDirtyRects::ApplyMoves(MappedSurface.pBits, MappedSurface.Pitch, (INT)desc.Width, (INT)desc.Height, pMoveRects, uiMoveCount);
+
+		hr = ipCopySurface->Unmap();
+		CHECK_HR_RETURN(hr);
+	}
+
+	// copy the dirty rects (gpu side)
+	for (UINT i = 0; i < uiDirtyCount; ++i)
+	{
+		const tagFrameRect &rc = pDirtyRects[i];
+		D3D11_BOX box = {
+			(UINT)(rc.Left + m_rendererInfo.CopyBounds.X),
+			(UINT)(rc.Top + m_rendererInfo.CopyBounds.Y),
+			0,
+			(UINT)(rc.Right + m_rendererInfo.CopyBounds.X),
+			(UINT)(rc.Bottom + m_rendererInfo.CopyBounds.Y),
+			1 };
+		m_ipD3D11DeviceContext->CopySubresourceRegion(m_ipCopyTexture2D, 0, (UINT)rc.Left, (UINT)rc.Top, 0, pAcquiredDesktopImage, 0, &box);
+		m_frameUpdateStats.BytesCopied += (UINT64)(rc.Right - rc.Left) * (rc.Bottom - rc.Top) * 4;
+	}
+
+	m_frameUpdateStats.BytesTouched += m_frameUpdateStats.BytesMoved + m_frameUpdateStats.BytesCopied;
+
+	return S_OK;
+} // updateCopyTexture
+
+//
+// Acquires the next desktop image, draws the mouse and renders the output bitmap.
+// Returns S_FALSE if no new image arrived within the timeout.
+//
+HRESULT CDXGICapture::renderFrame(UINT uiTimeoutMsec, BOOL *pRetIsTimeout)
+{
+	AUTOLOCK();
+
+	if (nullptr != pRetIsTimeout) {
+		*pRetIsTimeout = FALSE;
 	}
 
+	CHECK_POINTER_EX(m_ipDxgiOutputDuplication, E_INVALIDARG);
+
+	HRESULT hr = S_OK;
+
 	DXGI_OUTDUPL_FRAME_INFO     FrameInfo;
 	CComPtr<IDXGIResource>      ipDesktopResource;
 	CComPtr<ID3D11Texture2D>    ipAcquiredDesktopImage;
-	CComPtr<ID2D1Bitmap>        ipD2D1SourceBitmap;
-
-	std::chrono::system_clock::time_point startTick;
-	if (nullptr != pRetRenderDuration) {
-		startTick = std::chrono::high_resolution_clock::now();
-	}
+	CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
 
 	// Get new frame
-	hr = m_ipDxgiOutputDuplication->AcquireNextFrame(1000, &FrameInfo, &ipDesktopResource);
+	hr = m_ipDxgiOutputDuplication->AcquireNextFrame(uiTimeoutMsec, &FrameInfo, &ipDesktopResource);
 	if (hr == DXGI_ERROR_WAIT_TIMEOUT)
 	{
+		m_metrics.RecordAcquire(CDXGICaptureMetrics::Lap(&tick), TRUE, 0);
 		if (nullptr != pRetIsTimeout) {
 			*pRetIsTimeout = TRUE;
 		}
@@ -591,6 +949,8 @@ HRESULT CDXGICapture::CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ B
 	{
 		return hr;
 	}
+	m_metrics.RecordAcquire(CDXGICaptureMetrics::Lap(&tick), FALSE, FrameInfo.AccumulatedFrames);
+	CDXGICaptureMetrics::ResetFrameTimes(&m_frameTimes);
 
 	// QI for ID3D11Texture2D
 	hr = ipDesktopResource->QueryInterface(IID_PPV_ARGS(&ipAcquiredDesktopImage));
@@ -604,13 +964,30 @@ HRESULT CDXGICapture::CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ B
 		return E_OUTOFMEMORY;
 	}
 
-	// Copy needed full part of desktop image
-	m_ipD3D11DeviceContext->CopyResource(m_ipCopyTexture2D, ipAcquiredDesktopImage);
+	// Copy needed part of desktop image
+	hr = this->updateCopyTexture(&FrameInfo, ipAcquiredDesktopImage);
+	if (FAILED(hr)) {
+		// release frame
+		m_ipDxgiOutputDuplication->ReleaseFrame();
+		return hr;
+	}
+
+	RtlZeroMemory(&m_frameCopyStats, sizeof(m_frameCopyStats));
+	m_frameCopyStats.Passthrough = m_bPassthrough;
+	DXGICaptureCopy::AddCopy(&m_frameCopyStats, m_frameUpdateStats.BytesCopied);
+	CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
 
 	if (m_rendererInfo.ShowCursor) {
 		hr = DXGICaptureHelper::GetMouse(m_ipDxgiOutputDuplication, &m_mouseInfo, &FrameInfo, (UINT)m_rendererInfo.MonitorIdx, m_desktopOutputDesc.DesktopCoordinates.left, m_desktopOutputDesc.DesktopCoordinates.top);
-		if (SUCCEEDED(hr) && m_mouseInfo.Visible) {
-			hr = DXGICaptureHelper::DrawMouse(&m_mouseInfo, &m_desktopOutputDesc, &m_tempMouseBuffer, m_ipCopyTexture2D);
+		CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_CursorFetch, CDXGICaptureMetrics::Lap(&tick));
+		if (SUCCEEDED(hr) && m_mouseInfo.Visible)
+		{
+			tagMouseInfo mouseInfo = m_mouseInfo;
+			DXGI_OUTPUT_DESC outputDesc;
+			DXGICaptureHelper::GetRegionMouse(&m_rendererInfo, &m_desktopOutputDesc, &mouseInfo, &outputDesc);
+			hr = DXGICaptureHelper::DrawMouse(&mouseInfo, &outputDesc, &m_cursorCache, &m_tempMouseRotateBuffer, m_ipCopyTexture2D,
+				m_rendererInfo.Incremental ? &m_mouseBackground : nullptr);
+			CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_CursorComposite, CDXGICaptureMetrics::Lap(&tick));
 		}
 
 		if (FAILED(hr)) {
@@ -624,9 +1001,193 @@ HRESULT CDXGICapture::CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ B
 	hr = m_ipDxgiOutputDuplication->ReleaseFrame();
 	CHECK_HR_RETURN(hr);
 
-	// create D2D1 source bitmap
-	hr = DXGICaptureHelper::CreateBitmap(m_ipD2D1RenderTarget, m_ipCopyTexture2D, &ipD2D1SourceBitmap);
+	if (m_bPassthrough || m_bCpuRender)
+	{
+		// copy or draw the copy texture into the output frame on the cpu
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		hr = m_ipD3D11DeviceContext->Map(m_ipCopyTexture2D, 0, D3D11_MAP_READ, 0, &mapped);
+		CHECK_HR_RETURN(hr);
+		CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
+
+		hr = this->renderOutputFrame(reinterpret_cast<const BYTE*>(mapped.pData), (INT)mapped.RowPitch);
+		m_ipD3D11DeviceContext->Unmap(m_ipCopyTexture2D, 0);
+		CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Render, CDXGICaptureMetrics::Lap(&tick));
+		return hr;
+	}
+
+	// update D2D1 source bitmap (persistent, updated in place)
+	hr = DXGICaptureHelper::UpdateBitmap(m_ipD2D1SourceBitmap, m_ipCopyTexture2D);
 	CHECK_HR_RETURN(hr);
+	DXGICaptureCopy::AddCopy(&m_frameCopyStats, (UINT64)m_rendererInfo.SrcBounds.Width * m_rendererInfo.SrcBounds.Height * 4);
+	CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
+
+	hr = this->drawOutputBitmap();
+	CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Render, CDXGICaptureMetrics::Lap(&tick));
+	return hr;
+} // renderFrame
+
+//
+// Continuous capture through the staging ring. The new desktop image is copied
+// into the next staging slot and released right away; the oldest slot is
+// processed when the ring is full, or when no new image arrived (idle desktop).
+// Returns S_FALSE if no frame was rendered.
+//
+HRESULT CDXGICapture::renderStagedFrame(UINT uiTimeoutMsec, BOOL *pRetIsTimeout, INT64 *pRetCaptureTime)
+{
+	AUTOLOCK();
+
+	if (nullptr != pRetIsTimeout) {
+		*pRetIsTimeout = FALSE;
+	}
+
+	CHECK_POINTER_EX(m_ipDxgiOutputDuplication, E_INVALIDARG);
+	CHECK_POINTER_EX(pRetCaptureTime, E_INVALIDARG);
+
+	HRESULT hr = S_OK;
+
+	DXGI_OUTDUPL_FRAME_INFO     FrameInfo;
+	CComPtr<IDXGIResource>      ipDesktopResource;
+	CComPtr<ID3D11Texture2D>    ipAcquiredDesktopImage;
+	CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+
+	// Get new frame
+	hr = m_ipDxgiOutputDuplication->AcquireNextFrame(uiTimeoutMsec, &FrameInfo, &ipDesktopResource);
+	if (hr == DXGI_ERROR_WAIT_TIMEOUT)
+	{
+		m_metrics.RecordAcquire(CDXGICaptureMetrics::Lap(&tick), TRUE, 0);
+		if (m_stagingRing.IsEmpty())
+		{
+			if (nullptr != pRetIsTimeout) {
+				*pRetIsTimeout = TRUE;
+			}
+			return S_FALSE;
+		}
+		// nothing new, drain the ring
+	}
+	else if (FAILED(hr))
+	{
+		return hr;
+	}
+	else
+	{
+		// the stage times of the slots add up until a frame is delivered
+		m_metrics.RecordAcquire(CDXGICaptureMetrics::Lap(&tick), FALSE, FrameInfo.AccumulatedFrames);
+
+		// QI for ID3D11Texture2D
+		hr = ipDesktopResource->QueryInterface(IID_PPV_ARGS(&ipAcquiredDesktopImage));
+		ipDesktopResource = nullptr;
+		if (FAILED(hr) || (nullptr == ipAcquiredDesktopImage))
+		{
+			// release frame
+			m_ipDxgiOutputDuplication->ReleaseFrame();
+			return FAILED(hr) ? hr : E_OUTOFMEMORY;
+		}
+
+		// the pointer of this frame, it is drawn when the slot is processed
+		if (m_rendererInfo.ShowCursor)
+		{
+			hr = DXGICaptureHelper::GetMouse(m_ipDxgiOutputDuplication, &m_mouseInfo, &FrameInfo, (UINT)m_rendererInfo.MonitorIdx, m_desktopOutputDesc.DesktopCoordinates.left, m_desktopOutputDesc.DesktopCoordinates.top);
+			if (FAILED(hr))
+			{
+				// release frame
+				m_ipDxgiOutputDuplication->ReleaseFrame();
+				return hr;
+			}
+			CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_CursorFetch, CDXGICaptureMetrics::Lap(&tick));
+		}
+
+		// queue the copy, the frame is released by the ring once the copy is queued
+		UINT uiSlot = 0;
+		m_stagingTextures.SetSource(ipAcquiredDesktopImage);
+		hr = m_stagingRing.Submit(m_stagingRing.GetSubmittedCount() + 1, this->getCaptureTime(), &uiSlot);
+		if (FAILED(hr))
+		{
+			// release frame
+			m_stagingTextures.SetSource(nullptr);
+			m_ipDxgiOutputDuplication->ReleaseFrame();
+			return hr;
+		}
+
+		m_stagingMousePosition[uiSlot] = m_mouseInfo.Position;
+		m_stagingMouseVisible[uiSlot]  = m_mouseInfo.Visible;
+
+		RtlZeroMemory(&m_frameUpdateStats, sizeof(m_frameUpdateStats));
+		m_frameUpdateStats.BytesTotal   = (UINT64)m_rendererInfo.SrcBounds.Width * m_rendererInfo.SrcBounds.Height * 4;
+		m_frameUpdateStats.BytesCopied  = m_frameUpdateStats.BytesTotal;
+		m_frameUpdateStats.BytesTouched = m_frameUpdateStats.BytesTotal;
+		m_frameUpdateStats.FullUpdate   = TRUE;
+		CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
+
+		if (!m_stagingRing.IsFull())
+		{
+			// keep the gpu busy, nothing to deliver yet
+			if (nullptr != pRetIsTimeout) {
+				*pRetIsTimeout = TRUE;
+			}
+			return S_FALSE;
+		}
+	}
+
+	// process the oldest slot
+	tagStagingFrame stagingFrame;
+	hr = m_stagingRing.MapOldest(this->getCaptureTime(), &stagingFrame);
+	if (hr != S_OK) {
+		return FAILED(hr) ? hr : E_UNEXPECTED;
+	}
+
+	// the slot holds a full copy of its desktop image
+	const UINT64 ullSourceBytes = (UINT64)m_rendererInfo.SrcBounds.Width * m_rendererInfo.SrcBounds.Height * 4;
+	const BOOL bDirect = m_bPassthrough || m_bCpuRender;
+	RtlZeroMemory(&m_frameCopyStats, sizeof(m_frameCopyStats));
+	m_frameCopyStats.Passthrough = m_bPassthrough;
+	DXGICaptureCopy::AddCopy(&m_frameCopyStats, ullSourceBytes);
+	CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
+
+	if (m_rendererInfo.ShowCursor && m_stagingMouseVisible[stagingFrame.Slot])
+	{
+		tagMouseInfo mouseInfo = m_mouseInfo;
+		mouseInfo.Position = m_stagingMousePosition[stagingFrame.Slot];
+		mouseInfo.Visible  = true;
+		DXGI_OUTPUT_DESC outputDesc;
+		DXGICaptureHelper::GetRegionMouse(&m_rendererInfo, &m_desktopOutputDesc, &mouseInfo, &outputDesc);
+		hr = DXGICaptureHelper::DrawMouseToBuffer(&mouseInfo, &outputDesc, &m_cursorCache, &m_tempMouseRotateBuffer,
+			stagingFrame.Data, stagingFrame.Pitch, m_rendererInfo.SrcBounds.Width, m_rendererInfo.SrcBounds.Height);
+		CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_CursorComposite, CDXGICaptureMetrics::Lap(&tick));
+	}
+
+	// update D2D1 source bitmap, or copy/draw the mapped slot into the output frame
+	if (SUCCEEDED(hr) && bDirect) {
+		hr = this->renderOutputFrame(stagingFrame.Data, stagingFrame.Pitch);
+	}
+	else if (SUCCEEDED(hr))
+	{
+		hr = m_ipD2D1SourceBitmap->CopyFromMemory(NULL, (const void*)stagingFrame.Data, stagingFrame.Pitch);
+		DXGICaptureCopy::AddCopy(&m_frameCopyStats, ullSourceBytes);
+	}
+
+	HRESULT hrUnmap = m_stagingRing.UnmapOldest(&stagingFrame);
+	CHECK_HR_RETURN(hr);
+	CHECK_HR_RETURN(hrUnmap);
+	CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, bDirect ? tagCaptureStage_Render : tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
+
+	*pRetCaptureTime = stagingFrame.SubmitTime;
+
+	if (!bDirect)
+	{
+		hr = this->drawOutputBitmap();
+		CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Render, CDXGICaptureMetrics::Lap(&tick));
+	}
+	return hr;
+} // renderStagedFrame
+
+//
+// Renders the source bitmap into the output bitmap (rotate, scale)
+//
+HRESULT CDXGICapture::drawOutputBitmap()
+{
+	AUTOLOCK();
+
+	HRESULT hr = S_OK;
 
 	D2D1_RECT_F rcSource = D2D1::RectF(
 		(FLOAT)m_rendererInfo.SrcBounds.X,
@@ -657,7 +1218,7 @@ HRESULT CDXGICapture::CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ B
 	m_ipD2D1RenderTarget->BeginDraw();
 	// clear background color
 	m_ipD2D1RenderTarget->Clear(D2D1::ColorF(D2D1::ColorF::Black, 1.0f));
-	m_ipD2D1RenderTarget->DrawBitmap(ipD2D1SourceBitmap, rcTarget, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, rcSource);
+	m_ipD2D1RenderTarget->DrawBitmap(m_ipD2D1SourceBitmap, rcTarget, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR, rcSource);
 	// Reset transform
 	//m_ipD2D1RenderTarget->SetTransform(D2D1::Matrix3x2F::Identity());
 	// Logo draw sample
@@ -667,17 +1228,525 @@ HRESULT CDXGICapture::CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ B
 		return hr;
 	}
 
-	// calculate render time without save
+	DXGICaptureCopy::AddCopy(&m_frameCopyStats, (UINT64)m_rendererInfo.OutputSize.Width * m_rendererInfo.OutputSize.Height * 4);
+	return S_OK;
+} // drawOutputBitmap
+
+//
+// Copies (passthrough) or draws the mapped desktop image into a new frame of the
+// frame pool on the cpu, scaled (m_scaler) or rotated (DXGICaptureRender).
+// The frame is taken by the next copyOutputToFrame.
+//
+HRESULT CDXGICapture::renderOutputFrame(const BYTE *pSrc, INT nSrcPitch)
+{
+	AUTOLOCK();
+	CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+	CHECK_POINTER_EX(m_pFramePool, E_INVALIDARG);
+
+	if (nullptr != m_pRenderedFrame)
+	{
+		m_pRenderedFrame->Release(); // never taken
+		m_pRenderedFrame = nullptr;
+	}
+
+	INT nWidth  = (INT)m_rendererInfo.OutputSize.Width;
+	INT nHeight = (INT)m_rendererInfo.OutputSize.Height;
+	INT nPitch  = nWidth * 4;
+
+	CDXGICaptureFrame *pFrame = m_pFramePool->AcquireFrame(nWidth, nHeight, nPitch);
+	if (nullptr == pFrame) {
+		return E_OUTOFMEMORY;
+	}
+
+	HRESULT hr = S_OK;
+	if (m_bPassthrough)
+	{
+		// opaque like the D2D1 drawing over the black background
+		DXGICaptureCopy::CopyPixels(pSrc, nSrcPitch, pFrame->GetBuffer(), nPitch, nWidth, nHeight, TRUE, tagSimdLevel_Auto, &m_frameCopyStats);
+	}
+	else
+	{
+		hr = m_scaler.IsConfigured()
+			? m_scaler.Scale(pSrc, nSrcPitch, pFrame->GetBuffer(), nPitch)
+			: DXGICaptureRender::Render(pSrc, nSrcPitch, m_rendererInfo.SrcBounds.Width, m_rendererInfo.SrcBounds.Height, &m_frameGeometry, pFrame->GetBuffer(), nPitch);
+		DXGICaptureCopy::AddCopy(&m_frameCopyStats, (UINT64)nPitch * nHeight);
+	}
+	if (FAILED(hr))
+	{
+		pFrame->Release();
+		return hr;
+	}
+
+	m_pRenderedFrame = pFrame;
+	return S_OK;
+} // renderOutputFrame
+
+HRESULT CDXGICapture::CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ BOOL *pRetIsTimeout /*= NULL*/, _Out_opt_ UINT *pRetRenderDuration /*= NULL*/, _Out_opt_ BOOL *pRetIsUnchanged /*= NULL*/)
+{
+	if (nullptr != pRetIsTimeout) {
+		*pRetIsTimeout = FALSE;
+	}
+
+	if (nullptr != pRetIsUnchanged) {
+		*pRetIsUnchanged = FALSE;
+	}
+
 	if (nullptr != pRetRenderDuration) {
-		*pRetRenderDuration = (UINT)((std::chrono::high_resolution_clock::now() - startTick).count() / 10000);
+		*pRetRenderDuration = 0xFFFFFFFF;
 	}
 
-	hr = DXGICaptureHelper::SaveImageToFile(m_ipWICImageFactory, m_ipWICOutputBitmap, lpcwOutputFileName);
+	HRESULT hr = S_OK;
+	CDXGICaptureFrame *pFrame = nullptr;
+	{
+		AUTOLOCK();
+
+		if (!m_bInitialized) {
+			return D2DERR_NOT_INITIALIZED;
+		}
+
+		CHECK_POINTER_EX(m_ipDxgiOutputDuplication, E_INVALIDARG);
+		CHECK_POINTER_EX(lpcwOutputFileName, E_INVALIDARG);
+
+		hr = DXGICaptureHelper::IsRendererInfoValid(&m_rendererInfo);
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		// is valid?
+		hr = DXGICaptureHelper::GetContainerFormatByFileName(lpcwOutputFileName);
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		if (m_captureThread.joinable()) {
+			return HRESULT_FROM_WIN32(ERROR_BUSY); // continuous capture is running
+		}
+
+		if (nullptr == m_pFramePool)
+		{
+			m_pFramePool = CDXGICaptureFramePool::Create();
+			if (nullptr == m_pFramePool) {
+				return E_OUTOFMEMORY;
+			}
+		}
+
+		// the stages of the frame, with the encode and the write, are in the metrics (GetMetrics)
+		std::chrono::steady_clock::time_point startTick = std::chrono::steady_clock::now();
+
+		hr = this->renderFrame(1000, pRetIsTimeout);
+		if (hr != S_OK) {
+			return hr;
+		}
+
+		// calculate render time without save
+		if (nullptr != pRetRenderDuration) {
+			*pRetRenderDuration = (UINT)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTick).count();
+		}
+
+		hr = this->copyOutputToFrame(&pFrame);
+		if (FAILED(hr)) {
+			return hr;
+		}
+	}
+
+	// the image is encoded without the lock, a slow png/tiff encode does not hold up the next capture
+	hr = this->SaveFrameToFile(pFrame, lpcwOutputFileName);
+	pFrame->Release();
+	if (hr == S_FALSE)
+	{
+		if (nullptr != pRetIsUnchanged) {
+			*pRetIsUnchanged = TRUE;
+		}
+		hr = S_OK;
+	}
+	return hr;
+} // CaptureToFile
+
+//
+// Returns the frame written by renderOutputFrame, or copies the output bitmap
+// of the D2D1 drawing into a frame of the frame pool
+//
+HRESULT CDXGICapture::copyOutputToFrame(CDXGICaptureFrame **ppFrame)
+{
+	AUTOLOCK();
+	CHECK_POINTER(ppFrame);
+	*ppFrame = nullptr;
+	CHECK_POINTER_EX(m_pFramePool, E_INVALIDARG);
+
+	INT nWidth  = (INT)m_rendererInfo.OutputSize.Width;
+	INT nHeight = (INT)m_rendererInfo.OutputSize.Height;
+	INT nPitch  = nWidth * 4;
+
+	HRESULT hr = S_OK;
+	CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+	CDXGICaptureFrame *pFrame = m_pRenderedFrame;
+	m_pRenderedFrame = nullptr;
+	if (nullptr == pFrame)
+	{
+		pFrame = m_pFramePool->AcquireFrame(nWidth, nHeight, nPitch);
+		if (nullptr == pFrame) {
+			return E_OUTOFMEMORY;
+		}
+		hr = DXGICaptureHelper::CopyBitmapToBuffer(m_ipWICOutputBitmap, pFrame->GetBuffer(), nPitch, nWidth, nHeight, &m_frameCopyStats);
+		CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
+	}
+
+	if (SUCCEEDED(hr) && m_rendererInfo.SkipUnchanged)
+	{
+		// change map of the output image, its hash identifies an unchanged image on save
+		if ((m_tileHasher.GetWidth() != nWidth) || (m_tileHasher.GetHeight() != nHeight)) {
+			hr = m_tileHasher.Initialize(nWidth, nHeight);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = m_tileHasher.Update(pFrame->GetBuffer(), nPitch);
+		}
+		if (SUCCEEDED(hr))
+		{
+			pFrame->SetContentHash(m_tileHasher.GetFrameHash());
+			hr = S_OK;
+		}
+	}
+	if (SUCCEEDED(hr) && (m_rendererInfo.YuvFormat != tagYuvFormat_None))
+	{
+		// the consumer gets the planes with the BGRA image (CDXGICaptureFrame::GetYuvImage)
+		hr = pFrame->ConvertToYuv(m_rendererInfo.YuvFormat, m_rendererInfo.YuvMatrix, m_rendererInfo.YuvRange);
+	}
+	if (FAILED(hr))
+	{
+		pFrame->Release();
+		return hr;
+	}
+
+	// the frame is complete, its stage times go to the histograms
+	CDXGICaptureMetrics::AddFrameTime(&m_frameTimes, tagCaptureStage_Render, CDXGICaptureMetrics::Lap(&tick));
+	m_metrics.RecordFrame(&m_frameTimes, m_frameCopyStats.BytesCopied);
+	CDXGICaptureMetrics::ResetFrameTimes(&m_frameTimes);
+
+	*ppFrame = pFrame;
+	return S_OK;
+} // copyOutputToFrame
+
+//
+// Microseconds since the capture was started
+//
+INT64 CDXGICapture::getCaptureTime() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_captureStartTick).count();
+}
+
+void CDXGICapture::captureThreadProc()
+{
+	typedef std::chrono::steady_clock clock_type;
+
+	HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	BOOL bCoInitialized = SUCCEEDED(hr);
+
+	CDXGICaptureFrame *pLastFrame = nullptr;
+	UINT64 ullFrameNumber = 0;
+
+	// the ring is not used for the incremental update (see createDeviceResource)
+	BOOL bStaged = (m_rendererInfo.StagingDepth > 1);
+
+	clock_type::time_point nextTick = m_captureStartTick;
+	clock_type::duration interval = (m_uiTargetFps > 0)
+		? clock_type::duration(std::chrono::microseconds(1000000 / m_uiTargetFps))
+		: clock_type::duration::zero();
+
+	hr = S_OK;
+	while (!m_bStopCapture)
+	{
+		if (m_uiTargetFps > 0)
+		{
+			// wait for the next tick, skip the missed ones
+			std::this_thread::sleep_until(nextTick);
+			nextTick += interval;
+			clock_type::time_point now = clock_type::now();
+			while (nextTick <= now) {
+				nextTick += interval;
+			}
+		}
+
+		// paced: take whatever arrived since the last tick, otherwise wait for a new image
+		UINT uiTimeoutMsec = (m_uiTargetFps > 0) ? 0 : 100;
+		BOOL bTimeout = FALSE;
+		INT64 llTimestamp = this->getCaptureTime();
+		hr = bStaged
+			? this->renderStagedFrame(uiTimeoutMsec, &bTimeout, &llTimestamp)
+			: this->renderFrame(uiTimeoutMsec, &bTimeout);
+		if (FAILED(hr)) {
+			break;
+		}
+
+		if (!bTimeout)
+		{
+			CDXGICaptureFrame *pFrame = nullptr;
+			hr = this->copyOutputToFrame(&pFrame);
+			if (FAILED(hr)) {
+				break;
+			}
+
+			pFrame->SetFrameInfo(++ullFrameNumber, llTimestamp);
+
+			if (nullptr != pLastFrame) {
+				pLastFrame->Release();
+			}
+			pLastFrame = pFrame;
+		}
+		else if ((m_uiTargetFps == 0) || (nullptr == pLastFrame))
+		{
+			// nothing new to deliver
+			continue;
+		}
+
+		// a repeated frame is delivered again (same frame number)
+		hr = m_pfnFrameCallback(pLastFrame, m_pFrameCallbackContext);
+		if (hr != S_OK) {
+			break;
+		}
+	}
+
+	if (nullptr != pLastFrame) {
+		pLastFrame->Release();
+	}
+
+	m_hrCaptureResult = FAILED(hr) ? hr : S_OK;
+	m_bCaptureRunning = FALSE;
+
+	if (bCoInitialized) {
+		CoUninitialize();
+	}
+} // captureThreadProc
+
+HRESULT CDXGICapture::StartCapture(_In_ PFN_DXGICAPTURE_FRAME_CALLBACK pfnCallback, _In_opt_ void *pContext, _In_ UINT uiTargetFps)
+{
+	AUTOLOCK();
+
+	if (!m_bInitialized) {
+		return D2DERR_NOT_INITIALIZED;
+	}
+
+	CHECK_POINTER_EX(m_ipDxgiOutputDuplication, E_INVALIDARG);
+	CHECK_POINTER_EX(pfnCallback, E_INVALIDARG);
+
+	if (m_captureThread.joinable()) {
+		return HRESULT_FROM_WIN32(ERROR_ALREADY_INITIALIZED); // already started
+	}
+
+	HRESULT hr = DXGICaptureHelper::IsRendererInfoValid(&m_rendererInfo);
 	if (FAILED(hr)) {
 		return hr;
 	}
 
+	m_stagingRing.Reset();
+	m_stagingRing.ResetStats();
+	CDXGICaptureMetrics::ResetFrameTimes(&m_frameTimes);
+
+	if (nullptr == m_pFramePool)
+	{
+		m_pFramePool = CDXGICaptureFramePool::Create();
+		if (nullptr == m_pFramePool) {
+			return E_OUTOFMEMORY;
+		}
+	}
+
+	m_pfnFrameCallback      = pfnCallback;
+	m_pFrameCallbackContext = pContext;
+	m_uiTargetFps           = uiTargetFps;
+	m_captureStartTick      = std::chrono::steady_clock::now();
+	m_hrCaptureResult       = S_OK;
+	m_bStopCapture          = FALSE;
+	m_bCaptureRunning       = TRUE;
+
+	try
+	{
+		m_captureThread = std::thread(&CDXGICapture::captureThreadProc, this);
+	}
+	catch (...)
+	{
+		m_bCaptureRunning = FALSE;
+		return E_FAIL;
+	}
+
 	return S_OK;
-} // CaptureToFile
+}
+
+HRESULT CDXGICapture::StopCapture()
+{
+	std::thread captureThread;
+	{
+		AUTOLOCK();
+		if (!m_captureThread.joinable()) {
+			return S_FALSE; // not started
+		}
+
+		m_bStopCapture = TRUE;
+		captureThread.swap(m_captureThread);
+	}
+
+	// the capture thread takes the lock for every frame, do not hold it here
+	captureThread.join();
+
+	AUTOLOCK();
+	m_stagingRing.Reset(); // frames still in flight are dropped
+	if (nullptr != m_pFramePool) {
+		m_pFramePool->Release(); // frames still held by the consumer keep the pool alive
+		m_pFramePool = nullptr;
+	}
+	m_pfnFrameCallback      = nullptr;
+	m_pFrameCallbackContext = nullptr;
+
+	return m_hrCaptureResult;
+}
+
+BOOL CDXGICapture::IsCapturing() const
+{
+	// atomic, read without the lock
+	return m_bCaptureRunning.load();
+}
+
+HRESULT CDXGICapture::SaveFrameToFile(_In_ const CDXGICaptureFrame *pFrame, _In_ LPCWSTR lpcwOutputFileName)
+{
+	CHECK_POINTER_EX(pFrame, E_INVALIDARG);
+	CHECK_POINTER_EX(lpcwOutputFileName, E_INVALIDARG);
+
+	// WIC factory is free threaded, only the pointer is taken under the lock
+	CComPtr<IWICImagingFactory> ipWICImageFactory;
+	INT nEncodeThreads = 0;
+	{
+		AUTOLOCK();
+		ipWICImageFactory = m_ipWICImageFactory;
+		nEncodeThreads = m_rendererInfo.EncodeThreads;
+	}
+	CHECK_POINTER_EX(ipWICImageFactory, D2DERR_NOT_INITIALIZED);
+
+	GUID guidContainerFormat = GUID_NULL;
+	HRESULT hr = DXGICaptureHelper::GetContainerFormatByFileName(lpcwOutputFileName, &guidContainerFormat);
+	CHECK_HR_RETURN(hr);
+
+	// an unchanged image is not encoded again: the file is already written or is copied
+	const UINT64 ullContentHash = pFrame->GetContentHash();
+	if (ullContentHash != 0)
+	{
+		std::wstring lastSavedFileName;
+		{
+			AUTOLOCK();
+			if ((ullContentHash == m_ullLastSavedHash) && IsEqualGUID(guidContainerFormat, m_guidLastSavedFormat)) {
+				lastSavedFileName = m_lastSavedFileName;
+			}
+		}
+		if (!lastSavedFileName.empty())
+		{
+			if (_wcsicmp(lastSavedFileName.c_str(), lpcwOutputFileName) == 0) {
+				return S_FALSE;
+			}
+			if (CopyFileW(lastSavedFileName.c_str(), lpcwOutputFileName, FALSE)) {
+				return S_FALSE;
+			}
+			// the last file is gone, encode
+		}
+	}
+
+	hr = this->saveFrameToFile(pFrame, lpcwOutputFileName, guidContainerFormat, ipWICImageFactory, nEncodeThreads);
+	if (SUCCEEDED(hr) && (ullContentHash != 0))
+	{
+		AUTOLOCK();
+		m_ullLastSavedHash    = ullContentHash;
+		m_guidLastSavedFormat = guidContainerFormat;
+		m_lastSavedFileName   = lpcwOutputFileName;
+	}
+	return hr;
+}
+
+//
+// Encodes the frame in memory and writes it to the file
+//
+HRESULT CDXGICapture::saveFrameToFile(const CDXGICaptureFrame *pFrame, LPCWSTR lpcwOutputFileName, REFGUID guidContainerFormat, IWICImagingFactory *pWICImageFactory, INT nEncodeThreads)
+{
+	tagFrameBufferInfo output;
+	RtlZeroMemory(&output, sizeof(output));
+	UINT uiSize = 0;
+	HRESULT hr = this->encodeFrame(pFrame, guidContainerFormat, pWICImageFactory, nEncodeThreads, &output, &uiSize);
+	if (SUCCEEDED(hr))
+	{
+		CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+		hr = DXGICaptureHelper::SaveMemoryToFile(lpcwOutputFileName, output.Buffer, uiSize);
+		if (SUCCEEDED(hr)) {
+			m_metrics.RecordWrite(CDXGICaptureMetrics::Lap(&tick), uiSize);
+		}
+	}
+	DXGICaptureFrameBuffer::Free(&output);
+	return hr;
+} // saveFrameToFile
+
+//
+// Encodes the frame with the built-in (qoi, parallel strips) or the WIC encoder of the container format
+//
+HRESULT CDXGICapture::encodeFrame(const CDXGICaptureFrame *pFrame, REFGUID guidContainerFormat, IWICImagingFactory *pWICImageFactory, INT nEncodeThreads, tagFrameBufferInfo *pOutput, UINT *pRetSize)
+{
+	CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+
+	HRESULT hr = S_OK;
+	tagStripImageFormat stripFormat = tagStripImageFormat_Png;
+	if (IsEqualGUID(guidContainerFormat, GUID_ContainerFormatQoi))
+	{
+		hr = DXGICaptureQoi::Encode(
+			pFrame->GetBuffer(),
+			pFrame->GetPitch(),
+			pFrame->GetWidth(),
+			pFrame->GetHeight(),
+			pOutput,
+			pRetSize);
+	}
+	else if ((nEncodeThreads > 0) && SUCCEEDED(DXGICaptureHelper::GetStripImageFormat(guidContainerFormat, &stripFormat)))
+	{
+		hr = DXGICaptureStripEncoder::Encode(
+			stripFormat,
+			pFrame->GetBuffer(),
+			pFrame->GetPitch(),
+			pFrame->GetWidth(),
+			pFrame->GetHeight(),
+			(UINT)nEncodeThreads,
+			pOutput,
+			pRetSize);
+	}
+	else
+	{
+		CHECK_POINTER_EX(pWICImageFactory, D2DERR_NOT_INITIALIZED);
+		hr = DXGICaptureHelper::EncodeBufferToMemory(
+			pWICImageFactory,
+			pFrame->GetBuffer(),
+			pFrame->GetWidth(),
+			pFrame->GetHeight(),
+			pFrame->GetPitch(),
+			guidContainerFormat,
+			pOutput,
+			pRetSize);
+	}
+
+	if (SUCCEEDED(hr)) {
+		m_metrics.RecordEncode(CDXGICaptureMetrics::Lap(&tick), *pRetSize);
+	}
+	return hr;
+} // encodeFrame
+
+HRESULT CDXGICapture::EncodeFrame(_In_ const CDXGICaptureFrame *pFrame, _In_ REFGUID guidContainerFormat, _Inout_ tagFrameBufferInfo *pOutput, _Out_ UINT *pRetSize)
+{
+	CHECK_POINTER_EX(pFrame, E_INVALIDARG);
+	CHECK_POINTER_EX(pOutput, E_INVALIDARG);
+	CHECK_POINTER(pRetSize);
+	*pRetSize = 0;
+
+	// WIC factory is free threaded, only the pointer is taken under the lock (qoi needs neither)
+	CComPtr<IWICImagingFactory> ipWICImageFactory;
+	INT nEncodeThreads = 0;
+	if (!IsEqualGUID(guidContainerFormat, GUID_ContainerFormatQoi))
+	{
+		AUTOLOCK();
+		ipWICImageFactory = m_ipWICImageFactory;
+		nEncodeThreads = m_rendererInfo.EncodeThreads;
+	}
+
+	return this->encodeFrame(pFrame, guidContainerFormat, ipWICImageFactory, nEncodeThreads, pOutput, pRetSize);
+}
 
 #undef AUTOLOCK
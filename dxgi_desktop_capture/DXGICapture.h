@@ -28,21 +28,62 @@
 #include <d2d1_1.h> // for ID2D1Effect
 #include <wincodec.h>
 
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "DXGICaptureTypes.h"
+#include "DXGICaptureCopy.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICaptureFrame.h"
+#include "DXGICaptureMetrics.h"
+#include "DXGICaptureRender.h"
+#include "DXGICaptureScale.h"
+#include "DXGICaptureSnapshot.h"
+#include "DXGICaptureStagingRing.h"
+#include "DXGICaptureStagingTextures.h"
+#include "DXGICaptureTileHash.h"
 
 #define D3D_FEATURE_LEVEL_INVALID  ((D3D_FEATURE_LEVEL)0x0)
 
+//
+// Called on the capture thread for every frame of a continuous capture.
+// The frame is valid until the callback returns, AddRef it to keep it longer.
+// Returning S_FALSE stops the capture, a failure code also stops it and is returned by StopCapture.
+//
+typedef HRESULT (*PFN_DXGICAPTURE_FRAME_CALLBACK)(_In_ CDXGICaptureFrame *pFrame, _In_opt_ void *pContext);
+
+//
+// struct tagCaptureDeviceSnapshot_s
+//
+// Device state published by Initialize (cleared by Terminate), read without the capture lock
+//
+typedef struct tagCaptureDeviceSnapshot_s
+{
+	D3D_FEATURE_LEVEL                     FeatureLevel;
+	std::vector<tagDublicatorMonitorInfo> MonitorInfos;
+} tagCaptureDeviceSnapshot;
+
 class CDXGICapture
 {
 private:
 	ATL::CComAutoCriticalSection    m_csLock;
 
 	BOOL                            m_bInitialized;
-	DublicatorMonitorInfoVec        m_monitorInfos;
 	tagRendererInfo                 m_rendererInfo;
 
+	// the monitor infos and the renderer config for the getters: published under the lock
+	// by Initialize/Terminate and SetConfig, read wait-free (a capture holding the lock
+	// for an acquire or an encode does not hold up a thread that polls them)
+	CDXGICaptureSnapshot<tagCaptureDeviceSnapshot> m_deviceSnapshot;
+	CDXGICaptureSnapshot<tagRendererInfo>          m_rendererSnapshot;
+
 	tagMouseInfo                    m_mouseInfo;
-	tagFrameBufferInfo              m_tempMouseBuffer;
+	CDXGICursorCache                m_cursorCache;
+	tagFrameBufferInfo              m_tempMouseRotateBuffer;
 	DXGI_OUTPUT_DESC                m_desktopOutputDesc;
 
 	D3D_FEATURE_LEVEL               m_lD3DFeatureLevel;
@@ -52,39 +93,129 @@ private:
 	CComPtr<IDXGIOutputDuplication> m_ipDxgiOutputDuplication;
 	CComPtr<ID3D11Texture2D>        m_ipCopyTexture2D;
 
+	// incremental update of the copy texture
+	BOOL                            m_bCopyTextureValid;
+	tagFrameBufferInfo              m_frameMetadataBuffer;
+	tagFrameBufferInfo              m_mouseBackground;
+	tagFrameUpdateStats             m_frameUpdateStats;
+	std::vector<tagFrameRect>       m_regionRects;  // changed rects inside the region
+
+	// readback ring of the continuous capture (mouse state is kept per slot)
+	CDXGIStagingTextures            m_stagingTextures;
+	CDXGICaptureStagingRing         m_stagingRing;
+	POINT                           m_stagingMousePosition[DXGICAPTURE_STAGING_MAX_DEPTH];
+	bool                            m_stagingMouseVisible[DXGICAPTURE_STAGING_MAX_DEPTH];
+
 	CComPtr<ID2D1Device>            m_ipD2D1Device;
 	CComPtr<ID2D1Factory>           m_ipD2D1Factory;
 	CComPtr<IWICImagingFactory>     m_ipWICImageFactory;
 	CComPtr<IWICBitmap>             m_ipWICOutputBitmap;
 	CComPtr<ID2D1RenderTarget>      m_ipD2D1RenderTarget;
+	CComPtr<ID2D1Bitmap>            m_ipD2D1SourceBitmap;
+
+	// cpu drawing of the output (ScaleFilter), replaces the D2D1 drawing: the scaler
+	// takes the non rotated outputs, the single pass renderer the rotated ones
+	CDXGICaptureScaler              m_scaler;
+	tagFrameGeometry                m_frameGeometry;
+	BOOL                            m_bCpuRender;
+
+	// passthrough (output equals the desktop image) and cpu drawing write the mapped
+	// desktop image straight into a frame of the pool, the WIC output bitmap is skipped
+	BOOL                            m_bPassthrough;
+	CDXGICaptureFrame*              m_pRenderedFrame;
+	tagFrameCopyStats               m_frameCopyStats;
+
+	// change map of the output (SkipUnchanged) and the last image written by SaveFrameToFile
+	CDXGITileHasher                 m_tileHasher;
+	UINT64                          m_ullLastSavedHash;
+	GUID                            m_guidLastSavedFormat;
+	std::wstring                    m_lastSavedFileName;
+
+	// continuous capture
+	std::thread                     m_captureThread;
+	std::atomic<BOOL>               m_bStopCapture;
+	std::atomic<BOOL>               m_bCaptureRunning;
+	HRESULT                         m_hrCaptureResult;
+	PFN_DXGICAPTURE_FRAME_CALLBACK  m_pfnFrameCallback;
+	void*                           m_pFrameCallbackContext;
+	UINT                            m_uiTargetFps;
+	CDXGICaptureFramePool*          m_pFramePool;
+	std::chrono::steady_clock::time_point m_captureStartTick;
+
+	// stage latencies and frame counters, thread safe (encoders record without the lock);
+	// the stage times of the frame in progress are recorded by copyOutputToFrame
+	CDXGICaptureMetrics             m_metrics;
+	tagCaptureFrameTimes            m_frameTimes;
 
 public:
 	CDXGICapture();
 	~CDXGICapture();
 
 private:
-	HRESULT loadMonitorInfos(ID3D11Device *pDevice);
-	void freeMonitorInfos();
+	HRESULT loadMonitorInfos(ID3D11Device *pDevice, std::vector<tagDublicatorMonitorInfo> *pMonitorInfos);
 
 	HRESULT createDeviceResource(
 		const tagScreenCaptureFilterConfig *pConfig, 
 		const tagDublicatorMonitorInfo *pSelectedMonitorInfo);
 	void terminateDeviceResource();
 
+	HRESULT updateCopyTexture(const DXGI_OUTDUPL_FRAME_INFO *pFrameInfo, ID3D11Texture2D *pAcquiredDesktopImage);
+	HRESULT renderFrame(UINT uiTimeoutMsec, BOOL *pRetIsTimeout);
+	HRESULT renderStagedFrame(UINT uiTimeoutMsec, BOOL *pRetIsTimeout, INT64 *pRetCaptureTime);
+	HRESULT drawOutputBitmap();
+	HRESULT renderOutputFrame(const BYTE *pSrc, INT nSrcPitch);
+	INT64 getCaptureTime() const;
+	HRESULT copyOutputToFrame(CDXGICaptureFrame **ppFrame);
+	HRESULT saveFrameToFile(const CDXGICaptureFrame *pFrame, LPCWSTR lpcwOutputFileName, REFGUID guidContainerFormat, IWICImagingFactory *pWICImageFactory, INT nEncodeThreads);
+	HRESULT encodeFrame(const CDXGICaptureFrame *pFrame, REFGUID guidContainerFormat, IWICImagingFactory *pWICImageFactory, INT nEncodeThreads, tagFrameBufferInfo *pOutput, UINT *pRetSize);
+	void captureThreadProc();
+
 public:
 	HRESULT Initialize();
 	HRESULT Terminate();
 	HRESULT SetConfig(const tagScreenCaptureFilterConfig *pConfig);
 	HRESULT SetConfig(const tagScreenCaptureFilterConfig &config);
+	// gives the output duplication back, e.g. to a CDXGIDuplicationSource (DXGI allows one duplication
+	// per output and process); the encoder of SetConfig is kept, capturing fails until the next SetConfig
+	HRESULT ReleaseDuplication();
 	
+	// the getters below do not take the capture lock
 	BOOL IsInitialized() const;
 	D3D_FEATURE_LEVEL GetD3DFeatureLevel() const;
 
 	int GetDublicatorMonitorInfoCount() const;
-	const tagDublicatorMonitorInfo* GetDublicatorMonitorInfo(int index) const;
-	const tagDublicatorMonitorInfo* FindDublicatorMonitorInfo(int monitorIdx) const;
-
-	HRESULT CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ BOOL *pRetIsTimeout = NULL, _Out_opt_ UINT *pRetRenderDuration = NULL);
+	// the infos are copied out of the snapshot, safe while another thread may call Terminate (S_FALSE: not found)
+	HRESULT GetDublicatorMonitorInfo(_In_ int index, _Out_ tagDublicatorMonitorInfo *pInfo) const;
+	HRESULT FindDublicatorMonitorInfo(_In_ int monitorIdx, _Out_ tagDublicatorMonitorInfo *pInfo) const;
+	// renderer config of the last SetConfig (S_FALSE: not configured)
+	HRESULT GetRendererInfo(_Out_ tagRendererInfo *pInfo) const;
+
+	HRESULT GetCursorCacheStats(_Out_ tagCursorCacheStats *pStats) const;
+	HRESULT ResetCursorCacheStats();
+	HRESULT GetFrameUpdateStats(_Out_ tagFrameUpdateStats *pStats) const;
+	HRESULT GetFrameCopyStats(_Out_ tagFrameCopyStats *pStats) const;
+	HRESULT GetStagingRingStats(_Out_ tagStagingRingStats *pStats) const;
+	// changed 64x64 tiles of the last output image (SkipUnchanged), bit (y * TilesX + x) of pBitmap
+	HRESULT GetChangedTiles(_Out_ tagTileChangeInfo *pInfo, _Out_writes_opt_(uiBitmapWords) UINT64 *pBitmap, _In_ UINT uiBitmapWords) const;
+	HRESULT GetTileHashStats(_Out_ tagTileHashStats *pStats) const;
+	// latency histograms of the capture stages (acquire wait, copy, cursor, render, encode, file write)
+	// and the frame counters; thread safe, other writers (e.g. an encoder pool) may record into it
+	CDXGICaptureMetrics* GetMetrics();
+	HRESULT ExportMetricsJson(_Out_ std::string *pJson) const;
+
+	// pRetIsUnchanged: the image equals the last written one (SkipUnchanged), it was not encoded again
+	HRESULT CaptureToFile(_In_ LPCWSTR lpcwOutputFileName, _Out_opt_ BOOL *pRetIsTimeout = NULL, _Out_opt_ UINT *pRetRenderDuration = NULL, _Out_opt_ BOOL *pRetIsUnchanged = NULL);
+
+	// uiTargetFps = 0: every new desktop image is delivered as it comes,
+	// otherwise frames are delivered at the given rate (the last frame is repeated if the desktop did not change)
+	HRESULT StartCapture(_In_ PFN_DXGICAPTURE_FRAME_CALLBACK pfnCallback, _In_opt_ void *pContext, _In_ UINT uiTargetFps);
+	HRESULT StopCapture();
+	BOOL IsCapturing() const;
+
+	// S_FALSE: the image equals the last written one (SkipUnchanged), the file is already written or was copied
+	HRESULT SaveFrameToFile(_In_ const CDXGICaptureFrame *pFrame, _In_ LPCWSTR lpcwOutputFileName);
+	// encodes the frame in memory (e.g. on a worker of CDXGICaptureEncoderPool), guidContainerFormat: see GetContainerFormatByFileName
+	HRESULT EncodeFrame(_In_ const CDXGICaptureFrame *pFrame, _In_ REFGUID guidContainerFormat, _Inout_ tagFrameBufferInfo *pOutput, _Out_ UINT *pRetSize);
 };
 
 #endif // __DXGICAPTURE_H__
@@ -0,0 +1,261 @@
+/*****************************************************************************
+* DXGICaptureBlend.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREBLEND_H__
+#define __DXGICAPTUREBLEND_H__
+
+#include "DXGICapturePlatform.h"
+
+//
+// class DXGICaptureBlend
+//
+// Alpha blending of a 32bpp (0xAARRGGBB) source over a 32bpp destination.
+// Per channel: Dst = ((255 - A) * Dst + A * Src) >> 8
+//         and: DstA = A + (((255 - A) * DstA) >> 8)
+// All kernels produce bit-exact results of the scalar version.
+//
+class DXGICaptureBlend
+{
+public:
+	static
+	inline
+	void
+	AlphaBlendRowScalar(
+		_Inout_ UINT *pDst,
+		_In_ const UINT *pSrc,
+		_In_ INT count
+		)
+	{
+		// Alpha blending masks
+		const UINT AMask    = 0xFF000000;
+		const UINT RBMask   = 0x00FF00FF;
+		const UINT GMask    = 0x0000FF00;
+		const UINT AGMask   = AMask | GMask;
+		const UINT OneAlpha = 0x01000000;
+		UINT uiPixel1;
+		UINT uiPixel2;
+		UINT uiAlpha;
+		UINT uiNAlpha;
+		UINT uiRedBlue;
+		UINT uiAlphaGreen;
+
+		for (INT i = 0; i < count; ++i)
+		{
+			uiPixel1 = pDst[i];
+			uiPixel2 = pSrc[i];
+			uiAlpha = (uiPixel2 & AMask) >> 24;
+			uiNAlpha = 255 - uiAlpha;
+			uiRedBlue = ((uiNAlpha * (uiPixel1 & RBMask)) + (uiAlpha * (uiPixel2 & RBMask))) >> 8;
+			uiAlphaGreen = (uiNAlpha * ((uiPixel1 & AGMask) >> 8)) + (uiAlpha * (OneAlpha | ((uiPixel2 & GMask) >> 8)));
+
+			pDst[i] = ((uiRedBlue & RBMask) | (uiAlphaGreen & AGMask));
+		}
+	} // AlphaBlendRowScalar
+
+#if defined(DXGICAPTURE_HAVE_X86)
+	//
+	// 4 pixels per iteration
+	//
+	static
+	inline
+	void
+	AlphaBlendRowSSE2(
+		_Inout_ UINT *pDst,
+		_In_ const UINT *pSrc,
+		_In_ INT count
+		)
+	{
+		const __m128i zero      = _mm_setzero_si128();
+		const __m128i c255      = _mm_set1_epi16(255);
+		// 16 bit lanes: B G R A B G R A
+		const __m128i alphaLane = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+		const __m128i oneAlpha  = _mm_set_epi16(256, 0, 0, 0, 256, 0, 0, 0);
+
+		INT i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst + i));
+
+			__m128i sLo = _mm_unpacklo_epi8(s, zero);
+			__m128i sHi = _mm_unpackhi_epi8(s, zero);
+			__m128i dLo = _mm_unpacklo_epi8(d, zero);
+			__m128i dHi = _mm_unpackhi_epi8(d, zero);
+
+			// broadcast alpha to all channels of its pixel
+			__m128i aLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sLo, 0xFF), 0xFF);
+			__m128i aHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sHi, 0xFF), 0xFF);
+			__m128i naLo = _mm_sub_epi16(c255, aLo);
+			__m128i naHi = _mm_sub_epi16(c255, aHi);
+
+			// the alpha channel of the source counts as 256
+			sLo = _mm_or_si128(_mm_andnot_si128(alphaLane, sLo), oneAlpha);
+			sHi = _mm_or_si128(_mm_andnot_si128(alphaLane, sHi), oneAlpha);
+
+			__m128i rLo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(naLo, dLo), _mm_mullo_epi16(aLo, sLo)), 8);
+			__m128i rHi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(naHi, dHi), _mm_mullo_epi16(aHi, sHi)), 8);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), _mm_packus_epi16(rLo, rHi));
+		}
+
+		if (i < count) {
+			AlphaBlendRowScalar(pDst + i, pSrc + i, count - i);
+		}
+	} // AlphaBlendRowSSE2
+
+	//
+	// 8 pixels per iteration
+	//
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	void
+	AlphaBlendRowAVX2(
+		_Inout_ UINT *pDst,
+		_In_ const UINT *pSrc,
+		_In_ INT count
+		)
+	{
+		const __m256i zero      = _mm256_setzero_si256();
+		const __m256i c255      = _mm256_set1_epi16(255);
+		const __m256i alphaLane = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+		const __m256i oneAlpha  = _mm256_set_epi16(256, 0, 0, 0, 256, 0, 0, 0, 256, 0, 0, 0, 256, 0, 0, 0);
+
+		INT i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+			__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pDst + i));
+
+			// unpack/pack work inside the 128 bit lanes, so the pixel order is kept
+			__m256i sLo = _mm256_unpacklo_epi8(s, zero);
+			__m256i sHi = _mm256_unpackhi_epi8(s, zero);
+			__m256i dLo = _mm256_unpacklo_epi8(d, zero);
+			__m256i dHi = _mm256_unpackhi_epi8(d, zero);
+
+			__m256i aLo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sLo, 0xFF), 0xFF);
+			__m256i aHi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sHi, 0xFF), 0xFF);
+			__m256i naLo = _mm256_sub_epi16(c255, aLo);
+			__m256i naHi = _mm256_sub_epi16(c255, aHi);
+
+			sLo = _mm256_or_si256(_mm256_andnot_si256(alphaLane, sLo), oneAlpha);
+			sHi = _mm256_or_si256(_mm256_andnot_si256(alphaLane, sHi), oneAlpha);
+
+			__m256i rLo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(naLo, dLo), _mm256_mullo_epi16(aLo, sLo)), 8);
+			__m256i rHi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(naHi, dHi), _mm256_mullo_epi16(aHi, sHi)), 8);
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), _mm256_packus_epi16(rLo, rHi));
+		}
+
+		if (i < count) {
+			AlphaBlendRowSSE2(pDst + i, pSrc + i, count - i);
+		}
+	} // AlphaBlendRowAVX2
+#endif // DXGICAPTURE_HAVE_X86
+
+#if defined(DXGICAPTURE_HAVE_NEON)
+	//
+	// 8 pixels per iteration
+	//
+	static
+	inline
+	void
+	AlphaBlendRowNEON(
+		_Inout_ UINT *pDst,
+		_In_ const UINT *pSrc,
+		_In_ INT count
+		)
+	{
+		const uint8x8_t c255 = vdup_n_u8(255);
+
+		INT i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			// de-interleave: val[0]=B, val[1]=G, val[2]=R, val[3]=A
+			uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8_t*>(pSrc + i));
+			uint8x8x4_t d = vld4_u8(reinterpret_cast<const uint8_t*>(pDst + i));
+			uint8x8_t a  = s.val[3];
+			uint8x8_t na = vsub_u8(c255, a);
+
+			uint8x8x4_t r;
+			r.val[0] = vshrn_n_u16(vmlal_u8(vmull_u8(na, d.val[0]), a, s.val[0]), 8);
+			r.val[1] = vshrn_n_u16(vmlal_u8(vmull_u8(na, d.val[1]), a, s.val[1]), 8);
+			r.val[2] = vshrn_n_u16(vmlal_u8(vmull_u8(na, d.val[2]), a, s.val[2]), 8);
+			r.val[3] = vshrn_n_u16(vaddq_u16(vmull_u8(na, d.val[3]), vshll_n_u8(a, 8)), 8);
+
+			vst4_u8(reinterpret_cast<uint8_t*>(pDst + i), r);
+		}
+
+		if (i < count) {
+			AlphaBlendRowScalar(pDst + i, pSrc + i, count - i);
+		}
+	} // AlphaBlendRowNEON
+#endif // DXGICAPTURE_HAVE_NEON
+
+	//
+	// Blends a width x height source image over the destination image.
+	// Pitches are in bytes.
+	//
+	static
+	inline
+	void
+	AlphaBlend(
+		_Inout_ BYTE *pDst,
+		_In_ INT dstPitch,
+		_In_ const BYTE *pSrc,
+		_In_ INT srcPitch,
+		_In_ INT width,
+		_In_ INT height,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		if ((nullptr == pDst) || (nullptr == pSrc) || (width <= 0) || (height <= 0)) {
+			return;
+		}
+
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		for (INT Row = 0; Row < height; ++Row)
+		{
+			UINT *pDstRow = reinterpret_cast<UINT*>(pDst + (ptrdiff_t)Row * dstPitch);
+			const UINT *pSrcRow = reinterpret_cast<const UINT*>(pSrc + (ptrdiff_t)Row * srcPitch);
+
+			switch (level)
+			{
+#if defined(DXGICAPTURE_HAVE_X86)
+			case tagSimdLevel_AVX2:
+				AlphaBlendRowAVX2(pDstRow, pSrcRow, width);
+				break;
+			case tagSimdLevel_SSE2:
+				AlphaBlendRowSSE2(pDstRow, pSrcRow, width);
+				break;
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+			case tagSimdLevel_NEON:
+				AlphaBlendRowNEON(pDstRow, pSrcRow, width);
+				break;
+#endif
+			default:
+				AlphaBlendRowScalar(pDstRow, pSrcRow, width);
+				break;
+			}
+		}
+	} // AlphaBlend
+
+}; // end class DXGICaptureBlend
+
+#endif // __DXGICAPTUREBLEND_H__
@@ -0,0 +1,140 @@
+/*****************************************************************************
+* DXGICaptureBmp.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREBMP_H__
+#define __DXGICAPTUREBMP_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureFrameBuffer.h"
+
+#include <string.h>
+
+#define DXGICAPTURE_BMP_HEADER_SIZE     54 /* BITMAPFILEHEADER + BITMAPINFOHEADER */
+
+//
+// class DXGICaptureBmp
+//
+// Portable 32bpp BMP encoder (top-down, BI_RGB), the image encoder of the
+// headless pipeline where WIC is not available.
+//
+class DXGICaptureBmp
+{
+private:
+	static
+	inline
+	void
+	putU16(
+		_Out_ BYTE *p,
+		_In_ UINT v
+		)
+	{
+		p[0] = (BYTE)(v & 0xFF);
+		p[1] = (BYTE)((v >> 8) & 0xFF);
+	} // putU16
+
+	static
+	inline
+	void
+	putU32(
+		_Out_ BYTE *p,
+		_In_ UINT v
+		)
+	{
+		p[0] = (BYTE)(v & 0xFF);
+		p[1] = (BYTE)((v >> 8) & 0xFF);
+		p[2] = (BYTE)((v >> 16) & 0xFF);
+		p[3] = (BYTE)((v >> 24) & 0xFF);
+	} // putU32
+
+public:
+	static
+	inline
+	UINT
+	GetEncodedSize(
+		_In_ INT nWidth,
+		_In_ INT nHeight
+		)
+	{
+		return DXGICAPTURE_BMP_HEADER_SIZE + (UINT)nWidth * (UINT)nHeight * 4;
+	} // GetEncodedSize
+
+	//
+	// Encodes the 32bpp image into pOutput (grown as needed), *pRetSize receives the encoded size
+	//
+	static
+	inline
+	HRESULT
+	Encode(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize
+		)
+	{
+		CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutput, E_INVALIDARG);
+		CHECK_POINTER(pRetSize);
+		*pRetSize = 0;
+		if ((nWidth <= 0) || (nHeight <= 0)) {
+			return E_INVALIDARG;
+		}
+
+		UINT uiSize = GetEncodedSize(nWidth, nHeight);
+		HRESULT hr = DXGICaptureFrameBuffer::Resize(pOutput, uiSize);
+		CHECK_HR_RETURN(hr);
+
+		BYTE *p = pOutput->Buffer;
+		memset(p, 0, DXGICAPTURE_BMP_HEADER_SIZE);
+
+		// BITMAPFILEHEADER
+		p[0] = 'B';
+		p[1] = 'M';
+		putU32(p + 2, uiSize);
+		putU32(p + 10, DXGICAPTURE_BMP_HEADER_SIZE);
+
+		// BITMAPINFOHEADER
+		putU32(p + 14, 40);
+		putU32(p + 18, (UINT)nWidth);
+		putU32(p + 22, (UINT)(-nHeight)); // top-down
+		putU16(p + 26, 1);
+		putU16(p + 28, 32);
+		putU32(p + 34, uiSize - DXGICAPTURE_BMP_HEADER_SIZE);
+		putU32(p + 38, 2835); // 72 dpi
+		putU32(p + 42, 2835);
+
+		const INT nRowBytes = nWidth * 4;
+		BYTE *pDst = p + DXGICAPTURE_BMP_HEADER_SIZE;
+		if (nSrcPitch == nRowBytes)
+		{
+			memcpy(pDst, pSrc, (size_t)nRowBytes * nHeight);
+		}
+		else
+		{
+			for (INT y = 0; y < nHeight; ++y) {
+				memcpy(pDst + (size_t)y * nRowBytes, pSrc + (size_t)y * nSrcPitch, nRowBytes);
+			}
+		}
+
+		*pRetSize = uiSize;
+		return S_OK;
+	} // Encode
+
+}; // end class DXGICaptureBmp
+
+#endif // __DXGICAPTUREBMP_H__
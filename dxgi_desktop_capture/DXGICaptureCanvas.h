@@ -0,0 +1,698 @@
+/*****************************************************************************
+* DXGICaptureCanvas.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+
+#pragma once
+#ifndef __DXGICAPTURECANVAS_H__
+#define __DXGICAPTURECANVAS_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICapturePointer.h"
+#include "DXGICaptureRotate.h"
+#include "DXGICaptureSource.h"
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#define DXGICAPTURE_CANVAS_MAX_MONITORS         16
+#define DXGICAPTURE_CANVAS_MAX_RECTS            64      /* changed rects kept per monitor, more are merged */
+#define DXGICAPTURE_CANVAS_ACQUIRE_TIMEOUT      50      /* msec, the workers check for Stop in between */
+#define DXGICAPTURE_CANVAS_DEFAULT_SYNC_WINDOW  4000    /* usec */
+
+//
+// struct tagCanvasMonitor_s
+//
+typedef struct tagCanvasMonitor_s
+{
+	IDXGICaptureSource* Source;
+	tagFrameBounds      Bounds;     /* desktop coordinates (may be negative), the size is the desktop size of the source */
+} tagCanvasMonitor;
+
+//
+// struct tagCanvasConfig_s
+//
+typedef struct tagCanvasConfig_s
+{
+	UINT                SyncWindowUsec;     /* after the first new monitor image, wait this long for the other monitors */
+	INT                 ShowPointer;
+	UINT                BackgroundColor;    /* canvas areas without a monitor, 0xAARRGGBB */
+} tagCanvasConfig;
+
+//
+// struct tagCanvasStats_s
+//
+typedef struct tagCanvasStats_s
+{
+	UINT64              Frames;
+	UINT64              PartialFrames;      /* frames without a new image of every monitor */
+	UINT64              MonitorUpdates;     /* monitor images taken into the canvas */
+	UINT64              BytesCopied;        /* changed regions copied into the canvas */
+	UINT64              BytesTotal;         /* canvas size of every frame */
+	INT64               MaxSkewUsec;        /* arrival spread of the monitor images of one frame */
+	INT64               TotalSkewUsec;
+	UINT64              SkewFrames;         /* frames with more than one monitor image */
+} tagCanvasStats;
+
+//
+// class CDXGICaptureCanvas
+//
+// Captures several monitors at once: every monitor source runs on its own
+// thread and keeps a desktop oriented copy of its monitor (rotated displays
+// are turned upright) with the regions changed since the last composite.
+// ProcessFrame composes the virtual desktop, the union of the monitor bounds
+// in desktop coordinates: it waits for the first new monitor image, gives the
+// other monitors SyncWindowUsec to catch up, then copies only the changed
+// regions into the canvas and draws the pointer of the monitor that shows it.
+// The timestamp of a frame is the arrival of its latest monitor image (usec
+// since Start), the spread of the arrivals is kept in the stats.
+//
+class CDXGICaptureCanvas
+{
+private:
+	typedef struct tagMonitorState_s
+	{
+		IDXGICaptureSource*         Source;
+		tagCaptureSourceDesc        Desc;
+		tagFrameBounds              Bounds;     /* canvas coordinates */
+		std::thread                 Thread;
+
+		// worker side, under Lock
+		std::mutex                  Lock;
+		tagFrameBufferInfo          Frame;      /* desktop orientation */
+		std::vector<tagFrameRect>   Changed;    /* desktop coordinates, since the last composite */
+		std::vector<tagFrameRect>   Rects;      /* worker scratch */
+		tagCapturePointer           Pointer;
+		std::vector<BYTE>           Shape;
+		INT64                       PointerTime;
+
+		// under m_stateLock
+		BOOL                        Pending;
+		INT64                       Arrival;
+		HRESULT                     Result;
+	} tagMonitorState;
+
+	std::vector<tagMonitorState*>   m_monitors;
+	tagCanvasConfig                 m_config;
+	tagFrameBounds                  m_desktopBounds;
+	tagFrameBufferInfo              m_canvas;
+
+	std::mutex                      m_stateLock;
+	std::condition_variable         m_stateCond;
+	std::atomic<bool>               m_bStop;
+	BOOL                            m_bRunning;
+	std::chrono::steady_clock::time_point m_startTick;
+
+	// pointer drawn into the canvas, the pixels under it are restored before the next composite
+	tagCapturePointer               m_pointer;
+	std::vector<BYTE>               m_pointerShape;
+	CDXGICursorCache                m_cursorCache;
+	tagFrameBufferInfo              m_pointerBackground;
+	tagFrameBufferInfo              m_tempMouseRotateBuffer;
+
+	std::vector<BOOL>               m_taken;
+	UINT64                          m_ullFrameNumber;
+	INT64                           m_llTimestamp;
+	INT64                           m_llSkew;
+	tagCanvasStats                  m_stats;
+
+	// disable copy
+	CDXGICaptureCanvas(const CDXGICaptureCanvas&);
+	CDXGICaptureCanvas& operator=(const CDXGICaptureCanvas&);
+
+	inline INT64 now() const
+	{
+		return (INT64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_startTick).count();
+	}
+
+	//
+	// Maps a rect of the acquired image to desktop coordinates (the image is rotated clockwise by nDegrees)
+	//
+	static
+	inline
+	tagFrameRect
+	rotateRect(
+		_In_ const tagFrameRect &rc,
+		_In_ INT width,
+		_In_ INT height,
+		_In_ INT nDegrees
+		)
+	{
+		tagFrameRect out = rc;
+		switch (nDegrees)
+		{
+		case 90:
+			out.Left = height - rc.Bottom; out.Top = rc.Left; out.Right = height - rc.Top; out.Bottom = rc.Right;
+			break;
+		case 180:
+			out.Left = width - rc.Right; out.Top = height - rc.Bottom; out.Right = width - rc.Left; out.Bottom = height - rc.Top;
+			break;
+		case 270:
+			out.Left = rc.Top; out.Top = width - rc.Right; out.Right = rc.Bottom; out.Bottom = width - rc.Left;
+			break;
+		default:
+			break;
+		}
+		return out;
+	} // rotateRect
+
+	//
+	// Worker side: copies the changed regions of the acquired image into the monitor frame
+	//
+	static
+	inline
+	void
+	updateMonitor(
+		_Inout_ tagMonitorState *pMonitor,
+		_In_ const tagCaptureSourceFrame *pFrame,
+		_In_ INT64 llArrival
+		)
+	{
+		const INT nWidth  = pMonitor->Desc.Width;
+		const INT nHeight = pMonitor->Desc.Height;
+		const INT nDegrees = pMonitor->Desc.RotationDegrees;
+
+		// the image is complete, so moved regions are copied like dirty ones
+		std::vector<tagFrameRect> &rects = pMonitor->Rects;
+		rects.clear();
+		for (UINT i = 0; i < pFrame->MoveRectCount; ++i) {
+			rects.push_back(pFrame->MoveRects[i].Dst);
+		}
+		rects.insert(rects.end(), pFrame->DirtyRects, pFrame->DirtyRects + pFrame->DirtyRectCount);
+		UINT uiCount = rects.empty() ? 0 : DXGICaptureDirtyRects::MergeRects(&rects[0], (UINT)rects.size(), nWidth, nHeight);
+
+		std::lock_guard<std::mutex> lock(pMonitor->Lock);
+
+		for (UINT i = 0; i < uiCount; ++i)
+		{
+			const tagFrameRect &rc = rects[i];
+			tagFrameRect rcDesktop = rotateRect(rc, nWidth, nHeight, nDegrees);
+			DXGICaptureRotate::Rotate(
+				pFrame->Data + (size_t)rc.Top * pFrame->Pitch + (size_t)rc.Left * 4, pFrame->Pitch,
+				rc.Right - rc.Left, rc.Bottom - rc.Top,
+				pMonitor->Frame.Buffer + (size_t)rcDesktop.Top * pMonitor->Frame.Pitch + (size_t)rcDesktop.Left * 4, pMonitor->Frame.Pitch,
+				nDegrees);
+			pMonitor->Changed.push_back(rcDesktop);
+		}
+
+		if (pMonitor->Changed.size() > DXGICAPTURE_CANVAS_MAX_RECTS)
+		{
+			std::vector<tagFrameRect> &changed = pMonitor->Changed;
+			UINT n = DXGICaptureDirtyRects::MergeRects(&changed[0], (UINT)changed.size(), pMonitor->Desc.DesktopWidth, pMonitor->Desc.DesktopHeight);
+			changed.resize(n);
+			if (n > DXGICAPTURE_CANVAS_MAX_RECTS)
+			{
+				// too scattered, take the bounding box
+				tagFrameRect u = changed[0];
+				for (UINT i = 1; i < n; ++i)
+				{
+					if (changed[i].Left < u.Left) { u.Left = changed[i].Left; }
+					if (changed[i].Top < u.Top) { u.Top = changed[i].Top; }
+					if (changed[i].Right > u.Right) { u.Right = changed[i].Right; }
+					if (changed[i].Bottom > u.Bottom) { u.Bottom = changed[i].Bottom; }
+				}
+				changed.assign(1, u);
+			}
+		}
+
+		// the shape is only valid until ReleaseFrame, keep a copy
+		if (nullptr != pFrame->Pointer)
+		{
+			UINT64 ullShapeHash = pMonitor->Pointer.ShapeHash;
+			pMonitor->Pointer = *pFrame->Pointer;
+			if ((nullptr != pFrame->Pointer->Shape) && (pFrame->Pointer->ShapeSize > 0) &&
+				((pFrame->Pointer->ShapeHash != ullShapeHash) || (pFrame->Pointer->ShapeSize != (UINT)pMonitor->Shape.size())))
+			{
+				pMonitor->Shape.assign(pFrame->Pointer->Shape, pFrame->Pointer->Shape + pFrame->Pointer->ShapeSize);
+			}
+			else if (pMonitor->Shape.empty()) {
+				pMonitor->Pointer.Visible = FALSE; // no shape yet
+			}
+			else
+			{
+				pMonitor->Pointer.ShapeHash = ullShapeHash;
+				pMonitor->Pointer.ShapeSize = (UINT)pMonitor->Shape.size();
+			}
+			pMonitor->Pointer.Shape = pMonitor->Shape.empty() ? nullptr : &pMonitor->Shape[0];
+			if (pMonitor->Pointer.Visible) {
+				pMonitor->PointerTime = llArrival;
+			}
+		}
+	} // updateMonitor
+
+	inline void workerProc(_In_ UINT uiMonitor)
+	{
+		tagMonitorState *pMonitor = m_monitors[uiMonitor];
+		HRESULT hr = S_OK;
+
+		while (!m_bStop)
+		{
+			tagCaptureSourceFrame frame;
+			hr = pMonitor->Source->AcquireFrame(DXGICAPTURE_CANVAS_ACQUIRE_TIMEOUT, &frame);
+			if (hr == S_FALSE) {
+				continue; // timeout
+			}
+			CHECK_HR_BREAK(hr);
+
+			INT64 llArrival = now();
+			updateMonitor(pMonitor, &frame, llArrival);
+			hr = pMonitor->Source->ReleaseFrame();
+			CHECK_HR_BREAK(hr);
+
+			{
+				std::lock_guard<std::mutex> lock(m_stateLock);
+				pMonitor->Pending = TRUE;
+				pMonitor->Arrival = llArrival;
+			}
+			m_stateCond.notify_all();
+		}
+
+		if (FAILED(hr))
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_stateLock);
+				pMonitor->Result = hr;
+			}
+			m_stateCond.notify_all();
+		}
+	}
+
+	// under m_stateLock
+	inline HRESULT stateResult(_Out_ UINT *pRetPending) const
+	{
+		UINT uiPending = 0;
+		HRESULT hr = S_OK;
+		for (size_t i = 0; i < m_monitors.size(); ++i)
+		{
+			if (m_monitors[i]->Pending) {
+				uiPending++;
+			}
+			if (FAILED(m_monitors[i]->Result)) {
+				hr = m_monitors[i]->Result;
+			}
+		}
+		*pRetPending = uiPending;
+		return hr;
+	}
+
+	inline void restorePointerBackground()
+	{
+		if (m_pointerBackground.Bounds.Width > 0)
+		{
+			tagFrameRect rcMouse = {
+				m_pointerBackground.Bounds.X,
+				m_pointerBackground.Bounds.Y,
+				m_pointerBackground.Bounds.X + m_pointerBackground.Bounds.Width,
+				m_pointerBackground.Bounds.Y + m_pointerBackground.Bounds.Height };
+			DXGICaptureDirtyRects::CopyBackground(m_canvas.Buffer, m_canvas.Pitch, m_pointerBackground.Buffer, rcMouse, FALSE);
+			m_pointerBackground.Bounds.Width = 0;
+		}
+	}
+
+	inline HRESULT drawPointer(_In_ INT nMonitor)
+	{
+		if ((nMonitor < 0) || !m_pointer.Visible) {
+			return S_FALSE;
+		}
+
+		const tagMonitorState *pMonitor = m_monitors[nMonitor];
+		BYTE *pSurface = m_canvas.Buffer + (size_t)pMonitor->Bounds.Y * m_canvas.Pitch + (size_t)pMonitor->Bounds.X * 4;
+
+		// the canvas is upright, the shape is drawn without rotation and clipped to its monitor
+		HRESULT hr = DXGICapturePointer::Draw(&m_pointer, pMonitor->Bounds.Width, pMonitor->Bounds.Height, 0,
+			&m_cursorCache, &m_tempMouseRotateBuffer, pSurface, m_canvas.Pitch, pMonitor->Bounds.Width, pMonitor->Bounds.Height,
+			&m_pointerBackground);
+		if (m_pointerBackground.Bounds.Width > 0)
+		{
+			m_pointerBackground.Bounds.X += pMonitor->Bounds.X;
+			m_pointerBackground.Bounds.Y += pMonitor->Bounds.Y;
+		}
+		return hr;
+	}
+
+public:
+	CDXGICaptureCanvas()
+		: m_bStop(false)
+		, m_bRunning(FALSE)
+		, m_ullFrameNumber(0)
+		, m_llTimestamp(0)
+		, m_llSkew(0)
+	{
+		memset(&m_config, 0, sizeof(m_config));
+		memset(&m_desktopBounds, 0, sizeof(m_desktopBounds));
+		memset(&m_canvas, 0, sizeof(m_canvas));
+		memset(&m_pointer, 0, sizeof(m_pointer));
+		memset(&m_pointerBackground, 0, sizeof(m_pointerBackground));
+		memset(&m_tempMouseRotateBuffer, 0, sizeof(m_tempMouseRotateBuffer));
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
+	~CDXGICaptureCanvas()
+	{
+		Terminate();
+	}
+
+	//
+	// The sources must stay valid until Terminate, they are used on the worker threads after Start
+	//
+	inline
+	HRESULT
+	Initialize(
+		_In_ const tagCanvasMonitor *pMonitors,
+		_In_ UINT uiCount,
+		_In_opt_ const tagCanvasConfig *pConfig
+		)
+	{
+		CHECK_POINTER_EX(pMonitors, E_INVALIDARG);
+		if ((uiCount == 0) || (uiCount > DXGICAPTURE_CANVAS_MAX_MONITORS)) {
+			return E_INVALIDARG;
+		}
+
+		Terminate();
+
+		if (nullptr != pConfig) {
+			m_config = *pConfig;
+		}
+		else
+		{
+			m_config.SyncWindowUsec  = DXGICAPTURE_CANVAS_DEFAULT_SYNC_WINDOW;
+			m_config.ShowPointer     = 1;
+			m_config.BackgroundColor = 0xFF000000u;
+		}
+
+		// the virtual desktop is the union of the monitor bounds
+		LONG nLeft = 0, nTop = 0, nRight = 0, nBottom = 0;
+		for (UINT i = 0; i < uiCount; ++i)
+		{
+			const tagCanvasMonitor &m = pMonitors[i];
+			CHECK_POINTER_EX(m.Source, E_INVALIDARG);
+			if ((m.Bounds.Width <= 0) || (m.Bounds.Height <= 0)) {
+				return E_INVALIDARG;
+			}
+			if ((i == 0) || (m.Bounds.X < nLeft)) { nLeft = m.Bounds.X; }
+			if ((i == 0) || (m.Bounds.Y < nTop)) { nTop = m.Bounds.Y; }
+			if ((i == 0) || (m.Bounds.X + m.Bounds.Width > nRight)) { nRight = m.Bounds.X + m.Bounds.Width; }
+			if ((i == 0) || (m.Bounds.Y + m.Bounds.Height > nBottom)) { nBottom = m.Bounds.Y + m.Bounds.Height; }
+		}
+		if ((INT64)(nRight - nLeft) * (nBottom - nTop) * 4 > 0x7FFFFFFF) {
+			return E_INVALIDARG;
+		}
+		m_desktopBounds.X      = nLeft;
+		m_desktopBounds.Y      = nTop;
+		m_desktopBounds.Width  = nRight - nLeft;
+		m_desktopBounds.Height = nBottom - nTop;
+
+		HRESULT hr = S_OK;
+		for (UINT i = 0; i < uiCount; ++i)
+		{
+			tagMonitorState *pMonitor = new (std::nothrow) tagMonitorState;
+			if (nullptr == pMonitor)
+			{
+				Terminate();
+				return E_OUTOFMEMORY;
+			}
+			m_monitors.push_back(pMonitor);
+
+			pMonitor->Source      = pMonitors[i].Source;
+			memset(&pMonitor->Frame, 0, sizeof(pMonitor->Frame));
+			memset(&pMonitor->Pointer, 0, sizeof(pMonitor->Pointer));
+			pMonitor->PointerTime = 0;
+			pMonitor->Pending     = FALSE;
+			pMonitor->Arrival     = 0;
+			pMonitor->Result      = S_OK;
+
+			hr = pMonitor->Source->GetDesc(&pMonitor->Desc);
+			if (SUCCEEDED(hr) && ((pMonitor->Desc.DesktopWidth != pMonitors[i].Bounds.Width) || (pMonitor->Desc.DesktopHeight != pMonitors[i].Bounds.Height))) {
+				hr = E_INVALIDARG; // the bounds do not fit the source
+			}
+			if (SUCCEEDED(hr)) {
+				hr = DXGICaptureFrameBuffer::Resize(&pMonitor->Frame, (UINT)(pMonitor->Desc.DesktopWidth * pMonitor->Desc.DesktopHeight * 4));
+			}
+			if (FAILED(hr))
+			{
+				Terminate();
+				return hr;
+			}
+			pMonitor->Frame.BytesPerPixel = 4;
+			pMonitor->Frame.Pitch         = pMonitor->Desc.DesktopWidth * 4;
+			pMonitor->Frame.Bounds.Width  = pMonitor->Desc.DesktopWidth;
+			pMonitor->Frame.Bounds.Height = pMonitor->Desc.DesktopHeight;
+
+			pMonitor->Bounds.X      = pMonitors[i].Bounds.X - nLeft;
+			pMonitor->Bounds.Y      = pMonitors[i].Bounds.Y - nTop;
+			pMonitor->Bounds.Width  = pMonitors[i].Bounds.Width;
+			pMonitor->Bounds.Height = pMonitors[i].Bounds.Height;
+		}
+
+		hr = DXGICaptureFrameBuffer::Resize(&m_canvas, (UINT)(m_desktopBounds.Width * m_desktopBounds.Height * 4));
+		if (FAILED(hr))
+		{
+			Terminate();
+			return hr;
+		}
+		m_canvas.BytesPerPixel = 4;
+		m_canvas.Pitch         = m_desktopBounds.Width * 4;
+		m_canvas.Bounds.Width  = m_desktopBounds.Width;
+		m_canvas.Bounds.Height = m_desktopBounds.Height;
+		for (LONG y = 0; y < m_desktopBounds.Height; ++y)
+		{
+			UINT *pRow = (UINT*)(m_canvas.Buffer + (size_t)y * m_canvas.Pitch);
+			for (LONG x = 0; x < m_desktopBounds.Width; ++x) {
+				pRow[x] = m_config.BackgroundColor;
+			}
+		}
+
+		m_taken.assign(uiCount, FALSE);
+		m_ullFrameNumber = 0;
+		m_llTimestamp    = 0;
+		m_llSkew         = 0;
+		memset(&m_stats, 0, sizeof(m_stats));
+		return S_OK;
+	}
+
+	inline void Terminate()
+	{
+		Stop();
+
+		for (size_t i = 0; i < m_monitors.size(); ++i)
+		{
+			DXGICaptureFrameBuffer::Free(&m_monitors[i]->Frame);
+			delete m_monitors[i];
+		}
+		m_monitors.clear();
+		m_taken.clear();
+
+		DXGICaptureFrameBuffer::Free(&m_canvas);
+		DXGICaptureFrameBuffer::Free(&m_pointerBackground);
+		DXGICaptureFrameBuffer::Free(&m_tempMouseRotateBuffer);
+		m_cursorCache.Clear();
+		memset(&m_pointer, 0, sizeof(m_pointer));
+		m_pointerShape.clear();
+	}
+
+	//
+	// Starts one capture thread per monitor
+	//
+	inline HRESULT Start()
+	{
+		if (m_monitors.empty()) {
+			return E_UNEXPECTED;
+		}
+		if (m_bRunning) {
+			return S_FALSE;
+		}
+
+		m_bStop = false;
+		m_startTick = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < m_monitors.size(); ++i)
+		{
+			m_monitors[i]->Pending = FALSE;
+			m_monitors[i]->Result  = S_OK;
+			m_monitors[i]->Thread  = std::thread(&CDXGICaptureCanvas::workerProc, this, (UINT)i);
+		}
+		m_bRunning = TRUE;
+		return S_OK;
+	}
+
+	inline void Stop()
+	{
+		if (!m_bRunning) {
+			return;
+		}
+
+		m_bStop = true;
+		for (size_t i = 0; i < m_monitors.size(); ++i)
+		{
+			if (m_monitors[i]->Thread.joinable()) {
+				m_monitors[i]->Thread.join();
+			}
+		}
+		m_bRunning = FALSE;
+	}
+
+	//
+	// Waits up to uiTimeoutMsec for a new monitor image and composes the canvas.
+	// Returns S_FALSE on timeout, or the error of a monitor source. After Stop
+	// the images delivered until then are composed without waiting.
+	//
+	inline
+	HRESULT
+	ProcessFrame(
+		_In_ UINT uiTimeoutMsec,
+		_Out_opt_ BOOL *pRetIsTimeout
+		)
+	{
+		RESET_POINTER_EX(pRetIsTimeout, FALSE);
+		if (m_monitors.empty()) {
+			return E_UNEXPECTED;
+		}
+
+		const size_t nCount = m_monitors.size();
+		UINT uiTaken = 0;
+		INT64 llFirst = 0, llLast = 0;
+		{
+			std::unique_lock<std::mutex> lock(m_stateLock);
+
+			UINT uiPending = 0;
+			HRESULT hr = stateResult(&uiPending);
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(uiTimeoutMsec);
+			while (m_bRunning && SUCCEEDED(hr) && (uiPending == 0))
+			{
+				if (m_stateCond.wait_until(lock, deadline) == std::cv_status::timeout)
+				{
+					hr = stateResult(&uiPending);
+					if (SUCCEEDED(hr) && (uiPending == 0))
+					{
+						RESET_POINTER_EX(pRetIsTimeout, TRUE);
+						return S_FALSE;
+					}
+					break;
+				}
+				hr = stateResult(&uiPending);
+			}
+			CHECK_HR_RETURN(hr);
+
+			// the other monitors may be about to deliver, keep the frame together
+			deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_config.SyncWindowUsec);
+			while (m_bRunning && (uiPending < (UINT)nCount) && SUCCEEDED(hr))
+			{
+				if (m_stateCond.wait_until(lock, deadline) == std::cv_status::timeout) {
+					break;
+				}
+				hr = stateResult(&uiPending);
+			}
+
+			for (size_t i = 0; i < nCount; ++i)
+			{
+				tagMonitorState *pMonitor = m_monitors[i];
+				m_taken[i] = pMonitor->Pending;
+				if (!pMonitor->Pending) {
+					continue;
+				}
+				if ((uiTaken == 0) || (pMonitor->Arrival < llFirst)) { llFirst = pMonitor->Arrival; }
+				if ((uiTaken == 0) || (pMonitor->Arrival > llLast)) { llLast = pMonitor->Arrival; }
+				pMonitor->Pending = FALSE;
+				uiTaken++;
+			}
+		}
+
+		restorePointerBackground();
+
+		// changed regions of every monitor (also the ones that arrived just now), and the latest pointer
+		INT nPointerMonitor = -1;
+		INT64 llPointerTime = 0;
+		UINT64 ullBytes = 0;
+		for (size_t i = 0; i < nCount; ++i)
+		{
+			tagMonitorState *pMonitor = m_monitors[i];
+			std::lock_guard<std::mutex> lock(pMonitor->Lock);
+
+			if (!pMonitor->Changed.empty())
+			{
+				BYTE *pDst = m_canvas.Buffer + (size_t)pMonitor->Bounds.Y * m_canvas.Pitch + (size_t)pMonitor->Bounds.X * 4;
+				ullBytes += DXGICaptureDirtyRects::ApplyDirtyRects(pDst, m_canvas.Pitch, pMonitor->Frame.Buffer, pMonitor->Frame.Pitch,
+					&pMonitor->Changed[0], (UINT)pMonitor->Changed.size());
+				pMonitor->Changed.clear();
+			}
+
+			if (m_config.ShowPointer && pMonitor->Pointer.Visible && ((nPointerMonitor < 0) || (pMonitor->PointerTime > llPointerTime)))
+			{
+				nPointerMonitor = (INT)i;
+				llPointerTime   = pMonitor->PointerTime;
+
+				UINT64 ullShapeHash = m_pointer.ShapeHash;
+				m_pointer = pMonitor->Pointer;
+				if ((m_pointer.ShapeHash != ullShapeHash) || (m_pointer.ShapeSize != (UINT)m_pointerShape.size())) {
+					m_pointerShape.assign(pMonitor->Shape.begin(), pMonitor->Shape.end());
+				}
+				m_pointer.Shape = m_pointerShape.empty() ? nullptr : &m_pointerShape[0];
+			}
+		}
+
+		HRESULT hr = drawPointer(nPointerMonitor);
+		CHECK_HR_RETURN(hr);
+
+		m_ullFrameNumber++;
+		m_llTimestamp = llLast;
+		m_llSkew      = llLast - llFirst;
+
+		m_stats.Frames++;
+		m_stats.MonitorUpdates += uiTaken;
+		m_stats.BytesCopied    += ullBytes;
+		m_stats.BytesTotal     += (UINT64)m_canvas.Pitch * m_canvas.Bounds.Height;
+		if (uiTaken < (UINT)nCount) {
+			m_stats.PartialFrames++;
+		}
+		if (uiTaken > 1)
+		{
+			m_stats.SkewFrames++;
+			m_stats.TotalSkewUsec += m_llSkew;
+			if (m_llSkew > m_stats.MaxSkewUsec) {
+				m_stats.MaxSkewUsec = m_llSkew;
+			}
+		}
+		return S_OK;
+	}
+
+	inline const tagFrameBufferInfo* GetCanvas() const { return &m_canvas; }
+	// union of the monitor bounds in desktop coordinates
+	inline const tagFrameBounds* GetDesktopBounds() const { return &m_desktopBounds; }
+	inline UINT GetMonitorCount() const { return (UINT)m_monitors.size(); }
+	// bounds of the monitor in the canvas
+	inline const tagFrameBounds* GetMonitorBounds(UINT uiMonitor) const { return (uiMonitor < m_monitors.size()) ? &m_monitors[uiMonitor]->Bounds : nullptr; }
+	// TRUE if the last frame contains a new image of the monitor
+	inline BOOL IsMonitorUpdated(UINT uiMonitor) const { return (uiMonitor < m_taken.size()) ? m_taken[uiMonitor] : FALSE; }
+	inline UINT64 GetFrameNumber() const { return m_ullFrameNumber; }
+	inline INT64 GetTimestamp() const { return m_llTimestamp; }
+	inline INT64 GetSkew() const { return m_llSkew; }
+	inline BOOL IsRunning() const { return m_bRunning; }
+
+	inline void GetStats(_Out_ tagCanvasStats *pStats) const
+	{
+		*pStats = m_stats;
+	}
+
+}; // end class CDXGICaptureCanvas
+
+#endif // __DXGICAPTURECANVAS_H__
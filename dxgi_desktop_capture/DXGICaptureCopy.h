@@ -0,0 +1,318 @@
+/*****************************************************************************
+* DXGICaptureCopy.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURECOPY_H__
+#define __DXGICAPTURECOPY_H__
+
+#include "DXGICapturePlatform.h"
+
+#include <string.h>
+
+// copies of at least this size bypass the cache (non-temporal stores), the
+// destination is read by the encoder much later, after other frames went through the cache
+#define DXGICAPTURE_STREAM_COPY_MIN_BYTES   (2 * 1024 * 1024)
+
+//
+// struct tagFrameCopyStats_s
+//
+// Image copies of the last frame, from the readback of the desktop image
+// up to the frame handed to the encoder or the consumer.
+//
+typedef struct tagFrameCopyStats_s
+{
+	UINT   Copies;
+	UINT64 BytesCopied;
+	UINT64 BytesStreamed;       /* part of BytesCopied written with non-temporal stores */
+	BOOL   Passthrough;         /* the output is the desktop image, nothing was rendered */
+} tagFrameCopyStats;
+
+//
+// class DXGICaptureCopy
+//
+// Copies 32bpp images row by row. Large copies are written with non-temporal
+// stores (SSE2/AVX2), so a full frame does not evict the working set of the
+// capture from the cache. Opaque copies set the alpha of every pixel to 0xFF.
+//
+class DXGICaptureCopy
+{
+public:
+	static
+	inline
+	void
+	CopyRowScalar(
+		_In_ const BYTE *pSrc,
+		_Out_ BYTE *pDst,
+		_In_ INT nWidth,
+		_In_ BOOL bOpaque
+		)
+	{
+		if (!bOpaque)
+		{
+			memcpy(pDst, pSrc, (size_t)nWidth * 4);
+			return;
+		}
+
+		const UINT *pIn = (const UINT*)pSrc;
+		UINT *pOut = (UINT*)pDst;
+		for (INT x = 0; x < nWidth; ++x) {
+			pOut[x] = pIn[x] | 0xFF000000;
+		}
+	} // CopyRowScalar
+
+#if defined(DXGICAPTURE_HAVE_X86)
+	//
+	// The destination is aligned to 16 bytes by a scalar head, the body is
+	// written a cache line (4 registers) per step
+	//
+	static
+	inline
+	void
+	CopyRowSSE2(
+		_In_ const BYTE *pSrc,
+		_Out_ BYTE *pDst,
+		_In_ INT nWidth,
+		_In_ BOOL bOpaque,
+		_In_ BOOL bStream
+		)
+	{
+		INT nHead = (INT)(((16 - ((size_t)pDst & 15)) & 15) >> 2);
+		if (((size_t)pDst & 3) || (nHead > nWidth)) {
+			nHead = nWidth;
+		}
+		CopyRowScalar(pSrc, pDst, nHead, bOpaque);
+
+		const __m128i alpha = _mm_set1_epi32(bOpaque ? (int)0xFF000000 : 0);
+		INT x = nHead;
+		for (; x + 16 <= nWidth; x += 16)
+		{
+			const __m128i *pIn = reinterpret_cast<const __m128i*>(pSrc + (size_t)x * 4);
+			__m128i *pOut = reinterpret_cast<__m128i*>(pDst + (size_t)x * 4);
+			__m128i p0 = _mm_or_si128(_mm_loadu_si128(pIn), alpha);
+			__m128i p1 = _mm_or_si128(_mm_loadu_si128(pIn + 1), alpha);
+			__m128i p2 = _mm_or_si128(_mm_loadu_si128(pIn + 2), alpha);
+			__m128i p3 = _mm_or_si128(_mm_loadu_si128(pIn + 3), alpha);
+			if (bStream)
+			{
+				_mm_stream_si128(pOut, p0);
+				_mm_stream_si128(pOut + 1, p1);
+				_mm_stream_si128(pOut + 2, p2);
+				_mm_stream_si128(pOut + 3, p3);
+			}
+			else
+			{
+				_mm_store_si128(pOut, p0);
+				_mm_store_si128(pOut + 1, p1);
+				_mm_store_si128(pOut + 2, p2);
+				_mm_store_si128(pOut + 3, p3);
+			}
+		}
+		for (; x + 4 <= nWidth; x += 4)
+		{
+			__m128i p = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + (size_t)x * 4)), alpha);
+			if (bStream) {
+				_mm_stream_si128(reinterpret_cast<__m128i*>(pDst + (size_t)x * 4), p);
+			}
+			else {
+				_mm_store_si128(reinterpret_cast<__m128i*>(pDst + (size_t)x * 4), p);
+			}
+		}
+		CopyRowScalar(pSrc + (size_t)x * 4, pDst + (size_t)x * 4, nWidth - x, bOpaque);
+	} // CopyRowSSE2
+
+	//
+	// Same as SSE2 with 32 byte registers, the destination is aligned to 32 bytes
+	//
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	void
+	CopyRowAVX2(
+		_In_ const BYTE *pSrc,
+		_Out_ BYTE *pDst,
+		_In_ INT nWidth,
+		_In_ BOOL bOpaque,
+		_In_ BOOL bStream
+		)
+	{
+		INT nHead = (INT)(((32 - ((size_t)pDst & 31)) & 31) >> 2);
+		if (((size_t)pDst & 3) || (nHead > nWidth)) {
+			nHead = nWidth;
+		}
+		CopyRowScalar(pSrc, pDst, nHead, bOpaque);
+
+		const __m256i alpha = _mm256_set1_epi32(bOpaque ? (int)0xFF000000 : 0);
+		INT x = nHead;
+		for (; x + 16 <= nWidth; x += 16)
+		{
+			const __m256i *pIn = reinterpret_cast<const __m256i*>(pSrc + (size_t)x * 4);
+			__m256i *pOut = reinterpret_cast<__m256i*>(pDst + (size_t)x * 4);
+			__m256i p0 = _mm256_or_si256(_mm256_loadu_si256(pIn), alpha);
+			__m256i p1 = _mm256_or_si256(_mm256_loadu_si256(pIn + 1), alpha);
+			if (bStream)
+			{
+				_mm256_stream_si256(pOut, p0);
+				_mm256_stream_si256(pOut + 1, p1);
+			}
+			else
+			{
+				_mm256_store_si256(pOut, p0);
+				_mm256_store_si256(pOut + 1, p1);
+			}
+		}
+		for (; x + 8 <= nWidth; x += 8)
+		{
+			__m256i p = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + (size_t)x * 4)), alpha);
+			if (bStream) {
+				_mm256_stream_si256(reinterpret_cast<__m256i*>(pDst + (size_t)x * 4), p);
+			}
+			else {
+				_mm256_store_si256(reinterpret_cast<__m256i*>(pDst + (size_t)x * 4), p);
+			}
+		}
+		CopyRowScalar(pSrc + (size_t)x * 4, pDst + (size_t)x * 4, nWidth - x, bOpaque);
+	} // CopyRowAVX2
+#endif // DXGICAPTURE_HAVE_X86
+
+#if defined(DXGICAPTURE_HAVE_NEON)
+	//
+	// NEON has no non-temporal store intrinsic, only the opaque copy is vectorized
+	//
+	static
+	inline
+	void
+	CopyRowNEON(
+		_In_ const BYTE *pSrc,
+		_Out_ BYTE *pDst,
+		_In_ INT nWidth,
+		_In_ BOOL bOpaque
+		)
+	{
+		if (!bOpaque)
+		{
+			memcpy(pDst, pSrc, (size_t)nWidth * 4);
+			return;
+		}
+
+		const uint32x4_t alpha = vdupq_n_u32(0xFF000000);
+		INT x = 0;
+		for (; x + 4 <= nWidth; x += 4)
+		{
+			uint32x4_t p = vld1q_u32(reinterpret_cast<const uint32_t*>(pSrc + (size_t)x * 4));
+			vst1q_u32(reinterpret_cast<uint32_t*>(pDst + (size_t)x * 4), vorrq_u32(p, alpha));
+		}
+		CopyRowScalar(pSrc + (size_t)x * 4, pDst + (size_t)x * 4, nWidth - x, bOpaque);
+	} // CopyRowNEON
+#endif // DXGICAPTURE_HAVE_NEON
+
+	//
+	// Copies nWidth x nHeight pixels, streamed when the image is at least
+	// DXGICAPTURE_STREAM_COPY_MIN_BYTES. The copy is added to pStats.
+	//
+	static
+	inline
+	void
+	CopyPixels(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_Out_ BYTE *pDst,
+		_In_ INT nDstPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ BOOL bOpaque = FALSE,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto,
+		_Inout_opt_ tagFrameCopyStats *pStats = nullptr
+		)
+	{
+		if ((nWidth <= 0) || (nHeight <= 0)) {
+			return;
+		}
+
+		const UINT64 ullBytes = (UINT64)nWidth * nHeight * 4;
+		const BOOL bStream = (ullBytes >= DXGICAPTURE_STREAM_COPY_MIN_BYTES);
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		// one block when both images are packed
+		if ((nSrcPitch == nWidth * 4) && (nDstPitch == nWidth * 4))
+		{
+			nWidth *= nHeight;
+			nHeight = 1;
+		}
+
+		BOOL bStreamed = FALSE;
+		switch (level)
+		{
+#if defined(DXGICAPTURE_HAVE_X86)
+		case tagSimdLevel_AVX2:
+			for (INT y = 0; y < nHeight; ++y) {
+				CopyRowAVX2(pSrc + (size_t)y * nSrcPitch, pDst + (size_t)y * nDstPitch, nWidth, bOpaque, bStream);
+			}
+			bStreamed = bStream;
+			break;
+		case tagSimdLevel_SSE2:
+			for (INT y = 0; y < nHeight; ++y) {
+				CopyRowSSE2(pSrc + (size_t)y * nSrcPitch, pDst + (size_t)y * nDstPitch, nWidth, bOpaque, bStream);
+			}
+			bStreamed = bStream;
+			break;
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+		case tagSimdLevel_NEON:
+			for (INT y = 0; y < nHeight; ++y) {
+				CopyRowNEON(pSrc + (size_t)y * nSrcPitch, pDst + (size_t)y * nDstPitch, nWidth, bOpaque);
+			}
+			break;
+#endif
+		default:
+			for (INT y = 0; y < nHeight; ++y) {
+				CopyRowScalar(pSrc + (size_t)y * nSrcPitch, pDst + (size_t)y * nDstPitch, nWidth, bOpaque);
+			}
+			break;
+		}
+
+#if defined(DXGICAPTURE_HAVE_X86)
+		if (bStreamed) {
+			_mm_sfence(); // the streamed lines are visible before the frame is handed over
+		}
+#endif
+
+		if (nullptr != pStats) {
+			AddCopy(pStats, ullBytes, bStreamed);
+		}
+	} // CopyPixels
+
+	//
+	// Counts a copy that was done elsewhere (gpu readback, D2D1 upload and drawing)
+	//
+	static
+	inline
+	void
+	AddCopy(
+		_Inout_ tagFrameCopyStats *pStats,
+		_In_ UINT64 ullBytes,
+		_In_ BOOL bStreamed = FALSE
+		)
+	{
+		pStats->Copies++;
+		pStats->BytesCopied += ullBytes;
+		if (bStreamed) {
+			pStats->BytesStreamed += ullBytes;
+		}
+	} // AddCopy
+
+}; // end class DXGICaptureCopy
+
+#endif // __DXGICAPTURECOPY_H__
@@ -0,0 +1,276 @@
+/*****************************************************************************
+* DXGICaptureCursorCache.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURECURSORCACHE_H__
+#define __DXGICAPTURECURSORCACHE_H__
+
+#include "DXGICapturePlatform.h"
+
+#include <string.h>
+
+//
+// struct tagCursorCacheStats_s
+//
+typedef struct tagCursorCacheStats_s
+{
+	UINT64 Hits;      /* lookups that found a processed shape */
+	UINT64 Misses;    /* lookups that had to process the shape */
+	UINT64 Evictions; /* processed shapes dropped for a new one */
+	UINT   Entries;   /* processed shapes currently cached */
+	UINT   Capacity;
+} tagCursorCacheStats;
+
+//
+// struct tagCursorCacheEntry_s
+//
+typedef struct tagCursorCacheEntry_s
+{
+	UINT64                               Key;
+	UINT64                               LastUsed;  /* 0: empty slot */
+	UINT                                 BufferSize;
+	_Field_size_bytes_(BufferSize) BYTE* Buffer;    /* processed (expanded + rotated) shape */
+	INT                                  Width;
+	INT                                  Height;
+	INT                                  Pitch;
+} tagCursorCacheEntry;
+
+//
+// class CDXGICursorCache
+//
+// Small LRU cache of processed cursor shapes. The shape processing
+// (mask expansion + rotation) only depends on the raw shape, the shape
+// info and the output rotation, so a cursor that was already processed
+// costs a single blend per frame.
+//
+class CDXGICursorCache
+{
+public:
+	enum { DEFAULT_CAPACITY = 8, MAX_CAPACITY = 32 };
+
+private:
+	tagCursorCacheEntry m_entries[MAX_CAPACITY];
+	UINT                m_uiCapacity;
+	UINT64              m_ullTick;
+	tagCursorCacheStats m_stats;
+
+	// disable copy, the entries own their buffers
+	CDXGICursorCache(const CDXGICursorCache&);
+	CDXGICursorCache& operator=(const CDXGICursorCache&);
+
+	static
+	inline
+	UINT64
+	rotl64(UINT64 x, INT r)
+	{
+		return (x << r) | (x >> (64 - r));
+	} // rotl64
+
+	static
+	inline
+	UINT64
+	mix64(UINT64 x)
+	{
+		x ^= x >> 33;
+		x *= 0xFF51AFD7ED558CCDULL;
+		x ^= x >> 33;
+		x *= 0xC4CEB9FE1A85EC53ULL;
+		x ^= x >> 33;
+		return x;
+	} // mix64
+
+public:
+	CDXGICursorCache(UINT uiCapacity = DEFAULT_CAPACITY)
+		: m_uiCapacity((uiCapacity == 0) ? 1 : ((uiCapacity > (UINT)MAX_CAPACITY) ? (UINT)MAX_CAPACITY : uiCapacity))
+		, m_ullTick(0)
+	{
+		memset(m_entries, 0, sizeof(m_entries));
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
+	~CDXGICursorCache()
+	{
+		this->Clear();
+	}
+
+	//
+	// Fast 64-bit hash of a shape buffer (8 bytes per step)
+	//
+	static
+	inline
+	UINT64
+	HashBytes(
+		_In_reads_bytes_(uiSize) const BYTE *pData,
+		_In_ UINT uiSize,
+		_In_ UINT64 ullSeed
+		)
+	{
+		UINT64 h = ullSeed ^ ((UINT64)uiSize * 0x9E3779B97F4A7C15ULL);
+		UINT i = 0;
+		for (; i + 8 <= uiSize; i += 8)
+		{
+			UINT64 k;
+			memcpy(&k, pData + i, sizeof(k));
+			h ^= rotl64(k * 0x87C37B91114253D5ULL, 31) * 0x4CF5AD432745937FULL;
+			h = rotl64(h, 27) * 5 + 0x52DCE729;
+		}
+		if (i < uiSize)
+		{
+			UINT64 k = 0;
+			memcpy(&k, pData + i, uiSize - i);
+			h ^= rotl64(k * 0x87C37B91114253D5ULL, 31) * 0x4CF5AD432745937FULL;
+		}
+		return mix64(h);
+	} // HashBytes
+
+	//
+	// Combines the shape hash with the shape description and the rotation
+	//
+	static
+	inline
+	UINT64
+	MakeKey(
+		_In_ UINT64 ullShapeHash,
+		_In_ UINT uiType,
+		_In_ UINT uiWidth,
+		_In_ UINT uiHeight,
+		_In_ UINT uiPitch,
+		_In_ INT nRotateDegrees
+		)
+	{
+		UINT64 k = ullShapeHash;
+		k = mix64(k ^ (((UINT64)uiType << 32) | (UINT64)(UINT)nRotateDegrees));
+		k = mix64(k ^ (((UINT64)uiWidth << 32) | (UINT64)uiHeight));
+		k = mix64(k ^ (UINT64)uiPitch);
+		return k;
+	} // MakeKey
+
+	//
+	// Returns the cached shape of the key or nullptr, counts a hit or a miss
+	//
+	inline
+	tagCursorCacheEntry*
+	Find(
+		_In_ UINT64 ullKey
+		)
+	{
+		for (UINT i = 0; i < m_uiCapacity; ++i)
+		{
+			tagCursorCacheEntry *pEntry = &m_entries[i];
+			if ((pEntry->LastUsed != 0) && (pEntry->Key == ullKey))
+			{
+				pEntry->LastUsed = ++m_ullTick;
+				++m_stats.Hits;
+				return pEntry;
+			}
+		}
+		++m_stats.Misses;
+		return nullptr;
+	} // Find
+
+	//
+	// Returns the slot for a new shape (an empty or the least recently used one).
+	// The slot keeps its buffer, the caller resizes and fills it.
+	//
+	inline
+	tagCursorCacheEntry*
+	Insert(
+		_In_ UINT64 ullKey
+		)
+	{
+		tagCursorCacheEntry *pSlot = &m_entries[0];
+		for (UINT i = 0; i < m_uiCapacity; ++i)
+		{
+			tagCursorCacheEntry *pEntry = &m_entries[i];
+			if (pEntry->LastUsed == 0)
+			{
+				pSlot = pEntry;
+				break;
+			}
+			if (pEntry->LastUsed < pSlot->LastUsed) {
+				pSlot = pEntry;
+			}
+		}
+
+		if (pSlot->LastUsed != 0) {
+			++m_stats.Evictions;
+		}
+
+		pSlot->Key      = ullKey;
+		pSlot->LastUsed = ++m_ullTick;
+		pSlot->Width    = 0;
+		pSlot->Height   = 0;
+		pSlot->Pitch    = 0;
+		return pSlot;
+	} // Insert
+
+	//
+	// Marks a slot empty again (e.g. processing failed), keeps its buffer
+	//
+	inline
+	void
+	Remove(
+		_Inout_ tagCursorCacheEntry *pEntry
+		)
+	{
+		if (nullptr != pEntry) {
+			pEntry->LastUsed = 0;
+		}
+	} // Remove
+
+	//
+	// Frees all processed shapes, the counters are kept
+	//
+	inline
+	void
+	Clear()
+	{
+		for (UINT i = 0; i < MAX_CAPACITY; ++i)
+		{
+			if (nullptr != m_entries[i].Buffer) {
+				delete[] m_entries[i].Buffer;
+			}
+		}
+		memset(m_entries, 0, sizeof(m_entries));
+	} // Clear
+
+	inline
+	void
+	GetStats(
+		_Out_ tagCursorCacheStats *pStats
+		) const
+	{
+		*pStats = m_stats;
+		pStats->Entries = 0;
+		for (UINT i = 0; i < m_uiCapacity; ++i)
+		{
+			if (m_entries[i].LastUsed != 0) {
+				++(pStats->Entries);
+			}
+		}
+		pStats->Capacity = m_uiCapacity;
+	} // GetStats
+
+	inline
+	void
+	ResetStats()
+	{
+		memset(&m_stats, 0, sizeof(m_stats));
+	} // ResetStats
+
+}; // end class CDXGICursorCache
+
+#endif // __DXGICAPTURECURSORCACHE_H__
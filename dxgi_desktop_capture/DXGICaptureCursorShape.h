@@ -0,0 +1,415 @@
+/*****************************************************************************
+* DXGICaptureCursorShape.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURECURSORSHAPE_H__
+#define __DXGICAPTURECURSORSHAPE_H__
+
+#include "DXGICapturePlatform.h"
+
+//
+// class DXGICaptureCursorShape
+//
+// Expands monochrome and masked color cursor shapes to two 32bpp planes,
+// an AND mask and a XOR mask. The compositor applies both in one pass:
+//   Dst = (Dst & AndMask) ^ XorMask
+//
+//   Monochrome   AND XOR   result
+//                 0   0    black
+//                 0   1    white
+//                 1   0    screen (transparent)
+//                 1   1    inverted screen
+//
+//   Masked color: mask 0x00 -> the color replaces the screen pixel
+//                 mask 0xFF -> the color is XORed with the screen pixel
+//                 (other mask values: the high bit decides)
+//
+// The alpha channel of the destination is always kept.
+//
+class DXGICaptureCursorShape
+{
+private:
+	//
+	// 8 pixel mask (0x00 or 0xFF per byte, first pixel in the lowest byte) for each mask byte.
+	// Built by the preprocessor, the table is constant initialized.
+	//
+	static
+	inline
+	const UINT64*
+	getExpandTable()
+	{
+#define DXGICAPTURE_MASK_BIT(v, b)  (((((v) >> (7 - (b))) & 1) != 0) ? ((UINT64)0xFF << ((b) * 8)) : (UINT64)0)
+#define DXGICAPTURE_MASK_BYTE(v)    (DXGICAPTURE_MASK_BIT(v, 0) | DXGICAPTURE_MASK_BIT(v, 1) | DXGICAPTURE_MASK_BIT(v, 2) | DXGICAPTURE_MASK_BIT(v, 3) | \
+                                     DXGICAPTURE_MASK_BIT(v, 4) | DXGICAPTURE_MASK_BIT(v, 5) | DXGICAPTURE_MASK_BIT(v, 6) | DXGICAPTURE_MASK_BIT(v, 7))
+#define DXGICAPTURE_MASK_4(v)       DXGICAPTURE_MASK_BYTE(v), DXGICAPTURE_MASK_BYTE((v) + 1), DXGICAPTURE_MASK_BYTE((v) + 2), DXGICAPTURE_MASK_BYTE((v) + 3)
+#define DXGICAPTURE_MASK_16(v)      DXGICAPTURE_MASK_4(v), DXGICAPTURE_MASK_4((v) + 4), DXGICAPTURE_MASK_4((v) + 8), DXGICAPTURE_MASK_4((v) + 12)
+#define DXGICAPTURE_MASK_64(v)      DXGICAPTURE_MASK_16(v), DXGICAPTURE_MASK_16((v) + 16), DXGICAPTURE_MASK_16((v) + 32), DXGICAPTURE_MASK_16((v) + 48)
+
+		static const UINT64 s_expandTable[256] =
+		{
+			DXGICAPTURE_MASK_64(0), DXGICAPTURE_MASK_64(64), DXGICAPTURE_MASK_64(128), DXGICAPTURE_MASK_64(192)
+		};
+
+#undef DXGICAPTURE_MASK_64
+#undef DXGICAPTURE_MASK_16
+#undef DXGICAPTURE_MASK_4
+#undef DXGICAPTURE_MASK_BYTE
+#undef DXGICAPTURE_MASK_BIT
+
+		return s_expandTable;
+	} // getExpandTable
+
+	static const UINT ALPHA_MASK = 0xFF000000;
+	static const UINT COLOR_MASK = 0x00FFFFFF;
+
+	//
+	// Expands one row of AND and XOR mask bits
+	//
+	static
+	inline
+	void
+	expandMonochromeRowScalar(
+		UINT *pAnd,
+		UINT *pXor,
+		const BYTE *pAndBits,
+		const BYTE *pXorBits,
+		INT width
+		)
+	{
+		const UINT64 *pTable = getExpandTable();
+		for (INT x = 0; x < width; x += 8)
+		{
+			UINT64 andMask = pTable[pAndBits[x >> 3]];
+			UINT64 xorMask = pTable[pXorBits[x >> 3]];
+			INT n = (width - x < 8) ? (width - x) : 8;
+			for (INT i = 0; i < n; ++i)
+			{
+				UINT a = (UINT)(BYTE)(andMask >> (i * 8)) * 0x01010101u;
+				UINT b = (UINT)(BYTE)(xorMask >> (i * 8)) * 0x01010101u;
+				pAnd[x + i] = a | ALPHA_MASK;
+				pXor[x + i] = b & COLOR_MASK;
+			}
+		}
+	} // expandMonochromeRowScalar
+
+#if defined(DXGICAPTURE_HAVE_X86)
+	static
+	inline
+	void
+	expandMonochromeRowSSE2(
+		UINT *pAnd,
+		UINT *pXor,
+		const BYTE *pAndBits,
+		const BYTE *pXorBits,
+		INT width
+		)
+	{
+		const UINT64 *pTable = getExpandTable();
+		const __m128i alpha = _mm_set1_epi32((int)ALPHA_MASK);
+		const __m128i color = _mm_set1_epi32((int)COLOR_MASK);
+
+		INT x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			__m128i a = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTable + pAndBits[x >> 3]));
+			__m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTable + pXorBits[x >> 3]));
+			// 8 x 8 bit -> 8 x 32 bit
+			a = _mm_unpacklo_epi8(a, a);
+			b = _mm_unpacklo_epi8(b, b);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pAnd + x),     _mm_or_si128(_mm_unpacklo_epi16(a, a), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pAnd + x + 4), _mm_or_si128(_mm_unpackhi_epi16(a, a), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pXor + x),     _mm_and_si128(_mm_unpacklo_epi16(b, b), color));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pXor + x + 4), _mm_and_si128(_mm_unpackhi_epi16(b, b), color));
+		}
+
+		if (x < width) {
+			expandMonochromeRowScalar(pAnd + x, pXor + x, pAndBits + (x >> 3), pXorBits + (x >> 3), width - x);
+		}
+	} // expandMonochromeRowSSE2
+
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	void
+	expandMonochromeRowAVX2(
+		UINT *pAnd,
+		UINT *pXor,
+		const BYTE *pAndBits,
+		const BYTE *pXorBits,
+		INT width
+		)
+	{
+		const UINT64 *pTable = getExpandTable();
+		const __m256i alpha = _mm256_set1_epi32((int)ALPHA_MASK);
+		const __m256i color = _mm256_set1_epi32((int)COLOR_MASK);
+
+		INT x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			// sign extension turns 0xFF into 0xFFFFFFFF
+			__m256i a = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTable + pAndBits[x >> 3])));
+			__m256i b = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pTable + pXorBits[x >> 3])));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pAnd + x), _mm256_or_si256(a, alpha));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pXor + x), _mm256_and_si256(b, color));
+		}
+
+		if (x < width) {
+			expandMonochromeRowScalar(pAnd + x, pXor + x, pAndBits + (x >> 3), pXorBits + (x >> 3), width - x);
+		}
+	} // expandMonochromeRowAVX2
+#endif // DXGICAPTURE_HAVE_X86
+
+#if defined(DXGICAPTURE_HAVE_NEON)
+	static
+	inline
+	void
+	expandMonochromeRowNEON(
+		UINT *pAnd,
+		UINT *pXor,
+		const BYTE *pAndBits,
+		const BYTE *pXorBits,
+		INT width
+		)
+	{
+		const UINT64 *pTable = getExpandTable();
+		const uint32x4_t alpha = vdupq_n_u32(ALPHA_MASK);
+		const uint32x4_t color = vdupq_n_u32(COLOR_MASK);
+
+		INT x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			int16x8_t a = vmovl_s8(vreinterpret_s8_u64(vld1_u64(pTable + pAndBits[x >> 3])));
+			int16x8_t b = vmovl_s8(vreinterpret_s8_u64(vld1_u64(pTable + pXorBits[x >> 3])));
+			vst1q_u32(pAnd + x,     vorrq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(a))),  alpha));
+			vst1q_u32(pAnd + x + 4, vorrq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(a))), alpha));
+			vst1q_u32(pXor + x,     vandq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(b))),  color));
+			vst1q_u32(pXor + x + 4, vandq_u32(vreinterpretq_u32_s32(vmovl_s16(vget_high_s16(b))), color));
+		}
+
+		if (x < width) {
+			expandMonochromeRowScalar(pAnd + x, pXor + x, pAndBits + (x >> 3), pXorBits + (x >> 3), width - x);
+		}
+	} // expandMonochromeRowNEON
+#endif // DXGICAPTURE_HAVE_NEON
+
+	static
+	inline
+	void
+	expandMaskedColorRow(
+		UINT *pAnd,
+		UINT *pXor,
+		const UINT *pSrc,
+		INT width,
+		tagSimdLevel level
+		)
+	{
+		INT x = 0;
+#if defined(DXGICAPTURE_HAVE_X86)
+		if (level >= tagSimdLevel_SSE2)
+		{
+			const __m128i alpha = _mm_set1_epi32((int)ALPHA_MASK);
+			const __m128i color = _mm_set1_epi32((int)COLOR_MASK);
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + x));
+				// mask byte 0xFF -> 0xFFFFFFFF, 0x00 -> 0x00000000 (the high bit decides)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pAnd + x), _mm_or_si128(_mm_srai_epi32(s, 31), alpha));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pXor + x), _mm_and_si128(s, color));
+			}
+		}
+#elif defined(DXGICAPTURE_HAVE_NEON)
+		if (level == tagSimdLevel_NEON)
+		{
+			const uint32x4_t alpha = vdupq_n_u32(ALPHA_MASK);
+			const uint32x4_t color = vdupq_n_u32(COLOR_MASK);
+			for (; x + 4 <= width; x += 4)
+			{
+				uint32x4_t s = vld1q_u32(pSrc + x);
+				vst1q_u32(pAnd + x, vorrq_u32(vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(s), 31)), alpha));
+				vst1q_u32(pXor + x, vandq_u32(s, color));
+			}
+		}
+#else
+		(void)level;
+#endif
+		for (; x < width; ++x)
+		{
+			pAnd[x] = (pSrc[x] & 0x80000000) ? 0xFFFFFFFF : ALPHA_MASK;
+			pXor[x] = pSrc[x] & COLOR_MASK;
+		}
+	} // expandMaskedColorRow
+
+	static
+	inline
+	void
+	composeMaskRow(
+		UINT *pDst,
+		const UINT *pAnd,
+		const UINT *pXor,
+		INT width,
+		tagSimdLevel level
+		)
+	{
+		INT x = 0;
+#if defined(DXGICAPTURE_HAVE_X86)
+		if (level >= tagSimdLevel_SSE2)
+		{
+			for (; x + 4 <= width; x += 4)
+			{
+				__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pDst + x));
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAnd + x));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pXor + x));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + x), _mm_xor_si128(_mm_and_si128(d, a), b));
+			}
+		}
+#elif defined(DXGICAPTURE_HAVE_NEON)
+		if (level == tagSimdLevel_NEON)
+		{
+			for (; x + 4 <= width; x += 4)
+			{
+				vst1q_u32(pDst + x, veorq_u32(vandq_u32(vld1q_u32(pDst + x), vld1q_u32(pAnd + x)), vld1q_u32(pXor + x)));
+			}
+		}
+#else
+		(void)level;
+#endif
+		for (; x < width; ++x)
+		{
+			pDst[x] = (pDst[x] & pAnd[x]) ^ pXor[x];
+		}
+	} // composeMaskRow
+
+public:
+	//
+	// Expands a DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME shape.
+	// pShape holds the AND mask rows followed by the XOR mask rows (height rows each),
+	// one bit per pixel, most significant bit first.
+	//
+	static
+	inline
+	void
+	ExpandMonochrome(
+		_In_ const BYTE *pShape,
+		_In_ INT shapePitch,
+		_In_ INT width,
+		_In_ INT height,
+		_Out_ BYTE *pAnd,
+		_In_ INT andPitch,
+		_Out_ BYTE *pXor,
+		_In_ INT xorPitch,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		for (INT y = 0; y < height; ++y)
+		{
+			UINT *pAndRow = reinterpret_cast<UINT*>(pAnd + (ptrdiff_t)y * andPitch);
+			UINT *pXorRow = reinterpret_cast<UINT*>(pXor + (ptrdiff_t)y * xorPitch);
+			const BYTE *pAndBits = pShape + (ptrdiff_t)y * shapePitch;
+			const BYTE *pXorBits = pShape + (ptrdiff_t)(y + height) * shapePitch;
+
+			switch (level)
+			{
+#if defined(DXGICAPTURE_HAVE_X86)
+			case tagSimdLevel_AVX2:
+				expandMonochromeRowAVX2(pAndRow, pXorRow, pAndBits, pXorBits, width);
+				break;
+			case tagSimdLevel_SSE2:
+				expandMonochromeRowSSE2(pAndRow, pXorRow, pAndBits, pXorBits, width);
+				break;
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+			case tagSimdLevel_NEON:
+				expandMonochromeRowNEON(pAndRow, pXorRow, pAndBits, pXorBits, width);
+				break;
+#endif
+			default:
+				expandMonochromeRowScalar(pAndRow, pXorRow, pAndBits, pXorBits, width);
+				break;
+			}
+		}
+	} // ExpandMonochrome
+
+	//
+	// Expands a DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR shape (32bpp, mask in the alpha byte)
+	//
+	static
+	inline
+	void
+	ExpandMaskedColor(
+		_In_ const BYTE *pShape,
+		_In_ INT shapePitch,
+		_In_ INT width,
+		_In_ INT height,
+		_Out_ BYTE *pAnd,
+		_In_ INT andPitch,
+		_Out_ BYTE *pXor,
+		_In_ INT xorPitch,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		for (INT y = 0; y < height; ++y)
+		{
+			expandMaskedColorRow(
+				reinterpret_cast<UINT*>(pAnd + (ptrdiff_t)y * andPitch),
+				reinterpret_cast<UINT*>(pXor + (ptrdiff_t)y * xorPitch),
+				reinterpret_cast<const UINT*>(pShape + (ptrdiff_t)y * shapePitch),
+				width,
+				level);
+		}
+	} // ExpandMaskedColor
+
+	//
+	// Dst = (Dst & And) ^ Xor
+	//
+	static
+	inline
+	void
+	ComposeMask(
+		_Inout_ BYTE *pDst,
+		_In_ INT dstPitch,
+		_In_ const BYTE *pAnd,
+		_In_ INT andPitch,
+		_In_ const BYTE *pXor,
+		_In_ INT xorPitch,
+		_In_ INT width,
+		_In_ INT height,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		if ((nullptr == pDst) || (nullptr == pAnd) || (nullptr == pXor) || (width <= 0) || (height <= 0)) {
+			return;
+		}
+
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		for (INT y = 0; y < height; ++y)
+		{
+			composeMaskRow(
+				reinterpret_cast<UINT*>(pDst + (ptrdiff_t)y * dstPitch),
+				reinterpret_cast<const UINT*>(pAnd + (ptrdiff_t)y * andPitch),
+				reinterpret_cast<const UINT*>(pXor + (ptrdiff_t)y * xorPitch),
+				width,
+				level);
+		}
+	} // ComposeMask
+
+}; // end class DXGICaptureCursorShape
+
+#endif // __DXGICAPTURECURSORSHAPE_H__
@@ -0,0 +1,666 @@
+/*****************************************************************************
+* DXGICaptureDeflate.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREDEFLATE_H__
+#define __DXGICAPTUREDEFLATE_H__
+
+#include "DXGICapturePlatform.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#define DXGICAPTURE_DEFLATE_WINDOW_SIZE     32768
+#define DXGICAPTURE_DEFLATE_HASH_BITS       15
+#define DXGICAPTURE_DEFLATE_MIN_MATCH       3
+#define DXGICAPTURE_DEFLATE_MAX_MATCH       258
+#define DXGICAPTURE_DEFLATE_MAX_CHAIN       16
+#define DXGICAPTURE_DEFLATE_BLOCK_TOKENS    65536
+
+//
+// class DXGICaptureDeflate
+//
+// Portable deflate (RFC 1951) compressor: greedy LZ77 over hash chains and
+// dynamic Huffman blocks. A buffer is compressed as an independent run of
+// blocks that ends byte aligned (sync flush), so the runs of several strips
+// compressed on different threads concatenate into one valid stream; the
+// zlib (RFC 1950) Adler-32 of the whole stream is combined from the strips.
+//
+class DXGICaptureDeflate
+{
+private:
+	//
+	// LSB first bit writer
+	//
+	typedef struct tagBitWriter_s
+	{
+		std::vector<BYTE>* Output;
+		UINT64             Bits;
+		UINT               Count;
+	} tagBitWriter;
+
+	static
+	inline
+	void
+	putBits(
+		_Inout_ tagBitWriter *pWriter,
+		_In_ UINT uiBits,
+		_In_ UINT uiCount
+		)
+	{
+		pWriter->Bits |= (UINT64)uiBits << pWriter->Count;
+		pWriter->Count += uiCount;
+		while (pWriter->Count >= 8)
+		{
+			pWriter->Output->push_back((BYTE)pWriter->Bits);
+			pWriter->Bits >>= 8;
+			pWriter->Count -= 8;
+		}
+	} // putBits
+
+	static
+	inline
+	void
+	alignBits(
+		_Inout_ tagBitWriter *pWriter
+		)
+	{
+		if (pWriter->Count > 0) {
+			putBits(pWriter, 0, 8 - pWriter->Count);
+		}
+	} // alignBits
+
+	static
+	inline
+	UINT
+	reverseBits(
+		_In_ UINT uiCode,
+		_In_ UINT uiLength
+		)
+	{
+		UINT uiResult = 0;
+		for (UINT i = 0; i < uiLength; ++i)
+		{
+			uiResult = (uiResult << 1) | (uiCode & 1);
+			uiCode >>= 1;
+		}
+		return uiResult;
+	} // reverseBits
+
+	//
+	// Huffman code lengths limited to uiMaxBits, the frequencies are flattened until the tree fits
+	//
+	static
+	inline
+	void
+	buildLengths(
+		_In_ const UINT *pFreq,
+		_In_ UINT uiCount,
+		_In_ UINT uiMaxBits,
+		_Out_ BYTE *pLengths
+		)
+	{
+		std::vector<UINT> freq(pFreq, pFreq + uiCount);
+		std::vector<UINT> symbols;
+		std::vector<UINT> weight;
+		std::vector<UINT> parent;
+		std::vector<UINT> depth;
+
+		for (;;)
+		{
+			memset(pLengths, 0, uiCount);
+			symbols.clear();
+			for (UINT i = 0; i < uiCount; ++i)
+			{
+				if (freq[i] > 0) {
+					symbols.push_back(i);
+				}
+			}
+			if (symbols.empty()) {
+				return;
+			}
+			if (symbols.size() == 1)
+			{
+				pLengths[symbols[0]] = 1;
+				return;
+			}
+
+			std::stable_sort(symbols.begin(), symbols.end(), [&](UINT a, UINT b) { return freq[a] < freq[b]; });
+
+			// two queue Huffman: leaves [0, m), internal nodes [m, 2m-1)
+			const UINT m = (UINT)symbols.size();
+			weight.assign(2 * m - 1, 0);
+			parent.assign(2 * m - 1, 0);
+			depth.assign(2 * m - 1, 0);
+			for (UINT i = 0; i < m; ++i) {
+				weight[i] = freq[symbols[i]];
+			}
+
+			UINT uiLeaf = 0;
+			UINT uiNode = m;
+			for (UINT k = m; k < 2 * m - 1; ++k)
+			{
+				UINT child[2];
+				for (UINT c = 0; c < 2; ++c)
+				{
+					if ((uiLeaf < m) && ((uiNode >= k) || (weight[uiLeaf] <= weight[uiNode]))) {
+						child[c] = uiLeaf++;
+					}
+					else {
+						child[c] = uiNode++;
+					}
+				}
+				weight[k] = weight[child[0]] + weight[child[1]];
+				parent[child[0]] = k;
+				parent[child[1]] = k;
+			}
+
+			UINT uiMaxDepth = 0;
+			for (INT k = (INT)(2 * m - 3); k >= 0; --k)
+			{
+				depth[k] = depth[parent[k]] + 1;
+				if (((UINT)k < m) && (depth[k] > uiMaxDepth)) {
+					uiMaxDepth = depth[k];
+				}
+			}
+
+			if (uiMaxDepth <= uiMaxBits)
+			{
+				for (UINT i = 0; i < m; ++i) {
+					pLengths[symbols[i]] = (BYTE)depth[i];
+				}
+				return;
+			}
+
+			for (UINT i = 0; i < uiCount; ++i)
+			{
+				if (freq[i] > 0) {
+					freq[i] = (freq[i] >> 1) | 1;
+				}
+			}
+		}
+	} // buildLengths
+
+	//
+	// Canonical codes of the lengths, bit reversed for the LSB first writer
+	//
+	static
+	inline
+	void
+	buildCodes(
+		_In_ const BYTE *pLengths,
+		_In_ UINT uiCount,
+		_Out_ UINT *pCodes
+		)
+	{
+		UINT blCount[16] = { 0 };
+		UINT nextCode[16] = { 0 };
+		for (UINT i = 0; i < uiCount; ++i) {
+			blCount[pLengths[i]]++;
+		}
+		blCount[0] = 0;
+
+		UINT uiCode = 0;
+		for (UINT bits = 1; bits < 16; ++bits)
+		{
+			uiCode = (uiCode + blCount[bits - 1]) << 1;
+			nextCode[bits] = uiCode;
+		}
+		for (UINT i = 0; i < uiCount; ++i) {
+			pCodes[i] = (pLengths[i] > 0) ? reverseBits(nextCode[pLengths[i]]++, pLengths[i]) : 0;
+		}
+	} // buildCodes
+
+	static
+	inline
+	UINT
+	getLengthCode(
+		_In_ UINT uiLength,
+		_Out_ UINT *pExtraBits,
+		_Out_ UINT *pExtra
+		)
+	{
+		static const USHORT s_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const BYTE s_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+		UINT i = 28;
+		while (s_base[i] > uiLength) {
+			--i;
+		}
+		*pExtraBits = s_extra[i];
+		*pExtra     = uiLength - s_base[i];
+		return 257 + i;
+	} // getLengthCode
+
+	static
+	inline
+	UINT
+	getDistanceCode(
+		_In_ UINT uiDistance,
+		_Out_ UINT *pExtraBits,
+		_Out_ UINT *pExtra
+		)
+	{
+		static const USHORT s_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const BYTE s_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		UINT i = 29;
+		while (s_base[i] > uiDistance) {
+			--i;
+		}
+		*pExtraBits = s_extra[i];
+		*pExtra     = uiDistance - s_base[i];
+		return i;
+	} // getDistanceCode
+
+	//
+	// Writes the tokens (literal, or length << 16 | distance) as one dynamic Huffman block
+	//
+	static
+	inline
+	void
+	writeBlock(
+		_Inout_ tagBitWriter *pWriter,
+		_In_ const std::vector<UINT> &tokens,
+		_In_ BOOL bFinal
+		)
+	{
+		static const BYTE s_clenOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		UINT litFreq[286] = { 0 };
+		UINT distFreq[30] = { 0 };
+		UINT uiExtraBits = 0;
+		UINT uiExtra = 0;
+
+		for (size_t i = 0; i < tokens.size(); ++i)
+		{
+			UINT t = tokens[i];
+			if (t < 256) {
+				litFreq[t]++;
+			}
+			else {
+				litFreq[getLengthCode(t >> 16, &uiExtraBits, &uiExtra)]++;
+				distFreq[getDistanceCode(t & 0xFFFF, &uiExtraBits, &uiExtra)]++;
+			}
+		}
+		litFreq[256] = 1;
+		if (distFreq[0] == 0) {
+			distFreq[0] = 1; // at least one distance code
+		}
+
+		BYTE litLengths[286];
+		BYTE distLengths[30];
+		UINT litCodes[286];
+		UINT distCodes[30];
+		buildLengths(litFreq, 286, 15, litLengths);
+		buildLengths(distFreq, 30, 15, distLengths);
+		buildCodes(litLengths, 286, litCodes);
+		buildCodes(distLengths, 30, distCodes);
+
+		UINT uiLitCount = 286;
+		while ((uiLitCount > 257) && (litLengths[uiLitCount - 1] == 0)) {
+			--uiLitCount;
+		}
+		UINT uiDistCount = 30;
+		while ((uiDistCount > 1) && (distLengths[uiDistCount - 1] == 0)) {
+			--uiDistCount;
+		}
+
+		// run length coded code lengths: symbol | repeat << 8
+		BYTE lengths[286 + 30];
+		memcpy(lengths, litLengths, uiLitCount);
+		memcpy(lengths + uiLitCount, distLengths, uiDistCount);
+		const UINT uiTotal = uiLitCount + uiDistCount;
+
+		std::vector<UINT> clens;
+		UINT clenFreq[19] = { 0 };
+		for (UINT i = 0; i < uiTotal;)
+		{
+			BYTE l = lengths[i];
+			UINT uiRun = 1;
+			while ((i + uiRun < uiTotal) && (lengths[i + uiRun] == l)) {
+				++uiRun;
+			}
+			i += uiRun;
+
+			if (l == 0)
+			{
+				while (uiRun >= 11)
+				{
+					UINT n = (uiRun > 138) ? 138 : uiRun;
+					clens.push_back(18 | ((n - 11) << 8));
+					clenFreq[18]++;
+					uiRun -= n;
+				}
+				if (uiRun >= 3)
+				{
+					clens.push_back(17 | ((uiRun - 3) << 8));
+					clenFreq[17]++;
+					uiRun = 0;
+				}
+			}
+			else
+			{
+				clens.push_back(l);
+				clenFreq[l]++;
+				--uiRun;
+				while (uiRun >= 3)
+				{
+					UINT n = (uiRun > 6) ? 6 : uiRun;
+					clens.push_back(16 | ((n - 3) << 8));
+					clenFreq[16]++;
+					uiRun -= n;
+				}
+			}
+			while (uiRun > 0)
+			{
+				clens.push_back(l);
+				clenFreq[l]++;
+				--uiRun;
+			}
+		}
+
+		BYTE clenLengths[19];
+		UINT clenCodes[19];
+		buildLengths(clenFreq, 19, 7, clenLengths);
+		buildCodes(clenLengths, 19, clenCodes);
+
+		UINT uiClenCount = 19;
+		while ((uiClenCount > 4) && (clenLengths[s_clenOrder[uiClenCount - 1]] == 0)) {
+			--uiClenCount;
+		}
+
+		putBits(pWriter, bFinal ? 1 : 0, 1);
+		putBits(pWriter, 2, 2);
+		putBits(pWriter, uiLitCount - 257, 5);
+		putBits(pWriter, uiDistCount - 1, 5);
+		putBits(pWriter, uiClenCount - 4, 4);
+		for (UINT i = 0; i < uiClenCount; ++i) {
+			putBits(pWriter, clenLengths[s_clenOrder[i]], 3);
+		}
+		for (size_t i = 0; i < clens.size(); ++i)
+		{
+			UINT uiSymbol = clens[i] & 0xFF;
+			putBits(pWriter, clenCodes[uiSymbol], clenLengths[uiSymbol]);
+			if (uiSymbol == 16) {
+				putBits(pWriter, clens[i] >> 8, 2);
+			}
+			else if (uiSymbol == 17) {
+				putBits(pWriter, clens[i] >> 8, 3);
+			}
+			else if (uiSymbol == 18) {
+				putBits(pWriter, clens[i] >> 8, 7);
+			}
+		}
+
+		for (size_t i = 0; i < tokens.size(); ++i)
+		{
+			UINT t = tokens[i];
+			if (t < 256)
+			{
+				putBits(pWriter, litCodes[t], litLengths[t]);
+				continue;
+			}
+
+			UINT uiCode = getLengthCode(t >> 16, &uiExtraBits, &uiExtra);
+			putBits(pWriter, litCodes[uiCode], litLengths[uiCode]);
+			putBits(pWriter, uiExtra, uiExtraBits);
+			uiCode = getDistanceCode(t & 0xFFFF, &uiExtraBits, &uiExtra);
+			putBits(pWriter, distCodes[uiCode], distLengths[uiCode]);
+			putBits(pWriter, uiExtra, uiExtraBits);
+		}
+		putBits(pWriter, litCodes[256], litLengths[256]);
+	} // writeBlock
+
+public:
+	//
+	// Adler-32 of the buffer, continued from uiAdler (1 for a new stream)
+	//
+	static
+	inline
+	UINT
+	Adler32(
+		_In_ UINT uiAdler,
+		_In_reads_bytes_(nSize) const BYTE *pData,
+		_In_ size_t nSize
+		)
+	{
+		UINT a = uiAdler & 0xFFFF;
+		UINT b = uiAdler >> 16;
+		while (nSize > 0)
+		{
+			size_t n = (nSize > 5552) ? 5552 : nSize;
+			nSize -= n;
+			while (n-- > 0)
+			{
+				a += *pData++;
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	} // Adler32
+
+	//
+	// Adler-32 of two concatenated buffers from the ones of the parts (nSize2: size of the second one)
+	//
+	static
+	inline
+	UINT
+	Adler32Combine(
+		_In_ UINT uiAdler1,
+		_In_ UINT uiAdler2,
+		_In_ UINT64 ullSize2
+		)
+	{
+		const UINT64 BASE = 65521;
+		UINT64 rem  = ullSize2 % BASE;
+		UINT64 sum1 = uiAdler1 & 0xFFFF;
+		UINT64 sum2 = (rem * sum1) % BASE;
+		sum1 += (uiAdler2 & 0xFFFF) + BASE - 1;
+		sum2 += ((uiAdler1 >> 16) & 0xFFFF) + ((uiAdler2 >> 16) & 0xFFFF) + BASE - rem;
+		if (sum1 >= BASE) sum1 -= BASE;
+		if (sum1 >= BASE) sum1 -= BASE;
+		if (sum2 >= (BASE << 1)) sum2 -= (BASE << 1);
+		if (sum2 >= BASE) sum2 -= BASE;
+		return (UINT)(sum1 | (sum2 << 16));
+	} // Adler32Combine
+
+	//
+	// CRC-32 (PNG, zip) of the buffer, continued from uiCrc (0 for a new one)
+	//
+	static
+	inline
+	UINT
+	Crc32(
+		_In_ UINT uiCrc,
+		_In_reads_bytes_(nSize) const BYTE *pData,
+		_In_ size_t nSize
+		)
+	{
+		static UINT s_table[256];
+		static volatile LONG s_lInitialized = 0;
+		if (s_lInitialized == 0)
+		{
+			// idempotent, racing threads write the same values
+			for (UINT n = 0; n < 256; ++n)
+			{
+				UINT c = n;
+				for (UINT k = 0; k < 8; ++k) {
+					c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+				}
+				s_table[n] = c;
+			}
+			s_lInitialized = 1;
+		}
+
+		UINT c = ~uiCrc;
+		for (size_t i = 0; i < nSize; ++i) {
+			c = s_table[(c ^ pData[i]) & 0xFF] ^ (c >> 8);
+		}
+		return ~c;
+	} // Crc32
+
+	//
+	// Appends the deflate blocks of the buffer to pOutput. The run does not refer
+	// to data before pSrc and ends byte aligned: with bFinal the last block is
+	// marked final, otherwise an empty stored block (sync flush) follows.
+	//
+	static
+	inline
+	void
+	CompressRun(
+		_In_reads_bytes_(nSize) const BYTE *pSrc,
+		_In_ size_t nSize,
+		_In_ BOOL bFinal,
+		_Inout_ std::vector<BYTE> *pOutput
+		)
+	{
+		const UINT HASH_SIZE = 1 << DXGICAPTURE_DEFLATE_HASH_BITS;
+		const UINT WINDOW_MASK = DXGICAPTURE_DEFLATE_WINDOW_SIZE - 1;
+
+		tagBitWriter writer;
+		writer.Output = pOutput;
+		writer.Bits   = 0;
+		writer.Count  = 0;
+
+		std::vector<INT> head(HASH_SIZE, -1);
+		std::vector<INT> prev(DXGICAPTURE_DEFLATE_WINDOW_SIZE, -1);
+		std::vector<UINT> tokens;
+		tokens.reserve(DXGICAPTURE_DEFLATE_BLOCK_TOKENS);
+
+		const INT n = (INT)nSize;
+		INT pos = 0;
+		while (pos < n)
+		{
+			INT nBestLength = 0;
+			INT nBestDistance = 0;
+			INT nMaxLength = n - pos;
+			if (nMaxLength > DXGICAPTURE_DEFLATE_MAX_MATCH) {
+				nMaxLength = DXGICAPTURE_DEFLATE_MAX_MATCH;
+			}
+
+			if (nMaxLength >= DXGICAPTURE_DEFLATE_MIN_MATCH)
+			{
+				const BYTE *p = pSrc + pos;
+				UINT h = (((UINT)p[0] << 10) ^ ((UINT)p[1] << 5) ^ p[2]) & (HASH_SIZE - 1);
+				INT cand = head[h];
+				for (UINT uiChain = 0; (cand >= 0) && (pos - cand <= DXGICAPTURE_DEFLATE_WINDOW_SIZE) && (uiChain < DXGICAPTURE_DEFLATE_MAX_CHAIN); ++uiChain)
+				{
+					const BYTE *q = pSrc + cand;
+					if ((q[nBestLength] == p[nBestLength]) && (q[0] == p[0]))
+					{
+						INT nLength = 0;
+						while ((nLength < nMaxLength) && (q[nLength] == p[nLength])) {
+							++nLength;
+						}
+						if (nLength > nBestLength)
+						{
+							nBestLength   = nLength;
+							nBestDistance = pos - cand;
+							if (nLength == nMaxLength) {
+								break;
+							}
+						}
+					}
+					cand = prev[cand & WINDOW_MASK];
+				}
+			}
+
+			INT nStep = 1;
+			if (nBestLength >= DXGICAPTURE_DEFLATE_MIN_MATCH)
+			{
+				tokens.push_back(((UINT)nBestLength << 16) | (UINT)nBestDistance);
+				nStep = nBestLength;
+			}
+			else {
+				tokens.push_back(pSrc[pos]);
+			}
+
+			// insert the hashes of the covered positions
+			INT nEnd = pos + nStep;
+			if (nEnd > n - DXGICAPTURE_DEFLATE_MIN_MATCH + 1) {
+				nEnd = n - DXGICAPTURE_DEFLATE_MIN_MATCH + 1;
+			}
+			for (INT i = pos; i < nEnd; ++i)
+			{
+				const BYTE *p = pSrc + i;
+				UINT h = (((UINT)p[0] << 10) ^ ((UINT)p[1] << 5) ^ p[2]) & (HASH_SIZE - 1);
+				prev[i & WINDOW_MASK] = head[h];
+				head[h] = i;
+			}
+			pos += nStep;
+
+			if (tokens.size() >= DXGICAPTURE_DEFLATE_BLOCK_TOKENS)
+			{
+				writeBlock(&writer, tokens, bFinal && (pos >= n));
+				tokens.clear();
+			}
+		}
+
+		if (!tokens.empty()) {
+			writeBlock(&writer, tokens, bFinal);
+		}
+		else if (bFinal && (n == 0))
+		{
+			// empty final block with the fixed codes (end of block: 7 zero bits)
+			putBits(&writer, 1, 1);
+			putBits(&writer, 1, 2);
+			putBits(&writer, 0, 7);
+		}
+
+		if (!bFinal)
+		{
+			// empty stored block
+			putBits(&writer, 0, 3);
+			alignBits(&writer);
+			pOutput->push_back(0x00);
+			pOutput->push_back(0x00);
+			pOutput->push_back(0xFF);
+			pOutput->push_back(0xFF);
+		}
+		alignBits(&writer);
+	} // CompressRun
+
+	//
+	// Appends the zlib stream (header, final deflate run, Adler-32) of the buffer to pOutput
+	//
+	static
+	inline
+	void
+	Compress(
+		_In_reads_bytes_(nSize) const BYTE *pSrc,
+		_In_ size_t nSize,
+		_Inout_ std::vector<BYTE> *pOutput
+		)
+	{
+		pOutput->push_back(0x78);
+		pOutput->push_back(0x01);
+		CompressRun(pSrc, nSize, TRUE, pOutput);
+
+		UINT uiAdler = Adler32(1, pSrc, nSize);
+		pOutput->push_back((BYTE)(uiAdler >> 24));
+		pOutput->push_back((BYTE)(uiAdler >> 16));
+		pOutput->push_back((BYTE)(uiAdler >> 8));
+		pOutput->push_back((BYTE)uiAdler);
+	} // Compress
+
+}; // end class DXGICaptureDeflate
+
+#endif // __DXGICAPTUREDEFLATE_H__
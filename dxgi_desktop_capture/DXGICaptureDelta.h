@@ -0,0 +1,453 @@
+/*****************************************************************************
+* DXGICaptureDelta.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREDELTA_H__
+#define __DXGICAPTUREDELTA_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureFrameBuffer.h"
+
+#include <string.h>
+#include <vector>
+
+//
+// class DXGICaptureDelta
+//
+// Codec of the difference between two 32bpp images: the image is XORed with
+// the previous one and the residual is stored as a sequence of tokens
+//
+//   varint (count << 1) | 0 : count unchanged pixels (residual 0)
+//   varint (count << 1) | 1 : count residual pixels follow, 4 bytes each
+//
+// in row order over all rows. A keyframe is coded against a black image, i.e.
+// it holds the image itself. The runs of unchanged pixels are found with SIMD
+// compares of the current and the previous row.
+//
+class DXGICaptureDelta
+{
+private:
+	static
+	inline
+	UINT
+	countTrailingZeros(
+		_In_ UINT64 v
+		)
+	{
+#if defined(_MSC_VER)
+		unsigned long index = 0;
+#if defined(_M_X64) || defined(_M_ARM64)
+		_BitScanForward64(&index, v);
+#else
+		if (!_BitScanForward(&index, (unsigned long)v))
+		{
+			_BitScanForward(&index, (unsigned long)(v >> 32));
+			index += 32;
+		}
+#endif
+		return (UINT)index;
+#else
+		return (UINT)__builtin_ctzll(v);
+#endif
+	}
+
+	static
+	inline
+	BYTE*
+	putVarint(
+		_Inout_ BYTE *p,
+		_In_ UINT v
+		)
+	{
+		while (v >= 0x80)
+		{
+			*p++ = (BYTE)(v | 0x80);
+			v >>= 7;
+		}
+		*p++ = (BYTE)v;
+		return p;
+	}
+
+	static
+	inline
+	BOOL
+	getVarint(
+		_Inout_ const BYTE **ppData,
+		_In_ const BYTE *pEnd,
+		_Out_ UINT *pValue
+		)
+	{
+		const BYTE *p = *ppData;
+		UINT v = 0;
+		for (UINT shift = 0; shift < 35; shift += 7)
+		{
+			if (p >= pEnd) {
+				return FALSE;
+			}
+			BYTE b = *p++;
+			v |= (UINT)(b & 0x7F) << shift;
+			if (!(b & 0x80))
+			{
+				*ppData = p;
+				*pValue = v;
+				return TRUE;
+			}
+		}
+		return FALSE;
+	}
+
+public:
+	//
+	// Length of the leading run of pixels that are equal (bEqual = TRUE) or
+	// different (bEqual = FALSE) in both rows
+	//
+	static
+	inline
+	INT
+	ScanRunScalar(
+		_In_ const UINT *pSrc,
+		_In_ const UINT *pRef,
+		_In_ INT count,
+		_In_ BOOL bEqual
+		)
+	{
+		INT i = 0;
+		if (bEqual) {
+			while ((i < count) && (pSrc[i] == pRef[i])) { ++i; }
+		}
+		else {
+			while ((i < count) && (pSrc[i] != pRef[i])) { ++i; }
+		}
+		return i;
+	} // ScanRunScalar
+
+#if defined(DXGICAPTURE_HAVE_X86)
+	//
+	// 4 pixels per compare
+	//
+	static
+	inline
+	INT
+	ScanRunSSE2(
+		_In_ const UINT *pSrc,
+		_In_ const UINT *pRef,
+		_In_ INT count,
+		_In_ BOOL bEqual
+		)
+	{
+		const UINT uiFlip = bEqual ? 0xF : 0x0;
+
+		INT i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+			__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRef + i));
+			UINT uiStop = (UINT)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(s, r))) ^ uiFlip;
+			if (uiStop != 0) {
+				return i + (INT)countTrailingZeros(uiStop);
+			}
+		}
+		return i + ScanRunScalar(pSrc + i, pRef + i, count - i, bEqual);
+	} // ScanRunSSE2
+
+	//
+	// 16 pixels per iteration
+	//
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	INT
+	ScanRunAVX2(
+		_In_ const UINT *pSrc,
+		_In_ const UINT *pRef,
+		_In_ INT count,
+		_In_ BOOL bEqual
+		)
+	{
+		const UINT uiFlip = bEqual ? 0xFFFF : 0x0;
+
+		INT i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+			__m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRef + i));
+			__m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i + 8));
+			__m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRef + i + 8));
+			UINT uiMask0 = (UINT)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(s0, r0)));
+			UINT uiMask1 = (UINT)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(s1, r1)));
+			UINT uiStop = (uiMask0 | (uiMask1 << 8)) ^ uiFlip;
+			if (uiStop != 0) {
+				return i + (INT)countTrailingZeros(uiStop);
+			}
+		}
+		return i + ScanRunSSE2(pSrc + i, pRef + i, count - i, bEqual);
+	} // ScanRunAVX2
+#endif // DXGICAPTURE_HAVE_X86
+
+#if defined(DXGICAPTURE_HAVE_NEON)
+	//
+	// 4 pixels per compare
+	//
+	static
+	inline
+	INT
+	ScanRunNEON(
+		_In_ const UINT *pSrc,
+		_In_ const UINT *pRef,
+		_In_ INT count,
+		_In_ BOOL bEqual
+		)
+	{
+		const UINT64 ullFlip = bEqual ? ~0ULL : 0ULL;
+
+		INT i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			uint32x4_t eq = vceqq_u32(vld1q_u32(pSrc + i), vld1q_u32(pRef + i));
+			// 16 bits per pixel
+			UINT64 ullStop = vget_lane_u64(vreinterpret_u64_u16(vmovn_u32(eq)), 0) ^ ullFlip;
+			if (ullStop != 0) {
+				return i + (INT)(countTrailingZeros(ullStop) >> 4);
+			}
+		}
+		return i + ScanRunScalar(pSrc + i, pRef + i, count - i, bEqual);
+	} // ScanRunNEON
+#endif // DXGICAPTURE_HAVE_NEON
+
+	static
+	inline
+	INT
+	ScanRun(
+		_In_ const UINT *pSrc,
+		_In_ const UINT *pRef,
+		_In_ INT count,
+		_In_ BOOL bEqual,
+		_In_ tagSimdLevel level
+		)
+	{
+		switch (level)
+		{
+#if defined(DXGICAPTURE_HAVE_X86)
+		case tagSimdLevel_AVX2:
+			return ScanRunAVX2(pSrc, pRef, count, bEqual);
+		case tagSimdLevel_SSE2:
+			return ScanRunSSE2(pSrc, pRef, count, bEqual);
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+		case tagSimdLevel_NEON:
+			return ScanRunNEON(pSrc, pRef, count, bEqual);
+#endif
+		default:
+			return ScanRunScalar(pSrc, pRef, count, bEqual);
+		}
+	} // ScanRun
+
+	//
+	// Upper bound of the encoded size, 0 if the image is too large
+	//
+	static
+	inline
+	UINT64
+	GetMaxEncodedSize(
+		_In_ INT nWidth,
+		_In_ INT nHeight
+		)
+	{
+		if ((nWidth <= 0) || (nHeight <= 0) || (nWidth > 0x7FFF) || (nHeight > 0x7FFF)) {
+			return 0;
+		}
+		// a literal token per row and a zero token between two literal tokens
+		UINT64 ullPixels = (UINT64)nWidth * nHeight;
+		return ullPixels * 4 + ullPixels / 8 + (UINT64)nHeight * 10 + 16;
+	} // GetMaxEncodedSize
+
+	//
+	// Encodes pSrc against pPrev (updated to pSrc), or as a keyframe if pPrev is nullptr.
+	// pRetChangedPixels receives the number of pixels that differ from the previous image.
+	//
+	static
+	inline
+	HRESULT
+	Encode(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_Inout_opt_ BYTE *pPrev,
+		_In_ INT nPrevPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize,
+		_Out_opt_ UINT64 *pRetChangedPixels,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		CHECK_POINTER(pRetSize);
+		*pRetSize = 0;
+		RESET_POINTER_EX(pRetChangedPixels, 0);
+		CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutput, E_INVALIDARG);
+
+		UINT64 ullMaxSize = GetMaxEncodedSize(nWidth, nHeight);
+		if ((ullMaxSize == 0) || (ullMaxSize > 0xFFFFFFFFULL)) {
+			return E_INVALIDARG;
+		}
+		HRESULT hr = DXGICaptureFrameBuffer::Resize(pOutput, (UINT)ullMaxSize);
+		CHECK_HR_RETURN(hr);
+
+		// a keyframe is the difference to black
+		std::vector<UINT> zeroRow;
+		if (nullptr == pPrev)
+		{
+			try
+			{
+				zeroRow.assign((size_t)nWidth, 0);
+			}
+			catch (const std::bad_alloc&)
+			{
+				return E_OUTOFMEMORY;
+			}
+		}
+
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		BYTE *pOut = pOutput->Buffer;
+		UINT uiZeroRun = 0;
+		UINT64 ullChanged = 0;
+		for (INT y = 0; y < nHeight; ++y)
+		{
+			const UINT *pRow = reinterpret_cast<const UINT*>(pSrc + (size_t)y * nSrcPitch);
+			UINT *pRef = (nullptr != pPrev) ? reinterpret_cast<UINT*>(pPrev + (size_t)y * nPrevPitch) : &zeroRow[0];
+
+			INT x = 0;
+			while (x < nWidth)
+			{
+				INT n = ScanRun(pRow + x, pRef + x, nWidth - x, TRUE, level);
+				uiZeroRun += (UINT)n;
+				x += n;
+				if (x >= nWidth) {
+					break;
+				}
+
+				n = ScanRun(pRow + x, pRef + x, nWidth - x, FALSE, level);
+				if (uiZeroRun > 0)
+				{
+					pOut = putVarint(pOut, uiZeroRun << 1);
+					uiZeroRun = 0;
+				}
+				pOut = putVarint(pOut, ((UINT)n << 1) | 1);
+				for (INT i = 0; i < n; ++i)
+				{
+					UINT v = pRow[x + i] ^ pRef[x + i];
+					memcpy(pOut + i * 4, &v, 4);
+				}
+				if (nullptr != pPrev) {
+					memcpy(pRef + x, pRow + x, (size_t)n * 4);
+				}
+				pOut += n * 4;
+				ullChanged += (UINT64)n;
+				x += n;
+			}
+		}
+		if (uiZeroRun > 0) {
+			pOut = putVarint(pOut, uiZeroRun << 1);
+		}
+
+		*pRetSize = (UINT)(pOut - pOutput->Buffer);
+		RESET_POINTER_EX(pRetChangedPixels, ullChanged);
+		return S_OK;
+	} // Encode
+
+	//
+	// Applies an encoded difference to the previous image in pDst, a keyframe
+	// overwrites the image. Returns E_INVALIDARG for damaged data.
+	//
+	static
+	inline
+	HRESULT
+	Decode(
+		_In_reads_bytes_(uiSize) const BYTE *pData,
+		_In_ UINT uiSize,
+		_In_ BOOL bKeyframe,
+		_Inout_ BYTE *pDst,
+		_In_ INT nDstPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight
+		)
+	{
+		CHECK_POINTER_EX(pData, E_INVALIDARG);
+		CHECK_POINTER_EX(pDst, E_INVALIDARG);
+		if ((nWidth <= 0) || (nHeight <= 0)) {
+			return E_INVALIDARG;
+		}
+
+		const BYTE *pEnd = pData + uiSize;
+		const UINT64 ullPixels = (UINT64)nWidth * nHeight;
+		UINT64 ullPos = 0;
+		while (ullPos < ullPixels)
+		{
+			UINT uiToken = 0;
+			if (!getVarint(&pData, pEnd, &uiToken)) {
+				return E_INVALIDARG;
+			}
+			UINT64 ullCount = uiToken >> 1;
+			BOOL bLiteral = (uiToken & 1) ? TRUE : FALSE;
+			if ((ullCount == 0) || (ullCount > ullPixels - ullPos) ||
+				(bLiteral && (ullCount * 4 > (UINT64)(pEnd - pData))))
+			{
+				return E_INVALIDARG;
+			}
+
+			// the run can continue on the next rows
+			while (ullCount > 0)
+			{
+				INT y = (INT)(ullPos / (UINT)nWidth);
+				INT x = (INT)(ullPos % (UINT)nWidth);
+				INT n = nWidth - x;
+				if ((UINT64)n > ullCount) {
+					n = (INT)ullCount;
+				}
+				UINT *pRow = reinterpret_cast<UINT*>(pDst + (size_t)y * nDstPitch) + x;
+
+				if (bLiteral)
+				{
+					if (bKeyframe) {
+						memcpy(pRow, pData, (size_t)n * 4);
+					}
+					else
+					{
+						for (INT i = 0; i < n; ++i)
+						{
+							UINT v;
+							memcpy(&v, pData + i * 4, 4);
+							pRow[i] ^= v;
+						}
+					}
+					pData += n * 4;
+				}
+				else if (bKeyframe) {
+					memset(pRow, 0, (size_t)n * 4);
+				}
+
+				ullPos += (UINT64)n;
+				ullCount -= (UINT64)n;
+			}
+		}
+		return (pData == pEnd) ? S_OK : E_INVALIDARG;
+	} // Decode
+
+}; // end class DXGICaptureDelta
+
+#endif // __DXGICAPTUREDELTA_H__
@@ -0,0 +1,317 @@
+/*****************************************************************************
+* DXGICaptureDirtyRects.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREDIRTYRECTS_H__
+#define __DXGICAPTUREDIRTYRECTS_H__
+
+#include "DXGICapturePlatform.h"
+
+#include <string.h>
+
+//
+// struct tagFrameRect_s (same layout as RECT)
+//
+typedef struct tagFrameRect_s
+{
+	LONG Left;
+	LONG Top;
+	LONG Right;
+	LONG Bottom;
+} tagFrameRect;
+
+//
+// struct tagFrameMoveRect_s (same layout as DXGI_OUTDUPL_MOVE_RECT)
+//
+typedef struct tagFrameMoveRect_s
+{
+	LONG         SrcX;
+	LONG         SrcY;
+	tagFrameRect Dst;
+} tagFrameMoveRect;
+
+//
+// struct tagFrameUpdateStats_s
+//
+typedef struct tagFrameUpdateStats_s
+{
+	UINT   MoveRectCount;
+	UINT   DirtyRectCount;  /* after merging */
+	UINT64 BytesMoved;
+	UINT64 BytesCopied;
+	UINT64 BytesTouched;    /* moved + copied (+ restored mouse background) */
+	UINT64 BytesTotal;      /* size of the frame */
+	BOOL   FullUpdate;      /* the whole frame was copied */
+} tagFrameUpdateStats;
+
+//
+// class DXGICaptureDirtyRects
+//
+// Applies the move and dirty rectangles of the desktop duplication to a
+// persistent 32bpp frame: moves first (overlap safe, in the given order),
+// then the dirty rectangles are copied from the new desktop image.
+//
+class DXGICaptureDirtyRects
+{
+private:
+	static
+	inline
+	INT64
+	rectArea(
+		_In_ const tagFrameRect &rc
+		)
+	{
+		return (INT64)(rc.Right - rc.Left) * (INT64)(rc.Bottom - rc.Top);
+	} // rectArea
+
+	static
+	inline
+	INT64
+	intersectArea(
+		_In_ const tagFrameRect &a,
+		_In_ const tagFrameRect &b
+		)
+	{
+		LONG l = (a.Left > b.Left) ? a.Left : b.Left;
+		LONG t = (a.Top > b.Top) ? a.Top : b.Top;
+		LONG r = (a.Right < b.Right) ? a.Right : b.Right;
+		LONG d = (a.Bottom < b.Bottom) ? a.Bottom : b.Bottom;
+		return ((l < r) && (t < d)) ? (INT64)(r - l) * (INT64)(d - t) : 0;
+	} // intersectArea
+
+public:
+	static
+	inline
+	BOOL
+	IsRectEmpty(
+		_In_ const tagFrameRect &rc
+		)
+	{
+		return (rc.Left >= rc.Right) || (rc.Top >= rc.Bottom);
+	} // IsRectEmpty
+
+	//
+	// Clips the rect to [0, width) x [0, height), returns FALSE if nothing is left
+	//
+	static
+	inline
+	BOOL
+	ClipRect(
+		_Inout_ tagFrameRect *pRect,
+		_In_ INT width,
+		_In_ INT height
+		)
+	{
+		if (pRect->Left < 0) { pRect->Left = 0; }
+		if (pRect->Top < 0) { pRect->Top = 0; }
+		if (pRect->Right > width) { pRect->Right = width; }
+		if (pRect->Bottom > height) { pRect->Bottom = height; }
+		return !IsRectEmpty(*pRect);
+	} // ClipRect
+
+	//
+	// Clips the rects, drops the empty ones and merges overlapping or nearby
+	// rects as long as their bounding box wastes at most 1/4 of the covered area.
+	// Returns the new rect count.
+	//
+	static
+	inline
+	UINT
+	MergeRects(
+		_Inout_ tagFrameRect *pRects,
+		_In_ UINT count,
+		_In_ INT width,
+		_In_ INT height
+		)
+	{
+		UINT n = 0;
+		for (UINT i = 0; i < count; ++i)
+		{
+			tagFrameRect rc = pRects[i];
+			if (ClipRect(&rc, width, height)) {
+				pRects[n++] = rc;
+			}
+		}
+
+		BOOL bMerged = TRUE;
+		while (bMerged)
+		{
+			bMerged = FALSE;
+			for (UINT i = 0; i < n; ++i)
+			{
+				for (UINT j = i + 1; j < n; ++j)
+				{
+					const tagFrameRect &a = pRects[i];
+					const tagFrameRect &b = pRects[j];
+
+					tagFrameRect u;
+					u.Left   = (a.Left < b.Left) ? a.Left : b.Left;
+					u.Top    = (a.Top < b.Top) ? a.Top : b.Top;
+					u.Right  = (a.Right > b.Right) ? a.Right : b.Right;
+					u.Bottom = (a.Bottom > b.Bottom) ? a.Bottom : b.Bottom;
+
+					INT64 covered = rectArea(a) + rectArea(b) - intersectArea(a, b);
+					if ((rectArea(u) - covered) * 4 > covered) {
+						continue;
+					}
+
+					pRects[i] = u;
+					pRects[j] = pRects[--n];
+					--j;
+					bMerged = TRUE;
+				}
+			}
+		}
+
+		return n;
+	} // MergeRects
+
+	//
+	// Moves pixels inside the frame (source and destination may overlap).
+	// Returns the number of bytes written.
+	//
+	static
+	inline
+	UINT64
+	ApplyMoves(
+		_Inout_ BYTE *pFrame,
+		_In_ INT pitch,
+		_In_ INT width,
+		_In_ INT height,
+		_In_ const tagFrameMoveRect *pMoves,
+		_In_ UINT count
+		)
+	{
+		UINT64 ullBytes = 0;
+		for (UINT i = 0; i < count; ++i)
+		{
+			tagFrameRect dst = pMoves[i].Dst;
+			LONG srcX = pMoves[i].SrcX;
+			LONG srcY = pMoves[i].SrcY;
+
+			// clip destination and source together
+			if (dst.Left < 0)   { srcX -= dst.Left; dst.Left = 0; }
+			if (dst.Top < 0)    { srcY -= dst.Top; dst.Top = 0; }
+			if (srcX < 0)       { dst.Left -= srcX; srcX = 0; }
+			if (srcY < 0)       { dst.Top -= srcY; srcY = 0; }
+			if (dst.Right > width)   { dst.Right = width; }
+			if (dst.Bottom > height) { dst.Bottom = height; }
+			if (srcX + (dst.Right - dst.Left) > width)   { dst.Right = dst.Left + (width - srcX); }
+			if (srcY + (dst.Bottom - dst.Top) > height)  { dst.Bottom = dst.Top + (height - srcY); }
+			if (IsRectEmpty(dst)) {
+				continue;
+			}
+
+			INT rowBytes = (dst.Right - dst.Left) * 4;
+			INT rows     = dst.Bottom - dst.Top;
+			BYTE *pDst       = pFrame + (size_t)dst.Top * pitch + dst.Left * 4;
+			const BYTE *pSrc = pFrame + (size_t)srcY * pitch + srcX * 4;
+
+			if (dst.Top > srcY)
+			{
+				// moving down: bottom-up, so source rows are read before they are overwritten
+				for (INT y = rows - 1; y >= 0; --y) {
+					memmove(pDst + (size_t)y * pitch, pSrc + (size_t)y * pitch, rowBytes);
+				}
+			}
+			else
+			{
+				// same row: memmove handles the horizontal overlap
+				for (INT y = 0; y < rows; ++y) {
+					memmove(pDst + (size_t)y * pitch, pSrc + (size_t)y * pitch, rowBytes);
+				}
+			}
+			ullBytes += (UINT64)rowBytes * rows;
+		}
+		return ullBytes;
+	} // ApplyMoves
+
+	//
+	// Copies the rects from the new desktop image into the frame.
+	// Returns the number of bytes written.
+	//
+	static
+	inline
+	UINT64
+	ApplyDirtyRects(
+		_Inout_ BYTE *pFrame,
+		_In_ INT pitch,
+		_In_ const BYTE *pSrc,
+		_In_ INT srcPitch,
+		_In_ const tagFrameRect *pRects,
+		_In_ UINT count
+		)
+	{
+		UINT64 ullBytes = 0;
+		for (UINT i = 0; i < count; ++i)
+		{
+			const tagFrameRect &rc = pRects[i];
+			if (IsRectEmpty(rc)) {
+				continue;
+			}
+
+			INT rowBytes = (rc.Right - rc.Left) * 4;
+			BYTE *pDst       = pFrame + (size_t)rc.Top * pitch + rc.Left * 4;
+			const BYTE *pRow = pSrc + (size_t)rc.Top * srcPitch + rc.Left * 4;
+			for (LONG y = rc.Top; y < rc.Bottom; ++y)
+			{
+				memcpy(pDst, pRow, rowBytes);
+				pDst += pitch;
+				pRow += srcPitch;
+			}
+			ullBytes += (UINT64)rowBytes * (rc.Bottom - rc.Top);
+		}
+		return ullBytes;
+	} // ApplyDirtyRects
+
+	//
+	// Saves (bSave = TRUE) or restores the pixels under a rect, e.g. the mouse
+	// shape drawn into the persistent frame. Returns the number of bytes written.
+	//
+	static
+	inline
+	UINT64
+	CopyBackground(
+		_Inout_ BYTE *pFrame,
+		_In_ INT pitch,
+		_Inout_ BYTE *pBackground,
+		_In_ const tagFrameRect &rc,
+		_In_ BOOL bSave
+		)
+	{
+		if (IsRectEmpty(rc)) {
+			return 0;
+		}
+
+		INT rowBytes = (rc.Right - rc.Left) * 4;
+		BYTE *pRow = pFrame + (size_t)rc.Top * pitch + rc.Left * 4;
+		for (LONG y = rc.Top; y < rc.Bottom; ++y)
+		{
+			if (bSave) {
+				memcpy(pBackground, pRow, rowBytes);
+			}
+			else {
+				memcpy(pRow, pBackground, rowBytes);
+			}
+			pRow += pitch;
+			pBackground += rowBytes;
+		}
+		return (UINT64)rowBytes * (rc.Bottom - rc.Top);
+	} // CopyBackground
+
+}; // end class DXGICaptureDirtyRects
+
+#endif // __DXGICAPTUREDIRTYRECTS_H__
@@ -0,0 +1,325 @@
+/*****************************************************************************
+* DXGICaptureDuplicationSource.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREDUPLICATIONSOURCE_H__
+#define __DXGICAPTUREDUPLICATIONSOURCE_H__
+
+#include <atlbase.h>
+
+#include <dxgi1_2.h>
+#include <d3d11.h>
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureHelper.h"
+#include "DXGICaptureSource.h"
+
+#include <vector>
+
+//
+// class CDXGIDuplicationSource
+//
+// Capture source of a DXGI desktop duplication: every acquired desktop image
+// is copied into a staging texture that stays mapped until ReleaseFrame.
+// Initialized by monitor index, the source duplicates the output on a device
+// of its own, so the sources of several monitors can run on parallel threads
+// (CDXGICaptureCanvas). With copy rects (the regions of the pipeline) only
+// those parts of the desktop image are copied.
+//
+class CDXGIDuplicationSource : public IDXGICaptureSource
+{
+private:
+	CComPtr<ID3D11Device>           m_ipDevice;     /* own device (monitor index) */
+	CComPtr<ID3D11DeviceContext>    m_ipContext;
+	CComPtr<IDXGIOutputDuplication> m_ipOutputDuplication;
+	CComPtr<ID3D11Texture2D>        m_ipStagingTexture;
+	DXGI_OUTPUT_DESC                m_outputDesc;
+	tagCaptureSourceDesc            m_desc;
+	UINT                            m_uiMonitorIdx;
+
+	tagMouseInfo                    m_mouseInfo;
+	tagCapturePointer               m_pointer;
+	tagFrameBufferInfo              m_frameMetadataBuffer;
+	tagFrameRect                    m_fullRect;
+	std::vector<D3D11_BOX>          m_copyBoxes;    /* empty: the whole image */
+	UINT64                          m_ullFrameNumber;
+	LARGE_INTEGER                   m_liFrequency;
+	BOOL                            m_bAcquired;
+	BOOL                            m_bMapped;
+
+	// disable copy
+	CDXGIDuplicationSource(const CDXGIDuplicationSource&);
+	CDXGIDuplicationSource& operator=(const CDXGIDuplicationSource&);
+
+public:
+	CDXGIDuplicationSource()
+		: m_uiMonitorIdx(0)
+		, m_ullFrameNumber(0)
+		, m_bAcquired(FALSE)
+		, m_bMapped(FALSE)
+	{
+		RtlZeroMemory(&m_outputDesc, sizeof(m_outputDesc));
+		RtlZeroMemory(&m_desc, sizeof(m_desc));
+		RtlZeroMemory(&m_mouseInfo, sizeof(m_mouseInfo));
+		RtlZeroMemory(&m_pointer, sizeof(m_pointer));
+		RtlZeroMemory(&m_frameMetadataBuffer, sizeof(m_frameMetadataBuffer));
+		RtlZeroMemory(&m_fullRect, sizeof(m_fullRect));
+		QueryPerformanceFrequency(&m_liFrequency);
+	}
+
+	virtual ~CDXGIDuplicationSource()
+	{
+		Terminate();
+	}
+
+	inline
+	HRESULT
+	Initialize(
+		_In_ ID3D11Device *pDevice,
+		_In_ ID3D11DeviceContext *pContext,
+		_In_ IDXGIOutputDuplication *pOutputDuplication,
+		_In_ const DXGI_OUTPUT_DESC *pOutputDesc,
+		_In_ UINT uiMonitorIdx
+		)
+	{
+		CHECK_POINTER_EX(pDevice, E_INVALIDARG);
+		CHECK_POINTER_EX(pContext, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutputDuplication, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutputDesc, E_INVALIDARG);
+
+		Terminate();
+
+		DXGI_OUTDUPL_DESC dxgiOutputDuplDesc;
+		pOutputDuplication->GetDesc(&dxgiOutputDuplDesc);
+
+		INT nDesktopWidth  = (INT)dxgiOutputDuplDesc.ModeDesc.Width;
+		INT nDesktopHeight = (INT)dxgiOutputDuplDesc.ModeDesc.Height;
+		INT nRotation      = DXGICaptureHelper::GetDisplayRotationDegrees(dxgiOutputDuplDesc.Rotation);
+
+		m_desc.RotationDegrees = nRotation;
+		m_desc.DesktopWidth    = nDesktopWidth;
+		m_desc.DesktopHeight   = nDesktopHeight;
+		m_desc.Width           = ((nRotation == 90) || (nRotation == 270)) ? nDesktopHeight : nDesktopWidth;
+		m_desc.Height          = ((nRotation == 90) || (nRotation == 270)) ? nDesktopWidth : nDesktopHeight;
+
+		D3D11_TEXTURE2D_DESC desc;
+		desc.Width              = (UINT)m_desc.Width;
+		desc.Height             = (UINT)m_desc.Height;
+		desc.Format             = dxgiOutputDuplDesc.ModeDesc.Format;
+		desc.ArraySize          = 1;
+		desc.BindFlags          = 0;
+		desc.MiscFlags          = 0;
+		desc.SampleDesc.Count   = 1;
+		desc.SampleDesc.Quality = 0;
+		desc.MipLevels          = 1;
+		desc.CPUAccessFlags     = D3D11_CPU_ACCESS_READ;
+		desc.Usage              = D3D11_USAGE_STAGING;
+
+		HRESULT hr = pDevice->CreateTexture2D(&desc, NULL, &m_ipStagingTexture);
+		CHECK_HR_RETURN(hr);
+
+		m_ipContext           = pContext;
+		m_ipOutputDuplication = pOutputDuplication;
+		m_outputDesc          = *pOutputDesc;
+		m_uiMonitorIdx        = uiMonitorIdx;
+		m_fullRect.Right      = m_desc.Width;
+		m_fullRect.Bottom     = m_desc.Height;
+		return S_OK;
+	}
+
+	//
+	// Creates a device of its own on the default adapter and duplicates the output uiMonitorIdx
+	//
+	inline
+	HRESULT
+	Initialize(
+		_In_ UINT uiMonitorIdx
+		)
+	{
+		Terminate();
+
+		CComPtr<ID3D11Device>           ipDevice;
+		CComPtr<ID3D11DeviceContext>    ipContext;
+		CComPtr<IDXGIDevice>            ipDxgiDevice;
+		CComPtr<IDXGIAdapter>           ipDxgiAdapter;
+		CComPtr<IDXGIOutput>            ipDxgiOutput;
+		CComPtr<IDXGIOutput1>           ipDxgiOutput1;
+		CComPtr<IDXGIOutputDuplication> ipOutputDuplication;
+		DXGI_OUTPUT_DESC                outputDesc;
+
+		HRESULT hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION, &ipDevice, nullptr, &ipContext);
+		CHECK_HR_RETURN(hr);
+		hr = ipDevice->QueryInterface(IID_PPV_ARGS(&ipDxgiDevice));
+		CHECK_HR_RETURN(hr);
+		hr = ipDxgiDevice->GetParent(IID_PPV_ARGS(&ipDxgiAdapter));
+		CHECK_HR_RETURN(hr);
+		hr = ipDxgiAdapter->EnumOutputs(uiMonitorIdx, &ipDxgiOutput);
+		CHECK_HR_RETURN(hr);
+		hr = ipDxgiOutput->GetDesc(&outputDesc);
+		CHECK_HR_RETURN(hr);
+		hr = ipDxgiOutput->QueryInterface(IID_PPV_ARGS(&ipDxgiOutput1));
+		CHECK_HR_RETURN(hr);
+		hr = ipDxgiOutput1->DuplicateOutput(ipDevice, &ipOutputDuplication);
+		CHECK_HR_RETURN(hr);
+
+		hr = Initialize(ipDevice, ipContext, ipOutputDuplication, &outputDesc, uiMonitorIdx);
+		CHECK_HR_RETURN(hr);
+		m_ipDevice = ipDevice;
+		return S_OK;
+	}
+
+	inline void Terminate()
+	{
+		if (m_bMapped) {
+			m_ipContext->Unmap(m_ipStagingTexture, 0);
+			m_bMapped = FALSE;
+		}
+		if (m_bAcquired) {
+			m_ipOutputDuplication->ReleaseFrame();
+			m_bAcquired = FALSE;
+		}
+		if (nullptr != m_mouseInfo.PtrShapeBuffer) {
+			delete[] m_mouseInfo.PtrShapeBuffer;
+		}
+		RtlZeroMemory(&m_mouseInfo, sizeof(m_mouseInfo));
+		DXGICaptureFrameBuffer::Free(&m_frameMetadataBuffer);
+
+		m_ipStagingTexture    = nullptr;
+		m_ipOutputDuplication = nullptr;
+		m_ipContext           = nullptr;
+		m_ipDevice            = nullptr;
+		m_copyBoxes.clear();
+		m_ullFrameNumber      = 0;
+	}
+
+	// IDXGICaptureSource
+	virtual HRESULT GetDesc(_Out_ tagCaptureSourceDesc *pDesc)
+	{
+		CHECK_POINTER(pDesc);
+		*pDesc = m_desc;
+		return S_OK;
+	}
+
+	virtual HRESULT AcquireFrame(_In_ UINT uiTimeoutMsec, _Out_ tagCaptureSourceFrame *pFrame)
+	{
+		CHECK_POINTER(pFrame);
+		RtlZeroMemory(pFrame, sizeof(*pFrame));
+		CHECK_POINTER_EX(m_ipOutputDuplication, E_UNEXPECTED);
+		if (m_bAcquired) {
+			return E_UNEXPECTED;
+		}
+
+		DXGI_OUTDUPL_FRAME_INFO     FrameInfo;
+		CComPtr<IDXGIResource>      ipDesktopResource;
+		CComPtr<ID3D11Texture2D>    ipAcquiredDesktopImage;
+
+		HRESULT hr = m_ipOutputDuplication->AcquireNextFrame(uiTimeoutMsec, &FrameInfo, &ipDesktopResource);
+		if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
+			return S_FALSE;
+		}
+		CHECK_HR_RETURN(hr);
+		m_bAcquired = TRUE;
+
+		do
+		{
+			hr = ipDesktopResource->QueryInterface(IID_PPV_ARGS(&ipAcquiredDesktopImage));
+			CHECK_HR_BREAK(hr);
+
+			if (m_copyBoxes.empty()) {
+				m_ipContext->CopyResource(m_ipStagingTexture, ipAcquiredDesktopImage);
+			}
+			for (size_t i = 0; i < m_copyBoxes.size(); ++i)
+			{
+				const D3D11_BOX &box = m_copyBoxes[i];
+				m_ipContext->CopySubresourceRegion(m_ipStagingTexture, 0, box.left, box.top, 0, ipAcquiredDesktopImage, 0, &box);
+			}
+
+			hr = DXGICaptureHelper::GetMouse(m_ipOutputDuplication, &m_mouseInfo, &FrameInfo, m_uiMonitorIdx, m_outputDesc.DesktopCoordinates.left, m_outputDesc.DesktopCoordinates.top);
+			CHECK_HR_BREAK(hr);
+			DXGICaptureHelper::GetCapturePointer(&m_mouseInfo, &m_pointer);
+
+			// the rects are in the orientation of the acquired image, only identity is reported
+			tagFrameMoveRect *pMoveRects  = nullptr;
+			tagFrameRect     *pDirtyRects = nullptr;
+			UINT             uiMoveCount  = 0;
+			UINT             uiDirtyCount = 0;
+			if ((m_ullFrameNumber > 0) && (m_desc.RotationDegrees == 0)) {
+				hr = DXGICaptureHelper::GetFrameMetadata(m_ipOutputDuplication, &FrameInfo, &m_frameMetadataBuffer, &pMoveRects, &uiMoveCount, &pDirtyRects, &uiDirtyCount);
+			}
+			if (FAILED(hr) || (m_ullFrameNumber == 0) || ((m_desc.RotationDegrees != 0) && (FrameInfo.AccumulatedFrames > 0)))
+			{
+				pMoveRects   = nullptr;
+				uiMoveCount  = 0;
+				pDirtyRects  = &m_fullRect;
+				uiDirtyCount = 1;
+			}
+
+			D3D11_MAPPED_SUBRESOURCE mapped;
+			hr = m_ipContext->Map(m_ipStagingTexture, 0, D3D11_MAP_READ, 0, &mapped);
+			CHECK_HR_BREAK(hr);
+			m_bMapped = TRUE;
+
+			pFrame->Data           = reinterpret_cast<const BYTE*>(mapped.pData);
+			pFrame->Pitch          = (INT)mapped.RowPitch;
+			pFrame->FrameNumber    = m_ullFrameNumber++;
+			pFrame->Timestamp      = (INT64)(FrameInfo.LastPresentTime.QuadPart * 1000000 / m_liFrequency.QuadPart);
+			pFrame->AccumulatedFrames = FrameInfo.AccumulatedFrames;
+			pFrame->MoveRects      = pMoveRects;
+			pFrame->MoveRectCount  = uiMoveCount;
+			pFrame->DirtyRects     = pDirtyRects;
+			pFrame->DirtyRectCount = uiDirtyCount;
+			pFrame->Pointer        = &m_pointer;
+		} while (false);
+
+		if (FAILED(hr))
+		{
+			ReleaseFrame();
+			RtlZeroMemory(pFrame, sizeof(*pFrame));
+		}
+		return hr;
+	}
+
+	virtual HRESULT SetCopyRects(_In_opt_ const tagFrameRect *pRects, _In_ UINT uiCount)
+	{
+		m_copyBoxes.clear();
+		for (UINT i = 0; (nullptr != pRects) && (i < uiCount); ++i)
+		{
+			tagFrameRect rc = pRects[i];
+			if (!DXGICaptureDirtyRects::ClipRect(&rc, m_desc.Width, m_desc.Height)) {
+				continue;
+			}
+			D3D11_BOX box = { (UINT)rc.Left, (UINT)rc.Top, 0, (UINT)rc.Right, (UINT)rc.Bottom, 1 };
+			m_copyBoxes.push_back(box);
+		}
+		return S_OK;
+	}
+
+	virtual HRESULT ReleaseFrame()
+	{
+		if (!m_bAcquired) {
+			return E_UNEXPECTED;
+		}
+		if (m_bMapped) {
+			m_ipContext->Unmap(m_ipStagingTexture, 0);
+			m_bMapped = FALSE;
+		}
+		m_bAcquired = FALSE;
+		return m_ipOutputDuplication->ReleaseFrame();
+	}
+
+}; // end class CDXGIDuplicationSource
+
+#endif // __DXGICAPTUREDUPLICATIONSOURCE_H__
@@ -0,0 +1,714 @@
+/*****************************************************************************
+* DXGICaptureEncoderPool.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREENCODERPOOL_H__
+#define __DXGICAPTUREENCODERPOOL_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureFrame.h"
+#include "DXGICaptureFrameBuffer.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define DXGICAPTURE_ENCODER_MAX_WORKERS         16
+#define DXGICAPTURE_ENCODER_MAX_QUEUE_DEPTH     48
+#define DXGICAPTURE_ENCODER_DEFAULT_QUEUE_DEPTH 8
+#define DXGICAPTURE_ENCODER_MAX_SLOTS           (DXGICAPTURE_ENCODER_MAX_WORKERS + DXGICAPTURE_ENCODER_MAX_QUEUE_DEPTH)
+#define DXGICAPTURE_ENCODER_ORDER_SIZE          (DXGICAPTURE_ENCODER_MAX_SLOTS * 2)
+
+//
+// enum tagEncodeBackpressure_e
+//
+typedef enum tagEncodeBackpressure_e : UINT
+{
+	tagEncodeBackpressure_Block      = 0x0, /* Submit waits for a free slot */
+	tagEncodeBackpressure_DropOldest = 0x1, /* the oldest queued frame gives its slot to the new one */
+	tagEncodeBackpressure_DropNewest = 0x2, /* the submitted frame is dropped */
+} tagEncodeBackpressure;
+
+//
+// struct tagEncoderPoolStats_s
+//
+typedef struct tagEncoderPoolStats_s
+{
+	UINT   Workers;
+	UINT   Slots;              /* queue depth + workers: frames queued, encoding or waiting for their turn to be written */
+	UINT   QueueDepth;         /* frames waiting for a worker now */
+	UINT   MaxQueueDepth;
+	UINT64 Submitted;
+	UINT64 Encoded;
+	UINT64 Written;
+	UINT64 Failed;
+	UINT64 DroppedOldest;
+	UINT64 DroppedNewest;
+	UINT64 Blocked;            /* submits that waited for a free slot */
+	INT64  BlockedUsec;
+	INT64  ElapsedUsec;        /* since Initialize (until Terminate) */
+} tagEncoderPoolStats;
+
+//
+// struct tagEncoderWorkerStats_s
+//
+typedef struct tagEncoderWorkerStats_s
+{
+	UINT64 Frames;
+	INT64  EncodeUsec;
+	INT64  WriteUsec;          /* ordered writes done on this worker */
+	INT64  ElapsedUsec;        /* utilisation = (EncodeUsec + WriteUsec) / ElapsedUsec */
+} tagEncoderWorkerStats;
+
+//
+// class IDXGICaptureEncoder
+//
+// The image encoder and the writer of the encoder pool. Encode is called on
+// several workers at once, Write is called one frame at a time in submit
+// order.
+//
+class IDXGICaptureEncoder
+{
+public:
+	virtual ~IDXGICaptureEncoder() {}
+
+	// called on every worker thread before its first and after its last frame (e.g. COM apartment)
+	virtual HRESULT BeginThread() { return S_OK; }
+	virtual void EndThread() {}
+
+	// encodes the frame into pOutput (grown as needed), *pRetSize receives the encoded size
+	virtual HRESULT Encode(_In_ const CDXGICaptureFrame *pFrame, _Inout_ tagFrameBufferInfo *pOutput, _Out_ UINT *pRetSize) = 0;
+	// writes the encoded frame, ullSequence is the submit index (dropped frames leave gaps)
+	virtual HRESULT Write(_In_ const CDXGICaptureFrame *pFrame, _In_ UINT64 ullSequence, _In_reads_bytes_(uiSize) const BYTE *pData, _In_ UINT uiSize) = 0;
+};
+
+//
+// class CDXGICaptureSlotQueue
+//
+// Bounded lock-free multi producer / multi consumer FIFO of slot indices
+// (every cell carries the sequence number of the position it is ready for).
+//
+class CDXGICaptureSlotQueue
+{
+private:
+	typedef struct tagCell_s
+	{
+		std::atomic<size_t> Sequence;
+		UINT                Value;
+	} tagCell;
+
+	tagCell             m_cells[DXGICAPTURE_ENCODER_MAX_SLOTS];
+	std::atomic<size_t> m_enqueuePos;
+	std::atomic<size_t> m_dequeuePos;
+
+	// disable copy
+	CDXGICaptureSlotQueue(const CDXGICaptureSlotQueue&);
+	CDXGICaptureSlotQueue& operator=(const CDXGICaptureSlotQueue&);
+
+public:
+	CDXGICaptureSlotQueue()
+	{
+		Reset();
+	}
+
+	// not thread safe
+	inline void Reset()
+	{
+		for (size_t i = 0; i < DXGICAPTURE_ENCODER_MAX_SLOTS; ++i)
+		{
+			m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+			m_cells[i].Value = 0;
+		}
+		m_enqueuePos.store(0, std::memory_order_relaxed);
+		m_dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	inline BOOL TryPush(_In_ UINT uiValue)
+	{
+		tagCell *pCell = nullptr;
+		size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			pCell = &m_cells[pos % DXGICAPTURE_ENCODER_MAX_SLOTS];
+			size_t seq = pCell->Sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+			if (diff == 0)
+			{
+				if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				return FALSE; // full
+			}
+			else {
+				pos = m_enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+		pCell->Value = uiValue;
+		pCell->Sequence.store(pos + 1, std::memory_order_release);
+		return TRUE;
+	}
+
+	inline BOOL TryPop(_Out_ UINT *pValue)
+	{
+		tagCell *pCell = nullptr;
+		size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			pCell = &m_cells[pos % DXGICAPTURE_ENCODER_MAX_SLOTS];
+			size_t seq = pCell->Sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+			if (diff == 0)
+			{
+				if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (diff < 0) {
+				return FALSE; // empty
+			}
+			else {
+				pos = m_dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+		*pValue = pCell->Value;
+		pCell->Sequence.store(pos + DXGICAPTURE_ENCODER_MAX_SLOTS, std::memory_order_release);
+		return TRUE;
+	}
+
+}; // end class CDXGICaptureSlotQueue
+
+//
+// class CDXGICaptureEncoderPool
+//
+// Encodes the submitted frames on a bounded pool of workers, so a slow image
+// encoder does not hold up the capture. Submit hands the frame (AddRef) to a
+// free slot and pushes the slot onto the lock-free work queue; the workers
+// encode the slots in any order and the finished frames are written strictly
+// in submit order by whichever worker completes the next one. When all slots
+// are taken the backpressure policy blocks, drops the oldest queued frame or
+// drops the submitted one. Submit, Flush and Terminate are called from one
+// producer thread.
+//
+class CDXGICaptureEncoderPool
+{
+private:
+	typedef std::chrono::steady_clock clock_type;
+
+	typedef struct tagSlot_s
+	{
+		CDXGICaptureFrame* Frame;
+		UINT64             Sequence;
+		HRESULT            Result;
+		UINT               Size;
+		tagFrameBufferInfo Output;
+	} tagSlot;
+
+	typedef struct tagWorker_s
+	{
+		std::atomic<UINT64> Frames;
+		std::atomic<INT64>  EncodeUsec;
+		std::atomic<INT64>  WriteUsec;
+	} tagWorker;
+
+	// m_order value of a dropped sequence, other values are slot + 1
+	static const UINT SKIPPED_SEQUENCE = 0xFFFFFFFF;
+
+	IDXGICaptureEncoder*   m_pEncoder;
+	UINT                   m_uiWorkers;
+	UINT                   m_uiSlots;
+	tagEncodeBackpressure  m_policy;
+
+	tagSlot                m_slots[DXGICAPTURE_ENCODER_MAX_SLOTS];
+	tagWorker              m_workers[DXGICAPTURE_ENCODER_MAX_WORKERS];
+	std::thread            m_threads[DXGICAPTURE_ENCODER_MAX_WORKERS];
+	CDXGICaptureSlotQueue  m_workQueue;
+	CDXGICaptureSlotQueue  m_freeSlots;
+
+	// workers sleep here while the work queue is empty
+	std::mutex             m_waitLock;
+	std::condition_variable m_workCond;
+	std::atomic<LONG>      m_lIdleWorkers;
+	std::atomic<LONG>      m_lQueued;
+	std::atomic<bool>      m_bStop;
+
+	// ordered writes: m_order[sequence % size] is set when the sequence is encoded (or dropped)
+	std::mutex             m_commitLock;
+	std::condition_variable m_commitCond;
+	std::atomic<UINT>      m_order[DXGICAPTURE_ENCODER_ORDER_SIZE];
+	std::atomic<UINT64>    m_ullNextWrite;
+	UINT64                 m_ullNextSequence;
+	std::atomic<HRESULT>   m_hrResult;
+
+	clock_type::time_point m_startTick;
+	std::atomic<INT64>     m_llElapsedUsec;     // set by Terminate
+	std::atomic<UINT>      m_uiMaxQueued;
+	std::atomic<UINT64>    m_ullSubmitted;
+	std::atomic<UINT64>    m_ullEncoded;
+	std::atomic<UINT64>    m_ullWritten;
+	std::atomic<UINT64>    m_ullFailed;
+	std::atomic<UINT64>    m_ullDroppedOldest;
+	std::atomic<UINT64>    m_ullDroppedNewest;
+	std::atomic<UINT64>    m_ullBlocked;
+	std::atomic<INT64>     m_llBlockedUsec;
+
+	// disable copy
+	CDXGICaptureEncoderPool(const CDXGICaptureEncoderPool&);
+	CDXGICaptureEncoderPool& operator=(const CDXGICaptureEncoderPool&);
+
+	inline INT64 getUsec(clock_type::time_point start) const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count();
+	}
+
+	//
+	// Writes the encoded frames that are next in order, m_commitLock is held.
+	// nWorker is the calling worker (-1: producer).
+	//
+	inline void drainLocked(_In_ INT nWorker)
+	{
+		BOOL bAdvanced = FALSE;
+		for (;;)
+		{
+			UINT64 ullNext = m_ullNextWrite.load();
+			std::atomic<UINT> &order = m_order[ullNext % DXGICAPTURE_ENCODER_ORDER_SIZE];
+			UINT uiValue = order.load();
+			if (uiValue == 0) {
+				break;
+			}
+			order.store(0);
+
+			if (uiValue != SKIPPED_SEQUENCE)
+			{
+				UINT uiSlot = uiValue - 1;
+				tagSlot &slot = m_slots[uiSlot];
+				HRESULT hr = slot.Result;
+				if (SUCCEEDED(hr) && SUCCEEDED(m_hrResult.load()))
+				{
+					clock_type::time_point writeStart = clock_type::now();
+					hr = m_pEncoder->Write(slot.Frame, slot.Sequence, slot.Output.Buffer, slot.Size);
+					if (nWorker >= 0) {
+						m_workers[nWorker].WriteUsec += getUsec(writeStart);
+					}
+					if (SUCCEEDED(hr)) {
+						++m_ullWritten;
+					}
+				}
+				if (FAILED(hr))
+				{
+					++m_ullFailed;
+					HRESULT hrExpected = S_OK;
+					m_hrResult.compare_exchange_strong(hrExpected, hr);
+				}
+
+				slot.Frame->Release();
+				slot.Frame = nullptr;
+				m_freeSlots.TryPush(uiSlot); // under m_commitLock, see Submit
+			}
+
+			m_ullNextWrite.store(ullNext + 1);
+			bAdvanced = TRUE;
+		}
+
+		if (bAdvanced) {
+			m_commitCond.notify_all();
+		}
+	}
+
+	//
+	// Drains without waiting for a worker that is writing, the owner of the
+	// lock checks again for results that arrived while it was writing.
+	//
+	inline void commit(_In_ INT nWorker)
+	{
+		for (;;)
+		{
+			std::unique_lock<std::mutex> lock(m_commitLock, std::try_to_lock);
+			if (!lock.owns_lock()) {
+				return;
+			}
+			drainLocked(nWorker);
+			lock.unlock();
+
+			if (m_order[m_ullNextWrite.load() % DXGICAPTURE_ENCODER_ORDER_SIZE].load() == 0) {
+				return;
+			}
+		}
+	}
+
+	inline void wakeWorker()
+	{
+		if (m_lIdleWorkers.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock(m_waitLock);
+			m_workCond.notify_one();
+		}
+	}
+
+	inline void workerProc(_In_ UINT uiWorker)
+	{
+		tagWorker &worker = m_workers[uiWorker];
+		HRESULT hrThread = m_pEncoder->BeginThread();
+
+		for (;;)
+		{
+			UINT uiSlot = 0;
+			if (!m_workQueue.TryPop(&uiSlot))
+			{
+				std::unique_lock<std::mutex> lock(m_waitLock);
+				++m_lIdleWorkers;
+				while ((m_lQueued.load() == 0) && !m_bStop.load()) {
+					m_workCond.wait(lock);
+				}
+				--m_lIdleWorkers;
+				if ((m_lQueued.load() == 0) && m_bStop.load()) {
+					break;
+				}
+				continue;
+			}
+			--m_lQueued;
+
+			tagSlot &slot = m_slots[uiSlot];
+			clock_type::time_point encodeStart = clock_type::now();
+			slot.Size   = 0;
+			slot.Result = FAILED(hrThread) ? hrThread : m_pEncoder->Encode(slot.Frame, &slot.Output, &slot.Size);
+			worker.EncodeUsec += getUsec(encodeStart);
+			++worker.Frames;
+			if (SUCCEEDED(slot.Result)) {
+				++m_ullEncoded;
+			}
+
+			m_order[slot.Sequence % DXGICAPTURE_ENCODER_ORDER_SIZE].store(uiSlot + 1);
+			commit((INT)uiWorker);
+		}
+
+		if (SUCCEEDED(hrThread)) {
+			m_pEncoder->EndThread();
+		}
+	}
+
+	inline void stopWorkers()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_waitLock);
+			m_bStop.store(true);
+			m_workCond.notify_all();
+		}
+		for (UINT i = 0; i < DXGICAPTURE_ENCODER_MAX_WORKERS; ++i)
+		{
+			if (m_threads[i].joinable()) {
+				m_threads[i].join();
+			}
+		}
+	}
+
+	inline void resetStats()
+	{
+		for (UINT i = 0; i < DXGICAPTURE_ENCODER_MAX_WORKERS; ++i)
+		{
+			m_workers[i].Frames.store(0);
+			m_workers[i].EncodeUsec.store(0);
+			m_workers[i].WriteUsec.store(0);
+		}
+		m_startTick = clock_type::now();
+		m_llElapsedUsec.store(-1);
+		m_uiMaxQueued.store(0);
+		m_ullSubmitted.store(0);
+		m_ullEncoded.store(0);
+		m_ullWritten.store(0);
+		m_ullFailed.store(0);
+		m_ullDroppedOldest.store(0);
+		m_ullDroppedNewest.store(0);
+		m_ullBlocked.store(0);
+		m_llBlockedUsec.store(0);
+	}
+
+public:
+	CDXGICaptureEncoderPool()
+		: m_pEncoder(nullptr)
+		, m_uiWorkers(0)
+		, m_uiSlots(0)
+		, m_policy(tagEncodeBackpressure_Block)
+		, m_lIdleWorkers(0)
+		, m_lQueued(0)
+		, m_bStop(false)
+		, m_ullNextWrite(0)
+		, m_ullNextSequence(0)
+		, m_hrResult(S_OK)
+	{
+		memset(m_slots, 0, sizeof(m_slots));
+		for (UINT i = 0; i < DXGICAPTURE_ENCODER_ORDER_SIZE; ++i) {
+			m_order[i].store(0);
+		}
+		resetStats();
+		m_llElapsedUsec.store(0);
+	}
+
+	~CDXGICaptureEncoderPool()
+	{
+		Terminate();
+		for (UINT i = 0; i < DXGICAPTURE_ENCODER_MAX_SLOTS; ++i) {
+			DXGICaptureFrameBuffer::Free(&m_slots[i].Output);
+		}
+	}
+
+	//
+	// Starts uiWorkers workers (1..16) with uiQueueDepth queued frames (1..48), the encoder is not owned
+	//
+	inline
+	HRESULT
+	Initialize(
+		_In_ IDXGICaptureEncoder *pEncoder,
+		_In_ UINT uiWorkers,
+		_In_ UINT uiQueueDepth,
+		_In_ tagEncodeBackpressure policy
+		)
+	{
+		CHECK_POINTER_EX(pEncoder, E_INVALIDARG);
+		if ((uiWorkers < 1) || (uiWorkers > DXGICAPTURE_ENCODER_MAX_WORKERS) ||
+			(uiQueueDepth < 1) || (uiQueueDepth > DXGICAPTURE_ENCODER_MAX_QUEUE_DEPTH) ||
+			(policy > tagEncodeBackpressure_DropNewest)) {
+			return E_INVALIDARG;
+		}
+
+		Terminate();
+
+		m_pEncoder  = pEncoder;
+		m_uiWorkers = uiWorkers;
+		m_uiSlots   = uiWorkers + uiQueueDepth;
+		m_policy    = policy;
+
+		m_workQueue.Reset();
+		m_freeSlots.Reset();
+		for (UINT i = 0; i < m_uiSlots; ++i) {
+			m_freeSlots.TryPush(i);
+		}
+		for (UINT i = 0; i < DXGICAPTURE_ENCODER_ORDER_SIZE; ++i) {
+			m_order[i].store(0);
+		}
+		m_lQueued.store(0);
+		m_lIdleWorkers.store(0);
+		m_ullNextWrite.store(0);
+		m_ullNextSequence = 0;
+		m_hrResult.store(S_OK);
+		m_bStop.store(false);
+		resetStats();
+
+		try
+		{
+			for (UINT i = 0; i < m_uiWorkers; ++i) {
+				m_threads[i] = std::thread(&CDXGICaptureEncoderPool::workerProc, this, i);
+			}
+		}
+		catch (...)
+		{
+			stopWorkers();
+			m_pEncoder = nullptr;
+			return E_FAIL;
+		}
+
+		return S_OK;
+	}
+
+	//
+	// Encodes and writes the frames still in the pool, then stops the workers.
+	// Returns the first encode or write failure.
+	//
+	inline HRESULT Terminate()
+	{
+		if (nullptr == m_pEncoder) {
+			return S_FALSE;
+		}
+
+		stopWorkers();
+		{
+			std::lock_guard<std::mutex> lock(m_commitLock);
+			drainLocked(-1);
+		}
+
+		// nothing is left in flight, unless a frame was dropped after the last write
+		for (UINT i = 0; i < m_uiSlots; ++i)
+		{
+			if (nullptr != m_slots[i].Frame)
+			{
+				m_slots[i].Frame->Release();
+				m_slots[i].Frame = nullptr;
+			}
+		}
+
+		m_llElapsedUsec.store(getUsec(m_startTick));
+		m_pEncoder = nullptr;
+		return m_hrResult.load();
+	}
+
+	inline BOOL IsInitialized() const { return (nullptr != m_pEncoder); }
+	inline UINT GetWorkerCount() const { return m_uiWorkers; }
+	inline tagEncodeBackpressure GetBackpressure() const { return m_policy; }
+
+	//
+	// Queues the frame (the pool takes its own reference).
+	// Returns S_FALSE if the frame was dropped (DropNewest), or the first encode
+	// or write failure of the pool.
+	//
+	inline
+	HRESULT
+	Submit(
+		_In_ CDXGICaptureFrame *pFrame
+		)
+	{
+		CHECK_POINTER_EX(pFrame, E_INVALIDARG);
+		CHECK_POINTER_EX(m_pEncoder, E_UNEXPECTED);
+		HRESULT hr = m_hrResult.load();
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		++m_ullSubmitted;
+
+		UINT uiSlot = 0;
+		BOOL bSlot = m_freeSlots.TryPop(&uiSlot);
+		if (!bSlot && (m_policy == tagEncodeBackpressure_DropNewest))
+		{
+			++m_ullDroppedNewest;
+			return S_FALSE;
+		}
+
+		if (!bSlot && (m_policy == tagEncodeBackpressure_DropOldest) && m_workQueue.TryPop(&uiSlot))
+		{
+			// the sequence of the dropped frame is skipped by the writer, the slot is reused
+			--m_lQueued;
+			m_slots[uiSlot].Frame->Release();
+			m_slots[uiSlot].Frame = nullptr;
+			m_order[m_slots[uiSlot].Sequence % DXGICAPTURE_ENCODER_ORDER_SIZE].store(SKIPPED_SEQUENCE);
+			++m_ullDroppedOldest;
+			commit(-1);
+			bSlot = TRUE;
+		}
+
+		// wait for a free slot (all slots encoding with DropOldest), or for the
+		// writer when skipped sequences fill the order window
+		clock_type::time_point blockStart = clock_type::now();
+		BOOL bBlocked = FALSE;
+		while (!bSlot || ((m_ullNextSequence - m_ullNextWrite.load()) >= DXGICAPTURE_ENCODER_ORDER_SIZE))
+		{
+			std::unique_lock<std::mutex> lock(m_commitLock);
+			drainLocked(-1);
+			if (!bSlot && m_freeSlots.TryPop(&uiSlot))
+			{
+				bSlot = TRUE;
+				continue;
+			}
+			hr = m_hrResult.load();
+			if (FAILED(hr))
+			{
+				if (bSlot) {
+					m_freeSlots.TryPush(uiSlot);
+				}
+				return hr;
+			}
+			bBlocked = TRUE;
+			m_commitCond.wait(lock);
+		}
+		if (bBlocked)
+		{
+			++m_ullBlocked;
+			m_llBlockedUsec += getUsec(blockStart);
+		}
+
+		tagSlot &slot = m_slots[uiSlot];
+		pFrame->AddRef();
+		slot.Frame    = pFrame;
+		slot.Sequence = m_ullNextSequence++;
+		slot.Result   = S_OK;
+		slot.Size     = 0;
+
+		m_workQueue.TryPush(uiSlot);
+		UINT uiQueued = (UINT)(++m_lQueued);
+		if (uiQueued > m_uiMaxQueued.load()) {
+			m_uiMaxQueued.store(uiQueued);
+		}
+		wakeWorker();
+		return S_OK;
+	}
+
+	//
+	// Waits until every submitted frame is written (or dropped).
+	// Returns the first encode or write failure.
+	//
+	inline HRESULT Flush()
+	{
+		CHECK_POINTER_EX(m_pEncoder, E_UNEXPECTED);
+
+		std::unique_lock<std::mutex> lock(m_commitLock);
+		for (;;)
+		{
+			drainLocked(-1);
+			if (m_ullNextWrite.load() == m_ullNextSequence) {
+				break;
+			}
+			m_commitCond.wait(lock);
+		}
+		return m_hrResult.load();
+	}
+
+	inline void GetStats(_Out_ tagEncoderPoolStats *pStats) const
+	{
+		LONG lQueued = m_lQueued.load();
+		INT64 llElapsedUsec = m_llElapsedUsec.load();
+
+		pStats->Workers       = m_uiWorkers;
+		pStats->Slots         = m_uiSlots;
+		pStats->QueueDepth    = (lQueued > 0) ? (UINT)lQueued : 0;
+		pStats->MaxQueueDepth = m_uiMaxQueued.load();
+		pStats->Submitted     = m_ullSubmitted.load();
+		pStats->Encoded       = m_ullEncoded.load();
+		pStats->Written       = m_ullWritten.load();
+		pStats->Failed        = m_ullFailed.load();
+		pStats->DroppedOldest = m_ullDroppedOldest.load();
+		pStats->DroppedNewest = m_ullDroppedNewest.load();
+		pStats->Blocked       = m_ullBlocked.load();
+		pStats->BlockedUsec   = m_llBlockedUsec.load();
+		pStats->ElapsedUsec   = (llElapsedUsec >= 0) ? llElapsedUsec : getUsec(m_startTick);
+	}
+
+	inline
+	HRESULT
+	GetWorkerStats(
+		_In_ UINT uiWorker,
+		_Out_ tagEncoderWorkerStats *pStats
+		) const
+	{
+		CHECK_POINTER(pStats);
+		if (uiWorker >= m_uiWorkers) {
+			return E_INVALIDARG;
+		}
+
+		INT64 llElapsedUsec = m_llElapsedUsec.load();
+		pStats->Frames      = m_workers[uiWorker].Frames.load();
+		pStats->EncodeUsec  = m_workers[uiWorker].EncodeUsec.load();
+		pStats->WriteUsec   = m_workers[uiWorker].WriteUsec.load();
+		pStats->ElapsedUsec = (llElapsedUsec >= 0) ? llElapsedUsec : getUsec(m_startTick);
+		return S_OK;
+	}
+
+}; // end class CDXGICaptureEncoderPool
+
+#endif // __DXGICAPTUREENCODERPOOL_H__
@@ -0,0 +1,324 @@
+/*****************************************************************************
+* DXGICaptureFrame.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREFRAME_H__
+#define __DXGICAPTUREFRAME_H__
+
+#include "DXGICapturePlatform.h"
+#include "DXGICaptureMetrics.h"
+#include "DXGICaptureYuv.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+class CDXGICaptureFramePool;
+
+//
+// class CDXGICaptureFrame
+//
+// Ref-counted 32bpp BGRA frame. A frame is handed to the consumer with one
+// reference owned by the caller; AddRef it to keep the frame after the
+// callback returns and Release it when done. The last Release gives the
+// buffer back to the pool it came from.
+//
+class CDXGICaptureFrame
+{
+	friend class CDXGICaptureFramePool;
+
+private:
+	std::atomic<LONG>                    m_lRefCount;
+	CDXGICaptureFramePool*               m_pPool;
+	UINT                                 m_uiBufferSize;
+	_Field_size_bytes_(m_uiBufferSize) BYTE* m_pBuffer;
+	INT                                  m_nWidth;
+	INT                                  m_nHeight;
+	INT                                  m_nPitch;
+	UINT64                               m_ullFrameNumber;
+	INT64                                m_llTimestamp;
+	UINT64                               m_ullContentHash;
+	UINT                                 m_uiYuvBufferSize;
+	_Field_size_bytes_(m_uiYuvBufferSize) BYTE* m_pYuvBuffer;
+	tagYuvImage                          m_yuvImage;
+
+	CDXGICaptureFrame()
+		: m_lRefCount(1)
+		, m_pPool(nullptr)
+		, m_uiBufferSize(0)
+		, m_pBuffer(nullptr)
+		, m_nWidth(0)
+		, m_nHeight(0)
+		, m_nPitch(0)
+		, m_ullFrameNumber(0)
+		, m_llTimestamp(0)
+		, m_ullContentHash(0)
+		, m_uiYuvBufferSize(0)
+		, m_pYuvBuffer(nullptr)
+	{
+		memset(&m_yuvImage, 0, sizeof(m_yuvImage));
+	}
+
+	~CDXGICaptureFrame()
+	{
+		if (nullptr != m_pBuffer) {
+			delete[] m_pBuffer;
+			m_pBuffer = nullptr;
+		}
+		if (nullptr != m_pYuvBuffer) {
+			delete[] m_pYuvBuffer;
+			m_pYuvBuffer = nullptr;
+		}
+	}
+
+	// disable copy
+	CDXGICaptureFrame(const CDXGICaptureFrame&);
+	CDXGICaptureFrame& operator=(const CDXGICaptureFrame&);
+
+public:
+	inline LONG AddRef()
+	{
+		return ++m_lRefCount;
+	}
+
+	inline LONG Release();
+
+	// TRUE while another owner holds a reference (the frame must not be written then)
+	inline BOOL IsShared() const { return (m_lRefCount.load() > 1) ? TRUE : FALSE; }
+
+	inline BYTE* GetBuffer() { return m_pBuffer; }
+	inline const BYTE* GetBuffer() const { return m_pBuffer; }
+	inline UINT GetBufferSize() const { return m_uiBufferSize; }
+	inline INT GetWidth() const { return m_nWidth; }
+	inline INT GetHeight() const { return m_nHeight; }
+	inline INT GetPitch() const { return m_nPitch; }
+
+	// sequence number of the captured desktop image, a repeated frame keeps its number
+	inline UINT64 GetFrameNumber() const { return m_ullFrameNumber; }
+	// capture time in microseconds since the capture was started
+	inline INT64 GetTimestamp() const { return m_llTimestamp; }
+
+	inline void SetFrameInfo(UINT64 ullFrameNumber, INT64 llTimestamp)
+	{
+		m_ullFrameNumber = ullFrameNumber;
+		m_llTimestamp    = llTimestamp;
+	}
+
+	// hash of the image (see CDXGITileHasher::GetFrameHash), 0: not hashed
+	inline UINT64 GetContentHash() const { return m_ullContentHash; }
+	inline void SetContentHash(UINT64 ullContentHash) { m_ullContentHash = ullContentHash; }
+
+	// planes of the last ConvertToYuv, Format is tagYuvFormat_None if the frame was not converted
+	inline const tagYuvImage* GetYuvImage() const { return &m_yuvImage; }
+
+	//
+	// Converts the BGRA image into the YUV buffer of the frame, the buffer is
+	// kept with the frame in the pool
+	//
+	inline
+	HRESULT
+	ConvertToYuv(
+		_In_ tagYuvFormat format,
+		_In_ tagYuvMatrix matrix,
+		_In_ tagYuvRange range,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		UINT uiSize = DXGICaptureYuv::GetImageSize(format, m_nWidth, m_nHeight);
+		if (uiSize == 0) {
+			return E_INVALIDARG;
+		}
+		if (m_uiYuvBufferSize < uiSize)
+		{
+			if (nullptr != m_pYuvBuffer) {
+				delete[] m_pYuvBuffer;
+			}
+			m_pYuvBuffer = new (std::nothrow) BYTE[uiSize];
+			if (nullptr == m_pYuvBuffer)
+			{
+				m_uiYuvBufferSize = 0;
+				return E_OUTOFMEMORY;
+			}
+			m_uiYuvBufferSize = uiSize;
+			DXGICaptureAllocations::Add(uiSize);
+		}
+
+		HRESULT hr = DXGICaptureYuv::SetupImage(format, matrix, range, m_nWidth, m_nHeight, m_pYuvBuffer, m_uiYuvBufferSize, &m_yuvImage);
+		CHECK_HR_RETURN(hr);
+		return DXGICaptureYuv::Convert(m_pBuffer, m_nPitch, &m_yuvImage, level);
+	}
+
+}; // end class CDXGICaptureFrame
+
+//
+// class CDXGICaptureFramePool
+//
+// Recycles frame buffers, so a running capture does not allocate per frame.
+// The pool is ref-counted by its owner and by every frame that is out, so it
+// stays alive until the last frame is released.
+//
+class CDXGICaptureFramePool
+{
+	friend class CDXGICaptureFrame;
+
+private:
+	std::atomic<LONG>               m_lRefCount;
+	std::mutex                      m_lock;
+	std::vector<CDXGICaptureFrame*> m_freeFrames;
+	UINT                            m_uiMaxFreeFrames;
+
+	CDXGICaptureFramePool(UINT uiMaxFreeFrames)
+		: m_lRefCount(1)
+		, m_uiMaxFreeFrames(uiMaxFreeFrames)
+	{
+	}
+
+	~CDXGICaptureFramePool()
+	{
+		for (size_t i = 0; i < m_freeFrames.size(); ++i) {
+			delete m_freeFrames[i];
+		}
+		m_freeFrames.clear();
+	}
+
+	// disable copy
+	CDXGICaptureFramePool(const CDXGICaptureFramePool&);
+	CDXGICaptureFramePool& operator=(const CDXGICaptureFramePool&);
+
+	inline void recycle(CDXGICaptureFrame *pFrame)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (m_freeFrames.size() < m_uiMaxFreeFrames)
+			{
+				m_freeFrames.push_back(pFrame);
+				pFrame = nullptr;
+			}
+		}
+		if (nullptr != pFrame) {
+			delete pFrame;
+		}
+
+		// reference of the returned frame
+		this->Release();
+	}
+
+public:
+	static
+	inline
+	CDXGICaptureFramePool*
+	Create(
+		_In_ UINT uiMaxFreeFrames = 4
+		)
+	{
+		return new (std::nothrow) CDXGICaptureFramePool(uiMaxFreeFrames);
+	}
+
+	inline LONG AddRef()
+	{
+		return ++m_lRefCount;
+	}
+
+	inline LONG Release()
+	{
+		LONG lRefCount = --m_lRefCount;
+		if (lRefCount == 0) {
+			delete this;
+		}
+		return lRefCount;
+	}
+
+	//
+	// Returns a frame with one reference, nullptr if out of memory
+	//
+	inline
+	CDXGICaptureFrame*
+	AcquireFrame(
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ INT nPitch
+		)
+	{
+		UINT uiSize = (UINT)(nHeight * nPitch);
+		CDXGICaptureFrame *pFrame = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (!m_freeFrames.empty())
+			{
+				pFrame = m_freeFrames.back();
+				m_freeFrames.pop_back();
+			}
+		}
+
+		if (nullptr == pFrame)
+		{
+			pFrame = new (std::nothrow) CDXGICaptureFrame();
+			if (nullptr == pFrame) {
+				return nullptr;
+			}
+			DXGICaptureAllocations::Add(sizeof(CDXGICaptureFrame));
+		}
+
+		if (pFrame->m_uiBufferSize < uiSize)
+		{
+			if (nullptr != pFrame->m_pBuffer) {
+				delete[] pFrame->m_pBuffer;
+			}
+			pFrame->m_pBuffer = new (std::nothrow) BYTE[uiSize];
+			if (nullptr == pFrame->m_pBuffer)
+			{
+				pFrame->m_uiBufferSize = 0;
+				delete pFrame;
+				return nullptr;
+			}
+			pFrame->m_uiBufferSize = uiSize;
+			DXGICaptureAllocations::Add(uiSize);
+		}
+
+		pFrame->m_lRefCount      = 1;
+		pFrame->m_pPool          = this;
+		pFrame->m_nWidth         = nWidth;
+		pFrame->m_nHeight        = nHeight;
+		pFrame->m_nPitch         = nPitch;
+		pFrame->m_ullFrameNumber = 0;
+		pFrame->m_llTimestamp    = 0;
+		pFrame->m_ullContentHash = 0;
+		pFrame->m_yuvImage.Format = tagYuvFormat_None;
+
+		// the frame keeps the pool alive
+		this->AddRef();
+		return pFrame;
+	}
+
+}; // end class CDXGICaptureFramePool
+
+inline LONG CDXGICaptureFrame::Release()
+{
+	LONG lRefCount = --m_lRefCount;
+	if (lRefCount == 0)
+	{
+		if (nullptr != m_pPool) {
+			m_pPool->recycle(this);
+		}
+		else {
+			delete this;
+		}
+	}
+	return lRefCount;
+}
+
+#endif // __DXGICAPTUREFRAME_H__
@@ -0,0 +1,89 @@
+/*****************************************************************************
+* DXGICaptureFrameBuffer.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREFRAMEBUFFER_H__
+#define __DXGICAPTUREFRAMEBUFFER_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureMetrics.h"
+
+#include <new>
+#include <string.h>
+
+//
+// class DXGICaptureFrameBuffer
+//
+// Grow-only buffers of tagFrameBufferInfo
+//
+class DXGICaptureFrameBuffer
+{
+public:
+	//
+	// Returns S_FALSE if the buffer is already large enough (the content is kept),
+	// otherwise the buffer is reallocated and its content is undefined.
+	//
+	static
+	inline
+	HRESULT
+	Resize(
+		_Inout_ tagFrameBufferInfo *pBufferInfo,
+		_In_ UINT uiNewSize
+		)
+	{
+		CHECK_POINTER(pBufferInfo);
+
+		if (uiNewSize <= pBufferInfo->BufferSize)
+		{
+			return S_FALSE; // no change
+		}
+
+		if (nullptr != pBufferInfo->Buffer) {
+			delete[] pBufferInfo->Buffer;
+			pBufferInfo->Buffer = nullptr;
+		}
+
+		pBufferInfo->Buffer = new (std::nothrow) BYTE[uiNewSize];
+		if (!(pBufferInfo->Buffer))
+		{
+			pBufferInfo->BufferSize = 0;
+			return E_OUTOFMEMORY;
+		}
+		pBufferInfo->BufferSize = uiNewSize;
+		DXGICaptureAllocations::Add(uiNewSize);
+
+		return S_OK;
+	} // Resize
+
+	//
+	// Frees the buffer and clears all fields
+	//
+	static
+	inline
+	void
+	Free(
+		_Inout_ tagFrameBufferInfo *pBufferInfo
+		)
+	{
+		if (nullptr != pBufferInfo->Buffer) {
+			delete[] pBufferInfo->Buffer;
+		}
+		memset(pBufferInfo, 0, sizeof(*pBufferInfo));
+	} // Free
+
+}; // end class DXGICaptureFrameBuffer
+
+#endif // __DXGICAPTUREFRAMEBUFFER_H__
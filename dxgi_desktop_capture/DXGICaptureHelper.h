@@ -28,9 +28,27 @@
 #include <wincodec.h>
 
 #include "DXGICaptureTypes.h"
+#include "DXGICaptureBlend.h"
+#include "DXGICaptureCopy.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureCursorShape.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICapturePointer.h"
+#include "DXGICaptureQoi.h"
+#include "DXGICaptureRegion.h"
+#include "DXGICaptureRender.h"
+#include "DXGICaptureRotate.h"
+#include "DXGICaptureStripEncoder.h"
 
 #pragma comment (lib, "Shlwapi.lib")
 
+//
+// Container format of the built-in QOI codec (*.qoi), WIC has no QOI encoder
+// {6F4C1A3E-2B7D-4E55-9A61-3C0E8B42D17F}
+//
+static const GUID GUID_ContainerFormatQoi = { 0x6f4c1a3e, 0x2b7d, 0x4e55, { 0x9a, 0x61, 0x3c, 0x0e, 0x8b, 0x42, 0xd1, 0x7f } };
+
 //
 // class DXGICaptureHelper
 //
@@ -134,6 +152,24 @@ public:
 		return S_OK;
 	}
 
+	static
+	inline
+	void
+	GetFrameGeometry(
+		_In_ const tagRendererInfo *pRendererInfo,
+		_Out_ tagFrameGeometry *pGeometry
+		)
+	{
+		pGeometry->RotationMode    = pRendererInfo->RotationMode;
+		pGeometry->SizeMode        = pRendererInfo->SizeMode;
+		pGeometry->OutputSize      = pRendererInfo->OutputSize;
+		pGeometry->RotationDegrees = pRendererInfo->RotationDegrees;
+		pGeometry->ScaleX          = pRendererInfo->ScaleX;
+		pGeometry->ScaleY          = pRendererInfo->ScaleY;
+		pGeometry->SrcBounds       = pRendererInfo->SrcBounds;
+		pGeometry->DstBounds       = pRendererInfo->DstBounds;
+	} // GetFrameGeometry
+
 	static
 	COM_DECLSPEC_NOTHROW
 	inline
@@ -146,178 +182,34 @@ public:
 		CHECK_POINTER_EX(pDxgiOutputDuplDesc, E_INVALIDARG);
 		CHECK_POINTER_EX(pRendererInfo, E_INVALIDARG);
 
-		pRendererInfo->SrcFormat = pDxgiOutputDuplDesc->ModeDesc.Format;
-		// get rotate state
-		switch (pDxgiOutputDuplDesc->Rotation)
-		{		
-		case DXGI_MODE_ROTATION_ROTATE90:
-			pRendererInfo->RotationDegrees  = 90.0f;
-			pRendererInfo->SrcBounds.X      = 0;
-			pRendererInfo->SrcBounds.Y      = 0;
-			pRendererInfo->SrcBounds.Width  = pDxgiOutputDuplDesc->ModeDesc.Height;
-			pRendererInfo->SrcBounds.Height = pDxgiOutputDuplDesc->ModeDesc.Width;
-			break;
-		case DXGI_MODE_ROTATION_ROTATE180:
-			pRendererInfo->RotationDegrees  = 180.0;
-			pRendererInfo->SrcBounds.X      = 0;
-			pRendererInfo->SrcBounds.Y      = 0;
-			pRendererInfo->SrcBounds.Width  = pDxgiOutputDuplDesc->ModeDesc.Width;
-			pRendererInfo->SrcBounds.Height = pDxgiOutputDuplDesc->ModeDesc.Height;
-			break;
-		case DXGI_MODE_ROTATION_ROTATE270:
-			pRendererInfo->RotationDegrees  = 270.0f;
-			pRendererInfo->SrcBounds.X      = 0;
-			pRendererInfo->SrcBounds.Y      = 0;
-			pRendererInfo->SrcBounds.Width  = pDxgiOutputDuplDesc->ModeDesc.Height;
-			pRendererInfo->SrcBounds.Height = pDxgiOutputDuplDesc->ModeDesc.Width;
-			break;
-		default: // OR DXGI_MODE_ROTATION_IDENTITY:
-			pRendererInfo->RotationDegrees  = 0.0f;
-			pRendererInfo->SrcBounds.X      = 0;
-			pRendererInfo->SrcBounds.Y      = 0;
-			pRendererInfo->SrcBounds.Width  = pDxgiOutputDuplDesc->ModeDesc.Width;
-			pRendererInfo->SrcBounds.Height = pDxgiOutputDuplDesc->ModeDesc.Height;
-			break;
-		}
-
-		// force rotate
-		switch (pRendererInfo->RotationMode)
-		{
-		case tagFrameRotationMode::tagFrameRotationMode_Identity:
-			pRendererInfo->RotationDegrees = 0.0f;
-			break;
-		case tagFrameRotationMode::tagFrameRotationMode_90:
-			pRendererInfo->RotationDegrees = 90.0f;
-			break;
-		case tagFrameRotationMode::tagFrameRotationMode_180:
-			pRendererInfo->RotationDegrees = 180.0f;
-			break;
-		case tagFrameRotationMode::tagFrameRotationMode_270:
-			pRendererInfo->RotationDegrees = 270.0f;
-			break;
-		default: // tagFrameRotationMode::tagFrameRotationMode_Auto
-			break;
-		}
-
-		if (pRendererInfo->SizeMode == tagFrameSizeMode_Zoom)
-		{
-			FLOAT fSrcAspect, fOutAspect, fScaleFactor;
-
-			// center for output
-			pRendererInfo->DstBounds.Width  = pRendererInfo->SrcBounds.Width;
-			pRendererInfo->DstBounds.Height = pRendererInfo->SrcBounds.Height;
-			pRendererInfo->DstBounds.X      = (pRendererInfo->OutputSize.Width  - pRendererInfo->SrcBounds.Width) >> 1;
-			pRendererInfo->DstBounds.Y      = (pRendererInfo->OutputSize.Height - pRendererInfo->SrcBounds.Height) >> 1;
-
-			fOutAspect = (FLOAT)pRendererInfo->OutputSize.Width / pRendererInfo->OutputSize.Height;
-
-			if ((pRendererInfo->RotationDegrees == 0.0f) || (pRendererInfo->RotationDegrees == 180.0f))
-			{
-				fSrcAspect = (FLOAT)pRendererInfo->SrcBounds.Width / pRendererInfo->SrcBounds.Height;
-
-				if (fSrcAspect > fOutAspect)
-				{
-					fScaleFactor = (FLOAT)pRendererInfo->OutputSize.Width / pRendererInfo->SrcBounds.Width;
-				}
-				else
-				{
-					fScaleFactor = (FLOAT)pRendererInfo->OutputSize.Height / pRendererInfo->SrcBounds.Height;
-				}
-			}
-			else // 90 or 270 degree
-			{
-				fSrcAspect = (FLOAT)pRendererInfo->SrcBounds.Height / pRendererInfo->SrcBounds.Width;
-
-				if (fSrcAspect > fOutAspect)
-				{
-					fScaleFactor = (FLOAT)pRendererInfo->OutputSize.Width / pRendererInfo->SrcBounds.Height;
-				}
-				else
-				{
-					fScaleFactor = (FLOAT)pRendererInfo->OutputSize.Height / pRendererInfo->SrcBounds.Width;
-				}
-			}
-
-			pRendererInfo->ScaleX = fScaleFactor;
-			pRendererInfo->ScaleY = fScaleFactor;
-		}
-		else if (pRendererInfo->SizeMode == tagFrameSizeMode_CenterImage)
-		{
-			// center for output
-			pRendererInfo->DstBounds.Width  = pRendererInfo->SrcBounds.Width;
-			pRendererInfo->DstBounds.Height = pRendererInfo->SrcBounds.Height;
-			pRendererInfo->DstBounds.X      = (pRendererInfo->OutputSize.Width  - pRendererInfo->SrcBounds.Width) >> 1;
-			pRendererInfo->DstBounds.Y      = (pRendererInfo->OutputSize.Height - pRendererInfo->SrcBounds.Height) >> 1;
-		}
-		else if (pRendererInfo->SizeMode == tagFrameSizeMode_AutoSize)
-		{
-			// set the destination bounds
-			pRendererInfo->DstBounds.Width  = pRendererInfo->SrcBounds.Width;
-			pRendererInfo->DstBounds.Height = pRendererInfo->SrcBounds.Height;
-
-			if ((pRendererInfo->RotationDegrees == 0.0f) || (pRendererInfo->RotationDegrees == 180.0f))
-			{
-				// same as the source size
-				pRendererInfo->OutputSize.Width  = pRendererInfo->SrcBounds.Width;
-				pRendererInfo->OutputSize.Height = pRendererInfo->SrcBounds.Height;
-			}
-			else // 90 or 270 degree
-			{
-				// same as the source size
-				pRendererInfo->OutputSize.Width  = pRendererInfo->SrcBounds.Height;
-				pRendererInfo->OutputSize.Height = pRendererInfo->SrcBounds.Width;
-
-				// center for output
-				pRendererInfo->DstBounds.X = (pRendererInfo->OutputSize.Width - pRendererInfo->SrcBounds.Width) >> 1;
-				pRendererInfo->DstBounds.Y = (pRendererInfo->OutputSize.Height - pRendererInfo->SrcBounds.Height) >> 1;
-			}
-		}
-		else if (pRendererInfo->SizeMode == tagFrameSizeMode_StretchImage)
-		{
-			// center for output
-			pRendererInfo->DstBounds.Width  = pRendererInfo->SrcBounds.Width;
-			pRendererInfo->DstBounds.Height = pRendererInfo->SrcBounds.Height;
-			pRendererInfo->DstBounds.X      = (pRendererInfo->OutputSize.Width - pRendererInfo->SrcBounds.Width) >> 1;
-			pRendererInfo->DstBounds.Y      = (pRendererInfo->OutputSize.Height - pRendererInfo->SrcBounds.Height) >> 1;
-			
-			if ((pRendererInfo->RotationDegrees == 0.0f) || (pRendererInfo->RotationDegrees == 180.0f))
-			{
-				pRendererInfo->ScaleX = (FLOAT)pRendererInfo->OutputSize.Width / pRendererInfo->DstBounds.Width;
-				pRendererInfo->ScaleY = (FLOAT)pRendererInfo->OutputSize.Height / pRendererInfo->DstBounds.Height;
-			}
-			else // 90 or 270 degree
-			{
-				pRendererInfo->ScaleX = (FLOAT)pRendererInfo->OutputSize.Width / pRendererInfo->DstBounds.Height;
-				pRendererInfo->ScaleY = (FLOAT)pRendererInfo->OutputSize.Height / pRendererInfo->DstBounds.Width;
-			}
-		}
-		else // tagFrameSizeMode_Normal
-		{
-			pRendererInfo->DstBounds.Width  = pRendererInfo->SrcBounds.Width;
-			pRendererInfo->DstBounds.Height = pRendererInfo->SrcBounds.Height;
+		tagFrameGeometry geometry;
+		GetFrameGeometry(pRendererInfo, &geometry);
+
+		// a region is rendered like a desktop of its size, the copy texture holds only the region
+		tagFrameRect rcCopy;
+		HRESULT hr = DXGICaptureRegion::CalculateCopyGeometry(
+			&pRendererInfo->Region,
+			(INT)pDxgiOutputDuplDesc->ModeDesc.Width,
+			(INT)pDxgiOutputDuplDesc->ModeDesc.Height,
+			DXGICaptureHelper::GetDisplayRotationDegrees(pDxgiOutputDuplDesc->Rotation),
+			&geometry,
+			&rcCopy);
+		CHECK_HR_RETURN(hr);
 
-			if (pRendererInfo->RotationDegrees == 90)
-			{
-				// set destination origin (bottom-left)
-				pRendererInfo->DstBounds.X = (pRendererInfo->OutputSize.Width - pRendererInfo->OutputSize.Height) >> 1;
-				pRendererInfo->DstBounds.Y = ((pRendererInfo->OutputSize.Width + pRendererInfo->OutputSize.Height) >> 1) - pRendererInfo->DstBounds.Height;
-			}
-			else if (pRendererInfo->RotationDegrees == 180.0f)
-			{
-				// set destination origin (bottom-right)
-				pRendererInfo->DstBounds.X = pRendererInfo->OutputSize.Width - pRendererInfo->DstBounds.Width;
-				pRendererInfo->DstBounds.Y = pRendererInfo->OutputSize.Height - pRendererInfo->DstBounds.Height;
-			}
-			else if (pRendererInfo->RotationDegrees == 270)
-			{
-				// set destination origin (top-right)
-				pRendererInfo->DstBounds.Y = (pRendererInfo->OutputSize.Height - pRendererInfo->OutputSize.Width) >> 1;
-				pRendererInfo->DstBounds.X = pRendererInfo->OutputSize.Width - pRendererInfo->DstBounds.Width - ((pRendererInfo->OutputSize.Width - pRendererInfo->OutputSize.Height) >> 1);
-			}
-		}
+		pRendererInfo->SrcFormat       = pDxgiOutputDuplDesc->ModeDesc.Format;
+		pRendererInfo->OutputSize      = geometry.OutputSize;
+		pRendererInfo->RotationDegrees = geometry.RotationDegrees;
+		pRendererInfo->ScaleX          = geometry.ScaleX;
+		pRendererInfo->ScaleY          = geometry.ScaleY;
+		pRendererInfo->SrcBounds       = geometry.SrcBounds;
+		pRendererInfo->DstBounds       = geometry.DstBounds;
+		pRendererInfo->CopyBounds.X      = rcCopy.Left;
+		pRendererInfo->CopyBounds.Y      = rcCopy.Top;
+		pRendererInfo->CopyBounds.Width  = rcCopy.Right - rcCopy.Left;
+		pRendererInfo->CopyBounds.Height = rcCopy.Bottom - rcCopy.Top;
 
 		return S_OK;
-	}
+	} // CalculateRendererInfo
 
 	static
 	COM_DECLSPEC_NOTHROW
@@ -328,27 +220,7 @@ public:
 		_In_ UINT uiNewSize
 		)
 	{
-		CHECK_POINTER(pBufferInfo);
-
-		if (uiNewSize <= pBufferInfo->BufferSize)
-		{
-			return S_FALSE; // no change
-		}
-
-		if (nullptr != pBufferInfo->Buffer) {
-			delete[] pBufferInfo->Buffer;
-			pBufferInfo->Buffer = nullptr;
-		}
-
-		pBufferInfo->Buffer = new (std::nothrow) BYTE[uiNewSize];
-		if (!(pBufferInfo->Buffer))
-		{
-			pBufferInfo->BufferSize = 0;
-			return E_OUTOFMEMORY;
-		}
-		pBufferInfo->BufferSize = uiNewSize;
-
-		return S_OK;
+		return DXGICaptureFrameBuffer::Resize(pBufferInfo, uiNewSize);
 	} // ResizeFrameBuffer
 
 	static
@@ -423,6 +295,7 @@ public:
 
 			// Update buffer size
 			PtrInfo->ShapeBufferSize = FrameInfo->PointerShapeBufferSize;
+			DXGICaptureAllocations::Add(FrameInfo->PointerShapeBufferSize);
 		}
 
 		// Get shape
@@ -438,216 +311,192 @@ public:
 			delete[] PtrInfo->PtrShapeBuffer;
 			PtrInfo->PtrShapeBuffer = nullptr;
 			PtrInfo->ShapeBufferSize = 0;
+			PtrInfo->ShapeHash = 0;
 			return hr;
 		}
 
+		// key of the processed shape in the cursor cache
+		PtrInfo->ShapeHash = CDXGICursorCache::HashBytes(PtrInfo->PtrShapeBuffer, FrameInfo->PointerShapeBufferSize, 0);
+
 		return S_OK;
 	} // GetMouse
 
+	//
+	// Returns the rotation of the display in degrees (0, 90, 180, 270)
+	//
 	static
-	COM_DECLSPEC_NOTHROW
 	inline
-	HRESULT 
-	ProcessMouseMask(
-		_In_ const tagMouseInfo *PtrInfo,
-		_In_ const DXGI_OUTPUT_DESC *DesktopDesc,
-		_Inout_ tagFrameBufferInfo *pBufferInfo
+	INT
+	GetDisplayRotationDegrees(
+		_In_ DXGI_MODE_ROTATION Rotation
 		)
 	{
-		CHECK_POINTER_EX(PtrInfo, E_INVALIDARG);
-		CHECK_POINTER_EX(DesktopDesc, E_INVALIDARG);
-		CHECK_POINTER_EX(pBufferInfo, E_INVALIDARG);
-
-		if (!PtrInfo->Visible) {
-			return S_FALSE;
-		}
-
-		HRESULT hr = S_OK;
-		INT DesktopWidth  = (INT)(DesktopDesc->DesktopCoordinates.right - DesktopDesc->DesktopCoordinates.left);
-		INT DesktopHeight = (INT)(DesktopDesc->DesktopCoordinates.bottom - DesktopDesc->DesktopCoordinates.top);
-
-		pBufferInfo->Bounds.X      = PtrInfo->Position.x;
-		pBufferInfo->Bounds.Y      = PtrInfo->Position.y;
-		pBufferInfo->Bounds.Width  = PtrInfo->ShapeInfo.Width;
-		pBufferInfo->Bounds.Height = (PtrInfo->ShapeInfo.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME)
-			? (INT)(PtrInfo->ShapeInfo.Height / 2)
-			: (INT)PtrInfo->ShapeInfo.Height;
-		pBufferInfo->Pitch         = pBufferInfo->Bounds.Width * 4;
-
-		switch (PtrInfo->ShapeInfo.Type)
-		{
-		case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR:
+		switch (Rotation)
 		{
-			// Resize mouseshape buffer (if necessary)
-			hr = DXGICaptureHelper::ResizeFrameBuffer(pBufferInfo, PtrInfo->ShapeBufferSize);
-			if (FAILED(hr)) {
-				return hr;
-			}
-
-			// use current mouseshape buffer
-			// Copy mouseshape buffer
-			memcpy_s((void*)pBufferInfo->Buffer, pBufferInfo->BufferSize, (const void*)PtrInfo->PtrShapeBuffer, PtrInfo->ShapeBufferSize);
-			break;
+		case DXGI_MODE_ROTATION_ROTATE90:
+			return 90;
+		case DXGI_MODE_ROTATION_ROTATE180:
+			return 180;
+		case DXGI_MODE_ROTATION_ROTATE270:
+			return 270;
+		default:
+			return 0;
 		}
+	} // GetDisplayRotationDegrees
 
-		case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME:
-		{
-			// Resize mouseshape buffer (if necessary)
-			hr = DXGICaptureHelper::ResizeFrameBuffer(pBufferInfo, pBufferInfo->Bounds.Height * pBufferInfo->Pitch);
-			if (FAILED(hr)) {
-				return hr;
-			}
-
-			UINT* InitBuffer32 = reinterpret_cast<UINT*>(pBufferInfo->Buffer);
-
-			for (INT Row = 0; Row < pBufferInfo->Bounds.Height; ++Row)
-			{
-				// Set mask
-				BYTE Mask = 0x80;
-				for (INT Col = 0; Col < pBufferInfo->Bounds.Width; ++Col)
-				{
-					BYTE XorMask = PtrInfo->PtrShapeBuffer[(Col / 8) + ((Row + (PtrInfo->ShapeInfo.Height / 2)) * (PtrInfo->ShapeInfo.Pitch))] & Mask;
-
-					// Set new pixel
-					InitBuffer32[(Row * pBufferInfo->Bounds.Width) + Col] = (XorMask) ? 0xFFFFFFFF : 0x00000000;
-
-					// Adjust mask
-					if (Mask == 0x01)
-					{
-						Mask = 0x80;
-					}
-					else
-					{
-						Mask = Mask >> 1;
-					}
-				}
-			}
-
-			break;
-		}
+	//
+	// Returns the clockwise rotation (in degrees) that brings the mouse shape to the desktop image orientation
+	//
+	static
+	inline
+	INT
+	GetMouseRotateDegrees(
+		_In_ DXGI_MODE_ROTATION Rotation
+		)
+	{
+		return DXGICapturePointer::GetRotateDegrees(GetDisplayRotationDegrees(Rotation));
+	} // GetMouseRotateDegrees
 
-		case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR:
-		{
-			// Resize mouseshape buffer (if necessary)
-			hr = DXGICaptureHelper::ResizeFrameBuffer(pBufferInfo, pBufferInfo->Bounds.Height * pBufferInfo->Pitch);
-			if (FAILED(hr)) {
-				return hr;
-			}
+	//
+	// Fills the source independent pointer state from the duplication mouse info
+	//
+	static
+	inline
+	void
+	GetCapturePointer(
+		_In_ const tagMouseInfo *PtrInfo,
+		_Out_ tagCapturePointer *pPointer
+		)
+	{
+		pPointer->Visible   = PtrInfo->Visible ? TRUE : FALSE;
+		pPointer->X         = PtrInfo->Position.x;
+		pPointer->Y         = PtrInfo->Position.y;
+		pPointer->Type      = PtrInfo->ShapeInfo.Type;
+		pPointer->Width     = PtrInfo->ShapeInfo.Width;
+		pPointer->Height    = PtrInfo->ShapeInfo.Height;
+		pPointer->Pitch     = PtrInfo->ShapeInfo.Pitch;
+		pPointer->ShapeSize = PtrInfo->ShapeBufferSize;
+		pPointer->Shape     = PtrInfo->PtrShapeBuffer;
+		pPointer->ShapeHash = PtrInfo->ShapeHash;
+	} // GetCapturePointer
 
-			UINT* InitBuffer32 = reinterpret_cast<UINT*>(pBufferInfo->Buffer);
-			UINT* ShapeBuffer32 = reinterpret_cast<UINT*>(PtrInfo->PtrShapeBuffer);
+	//
+	// Expands and rotates the mouse shape, the bounds of the result are in mouse shape coordinates
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT 
+	ProcessMouseShape(
+		_In_ const tagMouseInfo *PtrInfo,
+		_In_ INT nRotateDegrees,
+		_Inout_ tagFrameBufferInfo *pBufferInfo,
+		_Inout_ tagFrameBufferInfo *pRotateBuffer
+		)
+	{
+		CHECK_POINTER_EX(PtrInfo, E_INVALIDARG);
 
-			for (INT Row = 0; Row < pBufferInfo->Bounds.Height; ++Row)
-			{
-				for (INT Col = 0; Col < pBufferInfo->Bounds.Width; ++Col)
-				{
-					InitBuffer32[(Row * pBufferInfo->Bounds.Width) + Col] = ShapeBuffer32[Col + (Row * (PtrInfo->ShapeInfo.Pitch / sizeof(UINT)))] | 0xFF000000;
-				}
-			}
+		tagCapturePointer Pointer;
+		DXGICaptureHelper::GetCapturePointer(PtrInfo, &Pointer);
+		return DXGICapturePointer::ProcessShape(&Pointer, nRotateDegrees, pBufferInfo, pRotateBuffer);
+	} // ProcessMouseShape
 
-			break;
-		}
+	//
+	// Gets the processed mouse shape from the cache (processes it on a miss) and
+	// translates its position to the desktop image.
+	// pMouseShape only refers to the cached buffer, it is valid until the next cache insert.
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT 
+	ProcessMouseMask(
+		_In_ const tagMouseInfo *PtrInfo,
+		_In_ const DXGI_OUTPUT_DESC *DesktopDesc,
+		_Inout_ CDXGICursorCache *pCursorCache,
+		_Inout_ tagFrameBufferInfo *pRotateBuffer,
+		_Out_ tagFrameBufferInfo *pMouseShape
+		)
+	{
+		CHECK_POINTER_EX(PtrInfo, E_INVALIDARG);
+		CHECK_POINTER_EX(DesktopDesc, E_INVALIDARG);
 
-		default:
-			return E_INVALIDARG;
+		tagCapturePointer Pointer;
+		DXGICaptureHelper::GetCapturePointer(PtrInfo, &Pointer);
+		return DXGICapturePointer::ProcessMask(
+			&Pointer,
+			(INT)(DesktopDesc->DesktopCoordinates.right - DesktopDesc->DesktopCoordinates.left),
+			(INT)(DesktopDesc->DesktopCoordinates.bottom - DesktopDesc->DesktopCoordinates.top),
+			DXGICaptureHelper::GetDisplayRotationDegrees(DesktopDesc->Rotation),
+			pCursorCache,
+			pRotateBuffer,
+			pMouseShape);
+	} // ProcessMouseMask
 
+	//
+	// The pointer and desktop of the captured region: the position relative to the
+	// region, the desktop coordinates of its size (unchanged without a region)
+	//
+	static
+	inline
+	void
+	GetRegionMouse(
+		_In_ const tagRendererInfo *pRendererInfo,
+		_In_ const DXGI_OUTPUT_DESC *pDesktopDesc,
+		_Inout_ tagMouseInfo *pMouseInfo,
+		_Out_ DXGI_OUTPUT_DESC *pRegionDesc
+		)
+	{
+		*pRegionDesc = *pDesktopDesc;
+		if ((pRendererInfo->Region.Width <= 0) || (pRendererInfo->Region.Height <= 0)) {
+			return;
 		}
 
-		UINT* InitBuffer32 = reinterpret_cast<UINT*>(pBufferInfo->Buffer);
-		UINT width  = (UINT)pBufferInfo->Bounds.Width;
-		UINT height = (UINT)pBufferInfo->Bounds.Height;
+		pMouseInfo->Position.x -= pRendererInfo->Region.X;
+		pMouseInfo->Position.y -= pRendererInfo->Region.Y;
+		pRegionDesc->DesktopCoordinates.left   = 0;
+		pRegionDesc->DesktopCoordinates.top    = 0;
+		pRegionDesc->DesktopCoordinates.right  = pRendererInfo->Region.Width;
+		pRegionDesc->DesktopCoordinates.bottom = pRendererInfo->Region.Height;
+	} // GetRegionMouse
 
-		switch (DesktopDesc->Rotation)
-		{
-		case DXGI_MODE_ROTATION_ROTATE90:
-		{
-			// Rotate -90 or +270
-			for (UINT i = 0; i < width; i++)
-			{
-				for (UINT j = 0; j < height; j++)
-				{
-					UINT I = j;
-					UINT J = width - 1 - i;
-					while ((i*height + j) >(I*width + J))
-					{
-						UINT p = I*width + J;
-						UINT tmp_i = p / height;
-						UINT tmp_j = p % height;
-						I = tmp_j;
-						J = width - 1 - tmp_i;
-					}
-					std::swap(*(InitBuffer32 + (i*height + j)), *(InitBuffer32 + (I*width + J)));
-				}
-			}
-
-			// translate bounds
-			std::swap(pBufferInfo->Bounds.Width, pBufferInfo->Bounds.Height);
-			INT nX = pBufferInfo->Bounds.Y;
-			INT nY = DesktopWidth - (INT)(pBufferInfo->Bounds.X + pBufferInfo->Bounds.Height);
-			pBufferInfo->Bounds.X = nX;
-			pBufferInfo->Bounds.Y = nY;
-			pBufferInfo->Pitch    = pBufferInfo->Bounds.Width * 4;
-		} break;
-		case DXGI_MODE_ROTATION_ROTATE180:
-		{
-			// Rotate -180 or +180
-			if (height % 2 != 0)
-			{
-				//If N is odd reverse the middle row in the matrix
-				UINT j = height >> 1;
-				for (UINT i = 0; i < (width >> 1); i++)
-				{
-					std::swap(InitBuffer32[j * width + i], InitBuffer32[j * width + width - i - 1]);
-				}
-			}
-
-			for (UINT j = 0; j < (height >> 1); j++)
-			{
-				for (UINT i = 0; i < width; i++)
-				{
-					std::swap(InitBuffer32[j * width + i], InitBuffer32[(height - j - 1) * width + width - i - 1]);
-				}
-			}
-
-			// translate position
-			INT nX = DesktopWidth  - (INT)(pBufferInfo->Bounds.X + pBufferInfo->Bounds.Width);
-			INT nY = DesktopHeight - (INT)(pBufferInfo->Bounds.Y + pBufferInfo->Bounds.Height);
-			pBufferInfo->Bounds.X = nX;
-			pBufferInfo->Bounds.Y = nY;
-		} break;
-		case DXGI_MODE_ROTATION_ROTATE270:
-		{
-			// Rotate -270 or +90
-			for (UINT i = 0; i < width; i++)
-			{
-				for (UINT j = 0; j < height; j++)
-				{
-					UINT I = height - 1 - j;
-					UINT J = i;
-					while ((i*height + j) >(I*width + J))
-					{
-						int p = I*width + J;
-						int tmp_i = p / height;
-						int tmp_j = p % height;
-						I = height - 1 - tmp_j;
-						J = tmp_i;
-					}
-					std::swap(*(InitBuffer32 + (i*height + j)), *(InitBuffer32 + (I*width + J)));
-				}
-			}
-
-			// translate bounds
-			std::swap(pBufferInfo->Bounds.Width, pBufferInfo->Bounds.Height);
-			INT nX = DesktopHeight - (pBufferInfo->Bounds.Y + pBufferInfo->Bounds.Width);
-			INT nY = pBufferInfo->Bounds.X;
-			pBufferInfo->Bounds.X = nX;
-			pBufferInfo->Bounds.Y = nY;
-			pBufferInfo->Pitch    = pBufferInfo->Bounds.Width * 4;
-		} break;
-		}
+	//
+	// Draw mouse provided in buffer to a mapped 32bpp surface
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT 
+	DrawMouseToBuffer(
+		_In_ tagMouseInfo *PtrInfo,
+		_In_ const DXGI_OUTPUT_DESC *DesktopDesc,
+		_Inout_ CDXGICursorCache *pCursorCache,
+		_Inout_ tagFrameBufferInfo *pTempRotateBuffer,
+		_Inout_ BYTE *pSurfBits,
+		_In_ INT SurfPitch,
+		_In_ INT SurfWidth,
+		_In_ INT SurfHeight,
+		_Inout_opt_ tagFrameBufferInfo *pBackground = nullptr
+		)
+	{
+		CHECK_POINTER_EX(PtrInfo, E_INVALIDARG);
+		CHECK_POINTER_EX(DesktopDesc, E_INVALIDARG);
 
-		return S_OK;
-	} // ProcessMouseMask
+		tagCapturePointer Pointer;
+		DXGICaptureHelper::GetCapturePointer(PtrInfo, &Pointer);
+		return DXGICapturePointer::Draw(
+			&Pointer,
+			(INT)(DesktopDesc->DesktopCoordinates.right - DesktopDesc->DesktopCoordinates.left),
+			(INT)(DesktopDesc->DesktopCoordinates.bottom - DesktopDesc->DesktopCoordinates.top),
+			DXGICaptureHelper::GetDisplayRotationDegrees(DesktopDesc->Rotation),
+			pCursorCache,
+			pTempRotateBuffer,
+			pSurfBits,
+			SurfPitch,
+			SurfWidth,
+			SurfHeight,
+			pBackground);
+	} // DrawMouseToBuffer
 
 	//
 	// Draw mouse provided in buffer to backbuffer
@@ -659,13 +508,16 @@ public:
 	DrawMouse(
 		_In_ tagMouseInfo *PtrInfo,
 		_In_ const DXGI_OUTPUT_DESC *DesktopDesc,
-		_Inout_ tagFrameBufferInfo *pTempMouseBuffer,
-		_Inout_ ID3D11Texture2D *pSharedSurf
+		_Inout_ CDXGICursorCache *pCursorCache,
+		_Inout_ tagFrameBufferInfo *pTempRotateBuffer,
+		_Inout_ ID3D11Texture2D *pSharedSurf,
+		_Inout_opt_ tagFrameBufferInfo *pBackground = nullptr
 		)
 	{
 		CHECK_POINTER_EX(PtrInfo, E_INVALIDARG);
 		CHECK_POINTER_EX(DesktopDesc, E_INVALIDARG);
-		CHECK_POINTER_EX(pTempMouseBuffer, E_INVALIDARG);
+		CHECK_POINTER_EX(pCursorCache, E_INVALIDARG);
+		CHECK_POINTER_EX(pTempRotateBuffer, E_INVALIDARG);
 		CHECK_POINTER_EX(pSharedSurf, E_INVALIDARG);
 
 		HRESULT hr = S_OK;
@@ -673,57 +525,6 @@ public:
 		D3D11_TEXTURE2D_DESC FullDesc;
 		pSharedSurf->GetDesc(&FullDesc);
 
-		INT SurfWidth  = FullDesc.Width;
-		INT SurfHeight = FullDesc.Height;
-		INT SurfPitch  = FullDesc.Width * 4;
-
-		hr = DXGICaptureHelper::ProcessMouseMask(PtrInfo, DesktopDesc, pTempMouseBuffer);
-		if (FAILED(hr)) {
-			return hr;
-		}
-
-		// Buffer used if necessary (in case of monochrome or masked pointer)
-		BYTE* InitBuffer = pTempMouseBuffer->Buffer;
-
-		// Clipping adjusted coordinates / dimensions
-		INT PtrWidth  = (INT)pTempMouseBuffer->Bounds.Width;
-		INT PtrHeight = (INT)pTempMouseBuffer->Bounds.Height;
-
-		INT PtrLeft   = (INT)pTempMouseBuffer->Bounds.X;
-		INT PtrTop    = (INT)pTempMouseBuffer->Bounds.Y;
-		INT PtrPitch  = (INT)pTempMouseBuffer->Pitch;
-
-		INT SrcLeft   = 0;
-		INT SrcTop    = 0;
-		INT SrcWidth  = PtrWidth;
-		INT SrcHeight = PtrHeight;
-
-		if (PtrLeft < 0)
-		{
-			// crop mouseshape left
-			SrcLeft = -PtrLeft;
-			// new mouse x position for drawing
-			PtrLeft = 0;
-		}
-		else if (PtrLeft + PtrWidth > SurfWidth)
-		{
-			// crop mouseshape width
-			SrcWidth = SurfWidth - PtrLeft;
-		}
-
-		if (PtrTop < 0)
-		{
-			// crop mouseshape top
-			SrcTop = -PtrTop;
-			// new mouse y position for drawing
-			PtrTop = 0;
-		}
-		else if (PtrTop + PtrHeight > SurfHeight)
-		{
-			// crop mouseshape height
-			SrcHeight = SurfHeight - PtrTop;
-		}
-
 		// QI for IDXGISurface
 		CComPtr<IDXGISurface> ipCopySurface;
 		hr = pSharedSurf->QueryInterface(__uuidof(IDXGISurface), (void **)&ipCopySurface);
@@ -733,47 +534,88 @@ public:
 			hr = ipCopySurface->Map(&MappedSurface, DXGI_MAP_READ | DXGI_MAP_WRITE);
 			if (SUCCEEDED(hr))
 			{
-				// 0xAARRGGBB
-				UINT* SrcBuffer32 = reinterpret_cast<UINT*>(InitBuffer);
-				UINT* DstBuffer32 = reinterpret_cast<UINT*>(MappedSurface.pBits) + PtrTop * SurfWidth + PtrLeft;
-
-				// Alpha blending masks
-				const UINT AMask = 0xFF000000;
-				const UINT RBMask = 0x00FF00FF;
-				const UINT GMask = 0x0000FF00;
-				const UINT AGMask = AMask | GMask;
-				const UINT OneAlpha = 0x01000000;
-				UINT uiPixel1;
-				UINT uiPixel2;
-				UINT uiAlpha;
-				UINT uiNAlpha;
-				UINT uiRedBlue;
-				UINT uiAlphaGreen;
-
-				for (INT Row = SrcTop; Row < SrcHeight; ++Row)
-				{
-					for (INT Col = SrcLeft; Col < SrcWidth; ++Col)
-					{
-						// Alpha blending
-						uiPixel1 = DstBuffer32[((Row - SrcTop) * SurfWidth) + (Col - SrcLeft)];
-						uiPixel2 = SrcBuffer32[(Row * PtrWidth) + Col];
-						uiAlpha = (uiPixel2 & AMask) >> 24;
-						uiNAlpha = 255 - uiAlpha;
-						uiRedBlue = ((uiNAlpha * (uiPixel1 & RBMask)) + (uiAlpha * (uiPixel2 & RBMask))) >> 8;
-						uiAlphaGreen = (uiNAlpha * ((uiPixel1 & AGMask) >> 8)) + (uiAlpha * (OneAlpha | ((uiPixel2 & GMask) >> 8)));
-
-						DstBuffer32[((Row - SrcTop) * SurfWidth) + (Col - SrcLeft)] = ((uiRedBlue & RBMask) | (uiAlphaGreen & AGMask));
-					}
+				hr = DXGICaptureHelper::DrawMouseToBuffer(PtrInfo, DesktopDesc, pCursorCache, pTempRotateBuffer,
+					MappedSurface.pBits, MappedSurface.Pitch, (INT)FullDesc.Width, (INT)FullDesc.Height, pBackground);
+
+				// Done with resource
+				ipCopySurface->Unmap();
+				if (FAILED(hr)) {
+					return hr;
 				}
 			}
-
-			// Done with resource
-			hr = ipCopySurface->Unmap();
 		}
 
 		return S_OK;
 	} // DrawMouse
 
+	//
+	// Gets the move and dirty rects of the acquired frame.
+	// Both lists point into the metadata buffer (move rects first, dirty rects after them).
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT 
+	GetFrameMetadata(
+		_In_ IDXGIOutputDuplication *pOutputDuplication,
+		_In_ const DXGI_OUTDUPL_FRAME_INFO *FrameInfo,
+		_Inout_ tagFrameBufferInfo *pMetadata,
+		_Out_ tagFrameMoveRect **ppMoveRects,
+		_Out_ UINT *pMoveCount,
+		_Out_ tagFrameRect **ppDirtyRects,
+		_Out_ UINT *pDirtyCount
+		)
+	{
+		CHECK_POINTER_EX(pOutputDuplication, E_INVALIDARG);
+		CHECK_POINTER_EX(FrameInfo, E_INVALIDARG);
+		CHECK_POINTER_EX(pMetadata, E_INVALIDARG);
+		CHECK_POINTER(ppMoveRects);
+		CHECK_POINTER(pMoveCount);
+		CHECK_POINTER(ppDirtyRects);
+		CHECK_POINTER(pDirtyCount);
+
+		static_assert(sizeof(tagFrameMoveRect) == sizeof(DXGI_OUTDUPL_MOVE_RECT), "tagFrameMoveRect must match DXGI_OUTDUPL_MOVE_RECT");
+		static_assert(sizeof(tagFrameRect) == sizeof(RECT), "tagFrameRect must match RECT");
+
+		*ppMoveRects  = nullptr;
+		*pMoveCount   = 0;
+		*ppDirtyRects = nullptr;
+		*pDirtyCount  = 0;
+
+		if (FrameInfo->TotalMetadataBufferSize == 0) {
+			return S_OK;
+		}
+
+		// Resize metadata buffer (if necessary)
+		HRESULT hr = DXGICaptureHelper::ResizeFrameBuffer(pMetadata, FrameInfo->TotalMetadataBufferSize);
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		// Get move rects
+		UINT uiMoveBytes = 0;
+		hr = pOutputDuplication->GetFrameMoveRects(
+			pMetadata->BufferSize,
+			reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(pMetadata->Buffer),
+			&uiMoveBytes);
+		CHECK_HR_RETURN(hr);
+
+		// Get dirty rects
+		UINT uiDirtyBytes = 0;
+		hr = pOutputDuplication->GetFrameDirtyRects(
+			pMetadata->BufferSize - uiMoveBytes,
+			reinterpret_cast<RECT*>(pMetadata->Buffer + uiMoveBytes),
+			&uiDirtyBytes);
+		CHECK_HR_RETURN(hr);
+
+		*ppMoveRects  = reinterpret_cast<tagFrameMoveRect*>(pMetadata->Buffer);
+		*pMoveCount   = uiMoveBytes / sizeof(DXGI_OUTDUPL_MOVE_RECT);
+		*ppDirtyRects = reinterpret_cast<tagFrameRect*>(pMetadata->Buffer + uiMoveBytes);
+		*pDirtyCount  = uiDirtyBytes / sizeof(RECT);
+
+		return S_OK;
+	} // GetFrameMetadata
+
 	static
 	COM_DECLSPEC_NOTHROW
 	inline
@@ -829,6 +671,88 @@ public:
 		return S_OK;
 	} // CreateBitmap
 
+	//
+	// Copies the texture pixels into an existing bitmap of the same size
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT 
+	UpdateBitmap(
+		_In_ ID2D1Bitmap *pBitmap,
+		_In_ ID3D11Texture2D *pSourceTexture
+		)
+	{
+		CHECK_POINTER_EX(pBitmap, E_INVALIDARG);
+		CHECK_POINTER_EX(pSourceTexture, E_INVALIDARG);
+
+		HRESULT                  hr = S_OK;
+		CComPtr<ID3D11Texture2D> ipSourceTexture(pSourceTexture);
+		CComPtr<IDXGISurface>    ipCopySurface;
+
+		// QI for IDXGISurface
+		hr = ipSourceTexture->QueryInterface(__uuidof(IDXGISurface), (void **)&ipCopySurface);
+		CHECK_HR_RETURN(hr);
+
+		// Map pixels
+		DXGI_MAPPED_RECT MappedSurface;
+		hr = ipCopySurface->Map(&MappedSurface, DXGI_MAP_READ);
+		CHECK_HR_RETURN(hr);
+
+		hr = pBitmap->CopyFromMemory(NULL, (const void*)MappedSurface.pBits, MappedSurface.Pitch);
+		if (FAILED(hr))
+		{
+			// Done with resource
+			ipCopySurface->Unmap();
+			return hr;
+		}
+
+		// Done with resource
+		hr = ipCopySurface->Unmap();
+		CHECK_HR_RETURN(hr);
+
+		return S_OK;
+	} // UpdateBitmap
+
+	//
+	// Copies the pixels of a 32bpp WIC bitmap into a buffer (added to pStats)
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT 
+	CopyBitmapToBuffer(
+		_In_ IWICBitmap *pBitmap,
+		_Out_writes_bytes_(nDstPitch * nHeight) BYTE *pDst,
+		_In_ INT nDstPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_Inout_opt_ tagFrameCopyStats *pStats = nullptr
+		)
+	{
+		CHECK_POINTER_EX(pBitmap, E_INVALIDARG);
+		CHECK_POINTER_EX(pDst, E_INVALIDARG);
+
+		HRESULT                   hr = S_OK;
+		CComPtr<IWICBitmapLock>   ipLock;
+		WICRect                   rcLock = { 0, 0, nWidth, nHeight };
+		UINT                      uiStride = 0;
+		UINT                      uiSize = 0;
+		BYTE*                     pSrc = nullptr;
+
+		hr = pBitmap->Lock(&rcLock, WICBitmapLockRead, &ipLock);
+		CHECK_HR_RETURN(hr);
+
+		hr = ipLock->GetStride(&uiStride);
+		CHECK_HR_RETURN(hr);
+
+		hr = ipLock->GetDataPointer(&uiSize, &pSrc);
+		CHECK_HR_RETURN(hr);
+
+		DXGICaptureCopy::CopyPixels(pSrc, (INT)uiStride, pDst, nDstPitch, nWidth, nHeight, FALSE, tagSimdLevel_Auto, pStats);
+		return S_OK;
+	} // CopyBitmapToBuffer
+
 	static
 	inline
 	COM_DECLSPEC_NOTHROW
@@ -868,6 +792,10 @@ public:
 		{
 			RESET_POINTER_EX(pRetVal, GUID_ContainerFormatJpeg);
 		}
+		else if (lstrcmpiW(lpcwExtension, L".qoi") == 0)
+		{
+			RESET_POINTER_EX(pRetVal, GUID_ContainerFormatQoi);
+		}
 		else
 		{
 			return ERROR_MRM_INVALID_FILE_TYPE;
@@ -877,47 +805,37 @@ public:
 	}
 
 
+	//
+	// Encodes the image into the stream with the encoder of the container format
+	//
 	static
 	COM_DECLSPEC_NOTHROW
 	inline
 	HRESULT
-	SaveImageToFile(
+	EncodeImageToStream(
 		_In_ IWICImagingFactory *pWICImagingFactory,
 		_In_ IWICBitmapSource *pWICBitmapSource,
-		_In_ LPCWSTR lpcwFileName
+		_In_ REFGUID guidContainerFormat,
+		_In_ IStream *pStream
 		)
 	{
 		CHECK_POINTER_EX(pWICImagingFactory, E_INVALIDARG);
 		CHECK_POINTER_EX(pWICBitmapSource, E_INVALIDARG);
+		CHECK_POINTER_EX(pStream, E_INVALIDARG);
 
 		HRESULT hr = S_OK;
-		GUID guidContainerFormat;
-
-		hr = GetContainerFormatByFileName(lpcwFileName, &guidContainerFormat);
-		if (FAILED(hr)) {
-			return hr;
-		}
-
 		WICPixelFormatGUID format = GUID_WICPixelFormatDontCare;
 		CComPtr<IWICImagingFactory> ipWICImagingFactory(pWICImagingFactory);
 		CComPtr<IWICBitmapSource> ipWICBitmapSource(pWICBitmapSource);
-		CComPtr<IWICStream> ipStream;
 		CComPtr<IWICBitmapEncoder> ipEncoder;
 		CComPtr<IWICBitmapFrameEncode> ipFrameEncode;
 		unsigned int uiWidth = 0;
 		unsigned int uiHeight = 0;
 
-		hr = ipWICImagingFactory->CreateStream(&ipStream);
-		if (SUCCEEDED(hr)) {
-			hr = ipStream->InitializeFromFilename(lpcwFileName, GENERIC_WRITE);
-		}
-
-		if (SUCCEEDED(hr)) {
-			hr = ipWICImagingFactory->CreateEncoder(guidContainerFormat, NULL, &ipEncoder);
-		}
+		hr = ipWICImagingFactory->CreateEncoder(guidContainerFormat, NULL, &ipEncoder);
 		if (SUCCEEDED(hr))
 		{
-			hr = ipEncoder->Initialize(ipStream, WICBitmapEncoderNoCache);
+			hr = ipEncoder->Initialize(pStream, WICBitmapEncoderNoCache);
 		}
 		if (SUCCEEDED(hr))
 		{
@@ -952,9 +870,204 @@ public:
 			hr = ipEncoder->Commit();
 		}
 
+		return hr;
+	} // EncodeImageToStream
+
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT
+	SaveImageToFile(
+		_In_ IWICImagingFactory *pWICImagingFactory,
+		_In_ IWICBitmapSource *pWICBitmapSource,
+		_In_ LPCWSTR lpcwFileName
+		)
+	{
+		CHECK_POINTER_EX(pWICImagingFactory, E_INVALIDARG);
+		CHECK_POINTER_EX(pWICBitmapSource, E_INVALIDARG);
+
+		HRESULT hr = S_OK;
+		GUID guidContainerFormat;
+
+		hr = GetContainerFormatByFileName(lpcwFileName, &guidContainerFormat);
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		CComPtr<IWICStream> ipStream;
+
+		hr = pWICImagingFactory->CreateStream(&ipStream);
+		if (SUCCEEDED(hr)) {
+			hr = ipStream->InitializeFromFilename(lpcwFileName, GENERIC_WRITE);
+		}
+
+		if (SUCCEEDED(hr)) {
+			hr = EncodeImageToStream(pWICImagingFactory, pWICBitmapSource, guidContainerFormat, ipStream);
+		}
+
 		return hr;
 	} // SaveImageToFile
 
+	//
+	// Saves a 32bpp BGRA buffer (e.g. a captured frame) to file
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT
+	SaveBufferToFile(
+		_In_ IWICImagingFactory *pWICImagingFactory,
+		_In_reads_bytes_(nPitch * nHeight) const BYTE *pBuffer,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ INT nPitch,
+		_In_ LPCWSTR lpcwFileName
+		)
+	{
+		CHECK_POINTER_EX(pWICImagingFactory, E_INVALIDARG);
+		CHECK_POINTER_EX(pBuffer, E_INVALIDARG);
+
+		HRESULT hr = S_OK;
+		CComPtr<IWICBitmap> ipWICBitmap;
+
+		hr = pWICImagingFactory->CreateBitmapFromMemory(
+			(UINT)nWidth,
+			(UINT)nHeight,
+			GUID_WICPixelFormat32bppPBGRA,
+			(UINT)nPitch,
+			(UINT)(nPitch * nHeight),
+			const_cast<BYTE*>(pBuffer),
+			&ipWICBitmap);
+		CHECK_HR_RETURN(hr);
+
+		return SaveImageToFile(pWICImagingFactory, ipWICBitmap, lpcwFileName);
+	} // SaveBufferToFile
+
+	//
+	// Encodes a 32bpp BGRA buffer into pOutput (grown as needed), *pRetSize receives the encoded size
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT
+	EncodeBufferToMemory(
+		_In_ IWICImagingFactory *pWICImagingFactory,
+		_In_reads_bytes_(nPitch * nHeight) const BYTE *pBuffer,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ INT nPitch,
+		_In_ REFGUID guidContainerFormat,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize
+		)
+	{
+		CHECK_POINTER(pRetSize);
+		*pRetSize = 0;
+		CHECK_POINTER_EX(pWICImagingFactory, E_INVALIDARG);
+		CHECK_POINTER_EX(pBuffer, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutput, E_INVALIDARG);
+
+		HRESULT hr = S_OK;
+		CComPtr<IWICBitmap> ipWICBitmap;
+		CComPtr<IStream> ipMemoryStream;
+
+		hr = pWICImagingFactory->CreateBitmapFromMemory(
+			(UINT)nWidth,
+			(UINT)nHeight,
+			GUID_WICPixelFormat32bppPBGRA,
+			(UINT)nPitch,
+			(UINT)(nPitch * nHeight),
+			const_cast<BYTE*>(pBuffer),
+			&ipWICBitmap);
+		CHECK_HR_RETURN(hr);
+
+		hr = CreateStreamOnHGlobal(NULL, TRUE, &ipMemoryStream);
+		CHECK_HR_RETURN(hr);
+
+		hr = EncodeImageToStream(pWICImagingFactory, ipWICBitmap, guidContainerFormat, ipMemoryStream);
+		CHECK_HR_RETURN(hr);
+
+		HGLOBAL hMemory = NULL;
+		STATSTG statstg;
+		hr = ipMemoryStream->Stat(&statstg, STATFLAG_NONAME);
+		CHECK_HR_RETURN(hr);
+		hr = GetHGlobalFromStream(ipMemoryStream, &hMemory);
+		CHECK_HR_RETURN(hr);
+
+		UINT uiSize = (UINT)statstg.cbSize.QuadPart;
+		hr = DXGICaptureFrameBuffer::Resize(pOutput, uiSize);
+		CHECK_HR_RETURN(hr);
+
+		const void *pData = GlobalLock(hMemory);
+		CHECK_POINTER_EX(pData, HRESULT_FROM_WIN32(GetLastError()));
+		memcpy(pOutput->Buffer, pData, uiSize);
+		GlobalUnlock(hMemory);
+
+		*pRetSize = uiSize;
+		return S_OK;
+	} // EncodeBufferToMemory
+
+	//
+	// Strip encoder format of the container format, E_INVALIDARG if there is none (bmp)
+	//
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT
+	GetStripImageFormat(
+		_In_ REFGUID guidContainerFormat,
+		_Out_ tagStripImageFormat *pRetVal
+		)
+	{
+		CHECK_POINTER(pRetVal);
+
+		if (IsEqualGUID(guidContainerFormat, GUID_ContainerFormatPng)) {
+			*pRetVal = tagStripImageFormat_Png;
+		}
+		else if (IsEqualGUID(guidContainerFormat, GUID_ContainerFormatJpeg)) {
+			*pRetVal = tagStripImageFormat_Jpeg;
+		}
+		else if (IsEqualGUID(guidContainerFormat, GUID_ContainerFormatTiff)) {
+			*pRetVal = tagStripImageFormat_Tiff;
+		}
+		else {
+			return E_INVALIDARG;
+		}
+
+		return S_OK;
+	} // GetStripImageFormat
+
+	static
+	COM_DECLSPEC_NOTHROW
+	inline
+	HRESULT
+	SaveMemoryToFile(
+		_In_ LPCWSTR lpcwFileName,
+		_In_reads_bytes_(uiSize) const BYTE *pData,
+		_In_ UINT uiSize
+		)
+	{
+		CHECK_POINTER_EX(lpcwFileName, E_INVALIDARG);
+		CHECK_POINTER_EX(pData, E_INVALIDARG);
+
+		HANDLE hFile = CreateFileW(lpcwFileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (INVALID_HANDLE_VALUE == hFile) {
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+
+		HRESULT hr = S_OK;
+		DWORD dwWritten = 0;
+		if (!WriteFile(hFile, pData, uiSize, &dwWritten, NULL)) {
+			hr = HRESULT_FROM_WIN32(GetLastError());
+		}
+		else if (dwWritten != uiSize) {
+			hr = HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+		}
+		CloseHandle(hFile);
+
+		return hr;
+	} // SaveMemoryToFile
+
 }; // end class DXGICaptureHelper
 
 #endif // __DXGICAPTUREHELPER_H__
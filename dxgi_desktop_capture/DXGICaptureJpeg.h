@@ -0,0 +1,549 @@
+/*****************************************************************************
+* DXGICaptureJpeg.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREJPEG_H__
+#define __DXGICAPTUREJPEG_H__
+
+#include "DXGICapturePlatform.h"
+
+#include <string.h>
+
+#include <vector>
+
+#define DXGICAPTURE_JPEG_DEFAULT_QUALITY    90
+
+//
+// struct tagJpegHuffmanTable_s
+//
+typedef struct tagJpegHuffmanTable_s
+{
+	USHORT Code[256];
+	BYTE   Size[256];
+} tagJpegHuffmanTable;
+
+//
+// struct tagJpegTables_s
+//
+typedef struct tagJpegTables_s
+{
+	BYTE                QuantY[64]; /* zigzag order, as written to DQT */
+	BYTE                QuantC[64];
+	float               ScaleY[64]; /* natural order, AAN descale and quantization */
+	float               ScaleC[64];
+	tagJpegHuffmanTable DcY;
+	tagJpegHuffmanTable AcY;
+	tagJpegHuffmanTable DcC;
+	tagJpegHuffmanTable AcC;
+} tagJpegTables;
+
+//
+// class DXGICaptureJpeg
+//
+// Baseline JPEG (4:2:0, Annex K tables) of 32bpp BGRA buffers. The scan is
+// split into restart intervals of whole MCU rows; each interval starts with
+// zeroed DC predictors, so the intervals are entropy coded independently
+// (on any thread) and joined with RSTn markers.
+//
+class DXGICaptureJpeg
+{
+private:
+	static
+	inline
+	const BYTE*
+	zigzag()
+	{
+		static const BYTE s_natural[64] = {
+			 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+			12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+			35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+			58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+		};
+		return s_natural;
+	} // zigzag
+
+	static const BYTE* dcBitsY() { static const BYTE s[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 }; return s; }
+	static const BYTE* dcBitsC() { static const BYTE s[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 }; return s; }
+	static const BYTE* acBitsY() { static const BYTE s[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d }; return s; }
+	static const BYTE* acBitsC() { static const BYTE s[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 }; return s; }
+
+	static
+	inline
+	const BYTE*
+	dcValues()
+	{
+		static const BYTE s[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+		return s;
+	} // dcValues
+
+	static
+	inline
+	const BYTE*
+	acValuesY()
+	{
+		static const BYTE s[162] = {
+			0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+			0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+			0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+			0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+			0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+			0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+			0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+			0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+			0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+			0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+			0xf9, 0xfa,
+		};
+		return s;
+	} // acValuesY
+
+	static
+	inline
+	const BYTE*
+	acValuesC()
+	{
+		static const BYTE s[162] = {
+			0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+			0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+			0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+			0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+			0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+			0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+			0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+			0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+			0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+			0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+			0xf9, 0xfa,
+		};
+		return s;
+	} // acValuesC
+
+	static
+	inline
+	void
+	buildHuffman(
+		_In_ const BYTE *pBits,
+		_In_ const BYTE *pValues,
+		_Out_ tagJpegHuffmanTable *pTable
+		)
+	{
+		memset(pTable, 0, sizeof(*pTable));
+		UINT uiCode = 0;
+		UINT k = 0;
+		for (UINT uiLength = 1; uiLength <= 16; ++uiLength)
+		{
+			for (UINT i = 0; i < pBits[uiLength - 1]; ++i)
+			{
+				pTable->Code[pValues[k]] = (USHORT)uiCode++;
+				pTable->Size[pValues[k]] = (BYTE)uiLength;
+				++k;
+			}
+			uiCode <<= 1;
+		}
+	} // buildHuffman
+
+	static
+	inline
+	void
+	buildQuant(
+		_In_ const BYTE *pBase,
+		_In_ UINT uiQuality,
+		_Out_ BYTE *pQuant,
+		_Out_ float *pScale
+		)
+	{
+		static const float s_aan[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+		const INT nScale = (uiQuality < 50) ? (INT)(5000 / uiQuality) : (INT)(200 - uiQuality * 2);
+		const BYTE *pNatural = zigzag();
+		for (UINT k = 0; k < 64; ++k)
+		{
+			UINT i = pNatural[k];
+			INT q = ((INT)pBase[i] * nScale + 50) / 100;
+			q = (q < 1) ? 1 : ((q > 255) ? 255 : q);
+			pQuant[k] = (BYTE)q;
+			pScale[i] = 1.0f / ((float)q * s_aan[i >> 3] * s_aan[i & 7] * 8.0f);
+		}
+	} // buildQuant
+
+	//
+	// Forward DCT (AAN, float), the output is scaled by 8 * aan[u] * aan[v]
+	//
+	static
+	inline
+	void
+	fdct(
+		_Inout_ float *d
+		)
+	{
+		for (UINT pass = 0; pass < 2; ++pass)
+		{
+			const UINT uiStep = (pass == 0) ? 1 : 8;
+			const UINT uiNext = (pass == 0) ? 8 : 1;
+			for (UINT n = 0; n < 8; ++n)
+			{
+				float *p = d + n * uiNext;
+				float tmp0 = p[0 * uiStep] + p[7 * uiStep];
+				float tmp7 = p[0 * uiStep] - p[7 * uiStep];
+				float tmp1 = p[1 * uiStep] + p[6 * uiStep];
+				float tmp6 = p[1 * uiStep] - p[6 * uiStep];
+				float tmp2 = p[2 * uiStep] + p[5 * uiStep];
+				float tmp5 = p[2 * uiStep] - p[5 * uiStep];
+				float tmp3 = p[3 * uiStep] + p[4 * uiStep];
+				float tmp4 = p[3 * uiStep] - p[4 * uiStep];
+
+				float tmp10 = tmp0 + tmp3;
+				float tmp13 = tmp0 - tmp3;
+				float tmp11 = tmp1 + tmp2;
+				float tmp12 = tmp1 - tmp2;
+
+				p[0 * uiStep] = tmp10 + tmp11;
+				p[4 * uiStep] = tmp10 - tmp11;
+				float z1 = (tmp12 + tmp13) * 0.707106781f;
+				p[2 * uiStep] = tmp13 + z1;
+				p[6 * uiStep] = tmp13 - z1;
+
+				tmp10 = tmp4 + tmp5;
+				tmp11 = tmp5 + tmp6;
+				tmp12 = tmp6 + tmp7;
+				float z5 = (tmp10 - tmp12) * 0.382683433f;
+				float z2 = 0.541196100f * tmp10 + z5;
+				float z4 = 1.306562965f * tmp12 + z5;
+				float z3 = tmp11 * 0.707106781f;
+				float z11 = tmp7 + z3;
+				float z13 = tmp7 - z3;
+
+				p[5 * uiStep] = z13 + z2;
+				p[3 * uiStep] = z13 - z2;
+				p[1 * uiStep] = z11 + z4;
+				p[7 * uiStep] = z11 - z4;
+			}
+		}
+	} // fdct
+
+	//
+	// MSB first bit writer with 0xFF byte stuffing
+	//
+	typedef struct tagBitWriter_s
+	{
+		std::vector<BYTE>* Output;
+		UINT               Bits;
+		UINT               Count;
+	} tagBitWriter;
+
+	static
+	inline
+	void
+	putBits(
+		_Inout_ tagBitWriter *pWriter,
+		_In_ UINT uiBits,
+		_In_ UINT uiCount
+		)
+	{
+		pWriter->Bits = (pWriter->Bits << uiCount) | (uiBits & ((1u << uiCount) - 1));
+		pWriter->Count += uiCount;
+		while (pWriter->Count >= 8)
+		{
+			BYTE b = (BYTE)(pWriter->Bits >> (pWriter->Count - 8));
+			pWriter->Output->push_back(b);
+			if (b == 0xFF) {
+				pWriter->Output->push_back(0x00);
+			}
+			pWriter->Count -= 8;
+		}
+	} // putBits
+
+	static
+	inline
+	void
+	encodeBlock(
+		_Inout_ tagBitWriter *pWriter,
+		_Inout_ float *pBlock,
+		_In_ const float *pScale,
+		_In_ const tagJpegHuffmanTable *pDc,
+		_In_ const tagJpegHuffmanTable *pAc,
+		_Inout_ INT *pDcPred
+		)
+	{
+		fdct(pBlock);
+
+		INT q[64];
+		const BYTE *pNatural = zigzag();
+		for (UINT k = 0; k < 64; ++k)
+		{
+			float v = pBlock[pNatural[k]] * pScale[pNatural[k]];
+			q[k] = (INT)((v < 0.0f) ? (v - 0.5f) : (v + 0.5f));
+		}
+
+		INT nDiff = q[0] - *pDcPred;
+		*pDcPred = q[0];
+		putValue(pWriter, pDc, 0, nDiff);
+
+		UINT uiRun = 0;
+		for (UINT k = 1; k < 64; ++k)
+		{
+			if (q[k] == 0)
+			{
+				++uiRun;
+				continue;
+			}
+			while (uiRun >= 16)
+			{
+				putBits(pWriter, pAc->Code[0xF0], pAc->Size[0xF0]);
+				uiRun -= 16;
+			}
+			putValue(pWriter, pAc, uiRun << 4, q[k]);
+			uiRun = 0;
+		}
+		if (uiRun > 0) {
+			putBits(pWriter, pAc->Code[0x00], pAc->Size[0x00]);
+		}
+	} // encodeBlock
+
+	static
+	inline
+	void
+	putValue(
+		_Inout_ tagBitWriter *pWriter,
+		_In_ const tagJpegHuffmanTable *pTable,
+		_In_ UINT uiPrefix,
+		_In_ INT nValue
+		)
+	{
+		INT nAbs = (nValue < 0) ? -nValue : nValue;
+		UINT uiCategory = 0;
+		while (nAbs > 0)
+		{
+			++uiCategory;
+			nAbs >>= 1;
+		}
+		UINT uiSymbol = uiPrefix | uiCategory;
+		putBits(pWriter, pTable->Code[uiSymbol], pTable->Size[uiSymbol]);
+		if (uiCategory > 0) {
+			putBits(pWriter, (UINT)((nValue < 0) ? (nValue - 1) : nValue), uiCategory);
+		}
+	} // putValue
+
+	static
+	inline
+	void
+	putMarker(
+		_Inout_ std::vector<BYTE> *pOutput,
+		_In_ BYTE bMarker,
+		_In_ UINT uiLength
+		)
+	{
+		pOutput->push_back(0xFF);
+		pOutput->push_back(bMarker);
+		if (uiLength > 0)
+		{
+			pOutput->push_back((BYTE)(uiLength >> 8));
+			pOutput->push_back((BYTE)uiLength);
+		}
+	} // putMarker
+
+	static
+	inline
+	void
+	putHuffman(
+		_Inout_ std::vector<BYTE> *pOutput,
+		_In_ BYTE bClassId,
+		_In_ const BYTE *pBits,
+		_In_ const BYTE *pValues
+		)
+	{
+		UINT uiCount = 0;
+		for (UINT i = 0; i < 16; ++i) {
+			uiCount += pBits[i];
+		}
+		pOutput->push_back(bClassId);
+		pOutput->insert(pOutput->end(), pBits, pBits + 16);
+		pOutput->insert(pOutput->end(), pValues, pValues + uiCount);
+	} // putHuffman
+
+public:
+	//
+	// Quantization and Huffman tables of the quality (1..100, IJG scaling)
+	//
+	static
+	inline
+	void
+	InitTables(
+		_In_ UINT uiQuality,
+		_Out_ tagJpegTables *pTables
+		)
+	{
+		static const BYTE s_baseY[64] = {
+			16, 11, 10, 16,  24,  40,  51,  61,  12, 12, 14, 19,  26,  58,  60,  55,
+			14, 13, 16, 24,  40,  57,  69,  56,  14, 17, 22, 29,  51,  87,  80,  62,
+			18, 22, 37, 56,  68, 109, 103,  77,  24, 35, 55, 64,  81, 104, 113,  92,
+			49, 64, 78, 87, 103, 121, 120, 101,  72, 92, 95, 98, 112, 100, 103,  99,
+		};
+		static const BYTE s_baseC[64] = {
+			17, 18, 24, 47, 99, 99, 99, 99,  18, 21, 26, 66, 99, 99, 99, 99,
+			24, 26, 56, 99, 99, 99, 99, 99,  47, 66, 99, 99, 99, 99, 99, 99,
+			99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99,
+			99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99,
+		};
+
+		uiQuality = (uiQuality < 1) ? 1 : ((uiQuality > 100) ? 100 : uiQuality);
+		buildQuant(s_baseY, uiQuality, pTables->QuantY, pTables->ScaleY);
+		buildQuant(s_baseC, uiQuality, pTables->QuantC, pTables->ScaleC);
+		buildHuffman(dcBitsY(), dcValues(), &pTables->DcY);
+		buildHuffman(acBitsY(), acValuesY(), &pTables->AcY);
+		buildHuffman(dcBitsC(), dcValues(), &pTables->DcC);
+		buildHuffman(acBitsC(), acValuesC(), &pTables->AcC);
+	} // InitTables
+
+	//
+	// Everything before the entropy coded data: SOI, APP0, DQT, SOF0, DHT, DRI (uiRestartInterval MCUs, 0: none) and SOS
+	//
+	static
+	inline
+	void
+	WriteHeaders(
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ const tagJpegTables *pTables,
+		_In_ UINT uiRestartInterval,
+		_Inout_ std::vector<BYTE> *pOutput
+		)
+	{
+		static const BYTE s_app0[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+
+		putMarker(pOutput, 0xD8, 0);
+		putMarker(pOutput, 0xE0, 16);
+		pOutput->insert(pOutput->end(), s_app0, s_app0 + 14);
+
+		putMarker(pOutput, 0xDB, 2 + 2 * 65);
+		pOutput->push_back(0);
+		pOutput->insert(pOutput->end(), pTables->QuantY, pTables->QuantY + 64);
+		pOutput->push_back(1);
+		pOutput->insert(pOutput->end(), pTables->QuantC, pTables->QuantC + 64);
+
+		putMarker(pOutput, 0xC0, 17);
+		pOutput->push_back(8);
+		pOutput->push_back((BYTE)(nHeight >> 8));
+		pOutput->push_back((BYTE)nHeight);
+		pOutput->push_back((BYTE)(nWidth >> 8));
+		pOutput->push_back((BYTE)nWidth);
+		pOutput->push_back(3);
+		const BYTE components[9] = { 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+		pOutput->insert(pOutput->end(), components, components + 9);
+
+		putMarker(pOutput, 0xC4, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+		putHuffman(pOutput, 0x00, dcBitsY(), dcValues());
+		putHuffman(pOutput, 0x10, acBitsY(), acValuesY());
+		putHuffman(pOutput, 0x01, dcBitsC(), dcValues());
+		putHuffman(pOutput, 0x11, acBitsC(), acValuesC());
+
+		if (uiRestartInterval > 0)
+		{
+			putMarker(pOutput, 0xDD, 4);
+			pOutput->push_back((BYTE)(uiRestartInterval >> 8));
+			pOutput->push_back((BYTE)uiRestartInterval);
+		}
+
+		putMarker(pOutput, 0xDA, 12);
+		const BYTE scan[10] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+		pOutput->insert(pOutput->end(), scan, scan + 10);
+	} // WriteHeaders
+
+	//
+	// Entropy coded data of the MCU rows [uiMcuRowBegin, uiMcuRowEnd) (16 pixel rows each),
+	// starting with zeroed DC predictors and padded with 1 bits to a byte boundary.
+	//
+	static
+	inline
+	void
+	EncodeInterval(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ const tagJpegTables *pTables,
+		_In_ UINT uiMcuRowBegin,
+		_In_ UINT uiMcuRowEnd,
+		_Inout_ std::vector<BYTE> *pOutput
+		)
+	{
+		tagBitWriter writer;
+		writer.Output = pOutput;
+		writer.Bits   = 0;
+		writer.Count  = 0;
+
+		INT nDcY  = 0;
+		INT nDcCb = 0;
+		INT nDcCr = 0;
+
+		float Y[4][64];
+		float Cb[64];
+		float Cr[64];
+		float cb[16 * 16];
+		float cr[16 * 16];
+
+		for (UINT uiMcuRow = uiMcuRowBegin; uiMcuRow < uiMcuRowEnd; ++uiMcuRow)
+		{
+			for (INT mx = 0; mx < nWidth; mx += 16)
+			{
+				for (INT y = 0; y < 16; ++y)
+				{
+					INT sy = (INT)uiMcuRow * 16 + y;
+					if (sy >= nHeight) {
+						sy = nHeight - 1;
+					}
+					const BYTE *pRow = pSrc + (ptrdiff_t)sy * nSrcPitch;
+					for (INT x = 0; x < 16; ++x)
+					{
+						INT sx = mx + x;
+						if (sx >= nWidth) {
+							sx = nWidth - 1;
+						}
+						const BYTE *p = pRow + sx * 4;
+						float b = p[0];
+						float g = p[1];
+						float r = p[2];
+						Y[((y >> 3) << 1) | (x >> 3)][((y & 7) << 3) | (x & 7)] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+						cb[y * 16 + x] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+						cr[y * 16 + x] =  0.5f * r - 0.418688f * g - 0.081312f * b;
+					}
+				}
+				for (INT y = 0; y < 8; ++y)
+				{
+					for (INT x = 0; x < 8; ++x)
+					{
+						INT i = (y * 2) * 16 + x * 2;
+						Cb[y * 8 + x] = 0.25f * (cb[i] + cb[i + 1] + cb[i + 16] + cb[i + 17]);
+						Cr[y * 8 + x] = 0.25f * (cr[i] + cr[i + 1] + cr[i + 16] + cr[i + 17]);
+					}
+				}
+
+				for (UINT i = 0; i < 4; ++i) {
+					encodeBlock(&writer, Y[i], pTables->ScaleY, &pTables->DcY, &pTables->AcY, &nDcY);
+				}
+				encodeBlock(&writer, Cb, pTables->ScaleC, &pTables->DcC, &pTables->AcC, &nDcCb);
+				encodeBlock(&writer, Cr, pTables->ScaleC, &pTables->DcC, &pTables->AcC, &nDcCr);
+			}
+		}
+
+		if (writer.Count > 0) {
+			putBits(&writer, 0x7F, 8 - writer.Count);
+		}
+	} // EncodeInterval
+
+}; // end class DXGICaptureJpeg
+
+#endif // __DXGICAPTUREJPEG_H__
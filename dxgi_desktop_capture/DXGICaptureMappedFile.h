@@ -0,0 +1,263 @@
+/*****************************************************************************
+* DXGICaptureMappedFile.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREMAPPEDFILE_H__
+#define __DXGICAPTUREMAPPEDFILE_H__
+
+#include "DXGICapturePlatform.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//
+// class CDXGIMappedFile
+//
+// A file mapped as a whole into memory: created with a preallocated size for
+// writing, or opened read-only. Close truncates a written file to the used size.
+//
+class CDXGIMappedFile
+{
+private:
+#if defined(_WIN32)
+	HANDLE      m_hFile;
+	HANDLE      m_hMapping;
+#else
+	int         m_fd;
+#endif
+	BYTE*       m_pData;
+	UINT64      m_ullSize;
+	BOOL        m_bWritable;
+
+	// disable copy
+	CDXGIMappedFile(const CDXGIMappedFile&);
+	CDXGIMappedFile& operator=(const CDXGIMappedFile&);
+
+	inline
+	HRESULT
+	map()
+	{
+		if ((m_ullSize == 0) || (m_ullSize != (UINT64)(size_t)m_ullSize)) {
+			return E_INVALIDARG; // does not fit into the address space
+		}
+#if defined(_WIN32)
+		m_hMapping = CreateFileMappingW(m_hFile, NULL, m_bWritable ? PAGE_READWRITE : PAGE_READONLY,
+			(DWORD)(m_ullSize >> 32), (DWORD)m_ullSize, NULL);
+		if (NULL == m_hMapping) {
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+		m_pData = (BYTE*)MapViewOfFile(m_hMapping, m_bWritable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, (SIZE_T)m_ullSize);
+		if (nullptr == m_pData) {
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+#else
+		void *p = mmap(nullptr, (size_t)m_ullSize, m_bWritable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m_fd, 0);
+		if (MAP_FAILED == p) {
+			return E_FAIL;
+		}
+		m_pData = (BYTE*)p;
+#endif
+		return S_OK;
+	}
+
+	inline
+	void
+	unmap()
+	{
+#if defined(_WIN32)
+		if (nullptr != m_pData) {
+			UnmapViewOfFile(m_pData);
+		}
+		if (NULL != m_hMapping) {
+			CloseHandle(m_hMapping);
+			m_hMapping = NULL;
+		}
+#else
+		if (nullptr != m_pData) {
+			munmap(m_pData, (size_t)m_ullSize);
+		}
+#endif
+		m_pData = nullptr;
+	}
+
+public:
+	CDXGIMappedFile()
+#if defined(_WIN32)
+		: m_hFile(INVALID_HANDLE_VALUE)
+		, m_hMapping(NULL)
+#else
+		: m_fd(-1)
+#endif
+		, m_pData(nullptr)
+		, m_ullSize(0)
+		, m_bWritable(FALSE)
+	{
+	}
+
+	~CDXGIMappedFile()
+	{
+		Close(0);
+	}
+
+	//
+	// Creates (or overwrites) the file with ullSize bytes and maps it for writing
+	//
+	inline
+	HRESULT
+	Create(
+		_In_ const char *pszFileName,
+		_In_ UINT64 ullSize
+		)
+	{
+		CHECK_POINTER_EX(pszFileName, E_INVALIDARG);
+		if (IsOpen()) {
+			return E_UNEXPECTED;
+		}
+
+		m_ullSize   = ullSize;
+		m_bWritable = TRUE;
+#if defined(_WIN32)
+		m_hFile = CreateFileA(pszFileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (INVALID_HANDLE_VALUE == m_hFile) {
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+		LARGE_INTEGER liSize;
+		liSize.QuadPart = (LONGLONG)ullSize;
+		if (!SetFilePointerEx(m_hFile, liSize, NULL, FILE_BEGIN) || !SetEndOfFile(m_hFile))
+		{
+			HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+			Close(0);
+			return hr;
+		}
+#else
+		m_fd = open(pszFileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_fd < 0) {
+			return E_FAIL;
+		}
+		// reserve the blocks, a sparse file could fail with SIGBUS on a full disk
+		if ((ftruncate(m_fd, (off_t)ullSize) != 0) || (posix_fallocate(m_fd, 0, (off_t)ullSize) != 0))
+		{
+			Close(0);
+			return E_FAIL;
+		}
+#endif
+		HRESULT hr = map();
+		if (FAILED(hr)) {
+			Close(0);
+		}
+		return hr;
+	} // Create
+
+	//
+	// Opens an existing file and maps it read-only
+	//
+	inline
+	HRESULT
+	Open(
+		_In_ const char *pszFileName
+		)
+	{
+		CHECK_POINTER_EX(pszFileName, E_INVALIDARG);
+		if (IsOpen()) {
+			return E_UNEXPECTED;
+		}
+
+		m_bWritable = FALSE;
+#if defined(_WIN32)
+		m_hFile = CreateFileA(pszFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (INVALID_HANDLE_VALUE == m_hFile) {
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+		LARGE_INTEGER liSize;
+		if (!GetFileSizeEx(m_hFile, &liSize))
+		{
+			HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+			Close(0);
+			return hr;
+		}
+		m_ullSize = (UINT64)liSize.QuadPart;
+#else
+		m_fd = open(pszFileName, O_RDONLY);
+		if (m_fd < 0) {
+			return E_FAIL;
+		}
+		struct stat st;
+		if (fstat(m_fd, &st) != 0)
+		{
+			Close(0);
+			return E_FAIL;
+		}
+		m_ullSize = (UINT64)st.st_size;
+#endif
+		HRESULT hr = map();
+		if (FAILED(hr)) {
+			Close(0);
+		}
+		return hr;
+	} // Open
+
+	//
+	// Unmaps and closes the file, a written file is truncated to ullUsedSize bytes
+	// (0: keep the size)
+	//
+	inline
+	HRESULT
+	Close(
+		_In_ UINT64 ullUsedSize
+		)
+	{
+		HRESULT hr = S_OK;
+		unmap();
+#if defined(_WIN32)
+		if (INVALID_HANDLE_VALUE != m_hFile)
+		{
+			if (m_bWritable && (ullUsedSize > 0) && (ullUsedSize < m_ullSize))
+			{
+				LARGE_INTEGER liSize;
+				liSize.QuadPart = (LONGLONG)ullUsedSize;
+				if (!SetFilePointerEx(m_hFile, liSize, NULL, FILE_BEGIN) || !SetEndOfFile(m_hFile)) {
+					hr = HRESULT_FROM_WIN32(GetLastError());
+				}
+			}
+			CloseHandle(m_hFile);
+			m_hFile = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (m_fd >= 0)
+		{
+			if (m_bWritable && (ullUsedSize > 0) && (ullUsedSize < m_ullSize) && (ftruncate(m_fd, (off_t)ullUsedSize) != 0)) {
+				hr = E_FAIL;
+			}
+			close(m_fd);
+			m_fd = -1;
+		}
+#endif
+		m_ullSize   = 0;
+		m_bWritable = FALSE;
+		return hr;
+	} // Close
+
+	inline BOOL IsOpen() const { return nullptr != m_pData; }
+	inline BYTE* GetData() const { return m_pData; }
+	inline UINT64 GetSize() const { return m_ullSize; }
+
+}; // end class CDXGIMappedFile
+
+#endif // __DXGICAPTUREMAPPEDFILE_H__
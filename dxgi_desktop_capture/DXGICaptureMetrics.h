@@ -0,0 +1,665 @@
+/*****************************************************************************
+* DXGICaptureMetrics.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREMETRICS_H__
+#define __DXGICAPTUREMETRICS_H__
+
+#include "DXGICaptureTypes.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// 32 sub-buckets per power of two: a recorded latency is off by less than 1/32 (3.1%)
+#define DXGICAPTURE_HISTOGRAM_SUB_BUCKET_BITS   5
+#define DXGICAPTURE_HISTOGRAM_SUB_BUCKETS       (1 << DXGICAPTURE_HISTOGRAM_SUB_BUCKET_BITS)
+// latencies up to 2^36 nsec (68.7 sec), longer ones are counted in the last bucket
+#define DXGICAPTURE_HISTOGRAM_MAX_BITS          36
+#define DXGICAPTURE_HISTOGRAM_BUCKETS           ((DXGICAPTURE_HISTOGRAM_MAX_BITS - DXGICAPTURE_HISTOGRAM_SUB_BUCKET_BITS + 1) * DXGICAPTURE_HISTOGRAM_SUB_BUCKETS)
+
+//
+// enum tagCaptureStage
+//
+typedef enum tagCaptureStage
+{
+	tagCaptureStage_AcquireWait     = 0, /* acquire of a new desktop image, timeouts are only counted */
+	tagCaptureStage_Copy            = 1, /* desktop image into the copy texture/desktop frame, readback to the cpu */
+	tagCaptureStage_CursorFetch     = 2, /* pointer position and shape of the acquired image */
+	tagCaptureStage_CursorComposite = 3, /* pointer drawn into the desktop image */
+	tagCaptureStage_Render          = 4, /* output image (rotate, scale), tile hash and yuv planes */
+	tagCaptureStage_Encode          = 5, /* output image into the bytes of its file format */
+	tagCaptureStage_FileWrite       = 6, /* encoded bytes written to the file */
+	tagCaptureStage_Frame           = 7, /* a captured frame: copy, pointer and render */
+	tagCaptureStage_Count
+} tagCaptureStage;
+
+//
+// struct tagLatencySummary_s
+//
+typedef struct tagLatencySummary_s
+{
+	UINT64  Count;      /* recorded latencies */
+	UINT64  MinNsec;
+	UINT64  MaxNsec;
+	UINT64  MeanNsec;
+	UINT64  P50Nsec;    /* percentiles are the highest value of their bucket, at most MaxNsec */
+	UINT64  P90Nsec;
+	UINT64  P99Nsec;
+	UINT64  P999Nsec;
+} tagLatencySummary;
+
+//
+// struct tagCaptureMetricsSnapshot_s
+//
+typedef struct tagCaptureMetricsSnapshot_s
+{
+	UINT64              ElapsedUsec;            /* since the metrics were created or reset */
+	UINT64              Frames;                 /* captured frames */
+	UINT64              Timeouts;               /* acquires without a new desktop image */
+	UINT64              TimeoutWaitNsec;        /* time spent waiting in those acquires */
+	UINT64              DroppedFrames;          /* desktop updates that were never acquired (AccumulatedFrames - 1) */
+	UINT64              BytesCopied;            /* frame copies (tagFrameCopyStats) */
+	UINT64              BytesEncoded;
+	UINT64              BytesWritten;
+	UINT64              Allocations;            /* buffers allocated by the library, process wide */
+	UINT64              AllocatedBytes;
+	UINT64              FramesWithAllocations;  /* frames that allocated a buffer (none in the steady state) */
+	UINT64              MaxFrameAllocations;
+	UINT64              MaxFrameAllocatedBytes;
+	tagLatencySummary   Stages[tagCaptureStage_Count];
+} tagCaptureMetricsSnapshot;
+
+//
+// struct tagCaptureFrameTimes_s
+//
+// The stage times of one frame, added up over the calls that produce it
+//
+typedef struct tagCaptureFrameTimes_s
+{
+	UINT    StageMask;                          /* 1 << stage for the stages that ran */
+	UINT64  StageNsec[tagCaptureStage_Count];
+} tagCaptureFrameTimes;
+
+//
+// class DXGICaptureAllocationCounters
+//
+// Process wide counters of the buffers allocated by the library (frame
+// buffers, pooled frames, yuv planes, pointer shapes). The statics live in a
+// class template so that the header needs no translation unit.
+//
+template <typename T>
+class DXGICaptureAllocationCounters
+{
+public:
+	static std::atomic<UINT64>  Count;
+	static std::atomic<UINT64>  Bytes;
+}; // end class DXGICaptureAllocationCounters
+
+template <typename T> std::atomic<UINT64> DXGICaptureAllocationCounters<T>::Count(0);
+template <typename T> std::atomic<UINT64> DXGICaptureAllocationCounters<T>::Bytes(0);
+
+//
+// class DXGICaptureAllocations
+//
+class DXGICaptureAllocations
+{
+public:
+	static
+	inline
+	void
+	Add(
+		_In_ UINT64 ullBytes
+		)
+	{
+		DXGICaptureAllocationCounters<void>::Count.fetch_add(1, std::memory_order_relaxed);
+		DXGICaptureAllocationCounters<void>::Bytes.fetch_add(ullBytes, std::memory_order_relaxed);
+	} // Add
+
+	static
+	inline
+	void
+	Get(
+		_Out_ UINT64 *pullCount,
+		_Out_ UINT64 *pullBytes
+		)
+	{
+		*pullCount = DXGICaptureAllocationCounters<void>::Count.load(std::memory_order_relaxed);
+		*pullBytes = DXGICaptureAllocationCounters<void>::Bytes.load(std::memory_order_relaxed);
+	} // Get
+
+}; // end class DXGICaptureAllocations
+
+//
+// class CDXGILatencyHistogram
+//
+// Log-linear latency histogram in nanoseconds (HDR histogram layout): values
+// below 64 have a bucket each, above that every power of two is split into 32
+// buckets. Recording is a few relaxed atomic adds, any thread may record while
+// another one reads the summary.
+//
+class CDXGILatencyHistogram
+{
+private:
+	std::atomic<UINT64> m_buckets[DXGICAPTURE_HISTOGRAM_BUCKETS];
+	std::atomic<UINT64> m_ullSumNsec;
+	std::atomic<UINT64> m_ullMinNsec;
+	std::atomic<UINT64> m_ullMaxNsec;
+
+private:
+	CDXGILatencyHistogram(const CDXGILatencyHistogram&);
+	CDXGILatencyHistogram& operator=(const CDXGILatencyHistogram&);
+
+public:
+	CDXGILatencyHistogram()
+	{
+		Reset();
+	}
+
+	//
+	// Not atomic as a whole: latencies recorded during a reset may be lost
+	//
+	inline void Reset()
+	{
+		for (UINT i = 0; i < DXGICAPTURE_HISTOGRAM_BUCKETS; ++i) {
+			m_buckets[i].store(0, std::memory_order_relaxed);
+		}
+		m_ullSumNsec.store(0, std::memory_order_relaxed);
+		m_ullMinNsec.store(~0ULL, std::memory_order_relaxed);
+		m_ullMaxNsec.store(0, std::memory_order_relaxed);
+	}
+
+	static
+	inline
+	UINT
+	GetBucketIndex(
+		_In_ UINT64 ullValue
+		)
+	{
+		if (ullValue < (2 * DXGICAPTURE_HISTOGRAM_SUB_BUCKETS)) {
+			return (UINT)ullValue;
+		}
+		if (ullValue >= (1ULL << DXGICAPTURE_HISTOGRAM_MAX_BITS)) {
+			return DXGICAPTURE_HISTOGRAM_BUCKETS - 1;
+		}
+
+		// highest set bit, at least 6 here
+		UINT uiMsb = 0;
+		UINT64 x = ullValue;
+		if (x >= (1ULL << 32)) { x >>= 32; uiMsb += 32; }
+		if (x >= (1ULL << 16)) { x >>= 16; uiMsb += 16; }
+		if (x >= (1ULL << 8))  { x >>= 8;  uiMsb += 8; }
+		if (x >= (1ULL << 4))  { x >>= 4;  uiMsb += 4; }
+		if (x >= (1ULL << 2))  { x >>= 2;  uiMsb += 2; }
+		if (x >= (1ULL << 1))  { uiMsb += 1; }
+
+		UINT uiShift = uiMsb - DXGICAPTURE_HISTOGRAM_SUB_BUCKET_BITS;
+		return (uiShift * DXGICAPTURE_HISTOGRAM_SUB_BUCKETS) + (UINT)(ullValue >> uiShift);
+	} // GetBucketIndex
+
+	//
+	// Highest value counted in the bucket
+	//
+	static
+	inline
+	UINT64
+	GetBucketUpperBound(
+		_In_ UINT uiIndex
+		)
+	{
+		if (uiIndex < (2 * DXGICAPTURE_HISTOGRAM_SUB_BUCKETS)) {
+			return uiIndex;
+		}
+		UINT uiShift = (uiIndex / DXGICAPTURE_HISTOGRAM_SUB_BUCKETS) - 1;
+		UINT64 ullSub = (uiIndex % DXGICAPTURE_HISTOGRAM_SUB_BUCKETS) + DXGICAPTURE_HISTOGRAM_SUB_BUCKETS;
+		return ((ullSub + 1) << uiShift) - 1;
+	} // GetBucketUpperBound
+
+	inline void Record(_In_ UINT64 ullNsec)
+	{
+		m_buckets[GetBucketIndex(ullNsec)].fetch_add(1, std::memory_order_relaxed);
+		m_ullSumNsec.fetch_add(ullNsec, std::memory_order_relaxed);
+
+		UINT64 ullMin = m_ullMinNsec.load(std::memory_order_relaxed);
+		while ((ullNsec < ullMin) && !m_ullMinNsec.compare_exchange_weak(ullMin, ullNsec, std::memory_order_relaxed)) {
+		}
+		UINT64 ullMax = m_ullMaxNsec.load(std::memory_order_relaxed);
+		while ((ullNsec > ullMax) && !m_ullMaxNsec.compare_exchange_weak(ullMax, ullNsec, std::memory_order_relaxed)) {
+		}
+	}
+
+	inline UINT64 GetBucketCount(_In_ UINT uiIndex) const
+	{
+		return (uiIndex < DXGICAPTURE_HISTOGRAM_BUCKETS) ? m_buckets[uiIndex].load(std::memory_order_relaxed) : 0;
+	}
+
+	inline void GetSummary(_Out_ tagLatencySummary *pSummary) const
+	{
+		memset(pSummary, 0, sizeof(*pSummary));
+
+		// the sum may run ahead of the buckets during a record
+		UINT64 ullTotal = 0;
+		for (UINT i = 0; i < DXGICAPTURE_HISTOGRAM_BUCKETS; ++i) {
+			ullTotal += m_buckets[i].load(std::memory_order_relaxed);
+		}
+		if (ullTotal == 0) {
+			return;
+		}
+
+		pSummary->Count    = ullTotal;
+		pSummary->MinNsec  = m_ullMinNsec.load(std::memory_order_relaxed);
+		pSummary->MaxNsec  = m_ullMaxNsec.load(std::memory_order_relaxed);
+		pSummary->MeanNsec = m_ullSumNsec.load(std::memory_order_relaxed) / ullTotal;
+		if (pSummary->MinNsec > pSummary->MaxNsec) {
+			pSummary->MinNsec = pSummary->MaxNsec;
+		}
+
+		const UINT64 ullRanks[4] = {
+			(ullTotal * 500 + 999) / 1000,
+			(ullTotal * 900 + 999) / 1000,
+			(ullTotal * 990 + 999) / 1000,
+			(ullTotal * 999 + 999) / 1000 };
+		UINT64 *pValues[4] = { &pSummary->P50Nsec, &pSummary->P90Nsec, &pSummary->P99Nsec, &pSummary->P999Nsec };
+
+		UINT64 ullSeen = 0;
+		UINT uiRank = 0;
+		for (UINT i = 0; (i < DXGICAPTURE_HISTOGRAM_BUCKETS) && (uiRank < 4); ++i)
+		{
+			ullSeen += m_buckets[i].load(std::memory_order_relaxed);
+			while ((uiRank < 4) && (ullSeen >= ullRanks[uiRank]))
+			{
+				UINT64 ullValue = GetBucketUpperBound(i);
+				*pValues[uiRank++] = (ullValue < pSummary->MaxNsec) ? ullValue : pSummary->MaxNsec;
+			}
+		}
+		for (; uiRank < 4; ++uiRank) {
+			*pValues[uiRank] = pSummary->MaxNsec;
+		}
+	}
+
+}; // end class CDXGILatencyHistogram
+
+//
+// class CDXGICaptureMetrics
+//
+// Latency histograms of the capture stages and the counters of the captured
+// frames: dropped desktop updates, copied/encoded/written bytes and the buffers
+// allocated per frame. Every member is a relaxed atomic, the capture thread,
+// the encoders and a reader of snapshots may use one instance concurrently.
+// A recorded stage costs a clock read and a few uncontended atomic adds, cheap
+// enough to leave enabled.
+//
+// The allocation counters are process wide: with several captures in one
+// process a frame also sees the allocations of the others.
+//
+class CDXGICaptureMetrics
+{
+public:
+	typedef std::chrono::steady_clock clock_type;
+
+private:
+	CDXGILatencyHistogram   m_stages[tagCaptureStage_Count];
+	std::atomic<BOOL>       m_bEnabled;
+	std::atomic<INT64>      m_llStartUsec;
+	std::atomic<UINT64>     m_ullFrames;
+	std::atomic<UINT64>     m_ullTimeouts;
+	std::atomic<UINT64>     m_ullTimeoutWaitNsec;
+	std::atomic<UINT64>     m_ullDroppedFrames;
+	std::atomic<UINT64>     m_ullBytesCopied;
+	std::atomic<UINT64>     m_ullBytesEncoded;
+	std::atomic<UINT64>     m_ullBytesWritten;
+	std::atomic<UINT64>     m_ullAllocationsBase;
+	std::atomic<UINT64>     m_ullAllocatedBytesBase;
+	std::atomic<UINT64>     m_ullLastAllocations;
+	std::atomic<UINT64>     m_ullLastAllocatedBytes;
+	std::atomic<UINT64>     m_ullFramesWithAllocations;
+	std::atomic<UINT64>     m_ullMaxFrameAllocations;
+	std::atomic<UINT64>     m_ullMaxFrameAllocatedBytes;
+
+private:
+	CDXGICaptureMetrics(const CDXGICaptureMetrics&);
+	CDXGICaptureMetrics& operator=(const CDXGICaptureMetrics&);
+
+	static inline void storeMax(std::atomic<UINT64> &target, UINT64 ullValue)
+	{
+		UINT64 ullMax = target.load(std::memory_order_relaxed);
+		while ((ullValue > ullMax) && !target.compare_exchange_weak(ullMax, ullValue, std::memory_order_relaxed)) {
+		}
+	}
+
+	static inline INT64 nowUsec()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now().time_since_epoch()).count();
+	}
+
+	static inline void appendFormat(std::string &text, const char *pszFormat, ...)
+	{
+		char szBuffer[256];
+		va_list args;
+		va_start(args, pszFormat);
+#if defined(_WIN32)
+		int nLength = vsprintf_s(szBuffer, sizeof(szBuffer), pszFormat, args);
+#else
+		int nLength = vsnprintf(szBuffer, sizeof(szBuffer), pszFormat, args);
+#endif
+		va_end(args);
+		if (nLength > 0) {
+			text.append(szBuffer, (size_t)nLength);
+		}
+	}
+
+public:
+	CDXGICaptureMetrics()
+		: m_bEnabled(TRUE)
+	{
+		Reset();
+	}
+
+	static inline const char* GetStageName(_In_ tagCaptureStage stage)
+	{
+		static const char *s_pszNames[tagCaptureStage_Count] = {
+			"acquire_wait", "copy", "cursor_fetch", "cursor_composite", "render", "encode", "file_write", "frame" };
+		return ((UINT)stage < (UINT)tagCaptureStage_Count) ? s_pszNames[stage] : "unknown";
+	}
+
+	//
+	// Nanoseconds since *pTick, *pTick moves to now: consecutive stages share one clock read
+	//
+	static inline UINT64 Lap(_Inout_ clock_type::time_point *pTick)
+	{
+		clock_type::time_point now = clock_type::now();
+		INT64 llNsec = std::chrono::duration_cast<std::chrono::nanoseconds>(now - *pTick).count();
+		*pTick = now;
+		return (llNsec > 0) ? (UINT64)llNsec : 0;
+	}
+
+	static inline void ResetFrameTimes(_Out_ tagCaptureFrameTimes *pTimes)
+	{
+		memset(pTimes, 0, sizeof(*pTimes));
+	}
+
+	static inline void AddFrameTime(_Inout_ tagCaptureFrameTimes *pTimes, _In_ tagCaptureStage stage, _In_ UINT64 ullNsec)
+	{
+		pTimes->StageMask |= (1U << stage);
+		pTimes->StageNsec[stage] += ullNsec;
+	}
+
+	//
+	// Clears the histograms and the counters, the allocations count from now
+	//
+	inline void Reset()
+	{
+		for (UINT i = 0; i < (UINT)tagCaptureStage_Count; ++i) {
+			m_stages[i].Reset();
+		}
+		m_ullFrames.store(0, std::memory_order_relaxed);
+		m_ullTimeouts.store(0, std::memory_order_relaxed);
+		m_ullTimeoutWaitNsec.store(0, std::memory_order_relaxed);
+		m_ullDroppedFrames.store(0, std::memory_order_relaxed);
+		m_ullBytesCopied.store(0, std::memory_order_relaxed);
+		m_ullBytesEncoded.store(0, std::memory_order_relaxed);
+		m_ullBytesWritten.store(0, std::memory_order_relaxed);
+		m_ullFramesWithAllocations.store(0, std::memory_order_relaxed);
+		m_ullMaxFrameAllocations.store(0, std::memory_order_relaxed);
+		m_ullMaxFrameAllocatedBytes.store(0, std::memory_order_relaxed);
+
+		UINT64 ullCount = 0, ullBytes = 0;
+		DXGICaptureAllocations::Get(&ullCount, &ullBytes);
+		m_ullAllocationsBase.store(ullCount, std::memory_order_relaxed);
+		m_ullAllocatedBytesBase.store(ullBytes, std::memory_order_relaxed);
+		m_ullLastAllocations.store(ullCount, std::memory_order_relaxed);
+		m_ullLastAllocatedBytes.store(ullBytes, std::memory_order_relaxed);
+		m_llStartUsec.store(nowUsec(), std::memory_order_relaxed);
+	}
+
+	inline void SetEnabled(_In_ BOOL bEnabled) { m_bEnabled.store(bEnabled ? TRUE : FALSE, std::memory_order_relaxed); }
+	inline BOOL IsEnabled() const { return m_bEnabled.load(std::memory_order_relaxed); }
+
+	inline void Record(_In_ tagCaptureStage stage, _In_ UINT64 ullNsec)
+	{
+		if (IsEnabled() && ((UINT)stage < (UINT)tagCaptureStage_Count)) {
+			m_stages[stage].Record(ullNsec);
+		}
+	}
+
+	//
+	// An acquire: its wait goes to the histogram if a new image arrived, to the
+	// timeout total otherwise; the desktop updates it accumulated beyond the
+	// first one are the dropped frames
+	//
+	inline void RecordAcquire(_In_ UINT64 ullWaitNsec, _In_ BOOL bTimeout, _In_ UINT uiAccumulatedFrames)
+	{
+		if (!IsEnabled()) {
+			return;
+		}
+		if (bTimeout)
+		{
+			m_ullTimeouts.fetch_add(1, std::memory_order_relaxed);
+			m_ullTimeoutWaitNsec.fetch_add(ullWaitNsec, std::memory_order_relaxed);
+			return;
+		}
+		m_stages[tagCaptureStage_AcquireWait].Record(ullWaitNsec);
+		if (uiAccumulatedFrames > 1) {
+			m_ullDroppedFrames.fetch_add(uiAccumulatedFrames - 1, std::memory_order_relaxed);
+		}
+	}
+
+	//
+	// A captured frame: its stage times (the frame stage is their sum), its
+	// copies and the buffers allocated since the previous frame
+	//
+	inline void RecordFrame(_In_ const tagCaptureFrameTimes *pTimes, _In_ UINT64 ullBytesCopied)
+	{
+		if (!IsEnabled()) {
+			return;
+		}
+
+		UINT64 ullFrameNsec = 0;
+		for (UINT i = 0; i < (UINT)tagCaptureStage_Count; ++i)
+		{
+			if ((i != (UINT)tagCaptureStage_Frame) && ((pTimes->StageMask & (1U << i)) != 0))
+			{
+				m_stages[i].Record(pTimes->StageNsec[i]);
+				if (i != (UINT)tagCaptureStage_AcquireWait) {
+					ullFrameNsec += pTimes->StageNsec[i];
+				}
+			}
+		}
+		m_stages[tagCaptureStage_Frame].Record(ullFrameNsec);
+		m_ullFrames.fetch_add(1, std::memory_order_relaxed);
+		m_ullBytesCopied.fetch_add(ullBytesCopied, std::memory_order_relaxed);
+
+		UINT64 ullCount = 0, ullBytes = 0;
+		DXGICaptureAllocations::Get(&ullCount, &ullBytes);
+		UINT64 ullFrameCount = ullCount - m_ullLastAllocations.exchange(ullCount, std::memory_order_relaxed);
+		UINT64 ullFrameBytes = ullBytes - m_ullLastAllocatedBytes.exchange(ullBytes, std::memory_order_relaxed);
+		if (ullFrameCount > 0)
+		{
+			m_ullFramesWithAllocations.fetch_add(1, std::memory_order_relaxed);
+			storeMax(m_ullMaxFrameAllocations, ullFrameCount);
+			storeMax(m_ullMaxFrameAllocatedBytes, ullFrameBytes);
+		}
+	}
+
+	inline void RecordEncode(_In_ UINT64 ullNsec, _In_ UINT64 ullBytes)
+	{
+		if (IsEnabled())
+		{
+			m_stages[tagCaptureStage_Encode].Record(ullNsec);
+			m_ullBytesEncoded.fetch_add(ullBytes, std::memory_order_relaxed);
+		}
+	}
+
+	inline void RecordWrite(_In_ UINT64 ullNsec, _In_ UINT64 ullBytes)
+	{
+		if (IsEnabled())
+		{
+			m_stages[tagCaptureStage_FileWrite].Record(ullNsec);
+			m_ullBytesWritten.fetch_add(ullBytes, std::memory_order_relaxed);
+		}
+	}
+
+	inline const CDXGILatencyHistogram* GetHistogram(_In_ tagCaptureStage stage) const
+	{
+		return ((UINT)stage < (UINT)tagCaptureStage_Count) ? &m_stages[stage] : nullptr;
+	}
+
+	inline void GetSnapshot(_Out_ tagCaptureMetricsSnapshot *pSnapshot) const
+	{
+		memset(pSnapshot, 0, sizeof(*pSnapshot));
+
+		INT64 llElapsed = nowUsec() - m_llStartUsec.load(std::memory_order_relaxed);
+		pSnapshot->ElapsedUsec            = (llElapsed > 0) ? (UINT64)llElapsed : 0;
+		pSnapshot->Frames                 = m_ullFrames.load(std::memory_order_relaxed);
+		pSnapshot->Timeouts               = m_ullTimeouts.load(std::memory_order_relaxed);
+		pSnapshot->TimeoutWaitNsec        = m_ullTimeoutWaitNsec.load(std::memory_order_relaxed);
+		pSnapshot->DroppedFrames          = m_ullDroppedFrames.load(std::memory_order_relaxed);
+		pSnapshot->BytesCopied            = m_ullBytesCopied.load(std::memory_order_relaxed);
+		pSnapshot->BytesEncoded           = m_ullBytesEncoded.load(std::memory_order_relaxed);
+		pSnapshot->BytesWritten           = m_ullBytesWritten.load(std::memory_order_relaxed);
+		pSnapshot->FramesWithAllocations  = m_ullFramesWithAllocations.load(std::memory_order_relaxed);
+		pSnapshot->MaxFrameAllocations    = m_ullMaxFrameAllocations.load(std::memory_order_relaxed);
+		pSnapshot->MaxFrameAllocatedBytes = m_ullMaxFrameAllocatedBytes.load(std::memory_order_relaxed);
+
+		UINT64 ullCount = 0, ullBytes = 0;
+		DXGICaptureAllocations::Get(&ullCount, &ullBytes);
+		pSnapshot->Allocations    = ullCount - m_ullAllocationsBase.load(std::memory_order_relaxed);
+		pSnapshot->AllocatedBytes = ullBytes - m_ullAllocatedBytesBase.load(std::memory_order_relaxed);
+
+		for (UINT i = 0; i < (UINT)tagCaptureStage_Count; ++i) {
+			m_stages[i].GetSummary(&pSnapshot->Stages[i]);
+		}
+	}
+
+	//
+	// A snapshot as a json object: the counters, and per stage the summary in
+	// microseconds with the non-empty buckets as [highest nsec, count] pairs
+	//
+	inline
+	HRESULT
+	ExportJson(
+		_Out_ std::string *pJson,
+		_In_ BOOL bBuckets = TRUE
+		) const
+	{
+		CHECK_POINTER(pJson);
+
+		tagCaptureMetricsSnapshot snapshot;
+		GetSnapshot(&snapshot);
+
+		try
+		{
+			std::string &json = *pJson;
+			json.clear();
+			json.reserve(4096);
+
+			const double dFrames = (snapshot.Frames > 0) ? (double)snapshot.Frames : 1.0;
+			json += "{\n";
+			appendFormat(json, "  \"elapsed_usec\" : %llu,\n", (unsigned long long)snapshot.ElapsedUsec);
+			appendFormat(json, "  \"frames\" : %llu,\n", (unsigned long long)snapshot.Frames);
+			appendFormat(json, "  \"fps\" : %.2f,\n", (snapshot.ElapsedUsec > 0) ? (snapshot.Frames * 1000000.0 / (double)snapshot.ElapsedUsec) : 0.0);
+			appendFormat(json, "  \"timeouts\" : %llu,\n", (unsigned long long)snapshot.Timeouts);
+			appendFormat(json, "  \"timeout_wait_usec\" : %llu,\n", (unsigned long long)(snapshot.TimeoutWaitNsec / 1000));
+			appendFormat(json, "  \"dropped_frames\" : %llu,\n", (unsigned long long)snapshot.DroppedFrames);
+			appendFormat(json, "  \"bytes_copied\" : %llu,\n", (unsigned long long)snapshot.BytesCopied);
+			appendFormat(json, "  \"bytes_encoded\" : %llu,\n", (unsigned long long)snapshot.BytesEncoded);
+			appendFormat(json, "  \"bytes_written\" : %llu,\n", (unsigned long long)snapshot.BytesWritten);
+			appendFormat(json, "  \"allocations\" : %llu,\n", (unsigned long long)snapshot.Allocations);
+			appendFormat(json, "  \"allocated_bytes\" : %llu,\n", (unsigned long long)snapshot.AllocatedBytes);
+			appendFormat(json, "  \"allocations_per_frame\" : %.3f,\n", snapshot.Allocations / dFrames);
+			appendFormat(json, "  \"allocated_bytes_per_frame\" : %.1f,\n", snapshot.AllocatedBytes / dFrames);
+			appendFormat(json, "  \"frames_with_allocations\" : %llu,\n", (unsigned long long)snapshot.FramesWithAllocations);
+			appendFormat(json, "  \"max_frame_allocations\" : %llu,\n", (unsigned long long)snapshot.MaxFrameAllocations);
+			appendFormat(json, "  \"max_frame_allocated_bytes\" : %llu,\n", (unsigned long long)snapshot.MaxFrameAllocatedBytes);
+			json += "  \"stages\" : {\n";
+			for (UINT i = 0; i < (UINT)tagCaptureStage_Count; ++i)
+			{
+				const tagLatencySummary &s = snapshot.Stages[i];
+				appendFormat(json, "    \"%s\" : {\n", GetStageName((tagCaptureStage)i));
+				appendFormat(json, "      \"count\" : %llu,\n", (unsigned long long)s.Count);
+				appendFormat(json, "      \"min_usec\" : %.3f,\n", s.MinNsec / 1000.0);
+				appendFormat(json, "      \"mean_usec\" : %.3f,\n", s.MeanNsec / 1000.0);
+				appendFormat(json, "      \"p50_usec\" : %.3f,\n", s.P50Nsec / 1000.0);
+				appendFormat(json, "      \"p90_usec\" : %.3f,\n", s.P90Nsec / 1000.0);
+				appendFormat(json, "      \"p99_usec\" : %.3f,\n", s.P99Nsec / 1000.0);
+				appendFormat(json, "      \"p999_usec\" : %.3f,\n", s.P999Nsec / 1000.0);
+				appendFormat(json, "      \"max_usec\" : %.3f%s\n", s.MaxNsec / 1000.0, bBuckets ? "," : "");
+				if (bBuckets)
+				{
+					json += "      \"buckets\" : [";
+					BOOL bFirst = TRUE;
+					for (UINT b = 0; b < DXGICAPTURE_HISTOGRAM_BUCKETS; ++b)
+					{
+						UINT64 ullCount = m_stages[i].GetBucketCount(b);
+						if (ullCount == 0) {
+							continue;
+						}
+						appendFormat(json, "%s[%llu, %llu]", bFirst ? "" : ", ",
+							(unsigned long long)CDXGILatencyHistogram::GetBucketUpperBound(b), (unsigned long long)ullCount);
+						bFirst = FALSE;
+					}
+					json += "]\n";
+				}
+				appendFormat(json, "    }%s\n", (i + 1 < (UINT)tagCaptureStage_Count) ? "," : "");
+			}
+			json += "  }\n";
+			json += "}\n";
+		}
+		catch (...)
+		{
+			return E_OUTOFMEMORY;
+		}
+		return S_OK;
+	}
+
+	//
+	// Writes ExportJson to a file
+	//
+	inline
+	HRESULT
+	SaveJson(
+		_In_ const char *pszFileName,
+		_In_ BOOL bBuckets = TRUE
+		) const
+	{
+		CHECK_POINTER_EX(pszFileName, E_INVALIDARG);
+
+		std::string json;
+		HRESULT hr = ExportJson(&json, bBuckets);
+		CHECK_HR_RETURN(hr);
+
+		FILE *fp = nullptr;
+#if defined(_WIN32)
+		if (fopen_s(&fp, pszFileName, "wb") != 0) {
+			fp = nullptr;
+		}
+#else
+		fp = fopen(pszFileName, "wb");
+#endif
+		if (nullptr == fp) {
+			return E_FAIL;
+		}
+		size_t written = fwrite(json.data(), 1, json.size(), fp);
+		int nClose = fclose(fp);
+		return ((written == json.size()) && (nClose == 0)) ? S_OK : E_FAIL;
+	}
+
+}; // end class CDXGICaptureMetrics
+
+#endif // __DXGICAPTUREMETRICS_H__
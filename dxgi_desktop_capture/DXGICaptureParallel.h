@@ -0,0 +1,125 @@
+/*****************************************************************************
+* DXGICaptureParallel.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREPARALLEL_H__
+#define __DXGICAPTUREPARALLEL_H__
+
+#include "DXGICapturePlatform.h"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define DXGICAPTURE_PARALLEL_MAX_THREADS    64
+
+//
+// class DXGICaptureParallel
+//
+// Runs independent work items (image strips, monitors, ...) on short lived
+// threads. The calling thread takes part, the items are handed out through
+// an atomic counter so uneven items balance out.
+//
+class DXGICaptureParallel
+{
+public:
+	//
+	// Number of hardware threads (at least 1)
+	//
+	static
+	inline
+	UINT
+	GetThreadCount()
+	{
+		UINT uiCount = (UINT)std::thread::hardware_concurrency();
+		if (uiCount == 0) {
+			uiCount = 1;
+		}
+		return (uiCount > DXGICAPTURE_PARALLEL_MAX_THREADS) ? DXGICAPTURE_PARALLEL_MAX_THREADS : uiCount;
+	} // GetThreadCount
+
+	//
+	// Calls fn(index) for every index in [0, uiCount) on up to uiThreads threads
+	// (0: GetThreadCount). Threads that can not be started leave their share to
+	// the others. The first exception thrown by fn stops the loop and is
+	// rethrown on the calling thread.
+	//
+	template<typename F>
+	static
+	inline
+	void
+	For(
+		_In_ UINT uiCount,
+		_In_ UINT uiThreads,
+		_In_ F &fn
+		)
+	{
+		if (uiThreads == 0) {
+			uiThreads = GetThreadCount();
+		}
+		if (uiThreads > uiCount) {
+			uiThreads = uiCount;
+		}
+		if (uiThreads > DXGICAPTURE_PARALLEL_MAX_THREADS) {
+			uiThreads = DXGICAPTURE_PARALLEL_MAX_THREADS;
+		}
+
+		std::atomic<UINT> next(0);
+		std::exception_ptr error;
+		std::mutex errorLock;
+		auto worker = [&]() {
+			try
+			{
+				for (UINT i = next++; i < uiCount; i = next++) {
+					fn(i);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorLock);
+				if (!error) {
+					error = std::current_exception();
+				}
+				next = uiCount;
+			}
+		};
+
+		std::vector<std::thread> threads;
+		try
+		{
+			threads.reserve(uiThreads);
+			for (UINT i = 1; i < uiThreads; ++i) {
+				threads.push_back(std::thread(worker));
+			}
+		}
+		catch (...)
+		{
+		}
+
+		worker();
+		for (size_t i = 0; i < threads.size(); ++i) {
+			threads[i].join();
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	} // For
+
+}; // end class DXGICaptureParallel
+
+#endif // __DXGICAPTUREPARALLEL_H__
@@ -0,0 +1,502 @@
+/*****************************************************************************
+* DXGICapturePipeline.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREPIPELINE_H__
+#define __DXGICAPTUREPIPELINE_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureCopy.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICaptureMetrics.h"
+#include "DXGICapturePointer.h"
+#include "DXGICaptureRegion.h"
+#include "DXGICaptureRender.h"
+#include "DXGICaptureScale.h"
+#include "DXGICaptureSource.h"
+#include "DXGICaptureTileHash.h"
+#include "DXGICaptureYuv.h"
+
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+//
+// class CDXGICapturePipeline
+//
+// The cpu side of a capture: takes the desktop images of a capture source,
+// keeps them in a persistent frame (full copy, or move/dirty rects in
+// incremental mode), draws the pointer and renders the output image with the
+// geometry of the filter config (the cpu scaler of the ScaleFilter, when the
+// output is not rotated). With SkipUnchanged the output image is hashed in
+// 64x64 tiles, IsOutputChanged tells whether it differs from the last one.
+// An output that equals the desktop image (not rotated, not scaled) is not
+// rendered, GetOutputFrame returns the desktop frame. With a YuvFormat the
+// changed output images are converted to NV12 or I420 (GetYuvImage).
+// With regions in the config no desktop frame is kept: every region copies,
+// draws and renders only its own pixels (CDXGICaptureRegionFrame), the source
+// is asked to copy just the region rects, and one acquired image yields the
+// outputs of all regions (GetRegionOutput). GetOutputFrame is the output of
+// the first region, SkipUnchanged and YuvFormat apply to it.
+// With metrics attached (SetMetrics) every frame records its acquire wait and
+// its copy, pointer and render times; the pointer of a source comes with its
+// image, there is no cursor fetch stage.
+//
+class CDXGICapturePipeline
+{
+private:
+	IDXGICaptureSource*             m_pSource;
+	tagScreenCaptureFilterConfig    m_config;
+	tagCaptureSourceDesc            m_desc;
+	tagFrameGeometry                m_geometry;
+	CDXGICaptureScaler              m_scaler;
+
+	tagFrameBufferInfo              m_desktopFrame;
+	tagFrameBufferInfo              m_outputFrame;
+	tagFrameBufferInfo              m_mouseBackground;
+	tagFrameBufferInfo              m_tempMouseRotateBuffer;
+	CDXGICursorCache                m_cursorCache;
+	std::vector<tagFrameRect>       m_dirtyRects;
+	BOOL                            m_bDesktopFrameValid;
+	CDXGITileHasher                 m_tileHasher;
+	BOOL                            m_bOutputChanged;
+	BOOL                            m_bPassthrough;
+	tagFrameBufferInfo              m_yuvFrame;
+	tagYuvImage                     m_yuvImage;
+	tagYuvConvertStats              m_yuvStats;
+	CDXGICaptureRegionFrame         m_regions[DXGICAPTURE_MAX_REGIONS];
+	UINT                            m_uiRegionCount;
+
+	tagFrameUpdateStats             m_frameUpdateStats;
+	tagFrameCopyStats               m_frameCopyStats;
+	UINT64                          m_ullFrameNumber;
+	INT64                           m_llTimestamp;
+	CDXGICaptureMetrics*            m_pMetrics;
+
+	// disable copy
+	CDXGICapturePipeline(const CDXGICapturePipeline&);
+	CDXGICapturePipeline& operator=(const CDXGICapturePipeline&);
+
+	inline
+	HRESULT
+	updateDesktopFrame(
+		_In_ const tagCaptureSourceFrame *pFrame
+		)
+	{
+		const INT nWidth  = m_desc.Width;
+		const INT nHeight = m_desc.Height;
+
+		memset(&m_frameUpdateStats, 0, sizeof(m_frameUpdateStats));
+		m_frameUpdateStats.BytesTotal = (UINT64)nWidth * nHeight * 4;
+
+		BOOL bIncremental = m_config.Incremental && m_bDesktopFrameValid;
+		if (!bIncremental)
+		{
+			DXGICaptureCopy::CopyPixels(pFrame->Data, pFrame->Pitch, m_desktopFrame.Buffer, m_desktopFrame.Pitch, nWidth, nHeight,
+				FALSE, tagSimdLevel_Auto, &m_frameCopyStats);
+
+			m_frameUpdateStats.FullUpdate   = TRUE;
+			m_frameUpdateStats.BytesCopied  = m_frameUpdateStats.BytesTotal;
+			m_frameUpdateStats.BytesTouched = m_frameUpdateStats.BytesTotal;
+
+			m_bDesktopFrameValid = TRUE;
+			m_mouseBackground.Bounds.Width = 0;
+			return S_OK;
+		}
+
+		// the rects are merged in place, keep the ones of the source untouched
+		m_dirtyRects.assign(pFrame->DirtyRects, pFrame->DirtyRects + pFrame->DirtyRectCount);
+		UINT uiDirtyCount = m_dirtyRects.empty() ? 0 : DXGICaptureDirtyRects::MergeRects(&m_dirtyRects[0], (UINT)m_dirtyRects.size(), nWidth, nHeight);
+
+		m_frameUpdateStats.MoveRectCount  = pFrame->MoveRectCount;
+		m_frameUpdateStats.DirtyRectCount = uiDirtyCount;
+
+		// restore the pixels under the last drawn mouse, then apply the moves
+		if (m_mouseBackground.Bounds.Width > 0)
+		{
+			tagFrameRect rcMouse = {
+				m_mouseBackground.Bounds.X,
+				m_mouseBackground.Bounds.Y,
+				m_mouseBackground.Bounds.X + m_mouseBackground.Bounds.Width,
+				m_mouseBackground.Bounds.Y + m_mouseBackground.Bounds.Height };
+			m_frameUpdateStats.BytesTouched += DXGICaptureDirtyRects::CopyBackground(m_desktopFrame.Buffer, m_desktopFrame.Pitch, m_mouseBackground.Buffer, rcMouse, FALSE);
+			m_mouseBackground.Bounds.Width = 0;
+		}
+
+		m_frameUpdateStats.BytesMoved = DXGICaptureDirtyRects::ApplyMoves(m_desktopFrame.Buffer, m_desktopFrame.Pitch, nWidth, nHeight, pFrame->MoveRects, pFrame->MoveRectCount);
+		if (uiDirtyCount > 0) {
+			m_frameUpdateStats.BytesCopied = DXGICaptureDirtyRects::ApplyDirtyRects(m_desktopFrame.Buffer, m_desktopFrame.Pitch, pFrame->Data, pFrame->Pitch, &m_dirtyRects[0], uiDirtyCount);
+		}
+
+		m_frameUpdateStats.BytesTouched += m_frameUpdateStats.BytesMoved + m_frameUpdateStats.BytesCopied;
+		DXGICaptureCopy::AddCopy(&m_frameCopyStats, m_frameUpdateStats.BytesCopied);
+		return S_OK;
+	}
+
+	inline
+	HRESULT
+	updateRegions(
+		_In_ const tagCaptureSourceFrame *pFrame
+		)
+	{
+		memset(&m_frameUpdateStats, 0, sizeof(m_frameUpdateStats));
+		m_frameUpdateStats.MoveRectCount = pFrame->MoveRectCount;
+
+		const tagCapturePointer *pPointer = m_config.ShowCursor ? pFrame->Pointer : nullptr;
+		for (UINT i = 0; i < m_uiRegionCount; ++i)
+		{
+			HRESULT hr = m_regions[i].Update(pFrame, m_config.Incremental, pPointer, &m_cursorCache, &m_frameUpdateStats, &m_frameCopyStats);
+			CHECK_HR_RETURN(hr);
+		}
+		return S_OK;
+	}
+
+public:
+	CDXGICapturePipeline()
+		: m_pSource(nullptr)
+		, m_bDesktopFrameValid(FALSE)
+		, m_bOutputChanged(FALSE)
+		, m_bPassthrough(FALSE)
+		, m_uiRegionCount(0)
+		, m_ullFrameNumber(0)
+		, m_llTimestamp(0)
+		, m_pMetrics(nullptr)
+	{
+		memset(&m_config, 0, sizeof(m_config));
+		memset(&m_desc, 0, sizeof(m_desc));
+		memset(&m_geometry, 0, sizeof(m_geometry));
+		memset(&m_desktopFrame, 0, sizeof(m_desktopFrame));
+		memset(&m_outputFrame, 0, sizeof(m_outputFrame));
+		memset(&m_mouseBackground, 0, sizeof(m_mouseBackground));
+		memset(&m_tempMouseRotateBuffer, 0, sizeof(m_tempMouseRotateBuffer));
+		memset(&m_frameUpdateStats, 0, sizeof(m_frameUpdateStats));
+		memset(&m_frameCopyStats, 0, sizeof(m_frameCopyStats));
+		memset(&m_yuvFrame, 0, sizeof(m_yuvFrame));
+		memset(&m_yuvImage, 0, sizeof(m_yuvImage));
+		memset(&m_yuvStats, 0, sizeof(m_yuvStats));
+	}
+
+	~CDXGICapturePipeline()
+	{
+		Terminate();
+	}
+
+	//
+	// Attaches the source (not owned) and calculates the output geometry
+	//
+	inline
+	HRESULT
+	Initialize(
+		_In_ IDXGICaptureSource *pSource,
+		_In_ const tagScreenCaptureFilterConfig *pConfig
+		)
+	{
+		CHECK_POINTER_EX(pSource, E_INVALIDARG);
+		CHECK_POINTER_EX(pConfig, E_INVALIDARG);
+
+		Terminate();
+
+		HRESULT hr = pSource->GetDesc(&m_desc);
+		CHECK_HR_RETURN(hr);
+		if ((m_desc.Width <= 0) || (m_desc.Height <= 0)) {
+			return E_INVALIDARG;
+		}
+
+		m_config = *pConfig;
+
+		if (m_config.RegionCount > 0)
+		{
+			hr = DXGICaptureRegion::Validate(&m_config, m_desc.DesktopWidth, m_desc.DesktopHeight);
+			CHECK_HR_RETURN(hr);
+
+			// only the region rects of the desktop image are read
+			tagFrameRect rcCopy[DXGICAPTURE_MAX_REGIONS];
+			for (INT i = 0; i < m_config.RegionCount; ++i)
+			{
+				hr = m_regions[i].Initialize(&m_config.Regions[i], &m_desc, &m_config);
+				CHECK_HR_RETURN(hr);
+				rcCopy[i] = *m_regions[i].GetImageRect();
+			}
+			m_uiRegionCount = (UINT)m_config.RegionCount;
+			m_geometry      = *m_regions[0].GetGeometry();
+			m_bPassthrough  = m_regions[0].IsPassthrough();
+
+			hr = pSource->SetCopyRects(rcCopy, m_uiRegionCount);
+			CHECK_HR_RETURN(hr);
+		}
+		else
+		{
+			memset(&m_geometry, 0, sizeof(m_geometry));
+			m_geometry.RotationMode = m_config.RotationMode;
+			m_geometry.SizeMode     = m_config.SizeMode;
+			m_geometry.OutputSize   = m_config.OutputSize;
+			m_geometry.ScaleX       = 1.0f;
+			m_geometry.ScaleY       = 1.0f;
+
+			hr = DXGICaptureRender::CalculateGeometry(m_desc.DesktopWidth, m_desc.DesktopHeight, m_desc.RotationDegrees, &m_geometry);
+			CHECK_HR_RETURN(hr);
+			hr = DXGICaptureRender::IsGeometryValid(&m_geometry);
+			CHECK_HR_RETURN(hr);
+
+			// rotated outputs are rendered by DXGICaptureRender
+			m_bPassthrough = DXGICaptureRender::IsPassthrough(&m_geometry, m_desc.Width, m_desc.Height);
+			if (!m_bPassthrough && (m_config.ScaleFilter != tagFrameScaleFilter_Default))
+			{
+				hr = m_scaler.SetConfig(&m_geometry, m_desc.Width, m_desc.Height, m_config.ScaleFilter);
+				if (hr != E_NOTIMPL) {
+					CHECK_HR_RETURN(hr);
+				}
+			}
+
+			hr = DXGICaptureFrameBuffer::Resize(&m_desktopFrame, (UINT)(m_desc.Width * m_desc.Height * 4));
+			CHECK_HR_RETURN(hr);
+			m_desktopFrame.BytesPerPixel = 4;
+			m_desktopFrame.Pitch         = m_desc.Width * 4;
+			m_desktopFrame.Bounds.Width  = m_desc.Width;
+			m_desktopFrame.Bounds.Height = m_desc.Height;
+
+			if (!m_bPassthrough)
+			{
+				hr = DXGICaptureFrameBuffer::Resize(&m_outputFrame, (UINT)(m_geometry.OutputSize.Width * m_geometry.OutputSize.Height * 4));
+				CHECK_HR_RETURN(hr);
+				m_outputFrame.BytesPerPixel = 4;
+				m_outputFrame.Pitch         = m_geometry.OutputSize.Width * 4;
+				m_outputFrame.Bounds.Width  = m_geometry.OutputSize.Width;
+				m_outputFrame.Bounds.Height = m_geometry.OutputSize.Height;
+			}
+
+			hr = pSource->SetCopyRects(nullptr, 0);
+			CHECK_HR_RETURN(hr);
+		}
+
+		if (m_config.SkipUnchanged)
+		{
+			hr = m_tileHasher.Initialize(m_geometry.OutputSize.Width, m_geometry.OutputSize.Height);
+			CHECK_HR_RETURN(hr);
+		}
+
+		if (m_config.YuvFormat != tagYuvFormat_None)
+		{
+			UINT uiYuvSize = DXGICaptureYuv::GetImageSize(m_config.YuvFormat, m_geometry.OutputSize.Width, m_geometry.OutputSize.Height);
+			hr = DXGICaptureFrameBuffer::Resize(&m_yuvFrame, uiYuvSize);
+			CHECK_HR_RETURN(hr);
+			hr = DXGICaptureYuv::SetupImage(m_config.YuvFormat, m_config.YuvMatrix, m_config.YuvRange,
+				m_geometry.OutputSize.Width, m_geometry.OutputSize.Height, m_yuvFrame.Buffer, m_yuvFrame.BufferSize, &m_yuvImage);
+			CHECK_HR_RETURN(hr);
+		}
+
+		m_pSource = pSource;
+		return S_OK;
+	}
+
+	inline void Terminate()
+	{
+		DXGICaptureFrameBuffer::Free(&m_desktopFrame);
+		DXGICaptureFrameBuffer::Free(&m_outputFrame);
+		DXGICaptureFrameBuffer::Free(&m_mouseBackground);
+		DXGICaptureFrameBuffer::Free(&m_tempMouseRotateBuffer);
+		DXGICaptureFrameBuffer::Free(&m_yuvFrame);
+		memset(&m_yuvImage, 0, sizeof(m_yuvImage));
+		memset(&m_yuvStats, 0, sizeof(m_yuvStats));
+		m_scaler.Reset();
+		m_cursorCache.Clear();
+		m_dirtyRects.clear();
+		m_bDesktopFrameValid = FALSE;
+		m_bOutputChanged     = FALSE;
+		m_bPassthrough       = FALSE;
+		m_tileHasher.Reset();
+		for (UINT i = 0; i < DXGICAPTURE_MAX_REGIONS; ++i) {
+			m_regions[i].Terminate();
+		}
+		m_uiRegionCount      = 0;
+		m_ullFrameNumber     = 0;
+		m_llTimestamp        = 0;
+		m_pSource            = nullptr;
+	}
+
+	//
+	// Acquires the next desktop image, draws the pointer and renders the output image.
+	// Returns S_FALSE if no new image arrived within the timeout.
+	//
+	inline
+	HRESULT
+	ProcessFrame(
+		_In_ UINT uiTimeoutMsec,
+		_Out_opt_ BOOL *pRetIsTimeout
+		)
+	{
+		RESET_POINTER_EX(pRetIsTimeout, FALSE);
+		CHECK_POINTER_EX(m_pSource, E_UNEXPECTED);
+
+		CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+		tagCaptureFrameTimes times;
+		CDXGICaptureMetrics::ResetFrameTimes(&times);
+
+		tagCaptureSourceFrame frame;
+		HRESULT hr = m_pSource->AcquireFrame(uiTimeoutMsec, &frame);
+		if (hr == S_FALSE)
+		{
+			if (nullptr != m_pMetrics) {
+				m_pMetrics->RecordAcquire(CDXGICaptureMetrics::Lap(&tick), TRUE, 0);
+			}
+			RESET_POINTER_EX(pRetIsTimeout, TRUE);
+			return S_FALSE;
+		}
+		CHECK_HR_RETURN(hr);
+		if (nullptr != m_pMetrics) {
+			m_pMetrics->RecordAcquire(CDXGICaptureMetrics::Lap(&tick), FALSE, frame.AccumulatedFrames);
+		}
+
+		memset(&m_frameCopyStats, 0, sizeof(m_frameCopyStats));
+		m_frameCopyStats.Passthrough = m_bPassthrough;
+
+		if (m_uiRegionCount > 0) {
+			hr = updateRegions(&frame);
+		}
+		else {
+			hr = updateDesktopFrame(&frame);
+		}
+		CDXGICaptureMetrics::AddFrameTime(&times, tagCaptureStage_Copy, CDXGICaptureMetrics::Lap(&tick));
+		if (SUCCEEDED(hr) && (m_uiRegionCount == 0) && m_config.ShowCursor && (nullptr != frame.Pointer))
+		{
+			hr = DXGICapturePointer::Draw(
+				frame.Pointer,
+				m_desc.DesktopWidth,
+				m_desc.DesktopHeight,
+				m_desc.RotationDegrees,
+				&m_cursorCache,
+				&m_tempMouseRotateBuffer,
+				m_desktopFrame.Buffer,
+				m_desktopFrame.Pitch,
+				m_desc.Width,
+				m_desc.Height,
+				m_config.Incremental ? &m_mouseBackground : nullptr);
+			CDXGICaptureMetrics::AddFrameTime(&times, tagCaptureStage_CursorComposite, CDXGICaptureMetrics::Lap(&tick));
+		}
+
+		m_ullFrameNumber = frame.FrameNumber;
+		m_llTimestamp    = frame.Timestamp;
+
+		HRESULT hrRelease = m_pSource->ReleaseFrame();
+		CHECK_HR_RETURN(hr);
+		CHECK_HR_RETURN(hrRelease);
+
+		const tagFrameBufferInfo *pOutput = GetOutputFrame();
+		if (m_uiRegionCount > 0)
+		{
+			hr = S_OK;
+			for (UINT i = 0; SUCCEEDED(hr) && (i < m_uiRegionCount); ++i) {
+				hr = m_regions[i].Render(&m_frameCopyStats);
+			}
+			CHECK_HR_RETURN(hr);
+		}
+		else if (m_bPassthrough) {
+			hr = S_OK;
+		}
+		else if (m_scaler.IsConfigured()) {
+			hr = m_scaler.Scale(m_desktopFrame.Buffer, m_desktopFrame.Pitch, m_outputFrame.Buffer, m_outputFrame.Pitch);
+		}
+		else
+		{
+			hr = DXGICaptureRender::Render(
+				m_desktopFrame.Buffer,
+				m_desktopFrame.Pitch,
+				m_desc.Width,
+				m_desc.Height,
+				&m_geometry,
+				m_outputFrame.Buffer,
+				m_outputFrame.Pitch);
+		}
+		CHECK_HR_RETURN(hr);
+		if (!m_bPassthrough && (m_uiRegionCount == 0)) {
+			DXGICaptureCopy::AddCopy(&m_frameCopyStats, (UINT64)pOutput->Pitch * pOutput->Bounds.Height);
+		}
+
+		m_bOutputChanged = TRUE;
+		if (m_config.SkipUnchanged)
+		{
+			hr = m_tileHasher.Update(pOutput->Buffer, pOutput->Pitch);
+			CHECK_HR_RETURN(hr);
+			m_bOutputChanged = (hr == S_OK);
+		}
+
+		// an unchanged output keeps the planes of the last image
+		if ((m_yuvImage.Format != tagYuvFormat_None) && m_bOutputChanged)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			hr = DXGICaptureYuv::Convert(pOutput->Buffer, pOutput->Pitch, &m_yuvImage);
+			CHECK_HR_RETURN(hr);
+			m_yuvStats.Frames++;
+			m_yuvStats.ConvertUsec += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		if (nullptr != m_pMetrics)
+		{
+			CDXGICaptureMetrics::AddFrameTime(&times, tagCaptureStage_Render, CDXGICaptureMetrics::Lap(&tick));
+			m_pMetrics->RecordFrame(&times, m_frameCopyStats.BytesCopied);
+		}
+		return S_OK;
+	}
+
+	//
+	// Attaches metrics (not owned, nullptr detaches), they may be shared with other pipelines
+	//
+	inline void SetMetrics(_In_opt_ CDXGICaptureMetrics *pMetrics) { m_pMetrics = pMetrics; }
+	inline CDXGICaptureMetrics* GetMetrics() const { return m_pMetrics; }
+
+	inline const tagFrameBufferInfo* GetOutputFrame() const
+	{
+		if (m_uiRegionCount > 0) {
+			return m_regions[0].GetOutputFrame();
+		}
+		return m_bPassthrough ? &m_desktopFrame : &m_outputFrame;
+	}
+	// empty with regions
+	inline const tagFrameBufferInfo* GetDesktopFrame() const { return &m_desktopFrame; }
+	inline const tagFrameGeometry* GetGeometry() const { return &m_geometry; }
+	inline const CDXGICaptureScaler* GetScaler() const { return (m_uiRegionCount > 0) ? m_regions[0].GetScaler() : &m_scaler; }
+	inline UINT GetRegionCount() const { return m_uiRegionCount; }
+	inline const CDXGICaptureRegionFrame* GetRegion(_In_ UINT uiIndex) const { return (uiIndex < m_uiRegionCount) ? &m_regions[uiIndex] : nullptr; }
+	inline const tagFrameBufferInfo* GetRegionOutput(_In_ UINT uiIndex) const { return (uiIndex < m_uiRegionCount) ? m_regions[uiIndex].GetOutputFrame() : nullptr; }
+	inline UINT64 GetFrameNumber() const { return m_ullFrameNumber; }
+	inline INT64 GetTimestamp() const { return m_llTimestamp; }
+	// FALSE if the output image equals the last one (SkipUnchanged), otherwise always TRUE
+	inline BOOL IsOutputChanged() const { return m_bOutputChanged; }
+	inline const CDXGITileHasher* GetTileHasher() const { return &m_tileHasher; }
+	inline BOOL IsPassthrough() const { return m_bPassthrough; }
+	// NV12/I420 planes of the output image, Format is tagYuvFormat_None without a YuvFormat
+	inline const tagYuvImage* GetYuvImage() const { return &m_yuvImage; }
+
+	inline void GetFrameUpdateStats(_Out_ tagFrameUpdateStats *pStats) const
+	{
+		*pStats = m_frameUpdateStats;
+	}
+
+	inline void GetFrameCopyStats(_Out_ tagFrameCopyStats *pStats) const
+	{
+		*pStats = m_frameCopyStats;
+	}
+
+	inline void GetYuvConvertStats(_Out_ tagYuvConvertStats *pStats) const
+	{
+		*pStats = m_yuvStats;
+	}
+
+}; // end class CDXGICapturePipeline
+
+#endif // __DXGICAPTUREPIPELINE_H__
@@ -0,0 +1,204 @@
+/*****************************************************************************
+* DXGICapturePlatform.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREPLATFORM_H__
+#define __DXGICAPTUREPLATFORM_H__
+
+//
+// Minimal platform layer for the pixel kernels.
+// The kernels only work on plain buffers and pitches, so they can be built
+// without the DirectX headers (e.g. for benchmarking on Linux).
+//
+#if defined(_WIN32)
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef uint8_t             BYTE;
+typedef int16_t             SHORT;
+typedef uint16_t            USHORT;
+typedef int32_t             INT;
+typedef uint32_t            UINT;
+typedef int32_t             LONG;
+typedef int32_t             BOOL;
+typedef float               FLOAT;
+typedef int64_t             INT64;
+typedef uint64_t            UINT64;
+
+typedef int32_t             HRESULT;
+
+#ifndef TRUE
+#define TRUE                1
+#endif
+#ifndef FALSE
+#define FALSE               0
+#endif
+
+#define S_OK                ((HRESULT)0x00000000L)
+#define S_FALSE             ((HRESULT)0x00000001L)
+#define E_NOTIMPL           ((HRESULT)0x80004001L)
+#define E_POINTER           ((HRESULT)0x80004003L)
+#define E_FAIL              ((HRESULT)0x80004005L)
+#define E_UNEXPECTED        ((HRESULT)0x8000FFFFL)
+#define E_OUTOFMEMORY       ((HRESULT)0x8007000EL)
+#define E_INVALIDARG        ((HRESULT)0x80070057L)
+#define SUCCEEDED(hr)       (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)          (((HRESULT)(hr)) < 0)
+
+// SAL annotations
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _Inout_opt_
+#define _In_reads_bytes_(s)
+#define _Out_writes_bytes_(s)
+#define _Field_size_bytes_(s)
+#endif // _WIN32
+
+//
+// SIMD instruction sets
+//
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DXGICAPTURE_HAVE_X86    1
+#include <emmintrin.h>          // SSE2
+#include <immintrin.h>          // AVX2
+#if !defined(_WIN32)
+#include <cpuid.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64) || defined(_M_ARM)
+#define DXGICAPTURE_HAVE_NEON   1
+#include <arm_neon.h>
+#endif
+
+// Functions that use AVX2 intrinsics must be compiled for AVX2 with GCC/Clang.
+// MSVC allows the intrinsics without /arch:AVX2.
+#if defined(DXGICAPTURE_HAVE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define DXGICAPTURE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DXGICAPTURE_TARGET_AVX2
+#endif
+
+// Cache line alignment of counters written by several threads.
+// VS2013 has no alignas.
+#define DXGICAPTURE_CACHE_LINE  64
+#if defined(_MSC_VER) && (_MSC_VER < 1900)
+#define DXGICAPTURE_CACHE_ALIGN __declspec(align(64))
+#else
+#define DXGICAPTURE_CACHE_ALIGN alignas(DXGICAPTURE_CACHE_LINE)
+#endif
+
+//
+// enum tagSimdLevel_e
+//
+typedef enum tagSimdLevel_e : UINT
+{
+	tagSimdLevel_Auto   = 0x0, /* best available for the running cpu */
+	tagSimdLevel_Scalar = 0x1,
+	tagSimdLevel_SSE2   = 0x2,
+	tagSimdLevel_AVX2   = 0x3,
+	tagSimdLevel_NEON   = 0x4,
+} tagSimdLevel;
+
+//
+// class DXGICaptureCpu
+//
+class DXGICaptureCpu
+{
+private:
+	static
+	inline
+	tagSimdLevel
+	detectSimdLevel()
+	{
+#if defined(DXGICAPTURE_HAVE_X86)
+		BOOL bAVX2 = FALSE;
+#if defined(_WIN32)
+		int regs[4];
+		__cpuid(regs, 0);
+		if (regs[0] >= 7)
+		{
+			__cpuid(regs, 1);
+			BOOL bOSXSave = (regs[2] & (1 << 27)) != 0;
+			BOOL bAVX     = (regs[2] & (1 << 28)) != 0;
+			__cpuidex(regs, 7, 0);
+			if (bOSXSave && bAVX && (regs[1] & (1 << 5)) && ((_xgetbv(0) & 0x6) == 0x6)) {
+				bAVX2 = TRUE;
+			}
+		}
+#else
+		__builtin_cpu_init();
+		bAVX2 = __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#endif
+		return bAVX2 ? tagSimdLevel_AVX2 : tagSimdLevel_SSE2;
+#elif defined(DXGICAPTURE_HAVE_NEON)
+		return tagSimdLevel_NEON;
+#else
+		return tagSimdLevel_Scalar;
+#endif
+	} // detectSimdLevel
+
+public:
+	//
+	// Returns the best instruction set of the running cpu
+	//
+	static
+	inline
+	tagSimdLevel
+	GetSimdLevel()
+	{
+		// benign race: every thread computes the same value
+		static volatile UINT s_uiSimdLevel = (UINT)tagSimdLevel_Auto;
+		if (s_uiSimdLevel == (UINT)tagSimdLevel_Auto) {
+			s_uiSimdLevel = (UINT)detectSimdLevel();
+		}
+		return (tagSimdLevel)s_uiSimdLevel;
+	} // GetSimdLevel
+
+	//
+	// Resolves the requested level to a level that can run on this cpu
+	//
+	static
+	inline
+	tagSimdLevel
+	ResolveSimdLevel(
+		_In_ tagSimdLevel level
+		)
+	{
+		tagSimdLevel best = GetSimdLevel();
+		if (level == tagSimdLevel_Auto) {
+			return best;
+		}
+		if (level == tagSimdLevel_Scalar) {
+			return level;
+		}
+		if (best == tagSimdLevel_NEON) {
+			return (level == tagSimdLevel_NEON) ? level : tagSimdLevel_Scalar;
+		}
+		if ((level == tagSimdLevel_NEON) || (best == tagSimdLevel_Scalar)) {
+			return tagSimdLevel_Scalar;
+		}
+		return (level < best) ? level : best;
+	} // ResolveSimdLevel
+
+}; // end class DXGICaptureCpu
+
+#endif // __DXGICAPTUREPLATFORM_H__
@@ -0,0 +1,441 @@
+/*****************************************************************************
+* DXGICapturePointer.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREPOINTER_H__
+#define __DXGICAPTUREPOINTER_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureBlend.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureCursorShape.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICaptureRotate.h"
+
+#include <algorithm>
+#include <string.h>
+
+// same values as DXGI_OUTDUPL_POINTER_SHAPE_TYPE
+#define DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME     0x1
+#define DXGICAPTURE_POINTER_SHAPE_TYPE_COLOR          0x2
+#define DXGICAPTURE_POINTER_SHAPE_TYPE_MASKED_COLOR   0x4
+
+//
+// struct tagCapturePointer_s
+//
+// Pointer state of a captured desktop image: position in desktop coordinates
+// and the raw shape as delivered by the desktop duplication.
+//
+typedef struct tagCapturePointer_s
+{
+	BOOL                            Visible;
+	LONG                            X;
+	LONG                            Y;
+	UINT                            Type;      /* DXGICAPTURE_POINTER_SHAPE_TYPE_xxx */
+	UINT                            Width;
+	UINT                            Height;    /* monochrome: AND + XOR mask, twice the pointer height */
+	UINT                            Pitch;
+	UINT                            ShapeSize;
+	_Field_size_bytes_(ShapeSize) const BYTE* Shape;
+	UINT64                          ShapeHash; /* CDXGICursorCache::HashBytes of the shape */
+} tagCapturePointer;
+
+//
+// class DXGICapturePointer
+//
+// Processes (expand, rotate, cache) and draws the pointer shape into a 32bpp
+// desktop image, independent of the capture source.
+//
+class DXGICapturePointer
+{
+public:
+	//
+	// Returns the clockwise rotation (in degrees) that brings the mouse shape to
+	// the desktop image orientation, nDisplayRotation is the rotation of the display
+	//
+	static
+	inline
+	INT
+	GetRotateDegrees(
+		_In_ INT nDisplayRotation
+		)
+	{
+		switch (nDisplayRotation)
+		{
+		case 90:
+			return 270; // Rotate -90 or +270
+		case 180:
+			return 180; // Rotate -180 or +180
+		case 270:
+			return 90;  // Rotate -270 or +90
+		default:
+			return 0;
+		}
+	} // GetRotateDegrees
+
+	//
+	// Expands and rotates the mouse shape, the bounds of the result are in mouse shape coordinates
+	//
+	static
+	inline
+	HRESULT
+	ProcessShape(
+		_In_ const tagCapturePointer *pPointer,
+		_In_ INT nRotateDegrees,
+		_Inout_ tagFrameBufferInfo *pBufferInfo,
+		_Inout_ tagFrameBufferInfo *pRotateBuffer
+		)
+	{
+		CHECK_POINTER_EX(pPointer, E_INVALIDARG);
+		CHECK_POINTER_EX(pBufferInfo, E_INVALIDARG);
+
+		HRESULT hr = S_OK;
+
+		pBufferInfo->BytesPerPixel = 4;
+		pBufferInfo->Bounds.X      = 0;
+		pBufferInfo->Bounds.Y      = 0;
+		pBufferInfo->Bounds.Width  = pPointer->Width;
+		pBufferInfo->Bounds.Height = (pPointer->Type == DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME)
+			? (INT)(pPointer->Height / 2)
+			: (INT)pPointer->Height;
+		pBufferInfo->Pitch         = pBufferInfo->Bounds.Width * 4;
+
+		switch (pPointer->Type)
+		{
+		case DXGICAPTURE_POINTER_SHAPE_TYPE_COLOR:
+		{
+			// Resize mouseshape buffer (if necessary), the rows are packed
+			hr = DXGICaptureFrameBuffer::Resize(pBufferInfo, pBufferInfo->Bounds.Height * pBufferInfo->Pitch);
+			if (FAILED(hr)) {
+				return hr;
+			}
+
+			for (INT y = 0; y < pBufferInfo->Bounds.Height; ++y) {
+				memcpy(pBufferInfo->Buffer + y * pBufferInfo->Pitch, pPointer->Shape + y * pPointer->Pitch, pBufferInfo->Pitch);
+			}
+			break;
+		}
+
+		case DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME:
+		{
+			// Resize mouseshape buffer (if necessary), AND mask plane + XOR mask plane
+			hr = DXGICaptureFrameBuffer::Resize(pBufferInfo, 2 * pBufferInfo->Bounds.Height * pBufferInfo->Pitch);
+			if (FAILED(hr)) {
+				return hr;
+			}
+
+			DXGICaptureCursorShape::ExpandMonochrome(
+				pPointer->Shape, (INT)pPointer->Pitch,
+				pBufferInfo->Bounds.Width, pBufferInfo->Bounds.Height,
+				pBufferInfo->Buffer, pBufferInfo->Pitch,
+				pBufferInfo->Buffer + pBufferInfo->Bounds.Height * pBufferInfo->Pitch, pBufferInfo->Pitch);
+			break;
+		}
+
+		case DXGICAPTURE_POINTER_SHAPE_TYPE_MASKED_COLOR:
+		{
+			// Resize mouseshape buffer (if necessary), AND mask plane + XOR mask plane
+			hr = DXGICaptureFrameBuffer::Resize(pBufferInfo, 2 * pBufferInfo->Bounds.Height * pBufferInfo->Pitch);
+			if (FAILED(hr)) {
+				return hr;
+			}
+
+			DXGICaptureCursorShape::ExpandMaskedColor(
+				pPointer->Shape, (INT)pPointer->Pitch,
+				pBufferInfo->Bounds.Width, pBufferInfo->Bounds.Height,
+				pBufferInfo->Buffer, pBufferInfo->Pitch,
+				pBufferInfo->Buffer + pBufferInfo->Bounds.Height * pBufferInfo->Pitch, pBufferInfo->Pitch);
+			break;
+		}
+
+		default:
+			return E_INVALIDARG;
+
+		}
+
+		if (nRotateDegrees == 0) {
+			return S_OK;
+		}
+
+		CHECK_POINTER_EX(pRotateBuffer, E_INVALIDARG);
+
+		INT nRotatedWidth;
+		INT nRotatedHeight;
+		DXGICaptureRotate::GetRotatedSize(pBufferInfo->Bounds.Width, pBufferInfo->Bounds.Height, nRotateDegrees, &nRotatedWidth, &nRotatedHeight);
+
+		// color shape has one plane, masked shapes have AND + XOR planes
+		INT nPlaneCount = (pPointer->Type == DXGICAPTURE_POINTER_SHAPE_TYPE_COLOR) ? 1 : 2;
+		INT nPlaneSize  = pBufferInfo->Bounds.Height * pBufferInfo->Pitch;
+
+		// Resize rotate buffer (if necessary)
+		hr = DXGICaptureFrameBuffer::Resize(pRotateBuffer, nPlaneCount * nPlaneSize);
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		for (INT nPlane = 0; nPlane < nPlaneCount; ++nPlane)
+		{
+			DXGICaptureRotate::Rotate(
+				pBufferInfo->Buffer + nPlane * nPlaneSize, pBufferInfo->Pitch, pBufferInfo->Bounds.Width, pBufferInfo->Bounds.Height,
+				pRotateBuffer->Buffer + nPlane * nPlaneSize, nRotatedWidth * 4,
+				nRotateDegrees);
+		}
+
+		// the rotated image becomes the mouseshape buffer, the old one is kept for the next rotation
+		std::swap(pBufferInfo->Buffer, pRotateBuffer->Buffer);
+		std::swap(pBufferInfo->BufferSize, pRotateBuffer->BufferSize);
+
+		pBufferInfo->Bounds.Width  = nRotatedWidth;
+		pBufferInfo->Bounds.Height = nRotatedHeight;
+		pBufferInfo->Pitch         = nRotatedWidth * 4;
+
+		return S_OK;
+	} // ProcessShape
+
+	//
+	// Gets the processed mouse shape from the cache (processes it on a miss) and
+	// translates its position to the desktop image. nDesktopWidth/nDesktopHeight
+	// is the size of the desktop in desktop coordinates (after display rotation).
+	// pMouseShape only refers to the cached buffer, it is valid until the next cache insert.
+	//
+	static
+	inline
+	HRESULT
+	ProcessMask(
+		_In_ const tagCapturePointer *pPointer,
+		_In_ INT nDesktopWidth,
+		_In_ INT nDesktopHeight,
+		_In_ INT nDisplayRotation,
+		_Inout_ CDXGICursorCache *pCursorCache,
+		_Inout_ tagFrameBufferInfo *pRotateBuffer,
+		_Out_ tagFrameBufferInfo *pMouseShape
+		)
+	{
+		CHECK_POINTER_EX(pPointer, E_INVALIDARG);
+		CHECK_POINTER_EX(pCursorCache, E_INVALIDARG);
+		CHECK_POINTER_EX(pMouseShape, E_INVALIDARG);
+
+		memset(pMouseShape, 0, sizeof(tagFrameBufferInfo));
+
+		if (!pPointer->Visible || (nullptr == pPointer->Shape)) {
+			return S_FALSE;
+		}
+
+		HRESULT hr = S_OK;
+		INT nRotateDegrees = GetRotateDegrees(nDisplayRotation);
+
+		UINT64 ullKey = CDXGICursorCache::MakeKey(
+			pPointer->ShapeHash,
+			pPointer->Type,
+			pPointer->Width,
+			pPointer->Height,
+			pPointer->Pitch,
+			nRotateDegrees);
+
+		tagCursorCacheEntry *pEntry = pCursorCache->Find(ullKey);
+		if (nullptr == pEntry)
+		{
+			pEntry = pCursorCache->Insert(ullKey);
+
+			tagFrameBufferInfo ShapeBuffer;
+			memset(&ShapeBuffer, 0, sizeof(ShapeBuffer));
+			ShapeBuffer.Buffer     = pEntry->Buffer;
+			ShapeBuffer.BufferSize = pEntry->BufferSize;
+
+			hr = ProcessShape(pPointer, nRotateDegrees, &ShapeBuffer, pRotateBuffer);
+
+			// the buffer may be reallocated or swapped with the rotate buffer
+			pEntry->Buffer     = ShapeBuffer.Buffer;
+			pEntry->BufferSize = ShapeBuffer.BufferSize;
+			if (FAILED(hr))
+			{
+				pCursorCache->Remove(pEntry);
+				return hr;
+			}
+
+			pEntry->Width  = ShapeBuffer.Bounds.Width;
+			pEntry->Height = ShapeBuffer.Bounds.Height;
+			pEntry->Pitch  = ShapeBuffer.Pitch;
+		}
+
+		pMouseShape->Buffer        = pEntry->Buffer;
+		pMouseShape->BufferSize    = pEntry->BufferSize;
+		pMouseShape->BytesPerPixel = 4;
+		pMouseShape->Bounds.Width  = pEntry->Width;
+		pMouseShape->Bounds.Height = pEntry->Height;
+		pMouseShape->Pitch         = pEntry->Pitch;
+
+		// size of the mouse shape before rotation
+		INT ShapeWidth  = (INT)pPointer->Width;
+		INT ShapeHeight = (pPointer->Type == DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME)
+			? (INT)(pPointer->Height / 2)
+			: (INT)pPointer->Height;
+
+		switch (nDisplayRotation)
+		{
+		case 90:
+			// translate bounds
+			pMouseShape->Bounds.X = pPointer->Y;
+			pMouseShape->Bounds.Y = nDesktopWidth - (pPointer->X + ShapeWidth);
+			break;
+		case 180:
+			// translate position
+			pMouseShape->Bounds.X = nDesktopWidth  - (pPointer->X + ShapeWidth);
+			pMouseShape->Bounds.Y = nDesktopHeight - (pPointer->Y + ShapeHeight);
+			break;
+		case 270:
+			// translate bounds
+			pMouseShape->Bounds.X = nDesktopHeight - (pPointer->Y + ShapeHeight);
+			pMouseShape->Bounds.Y = pPointer->X;
+			break;
+		default:
+			pMouseShape->Bounds.X = pPointer->X;
+			pMouseShape->Bounds.Y = pPointer->Y;
+			break;
+		}
+
+		return S_OK;
+	} // ProcessMask
+
+	//
+	// Draws the mouse into a 32bpp surface (the desktop image as acquired).
+	// pBackground (optional) receives the pixels under the mouse to restore them later.
+	// Returns S_FALSE if there is nothing to draw.
+	//
+	static
+	inline
+	HRESULT
+	Draw(
+		_In_ const tagCapturePointer *pPointer,
+		_In_ INT nDesktopWidth,
+		_In_ INT nDesktopHeight,
+		_In_ INT nDisplayRotation,
+		_Inout_ CDXGICursorCache *pCursorCache,
+		_Inout_ tagFrameBufferInfo *pTempRotateBuffer,
+		_Inout_ BYTE *pSurfBits,
+		_In_ INT SurfPitch,
+		_In_ INT SurfWidth,
+		_In_ INT SurfHeight,
+		_Inout_opt_ tagFrameBufferInfo *pBackground = nullptr
+		)
+	{
+		CHECK_POINTER_EX(pPointer, E_INVALIDARG);
+		CHECK_POINTER_EX(pCursorCache, E_INVALIDARG);
+		CHECK_POINTER_EX(pTempRotateBuffer, E_INVALIDARG);
+		CHECK_POINTER_EX(pSurfBits, E_INVALIDARG);
+
+		if (nullptr != pBackground) {
+			pBackground->Bounds.Width = 0;
+		}
+
+		HRESULT hr = S_OK;
+
+		tagFrameBufferInfo MouseShape;
+		hr = ProcessMask(pPointer, nDesktopWidth, nDesktopHeight, nDisplayRotation, pCursorCache, pTempRotateBuffer, &MouseShape);
+		if (hr != S_OK) {
+			return hr;
+		}
+
+		// Buffer used if necessary (in case of monochrome or masked pointer)
+		BYTE* InitBuffer = MouseShape.Buffer;
+
+		// Clipping adjusted coordinates / dimensions
+		INT PtrWidth  = (INT)MouseShape.Bounds.Width;
+		INT PtrHeight = (INT)MouseShape.Bounds.Height;
+
+		INT PtrLeft   = (INT)MouseShape.Bounds.X;
+		INT PtrTop    = (INT)MouseShape.Bounds.Y;
+		INT PtrPitch  = (INT)MouseShape.Pitch;
+
+		INT SrcLeft   = 0;
+		INT SrcTop    = 0;
+		INT SrcWidth  = PtrWidth;
+		INT SrcHeight = PtrHeight;
+
+		// both sides are clipped, a mouseshape can be wider/taller than a small surface (region)
+		if (PtrLeft < 0)
+		{
+			// crop mouseshape left
+			SrcLeft = -PtrLeft;
+			// new mouse x position for drawing
+			PtrLeft = 0;
+		}
+		if (PtrLeft + (SrcWidth - SrcLeft) > SurfWidth)
+		{
+			// crop mouseshape width
+			SrcWidth = SrcLeft + SurfWidth - PtrLeft;
+		}
+
+		if (PtrTop < 0)
+		{
+			// crop mouseshape top
+			SrcTop = -PtrTop;
+			// new mouse y position for drawing
+			PtrTop = 0;
+		}
+		if (PtrTop + (SrcHeight - SrcTop) > SurfHeight)
+		{
+			// crop mouseshape height
+			SrcHeight = SrcTop + SurfHeight - PtrTop;
+		}
+
+		// completely outside of the surface
+		tagFrameRect rcMouse = { PtrLeft, PtrTop, PtrLeft + SrcWidth - SrcLeft, PtrTop + SrcHeight - SrcTop };
+		if (DXGICaptureDirtyRects::IsRectEmpty(rcMouse)) {
+			return S_FALSE;
+		}
+
+		// the pixels under the mouse are kept to restore them later (incremental update)
+		if (nullptr != pBackground)
+		{
+			hr = DXGICaptureFrameBuffer::Resize(pBackground, (UINT)((rcMouse.Right - rcMouse.Left) * (rcMouse.Bottom - rcMouse.Top) * 4));
+			if (FAILED(hr)) {
+				return hr;
+			}
+
+			DXGICaptureDirtyRects::CopyBackground(pSurfBits, SurfPitch, pBackground->Buffer, rcMouse, TRUE);
+			pBackground->Bounds.X      = rcMouse.Left;
+			pBackground->Bounds.Y      = rcMouse.Top;
+			pBackground->Bounds.Width  = rcMouse.Right - rcMouse.Left;
+			pBackground->Bounds.Height = rcMouse.Bottom - rcMouse.Top;
+		}
+
+		// 0xAARRGGBB
+		BYTE* DstBuffer = pSurfBits + PtrTop * SurfPitch + PtrLeft * 4;
+		const BYTE* SrcBuffer = InitBuffer + SrcTop * PtrPitch + SrcLeft * 4;
+
+		if (pPointer->Type == DXGICAPTURE_POINTER_SHAPE_TYPE_COLOR)
+		{
+			// Alpha blending
+			DXGICaptureBlend::AlphaBlend(DstBuffer, SurfPitch, SrcBuffer, PtrPitch, SrcWidth - SrcLeft, SrcHeight - SrcTop);
+		}
+		else
+		{
+			// AND mask plane is followed by the XOR mask plane
+			DXGICaptureCursorShape::ComposeMask(
+				DstBuffer, SurfPitch,
+				SrcBuffer, PtrPitch,
+				SrcBuffer + PtrHeight * PtrPitch, PtrPitch,
+				SrcWidth - SrcLeft, SrcHeight - SrcTop);
+		}
+
+		return S_OK;
+	} // Draw
+
+}; // end class DXGICapturePointer
+
+#endif // __DXGICAPTUREPOINTER_H__
@@ -0,0 +1,358 @@
+/*****************************************************************************
+* DXGICaptureQoi.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREQOI_H__
+#define __DXGICAPTUREQOI_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureFrameBuffer.h"
+
+#include <string.h>
+
+#define DXGICAPTURE_QOI_HEADER_SIZE     14
+#define DXGICAPTURE_QOI_END_SIZE        8
+#define DXGICAPTURE_QOI_MAX_PIXELS      400000000 /* limit of the reference decoder */
+
+#define DXGICAPTURE_QOI_OP_INDEX        0x00 /* 00xxxxxx */
+#define DXGICAPTURE_QOI_OP_DIFF         0x40 /* 01xxxxxx */
+#define DXGICAPTURE_QOI_OP_LUMA         0x80 /* 10xxxxxx */
+#define DXGICAPTURE_QOI_OP_RUN          0xC0 /* 11xxxxxx */
+#define DXGICAPTURE_QOI_OP_RGB          0xFE
+#define DXGICAPTURE_QOI_OP_RGBA         0xFF
+#define DXGICAPTURE_QOI_MASK_2          0xC0
+
+//
+// class DXGICaptureQoi
+//
+// Portable QOI ("Quite OK Image", qoiformat.org) codec of 32bpp BGRA images:
+// lossless, one linear pass over the rows, no tables beyond the 64 entry
+// color index. Encodes RGBA (4 channels, sRGB) straight from the pitched
+// capture buffer; the decoder returns a tightly packed BGRA image.
+//
+class DXGICaptureQoi
+{
+private:
+	static
+	inline
+	void
+	putU32BE(
+		_Out_ BYTE *p,
+		_In_ UINT v
+		)
+	{
+		p[0] = (BYTE)(v >> 24);
+		p[1] = (BYTE)(v >> 16);
+		p[2] = (BYTE)(v >> 8);
+		p[3] = (BYTE)v;
+	} // putU32BE
+
+	static
+	inline
+	UINT
+	getU32BE(
+		_In_ const BYTE *p
+		)
+	{
+		return ((UINT)p[0] << 24) | ((UINT)p[1] << 16) | ((UINT)p[2] << 8) | (UINT)p[3];
+	} // getU32BE
+
+	//
+	// index position of the BGRA pixel (r * 3 + g * 5 + b * 7 + a * 11) % 64
+	//
+	static
+	inline
+	UINT
+	hashPixel(
+		_In_ UINT uiPixel
+		)
+	{
+		UINT b = uiPixel & 0xFF;
+		UINT g = (uiPixel >> 8) & 0xFF;
+		UINT r = (uiPixel >> 16) & 0xFF;
+		UINT a = uiPixel >> 24;
+		return (r * 3 + g * 5 + b * 7 + a * 11) & 63;
+	} // hashPixel
+
+public:
+	//
+	// Size of the worst case output (every pixel QOI_OP_RGBA)
+	//
+	static
+	inline
+	UINT64
+	GetMaxEncodedSize(
+		_In_ INT nWidth,
+		_In_ INT nHeight
+		)
+	{
+		return DXGICAPTURE_QOI_HEADER_SIZE + (UINT64)nWidth * (UINT64)nHeight * 5 + DXGICAPTURE_QOI_END_SIZE;
+	} // GetMaxEncodedSize
+
+	//
+	// Encodes the 32bpp image into pOutput (grown as needed), *pRetSize receives the encoded size
+	//
+	static
+	inline
+	HRESULT
+	Encode(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize
+		)
+	{
+		CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutput, E_INVALIDARG);
+		CHECK_POINTER(pRetSize);
+		*pRetSize = 0;
+		if ((nWidth <= 0) || (nHeight <= 0) || (nSrcPitch < nWidth * 4) ||
+			((UINT64)nWidth * (UINT64)nHeight > DXGICAPTURE_QOI_MAX_PIXELS))
+		{
+			return E_INVALIDARG;
+		}
+
+		UINT64 ullMaxSize = GetMaxEncodedSize(nWidth, nHeight);
+		if (ullMaxSize > 0xFFFFFFFF) {
+			return E_OUTOFMEMORY;
+		}
+		HRESULT hr = DXGICaptureFrameBuffer::Resize(pOutput, (UINT)ullMaxSize);
+		CHECK_HR_RETURN(hr);
+
+		BYTE *p = pOutput->Buffer;
+		p[0] = 'q';
+		p[1] = 'o';
+		p[2] = 'i';
+		p[3] = 'f';
+		putU32BE(p + 4, (UINT)nWidth);
+		putU32BE(p + 8, (UINT)nHeight);
+		p[12] = 4; // RGBA
+		p[13] = 0; // sRGB with linear alpha
+		p += DXGICAPTURE_QOI_HEADER_SIZE;
+
+		UINT index[64];
+		memset(index, 0, sizeof(index));
+		UINT uiPrev = 0xFF000000;
+		UINT uiRun = 0;
+
+		for (INT y = 0; y < nHeight; ++y)
+		{
+			const UINT *pRow = (const UINT*)(pSrc + (size_t)y * nSrcPitch);
+			for (INT x = 0; x < nWidth; ++x)
+			{
+				const UINT uiPixel = pRow[x];
+				if (uiPixel == uiPrev)
+				{
+					if (++uiRun == 62)
+					{
+						*p++ = (BYTE)(DXGICAPTURE_QOI_OP_RUN | (uiRun - 1));
+						uiRun = 0;
+					}
+					continue;
+				}
+				if (uiRun > 0)
+				{
+					*p++ = (BYTE)(DXGICAPTURE_QOI_OP_RUN | (uiRun - 1));
+					uiRun = 0;
+				}
+
+				const UINT uiHash = hashPixel(uiPixel);
+				if (index[uiHash] == uiPixel)
+				{
+					*p++ = (BYTE)(DXGICAPTURE_QOI_OP_INDEX | uiHash);
+				}
+				else
+				{
+					index[uiHash] = uiPixel;
+					if ((uiPixel >> 24) == (uiPrev >> 24))
+					{
+						const INT vr = (INT)((uiPixel >> 16) & 0xFF) - (INT)((uiPrev >> 16) & 0xFF);
+						const INT vg = (INT)((uiPixel >> 8) & 0xFF) - (INT)((uiPrev >> 8) & 0xFF);
+						const INT vb = (INT)(uiPixel & 0xFF) - (INT)(uiPrev & 0xFF);
+						// wrap around like the 8 bit channels of the decoder
+						const INT dr = (INT)(signed char)(BYTE)vr;
+						const INT dg = (INT)(signed char)(BYTE)vg;
+						const INT db = (INT)(signed char)(BYTE)vb;
+						const INT dr_dg = dr - dg;
+						const INT db_dg = db - dg;
+
+						if ((dr >= -2) && (dr <= 1) && (dg >= -2) && (dg <= 1) && (db >= -2) && (db <= 1))
+						{
+							*p++ = (BYTE)(DXGICAPTURE_QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+						}
+						else if ((dg >= -32) && (dg <= 31) && (dr_dg >= -8) && (dr_dg <= 7) && (db_dg >= -8) && (db_dg <= 7))
+						{
+							*p++ = (BYTE)(DXGICAPTURE_QOI_OP_LUMA | (dg + 32));
+							*p++ = (BYTE)(((dr_dg + 8) << 4) | (db_dg + 8));
+						}
+						else
+						{
+							*p++ = DXGICAPTURE_QOI_OP_RGB;
+							*p++ = (BYTE)(uiPixel >> 16);
+							*p++ = (BYTE)(uiPixel >> 8);
+							*p++ = (BYTE)uiPixel;
+						}
+					}
+					else
+					{
+						*p++ = DXGICAPTURE_QOI_OP_RGBA;
+						*p++ = (BYTE)(uiPixel >> 16);
+						*p++ = (BYTE)(uiPixel >> 8);
+						*p++ = (BYTE)uiPixel;
+						*p++ = (BYTE)(uiPixel >> 24);
+					}
+				}
+				uiPrev = uiPixel;
+			}
+		}
+		if (uiRun > 0) {
+			*p++ = (BYTE)(DXGICAPTURE_QOI_OP_RUN | (uiRun - 1));
+		}
+
+		memset(p, 0, DXGICAPTURE_QOI_END_SIZE - 1);
+		p[DXGICAPTURE_QOI_END_SIZE - 1] = 1;
+		p += DXGICAPTURE_QOI_END_SIZE;
+
+		*pRetSize = (UINT)(p - pOutput->Buffer);
+		return S_OK;
+	} // Encode
+
+	//
+	// Decodes a QOI image (3 or 4 channels) into pOutput as 32bpp BGRA with a pitch of nWidth * 4.
+	// Returns E_INVALIDARG for a truncated or malformed stream.
+	//
+	static
+	inline
+	HRESULT
+	Decode(
+		_In_reads_bytes_(uiSize) const BYTE *pData,
+		_In_ UINT uiSize,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ INT *pWidth,
+		_Out_ INT *pHeight
+		)
+	{
+		CHECK_POINTER_EX(pData, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutput, E_INVALIDARG);
+		CHECK_POINTER(pWidth);
+		CHECK_POINTER(pHeight);
+		*pWidth = 0;
+		*pHeight = 0;
+
+		if ((uiSize < DXGICAPTURE_QOI_HEADER_SIZE + DXGICAPTURE_QOI_END_SIZE) || (memcmp(pData, "qoif", 4) != 0)) {
+			return E_INVALIDARG;
+		}
+		const UINT uiWidth = getU32BE(pData + 4);
+		const UINT uiHeight = getU32BE(pData + 8);
+		const BYTE bChannels = pData[12];
+		if ((uiWidth == 0) || (uiHeight == 0) || (uiWidth > 0x7FFFFFFF) || (uiHeight > 0x7FFFFFFF) ||
+			((UINT64)uiWidth * uiHeight > DXGICAPTURE_QOI_MAX_PIXELS) ||
+			((bChannels != 3) && (bChannels != 4)) || (pData[13] > 1))
+		{
+			return E_INVALIDARG;
+		}
+
+		const UINT64 ullPixels = (UINT64)uiWidth * uiHeight;
+		if (ullPixels * 4 > 0xFFFFFFFF) {
+			return E_OUTOFMEMORY;
+		}
+		HRESULT hr = DXGICaptureFrameBuffer::Resize(pOutput, (UINT)(ullPixels * 4));
+		CHECK_HR_RETURN(hr);
+
+		UINT index[64];
+		memset(index, 0, sizeof(index));
+		UINT uiPixel = 0xFF000000;
+		UINT uiRun = 0;
+
+		UINT *pDst = (UINT*)pOutput->Buffer;
+		const BYTE *p = pData + DXGICAPTURE_QOI_HEADER_SIZE;
+		const BYTE *pEnd = pData + uiSize - DXGICAPTURE_QOI_END_SIZE;
+		for (UINT64 i = 0; i < ullPixels; ++i)
+		{
+			if (uiRun > 0)
+			{
+				--uiRun;
+				pDst[i] = uiPixel;
+				continue;
+			}
+			if (p >= pEnd) {
+				return E_INVALIDARG;
+			}
+
+			const BYTE b1 = *p++;
+			if (b1 == DXGICAPTURE_QOI_OP_RGB)
+			{
+				if (pEnd - p < 3) {
+					return E_INVALIDARG;
+				}
+				uiPixel = (uiPixel & 0xFF000000) | ((UINT)p[0] << 16) | ((UINT)p[1] << 8) | (UINT)p[2];
+				p += 3;
+			}
+			else if (b1 == DXGICAPTURE_QOI_OP_RGBA)
+			{
+				if (pEnd - p < 4) {
+					return E_INVALIDARG;
+				}
+				uiPixel = ((UINT)p[3] << 24) | ((UINT)p[0] << 16) | ((UINT)p[1] << 8) | (UINT)p[2];
+				p += 4;
+			}
+			else
+			{
+				switch (b1 & DXGICAPTURE_QOI_MASK_2)
+				{
+				case DXGICAPTURE_QOI_OP_INDEX:
+					uiPixel = index[b1];
+					break;
+				case DXGICAPTURE_QOI_OP_DIFF:
+					{
+						UINT r = ((uiPixel >> 16) + ((b1 >> 4) & 3) - 2) & 0xFF;
+						UINT g = ((uiPixel >> 8) + ((b1 >> 2) & 3) - 2) & 0xFF;
+						UINT b = (uiPixel + (b1 & 3) - 2) & 0xFF;
+						uiPixel = (uiPixel & 0xFF000000) | (r << 16) | (g << 8) | b;
+					}
+					break;
+				case DXGICAPTURE_QOI_OP_LUMA:
+					{
+						if (p >= pEnd) {
+							return E_INVALIDARG;
+						}
+						const BYTE b2 = *p++;
+						const INT vg = (INT)(b1 & 0x3F) - 32;
+						UINT r = (UINT)((INT)((uiPixel >> 16) & 0xFF) + vg - 8 + ((b2 >> 4) & 0x0F)) & 0xFF;
+						UINT g = (UINT)((INT)((uiPixel >> 8) & 0xFF) + vg) & 0xFF;
+						UINT b = (UINT)((INT)(uiPixel & 0xFF) + vg - 8 + (b2 & 0x0F)) & 0xFF;
+						uiPixel = (uiPixel & 0xFF000000) | (r << 16) | (g << 8) | b;
+					}
+					break;
+				default: // DXGICAPTURE_QOI_OP_RUN
+					uiRun = b1 & 0x3F;
+					break;
+				}
+			}
+			index[hashPixel(uiPixel)] = uiPixel;
+			pDst[i] = uiPixel;
+		}
+
+		*pWidth = (INT)uiWidth;
+		*pHeight = (INT)uiHeight;
+		return S_OK;
+	} // Decode
+
+}; // end class DXGICaptureQoi
+
+#endif // __DXGICAPTUREQOI_H__
@@ -0,0 +1,1076 @@
+/*****************************************************************************
+* DXGICaptureRecording.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURERECORDING_H__
+#define __DXGICAPTURERECORDING_H__
+
+#include "DXGICaptureSource.h"
+#include "DXGICaptureDelta.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICaptureMappedFile.h"
+#include "DXGICaptureQoi.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//
+// Recording container (*.NNNN.dxr segments, little endian):
+//
+//   segment  : file header | frame record ... | index entry ... | index trailer
+//   record   : frame header | move rects | dirty rects | pointer shape | image
+//
+// A delta image is the difference to the previous image after its move rects
+// were applied.
+//
+// Records start at 64 byte offsets, the image of a record too. A pointer shape
+// is stored once per segment and referenced by the following records. Delta
+// compressed segments start with a keyframe, so segments decode on their own. The
+// trailer at the end of the file locates the index, segments without an index
+// (interrupted recordings) are recovered by walking the records.
+//
+#define DXGICAPTURE_RECORDING_MAGIC                 0x31524744  /* 'DGR1' */
+#define DXGICAPTURE_RECORDING_FRAME_MAGIC           0x4D415246  /* 'FRAM' */
+#define DXGICAPTURE_RECORDING_INDEX_MAGIC           0x58444E49  /* 'INDX' */
+#define DXGICAPTURE_RECORDING_VERSION               1
+#define DXGICAPTURE_RECORDING_ALIGN                 64
+#define DXGICAPTURE_RECORDING_DEFAULT_SEGMENT_SIZE  (512ULL * 1024 * 1024)
+#define DXGICAPTURE_RECORDING_MAX_SEGMENTS          10000
+#define DXGICAPTURE_RECORDING_EXTENSION             "dxr"
+#define DXGICAPTURE_RECORDING_DEFAULT_KEYFRAME_INTERVAL 120
+#define DXGICAPTURE_RECORDING_DEFAULT_KEYFRAME_PERCENT  50
+
+#define DXGICAPTURE_RECORDING_FRAME_KEYFRAME        0x1 /* decodable without the previous frames */
+
+#define DXGICAPTURE_RECORDING_POINTER_PRESENT       0x1
+#define DXGICAPTURE_RECORDING_POINTER_VISIBLE       0x2
+#define DXGICAPTURE_RECORDING_POINTER_SHAPE         0x4 /* shape stored in this record */
+
+//
+// enum tagRecordingCompression_e
+//
+typedef enum tagRecordingCompression_e : UINT
+{
+	tagRecordingCompression_None  = 0x0, /* raw BGRA rows */
+	tagRecordingCompression_Qoi   = 0x1, /* every image is a qoi image, frames stay independent */
+	tagRecordingCompression_Delta = 0x2, /* difference to the previous image (DXGICaptureDelta), periodic keyframes */
+} tagRecordingCompression;
+
+//
+// struct tagRecordingConfig_s
+//
+typedef struct tagRecordingConfig_s
+{
+	UINT64                  SegmentSize;    /* preallocated size of a segment file, 0: default */
+	tagRecordingCompression Compression;
+	UINT                    KeyframeInterval; /* delta: frames between keyframes, 0: default */
+	UINT                    KeyframePercent;  /* delta: changed area (percent of the image) that forces a keyframe, 0: default */
+} tagRecordingConfig;
+
+//
+// struct tagRecordingFileHeader_s
+//
+typedef struct tagRecordingFileHeader_s
+{
+	UINT                    Magic;
+	UINT                    Version;
+	UINT                    HeaderSize;
+	UINT                    SegmentIndex;
+	UINT64                  FirstFrame;     /* recording index of the first frame of the segment */
+	INT                     Width;          /* tagCaptureSourceDesc of the recorded source */
+	INT                     Height;
+	INT                     RotationDegrees;
+	INT                     DesktopWidth;
+	INT                     DesktopHeight;
+	UINT                    Compression;    /* tagRecordingCompression */
+	UINT64                  SegmentSize;    /* preallocated size */
+	UINT64                  RecordingId;    /* same in all segments of a recording */
+} tagRecordingFileHeader;
+
+//
+// struct tagRecordingFrameHeader_s
+//
+typedef struct tagRecordingFrameHeader_s
+{
+	UINT                    Magic;
+	UINT                    RecordSize;     /* header, rects, shape, image and padding */
+	UINT64                  FrameNumber;
+	INT64                   Timestamp;      /* usec */
+	UINT                    AccumulatedFrames;
+	UINT                    Compression;    /* tagRecordingCompression */
+	UINT                    MoveRectCount;
+	UINT                    DirtyRectCount;
+	UINT                    ImageOffset;    /* from the start of the record */
+	UINT                    ImageSize;
+	INT                     Pitch;          /* raw images */
+	UINT                    PointerFlags;   /* DXGICAPTURE_RECORDING_POINTER_xxx */
+	LONG                    PointerX;
+	LONG                    PointerY;
+	UINT                    PointerType;
+	UINT                    PointerWidth;
+	UINT                    PointerHeight;
+	UINT                    PointerPitch;
+	UINT                    PointerShapeSize;
+	UINT                    Flags;          /* DXGICAPTURE_RECORDING_FRAME_xxx */
+	UINT64                  PointerShapeHash;
+	UINT64                  PointerShapeOffset; /* from the start of the segment */
+} tagRecordingFrameHeader;
+
+//
+// struct tagRecordingIndexEntry_s
+//
+typedef struct tagRecordingIndexEntry_s
+{
+	UINT64                  Offset;         /* of the record, from the start of the segment */
+	INT64                   Timestamp;
+	UINT64                  FrameNumber;
+	UINT                    RecordSize;
+	UINT                    Reserved;
+} tagRecordingIndexEntry;
+
+//
+// struct tagRecordingIndexTrailer_s
+//
+typedef struct tagRecordingIndexTrailer_s
+{
+	UINT                    Magic;
+	UINT                    FrameCount;
+	UINT64                  IndexOffset;
+	UINT64                  FirstFrame;
+	UINT64                  Reserved;
+} tagRecordingIndexTrailer;
+
+//
+// struct tagRecordingStats_s
+//
+typedef struct tagRecordingStats_s
+{
+	UINT64                  Frames;
+	UINT                    Segments;
+	UINT64                  RawBytes;       /* BGRA bytes of the recorded images */
+	UINT64                  StoredBytes;    /* bytes of the frame records */
+	UINT64                  Keyframes;
+	UINT64                  ChangedPixels;  /* delta: pixels that differ from the previous image */
+} tagRecordingStats;
+
+//
+// struct tagRecordingFrame_s
+//
+// A frame of an opened recording, the pointers point into the mapped segment.
+//
+typedef struct tagRecordingFrame_s
+{
+	const tagRecordingFrameHeader*  Header;
+	const tagFrameMoveRect*         MoveRects;
+	const tagFrameRect*             DirtyRects;
+	const BYTE*                     Shape;      /* nullptr without pointer shape */
+	const BYTE*                     Image;
+} tagRecordingFrame;
+
+//
+// class DXGICaptureRecording
+//
+class DXGICaptureRecording
+{
+public:
+	static
+	inline
+	UINT64
+	Align(
+		_In_ UINT64 ullValue,
+		_In_ UINT64 ullAlignment
+		)
+	{
+		return (ullValue + ullAlignment - 1) & ~(ullAlignment - 1);
+	} // Align
+
+	//
+	// <base>.NNNN.dxr
+	//
+	static
+	inline
+	std::string
+	GetSegmentFileName(
+		_In_ const char *pszBasePath,
+		_In_ UINT uiSegment
+		)
+	{
+		char szSuffix[32];
+		sprintf(szSuffix, ".%04u." DXGICAPTURE_RECORDING_EXTENSION, uiSegment);
+		return std::string(pszBasePath) + szSuffix;
+	} // GetSegmentFileName
+
+	//
+	// Offsets of the parts of a frame record
+	//
+	static
+	inline
+	void
+	GetRecordLayout(
+		_In_ UINT uiMoveRectCount,
+		_In_ UINT uiDirtyRectCount,
+		_In_ UINT uiShapeSize,
+		_In_ UINT64 ullImageSize,
+		_Out_ UINT64 *pShapeOffset,
+		_Out_ UINT64 *pImageOffset,
+		_Out_ UINT64 *pRecordSize
+		)
+	{
+		UINT64 ullRects = (UINT64)sizeof(tagRecordingFrameHeader)
+			+ (UINT64)uiMoveRectCount * sizeof(tagFrameMoveRect)
+			+ (UINT64)uiDirtyRectCount * sizeof(tagFrameRect);
+		*pShapeOffset = Align(ullRects, 8);
+		*pImageOffset = Align(*pShapeOffset + uiShapeSize, DXGICAPTURE_RECORDING_ALIGN);
+		*pRecordSize  = Align(*pImageOffset + ullImageSize, DXGICAPTURE_RECORDING_ALIGN);
+	} // GetRecordLayout
+
+}; // end class DXGICaptureRecording
+
+//
+// class CDXGIRecordingWriter
+//
+// Appends the frames of a capture source to preallocated, memory mapped
+// segment files. A segment is closed (index written, file truncated) when the
+// next frame does not fit anymore.
+//
+class CDXGIRecordingWriter
+{
+private:
+	std::string                         m_basePath;
+	tagCaptureSourceDesc                m_desc;
+	tagRecordingConfig                  m_config;
+	CDXGIMappedFile                     m_segment;
+	UINT                                m_uiSegment;
+	UINT64                              m_ullOffset;
+	UINT64                              m_ullFirstFrame;
+	UINT64                              m_ullRecordingId;
+	std::vector<tagRecordingIndexEntry> m_index;
+	BOOL                                m_bShapeStored;
+	UINT64                              m_ullShapeHash;
+	UINT64                              m_ullShapeOffset;
+	tagFrameBufferInfo                  m_encoded;
+	tagFrameBufferInfo                  m_previous;     /* delta: the last recorded image */
+	UINT                                m_uiSinceKeyframe;
+	tagRecordingStats                   m_stats;
+	BOOL                                m_bCreated;
+
+	// disable copy
+	CDXGIRecordingWriter(const CDXGIRecordingWriter&);
+	CDXGIRecordingWriter& operator=(const CDXGIRecordingWriter&);
+
+	inline
+	HRESULT
+	openSegment(
+		_In_ UINT64 ullMinRecordSize
+		)
+	{
+		UINT64 ullHeaderSize = DXGICaptureRecording::Align(sizeof(tagRecordingFileHeader), DXGICAPTURE_RECORDING_ALIGN);
+		UINT64 ullSize = ullHeaderSize + ullMinRecordSize + sizeof(tagRecordingIndexEntry) + sizeof(tagRecordingIndexTrailer);
+		if (ullSize < m_config.SegmentSize) {
+			ullSize = m_config.SegmentSize;
+		}
+		if (m_uiSegment >= DXGICAPTURE_RECORDING_MAX_SEGMENTS) {
+			return E_FAIL;
+		}
+
+		HRESULT hr = m_segment.Create(DXGICaptureRecording::GetSegmentFileName(m_basePath.c_str(), m_uiSegment).c_str(), ullSize);
+		CHECK_HR_RETURN(hr);
+
+		tagRecordingFileHeader *pHeader = (tagRecordingFileHeader*)m_segment.GetData();
+		memset(pHeader, 0, (size_t)ullHeaderSize);
+		pHeader->Magic           = DXGICAPTURE_RECORDING_MAGIC;
+		pHeader->Version         = DXGICAPTURE_RECORDING_VERSION;
+		pHeader->HeaderSize      = (UINT)ullHeaderSize;
+		pHeader->SegmentIndex    = m_uiSegment;
+		pHeader->FirstFrame      = m_ullFirstFrame;
+		pHeader->Width           = m_desc.Width;
+		pHeader->Height          = m_desc.Height;
+		pHeader->RotationDegrees = m_desc.RotationDegrees;
+		pHeader->DesktopWidth    = m_desc.DesktopWidth;
+		pHeader->DesktopHeight   = m_desc.DesktopHeight;
+		pHeader->Compression     = (UINT)m_config.Compression;
+		pHeader->SegmentSize     = ullSize;
+		pHeader->RecordingId     = m_ullRecordingId;
+
+		m_ullOffset    = ullHeaderSize;
+		m_bShapeStored = FALSE;
+		m_index.clear();
+		m_stats.Segments++;
+		return S_OK;
+	}
+
+	inline
+	HRESULT
+	closeSegment()
+	{
+		if (!m_segment.IsOpen()) {
+			return S_FALSE;
+		}
+
+		BYTE *pData = m_segment.GetData();
+		UINT64 ullIndexOffset = m_ullOffset;
+		if (!m_index.empty()) {
+			memcpy(pData + ullIndexOffset, &m_index[0], m_index.size() * sizeof(tagRecordingIndexEntry));
+		}
+
+		tagRecordingIndexTrailer trailer;
+		memset(&trailer, 0, sizeof(trailer));
+		trailer.Magic       = DXGICAPTURE_RECORDING_INDEX_MAGIC;
+		trailer.FrameCount  = (UINT)m_index.size();
+		trailer.IndexOffset = ullIndexOffset;
+		trailer.FirstFrame  = m_ullFirstFrame;
+		UINT64 ullTrailerOffset = ullIndexOffset + m_index.size() * sizeof(tagRecordingIndexEntry);
+		memcpy(pData + ullTrailerOffset, &trailer, sizeof(trailer));
+
+		m_ullFirstFrame += m_index.size();
+		m_index.clear();
+		m_uiSegment++;
+		return m_segment.Close(ullTrailerOffset + sizeof(trailer));
+	}
+
+	//
+	// Encodes the image of the frame into m_encoded (qoi, delta), returns the stored size
+	//
+	inline
+	HRESULT
+	encodeImage(
+		_In_ const tagCaptureSourceFrame *pFrame,
+		_In_ BOOL bKeyframe,
+		_Out_ UINT64 *pImageSize
+		)
+	{
+		*pImageSize = (UINT64)m_desc.Width * 4 * m_desc.Height;
+
+		UINT uiSize = 0;
+		HRESULT hr = S_OK;
+		switch (m_config.Compression)
+		{
+		case tagRecordingCompression_Qoi:
+			hr = DXGICaptureQoi::Encode(pFrame->Data, pFrame->Pitch, m_desc.Width, m_desc.Height, &m_encoded, &uiSize);
+			break;
+		case tagRecordingCompression_Delta:
+		{
+			// the moves are replayed before the difference is applied, a scroll only leaves the new strip
+			if (!bKeyframe && (pFrame->MoveRectCount > 0)) {
+				DXGICaptureDirtyRects::ApplyMoves(m_previous.Buffer, m_previous.Pitch, m_desc.Width, m_desc.Height, pFrame->MoveRects, pFrame->MoveRectCount);
+			}
+			UINT64 ullChanged = 0;
+			hr = DXGICaptureDelta::Encode(pFrame->Data, pFrame->Pitch, bKeyframe ? nullptr : m_previous.Buffer, m_previous.Pitch,
+				m_desc.Width, m_desc.Height, &m_encoded, &uiSize, &ullChanged);
+			if (SUCCEEDED(hr) && bKeyframe)
+			{
+				for (INT y = 0; y < m_desc.Height; ++y) {
+					memcpy(m_previous.Buffer + (size_t)y * m_previous.Pitch, pFrame->Data + (size_t)y * pFrame->Pitch, (size_t)m_desc.Width * 4);
+				}
+			}
+			if (SUCCEEDED(hr) && !bKeyframe) {
+				m_stats.ChangedPixels += ullChanged;
+			}
+			break;
+		}
+		default:
+			return S_OK;
+		}
+		CHECK_HR_RETURN(hr);
+		*pImageSize = uiSize;
+		return S_OK;
+	}
+
+	//
+	// Delta: a keyframe after KeyframeInterval frames or if the dirty rects of
+	// the frame cover more than KeyframePercent of the image
+	//
+	inline
+	BOOL
+	needKeyframe(
+		_In_ const tagCaptureSourceFrame *pFrame
+		) const
+	{
+		if ((m_config.Compression != tagRecordingCompression_Delta) || !m_segment.IsOpen() ||
+			(m_uiSinceKeyframe + 1 >= m_config.KeyframeInterval))
+		{
+			return TRUE;
+		}
+
+		UINT64 ullArea = 0;
+		for (UINT i = 0; i < pFrame->DirtyRectCount; ++i)
+		{
+			const tagFrameRect &rc = pFrame->DirtyRects[i];
+			if (!DXGICaptureDirtyRects::IsRectEmpty(rc)) {
+				ullArea += (UINT64)(rc.Right - rc.Left) * (UINT64)(rc.Bottom - rc.Top);
+			}
+		}
+		return ullArea * 100 > (UINT64)m_desc.Width * m_desc.Height * m_config.KeyframePercent;
+	}
+
+	// room for the record, its index entry and the trailer
+	inline BOOL fits(_In_ UINT64 ullRecordSize) const
+	{
+		UINT64 ullIndexSize = (m_index.size() + 1) * sizeof(tagRecordingIndexEntry) + sizeof(tagRecordingIndexTrailer);
+		return m_ullOffset + ullRecordSize + ullIndexSize <= m_segment.GetSize();
+	}
+
+public:
+	CDXGIRecordingWriter()
+		: m_uiSegment(0)
+		, m_ullOffset(0)
+		, m_ullFirstFrame(0)
+		, m_ullRecordingId(0)
+		, m_bShapeStored(FALSE)
+		, m_ullShapeHash(0)
+		, m_ullShapeOffset(0)
+		, m_uiSinceKeyframe(0)
+		, m_bCreated(FALSE)
+	{
+		memset(&m_desc, 0, sizeof(m_desc));
+		memset(&m_config, 0, sizeof(m_config));
+		memset(&m_encoded, 0, sizeof(m_encoded));
+		memset(&m_previous, 0, sizeof(m_previous));
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
+	~CDXGIRecordingWriter()
+	{
+		Close();
+		DXGICaptureFrameBuffer::Free(&m_encoded);
+		DXGICaptureFrameBuffer::Free(&m_previous);
+	}
+
+	//
+	// Starts a recording of images with the given description, the segments
+	// are written to <base>.NNNN.dxr
+	//
+	inline
+	HRESULT
+	Create(
+		_In_ const char *pszBasePath,
+		_In_ const tagCaptureSourceDesc *pDesc,
+		_In_opt_ const tagRecordingConfig *pConfig
+		)
+	{
+		CHECK_POINTER_EX(pszBasePath, E_INVALIDARG);
+		CHECK_POINTER_EX(pDesc, E_INVALIDARG);
+		if (m_bCreated) {
+			return E_UNEXPECTED;
+		}
+		if ((pDesc->Width <= 0) || (pDesc->Height <= 0) || (pDesc->Width > 0x7FFF) || (pDesc->Height > 0x7FFF)) {
+			return E_INVALIDARG;
+		}
+
+		memset(&m_config, 0, sizeof(m_config));
+		if (nullptr != pConfig) {
+			m_config = *pConfig;
+		}
+		if (m_config.SegmentSize == 0) {
+			m_config.SegmentSize = DXGICAPTURE_RECORDING_DEFAULT_SEGMENT_SIZE;
+		}
+		if (m_config.KeyframeInterval == 0) {
+			m_config.KeyframeInterval = DXGICAPTURE_RECORDING_DEFAULT_KEYFRAME_INTERVAL;
+		}
+		if (m_config.KeyframePercent == 0) {
+			m_config.KeyframePercent = DXGICAPTURE_RECORDING_DEFAULT_KEYFRAME_PERCENT;
+		}
+		if ((m_config.Compression > tagRecordingCompression_Delta) || (m_config.KeyframePercent > 100)) {
+			return E_INVALIDARG;
+		}
+		if (m_config.Compression == tagRecordingCompression_Delta)
+		{
+			HRESULT hr = DXGICaptureFrameBuffer::Resize(&m_previous, (UINT)(pDesc->Width * 4 * pDesc->Height));
+			CHECK_HR_RETURN(hr);
+			m_previous.BytesPerPixel = 4;
+			m_previous.Pitch         = pDesc->Width * 4;
+			m_previous.Bounds.Width  = pDesc->Width;
+			m_previous.Bounds.Height = pDesc->Height;
+		}
+
+		m_basePath      = pszBasePath;
+		m_desc          = *pDesc;
+		m_uiSegment     = 0;
+		m_ullOffset     = 0;
+		m_ullFirstFrame = 0;
+		// tells the segments apart from left overs of an earlier recording with the same name
+		m_ullRecordingId = (UINT64)std::chrono::system_clock::now().time_since_epoch().count() ^ (UINT64)(size_t)this;
+		m_uiSinceKeyframe = 0;
+		m_index.clear();
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_bCreated = TRUE;
+		return S_OK;
+	} // Create
+
+	//
+	// Appends a frame of the recorded source
+	//
+	inline
+	HRESULT
+	WriteFrame(
+		_In_ const tagCaptureSourceFrame *pFrame
+		)
+	{
+		CHECK_POINTER_EX(pFrame, E_INVALIDARG);
+		CHECK_POINTER_EX(pFrame->Data, E_INVALIDARG);
+		if (!m_bCreated) {
+			return E_UNEXPECTED;
+		}
+
+		const INT nRowSize = m_desc.Width * 4;
+		BOOL bKeyframe = needKeyframe(pFrame);
+		UINT64 ullImageSize = 0;
+		HRESULT hr = encodeImage(pFrame, bKeyframe, &ullImageSize);
+		CHECK_HR_RETURN(hr);
+
+		const tagCapturePointer *pPointer = pFrame->Pointer;
+		BOOL bShape = (nullptr != pPointer) && (nullptr != pPointer->Shape) && (pPointer->ShapeSize > 0);
+
+		// a new segment stores the shape again
+		UINT64 ullShapeOffset = 0, ullImageOffset = 0, ullRecordSize = 0;
+		for (INT nTry = 0; ; ++nTry)
+		{
+			BOOL bStoreShape = bShape && !(m_bShapeStored && (m_ullShapeHash == pPointer->ShapeHash));
+			DXGICaptureRecording::GetRecordLayout(pFrame->MoveRectCount, pFrame->DirtyRectCount, bStoreShape ? pPointer->ShapeSize : 0,
+				ullImageSize, &ullShapeOffset, &ullImageOffset, &ullRecordSize);
+			if (ullRecordSize > 0xFFFFFFFFULL) {
+				return E_INVALIDARG;
+			}
+			if (m_segment.IsOpen() && fits(ullRecordSize))
+			{
+				if (bStoreShape)
+				{
+					m_bShapeStored   = TRUE;
+					m_ullShapeHash   = pPointer->ShapeHash;
+					m_ullShapeOffset = m_ullOffset + ullShapeOffset;
+				}
+				else {
+					ullShapeOffset = 0;
+				}
+				break;
+			}
+			if (nTry > 0) {
+				return E_UNEXPECTED;
+			}
+			hr = closeSegment();
+			CHECK_HR_RETURN(hr);
+			if (!bKeyframe)
+			{
+				bKeyframe = TRUE;
+				hr = encodeImage(pFrame, bKeyframe, &ullImageSize);
+				CHECK_HR_RETURN(hr);
+			}
+			if (bShape) {
+				DXGICaptureRecording::GetRecordLayout(pFrame->MoveRectCount, pFrame->DirtyRectCount, pPointer->ShapeSize,
+					ullImageSize, &ullShapeOffset, &ullImageOffset, &ullRecordSize);
+			}
+			hr = openSegment(ullRecordSize);
+			CHECK_HR_RETURN(hr);
+		}
+
+		BYTE *pRecord = m_segment.GetData() + m_ullOffset;
+		tagRecordingFrameHeader *pHeader = (tagRecordingFrameHeader*)pRecord;
+		memset(pHeader, 0, sizeof(*pHeader));
+		pHeader->RecordSize        = (UINT)ullRecordSize;
+		pHeader->FrameNumber       = pFrame->FrameNumber;
+		pHeader->Timestamp         = pFrame->Timestamp;
+		pHeader->AccumulatedFrames = pFrame->AccumulatedFrames;
+		pHeader->Compression       = (UINT)m_config.Compression;
+		pHeader->MoveRectCount     = pFrame->MoveRectCount;
+		pHeader->DirtyRectCount    = pFrame->DirtyRectCount;
+		pHeader->ImageOffset       = (UINT)ullImageOffset;
+		pHeader->ImageSize         = (UINT)ullImageSize;
+		pHeader->Pitch             = nRowSize;
+		pHeader->Flags             = (bKeyframe || (m_config.Compression != tagRecordingCompression_Delta)) ? DXGICAPTURE_RECORDING_FRAME_KEYFRAME : 0;
+
+		BYTE *pDst = pRecord + sizeof(tagRecordingFrameHeader);
+		if (pFrame->MoveRectCount > 0)
+		{
+			memcpy(pDst, pFrame->MoveRects, pFrame->MoveRectCount * sizeof(tagFrameMoveRect));
+			pDst += pFrame->MoveRectCount * sizeof(tagFrameMoveRect);
+		}
+		if (pFrame->DirtyRectCount > 0) {
+			memcpy(pDst, pFrame->DirtyRects, pFrame->DirtyRectCount * sizeof(tagFrameRect));
+		}
+
+		if (nullptr != pPointer)
+		{
+			pHeader->PointerFlags = DXGICAPTURE_RECORDING_POINTER_PRESENT;
+			if (pPointer->Visible) {
+				pHeader->PointerFlags |= DXGICAPTURE_RECORDING_POINTER_VISIBLE;
+			}
+			pHeader->PointerX = pPointer->X;
+			pHeader->PointerY = pPointer->Y;
+			if (bShape)
+			{
+				if (ullShapeOffset > 0)
+				{
+					memcpy(pRecord + ullShapeOffset, pPointer->Shape, pPointer->ShapeSize);
+					pHeader->PointerFlags |= DXGICAPTURE_RECORDING_POINTER_SHAPE;
+				}
+				pHeader->PointerType        = pPointer->Type;
+				pHeader->PointerWidth       = pPointer->Width;
+				pHeader->PointerHeight      = pPointer->Height;
+				pHeader->PointerPitch       = pPointer->Pitch;
+				pHeader->PointerShapeSize   = pPointer->ShapeSize;
+				pHeader->PointerShapeHash   = pPointer->ShapeHash;
+				pHeader->PointerShapeOffset = m_ullShapeOffset;
+			}
+		}
+
+		BYTE *pImage = pRecord + ullImageOffset;
+		if (m_config.Compression != tagRecordingCompression_None) {
+			memcpy(pImage, m_encoded.Buffer, (size_t)ullImageSize);
+		}
+		else
+		{
+			for (INT y = 0; y < m_desc.Height; ++y) {
+				memcpy(pImage + (size_t)y * nRowSize, pFrame->Data + (size_t)y * pFrame->Pitch, nRowSize);
+			}
+		}
+
+		// the magic completes the record, see the recovery of CDXGIRecordingReader
+		pHeader->Magic = DXGICAPTURE_RECORDING_FRAME_MAGIC;
+
+		tagRecordingIndexEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.Offset      = m_ullOffset;
+		entry.Timestamp   = pFrame->Timestamp;
+		entry.FrameNumber = pFrame->FrameNumber;
+		entry.RecordSize  = (UINT)ullRecordSize;
+		m_index.push_back(entry);
+		m_ullOffset += ullRecordSize;
+
+		m_uiSinceKeyframe = bKeyframe ? 0 : m_uiSinceKeyframe + 1;
+		m_stats.Frames++;
+		if (pHeader->Flags & DXGICAPTURE_RECORDING_FRAME_KEYFRAME) {
+			m_stats.Keyframes++;
+		}
+		m_stats.RawBytes    += (UINT64)nRowSize * m_desc.Height;
+		m_stats.StoredBytes += ullRecordSize;
+		return S_OK;
+	} // WriteFrame
+
+	//
+	// Writes the index of the last segment and closes it
+	//
+	inline
+	HRESULT
+	Close()
+	{
+		HRESULT hr = closeSegment();
+		m_bCreated = FALSE;
+		return FAILED(hr) ? hr : S_OK;
+	} // Close
+
+	inline void GetStats(_Out_ tagRecordingStats *pStats) const
+	{
+		*pStats = m_stats;
+	}
+
+}; // end class CDXGIRecordingWriter
+
+//
+// class CDXGIRecordingReader
+//
+// Maps all segments of a recording read-only, frames are accessed by their
+// recording index in constant time. Delta compressed images are decoded
+// starting at the keyframe of GetKeyframe.
+//
+class CDXGIRecordingReader
+{
+private:
+	//
+	// struct tagFrameLocation_s
+	//
+	typedef struct tagFrameLocation_s
+	{
+		UINT            Segment;
+		UINT64          Offset;
+		UINT64          Keyframe;   /* index of the keyframe the frame is decoded from, ~0: none */
+	} tagFrameLocation;
+
+	std::vector<CDXGIMappedFile*>   m_segments;
+	std::vector<tagFrameLocation>   m_frames;
+	tagCaptureSourceDesc            m_desc;
+	tagRecordingCompression         m_compression;
+	UINT64                          m_ullRecordingId;
+	UINT                            m_uiRecoveredSegments;
+
+	// disable copy
+	CDXGIRecordingReader(const CDXGIRecordingReader&);
+	CDXGIRecordingReader& operator=(const CDXGIRecordingReader&);
+
+	//
+	// Checks that the record and everything it references lie inside the segment
+	//
+	inline
+	BOOL
+	isValidRecord(
+		_In_ const CDXGIMappedFile *pSegment,
+		_In_ UINT64 ullOffset
+		) const
+	{
+		UINT64 ullSize = pSegment->GetSize();
+		if ((ullOffset % DXGICAPTURE_RECORDING_ALIGN) || (ullOffset + sizeof(tagRecordingFrameHeader) > ullSize)) {
+			return FALSE;
+		}
+		const tagRecordingFrameHeader *pHeader = (const tagRecordingFrameHeader*)(pSegment->GetData() + ullOffset);
+		if ((pHeader->Magic != DXGICAPTURE_RECORDING_FRAME_MAGIC) || (pHeader->RecordSize < sizeof(tagRecordingFrameHeader)) ||
+			(ullOffset + pHeader->RecordSize > ullSize) || (pHeader->Compression != (UINT)m_compression))
+		{
+			return FALSE;
+		}
+
+		UINT64 ullShapeOffset = 0, ullImageOffset = 0, ullRecordSize = 0;
+		DXGICaptureRecording::GetRecordLayout(pHeader->MoveRectCount, pHeader->DirtyRectCount, 0, 0, &ullShapeOffset, &ullImageOffset, &ullRecordSize);
+		if ((pHeader->ImageOffset < ullShapeOffset) || ((UINT64)pHeader->ImageOffset + pHeader->ImageSize > pHeader->RecordSize)) {
+			return FALSE;
+		}
+		if ((m_compression == tagRecordingCompression_None) &&
+			((pHeader->Pitch != m_desc.Width * 4) || ((UINT64)pHeader->ImageSize != (UINT64)pHeader->Pitch * m_desc.Height)))
+		{
+			return FALSE;
+		}
+		if (pHeader->PointerShapeSize > 0)
+		{
+			// the shape is stored in this or an earlier record of the segment
+			if ((pHeader->PointerShapeOffset < sizeof(tagRecordingFileHeader)) ||
+				(pHeader->PointerShapeOffset > ullOffset + pHeader->ImageOffset) ||
+				(pHeader->PointerShapeOffset + pHeader->PointerShapeSize > ullSize) ||
+				(pHeader->PointerWidth == 0) || (pHeader->PointerHeight == 0) ||
+				((UINT64)pHeader->PointerPitch * pHeader->PointerHeight > pHeader->PointerShapeSize))
+			{
+				return FALSE;
+			}
+		}
+		return TRUE;
+	}
+
+	inline
+	HRESULT
+	addSegment(
+		_In_ UINT uiSegment
+		)
+	{
+		const CDXGIMappedFile *pSegment = m_segments[uiSegment];
+		const BYTE *pData = pSegment->GetData();
+		const UINT64 ullSize = pSegment->GetSize();
+		size_t nFirst = m_frames.size();
+
+		// the index of a closed segment
+		if (ullSize >= sizeof(tagRecordingIndexTrailer))
+		{
+			// a damaged file can end anywhere
+			tagRecordingIndexTrailer trailer;
+			memcpy(&trailer, pData + ullSize - sizeof(tagRecordingIndexTrailer), sizeof(trailer));
+			if ((trailer.Magic == DXGICAPTURE_RECORDING_INDEX_MAGIC) && ((trailer.IndexOffset % 8) == 0) &&
+				(trailer.IndexOffset + (UINT64)trailer.FrameCount * sizeof(tagRecordingIndexEntry) + sizeof(tagRecordingIndexTrailer) == ullSize))
+			{
+				const tagRecordingIndexEntry *pEntries = (const tagRecordingIndexEntry*)(pData + trailer.IndexOffset);
+				BOOL bValid = TRUE;
+				for (UINT i = 0; (i < trailer.FrameCount) && bValid; ++i)
+				{
+					bValid = isValidRecord(pSegment, pEntries[i].Offset);
+					if (bValid)
+					{
+						tagFrameLocation location = { uiSegment, pEntries[i].Offset, ~0ULL };
+						m_frames.push_back(location);
+					}
+				}
+				if (bValid) {
+					return S_OK;
+				}
+				m_frames.resize(nFirst);
+			}
+		}
+
+		// interrupted recording: walk the complete records
+		const tagRecordingFileHeader *pHeader = (const tagRecordingFileHeader*)pData;
+		UINT64 ullOffset = pHeader->HeaderSize;
+		while (isValidRecord(pSegment, ullOffset))
+		{
+			tagFrameLocation location = { uiSegment, ullOffset, ~0ULL };
+			m_frames.push_back(location);
+			ullOffset += ((const tagRecordingFrameHeader*)(pData + ullOffset))->RecordSize;
+		}
+		m_uiRecoveredSegments++;
+		return S_FALSE;
+	}
+
+public:
+	CDXGIRecordingReader()
+		: m_compression(tagRecordingCompression_None)
+		, m_ullRecordingId(0)
+		, m_uiRecoveredSegments(0)
+	{
+		memset(&m_desc, 0, sizeof(m_desc));
+	}
+
+	~CDXGIRecordingReader()
+	{
+		Close();
+	}
+
+	//
+	// Opens <base>.0000.dxr and the following segments
+	//
+	inline
+	HRESULT
+	Open(
+		_In_ const char *pszBasePath
+		)
+	{
+		CHECK_POINTER_EX(pszBasePath, E_INVALIDARG);
+		Close();
+
+		HRESULT hr = S_OK;
+		for (UINT i = 0; i < DXGICAPTURE_RECORDING_MAX_SEGMENTS; ++i)
+		{
+			CDXGIMappedFile *pSegment = new (std::nothrow) CDXGIMappedFile();
+			if (nullptr == pSegment)
+			{
+				hr = E_OUTOFMEMORY;
+				break;
+			}
+			hr = pSegment->Open(DXGICaptureRecording::GetSegmentFileName(pszBasePath, i).c_str());
+			if (FAILED(hr))
+			{
+				delete pSegment;
+				// the first missing segment ends the recording
+				hr = (i > 0) ? S_OK : hr;
+				break;
+			}
+			m_segments.push_back(pSegment);
+
+			const tagRecordingFileHeader *pHeader = (const tagRecordingFileHeader*)pSegment->GetData();
+			if ((i > 0) && (pSegment->GetSize() >= sizeof(tagRecordingFileHeader)) && (pHeader->RecordingId != m_ullRecordingId))
+			{
+				// a segment of an earlier, longer recording
+				delete pSegment;
+				m_segments.pop_back();
+				break;
+			}
+			if ((pSegment->GetSize() < sizeof(tagRecordingFileHeader)) ||
+				(pHeader->Magic != DXGICAPTURE_RECORDING_MAGIC) || (pHeader->Version != DXGICAPTURE_RECORDING_VERSION) ||
+				(pHeader->HeaderSize < sizeof(tagRecordingFileHeader)) || (pHeader->SegmentIndex != i) ||
+				(pHeader->FirstFrame != (UINT64)m_frames.size()) || (pHeader->Compression > tagRecordingCompression_Delta))
+			{
+				hr = E_INVALIDARG;
+				break;
+			}
+			if (i == 0)
+			{
+				if ((pHeader->Width <= 0) || (pHeader->Height <= 0) || (pHeader->Width > 0x7FFF) || (pHeader->Height > 0x7FFF))
+				{
+					hr = E_INVALIDARG;
+					break;
+				}
+				m_desc.Width           = pHeader->Width;
+				m_desc.Height          = pHeader->Height;
+				m_desc.RotationDegrees = pHeader->RotationDegrees;
+				m_desc.DesktopWidth    = pHeader->DesktopWidth;
+				m_desc.DesktopHeight   = pHeader->DesktopHeight;
+				m_compression          = (tagRecordingCompression)pHeader->Compression;
+				m_ullRecordingId       = pHeader->RecordingId;
+			}
+			else if ((pHeader->Width != m_desc.Width) || (pHeader->Height != m_desc.Height) || (pHeader->Compression != (UINT)m_compression))
+			{
+				hr = E_INVALIDARG;
+				break;
+			}
+
+			try
+			{
+				addSegment(i);
+			}
+			catch (const std::bad_alloc&)
+			{
+				hr = E_OUTOFMEMORY;
+				break;
+			}
+		}
+
+		// a frame (and a seek) decodes from the last keyframe before it
+		UINT64 ullKeyframe = ~0ULL;
+		for (size_t i = 0; SUCCEEDED(hr) && (i < m_frames.size()); ++i)
+		{
+			const tagRecordingFrameHeader *pHeader = (const tagRecordingFrameHeader*)(m_segments[m_frames[i].Segment]->GetData() + m_frames[i].Offset);
+			if (pHeader->Flags & DXGICAPTURE_RECORDING_FRAME_KEYFRAME) {
+				ullKeyframe = (UINT64)i;
+			}
+			m_frames[i].Keyframe = ullKeyframe;
+		}
+
+		if (FAILED(hr)) {
+			Close();
+		}
+		return hr;
+	} // Open
+
+	inline
+	void
+	Close()
+	{
+		for (size_t i = 0; i < m_segments.size(); ++i) {
+			delete m_segments[i];
+		}
+		m_segments.clear();
+		m_frames.clear();
+		memset(&m_desc, 0, sizeof(m_desc));
+		m_uiRecoveredSegments = 0;
+	} // Close
+
+	//
+	// Frame of the recording index in O(1), the data stays valid until Close
+	//
+	inline
+	HRESULT
+	GetFrame(
+		_In_ UINT64 ullIndex,
+		_Out_ tagRecordingFrame *pFrame
+		) const
+	{
+		CHECK_POINTER_EX(pFrame, E_INVALIDARG);
+		memset(pFrame, 0, sizeof(*pFrame));
+		if (ullIndex >= (UINT64)m_frames.size()) {
+			return E_INVALIDARG;
+		}
+
+		const tagFrameLocation &location = m_frames[(size_t)ullIndex];
+		const BYTE *pSegmentData = m_segments[location.Segment]->GetData();
+		const BYTE *pRecord = pSegmentData + location.Offset;
+		const tagRecordingFrameHeader *pHeader = (const tagRecordingFrameHeader*)pRecord;
+
+		pFrame->Header     = pHeader;
+		pFrame->MoveRects  = (const tagFrameMoveRect*)(pRecord + sizeof(tagRecordingFrameHeader));
+		pFrame->DirtyRects = (const tagFrameRect*)(pRecord + sizeof(tagRecordingFrameHeader) + pHeader->MoveRectCount * sizeof(tagFrameMoveRect));
+		pFrame->Shape      = (pHeader->PointerShapeSize > 0) ? (pSegmentData + pHeader->PointerShapeOffset) : nullptr;
+		pFrame->Image      = pRecord + pHeader->ImageOffset;
+		return S_OK;
+	} // GetFrame
+
+	//
+	// Recording index of the keyframe that the frame is decoded from, ~0 if there is none
+	//
+	inline
+	UINT64
+	GetKeyframe(
+		_In_ UINT64 ullIndex
+		) const
+	{
+		return (ullIndex < (UINT64)m_frames.size()) ? m_frames[(size_t)ullIndex].Keyframe : ~0ULL;
+	} // GetKeyframe
+
+	inline UINT64 GetFrameCount() const { return (UINT64)m_frames.size(); }
+	inline UINT GetSegmentCount() const { return (UINT)m_segments.size(); }
+	inline UINT GetRecoveredSegmentCount() const { return m_uiRecoveredSegments; }
+	inline tagRecordingCompression GetCompression() const { return m_compression; }
+	inline const tagCaptureSourceDesc* GetDesc() const { return &m_desc; }
+
+}; // end class CDXGIRecordingReader
+
+//
+// class CDXGIRecordingSource
+//
+// Capture source that passes the frames of another source through and
+// records every acquired frame.
+//
+class CDXGIRecordingSource : public IDXGICaptureSource
+{
+private:
+	IDXGICaptureSource*     m_pSource;
+	CDXGIRecordingWriter    m_writer;
+
+	// disable copy
+	CDXGIRecordingSource(const CDXGIRecordingSource&);
+	CDXGIRecordingSource& operator=(const CDXGIRecordingSource&);
+
+public:
+	CDXGIRecordingSource()
+		: m_pSource(nullptr)
+	{
+	}
+
+	virtual ~CDXGIRecordingSource()
+	{
+		m_writer.Close();
+	}
+
+	inline
+	HRESULT
+	Initialize(
+		_In_ IDXGICaptureSource *pSource,
+		_In_ const char *pszBasePath,
+		_In_opt_ const tagRecordingConfig *pConfig
+		)
+	{
+		CHECK_POINTER_EX(pSource, E_INVALIDARG);
+
+		tagCaptureSourceDesc desc;
+		HRESULT hr = pSource->GetDesc(&desc);
+		CHECK_HR_RETURN(hr);
+		hr = m_writer.Create(pszBasePath, &desc, pConfig);
+		CHECK_HR_RETURN(hr);
+
+		m_pSource = pSource;
+		return S_OK;
+	}
+
+	//
+	// Finishes the recording, the wrapped source is not used anymore
+	//
+	inline
+	HRESULT
+	Close()
+	{
+		m_pSource = nullptr;
+		return m_writer.Close();
+	}
+
+	inline void GetStats(_Out_ tagRecordingStats *pStats) const { m_writer.GetStats(pStats); }
+
+	// IDXGICaptureSource
+	virtual HRESULT GetDesc(_Out_ tagCaptureSourceDesc *pDesc)
+	{
+		CHECK_POINTER_EX(m_pSource, E_UNEXPECTED);
+		return m_pSource->GetDesc(pDesc);
+	}
+
+	virtual HRESULT AcquireFrame(_In_ UINT uiTimeoutMsec, _Out_ tagCaptureSourceFrame *pFrame)
+	{
+		CHECK_POINTER_EX(m_pSource, E_UNEXPECTED);
+		HRESULT hr = m_pSource->AcquireFrame(uiTimeoutMsec, pFrame);
+		if (hr != S_OK) {
+			return hr;
+		}
+
+		hr = m_writer.WriteFrame(pFrame);
+		if (FAILED(hr))
+		{
+			m_pSource->ReleaseFrame();
+			memset(pFrame, 0, sizeof(*pFrame));
+		}
+		return hr;
+	}
+
+	virtual HRESULT ReleaseFrame()
+	{
+		CHECK_POINTER_EX(m_pSource, E_UNEXPECTED);
+		return m_pSource->ReleaseFrame();
+	}
+
+}; // end class CDXGIRecordingSource
+
+#endif // __DXGICAPTURERECORDING_H__
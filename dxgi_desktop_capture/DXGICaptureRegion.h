@@ -0,0 +1,454 @@
+/*****************************************************************************
+* DXGICaptureRegion.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREREGION_H__
+#define __DXGICAPTUREREGION_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureCopy.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICapturePointer.h"
+#include "DXGICaptureRender.h"
+#include "DXGICaptureScale.h"
+#include "DXGICaptureSource.h"
+
+#include <string.h>
+#include <vector>
+
+//
+// class DXGICaptureRegion
+//
+// Source crop rectangles of the filter config. A region is given in desktop
+// coordinates of the monitor and covers a rect of the acquired (not rotated)
+// image. It is rendered like a desktop of its own size: RotationMode,
+// SizeMode and OutputSize apply to every region.
+//
+class DXGICaptureRegion
+{
+public:
+	//
+	// The regions must lie inside the desktop and must not be empty
+	//
+	static
+	inline
+	HRESULT
+	Validate(
+		_In_ const tagScreenCaptureFilterConfig *pConfig,
+		_In_ INT nDesktopWidth,
+		_In_ INT nDesktopHeight
+		)
+	{
+		CHECK_POINTER_EX(pConfig, E_INVALIDARG);
+
+		if ((pConfig->RegionCount < 0) || (pConfig->RegionCount > DXGICAPTURE_MAX_REGIONS)) {
+			return E_INVALIDARG;
+		}
+
+		for (INT i = 0; i < pConfig->RegionCount; ++i)
+		{
+			const tagFrameBounds &rgn = pConfig->Regions[i];
+			if ((rgn.X < 0) || (rgn.Y < 0) || (rgn.Width <= 0) || (rgn.Height <= 0) ||
+				(rgn.X + rgn.Width > nDesktopWidth) || (rgn.Y + rgn.Height > nDesktopHeight))
+			{
+				return E_INVALIDARG;
+			}
+		}
+
+		return S_OK;
+	} // Validate
+
+	//
+	// The rect of the acquired image under a region (desktop -> image is the
+	// inverse of the display rotation)
+	//
+	static
+	inline
+	void
+	ToImageRect(
+		_In_ const tagFrameBounds *pRegion,
+		_In_ INT nDesktopWidth,
+		_In_ INT nDesktopHeight,
+		_In_ INT nDisplayRotation,
+		_Out_ tagFrameRect *pRect
+		)
+	{
+		const LONG l = pRegion->X;
+		const LONG t = pRegion->Y;
+		const LONG r = pRegion->X + pRegion->Width;
+		const LONG b = pRegion->Y + pRegion->Height;
+
+		switch (nDisplayRotation)
+		{
+		case 90:
+			pRect->Left   = t;
+			pRect->Top    = nDesktopWidth - r;
+			pRect->Right  = b;
+			pRect->Bottom = nDesktopWidth - l;
+			break;
+		case 180:
+			pRect->Left   = nDesktopWidth - r;
+			pRect->Top    = nDesktopHeight - b;
+			pRect->Right  = nDesktopWidth - l;
+			pRect->Bottom = nDesktopHeight - t;
+			break;
+		case 270:
+			pRect->Left   = nDesktopHeight - b;
+			pRect->Top    = l;
+			pRect->Right  = nDesktopHeight - t;
+			pRect->Bottom = r;
+			break;
+		default:
+			pRect->Left   = l;
+			pRect->Top    = t;
+			pRect->Right  = r;
+			pRect->Bottom = b;
+			break;
+		}
+	} // ToImageRect
+
+	//
+	// Geometry of the desktop, or of the region if it is not empty (a region is
+	// rendered like a desktop of its size), and the rect of the acquired image
+	// to copy. The portable part of DXGICaptureHelper::CalculateRendererInfo.
+	//
+	static
+	inline
+	HRESULT
+	CalculateCopyGeometry(
+		_In_ const tagFrameBounds *pRegion,
+		_In_ INT nModeWidth,
+		_In_ INT nModeHeight,
+		_In_ INT nDisplayRotation,
+		_Inout_ tagFrameGeometry *pGeometry,
+		_Out_ tagFrameRect *pCopyRect
+		)
+	{
+		CHECK_POINTER_EX(pRegion, E_INVALIDARG);
+		CHECK_POINTER_EX(pGeometry, E_INVALIDARG);
+		CHECK_POINTER_EX(pCopyRect, E_INVALIDARG);
+
+		const BOOL bRegion = (pRegion->Width > 0) && (pRegion->Height > 0);
+
+		HRESULT hr = DXGICaptureRender::CalculateGeometry(
+			bRegion ? (INT)pRegion->Width : nModeWidth,
+			bRegion ? (INT)pRegion->Height : nModeHeight,
+			nDisplayRotation,
+			pGeometry);
+		CHECK_HR_RETURN(hr);
+
+		if (bRegion) {
+			ToImageRect(pRegion, nModeWidth, nModeHeight, nDisplayRotation, pCopyRect);
+		}
+		else
+		{
+			pCopyRect->Left   = 0;
+			pCopyRect->Top    = 0;
+			pCopyRect->Right  = pGeometry->SrcBounds.Width;
+			pCopyRect->Bottom = pGeometry->SrcBounds.Height;
+		}
+
+		return S_OK;
+	} // CalculateCopyGeometry
+
+	//
+	// Appends the parts of the rects inside rcClip, moved to its origin.
+	// Returns the number of appended rects.
+	//
+	static
+	inline
+	UINT
+	ClipRects(
+		_In_opt_ const tagFrameRect *pRects,
+		_In_ UINT count,
+		_In_ const tagFrameRect &rcClip,
+		_Inout_ std::vector<tagFrameRect> *pClipped
+		)
+	{
+		UINT uiAdded = 0;
+		for (UINT i = 0; i < count; ++i)
+		{
+			tagFrameRect rc = {
+				pRects[i].Left - rcClip.Left,
+				pRects[i].Top - rcClip.Top,
+				pRects[i].Right - rcClip.Left,
+				pRects[i].Bottom - rcClip.Top };
+			if (DXGICaptureDirtyRects::ClipRect(&rc, rcClip.Right - rcClip.Left, rcClip.Bottom - rcClip.Top))
+			{
+				pClipped->push_back(rc);
+				++uiAdded;
+			}
+		}
+		return uiAdded;
+	} // ClipRects
+
+}; // end class DXGICaptureRegion
+
+//
+// class CDXGICaptureRegionFrame
+//
+// One region of the cpu pipeline: keeps the region pixels of the acquired
+// images in a persistent frame (image orientation), draws the pointer and
+// renders the output image of the region. Only the pixels under the region
+// are read: a full update copies the region rect, an incremental update the
+// parts of the dirty rects and move destinations inside it (the desktop image
+// of the source is complete, so a move is a copy of its destination).
+//
+class CDXGICaptureRegionFrame
+{
+private:
+	tagFrameBounds                  m_region;       // desktop coordinates
+	tagFrameRect                    m_rcImage;      // rect of the acquired image
+	INT                             m_nDisplayRotation;
+	tagFrameGeometry                m_geometry;
+	CDXGICaptureScaler              m_scaler;
+	BOOL                            m_bPassthrough;
+
+	tagFrameBufferInfo              m_frame;
+	tagFrameBufferInfo              m_output;
+	tagFrameBufferInfo              m_mouseBackground;
+	tagFrameBufferInfo              m_tempMouseRotateBuffer;
+	std::vector<tagFrameRect>       m_rects;
+	BOOL                            m_bValid;
+
+	// disable copy
+	CDXGICaptureRegionFrame(const CDXGICaptureRegionFrame&);
+	CDXGICaptureRegionFrame& operator=(const CDXGICaptureRegionFrame&);
+
+public:
+	CDXGICaptureRegionFrame()
+		: m_nDisplayRotation(0)
+		, m_bPassthrough(FALSE)
+		, m_bValid(FALSE)
+	{
+		memset(&m_region, 0, sizeof(m_region));
+		memset(&m_rcImage, 0, sizeof(m_rcImage));
+		memset(&m_geometry, 0, sizeof(m_geometry));
+		memset(&m_frame, 0, sizeof(m_frame));
+		memset(&m_output, 0, sizeof(m_output));
+		memset(&m_mouseBackground, 0, sizeof(m_mouseBackground));
+		memset(&m_tempMouseRotateBuffer, 0, sizeof(m_tempMouseRotateBuffer));
+	}
+
+	~CDXGICaptureRegionFrame()
+	{
+		Terminate();
+	}
+
+	inline
+	HRESULT
+	Initialize(
+		_In_ const tagFrameBounds *pRegion,
+		_In_ const tagCaptureSourceDesc *pDesc,
+		_In_ const tagScreenCaptureFilterConfig *pConfig
+		)
+	{
+		CHECK_POINTER_EX(pRegion, E_INVALIDARG);
+		CHECK_POINTER_EX(pDesc, E_INVALIDARG);
+		CHECK_POINTER_EX(pConfig, E_INVALIDARG);
+
+		Terminate();
+
+		m_region           = *pRegion;
+		m_nDisplayRotation = pDesc->RotationDegrees;
+		DXGICaptureRegion::ToImageRect(&m_region, pDesc->DesktopWidth, pDesc->DesktopHeight, m_nDisplayRotation, &m_rcImage);
+		if ((m_rcImage.Left < 0) || (m_rcImage.Top < 0) || (m_rcImage.Right > pDesc->Width) || (m_rcImage.Bottom > pDesc->Height)) {
+			return E_INVALIDARG;
+		}
+
+		const INT nWidth  = m_rcImage.Right - m_rcImage.Left;
+		const INT nHeight = m_rcImage.Bottom - m_rcImage.Top;
+
+		memset(&m_geometry, 0, sizeof(m_geometry));
+		m_geometry.RotationMode = pConfig->RotationMode;
+		m_geometry.SizeMode     = pConfig->SizeMode;
+		m_geometry.OutputSize   = pConfig->OutputSize;
+		m_geometry.ScaleX       = 1.0f;
+		m_geometry.ScaleY       = 1.0f;
+
+		HRESULT hr = DXGICaptureRender::CalculateGeometry(m_region.Width, m_region.Height, m_nDisplayRotation, &m_geometry);
+		CHECK_HR_RETURN(hr);
+		hr = DXGICaptureRender::IsGeometryValid(&m_geometry);
+		CHECK_HR_RETURN(hr);
+
+		m_bPassthrough = DXGICaptureRender::IsPassthrough(&m_geometry, nWidth, nHeight);
+		if (!m_bPassthrough && (pConfig->ScaleFilter != tagFrameScaleFilter_Default))
+		{
+			hr = m_scaler.SetConfig(&m_geometry, nWidth, nHeight, pConfig->ScaleFilter);
+			if (hr != E_NOTIMPL) {
+				CHECK_HR_RETURN(hr);
+			}
+		}
+
+		hr = DXGICaptureFrameBuffer::Resize(&m_frame, (UINT)(nWidth * nHeight * 4));
+		CHECK_HR_RETURN(hr);
+		m_frame.BytesPerPixel = 4;
+		m_frame.Pitch         = nWidth * 4;
+		m_frame.Bounds.Width  = nWidth;
+		m_frame.Bounds.Height = nHeight;
+
+		if (!m_bPassthrough)
+		{
+			hr = DXGICaptureFrameBuffer::Resize(&m_output, (UINT)(m_geometry.OutputSize.Width * m_geometry.OutputSize.Height * 4));
+			CHECK_HR_RETURN(hr);
+			m_output.BytesPerPixel = 4;
+			m_output.Pitch         = m_geometry.OutputSize.Width * 4;
+			m_output.Bounds.Width  = m_geometry.OutputSize.Width;
+			m_output.Bounds.Height = m_geometry.OutputSize.Height;
+		}
+
+		return S_OK;
+	}
+
+	inline void Terminate()
+	{
+		DXGICaptureFrameBuffer::Free(&m_frame);
+		DXGICaptureFrameBuffer::Free(&m_output);
+		DXGICaptureFrameBuffer::Free(&m_mouseBackground);
+		DXGICaptureFrameBuffer::Free(&m_tempMouseRotateBuffer);
+		m_scaler.Reset();
+		m_rects.clear();
+		m_bPassthrough = FALSE;
+		m_bValid       = FALSE;
+	}
+
+	//
+	// Brings the region frame up to date with the acquired image and draws the
+	// pointer (nullptr: no pointer). The copied bytes are added to the stats.
+	//
+	inline
+	HRESULT
+	Update(
+		_In_ const tagCaptureSourceFrame *pFrame,
+		_In_ BOOL bIncremental,
+		_In_opt_ const tagCapturePointer *pPointer,
+		_Inout_ CDXGICursorCache *pCursorCache,
+		_Inout_ tagFrameUpdateStats *pUpdateStats,
+		_Inout_ tagFrameCopyStats *pCopyStats
+		)
+	{
+		CHECK_POINTER_EX(pFrame, E_INVALIDARG);
+		CHECK_POINTER_EX(m_frame.Buffer, E_UNEXPECTED);
+
+		const INT nWidth  = m_frame.Bounds.Width;
+		const INT nHeight = m_frame.Bounds.Height;
+		const BYTE *pSrc  = pFrame->Data + (size_t)m_rcImage.Top * pFrame->Pitch + m_rcImage.Left * 4;
+		const UINT64 ullBytes = (UINT64)nWidth * nHeight * 4;
+
+		pUpdateStats->BytesTotal += ullBytes;
+		if (!bIncremental || !m_bValid)
+		{
+			DXGICaptureCopy::CopyPixels(pSrc, pFrame->Pitch, m_frame.Buffer, m_frame.Pitch, nWidth, nHeight,
+				FALSE, tagSimdLevel_Auto, pCopyStats);
+
+			pUpdateStats->FullUpdate    = TRUE;
+			pUpdateStats->BytesCopied  += ullBytes;
+			pUpdateStats->BytesTouched += ullBytes;
+
+			m_bValid = TRUE;
+			m_mouseBackground.Bounds.Width = 0;
+		}
+		else
+		{
+			// restore the pixels under the last drawn mouse
+			if (m_mouseBackground.Bounds.Width > 0)
+			{
+				tagFrameRect rcMouse = {
+					m_mouseBackground.Bounds.X,
+					m_mouseBackground.Bounds.Y,
+					m_mouseBackground.Bounds.X + m_mouseBackground.Bounds.Width,
+					m_mouseBackground.Bounds.Y + m_mouseBackground.Bounds.Height };
+				pUpdateStats->BytesTouched += DXGICaptureDirtyRects::CopyBackground(m_frame.Buffer, m_frame.Pitch, m_mouseBackground.Buffer, rcMouse, FALSE);
+				m_mouseBackground.Bounds.Width = 0;
+			}
+
+			m_rects.clear();
+			DXGICaptureRegion::ClipRects(pFrame->DirtyRects, pFrame->DirtyRectCount, m_rcImage, &m_rects);
+			for (UINT i = 0; i < pFrame->MoveRectCount; ++i) {
+				DXGICaptureRegion::ClipRects(&pFrame->MoveRects[i].Dst, 1, m_rcImage, &m_rects);
+			}
+
+			UINT uiCount = m_rects.empty() ? 0 : DXGICaptureDirtyRects::MergeRects(&m_rects[0], (UINT)m_rects.size(), nWidth, nHeight);
+			if (uiCount > 0)
+			{
+				UINT64 ullCopied = DXGICaptureDirtyRects::ApplyDirtyRects(m_frame.Buffer, m_frame.Pitch, pSrc, pFrame->Pitch, &m_rects[0], uiCount);
+				pUpdateStats->DirtyRectCount += uiCount;
+				pUpdateStats->BytesCopied    += ullCopied;
+				pUpdateStats->BytesTouched   += ullCopied;
+				DXGICaptureCopy::AddCopy(pCopyStats, ullCopied);
+			}
+		}
+
+		if ((nullptr == pPointer) || !pPointer->Visible) {
+			return S_OK;
+		}
+
+		// the pointer relative to the region, drawn like on a desktop of the region size
+		tagCapturePointer pointer = *pPointer;
+		pointer.X -= m_region.X;
+		pointer.Y -= m_region.Y;
+		HRESULT hr = DXGICapturePointer::Draw(
+			&pointer,
+			m_region.Width,
+			m_region.Height,
+			m_nDisplayRotation,
+			pCursorCache,
+			&m_tempMouseRotateBuffer,
+			m_frame.Buffer,
+			m_frame.Pitch,
+			nWidth,
+			nHeight,
+			bIncremental ? &m_mouseBackground : nullptr);
+		return FAILED(hr) ? hr : S_OK;
+	}
+
+	//
+	// Renders the output image of the region (nothing to do for a passthrough region)
+	//
+	inline
+	HRESULT
+	Render(
+		_Inout_ tagFrameCopyStats *pCopyStats
+		)
+	{
+		CHECK_POINTER_EX(m_frame.Buffer, E_UNEXPECTED);
+		if (m_bPassthrough) {
+			return S_OK;
+		}
+
+		HRESULT hr = m_scaler.IsConfigured()
+			? m_scaler.Scale(m_frame.Buffer, m_frame.Pitch, m_output.Buffer, m_output.Pitch)
+			: DXGICaptureRender::Render(m_frame.Buffer, m_frame.Pitch, m_frame.Bounds.Width, m_frame.Bounds.Height, &m_geometry, m_output.Buffer, m_output.Pitch);
+		CHECK_HR_RETURN(hr);
+
+		DXGICaptureCopy::AddCopy(pCopyStats, (UINT64)m_output.Pitch * m_output.Bounds.Height);
+		return S_OK;
+	}
+
+	inline const tagFrameBufferInfo* GetOutputFrame() const { return m_bPassthrough ? &m_frame : &m_output; }
+	// region pixels of the acquired image, pointer drawn
+	inline const tagFrameBufferInfo* GetRegionFrame() const { return &m_frame; }
+	inline const tagFrameBounds* GetRegion() const { return &m_region; }
+	inline const tagFrameRect* GetImageRect() const { return &m_rcImage; }
+	inline const tagFrameGeometry* GetGeometry() const { return &m_geometry; }
+	inline const CDXGICaptureScaler* GetScaler() const { return &m_scaler; }
+	inline BOOL IsPassthrough() const { return m_bPassthrough; }
+
+}; // end class CDXGICaptureRegionFrame
+
+#endif // __DXGICAPTUREREGION_H__
@@ -0,0 +1,686 @@
+/*****************************************************************************
+* DXGICaptureRender.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURERENDER_H__
+#define __DXGICAPTURERENDER_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureRotate.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+//
+// struct tagFrameGeometry_s
+//
+// Placement of the desktop image in the output image: the source rect is drawn
+// into the destination rect, then rotated and scaled around the output center
+// (the transform of the D2D1 renderer).
+//
+typedef struct tagFrameGeometry_s
+{
+	tagFrameRotationMode    RotationMode;
+	tagFrameSizeMode        SizeMode;
+	tagFrameSize            OutputSize;
+
+	FLOAT                   RotationDegrees;
+	FLOAT                   ScaleX;
+	FLOAT                   ScaleY;
+	tagFrameBounds          SrcBounds;
+	tagFrameBounds          DstBounds;
+} tagFrameGeometry;
+
+//
+// struct tagRenderTap_s
+//
+// Bilinear tap of one axis: the two source indices and the 8 bit weight of the second.
+//
+typedef struct tagRenderTap_s
+{
+	INT     I0;
+	INT     I1;
+	UINT    W;
+} tagRenderTap;
+
+//
+// struct tagRenderMapping_s
+//
+// Inverse transform of a geometry: output pixel center -> source position,
+// and the visible source rect.
+//
+typedef struct tagRenderMapping_s
+{
+	INT     OutWidth;
+	INT     OutHeight;
+	INT     Left;
+	INT     Top;
+	INT     Right;
+	INT     Bottom;
+	BOOL    RightAngle;
+	double  cx, cy;
+	double  ux, uy;
+	double  vx, vy;
+	double  OffsetX;
+	double  OffsetY;
+} tagRenderMapping;
+
+//
+// class DXGICaptureRender
+//
+class DXGICaptureRender
+{
+private:
+	static
+	inline
+	void
+	getMapping(
+		_In_ const tagFrameGeometry *pGeometry,
+		_In_ INT nSrcWidth,
+		_In_ INT nSrcHeight,
+		_Out_ tagRenderMapping *pMap
+		)
+	{
+		pMap->OutWidth  = pGeometry->OutputSize.Width;
+		pMap->OutHeight = pGeometry->OutputSize.Height;
+
+		// visible source rect
+		pMap->Left   = (pGeometry->SrcBounds.X > 0) ? pGeometry->SrcBounds.X : 0;
+		pMap->Top    = (pGeometry->SrcBounds.Y > 0) ? pGeometry->SrcBounds.Y : 0;
+		pMap->Right  = pGeometry->SrcBounds.X + pGeometry->SrcBounds.Width;
+		pMap->Bottom = pGeometry->SrcBounds.Y + pGeometry->SrcBounds.Height;
+		if (pMap->Right > nSrcWidth) { pMap->Right = nSrcWidth; }
+		if (pMap->Bottom > nSrcHeight) { pMap->Bottom = nSrcHeight; }
+
+		// exact sine/cosine for the right angles
+		double dCos, dSin;
+		INT nDegrees = (INT)pGeometry->RotationDegrees;
+		pMap->RightAngle = ((FLOAT)nDegrees == pGeometry->RotationDegrees) && ((nDegrees % 90) == 0);
+		if (pMap->RightAngle)
+		{
+			static const INT s_cos[4] = { 1, 0, -1, 0 };
+			INT q = ((nDegrees / 90) % 4 + 4) % 4;
+			dCos = s_cos[q];
+			dSin = s_cos[(q + 3) % 4];
+		}
+		else
+		{
+			double dRad = pGeometry->RotationDegrees * 3.14159265358979323846 / 180.0;
+			dCos = cos(dRad);
+			dSin = sin(dRad);
+		}
+
+		// inverse of (rotate, then scale) around the output center
+		const double sx = pGeometry->ScaleX;
+		const double sy = pGeometry->ScaleY;
+		pMap->cx = pMap->OutWidth / 2.0;
+		pMap->cy = pMap->OutHeight / 2.0;
+		pMap->ux = dCos / sx;
+		pMap->uy = dSin / sy;
+		pMap->vx = -dSin / sx;
+		pMap->vy = dCos / sy;
+		pMap->OffsetX = pGeometry->SrcBounds.X - pGeometry->DstBounds.X;
+		pMap->OffsetY = pGeometry->SrcBounds.Y - pGeometry->DstBounds.Y;
+	} // getMapping
+
+	// source position of the first pixel of the output row (ey: row center - cy)
+	static inline double getOriginU(_In_ const tagRenderMapping *pMap, _In_ double ey)
+	{
+		return pMap->cx + pMap->ux * (0.5 - pMap->cx) + pMap->uy * ey + pMap->OffsetX;
+	}
+
+	static inline double getOriginV(_In_ const tagRenderMapping *pMap, _In_ double ey)
+	{
+		return pMap->cy + pMap->vx * (0.5 - pMap->cx) + pMap->vy * ey + pMap->OffsetY;
+	}
+
+	// bilinear tap of a source position, clamped to [nBegin, nEnd)
+	static
+	inline
+	void
+	getTap(
+		_In_ double u,
+		_In_ INT nBegin,
+		_In_ INT nEnd,
+		_Out_ tagRenderTap *pTap
+		)
+	{
+		double f = u - 0.5;
+		INT i0 = (INT)floor(f);
+		pTap->W  = (UINT)((f - i0) * 256.0);
+		pTap->I1 = i0 + 1;
+		pTap->I0 = (i0 < nBegin) ? nBegin : i0;
+		if (pTap->I1 >= nEnd) { pTap->I1 = nEnd - 1; }
+	} // getTap
+
+	//
+	// Per channel: ((a * (256 - wx) + b * wx) * (256 - wy) + (c * (256 - wx) + d * wx) * wy + 32768) >> 16
+	// B/R and G/A are calculated in the 32 bit halves of a 64 bit integer.
+	//
+	static
+	inline
+	UINT
+	sampleBilinear(
+		_In_ UINT p00,
+		_In_ UINT p01,
+		_In_ UINT p10,
+		_In_ UINT p11,
+		_In_ UINT wx,
+		_In_ UINT wy
+		)
+	{
+		if ((wx | wy) == 0) {
+			return p00;
+		}
+
+		const UINT64 ullRound = ((UINT64)32768 << 32) | 32768;
+		UINT64 a = ((UINT64)(p00 & 0x00FF0000) << 16) | (p00 & 0xFF), b = ((UINT64)(p01 & 0x00FF0000) << 16) | (p01 & 0xFF);
+		UINT64 c = ((UINT64)(p10 & 0x00FF0000) << 16) | (p10 & 0xFF), d = ((UINT64)(p11 & 0x00FF0000) << 16) | (p11 & 0xFF);
+		UINT64 rb = ((a * (256 - wx) + b * wx) * (256 - wy) + (c * (256 - wx) + d * wx) * wy + ullRound) >> 16;
+
+		p00 >>= 8; p01 >>= 8; p10 >>= 8; p11 >>= 8;
+		a = ((UINT64)(p00 & 0x00FF0000) << 16) | (p00 & 0xFF); b = ((UINT64)(p01 & 0x00FF0000) << 16) | (p01 & 0xFF);
+		c = ((UINT64)(p10 & 0x00FF0000) << 16) | (p10 & 0xFF); d = ((UINT64)(p11 & 0x00FF0000) << 16) | (p11 & 0xFF);
+		UINT64 ga = ((a * (256 - wx) + b * wx) * (256 - wy) + (c * (256 - wx) + d * wx) * wy + ullRound) >> 16;
+
+		return (UINT)(rb & 0xFF) | ((UINT)((rb >> 32) & 0xFF) << 16) | ((UINT)(ga & 0xFF) << 8) | ((UINT)((ga >> 32) & 0xFF) << 24);
+	} // sampleBilinear
+
+	static
+	inline
+	HRESULT
+	renderAffine(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ const tagRenderMapping *pMap,
+		_Out_ BYTE *pDst,
+		_In_ INT nDstPitch
+		)
+	{
+		const UINT uiBlack = 0xFF000000;
+
+		for (INT oy = 0; oy < pMap->OutHeight; ++oy)
+		{
+			UINT *pOut = (UINT*)(pDst + (size_t)oy * nDstPitch);
+			double ey = oy + 0.5 - pMap->cy;
+			double u = getOriginU(pMap, ey);
+			double v = getOriginV(pMap, ey);
+
+			for (INT ox = 0; ox < pMap->OutWidth; ++ox, u += pMap->ux, v += pMap->vx)
+			{
+				if ((u < pMap->Left) || (u >= pMap->Right) || (v < pMap->Top) || (v >= pMap->Bottom))
+				{
+					pOut[ox] = uiBlack;
+					continue;
+				}
+
+				// bilinear, clamped to the visible source rect
+				tagRenderTap x, y;
+				getTap(u, pMap->Left, pMap->Right, &x);
+				getTap(v, pMap->Top, pMap->Bottom, &y);
+
+				const BYTE *r0 = pSrc + (size_t)y.I0 * nSrcPitch;
+				const BYTE *r1 = pSrc + (size_t)y.I1 * nSrcPitch;
+				UINT p00 = *(const UINT*)(r0 + x.I0 * 4), p01 = *(const UINT*)(r0 + x.I1 * 4);
+				UINT p10 = *(const UINT*)(r1 + x.I0 * 4), p11 = *(const UINT*)(r1 + x.I1 * 4);
+
+				UINT uiPixel = 0;
+				for (INT c = 0; c < 32; c += 8)
+				{
+					UINT a = (p00 >> c) & 0xFF, b = (p01 >> c) & 0xFF;
+					UINT d = (p10 >> c) & 0xFF, e = (p11 >> c) & 0xFF;
+					UINT top    = a * (256 - x.W) + b * x.W;
+					UINT bottom = d * (256 - x.W) + e * x.W;
+					UINT value  = (top * (256 - y.W) + bottom * y.W + 32768) >> 16;
+					uiPixel |= value << c;
+				}
+				pOut[ox] = uiPixel;
+			}
+		}
+
+		return S_OK;
+	} // renderAffine
+
+public:
+	//
+	// Calculates the geometry from the size of the duplicated display mode and
+	// the display rotation (0, 90, 180, 270). RotationMode, SizeMode and
+	// OutputSize are the inputs, ScaleX/ScaleY must be initialized (1.0).
+	//
+	static
+	inline
+	HRESULT
+	CalculateGeometry(
+		_In_ INT nModeWidth,
+		_In_ INT nModeHeight,
+		_In_ INT nDisplayRotation,
+		_Inout_ tagFrameGeometry *pGeometry
+		)
+	{
+		CHECK_POINTER_EX(pGeometry, E_INVALIDARG);
+
+		// get rotate state
+		switch (nDisplayRotation)
+		{
+		case 90:
+			pGeometry->RotationDegrees  = 90.0f;
+			pGeometry->SrcBounds.X      = 0;
+			pGeometry->SrcBounds.Y      = 0;
+			pGeometry->SrcBounds.Width  = nModeHeight;
+			pGeometry->SrcBounds.Height = nModeWidth;
+			break;
+		case 180:
+			pGeometry->RotationDegrees  = 180.0;
+			pGeometry->SrcBounds.X      = 0;
+			pGeometry->SrcBounds.Y      = 0;
+			pGeometry->SrcBounds.Width  = nModeWidth;
+			pGeometry->SrcBounds.Height = nModeHeight;
+			break;
+		case 270:
+			pGeometry->RotationDegrees  = 270.0f;
+			pGeometry->SrcBounds.X      = 0;
+			pGeometry->SrcBounds.Y      = 0;
+			pGeometry->SrcBounds.Width  = nModeHeight;
+			pGeometry->SrcBounds.Height = nModeWidth;
+			break;
+		default: // OR identity
+			pGeometry->RotationDegrees  = 0.0f;
+			pGeometry->SrcBounds.X      = 0;
+			pGeometry->SrcBounds.Y      = 0;
+			pGeometry->SrcBounds.Width  = nModeWidth;
+			pGeometry->SrcBounds.Height = nModeHeight;
+			break;
+		}
+
+		// force rotate
+		switch (pGeometry->RotationMode)
+		{
+		case tagFrameRotationMode::tagFrameRotationMode_Identity:
+			pGeometry->RotationDegrees = 0.0f;
+			break;
+		case tagFrameRotationMode::tagFrameRotationMode_90:
+			pGeometry->RotationDegrees = 90.0f;
+			break;
+		case tagFrameRotationMode::tagFrameRotationMode_180:
+			pGeometry->RotationDegrees = 180.0f;
+			break;
+		case tagFrameRotationMode::tagFrameRotationMode_270:
+			pGeometry->RotationDegrees = 270.0f;
+			break;
+		default: // tagFrameRotationMode::tagFrameRotationMode_Auto
+			break;
+		}
+
+		if (pGeometry->SizeMode == tagFrameSizeMode_Zoom)
+		{
+			FLOAT fSrcAspect, fOutAspect, fScaleFactor;
+
+			// center for output
+			pGeometry->DstBounds.Width  = pGeometry->SrcBounds.Width;
+			pGeometry->DstBounds.Height = pGeometry->SrcBounds.Height;
+			pGeometry->DstBounds.X      = (pGeometry->OutputSize.Width  - pGeometry->SrcBounds.Width) >> 1;
+			pGeometry->DstBounds.Y      = (pGeometry->OutputSize.Height - pGeometry->SrcBounds.Height) >> 1;
+
+			fOutAspect = (FLOAT)pGeometry->OutputSize.Width / pGeometry->OutputSize.Height;
+
+			if ((pGeometry->RotationDegrees == 0.0f) || (pGeometry->RotationDegrees == 180.0f))
+			{
+				fSrcAspect = (FLOAT)pGeometry->SrcBounds.Width / pGeometry->SrcBounds.Height;
+
+				if (fSrcAspect > fOutAspect)
+				{
+					fScaleFactor = (FLOAT)pGeometry->OutputSize.Width / pGeometry->SrcBounds.Width;
+				}
+				else
+				{
+					fScaleFactor = (FLOAT)pGeometry->OutputSize.Height / pGeometry->SrcBounds.Height;
+				}
+			}
+			else // 90 or 270 degree
+			{
+				fSrcAspect = (FLOAT)pGeometry->SrcBounds.Height / pGeometry->SrcBounds.Width;
+
+				if (fSrcAspect > fOutAspect)
+				{
+					fScaleFactor = (FLOAT)pGeometry->OutputSize.Width / pGeometry->SrcBounds.Height;
+				}
+				else
+				{
+					fScaleFactor = (FLOAT)pGeometry->OutputSize.Height / pGeometry->SrcBounds.Width;
+				}
+			}
+
+			pGeometry->ScaleX = fScaleFactor;
+			pGeometry->ScaleY = fScaleFactor;
+		}
+		else if (pGeometry->SizeMode == tagFrameSizeMode_CenterImage)
+		{
+			// center for output
+			pGeometry->DstBounds.Width  = pGeometry->SrcBounds.Width;
+			pGeometry->DstBounds.Height = pGeometry->SrcBounds.Height;
+			pGeometry->DstBounds.X      = (pGeometry->OutputSize.Width  - pGeometry->SrcBounds.Width) >> 1;
+			pGeometry->DstBounds.Y      = (pGeometry->OutputSize.Height - pGeometry->SrcBounds.Height) >> 1;
+		}
+		else if (pGeometry->SizeMode == tagFrameSizeMode_AutoSize)
+		{
+			// set the destination bounds
+			pGeometry->DstBounds.Width  = pGeometry->SrcBounds.Width;
+			pGeometry->DstBounds.Height = pGeometry->SrcBounds.Height;
+
+			if ((pGeometry->RotationDegrees == 0.0f) || (pGeometry->RotationDegrees == 180.0f))
+			{
+				// same as the source size
+				pGeometry->OutputSize.Width  = pGeometry->SrcBounds.Width;
+				pGeometry->OutputSize.Height = pGeometry->SrcBounds.Height;
+			}
+			else // 90 or 270 degree
+			{
+				// same as the source size
+				pGeometry->OutputSize.Width  = pGeometry->SrcBounds.Height;
+				pGeometry->OutputSize.Height = pGeometry->SrcBounds.Width;
+
+				// center for output
+				pGeometry->DstBounds.X = (pGeometry->OutputSize.Width - pGeometry->SrcBounds.Width) >> 1;
+				pGeometry->DstBounds.Y = (pGeometry->OutputSize.Height - pGeometry->SrcBounds.Height) >> 1;
+			}
+		}
+		else if (pGeometry->SizeMode == tagFrameSizeMode_StretchImage)
+		{
+			// center for output
+			pGeometry->DstBounds.Width  = pGeometry->SrcBounds.Width;
+			pGeometry->DstBounds.Height = pGeometry->SrcBounds.Height;
+			pGeometry->DstBounds.X      = (pGeometry->OutputSize.Width - pGeometry->SrcBounds.Width) >> 1;
+			pGeometry->DstBounds.Y      = (pGeometry->OutputSize.Height - pGeometry->SrcBounds.Height) >> 1;
+
+			if ((pGeometry->RotationDegrees == 0.0f) || (pGeometry->RotationDegrees == 180.0f))
+			{
+				pGeometry->ScaleX = (FLOAT)pGeometry->OutputSize.Width / pGeometry->DstBounds.Width;
+				pGeometry->ScaleY = (FLOAT)pGeometry->OutputSize.Height / pGeometry->DstBounds.Height;
+			}
+			else // 90 or 270 degree
+			{
+				pGeometry->ScaleX = (FLOAT)pGeometry->OutputSize.Width / pGeometry->DstBounds.Height;
+				pGeometry->ScaleY = (FLOAT)pGeometry->OutputSize.Height / pGeometry->DstBounds.Width;
+			}
+		}
+		else // tagFrameSizeMode_Normal
+		{
+			pGeometry->DstBounds.Width  = pGeometry->SrcBounds.Width;
+			pGeometry->DstBounds.Height = pGeometry->SrcBounds.Height;
+
+			if (pGeometry->RotationDegrees == 90)
+			{
+				// set destination origin (bottom-left)
+				pGeometry->DstBounds.X = (pGeometry->OutputSize.Width - pGeometry->OutputSize.Height) >> 1;
+				pGeometry->DstBounds.Y = ((pGeometry->OutputSize.Width + pGeometry->OutputSize.Height) >> 1) - pGeometry->DstBounds.Height;
+			}
+			else if (pGeometry->RotationDegrees == 180.0f)
+			{
+				// set destination origin (bottom-right)
+				pGeometry->DstBounds.X = pGeometry->OutputSize.Width - pGeometry->DstBounds.Width;
+				pGeometry->DstBounds.Y = pGeometry->OutputSize.Height - pGeometry->DstBounds.Height;
+			}
+			else if (pGeometry->RotationDegrees == 270)
+			{
+				// set destination origin (top-right)
+				pGeometry->DstBounds.Y = (pGeometry->OutputSize.Height - pGeometry->OutputSize.Width) >> 1;
+				pGeometry->DstBounds.X = pGeometry->OutputSize.Width - pGeometry->DstBounds.Width - ((pGeometry->OutputSize.Width - pGeometry->OutputSize.Height) >> 1);
+			}
+		}
+
+		return S_OK;
+	} // CalculateGeometry
+
+	static
+	inline
+	HRESULT
+	IsGeometryValid(
+		_In_ const tagFrameGeometry *pGeometry
+		)
+	{
+		CHECK_POINTER_EX(pGeometry, E_INVALIDARG);
+
+		if ((pGeometry->OutputSize.Width <= 0) || (pGeometry->OutputSize.Height <= 0) ||
+			(pGeometry->DstBounds.Width <= 0) || (pGeometry->DstBounds.Height <= 0) ||
+			(pGeometry->SrcBounds.Width <= 0) || (pGeometry->SrcBounds.Height <= 0))
+		{
+			return E_INVALIDARG;
+		}
+
+		return S_OK;
+	} // IsGeometryValid
+
+	//
+	// TRUE if the output is the source image itself (not rotated, not scaled,
+	// same size, no letterbox), so it needs no rendering
+	//
+	static
+	inline
+	BOOL
+	IsPassthrough(
+		_In_ const tagFrameGeometry *pGeometry,
+		_In_ INT nSrcWidth,
+		_In_ INT nSrcHeight
+		)
+	{
+		if (nullptr == pGeometry) {
+			return FALSE;
+		}
+
+		return (pGeometry->RotationDegrees == 0.0f) &&
+			(pGeometry->ScaleX == 1.0f) && (pGeometry->ScaleY == 1.0f) &&
+			(pGeometry->SrcBounds.X == 0) && (pGeometry->SrcBounds.Y == 0) &&
+			(pGeometry->SrcBounds.Width == nSrcWidth) && (pGeometry->SrcBounds.Height == nSrcHeight) &&
+			(pGeometry->DstBounds.X == 0) && (pGeometry->DstBounds.Y == 0) &&
+			(pGeometry->DstBounds.Width == nSrcWidth) && (pGeometry->DstBounds.Height == nSrcHeight) &&
+			(pGeometry->OutputSize.Width == nSrcWidth) && (pGeometry->OutputSize.Height == nSrcHeight);
+	} // IsPassthrough
+
+	//
+	// Renders the 32bpp desktop image into the output image on the cpu, with the
+	// same transform as the D2D1 renderer. Uncovered output pixels are opaque
+	// black. Unscaled right angle rotations are pixel exact, anything else is
+	// sampled bilinear.
+	// Right angles (every geometry of CalculateGeometry) take a single pass that
+	// writes the letterbox bands once and samples the source through per row
+	// and per column tables; 90 and 270 degrees walk bands of output rows, so
+	// the source columns are read transposed in cache lines, and unscaled
+	// outputs are tiled rotations (DXGICaptureRotate). The result is
+	// pixel-identical to RenderAffine.
+	//
+	static
+	inline
+	HRESULT
+	Render(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nSrcWidth,
+		_In_ INT nSrcHeight,
+		_In_ const tagFrameGeometry *pGeometry,
+		_Out_ BYTE *pDst,
+		_In_ INT nDstPitch
+		)
+	{
+		CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+		CHECK_POINTER_EX(pDst, E_INVALIDARG);
+		HRESULT hr = IsGeometryValid(pGeometry);
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		tagRenderMapping map;
+		getMapping(pGeometry, nSrcWidth, nSrcHeight, &map);
+		if (!map.RightAngle) {
+			return renderAffine(pSrc, nSrcPitch, &map, pDst, nDstPitch);
+		}
+
+		const INT nOutWidth  = map.OutWidth;
+		const INT nOutHeight = map.OutHeight;
+		const UINT uiBlack   = 0xFF000000;
+
+		// 90/270: the source row changes along the output row, the column along the output column
+		const BOOL bTransposed = (map.ux == 0.0);
+		const INT nColBegin = bTransposed ? map.Top : map.Left;
+		const INT nColEnd   = bTransposed ? map.Bottom : map.Right;
+		const INT nRowBegin = bTransposed ? map.Left : map.Top;
+		const INT nRowEnd   = bTransposed ? map.Right : map.Bottom;
+
+		// the sampling positions are accumulated like the generic loop: the
+		// row term of the column axis is zero, the column step of the row axis is zero
+		std::vector<tagRenderTap> colTaps(nOutWidth);
+		std::vector<tagRenderTap> rowTaps(nOutHeight);
+		INT nSpanBegin = nOutWidth, nSpanEnd = 0;
+		INT nBandBegin = nOutHeight, nBandEnd = 0;
+		{
+			double ey = 0.5 - map.cy;
+			double s  = bTransposed ? getOriginV(&map, ey) : getOriginU(&map, ey);
+			double ds = bTransposed ? map.vx : map.ux;
+			for (INT ox = 0; ox < nOutWidth; ++ox, s += ds)
+			{
+				if ((s < nColBegin) || (s >= nColEnd)) {
+					continue;
+				}
+				getTap(s, nColBegin, nColEnd, &colTaps[ox]);
+				if (ox < nSpanBegin) { nSpanBegin = ox; }
+				nSpanEnd = ox + 1;
+			}
+			for (INT oy = 0; oy < nOutHeight; ++oy)
+			{
+				ey = oy + 0.5 - map.cy;
+				s  = bTransposed ? getOriginU(&map, ey) : getOriginV(&map, ey);
+				if ((s < nRowBegin) || (s >= nRowEnd)) {
+					continue;
+				}
+				getTap(s, nRowBegin, nRowEnd, &rowTaps[oy]);
+				if (oy < nBandBegin) { nBandBegin = oy; }
+				nBandEnd = oy + 1;
+			}
+		}
+		if ((nSpanEnd <= nSpanBegin) || (nBandEnd <= nBandBegin))
+		{
+			nSpanBegin = nSpanEnd = 0;
+			nBandBegin = nBandEnd = 0;
+		}
+
+		// letterbox bands
+		for (INT oy = 0; oy < nOutHeight; ++oy)
+		{
+			UINT *pOut = (UINT*)(pDst + (size_t)oy * nDstPitch);
+			if ((oy < nBandBegin) || (oy >= nBandEnd))
+			{
+				for (INT ox = 0; ox < nOutWidth; ++ox) { pOut[ox] = uiBlack; }
+				continue;
+			}
+			for (INT ox = 0; ox < nSpanBegin; ++ox) { pOut[ox] = uiBlack; }
+			for (INT ox = nSpanEnd; ox < nOutWidth; ++ox) { pOut[ox] = uiBlack; }
+		}
+
+		// unscaled: the covered block is the rotated source block (whole pixels)
+		const double dStepCol = bTransposed ? map.vx : map.ux;
+		const double dStepRow = bTransposed ? map.uy : map.vy;
+		if ((nSpanEnd > nSpanBegin) && ((dStepCol == 1.0) || (dStepCol == -1.0)) && ((dStepRow == 1.0) || (dStepRow == -1.0)) &&
+			(colTaps[nSpanBegin].W == 0) && (rowTaps[nBandBegin].W == 0))
+		{
+			INT nCol0 = colTaps[nSpanBegin].I0, nCol1 = colTaps[nSpanEnd - 1].I0;
+			INT nRow0 = rowTaps[nBandBegin].I0, nRow1 = rowTaps[nBandEnd - 1].I0;
+			INT nX = bTransposed ? ((nRow0 < nRow1) ? nRow0 : nRow1) : ((nCol0 < nCol1) ? nCol0 : nCol1);
+			INT nY = bTransposed ? ((nCol0 < nCol1) ? nCol0 : nCol1) : ((nRow0 < nRow1) ? nRow0 : nRow1);
+			INT nWidth  = bTransposed ? (nBandEnd - nBandBegin) : (nSpanEnd - nSpanBegin);
+			INT nHeight = bTransposed ? (nSpanEnd - nSpanBegin) : (nBandEnd - nBandBegin);
+			INT nDegrees = bTransposed ? ((map.vx < 0.0) ? 90 : 270) : ((map.ux > 0.0) ? 0 : 180);
+
+			DXGICaptureRotate::Rotate(pSrc + (size_t)nY * nSrcPitch + (size_t)nX * 4, nSrcPitch, nWidth, nHeight,
+				pDst + (size_t)nBandBegin * nDstPitch + (size_t)nSpanBegin * 4, nDstPitch, nDegrees);
+			return S_OK;
+		}
+
+		if (!bTransposed)
+		{
+			// 0/180: the source row is fixed along the output row
+			for (INT oy = nBandBegin; oy < nBandEnd; ++oy)
+			{
+				UINT *pOut = (UINT*)(pDst + (size_t)oy * nDstPitch);
+				const tagRenderTap &y = rowTaps[oy];
+				const UINT *r0 = (const UINT*)(pSrc + (size_t)y.I0 * nSrcPitch);
+				const UINT *r1 = (const UINT*)(pSrc + (size_t)y.I1 * nSrcPitch);
+
+				for (INT ox = nSpanBegin; ox < nSpanEnd; ++ox)
+				{
+					const tagRenderTap &x = colTaps[ox];
+					pOut[ox] = sampleBilinear(r0[x.I0], r0[x.I1], r1[x.I0], r1[x.I1], x.W, y.W);
+				}
+			}
+			return S_OK;
+		}
+
+		// 90/270: bands of output rows read neighbouring source columns of the same source rows
+		const INT nBand = 16;
+		for (INT oy = nBandBegin; oy < nBandEnd; oy += nBand)
+		{
+			INT nRows = ((nBandEnd - oy) < nBand) ? (nBandEnd - oy) : nBand;
+			UINT *pOut[nBand];
+			for (INT r = 0; r < nRows; ++r) {
+				pOut[r] = (UINT*)(pDst + (size_t)(oy + r) * nDstPitch);
+			}
+			const tagRenderTap *pX = &rowTaps[oy];
+
+			for (INT ox = nSpanBegin; ox < nSpanEnd; ++ox)
+			{
+				const tagRenderTap &y = colTaps[ox];
+				const UINT *r0 = (const UINT*)(pSrc + (size_t)y.I0 * nSrcPitch);
+				const UINT *r1 = (const UINT*)(pSrc + (size_t)y.I1 * nSrcPitch);
+				for (INT r = 0; r < nRows; ++r) {
+					pOut[r][ox] = sampleBilinear(r0[pX[r].I0], r0[pX[r].I1], r1[pX[r].I0], r1[pX[r].I1], pX[r].W, y.W);
+				}
+			}
+		}
+
+		return S_OK;
+	} // Render
+
+	//
+	// Generic affine renderer: every output pixel is mapped through the inverse
+	// transform. Reference of Render and the path of arbitrary angles.
+	//
+	static
+	inline
+	HRESULT
+	RenderAffine(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nSrcWidth,
+		_In_ INT nSrcHeight,
+		_In_ const tagFrameGeometry *pGeometry,
+		_Out_ BYTE *pDst,
+		_In_ INT nDstPitch
+		)
+	{
+		CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+		CHECK_POINTER_EX(pDst, E_INVALIDARG);
+		HRESULT hr = IsGeometryValid(pGeometry);
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		tagRenderMapping map;
+		getMapping(pGeometry, nSrcWidth, nSrcHeight, &map);
+		return renderAffine(pSrc, nSrcPitch, &map, pDst, nDstPitch);
+	} // RenderAffine
+
+}; // end class DXGICaptureRender
+
+#endif // __DXGICAPTURERENDER_H__
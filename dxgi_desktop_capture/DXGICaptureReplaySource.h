@@ -0,0 +1,276 @@
+/*****************************************************************************
+* DXGICaptureReplaySource.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREREPLAYSOURCE_H__
+#define __DXGICAPTUREREPLAYSOURCE_H__
+
+#include "DXGICaptureSource.h"
+#include "DXGICaptureDelta.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICaptureQoi.h"
+#include "DXGICaptureRecording.h"
+
+#include <string.h>
+
+//
+// class CDXGIReplaySource
+//
+// Capture source that plays a recording back (see CDXGIRecordingWriter).
+// Frames are delivered without waiting and with their recorded timestamps,
+// raw images straight from the mapped segment. Any frame can be selected with
+// Seek, a frame that does not follow the previous one is reported fully dirty.
+// Delta compressed frames are decoded from the nearest keyframe, or from the
+// last decoded frame if that is closer.
+//
+class CDXGIReplaySource : public IDXGICaptureSource
+{
+private:
+	CDXGIRecordingReader    m_reader;
+	tagFrameBufferInfo      m_image;
+	UINT64                  m_ullNext;
+	UINT64                  m_ullLast;      /* index of the last delivered frame, ~0: none */
+	UINT64                  m_ullDecoded;   /* delta: index of the image in m_image, ~0: none */
+	UINT64                  m_ullDecodedFrames;
+	BOOL                    m_bLoop;
+	BOOL                    m_bAcquired;
+	tagFrameRect            m_fullRect;
+	tagCapturePointer       m_pointer;
+
+	// disable copy
+	CDXGIReplaySource(const CDXGIReplaySource&);
+	CDXGIReplaySource& operator=(const CDXGIReplaySource&);
+
+	//
+	// Brings m_image to the delta compressed frame of the index
+	//
+	inline
+	HRESULT
+	decodeDelta(
+		_In_ UINT64 ullIndex
+		)
+	{
+		if (m_ullDecoded == ullIndex) {
+			return S_OK;
+		}
+		UINT64 ullKeyframe = m_reader.GetKeyframe(ullIndex);
+		if (ullKeyframe == ~0ULL) {
+			return E_INVALIDARG;
+		}
+
+		const tagCaptureSourceDesc *pDesc = m_reader.GetDesc();
+		HRESULT hr = DXGICaptureFrameBuffer::Resize(&m_image, (UINT)(pDesc->Width * 4 * pDesc->Height));
+		CHECK_HR_RETURN(hr);
+
+		UINT64 ullStart = ((m_ullDecoded != ~0ULL) && (m_ullDecoded >= ullKeyframe) && (m_ullDecoded < ullIndex)) ? m_ullDecoded + 1 : ullKeyframe;
+		m_ullDecoded = ~0ULL;
+		for (UINT64 i = ullStart; i <= ullIndex; ++i)
+		{
+			tagRecordingFrame frame;
+			hr = m_reader.GetFrame(i, &frame);
+			CHECK_HR_RETURN(hr);
+			BOOL bKeyframe = (frame.Header->Flags & DXGICAPTURE_RECORDING_FRAME_KEYFRAME) ? TRUE : FALSE;
+			if (!bKeyframe && (frame.Header->MoveRectCount > 0)) {
+				DXGICaptureDirtyRects::ApplyMoves(m_image.Buffer, pDesc->Width * 4, pDesc->Width, pDesc->Height, frame.MoveRects, frame.Header->MoveRectCount);
+			}
+			hr = DXGICaptureDelta::Decode(frame.Image, frame.Header->ImageSize, bKeyframe, m_image.Buffer, pDesc->Width * 4, pDesc->Width, pDesc->Height);
+			CHECK_HR_RETURN(hr);
+			m_ullDecodedFrames++;
+		}
+		m_ullDecoded = ullIndex;
+		return S_OK;
+	}
+
+public:
+	CDXGIReplaySource()
+		: m_ullNext(0)
+		, m_ullLast(~0ULL)
+		, m_ullDecoded(~0ULL)
+		, m_ullDecodedFrames(0)
+		, m_bLoop(FALSE)
+		, m_bAcquired(FALSE)
+	{
+		memset(&m_image, 0, sizeof(m_image));
+		memset(&m_fullRect, 0, sizeof(m_fullRect));
+		memset(&m_pointer, 0, sizeof(m_pointer));
+	}
+
+	virtual ~CDXGIReplaySource()
+	{
+		DXGICaptureFrameBuffer::Free(&m_image);
+	}
+
+	//
+	// Opens the recording <base>.NNNN.dxr, with bLoop the playback restarts
+	// at the first frame instead of timing out at the end
+	//
+	inline
+	HRESULT
+	Open(
+		_In_ const char *pszBasePath,
+		_In_ BOOL bLoop
+		)
+	{
+		if (m_bAcquired) {
+			return E_UNEXPECTED;
+		}
+
+		HRESULT hr = m_reader.Open(pszBasePath);
+		CHECK_HR_RETURN(hr);
+		if (m_reader.GetFrameCount() == 0)
+		{
+			m_reader.Close();
+			return E_INVALIDARG;
+		}
+
+		const tagCaptureSourceDesc *pDesc = m_reader.GetDesc();
+		m_fullRect.Left   = 0;
+		m_fullRect.Top    = 0;
+		m_fullRect.Right  = pDesc->Width;
+		m_fullRect.Bottom = pDesc->Height;
+		m_ullNext    = 0;
+		m_ullLast    = ~0ULL;
+		m_ullDecoded = ~0ULL;
+		m_bLoop      = bLoop;
+		return S_OK;
+	}
+
+	//
+	// The next acquired frame is the frame of the recording index
+	//
+	inline
+	HRESULT
+	Seek(
+		_In_ UINT64 ullIndex
+		)
+	{
+		if (ullIndex >= m_reader.GetFrameCount()) {
+			return E_INVALIDARG;
+		}
+		m_ullNext = ullIndex;
+		return S_OK;
+	}
+
+	inline UINT64 GetFrameCount() const { return m_reader.GetFrameCount(); }
+	inline UINT64 GetPosition() const { return m_ullNext; }
+	inline UINT64 GetDecodedFrameCount() const { return m_ullDecodedFrames; }
+	inline const CDXGIRecordingReader* GetReader() const { return &m_reader; }
+
+	// IDXGICaptureSource
+	virtual HRESULT GetDesc(_Out_ tagCaptureSourceDesc *pDesc)
+	{
+		CHECK_POINTER(pDesc);
+		*pDesc = *m_reader.GetDesc();
+		return S_OK;
+	}
+
+	virtual HRESULT AcquireFrame(_In_ UINT uiTimeoutMsec, _Out_ tagCaptureSourceFrame *pFrame)
+	{
+		(void)uiTimeoutMsec;
+		CHECK_POINTER(pFrame);
+		memset(pFrame, 0, sizeof(*pFrame));
+		if ((m_reader.GetFrameCount() == 0) || m_bAcquired) {
+			return E_UNEXPECTED;
+		}
+		if (m_ullNext >= m_reader.GetFrameCount())
+		{
+			if (!m_bLoop) {
+				return S_FALSE;
+			}
+			m_ullNext = 0;
+		}
+
+		tagRecordingFrame frame;
+		HRESULT hr = m_reader.GetFrame(m_ullNext, &frame);
+		CHECK_HR_RETURN(hr);
+		const tagRecordingFrameHeader *pHeader = frame.Header;
+		const tagCaptureSourceDesc *pDesc = m_reader.GetDesc();
+
+		if (pHeader->Compression == tagRecordingCompression_Qoi)
+		{
+			INT nWidth = 0, nHeight = 0;
+			hr = DXGICaptureQoi::Decode(frame.Image, pHeader->ImageSize, &m_image, &nWidth, &nHeight);
+			CHECK_HR_RETURN(hr);
+			if ((nWidth != pDesc->Width) || (nHeight != pDesc->Height)) {
+				return E_INVALIDARG;
+			}
+			pFrame->Data  = m_image.Buffer;
+			pFrame->Pitch = nWidth * 4;
+		}
+		else if (pHeader->Compression == tagRecordingCompression_Delta)
+		{
+			hr = decodeDelta(m_ullNext);
+			CHECK_HR_RETURN(hr);
+			pFrame->Data  = m_image.Buffer;
+			pFrame->Pitch = pDesc->Width * 4;
+		}
+		else
+		{
+			pFrame->Data  = frame.Image;
+			pFrame->Pitch = pHeader->Pitch;
+		}
+
+		// the rects are relative to the previous recorded frame
+		if ((m_ullLast != ~0ULL) && (m_ullNext == m_ullLast + 1))
+		{
+			pFrame->MoveRects      = (pHeader->MoveRectCount > 0) ? frame.MoveRects : nullptr;
+			pFrame->MoveRectCount  = pHeader->MoveRectCount;
+			pFrame->DirtyRects     = (pHeader->DirtyRectCount > 0) ? frame.DirtyRects : nullptr;
+			pFrame->DirtyRectCount = pHeader->DirtyRectCount;
+		}
+		else
+		{
+			pFrame->DirtyRects     = &m_fullRect;
+			pFrame->DirtyRectCount = 1;
+		}
+
+		if (pHeader->PointerFlags & DXGICAPTURE_RECORDING_POINTER_PRESENT)
+		{
+			memset(&m_pointer, 0, sizeof(m_pointer));
+			m_pointer.Visible   = (pHeader->PointerFlags & DXGICAPTURE_RECORDING_POINTER_VISIBLE) ? TRUE : FALSE;
+			m_pointer.X         = pHeader->PointerX;
+			m_pointer.Y         = pHeader->PointerY;
+			m_pointer.Type      = pHeader->PointerType;
+			m_pointer.Width     = pHeader->PointerWidth;
+			m_pointer.Height    = pHeader->PointerHeight;
+			m_pointer.Pitch     = pHeader->PointerPitch;
+			m_pointer.ShapeSize = pHeader->PointerShapeSize;
+			m_pointer.Shape     = frame.Shape;
+			m_pointer.ShapeHash = pHeader->PointerShapeHash;
+			pFrame->Pointer = &m_pointer;
+		}
+
+		pFrame->FrameNumber       = pHeader->FrameNumber;
+		pFrame->Timestamp         = pHeader->Timestamp;
+		pFrame->AccumulatedFrames = pHeader->AccumulatedFrames;
+
+		m_ullLast = m_ullNext++;
+		m_bAcquired = TRUE;
+		return S_OK;
+	}
+
+	virtual HRESULT ReleaseFrame()
+	{
+		if (!m_bAcquired) {
+			return E_UNEXPECTED;
+		}
+		m_bAcquired = FALSE;
+		return S_OK;
+	}
+
+}; // end class CDXGIReplaySource
+
+#endif // __DXGICAPTUREREPLAYSOURCE_H__
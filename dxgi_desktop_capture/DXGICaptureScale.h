@@ -0,0 +1,1026 @@
+/*****************************************************************************
+* DXGICaptureScale.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESCALE_H__
+#define __DXGICAPTURESCALE_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICaptureRender.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#define DXGICAPTURE_SCALE_BITS      14
+#define DXGICAPTURE_SCALE_ONE       (1 << DXGICAPTURE_SCALE_BITS)
+#define DXGICAPTURE_SCALE_ROUND     (1 << (DXGICAPTURE_SCALE_BITS - 1))
+
+//
+// class CDXGICaptureScaler
+//
+// Cpu scaler of the non rotated output, with the placement of the D2D1
+// renderer (see DXGICaptureRender::Render). The filter tables (14 bit fixed
+// point weights) are calculated once by SetConfig. Scale runs a vertical pass
+// into a row buffer and a horizontal pass into the output; integer 2x/3x/4x
+// box downscales average the source blocks directly. Output pixels outside of
+// the scaled image are opaque black. The SIMD kernels are bit-exact to the
+// scalar ones.
+//
+class CDXGICaptureScaler
+{
+private:
+	tagFrameScaleFilter     m_filter;
+	tagFrameSize            m_outputSize;
+	tagFrameBounds          m_srcRect;  // visible source rect
+	tagFrameBounds          m_dstRect;  // output rect covered by the image
+	INT                     m_nFactor;  // integer downscale factor of the box path, 0: filter tables
+	INT                     m_nTapsX;
+	INT                     m_nTapsY;
+	std::vector<INT>        m_xIndex;   // first tap of an output column, relative to the source rect
+	std::vector<SHORT>      m_xWeights; // m_nTapsX per output column
+	std::vector<INT>        m_yIndex;   // source row of every tap, m_nTapsY per output row
+	std::vector<SHORT>      m_yWeights; // m_nTapsY per output row
+	tagFrameBufferInfo      m_rowBuffer;
+
+	// disable copy
+	CDXGICaptureScaler(const CDXGICaptureScaler&);
+	CDXGICaptureScaler& operator=(const CDXGICaptureScaler&);
+
+	//
+	// Calculates the filter taps of one axis. The output position o samples the
+	// source at u = center + (o + 0.5 - center) / scale + offset, positions
+	// outside of [nBegin, nEnd) are not covered.
+	//
+	static
+	inline
+	HRESULT
+	buildAxis(
+		_In_ tagFrameScaleFilter filter,
+		_In_ INT nOut,
+		_In_ double dCenter,
+		_In_ double dScale,
+		_In_ double dOffset,
+		_In_ INT nBegin,
+		_In_ INT nEnd,
+		_Out_ INT *pRetDstBegin,
+		_Out_ INT *pRetDstEnd,
+		_Out_ INT *pRetTaps,
+		_Inout_ std::vector<INT> *pFirst,
+		_Inout_ std::vector<SHORT> *pWeights
+		)
+	{
+		*pRetDstBegin = 0;
+		*pRetDstEnd   = 0;
+		*pRetTaps     = 0;
+		pFirst->clear();
+		pWeights->clear();
+
+		INT nDstBegin = nOut, nDstEnd = 0;
+		for (INT o = 0; o < nOut; ++o)
+		{
+			double u = dCenter + (o + 0.5 - dCenter) / dScale + dOffset;
+			if ((u >= nBegin) && (u < nEnd))
+			{
+				if (o < nDstBegin) { nDstBegin = o; }
+				nDstEnd = o + 1;
+			}
+		}
+		if (nDstEnd <= nDstBegin) {
+			return E_INVALIDARG;
+		}
+
+		// area of an output pixel in the source
+		const double dHalf = (dScale < 1.0) ? (0.5 / dScale) : 0.5;
+
+		INT nTaps = 1;
+		if (filter == tagFrameScaleFilter_Bilinear) {
+			nTaps = 2;
+		}
+		else if (filter == tagFrameScaleFilter_Box) {
+			nTaps = (INT)ceil(2.0 * dHalf) + 1;
+		}
+		if ((filter != tagFrameScaleFilter_Nearest) && (nTaps & 1)) {
+			++nTaps; // the kernels take the taps in pairs
+		}
+
+		std::vector<double> weights(nTaps);
+		pFirst->resize(nDstEnd - nDstBegin);
+		pWeights->resize((size_t)(nDstEnd - nDstBegin) * nTaps);
+
+		for (INT o = nDstBegin; o < nDstEnd; ++o)
+		{
+			double u = dCenter + (o + 0.5 - dCenter) / dScale + dOffset;
+			INT nFirst = 0, nCount = 1;
+			weights.assign(nTaps, 0.0);
+
+			if (filter == tagFrameScaleFilter_Bilinear)
+			{
+				double f = u - 0.5;
+				INT x0 = (INT)floor(f);
+				double w = f - x0;
+				if (x0 < nBegin) {
+					nFirst = nBegin; weights[0] = 1.0;
+				}
+				else if (x0 + 1 >= nEnd) {
+					nFirst = nEnd - 1; weights[0] = 1.0;
+				}
+				else {
+					nFirst = x0; weights[0] = 1.0 - w; weights[1] = w; nCount = 2;
+				}
+			}
+			else if (filter == tagFrameScaleFilter_Box)
+			{
+				double a = u - dHalf, b = u + dHalf;
+				if (a < nBegin) { a = nBegin; }
+				if (b > nEnd) { b = nEnd; }
+				nFirst = (INT)floor(a);
+				nCount = (INT)ceil(b) - nFirst;
+				if (nCount > nTaps) { nCount = nTaps; }
+				for (INT i = 0; i < nCount; ++i)
+				{
+					double l = (nFirst + i > a) ? (nFirst + i) : a;
+					double r = (nFirst + i + 1 < b) ? (nFirst + i + 1) : b;
+					weights[i] = (r > l) ? ((r - l) / (b - a)) : 0.0;
+				}
+			}
+			else // tagFrameScaleFilter_Nearest
+			{
+				nFirst = (INT)floor(u);
+				weights[0] = 1.0;
+			}
+
+			// fixed point, the rounding error goes to the largest weight
+			SHORT *pW = &(*pWeights)[(size_t)(o - nDstBegin) * nTaps];
+			INT nSum = 0, nMax = 0;
+			for (INT i = 0; i < nTaps; ++i)
+			{
+				pW[i] = (SHORT)floor(weights[i] * DXGICAPTURE_SCALE_ONE + 0.5);
+				nSum += pW[i];
+				if (pW[i] > pW[nMax]) { nMax = i; }
+			}
+			pW[nMax] = (SHORT)(pW[nMax] + DXGICAPTURE_SCALE_ONE - nSum);
+
+			(*pFirst)[o - nDstBegin] = nFirst - nBegin;
+		}
+
+		*pRetDstBegin = nDstBegin;
+		*pRetDstEnd   = nDstEnd;
+		*pRetTaps     = nTaps;
+		return S_OK;
+	} // buildAxis
+
+	//
+	// Vertical pass: pDst[i] = sum(weight[k] * row[k][i]), nTaps is even
+	//
+	static
+	inline
+	void
+	verticalRowScalar(
+		_In_ const BYTE **ppRows,
+		_In_ const SHORT *pWeights,
+		_In_ INT nTaps,
+		_Out_ BYTE *pDst,
+		_In_ INT nBegin,
+		_In_ INT nBytes
+		)
+	{
+		for (INT i = nBegin; i < nBytes; ++i)
+		{
+			INT nSum = DXGICAPTURE_SCALE_ROUND;
+			for (INT k = 0; k < nTaps; ++k) {
+				nSum += pWeights[k] * ppRows[k][i];
+			}
+			nSum >>= DXGICAPTURE_SCALE_BITS;
+			pDst[i] = (BYTE)((nSum > 255) ? 255 : nSum);
+		}
+	} // verticalRowScalar
+
+	//
+	// Horizontal pass: one output pixel from nTaps row buffer pixels
+	//
+	static
+	inline
+	void
+	horizontalRowScalar(
+		_In_ const BYTE *pRow,
+		_In_ const INT *pFirst,
+		_In_ const SHORT *pWeights,
+		_In_ INT nTaps,
+		_Out_ UINT *pDst,
+		_In_ INT nBegin,
+		_In_ INT nCount
+		)
+	{
+		for (INT x = nBegin; x < nCount; ++x)
+		{
+			const BYTE *p = pRow + (size_t)pFirst[x] * 4;
+			const SHORT *w = pWeights + (size_t)x * nTaps;
+			INT b = DXGICAPTURE_SCALE_ROUND, g = b, r = b, a = b;
+			for (INT k = 0; k < nTaps; ++k, p += 4)
+			{
+				b += w[k] * p[0];
+				g += w[k] * p[1];
+				r += w[k] * p[2];
+				a += w[k] * p[3];
+			}
+			b >>= DXGICAPTURE_SCALE_BITS; g >>= DXGICAPTURE_SCALE_BITS;
+			r >>= DXGICAPTURE_SCALE_BITS; a >>= DXGICAPTURE_SCALE_BITS;
+			pDst[x] = (UINT)((b > 255) ? 255 : b) | ((UINT)((g > 255) ? 255 : g) << 8) |
+				((UINT)((r > 255) ? 255 : r) << 16) | ((UINT)((a > 255) ? 255 : a) << 24);
+		}
+	} // horizontalRowScalar
+
+	//
+	// Integer downscale: sums nFactor source rows into 16 bit lanes
+	//
+	static
+	inline
+	void
+	accumulateRowsScalar(
+		_In_ const BYTE **ppRows,
+		_In_ INT nFactor,
+		_Out_ USHORT *pAcc,
+		_In_ INT nBegin,
+		_In_ INT nBytes
+		)
+	{
+		for (INT i = nBegin; i < nBytes; ++i)
+		{
+			UINT uiSum = 0;
+			for (INT k = 0; k < nFactor; ++k) {
+				uiSum += ppRows[k][i];
+			}
+			pAcc[i] = (USHORT)uiSum;
+		}
+	} // accumulateRowsScalar
+
+	// rounded average of nFactor x nFactor pixels (3x: (s + 4) * 7282 >> 16 == round(s / 9) for s <= 9 * 255)
+	static
+	inline
+	UINT
+	boxAverage(
+		_In_ UINT uiSum,
+		_In_ INT nFactor
+		)
+	{
+		return (nFactor == 2) ? ((uiSum + 2) >> 2)
+			: (nFactor == 4) ? ((uiSum + 8) >> 4)
+			: (((uiSum + 4) * 7282) >> 16);
+	} // boxAverage
+
+	static
+	inline
+	void
+	boxRowScalar(
+		_In_ const USHORT *pAcc,
+		_In_ INT nFactor,
+		_Out_ UINT *pDst,
+		_In_ INT nBegin,
+		_In_ INT nCount
+		)
+	{
+		for (INT x = nBegin; x < nCount; ++x)
+		{
+			const USHORT *p = pAcc + (size_t)x * nFactor * 4;
+			UINT uiPixel = 0;
+			for (INT c = 0; c < 4; ++c)
+			{
+				UINT uiSum = 0;
+				for (INT k = 0; k < nFactor; ++k) {
+					uiSum += p[k * 4 + c];
+				}
+				uiPixel |= boxAverage(uiSum, nFactor) << (c * 8);
+			}
+			pDst[x] = uiPixel;
+		}
+	} // boxRowScalar
+
+#if defined(DXGICAPTURE_HAVE_X86)
+	//
+	// 16 bytes per iteration, the taps are multiplied in pairs (pmaddwd)
+	//
+	static
+	inline
+	void
+	verticalRowSSE2(
+		_In_ const BYTE **ppRows,
+		_In_ const SHORT *pWeights,
+		_In_ INT nTaps,
+		_Out_ BYTE *pDst,
+		_In_ INT nBytes
+		)
+	{
+		const __m128i zero  = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi32(DXGICAPTURE_SCALE_ROUND);
+
+		INT i = 0;
+		for (; i + 16 <= nBytes; i += 16)
+		{
+			__m128i s0 = round, s1 = round, s2 = round, s3 = round;
+			for (INT k = 0; k < nTaps; k += 2)
+			{
+				__m128i w  = _mm_set1_epi32((INT)(USHORT)pWeights[k] | ((INT)pWeights[k + 1] << 16));
+				__m128i a  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ppRows[k] + i));
+				__m128i b  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ppRows[k + 1] + i));
+				__m128i aL = _mm_unpacklo_epi8(a, zero), aH = _mm_unpackhi_epi8(a, zero);
+				__m128i bL = _mm_unpacklo_epi8(b, zero), bH = _mm_unpackhi_epi8(b, zero);
+				s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi16(aL, bL), w));
+				s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi16(aL, bL), w));
+				s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi16(aH, bH), w));
+				s3 = _mm_add_epi32(s3, _mm_madd_epi16(_mm_unpackhi_epi16(aH, bH), w));
+			}
+			__m128i lo = _mm_packs_epi32(_mm_srai_epi32(s0, DXGICAPTURE_SCALE_BITS), _mm_srai_epi32(s1, DXGICAPTURE_SCALE_BITS));
+			__m128i hi = _mm_packs_epi32(_mm_srai_epi32(s2, DXGICAPTURE_SCALE_BITS), _mm_srai_epi32(s3, DXGICAPTURE_SCALE_BITS));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), _mm_packus_epi16(lo, hi));
+		}
+
+		verticalRowScalar(ppRows, pWeights, nTaps, pDst, i, nBytes);
+	} // verticalRowSSE2
+
+	//
+	// 1 output pixel per iteration, 2 taps per pmaddwd
+	//
+	static
+	inline
+	void
+	horizontalRowSSE2(
+		_In_ const BYTE *pRow,
+		_In_ const INT *pFirst,
+		_In_ const SHORT *pWeights,
+		_In_ INT nTaps,
+		_Out_ UINT *pDst,
+		_In_ INT nCount
+		)
+	{
+		const __m128i zero  = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi32(DXGICAPTURE_SCALE_ROUND);
+
+		for (INT x = 0; x < nCount; ++x)
+		{
+			const BYTE *p = pRow + (size_t)pFirst[x] * 4;
+			const SHORT *w = pWeights + (size_t)x * nTaps;
+			__m128i s = round;
+			for (INT k = 0; k < nTaps; k += 2, p += 8)
+			{
+				// B0 G0 R0 A0 B1 G1 R1 A1 -> B0 B1 G0 G1 R0 R1 A0 A1
+				__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+				v = _mm_unpacklo_epi16(v, _mm_srli_si128(v, 8));
+				s = _mm_add_epi32(s, _mm_madd_epi16(v, _mm_set1_epi32((INT)(USHORT)w[k] | ((INT)w[k + 1] << 16))));
+			}
+			s = _mm_packs_epi32(_mm_srai_epi32(s, DXGICAPTURE_SCALE_BITS), zero);
+			pDst[x] = (UINT)_mm_cvtsi128_si32(_mm_packus_epi16(s, zero));
+		}
+	} // horizontalRowSSE2
+
+	static
+	inline
+	void
+	accumulateRowsSSE2(
+		_In_ const BYTE **ppRows,
+		_In_ INT nFactor,
+		_Out_ USHORT *pAcc,
+		_In_ INT nBytes
+		)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		INT i = 0;
+		for (; i + 16 <= nBytes; i += 16)
+		{
+			__m128i lo = zero, hi = zero;
+			for (INT k = 0; k < nFactor; ++k)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ppRows[k] + i));
+				lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+				hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pAcc + i), lo);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pAcc + i + 8), hi);
+		}
+
+		accumulateRowsScalar(ppRows, nFactor, pAcc, i, nBytes);
+	} // accumulateRowsSSE2
+
+	//
+	// 2 output pixels per iteration
+	//
+	static
+	inline
+	void
+	boxRowSSE2(
+		_In_ const USHORT *pAcc,
+		_In_ INT nFactor,
+		_Out_ UINT *pDst,
+		_In_ INT nCount
+		)
+	{
+		const __m128i zero = _mm_setzero_si128();
+
+		INT x = 0;
+		for (; x + 2 <= nCount; x += 2)
+		{
+			const USHORT *p0 = pAcc + (size_t)x * nFactor * 4;
+			const USHORT *p1 = p0 + nFactor * 4;
+			__m128i s0 = zero, s1 = zero;
+			for (INT k = 0; k < nFactor; ++k)
+			{
+				s0 = _mm_add_epi16(s0, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p0 + k * 4)));
+				s1 = _mm_add_epi16(s1, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p1 + k * 4)));
+			}
+			__m128i s = _mm_unpacklo_epi64(s0, s1);
+			if (nFactor == 2) {
+				s = _mm_srli_epi16(_mm_add_epi16(s, _mm_set1_epi16(2)), 2);
+			}
+			else if (nFactor == 4) {
+				s = _mm_srli_epi16(_mm_add_epi16(s, _mm_set1_epi16(8)), 4);
+			}
+			else {
+				s = _mm_mulhi_epu16(_mm_add_epi16(s, _mm_set1_epi16(4)), _mm_set1_epi16(7282));
+			}
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(pDst + x), _mm_packus_epi16(s, zero));
+		}
+
+		boxRowScalar(pAcc, nFactor, pDst, x, nCount);
+	} // boxRowSSE2
+
+	//
+	// 32 bytes per iteration
+	//
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	void
+	verticalRowAVX2(
+		_In_ const BYTE **ppRows,
+		_In_ const SHORT *pWeights,
+		_In_ INT nTaps,
+		_Out_ BYTE *pDst,
+		_In_ INT nBytes
+		)
+	{
+		const __m256i zero  = _mm256_setzero_si256();
+		const __m256i round = _mm256_set1_epi32(DXGICAPTURE_SCALE_ROUND);
+
+		INT i = 0;
+		for (; i + 32 <= nBytes; i += 32)
+		{
+			// unpack/pack work inside the 128 bit lanes, so the byte order is kept
+			__m256i s0 = round, s1 = round, s2 = round, s3 = round;
+			for (INT k = 0; k < nTaps; k += 2)
+			{
+				__m256i w  = _mm256_set1_epi32((INT)(USHORT)pWeights[k] | ((INT)pWeights[k + 1] << 16));
+				__m256i a  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ppRows[k] + i));
+				__m256i b  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ppRows[k + 1] + i));
+				__m256i aL = _mm256_unpacklo_epi8(a, zero), aH = _mm256_unpackhi_epi8(a, zero);
+				__m256i bL = _mm256_unpacklo_epi8(b, zero), bH = _mm256_unpackhi_epi8(b, zero);
+				s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(_mm256_unpacklo_epi16(aL, bL), w));
+				s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(_mm256_unpackhi_epi16(aL, bL), w));
+				s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(_mm256_unpacklo_epi16(aH, bH), w));
+				s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(_mm256_unpackhi_epi16(aH, bH), w));
+			}
+			__m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(s0, DXGICAPTURE_SCALE_BITS), _mm256_srai_epi32(s1, DXGICAPTURE_SCALE_BITS));
+			__m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(s2, DXGICAPTURE_SCALE_BITS), _mm256_srai_epi32(s3, DXGICAPTURE_SCALE_BITS));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), _mm256_packus_epi16(lo, hi));
+		}
+
+		verticalRowScalar(ppRows, pWeights, nTaps, pDst, i, nBytes);
+	} // verticalRowAVX2
+
+	//
+	// 2 output pixels per iteration, one in each 128 bit lane
+	//
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	void
+	horizontalRowAVX2(
+		_In_ const BYTE *pRow,
+		_In_ const INT *pFirst,
+		_In_ const SHORT *pWeights,
+		_In_ INT nTaps,
+		_Out_ UINT *pDst,
+		_In_ INT nCount
+		)
+	{
+		const __m256i round = _mm256_set1_epi32(DXGICAPTURE_SCALE_ROUND);
+		// B0 G0 R0 A0 B1 G1 R1 A1 -> B0 B1 G0 G1 R0 R1 A0 A1 (16 bit lanes)
+		const __m256i pairs = _mm256_setr_epi8(
+			0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+			0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+
+		INT x = 0;
+		for (; x + 2 <= nCount; x += 2)
+		{
+			const BYTE *p0 = pRow + (size_t)pFirst[x] * 4;
+			const BYTE *p1 = pRow + (size_t)pFirst[x + 1] * 4;
+			const SHORT *w0 = pWeights + (size_t)x * nTaps;
+			const SHORT *w1 = w0 + nTaps;
+			__m256i s = round;
+			for (INT k = 0; k < nTaps; k += 2, p0 += 8, p1 += 8)
+			{
+				__m128i v = _mm_unpacklo_epi64(
+					_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p0)),
+					_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p1)));
+				__m256i w = _mm256_inserti128_si256(
+					_mm256_castsi128_si256(_mm_set1_epi32((INT)(USHORT)w0[k] | ((INT)w0[k + 1] << 16))),
+					_mm_set1_epi32((INT)(USHORT)w1[k] | ((INT)w1[k + 1] << 16)), 1);
+				__m256i t = _mm256_shuffle_epi8(_mm256_cvtepu8_epi16(v), pairs);
+				s = _mm256_add_epi32(s, _mm256_madd_epi16(t, w));
+			}
+			s = _mm256_srai_epi32(s, DXGICAPTURE_SCALE_BITS);
+			s = _mm256_packus_epi16(_mm256_packs_epi32(s, s), s);
+			pDst[x]     = (UINT)_mm_cvtsi128_si32(_mm256_castsi256_si128(s));
+			pDst[x + 1] = (UINT)_mm_cvtsi128_si32(_mm256_extracti128_si256(s, 1));
+		}
+
+		if (x < nCount) {
+			horizontalRowSSE2(pRow, pFirst + x, pWeights + (size_t)x * nTaps, nTaps, pDst + x, nCount - x);
+		}
+	} // horizontalRowAVX2
+
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	void
+	accumulateRowsAVX2(
+		_In_ const BYTE **ppRows,
+		_In_ INT nFactor,
+		_Out_ USHORT *pAcc,
+		_In_ INT nBytes
+		)
+	{
+		INT i = 0;
+		for (; i + 32 <= nBytes; i += 32)
+		{
+			__m256i lo = _mm256_setzero_si256(), hi = lo;
+			for (INT k = 0; k < nFactor; ++k)
+			{
+				lo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ppRows[k] + i))));
+				hi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ppRows[k] + i + 16))));
+			}
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pAcc + i), lo);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pAcc + i + 16), hi);
+		}
+
+		accumulateRowsScalar(ppRows, nFactor, pAcc, i, nBytes);
+	} // accumulateRowsAVX2
+#endif // DXGICAPTURE_HAVE_X86
+
+#if defined(DXGICAPTURE_HAVE_NEON)
+	//
+	// 8 bytes per iteration
+	//
+	static
+	inline
+	void
+	verticalRowNEON(
+		_In_ const BYTE **ppRows,
+		_In_ const SHORT *pWeights,
+		_In_ INT nTaps,
+		_Out_ BYTE *pDst,
+		_In_ INT nBytes
+		)
+	{
+		INT i = 0;
+		for (; i + 8 <= nBytes; i += 8)
+		{
+			uint32x4_t lo = vdupq_n_u32(0), hi = lo;
+			for (INT k = 0; k < nTaps; ++k)
+			{
+				uint16x8_t v = vmovl_u8(vld1_u8(ppRows[k] + i));
+				lo = vmlal_n_u16(lo, vget_low_u16(v), (uint16_t)pWeights[k]);
+				hi = vmlal_n_u16(hi, vget_high_u16(v), (uint16_t)pWeights[k]);
+			}
+			// rounding narrow shifts: (s + 8192) >> 14
+			uint16x8_t r = vcombine_u16(vqrshrn_n_u32(lo, DXGICAPTURE_SCALE_BITS), vqrshrn_n_u32(hi, DXGICAPTURE_SCALE_BITS));
+			vst1_u8(pDst + i, vqmovn_u16(r));
+		}
+
+		verticalRowScalar(ppRows, pWeights, nTaps, pDst, i, nBytes);
+	} // verticalRowNEON
+
+	static
+	inline
+	void
+	horizontalRowNEON(
+		_In_ const BYTE *pRow,
+		_In_ const INT *pFirst,
+		_In_ const SHORT *pWeights,
+		_In_ INT nTaps,
+		_Out_ UINT *pDst,
+		_In_ INT nCount
+		)
+	{
+		for (INT x = 0; x < nCount; ++x)
+		{
+			const BYTE *p = pRow + (size_t)pFirst[x] * 4;
+			const SHORT *w = pWeights + (size_t)x * nTaps;
+			uint32x4_t s = vdupq_n_u32(0);
+			for (INT k = 0; k < nTaps; k += 2, p += 8)
+			{
+				uint16x8_t v = vmovl_u8(vld1_u8(p));
+				s = vmlal_n_u16(s, vget_low_u16(v), (uint16_t)w[k]);
+				s = vmlal_n_u16(s, vget_high_u16(v), (uint16_t)w[k + 1]);
+			}
+			uint16x4_t r = vqrshrn_n_u32(s, DXGICAPTURE_SCALE_BITS);
+			vst1_lane_u32(pDst + x, vreinterpret_u32_u8(vqmovn_u16(vcombine_u16(r, r))), 0);
+		}
+	} // horizontalRowNEON
+
+	static
+	inline
+	void
+	accumulateRowsNEON(
+		_In_ const BYTE **ppRows,
+		_In_ INT nFactor,
+		_Out_ USHORT *pAcc,
+		_In_ INT nBytes
+		)
+	{
+		INT i = 0;
+		for (; i + 16 <= nBytes; i += 16)
+		{
+			uint16x8_t lo = vdupq_n_u16(0), hi = lo;
+			for (INT k = 0; k < nFactor; ++k)
+			{
+				uint8x16_t v = vld1q_u8(ppRows[k] + i);
+				lo = vaddw_u8(lo, vget_low_u8(v));
+				hi = vaddw_u8(hi, vget_high_u8(v));
+			}
+			vst1q_u16(pAcc + i, lo);
+			vst1q_u16(pAcc + i + 8, hi);
+		}
+
+		accumulateRowsScalar(ppRows, nFactor, pAcc, i, nBytes);
+	} // accumulateRowsNEON
+
+	static
+	inline
+	void
+	boxRowNEON(
+		_In_ const USHORT *pAcc,
+		_In_ INT nFactor,
+		_Out_ UINT *pDst,
+		_In_ INT nCount
+		)
+	{
+		for (INT x = 0; x < nCount; ++x)
+		{
+			const USHORT *p = pAcc + (size_t)x * nFactor * 4;
+			uint16x4_t s = vld1_u16(p);
+			for (INT k = 1; k < nFactor; ++k) {
+				s = vadd_u16(s, vld1_u16(p + k * 4));
+			}
+			if (nFactor == 2) {
+				s = vrshr_n_u16(s, 2);
+			}
+			else if (nFactor == 4) {
+				s = vrshr_n_u16(s, 4);
+			}
+			else {
+				s = vshrn_n_u32(vmull_n_u16(vadd_u16(s, vdup_n_u16(4)), 7282), 16);
+			}
+			vst1_lane_u32(pDst + x, vreinterpret_u32_u8(vmovn_u16(vcombine_u16(s, s))), 0);
+		}
+	} // boxRowNEON
+#endif // DXGICAPTURE_HAVE_NEON
+
+	inline
+	void
+	verticalRow(
+		_In_ const BYTE **ppRows,
+		_In_ const SHORT *pWeights,
+		_Out_ BYTE *pDst,
+		_In_ INT nBytes,
+		_In_ tagSimdLevel level
+		)
+	{
+		switch (level)
+		{
+#if defined(DXGICAPTURE_HAVE_X86)
+		case tagSimdLevel_AVX2:
+			verticalRowAVX2(ppRows, pWeights, m_nTapsY, pDst, nBytes);
+			break;
+		case tagSimdLevel_SSE2:
+			verticalRowSSE2(ppRows, pWeights, m_nTapsY, pDst, nBytes);
+			break;
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+		case tagSimdLevel_NEON:
+			verticalRowNEON(ppRows, pWeights, m_nTapsY, pDst, nBytes);
+			break;
+#endif
+		default:
+			verticalRowScalar(ppRows, pWeights, m_nTapsY, pDst, 0, nBytes);
+			break;
+		}
+	} // verticalRow
+
+	inline
+	void
+	horizontalRow(
+		_In_ const BYTE *pRow,
+		_Out_ UINT *pDst,
+		_In_ tagSimdLevel level
+		)
+	{
+		const INT nCount = m_dstRect.Width;
+		switch (level)
+		{
+#if defined(DXGICAPTURE_HAVE_X86)
+		case tagSimdLevel_AVX2:
+			horizontalRowAVX2(pRow, &m_xIndex[0], &m_xWeights[0], m_nTapsX, pDst, nCount);
+			break;
+		case tagSimdLevel_SSE2:
+			horizontalRowSSE2(pRow, &m_xIndex[0], &m_xWeights[0], m_nTapsX, pDst, nCount);
+			break;
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+		case tagSimdLevel_NEON:
+			horizontalRowNEON(pRow, &m_xIndex[0], &m_xWeights[0], m_nTapsX, pDst, nCount);
+			break;
+#endif
+		default:
+			horizontalRowScalar(pRow, &m_xIndex[0], &m_xWeights[0], m_nTapsX, pDst, 0, nCount);
+			break;
+		}
+	} // horizontalRow
+
+	inline
+	void
+	boxRow(
+		_In_ const BYTE **ppRows,
+		_Out_ UINT *pDst,
+		_In_ tagSimdLevel level
+		)
+	{
+		const INT nBytes = m_srcRect.Width * 4;
+		const INT nCount = m_dstRect.Width;
+		USHORT *pAcc = reinterpret_cast<USHORT*>(m_rowBuffer.Buffer);
+		switch (level)
+		{
+#if defined(DXGICAPTURE_HAVE_X86)
+		case tagSimdLevel_AVX2:
+			accumulateRowsAVX2(ppRows, m_nFactor, pAcc, nBytes);
+			boxRowSSE2(pAcc, m_nFactor, pDst, nCount);
+			break;
+		case tagSimdLevel_SSE2:
+			accumulateRowsSSE2(ppRows, m_nFactor, pAcc, nBytes);
+			boxRowSSE2(pAcc, m_nFactor, pDst, nCount);
+			break;
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+		case tagSimdLevel_NEON:
+			accumulateRowsNEON(ppRows, m_nFactor, pAcc, nBytes);
+			boxRowNEON(pAcc, m_nFactor, pDst, nCount);
+			break;
+#endif
+		default:
+			accumulateRowsScalar(ppRows, m_nFactor, pAcc, 0, nBytes);
+			boxRowScalar(pAcc, m_nFactor, pDst, 0, nCount);
+			break;
+		}
+	} // boxRow
+
+public:
+	CDXGICaptureScaler()
+		: m_filter(tagFrameScaleFilter_Default)
+		, m_nFactor(0)
+		, m_nTapsX(0)
+		, m_nTapsY(0)
+	{
+		memset(&m_outputSize, 0, sizeof(m_outputSize));
+		memset(&m_srcRect, 0, sizeof(m_srcRect));
+		memset(&m_dstRect, 0, sizeof(m_dstRect));
+		memset(&m_rowBuffer, 0, sizeof(m_rowBuffer));
+	}
+
+	~CDXGICaptureScaler()
+	{
+		Reset();
+	}
+
+	inline void Reset()
+	{
+		DXGICaptureFrameBuffer::Free(&m_rowBuffer);
+		m_xIndex.clear();
+		m_xWeights.clear();
+		m_yIndex.clear();
+		m_yWeights.clear();
+		m_filter  = tagFrameScaleFilter_Default;
+		m_nFactor = 0;
+		m_nTapsX  = 0;
+		m_nTapsY  = 0;
+		memset(&m_outputSize, 0, sizeof(m_outputSize));
+		memset(&m_srcRect, 0, sizeof(m_srcRect));
+		memset(&m_dstRect, 0, sizeof(m_dstRect));
+	}
+
+	//
+	// Calculates the filter tables of the geometry for a nSrcWidth x nSrcHeight
+	// desktop image. Returns E_NOTIMPL for rotated geometries (D2D1 renderer).
+	//
+	inline
+	HRESULT
+	SetConfig(
+		_In_ const tagFrameGeometry *pGeometry,
+		_In_ INT nSrcWidth,
+		_In_ INT nSrcHeight,
+		_In_ tagFrameScaleFilter filter
+		)
+	{
+		Reset();
+
+		HRESULT hr = DXGICaptureRender::IsGeometryValid(pGeometry);
+		CHECK_HR_RETURN(hr);
+		if (pGeometry->RotationDegrees != 0.0f) {
+			return E_NOTIMPL;
+		}
+		if ((filter != tagFrameScaleFilter_Nearest) && (filter != tagFrameScaleFilter_Bilinear) && (filter != tagFrameScaleFilter_Box)) {
+			return E_INVALIDARG;
+		}
+
+		// visible source rect
+		INT nLeft   = (pGeometry->SrcBounds.X > 0) ? pGeometry->SrcBounds.X : 0;
+		INT nTop    = (pGeometry->SrcBounds.Y > 0) ? pGeometry->SrcBounds.Y : 0;
+		INT nRight  = pGeometry->SrcBounds.X + pGeometry->SrcBounds.Width;
+		INT nBottom = pGeometry->SrcBounds.Y + pGeometry->SrcBounds.Height;
+		if (nRight > nSrcWidth) { nRight = nSrcWidth; }
+		if (nBottom > nSrcHeight) { nBottom = nSrcHeight; }
+		if ((nRight <= nLeft) || (nBottom <= nTop)) {
+			return E_INVALIDARG;
+		}
+
+		const double cx = pGeometry->OutputSize.Width / 2.0;
+		const double cy = pGeometry->OutputSize.Height / 2.0;
+		INT nDstLeft, nDstRight, nDstTop, nDstBottom;
+
+		hr = buildAxis(filter, pGeometry->OutputSize.Width, cx, pGeometry->ScaleX, pGeometry->SrcBounds.X - pGeometry->DstBounds.X,
+			nLeft, nRight, &nDstLeft, &nDstRight, &m_nTapsX, &m_xIndex, &m_xWeights);
+		if (SUCCEEDED(hr)) {
+			hr = buildAxis(filter, pGeometry->OutputSize.Height, cy, pGeometry->ScaleY, pGeometry->SrcBounds.Y - pGeometry->DstBounds.Y,
+				nTop, nBottom, &nDstTop, &nDstBottom, &m_nTapsY, &m_yIndex, &m_yWeights);
+		}
+		if (FAILED(hr))
+		{
+			Reset();
+			return hr;
+		}
+
+		m_filter           = filter;
+		m_outputSize       = pGeometry->OutputSize;
+		m_srcRect.X        = nLeft;
+		m_srcRect.Y        = nTop;
+		m_srcRect.Width    = nRight - nLeft;
+		m_srcRect.Height   = nBottom - nTop;
+		m_dstRect.X        = nDstLeft;
+		m_dstRect.Y        = nDstTop;
+		m_dstRect.Width    = nDstRight - nDstLeft;
+		m_dstRect.Height   = nDstBottom - nDstTop;
+
+		// the vertical taps are kept as source rows (clamped), the weights of the padding are zero
+		for (size_t i = 0; i < m_yIndex.size(); ++i) {
+			m_yIndex[i] += nTop;
+		}
+		std::vector<INT> rows((size_t)m_dstRect.Height * m_nTapsY);
+		for (INT y = 0; y < m_dstRect.Height; ++y)
+		{
+			for (INT k = 0; k < m_nTapsY; ++k)
+			{
+				INT nRow = m_yIndex[y] + k;
+				rows[(size_t)y * m_nTapsY + k] = (nRow < nBottom) ? nRow : (nBottom - 1);
+			}
+		}
+		m_yIndex.swap(rows);
+
+		// integer downscale: every output pixel averages a factor x factor block of the source
+		// (bilinear sampling at 2x is the same average)
+		if ((filter == tagFrameScaleFilter_Box) || (filter == tagFrameScaleFilter_Bilinear))
+		{
+			INT nFactor = (INT)floor(1.0 / pGeometry->ScaleX + 0.5);
+			double dFirstX = cx + (nDstLeft + 0.5 - cx) / pGeometry->ScaleX + (pGeometry->SrcBounds.X - pGeometry->DstBounds.X);
+			double dFirstY = cy + (nDstTop + 0.5 - cy) / pGeometry->ScaleY + (pGeometry->SrcBounds.Y - pGeometry->DstBounds.Y);
+			if (((nFactor == 2) || ((filter == tagFrameScaleFilter_Box) && ((nFactor == 3) || (nFactor == 4)))) &&
+				(fabs(1.0 / pGeometry->ScaleX - nFactor) < 1e-3) && (fabs(1.0 / pGeometry->ScaleY - nFactor) < 1e-3) &&
+				(m_dstRect.Width * nFactor == m_srcRect.Width) && (m_dstRect.Height * nFactor == m_srcRect.Height) &&
+				(fabs(dFirstX - (nLeft + nFactor * 0.5)) < 1e-2) && (fabs(dFirstY - (nTop + nFactor * 0.5)) < 1e-2))
+			{
+				m_nFactor = nFactor;
+			}
+		}
+
+		// row buffer: one filtered source row (+ the padding read by the last taps), or the 16 bit sums of the box path
+		UINT uiRowSize = (m_nFactor > 0)
+			? (UINT)m_srcRect.Width * 4 * sizeof(USHORT)
+			: (UINT)(m_srcRect.Width + m_nTapsX + 1) * 4;
+		hr = DXGICaptureFrameBuffer::Resize(&m_rowBuffer, uiRowSize);
+		if (FAILED(hr))
+		{
+			Reset();
+			return hr;
+		}
+		memset(m_rowBuffer.Buffer, 0, m_rowBuffer.BufferSize);
+
+		return S_OK;
+	} // SetConfig
+
+	inline BOOL IsConfigured() const { return (m_filter != tagFrameScaleFilter_Default); }
+	inline tagFrameScaleFilter GetFilter() const { return m_filter; }
+	inline INT GetFactor() const { return m_nFactor; }
+	inline const tagFrameBounds* GetDstRect() const { return &m_dstRect; }
+
+	//
+	// Scales the 32bpp desktop image into the output image (OutputSize of the geometry).
+	// Pitches are in bytes.
+	//
+	inline
+	HRESULT
+	Scale(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_Out_ BYTE *pDst,
+		_In_ INT nDstPitch,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+		CHECK_POINTER_EX(pDst, E_INVALIDARG);
+		if (!IsConfigured()) {
+			return E_UNEXPECTED;
+		}
+
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		const UINT uiBlack = 0xFF000000;
+		const INT nOutWidth = m_outputSize.Width;
+		const INT nDstRight = m_dstRect.X + m_dstRect.Width;
+		const BYTE *pSrcOrigin = pSrc + (size_t)m_srcRect.X * 4;
+		const BYTE *rows[64];
+		std::vector<const BYTE*> manyRows;
+		const BYTE **ppRows = rows;
+		INT nRowTaps = (m_nFactor > 0) ? m_nFactor : m_nTapsY;
+		if (nRowTaps > (INT)(sizeof(rows) / sizeof(rows[0])))
+		{
+			manyRows.resize(nRowTaps);
+			ppRows = &manyRows[0];
+		}
+
+		for (INT oy = 0; oy < m_outputSize.Height; ++oy)
+		{
+			UINT *pOut = reinterpret_cast<UINT*>(pDst + (size_t)oy * nDstPitch);
+			INT y = oy - m_dstRect.Y;
+			if ((y < 0) || (y >= m_dstRect.Height))
+			{
+				for (INT ox = 0; ox < nOutWidth; ++ox) { pOut[ox] = uiBlack; }
+				continue;
+			}
+			for (INT ox = 0; ox < m_dstRect.X; ++ox) { pOut[ox] = uiBlack; }
+			for (INT ox = nDstRight; ox < nOutWidth; ++ox) { pOut[ox] = uiBlack; }
+			pOut += m_dstRect.X;
+
+			if (m_nFactor > 0)
+			{
+				for (INT k = 0; k < m_nFactor; ++k) {
+					ppRows[k] = pSrcOrigin + (size_t)(m_srcRect.Y + y * m_nFactor + k) * nSrcPitch;
+				}
+				boxRow(ppRows, pOut, level);
+			}
+			else if (m_filter == tagFrameScaleFilter_Nearest)
+			{
+				const UINT *pRow = reinterpret_cast<const UINT*>(pSrcOrigin + (size_t)m_yIndex[y] * nSrcPitch);
+				const INT *pFirst = &m_xIndex[0];
+				for (INT x = 0; x < m_dstRect.Width; ++x) {
+					pOut[x] = pRow[pFirst[x]];
+				}
+			}
+			else
+			{
+				for (INT k = 0; k < m_nTapsY; ++k) {
+					ppRows[k] = pSrcOrigin + (size_t)m_yIndex[(size_t)y * m_nTapsY + k] * nSrcPitch;
+				}
+				verticalRow(ppRows, &m_yWeights[(size_t)y * m_nTapsY], m_rowBuffer.Buffer, m_srcRect.Width * 4, level);
+				horizontalRow(m_rowBuffer.Buffer, pOut, level);
+			}
+		}
+
+		return S_OK;
+	} // Scale
+
+}; // end class CDXGICaptureScaler
+
+#endif // __DXGICAPTURESCALE_H__
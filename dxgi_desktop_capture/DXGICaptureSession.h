@@ -0,0 +1,859 @@
+/*****************************************************************************
+* DXGICaptureSession.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESESSION_H__
+#define __DXGICAPTURESESSION_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureCopy.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICaptureFrame.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICapturePointer.h"
+#include "DXGICaptureRender.h"
+#include "DXGICaptureScale.h"
+#include "DXGICaptureSource.h"
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#define DXGICAPTURE_SESSION_MAX_QUEUE_DEPTH     8
+#define DXGICAPTURE_SESSION_DEFAULT_QUEUE_DEPTH 2
+#define DXGICAPTURE_SESSION_ACQUIRE_TIMEOUT     50      /* msec, the capture thread checks for Stop in between */
+
+//
+// struct tagSessionConfig_s
+//
+typedef struct tagSessionConfig_s
+{
+	INT                 ShowPointer;        /* the pointer is drawn once into the shared frame */
+	INT                 Incremental;        /* a shared frame no subscriber holds any more is updated in place from the move/dirty rects */
+} tagSessionConfig;
+
+//
+// struct tagSubscriberConfig_s
+//
+typedef struct tagSubscriberConfig_s
+{
+	tagScreenCaptureFilterConfig Filter;    /* RotationMode, SizeMode, OutputSize, ScaleFilter and YuvFormat/Matrix/Range of the output */
+	UINT                MaxFps;             /* rate limit of the frames handed to the subscriber, 0: every frame */
+	UINT                QueueDepth;         /* frames waiting for the subscriber (1..8, 0: 2), a full queue drops its oldest frame */
+} tagSubscriberConfig;
+
+//
+// struct tagSessionStats_s
+//
+typedef struct tagSessionStats_s
+{
+	UINT64              Frames;             /* desktop images acquired */
+	UINT64              Published;          /* shared frames handed to at least one subscriber */
+	UINT64              FullCopies;         /* shared frames copied completely from the desktop image */
+	UINT64              BytesCopied;        /* desktop image bytes copied into the shared frames */
+	UINT64              Deliveries;         /* shared frame references queued for the subscribers */
+	INT64               ComposeUsec;        /* copy and pointer composite of the shared frames */
+} tagSessionStats;
+
+//
+// struct tagSubscriberStats_s
+//
+typedef struct tagSubscriberStats_s
+{
+	UINT64              Queued;
+	UINT64              Delivered;          /* OnFrame calls */
+	UINT64              Skipped;            /* frames left out by the rate limit */
+	UINT64              Dropped;            /* queued frames replaced by newer ones, the subscriber was too slow */
+	UINT64              Failed;             /* render or OnFrame errors */
+	UINT64              Rendered;           /* output images rendered by the subscriber thread */
+	INT64               RenderUsec;
+	INT64               CallbackUsec;
+	INT64               TotalLatencyUsec;   /* queued -> OnFrame returned */
+	INT64               MaxLatencyUsec;
+	UINT                MaxQueueDepth;
+} tagSubscriberStats;
+
+//
+// class IDXGICaptureSubscriber
+//
+// Consumer of a capture session. OnFrame is called on the thread of the
+// subscriber, one frame at a time, with one reference owned by the caller:
+// AddRef the frame to keep it after OnFrame returns. The frame of a
+// passthrough subscriber (output equals the desktop image, no YUV) is the
+// shared session frame itself and must not be written.
+//
+class IDXGICaptureSubscriber
+{
+public:
+	virtual ~IDXGICaptureSubscriber() {}
+
+	virtual HRESULT OnFrame(_In_ CDXGICaptureFrame *pFrame) = 0;
+};
+
+//
+// class CDXGICaptureSession
+//
+// One capture source (one desktop duplication) shared by any number of
+// subscribers. Every acquired desktop image is copied once into an immutable
+// ref-counted frame with the pointer drawn; the frame is queued for every
+// subscriber that is due by its rate limit. Each subscriber renders its own
+// output (size mode, rotation, cpu scaler, YUV) on a thread of its own, so a
+// slow subscriber only loses its own oldest queued frames and never holds up
+// the capture or the other subscribers. With Incremental a shared frame that
+// no subscriber holds any more is brought up to date in place from the move
+// and dirty rects, otherwise the next frame is taken from the pool.
+// Subscribers can be added and removed while the session runs.
+//
+class CDXGICaptureSession
+{
+private:
+	typedef struct tagSubscriberState_s
+	{
+		IDXGICaptureSubscriber*     Subscriber;
+		tagSubscriberConfig         Config;
+		UINT                        Id;
+		tagFrameGeometry            Geometry;
+		CDXGICaptureScaler          Scaler;
+		BOOL                        Passthrough;
+		CDXGICaptureFramePool*      Pool;
+		std::thread                 Thread;
+
+		// capture side
+		INT64                       IntervalUsec;
+		INT64                       NextDueUsec;
+
+		// under Lock
+		std::mutex                  Lock;
+		std::condition_variable     Cond;
+		CDXGICaptureFrame*          Queue[DXGICAPTURE_SESSION_MAX_QUEUE_DEPTH];
+		INT64                       QueuedAt[DXGICAPTURE_SESSION_MAX_QUEUE_DEPTH];
+		UINT                        Head;
+		UINT                        Count;
+		BOOL                        Busy;
+		BOOL                        Stop;
+		tagSubscriberStats          Stats;
+	} tagSubscriberState;
+
+	IDXGICaptureSource*             m_pSource;
+	tagSessionConfig                m_config;
+	tagCaptureSourceDesc            m_desc;
+	CDXGICaptureFramePool*          m_pFramePool;
+
+	// capture side: the last shared frame, the pixels under its pointer
+	CDXGICaptureFrame*              m_pFrame;
+	BOOL                            m_bFrameValid;
+	tagFrameBufferInfo              m_mouseBackground;
+	tagFrameBufferInfo              m_tempMouseRotateBuffer;
+	CDXGICursorCache                m_cursorCache;
+	std::vector<tagFrameRect>       m_dirtyRects;
+	std::vector<tagSubscriberState*> m_due;
+
+	std::mutex                      m_subscriberLock;
+	std::vector<tagSubscriberState*> m_subscribers;
+	UINT                            m_uiNextId;
+
+	std::thread                     m_captureThread;
+	std::atomic<bool>               m_bStop;
+	BOOL                            m_bRunning;
+	HRESULT                         m_hrCapture;
+	std::chrono::steady_clock::time_point m_startTick;
+
+	mutable std::mutex              m_statsLock;
+	tagSessionStats                 m_stats;
+
+	// disable copy
+	CDXGICaptureSession(const CDXGICaptureSession&);
+	CDXGICaptureSession& operator=(const CDXGICaptureSession&);
+
+	inline INT64 now() const
+	{
+		return (INT64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_startTick).count();
+	}
+
+	static inline void releaseQueue(_Inout_ tagSubscriberState *pState)
+	{
+		for (UINT i = 0; i < pState->Count; ++i)
+		{
+			UINT uiSlot = (pState->Head + i) % DXGICAPTURE_SESSION_MAX_QUEUE_DEPTH;
+			pState->Queue[uiSlot]->Release();
+			pState->Queue[uiSlot] = nullptr;
+		}
+		pState->Head  = 0;
+		pState->Count = 0;
+	}
+
+	//
+	// Subscriber side: renders the output of the shared frame (the shared frame itself for a passthrough output)
+	//
+	static
+	inline
+	HRESULT
+	renderOutput(
+		_Inout_ tagSubscriberState *pState,
+		_In_ CDXGICaptureFrame *pShared,
+		_Out_ CDXGICaptureFrame **ppOutput
+		)
+	{
+		*ppOutput = nullptr;
+		const tagScreenCaptureFilterConfig &filter = pState->Config.Filter;
+		if (pState->Passthrough && (filter.YuvFormat == tagYuvFormat_None))
+		{
+			pShared->AddRef();
+			*ppOutput = pShared;
+			return S_OK;
+		}
+
+		const INT nWidth  = pState->Geometry.OutputSize.Width;
+		const INT nHeight = pState->Geometry.OutputSize.Height;
+		CDXGICaptureFrame *pOutput = pState->Pool->AcquireFrame(nWidth, nHeight, nWidth * 4);
+		CHECK_POINTER_EX(pOutput, E_OUTOFMEMORY);
+
+		HRESULT hr = S_OK;
+		if (pState->Passthrough)
+		{
+			DXGICaptureCopy::CopyPixels(pShared->GetBuffer(), pShared->GetPitch(), pOutput->GetBuffer(), pOutput->GetPitch(),
+				nWidth, nHeight, FALSE, tagSimdLevel_Auto, nullptr);
+		}
+		else if (pState->Scaler.IsConfigured()) {
+			hr = pState->Scaler.Scale(pShared->GetBuffer(), pShared->GetPitch(), pOutput->GetBuffer(), pOutput->GetPitch());
+		}
+		else
+		{
+			hr = DXGICaptureRender::Render(pShared->GetBuffer(), pShared->GetPitch(), pShared->GetWidth(), pShared->GetHeight(),
+				&pState->Geometry, pOutput->GetBuffer(), pOutput->GetPitch());
+		}
+		pOutput->SetFrameInfo(pShared->GetFrameNumber(), pShared->GetTimestamp());
+		if (SUCCEEDED(hr) && (filter.YuvFormat != tagYuvFormat_None)) {
+			hr = pOutput->ConvertToYuv(filter.YuvFormat, filter.YuvMatrix, filter.YuvRange);
+		}
+		if (FAILED(hr))
+		{
+			pOutput->Release();
+			return hr;
+		}
+
+		*ppOutput = pOutput;
+		return S_OK;
+	}
+
+	inline void subscriberProc(_Inout_ tagSubscriberState *pState)
+	{
+		typedef std::chrono::steady_clock clock_type;
+
+		for (;;)
+		{
+			CDXGICaptureFrame *pShared = nullptr;
+			INT64 llQueuedAt = 0;
+			{
+				std::unique_lock<std::mutex> lock(pState->Lock);
+				while (!pState->Stop && (pState->Count == 0)) {
+					pState->Cond.wait(lock);
+				}
+				if (pState->Stop) {
+					break;
+				}
+				pShared    = pState->Queue[pState->Head];
+				llQueuedAt = pState->QueuedAt[pState->Head];
+				pState->Queue[pState->Head] = nullptr;
+				pState->Head = (pState->Head + 1) % DXGICAPTURE_SESSION_MAX_QUEUE_DEPTH;
+				pState->Count--;
+				pState->Busy = TRUE;
+			}
+
+			clock_type::time_point t0 = clock_type::now();
+			CDXGICaptureFrame *pOutput = nullptr;
+			HRESULT hr = renderOutput(pState, pShared, &pOutput);
+			pShared->Release();
+			clock_type::time_point t1 = clock_type::now();
+			if (SUCCEEDED(hr))
+			{
+				hr = pState->Subscriber->OnFrame(pOutput);
+				pOutput->Release();
+			}
+			clock_type::time_point t2 = clock_type::now();
+			INT64 llLatency = now() - llQueuedAt;
+
+			{
+				std::lock_guard<std::mutex> lock(pState->Lock);
+				tagSubscriberStats &stats = pState->Stats;
+				if (pOutput != pShared) {
+					stats.Rendered += (nullptr != pOutput) ? 1 : 0;
+					stats.RenderUsec += (INT64)std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+				}
+				stats.Delivered += (nullptr != pOutput) ? 1 : 0;
+				stats.Failed += FAILED(hr) ? 1 : 0;
+				stats.CallbackUsec += (INT64)std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+				stats.TotalLatencyUsec += llLatency;
+				if (llLatency > stats.MaxLatencyUsec) {
+					stats.MaxLatencyUsec = llLatency;
+				}
+				pState->Busy = FALSE;
+			}
+			pState->Cond.notify_all();
+		}
+	}
+
+	static inline void stopSubscriber(_Inout_ tagSubscriberState *pState)
+	{
+		{
+			std::lock_guard<std::mutex> lock(pState->Lock);
+			pState->Stop = TRUE;
+		}
+		pState->Cond.notify_all();
+		if (pState->Thread.joinable()) {
+			pState->Thread.join();
+		}
+
+		releaseQueue(pState);
+		if (nullptr != pState->Pool)
+		{
+			pState->Pool->Release();
+			pState->Pool = nullptr;
+		}
+		delete pState;
+	}
+
+	//
+	// Capture side: queues the shared frame, a full queue gives up its oldest frame
+	//
+	inline void queueFrame(_Inout_ tagSubscriberState *pState, _In_ CDXGICaptureFrame *pFrame, _In_ INT64 llNow)
+	{
+		CDXGICaptureFrame *pDropped = nullptr;
+		pFrame->AddRef();
+		{
+			std::lock_guard<std::mutex> lock(pState->Lock);
+			if (pState->Count == pState->Config.QueueDepth)
+			{
+				pDropped = pState->Queue[pState->Head];
+				pState->Queue[pState->Head] = nullptr;
+				pState->Head = (pState->Head + 1) % DXGICAPTURE_SESSION_MAX_QUEUE_DEPTH;
+				pState->Count--;
+				pState->Stats.Dropped++;
+			}
+			UINT uiSlot = (pState->Head + pState->Count) % DXGICAPTURE_SESSION_MAX_QUEUE_DEPTH;
+			pState->Queue[uiSlot]    = pFrame;
+			pState->QueuedAt[uiSlot] = llNow;
+			pState->Count++;
+			pState->Stats.Queued++;
+			if (pState->Count > pState->Stats.MaxQueueDepth) {
+				pState->Stats.MaxQueueDepth = pState->Count;
+			}
+		}
+		pState->Cond.notify_all();
+		if (nullptr != pDropped) {
+			pDropped->Release();
+		}
+	}
+
+	//
+	// Brings the shared frame up to the acquired image: in place from the rects while
+	// no subscriber holds it, otherwise a pool frame with a full copy
+	//
+	inline
+	HRESULT
+	composeFrame(
+		_In_ const tagCaptureSourceFrame *pFrame,
+		_Out_ UINT64 *pRetBytesCopied,
+		_Out_ BOOL *pRetFullCopy
+		)
+	{
+		const INT nWidth  = m_desc.Width;
+		const INT nHeight = m_desc.Height;
+		*pRetBytesCopied = 0;
+		*pRetFullCopy    = FALSE;
+
+		BOOL bInPlace = m_config.Incremental && m_bFrameValid && (nullptr != m_pFrame) && !m_pFrame->IsShared();
+		if (!bInPlace)
+		{
+			if ((nullptr == m_pFrame) || m_pFrame->IsShared())
+			{
+				if (nullptr != m_pFrame) {
+					m_pFrame->Release();
+				}
+				m_pFrame = m_pFramePool->AcquireFrame(nWidth, nHeight, nWidth * 4);
+				CHECK_POINTER_EX(m_pFrame, E_OUTOFMEMORY);
+			}
+			DXGICaptureCopy::CopyPixels(pFrame->Data, pFrame->Pitch, m_pFrame->GetBuffer(), m_pFrame->GetPitch(), nWidth, nHeight,
+				FALSE, tagSimdLevel_Auto, nullptr);
+			m_mouseBackground.Bounds.Width = 0;
+			*pRetBytesCopied = (UINT64)nWidth * nHeight * 4;
+			*pRetFullCopy    = TRUE;
+		}
+		else
+		{
+			BYTE *pBuffer = m_pFrame->GetBuffer();
+			const INT nPitch = m_pFrame->GetPitch();
+
+			// restore the pixels under the last drawn mouse, then apply the moves and the dirty rects
+			if (m_mouseBackground.Bounds.Width > 0)
+			{
+				tagFrameRect rcMouse = {
+					m_mouseBackground.Bounds.X,
+					m_mouseBackground.Bounds.Y,
+					m_mouseBackground.Bounds.X + m_mouseBackground.Bounds.Width,
+					m_mouseBackground.Bounds.Y + m_mouseBackground.Bounds.Height };
+				DXGICaptureDirtyRects::CopyBackground(pBuffer, nPitch, m_mouseBackground.Buffer, rcMouse, FALSE);
+				m_mouseBackground.Bounds.Width = 0;
+			}
+
+			*pRetBytesCopied = DXGICaptureDirtyRects::ApplyMoves(pBuffer, nPitch, nWidth, nHeight, pFrame->MoveRects, pFrame->MoveRectCount);
+			m_dirtyRects.assign(pFrame->DirtyRects, pFrame->DirtyRects + pFrame->DirtyRectCount);
+			UINT uiDirtyCount = m_dirtyRects.empty() ? 0 : DXGICaptureDirtyRects::MergeRects(&m_dirtyRects[0], (UINT)m_dirtyRects.size(), nWidth, nHeight);
+			if (uiDirtyCount > 0) {
+				*pRetBytesCopied += DXGICaptureDirtyRects::ApplyDirtyRects(pBuffer, nPitch, pFrame->Data, pFrame->Pitch, &m_dirtyRects[0], uiDirtyCount);
+			}
+		}
+		m_bFrameValid = TRUE;
+		m_pFrame->SetFrameInfo(pFrame->FrameNumber, pFrame->Timestamp);
+
+		if (!m_config.ShowPointer || (nullptr == pFrame->Pointer)) {
+			return S_OK;
+		}
+		HRESULT hr = DXGICapturePointer::Draw(
+			pFrame->Pointer,
+			m_desc.DesktopWidth,
+			m_desc.DesktopHeight,
+			m_desc.RotationDegrees,
+			&m_cursorCache,
+			&m_tempMouseRotateBuffer,
+			m_pFrame->GetBuffer(),
+			m_pFrame->GetPitch(),
+			nWidth,
+			nHeight,
+			&m_mouseBackground);
+		return FAILED(hr) ? hr : S_OK;
+	}
+
+	inline
+	HRESULT
+	processFrame(
+		_In_ UINT uiTimeoutMsec,
+		_Out_opt_ BOOL *pRetIsTimeout
+		)
+	{
+		typedef std::chrono::steady_clock clock_type;
+
+		RESET_POINTER_EX(pRetIsTimeout, FALSE);
+
+		tagCaptureSourceFrame frame;
+		HRESULT hr = m_pSource->AcquireFrame(uiTimeoutMsec, &frame);
+		if (hr == S_FALSE)
+		{
+			RESET_POINTER_EX(pRetIsTimeout, TRUE);
+			return S_FALSE;
+		}
+		CHECK_HR_RETURN(hr);
+
+		std::lock_guard<std::mutex> lock(m_subscriberLock);
+
+		// the subscribers due by their rate limit (source timestamps, a quarter interval early is in time)
+		m_due.clear();
+		for (size_t i = 0; i < m_subscribers.size(); ++i)
+		{
+			tagSubscriberState *pState = m_subscribers[i];
+			if ((pState->IntervalUsec > 0) && (frame.Timestamp + pState->IntervalUsec / 4 < pState->NextDueUsec))
+			{
+				std::lock_guard<std::mutex> stateLock(pState->Lock);
+				pState->Stats.Skipped++;
+				continue;
+			}
+			pState->NextDueUsec += pState->IntervalUsec;
+			if (pState->NextDueUsec <= frame.Timestamp) {
+				pState->NextDueUsec = frame.Timestamp + pState->IntervalUsec;
+			}
+			m_due.push_back(pState);
+		}
+
+		// nobody takes the image: keep the shared frame current only if that is cheap
+		clock_type::time_point start = clock_type::now();
+		UINT64 ullBytes = 0;
+		BOOL bFullCopy = FALSE;
+		if (!m_due.empty() || (m_config.Incremental && m_bFrameValid && (nullptr != m_pFrame) && !m_pFrame->IsShared())) {
+			hr = composeFrame(&frame, &ullBytes, &bFullCopy);
+		}
+		else {
+			m_bFrameValid = FALSE;
+		}
+		INT64 llComposeUsec = (INT64)std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count();
+
+		HRESULT hrRelease = m_pSource->ReleaseFrame();
+		CHECK_HR_RETURN(hr);
+		CHECK_HR_RETURN(hrRelease);
+
+		INT64 llNow = now();
+		for (size_t i = 0; i < m_due.size(); ++i) {
+			queueFrame(m_due[i], m_pFrame, llNow);
+		}
+
+		std::lock_guard<std::mutex> statsLock(m_statsLock);
+		m_stats.Frames++;
+		m_stats.Published   += m_due.empty() ? 0 : 1;
+		m_stats.FullCopies  += bFullCopy ? 1 : 0;
+		m_stats.BytesCopied += ullBytes;
+		m_stats.Deliveries  += m_due.size();
+		m_stats.ComposeUsec += llComposeUsec;
+		return S_OK;
+	}
+
+	inline void captureProc()
+	{
+		HRESULT hr = S_OK;
+		while (!m_bStop)
+		{
+			hr = processFrame(DXGICAPTURE_SESSION_ACQUIRE_TIMEOUT, nullptr);
+			CHECK_HR_BREAK(hr);
+		}
+		m_hrCapture = FAILED(hr) ? hr : S_OK;
+	}
+
+public:
+	CDXGICaptureSession()
+		: m_pSource(nullptr)
+		, m_pFramePool(nullptr)
+		, m_pFrame(nullptr)
+		, m_bFrameValid(FALSE)
+		, m_uiNextId(1)
+		, m_bStop(false)
+		, m_bRunning(FALSE)
+		, m_hrCapture(S_OK)
+	{
+		memset(&m_config, 0, sizeof(m_config));
+		memset(&m_desc, 0, sizeof(m_desc));
+		memset(&m_mouseBackground, 0, sizeof(m_mouseBackground));
+		memset(&m_tempMouseRotateBuffer, 0, sizeof(m_tempMouseRotateBuffer));
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_startTick = std::chrono::steady_clock::now();
+	}
+
+	~CDXGICaptureSession()
+	{
+		Terminate();
+	}
+
+	//
+	// Attaches the source (not owned), it must stay valid until Terminate
+	//
+	inline
+	HRESULT
+	Initialize(
+		_In_ IDXGICaptureSource *pSource,
+		_In_opt_ const tagSessionConfig *pConfig
+		)
+	{
+		CHECK_POINTER_EX(pSource, E_INVALIDARG);
+
+		Terminate();
+
+		HRESULT hr = pSource->GetDesc(&m_desc);
+		CHECK_HR_RETURN(hr);
+		if ((m_desc.Width <= 0) || (m_desc.Height <= 0)) {
+			return E_INVALIDARG;
+		}
+
+		if (nullptr != pConfig) {
+			m_config = *pConfig;
+		}
+		else
+		{
+			m_config.ShowPointer = 1;
+			m_config.Incremental = 1;
+		}
+
+		// the subscribers read the whole desktop image
+		hr = pSource->SetCopyRects(nullptr, 0);
+		CHECK_HR_RETURN(hr);
+
+		m_pFramePool = CDXGICaptureFramePool::Create();
+		CHECK_POINTER_EX(m_pFramePool, E_OUTOFMEMORY);
+
+		m_pSource   = pSource;
+		m_hrCapture = S_OK;
+		m_startTick = std::chrono::steady_clock::now();
+		memset(&m_stats, 0, sizeof(m_stats));
+		return S_OK;
+	}
+
+	inline void Terminate()
+	{
+		Stop();
+
+		std::vector<tagSubscriberState*> subscribers;
+		{
+			std::lock_guard<std::mutex> lock(m_subscriberLock);
+			subscribers.swap(m_subscribers);
+		}
+		for (size_t i = 0; i < subscribers.size(); ++i) {
+			stopSubscriber(subscribers[i]);
+		}
+
+		if (nullptr != m_pFrame)
+		{
+			m_pFrame->Release();
+			m_pFrame = nullptr;
+		}
+		if (nullptr != m_pFramePool)
+		{
+			m_pFramePool->Release();
+			m_pFramePool = nullptr;
+		}
+		DXGICaptureFrameBuffer::Free(&m_mouseBackground);
+		DXGICaptureFrameBuffer::Free(&m_tempMouseRotateBuffer);
+		m_cursorCache.Clear();
+		m_dirtyRects.clear();
+		m_due.clear();
+		m_bFrameValid = FALSE;
+		m_pSource     = nullptr;
+	}
+
+	//
+	// Adds a subscriber (not owned) with its own output and rate limit, its
+	// thread starts at once. The subscriber must stay valid until Unsubscribe.
+	//
+	inline
+	HRESULT
+	Subscribe(
+		_In_ IDXGICaptureSubscriber *pSubscriber,
+		_In_ const tagSubscriberConfig *pConfig,
+		_Out_opt_ UINT *pRetId
+		)
+	{
+		RESET_POINTER_EX(pRetId, 0);
+		CHECK_POINTER_EX(pSubscriber, E_INVALIDARG);
+		CHECK_POINTER_EX(pConfig, E_INVALIDARG);
+		CHECK_POINTER_EX(m_pSource, E_UNEXPECTED);
+		if (pConfig->QueueDepth > DXGICAPTURE_SESSION_MAX_QUEUE_DEPTH) {
+			return E_INVALIDARG;
+		}
+
+		tagSubscriberState *pState = new (std::nothrow) tagSubscriberState;
+		CHECK_POINTER_EX(pState, E_OUTOFMEMORY);
+
+		pState->Subscriber   = pSubscriber;
+		pState->Config       = *pConfig;
+		pState->Passthrough  = FALSE;
+		pState->Pool         = nullptr;
+		pState->IntervalUsec = (pConfig->MaxFps > 0) ? (1000000 / (INT64)pConfig->MaxFps) : 0;
+		pState->NextDueUsec  = 0;
+		pState->Head         = 0;
+		pState->Count        = 0;
+		pState->Busy         = FALSE;
+		pState->Stop         = FALSE;
+		memset(pState->Queue, 0, sizeof(pState->Queue));
+		memset(pState->QueuedAt, 0, sizeof(pState->QueuedAt));
+		memset(&pState->Stats, 0, sizeof(pState->Stats));
+		if (pState->Config.QueueDepth == 0) {
+			pState->Config.QueueDepth = DXGICAPTURE_SESSION_DEFAULT_QUEUE_DEPTH;
+		}
+
+		tagFrameGeometry &geometry = pState->Geometry;
+		memset(&geometry, 0, sizeof(geometry));
+		geometry.RotationMode = pConfig->Filter.RotationMode;
+		geometry.SizeMode     = pConfig->Filter.SizeMode;
+		geometry.OutputSize   = pConfig->Filter.OutputSize;
+		geometry.ScaleX       = 1.0f;
+		geometry.ScaleY       = 1.0f;
+
+		HRESULT hr = DXGICaptureRender::CalculateGeometry(m_desc.DesktopWidth, m_desc.DesktopHeight, m_desc.RotationDegrees, &geometry);
+		if (SUCCEEDED(hr)) {
+			hr = DXGICaptureRender::IsGeometryValid(&geometry);
+		}
+		if (SUCCEEDED(hr))
+		{
+			// rotated outputs are rendered by DXGICaptureRender
+			pState->Passthrough = DXGICaptureRender::IsPassthrough(&geometry, m_desc.Width, m_desc.Height);
+			if (!pState->Passthrough && (pConfig->Filter.ScaleFilter != tagFrameScaleFilter_Default))
+			{
+				hr = pState->Scaler.SetConfig(&geometry, m_desc.Width, m_desc.Height, pConfig->Filter.ScaleFilter);
+				if (hr == E_NOTIMPL) {
+					hr = S_OK;
+				}
+			}
+		}
+		if (SUCCEEDED(hr))
+		{
+			pState->Pool = CDXGICaptureFramePool::Create(pState->Config.QueueDepth + 2);
+			if (nullptr == pState->Pool) {
+				hr = E_OUTOFMEMORY;
+			}
+		}
+		if (FAILED(hr))
+		{
+			stopSubscriber(pState);
+			return hr;
+		}
+
+		pState->Thread = std::thread(&CDXGICaptureSession::subscriberProc, this, pState);
+
+		std::lock_guard<std::mutex> lock(m_subscriberLock);
+		pState->Id = m_uiNextId++;
+		m_subscribers.push_back(pState);
+		RESET_POINTER_EX(pRetId, pState->Id);
+		return S_OK;
+	}
+
+	//
+	// Removes the subscriber, its queued frames are dropped. Returns S_FALSE for an unknown id.
+	//
+	inline HRESULT Unsubscribe(_In_ UINT uiId)
+	{
+		tagSubscriberState *pState = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_subscriberLock);
+			for (size_t i = 0; i < m_subscribers.size(); ++i)
+			{
+				if (m_subscribers[i]->Id == uiId)
+				{
+					pState = m_subscribers[i];
+					m_subscribers.erase(m_subscribers.begin() + i);
+					break;
+				}
+			}
+		}
+		if (nullptr == pState) {
+			return S_FALSE;
+		}
+		stopSubscriber(pState);
+		return S_OK;
+	}
+
+	//
+	// Starts the capture thread
+	//
+	inline HRESULT Start()
+	{
+		CHECK_POINTER_EX(m_pSource, E_UNEXPECTED);
+		if (m_bRunning) {
+			return S_FALSE;
+		}
+
+		m_bStop     = false;
+		m_hrCapture = S_OK;
+		m_captureThread = std::thread(&CDXGICaptureSession::captureProc, this);
+		m_bRunning  = TRUE;
+		return S_OK;
+	}
+
+	//
+	// Stops the capture thread, returns the error that ended it (S_OK if none)
+	//
+	inline HRESULT Stop()
+	{
+		if (!m_bRunning) {
+			return S_OK;
+		}
+
+		m_bStop = true;
+		if (m_captureThread.joinable()) {
+			m_captureThread.join();
+		}
+		m_bRunning = FALSE;
+		return m_hrCapture;
+	}
+
+	//
+	// Acquires one desktop image and hands it to the subscribers that are due,
+	// on the calling thread (not while the capture thread runs). Returns S_FALSE
+	// if no new image arrived within the timeout.
+	//
+	inline
+	HRESULT
+	ProcessFrame(
+		_In_ UINT uiTimeoutMsec,
+		_Out_opt_ BOOL *pRetIsTimeout
+		)
+	{
+		RESET_POINTER_EX(pRetIsTimeout, FALSE);
+		CHECK_POINTER_EX(m_pSource, E_UNEXPECTED);
+		if (m_bRunning) {
+			return E_UNEXPECTED;
+		}
+		return processFrame(uiTimeoutMsec, pRetIsTimeout);
+	}
+
+	//
+	// Waits until every subscriber has taken all its queued frames (a running capture waits meanwhile)
+	//
+	inline void Flush()
+	{
+		std::lock_guard<std::mutex> lock(m_subscriberLock);
+		for (size_t i = 0; i < m_subscribers.size(); ++i)
+		{
+			tagSubscriberState *pState = m_subscribers[i];
+			std::unique_lock<std::mutex> stateLock(pState->Lock);
+			while ((pState->Count > 0) || pState->Busy) {
+				pState->Cond.wait(stateLock);
+			}
+		}
+	}
+
+	inline const tagCaptureSourceDesc* GetDesc() const { return &m_desc; }
+	inline BOOL IsRunning() const { return m_bRunning; }
+
+	inline UINT GetSubscriberCount()
+	{
+		std::lock_guard<std::mutex> lock(m_subscriberLock);
+		return (UINT)m_subscribers.size();
+	}
+
+	//
+	// Output size of the subscriber, FALSE for an unknown id
+	//
+	inline BOOL GetSubscriberOutput(_In_ UINT uiId, _Out_ tagFrameSize *pSize, _Out_opt_ BOOL *pRetIsPassthrough)
+	{
+		std::lock_guard<std::mutex> lock(m_subscriberLock);
+		for (size_t i = 0; i < m_subscribers.size(); ++i)
+		{
+			if (m_subscribers[i]->Id == uiId)
+			{
+				*pSize = m_subscribers[i]->Geometry.OutputSize;
+				RESET_POINTER_EX(pRetIsPassthrough, m_subscribers[i]->Passthrough);
+				return TRUE;
+			}
+		}
+		return FALSE;
+	}
+
+	inline BOOL GetSubscriberStats(_In_ UINT uiId, _Out_ tagSubscriberStats *pStats)
+	{
+		std::lock_guard<std::mutex> lock(m_subscriberLock);
+		for (size_t i = 0; i < m_subscribers.size(); ++i)
+		{
+			if (m_subscribers[i]->Id == uiId)
+			{
+				std::lock_guard<std::mutex> stateLock(m_subscribers[i]->Lock);
+				*pStats = m_subscribers[i]->Stats;
+				return TRUE;
+			}
+		}
+		memset(pStats, 0, sizeof(*pStats));
+		return FALSE;
+	}
+
+	inline void GetStats(_Out_ tagSessionStats *pStats) const
+	{
+		std::lock_guard<std::mutex> lock(m_statsLock);
+		*pStats = m_stats;
+	}
+
+}; // end class CDXGICaptureSession
+
+#endif // __DXGICAPTURESESSION_H__
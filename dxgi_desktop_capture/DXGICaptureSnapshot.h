@@ -0,0 +1,207 @@
+/*****************************************************************************
+* DXGICaptureSnapshot.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESNAPSHOT_H__
+#define __DXGICAPTURESNAPSHOT_H__
+
+#include "DXGICaptureTypes.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+
+//
+// class CDXGICaptureSnapshot
+//
+// An immutable value (monitor infos, renderer config, ...) that is replaced by
+// a writer and read without a lock. A reader is wait-free: it counts itself in
+// the reader counter of the current epoch, loads the snapshot, copies what it
+// needs and leaves (CReader). Publish swaps the snapshot and reclaims the old
+// one after two epoch flips, when every reader that may still see it has left;
+// only the writers wait, and only for readers inside their (short) read.
+// The reader counters are striped by thread, so polling threads do not share
+// a cache line.
+//
+template <typename T>
+class CDXGICaptureSnapshot
+{
+public:
+	enum { READER_STRIPES = 16 };
+
+private:
+	// reader counters of the two epochs (even, odd), one stripe per cache line;
+	// aligned, so a stripe does not straddle two lines of the snapshot object
+	typedef struct DXGICAPTURE_CACHE_ALIGN tagReaderStripe_s
+	{
+		std::atomic<UINT>   Readers[2];
+		BYTE                Padding[DXGICAPTURE_CACHE_LINE - 2 * sizeof(std::atomic<UINT>)];
+	} tagReaderStripe;
+
+	std::atomic<T*>         m_pCurrent;
+	std::atomic<UINT64>     m_ullEpoch;
+	mutable tagReaderStripe m_stripes[READER_STRIPES];
+	static_assert(sizeof(tagReaderStripe) == DXGICAPTURE_CACHE_LINE, "a reader stripe must fill one cache line");
+	std::mutex              m_publishLock;
+
+	// disable copy, the snapshot is owned
+	CDXGICaptureSnapshot(const CDXGICaptureSnapshot&);
+	CDXGICaptureSnapshot& operator=(const CDXGICaptureSnapshot&);
+
+	static
+	inline
+	UINT
+	getStripe()
+	{
+		return (UINT)(std::hash<std::thread::id>()(std::this_thread::get_id()) % READER_STRIPES);
+	} // getStripe
+
+	void waitForReaders(UINT uiParity) const
+	{
+		for (UINT i = 0; i < READER_STRIPES; ++i)
+		{
+			while (m_stripes[i].Readers[uiParity].load() != 0) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	//
+	// Grace period: returns when every reader that entered before the call has left.
+	// Late readers of the previous epoch are drained first, then the epoch flips and
+	// the readers of the current one are drained; new readers count in the next epoch
+	// and can only load the snapshot published before the call.
+	//
+	void synchronize()
+	{
+		const UINT uiParity = (UINT)(m_ullEpoch.load() & 1);
+		waitForReaders(uiParity ^ 1);
+		m_ullEpoch.fetch_add(1);
+		waitForReaders(uiParity);
+	}
+
+public:
+	//
+	// Read section of the current snapshot (nullptr: nothing published).
+	// The snapshot is valid while the reader lives, do not keep pointers into it.
+	//
+	class CReader
+	{
+	private:
+		std::atomic<UINT>*  m_pCounter;
+		const T*            m_pValue;
+
+		// disable copy
+		CReader(const CReader&);
+		CReader& operator=(const CReader&);
+
+	public:
+		explicit CReader(const CDXGICaptureSnapshot &snapshot)
+		{
+			tagReaderStripe *pStripe = &snapshot.m_stripes[getStripe()];
+			m_pCounter = &pStripe->Readers[snapshot.m_ullEpoch.load() & 1];
+			m_pCounter->fetch_add(1);
+			m_pValue = snapshot.m_pCurrent.load();
+		}
+
+		~CReader()
+		{
+			m_pCounter->fetch_sub(1, std::memory_order_release);
+		}
+
+		const T* Get() const
+		{
+			return m_pValue;
+		}
+	}; // end class CReader
+
+public:
+	CDXGICaptureSnapshot()
+		: m_pCurrent(nullptr)
+		, m_ullEpoch(0)
+	{
+		for (UINT i = 0; i < READER_STRIPES; ++i)
+		{
+			m_stripes[i].Readers[0].store(0);
+			m_stripes[i].Readers[1].store(0);
+		}
+	}
+
+	~CDXGICaptureSnapshot()
+	{
+		delete m_pCurrent.load();
+	}
+
+	//
+	// Replaces the snapshot, takes the ownership of pValue (nullptr: clears it).
+	// Returns when the old snapshot is deleted.
+	//
+	void Publish(_In_opt_ T *pValue)
+	{
+		std::lock_guard<std::mutex> lock(m_publishLock);
+
+		T *pOld = m_pCurrent.exchange(pValue);
+		if (nullptr != pOld)
+		{
+			synchronize();
+			delete pOld;
+		}
+	}
+
+	HRESULT Publish(_In_ const T &value)
+	{
+		T *pValue = new (std::nothrow) T(value);
+		if (nullptr == pValue) {
+			return E_OUTOFMEMORY;
+		}
+		Publish(pValue);
+		return S_OK;
+	}
+
+	void Clear()
+	{
+		Publish((T*)nullptr);
+	}
+
+	//
+	// Copies the current snapshot, S_FALSE if nothing is published
+	//
+	HRESULT Get(_Out_ T *pValue) const
+	{
+		CHECK_POINTER_EX(pValue, E_INVALIDARG);
+
+		CReader reader(*this);
+		if (nullptr == reader.Get()) {
+			return S_FALSE;
+		}
+		*pValue = *reader.Get();
+		return S_OK;
+	}
+
+	BOOL IsPublished() const
+	{
+		return (nullptr != m_pCurrent.load());
+	}
+
+	UINT64 GetEpoch() const
+	{
+		return m_ullEpoch.load();
+	}
+}; // end class CDXGICaptureSnapshot
+
+#endif // __DXGICAPTURESNAPSHOT_H__
@@ -0,0 +1,84 @@
+/*****************************************************************************
+* DXGICaptureSource.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESOURCE_H__
+#define __DXGICAPTURESOURCE_H__
+
+#include "DXGICapturePlatform.h"
+#include "DXGICaptureDirtyRects.h"
+#include "DXGICapturePointer.h"
+
+//
+// struct tagCaptureSourceDesc_s
+//
+typedef struct tagCaptureSourceDesc_s
+{
+	INT Width;              /* size of the desktop image (as acquired, not rotated) */
+	INT Height;
+	INT RotationDegrees;    /* display rotation: 0, 90, 180, 270 */
+	INT DesktopWidth;       /* size of the desktop in desktop coordinates (rotated) */
+	INT DesktopHeight;
+} tagCaptureSourceDesc;
+
+//
+// struct tagCaptureSourceFrame_s
+//
+// A desktop image acquired from a capture source. The data stays valid until
+// ReleaseFrame. The move and dirty rects (image coordinates) are relative to
+// the previous frame, the first frame of a source is always fully dirty.
+//
+typedef struct tagCaptureSourceFrame_s
+{
+	const BYTE*                 Data;           /* 32bpp BGRA, Height rows of Pitch bytes */
+	INT                         Pitch;
+	UINT64                      FrameNumber;
+	INT64                       Timestamp;      /* usec */
+	UINT                        AccumulatedFrames; /* desktop updates since the previous image */
+	const tagFrameMoveRect*     MoveRects;
+	UINT                        MoveRectCount;
+	const tagFrameRect*         DirtyRects;
+	UINT                        DirtyRectCount;
+	const tagCapturePointer*    Pointer;        /* nullptr if the source has no pointer */
+} tagCaptureSourceFrame;
+
+//
+// class IDXGICaptureSource
+//
+// Delivers desktop images: the DXGI desktop duplication, or a synthetic
+// generator for headless runs and benchmarks.
+//
+class IDXGICaptureSource
+{
+public:
+	virtual ~IDXGICaptureSource() {}
+
+	virtual HRESULT GetDesc(_Out_ tagCaptureSourceDesc *pDesc) = 0;
+	// waits up to uiTimeoutMsec for a new image, returns S_FALSE on timeout
+	virtual HRESULT AcquireFrame(_In_ UINT uiTimeoutMsec, _Out_ tagCaptureSourceFrame *pFrame) = 0;
+	virtual HRESULT ReleaseFrame() = 0;
+	// limits the copy of the next images to the rects (image coordinates), the
+	// pixels outside of them are undefined; no rects: the whole image.
+	// Returns S_FALSE if the source always delivers the whole image.
+	virtual HRESULT SetCopyRects(_In_opt_ const tagFrameRect *pRects, _In_ UINT uiCount)
+	{
+		(void)pRects;
+		(void)uiCount;
+		return S_FALSE;
+	}
+};
+
+#endif // __DXGICAPTURESOURCE_H__
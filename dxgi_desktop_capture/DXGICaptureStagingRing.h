@@ -0,0 +1,314 @@
+/*****************************************************************************
+* DXGICaptureStagingRing.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESTAGINGRING_H__
+#define __DXGICAPTURESTAGINGRING_H__
+
+#include "DXGICapturePlatform.h"
+
+#include <string.h>
+
+#define DXGICAPTURE_STAGING_MIN_DEPTH       1
+#define DXGICAPTURE_STAGING_MAX_DEPTH       4
+#define DXGICAPTURE_STAGING_DEFAULT_DEPTH   3
+
+//
+// class IDXGICaptureStagingDevice
+//
+// The gpu side of the readback ring: a set of cpu readable staging slots and
+// the source image (the acquired desktop image) that is copied into them.
+// Implemented with D3D11 staging textures, or by a mock without any gpu.
+//
+class IDXGICaptureStagingDevice
+{
+public:
+	virtual ~IDXGICaptureStagingDevice() {}
+
+	// queues the copy of the current source image into the slot, must not wait for it
+	virtual HRESULT CopyToSlot(_In_ UINT uiSlot) = 0;
+	// gives the source image back as soon as its copy is queued
+	virtual HRESULT ReleaseSource() = 0;
+	// S_OK if the copy into the slot has completed, S_FALSE if it is still in flight
+	virtual HRESULT IsSlotReady(_In_ UINT uiSlot) = 0;
+	// maps the slot for cpu read/write, waits for the copy if it is still in flight
+	virtual HRESULT MapSlot(_In_ UINT uiSlot, _Out_ BYTE **ppData, _Out_ INT *pPitch) = 0;
+	virtual HRESULT UnmapSlot(_In_ UINT uiSlot) = 0;
+};
+
+//
+// struct tagStagingFrame_s
+//
+typedef struct tagStagingFrame_s
+{
+	UINT   Slot;
+	UINT64 FrameNumber;
+	INT64  SubmitTime;      /* usec, as given to Submit */
+	UINT   LatencyFrames;   /* frames submitted after this one before it was mapped */
+	INT64  LatencyUsec;     /* map time - submit time */
+	BYTE*  Data;
+	INT    Pitch;
+} tagStagingFrame;
+
+//
+// struct tagStagingRingStats_s
+//
+typedef struct tagStagingRingStats_s
+{
+	UINT   Depth;
+	UINT   MaxInFlight;
+	UINT64 Submitted;
+	UINT64 Retrieved;
+	UINT64 Discarded;           /* in flight when the ring was reset */
+	UINT64 Stalls;              /* the copy was still in flight when the slot was mapped */
+	UINT64 TotalLatencyFrames;
+	INT64  TotalLatencyUsec;
+	INT64  MaxLatencyUsec;
+} tagStagingRingStats;
+
+//
+// class CDXGICaptureStagingRing
+//
+// Schedules the gpu -> cpu readback over 1..4 staging slots. Frame N is copied
+// into the next free slot and the source is released right away; the oldest
+// slot is mapped only when the ring is full (or drained while the desktop is
+// idle), so with depth 3 frame N is copied while frame N-2 is processed.
+// Slots are always retrieved in submit order. Depth 1 is the synchronous
+// copy-then-map readback.
+//
+class CDXGICaptureStagingRing
+{
+private:
+	typedef struct tagSlot_s
+	{
+		UINT64 FrameNumber;
+		UINT64 SubmitIndex;
+		INT64  SubmitTime;
+	} tagSlot;
+
+	IDXGICaptureStagingDevice* m_pDevice;
+	UINT                       m_uiDepth;
+	UINT                       m_uiHead;     // next slot to copy into
+	UINT                       m_uiInFlight; // submitted, not yet unmapped
+	BOOL                       m_bMapped;    // the oldest slot is mapped
+	tagSlot                    m_slots[DXGICAPTURE_STAGING_MAX_DEPTH];
+	tagStagingRingStats        m_stats;
+
+	// disable copy
+	CDXGICaptureStagingRing(const CDXGICaptureStagingRing&);
+	CDXGICaptureStagingRing& operator=(const CDXGICaptureStagingRing&);
+
+	inline UINT oldestSlot() const
+	{
+		return (m_uiHead + m_uiDepth - m_uiInFlight) % m_uiDepth;
+	}
+
+public:
+	CDXGICaptureStagingRing()
+		: m_pDevice(nullptr)
+		, m_uiDepth(DXGICAPTURE_STAGING_MIN_DEPTH)
+		, m_uiHead(0)
+		, m_uiInFlight(0)
+		, m_bMapped(FALSE)
+	{
+		memset(m_slots, 0, sizeof(m_slots));
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_stats.Depth = m_uiDepth;
+	}
+
+	//
+	// Attaches the device (not owned) and clears the ring and the statistics
+	//
+	inline
+	HRESULT
+	Initialize(
+		_In_ IDXGICaptureStagingDevice *pDevice,
+		_In_ UINT uiDepth
+		)
+	{
+		if ((nullptr == pDevice) || (uiDepth < DXGICAPTURE_STAGING_MIN_DEPTH) || (uiDepth > DXGICAPTURE_STAGING_MAX_DEPTH)) {
+			return E_INVALIDARG;
+		}
+
+		Reset();
+		m_pDevice = pDevice;
+		m_uiDepth = uiDepth;
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_stats.Depth = m_uiDepth;
+		return S_OK;
+	}
+
+	//
+	// Drops the frames in flight (counted as discarded), the device is kept
+	//
+	inline void Reset()
+	{
+		if (m_bMapped && (nullptr != m_pDevice)) {
+			m_pDevice->UnmapSlot(oldestSlot());
+		}
+		m_stats.Discarded += m_uiInFlight;
+		m_uiHead     = 0;
+		m_uiInFlight = 0;
+		m_bMapped    = FALSE;
+	}
+
+	inline UINT GetDepth() const { return m_uiDepth; }
+	inline UINT GetInFlight() const { return m_uiInFlight; }
+	inline BOOL IsEmpty() const { return (m_uiInFlight == 0); }
+	inline BOOL IsFull() const { return (m_uiInFlight == m_uiDepth); }
+	inline UINT64 GetSubmittedCount() const { return m_stats.Submitted; }
+
+	//
+	// Queues the copy of the current source into the next slot and releases the source.
+	// Fails with E_UNEXPECTED if all slots are in flight (retrieve the oldest first).
+	// The source is not released when the copy is not queued, the caller gives it back.
+	//
+	inline
+	HRESULT
+	Submit(
+		_In_ UINT64 ullFrameNumber,
+		_In_ INT64 llTimestamp,
+		_Out_opt_ UINT *pSlot
+		)
+	{
+		if (nullptr == m_pDevice) {
+			return E_UNEXPECTED;
+		}
+		if (IsFull()) {
+			return E_UNEXPECTED;
+		}
+
+		UINT uiSlot = m_uiHead;
+		HRESULT hr = m_pDevice->CopyToSlot(uiSlot);
+		if (FAILED(hr)) {
+			return hr;
+		}
+		hr = m_pDevice->ReleaseSource();
+		if (FAILED(hr)) {
+			return hr;
+		}
+
+		m_slots[uiSlot].FrameNumber = ullFrameNumber;
+		m_slots[uiSlot].SubmitIndex = m_stats.Submitted;
+		m_slots[uiSlot].SubmitTime  = llTimestamp;
+
+		m_uiHead = (m_uiHead + 1) % m_uiDepth;
+		m_uiInFlight++;
+		m_stats.Submitted++;
+		if (m_uiInFlight > m_stats.MaxInFlight) {
+			m_stats.MaxInFlight = m_uiInFlight;
+		}
+
+		if (nullptr != pSlot) {
+			*pSlot = uiSlot;
+		}
+		return S_OK;
+	}
+
+	//
+	// Maps the oldest slot, llTimestamp is the current time (usec).
+	// Returns S_FALSE if nothing is in flight.
+	//
+	inline
+	HRESULT
+	MapOldest(
+		_In_ INT64 llTimestamp,
+		_Out_ tagStagingFrame *pFrame
+		)
+	{
+		if (nullptr == pFrame) {
+			return E_POINTER;
+		}
+		memset(pFrame, 0, sizeof(*pFrame));
+		if (nullptr == m_pDevice) {
+			return E_UNEXPECTED;
+		}
+		if (m_bMapped) {
+			return E_UNEXPECTED; // unmap the previous one first
+		}
+		if (m_uiInFlight == 0) {
+			return S_FALSE;
+		}
+
+		UINT uiSlot = oldestSlot();
+		const tagSlot &slot = m_slots[uiSlot];
+
+		HRESULT hr = m_pDevice->IsSlotReady(uiSlot);
+		if (FAILED(hr)) {
+			return hr;
+		}
+		if (hr == S_FALSE) {
+			m_stats.Stalls++;
+		}
+
+		hr = m_pDevice->MapSlot(uiSlot, &pFrame->Data, &pFrame->Pitch);
+		if (FAILED(hr)) {
+			return hr;
+		}
+		m_bMapped = TRUE;
+
+		pFrame->Slot          = uiSlot;
+		pFrame->FrameNumber   = slot.FrameNumber;
+		pFrame->SubmitTime    = slot.SubmitTime;
+		pFrame->LatencyFrames = (UINT)(m_stats.Submitted - 1 - slot.SubmitIndex);
+		pFrame->LatencyUsec   = llTimestamp - slot.SubmitTime;
+		return S_OK;
+	}
+
+	//
+	// Unmaps the oldest slot and frees it for the next copy
+	//
+	inline
+	HRESULT
+	UnmapOldest(
+		_In_ const tagStagingFrame *pFrame
+		)
+	{
+		if (nullptr == pFrame) {
+			return E_POINTER;
+		}
+		if (!m_bMapped || (pFrame->Slot != oldestSlot())) {
+			return E_UNEXPECTED;
+		}
+
+		HRESULT hr = m_pDevice->UnmapSlot(pFrame->Slot);
+		m_bMapped = FALSE;
+		m_uiInFlight--;
+
+		m_stats.Retrieved++;
+		m_stats.TotalLatencyFrames += pFrame->LatencyFrames;
+		m_stats.TotalLatencyUsec   += pFrame->LatencyUsec;
+		if (pFrame->LatencyUsec > m_stats.MaxLatencyUsec) {
+			m_stats.MaxLatencyUsec = pFrame->LatencyUsec;
+		}
+		return hr;
+	}
+
+	inline void GetStats(_Out_ tagStagingRingStats *pStats) const
+	{
+		*pStats = m_stats;
+	}
+
+	// call it while nothing is in flight
+	inline void ResetStats()
+	{
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_stats.Depth = m_uiDepth;
+	}
+
+}; // end class CDXGICaptureStagingRing
+
+#endif // __DXGICAPTURESTAGINGRING_H__
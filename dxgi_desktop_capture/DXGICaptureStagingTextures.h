@@ -0,0 +1,229 @@
+/*****************************************************************************
+* DXGICaptureStagingTextures.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESTAGINGTEXTURES_H__
+#define __DXGICAPTURESTAGINGTEXTURES_H__
+
+#include <atlbase.h>
+
+#include <dxgi1_2.h>
+#include <d3d11.h>
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureStagingRing.h"
+
+//
+// class CDXGIStagingTextures
+//
+// D3D11 staging device of the readback ring. Every slot is a staging texture
+// with an event query that is signaled when the copy into it has completed.
+//
+class CDXGIStagingTextures : public IDXGICaptureStagingDevice
+{
+private:
+	CComPtr<ID3D11DeviceContext>    m_ipContext;
+	CComPtr<IDXGIOutputDuplication> m_ipOutputDuplication;
+	CComPtr<ID3D11Texture2D>        m_ipSource;
+	CComPtr<ID3D11Texture2D>        m_ipTextures[DXGICAPTURE_STAGING_MAX_DEPTH];
+	CComPtr<ID3D11Query>            m_ipQueries[DXGICAPTURE_STAGING_MAX_DEPTH];
+	UINT                            m_uiDepth;
+	D3D11_BOX                       m_copyBox;
+	BOOL                            m_bCopyBox;     /* FALSE: the whole source is copied */
+
+	// disable copy
+	CDXGIStagingTextures(const CDXGIStagingTextures&);
+	CDXGIStagingTextures& operator=(const CDXGIStagingTextures&);
+
+public:
+	CDXGIStagingTextures()
+		: m_uiDepth(0)
+		, m_bCopyBox(FALSE)
+	{
+		RtlZeroMemory(&m_copyBox, sizeof(m_copyBox));
+	}
+
+	virtual ~CDXGIStagingTextures()
+	{
+		Terminate();
+	}
+
+	//
+	// pFirstTexture is used as slot 0, the other slots get textures of the same description.
+	// pCopyBounds (optional) is the part of the source copied to the slots (a region).
+	//
+	inline
+	HRESULT
+	Initialize(
+		_In_ ID3D11Device *pDevice,
+		_In_ ID3D11DeviceContext *pContext,
+		_In_ IDXGIOutputDuplication *pOutputDuplication,
+		_In_ ID3D11Texture2D *pFirstTexture,
+		_In_ UINT uiDepth,
+		_In_opt_ const tagFrameBounds *pCopyBounds = nullptr
+		)
+	{
+		CHECK_POINTER_EX(pDevice, E_INVALIDARG);
+		CHECK_POINTER_EX(pContext, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutputDuplication, E_INVALIDARG);
+		CHECK_POINTER_EX(pFirstTexture, E_INVALIDARG);
+		if ((uiDepth < DXGICAPTURE_STAGING_MIN_DEPTH) || (uiDepth > DXGICAPTURE_STAGING_MAX_DEPTH)) {
+			return E_INVALIDARG;
+		}
+
+		Terminate();
+
+		HRESULT hr = S_OK;
+		D3D11_TEXTURE2D_DESC desc;
+		pFirstTexture->GetDesc(&desc);
+
+		D3D11_QUERY_DESC queryDesc;
+		queryDesc.Query     = D3D11_QUERY_EVENT;
+		queryDesc.MiscFlags = 0;
+
+		for (UINT i = 0; i < uiDepth; ++i)
+		{
+			if (i == 0) {
+				m_ipTextures[i] = pFirstTexture;
+			}
+			else
+			{
+				hr = pDevice->CreateTexture2D(&desc, NULL, &m_ipTextures[i]);
+				CHECK_HR_BREAK(hr);
+			}
+
+			hr = pDevice->CreateQuery(&queryDesc, &m_ipQueries[i]);
+			CHECK_HR_BREAK(hr);
+		}
+
+		if (FAILED(hr))
+		{
+			Terminate();
+			return hr;
+		}
+
+		m_ipContext           = pContext;
+		m_ipOutputDuplication = pOutputDuplication;
+		m_uiDepth             = uiDepth;
+		m_bCopyBox            = (nullptr != pCopyBounds);
+		if (m_bCopyBox)
+		{
+			m_copyBox.left   = (UINT)pCopyBounds->X;
+			m_copyBox.top    = (UINT)pCopyBounds->Y;
+			m_copyBox.front  = 0;
+			m_copyBox.right  = (UINT)(pCopyBounds->X + pCopyBounds->Width);
+			m_copyBox.bottom = (UINT)(pCopyBounds->Y + pCopyBounds->Height);
+			m_copyBox.back   = 1;
+		}
+		return S_OK;
+	}
+
+	inline void Terminate()
+	{
+		for (UINT i = 0; i < DXGICAPTURE_STAGING_MAX_DEPTH; ++i)
+		{
+			m_ipTextures[i] = nullptr;
+			m_ipQueries[i]  = nullptr;
+		}
+		m_ipSource            = nullptr;
+		m_ipOutputDuplication = nullptr;
+		m_ipContext           = nullptr;
+		m_uiDepth             = 0;
+		m_bCopyBox            = FALSE;
+	}
+
+	//
+	// The acquired desktop image for the next CopyToSlot
+	//
+	inline void SetSource(_In_ ID3D11Texture2D *pSource)
+	{
+		m_ipSource = pSource;
+	}
+
+	inline ID3D11Texture2D* GetTexture(_In_ UINT uiSlot) const
+	{
+		return (uiSlot < m_uiDepth) ? (ID3D11Texture2D*)m_ipTextures[uiSlot] : nullptr;
+	}
+
+	// IDXGICaptureStagingDevice
+	virtual HRESULT CopyToSlot(_In_ UINT uiSlot)
+	{
+		CHECK_POINTER_EX(m_ipSource, E_UNEXPECTED);
+		if (uiSlot >= m_uiDepth) {
+			return E_INVALIDARG;
+		}
+
+		if (m_bCopyBox) {
+			m_ipContext->CopySubresourceRegion(m_ipTextures[uiSlot], 0, 0, 0, 0, m_ipSource, 0, &m_copyBox);
+		}
+		else {
+			m_ipContext->CopyResource(m_ipTextures[uiSlot], m_ipSource);
+		}
+		m_ipContext->End(m_ipQueries[uiSlot]);
+		return S_OK;
+	}
+
+	virtual HRESULT ReleaseSource()
+	{
+		m_ipSource = nullptr;
+		CHECK_POINTER_EX(m_ipOutputDuplication, E_UNEXPECTED);
+		return m_ipOutputDuplication->ReleaseFrame();
+	}
+
+	virtual HRESULT IsSlotReady(_In_ UINT uiSlot)
+	{
+		if (uiSlot >= m_uiDepth) {
+			return E_INVALIDARG;
+		}
+
+		BOOL bDone = FALSE;
+		HRESULT hr = m_ipContext->GetData(m_ipQueries[uiSlot], &bDone, sizeof(bDone), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+		CHECK_HR_RETURN(hr);
+		return ((hr == S_OK) && bDone) ? S_OK : S_FALSE;
+	}
+
+	virtual HRESULT MapSlot(_In_ UINT uiSlot, _Out_ BYTE **ppData, _Out_ INT *pPitch)
+	{
+		CHECK_POINTER(ppData);
+		CHECK_POINTER(pPitch);
+		*ppData = nullptr;
+		*pPitch = 0;
+		if (uiSlot >= m_uiDepth) {
+			return E_INVALIDARG;
+		}
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		HRESULT hr = m_ipContext->Map(m_ipTextures[uiSlot], 0, D3D11_MAP_READ_WRITE, 0, &mapped);
+		CHECK_HR_RETURN(hr);
+
+		*ppData = reinterpret_cast<BYTE*>(mapped.pData);
+		*pPitch = (INT)mapped.RowPitch;
+		return S_OK;
+	}
+
+	virtual HRESULT UnmapSlot(_In_ UINT uiSlot)
+	{
+		if (uiSlot >= m_uiDepth) {
+			return E_INVALIDARG;
+		}
+
+		m_ipContext->Unmap(m_ipTextures[uiSlot], 0);
+		return S_OK;
+	}
+
+}; // end class CDXGIStagingTextures
+
+#endif // __DXGICAPTURESTAGINGTEXTURES_H__
@@ -0,0 +1,520 @@
+/*****************************************************************************
+* DXGICaptureStream.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESTREAM_H__
+#define __DXGICAPTURESTREAM_H__
+
+#include "DXGICaptureTypes.h"
+#include "DXGICaptureEncoderPool.h"
+#include "DXGICaptureFrame.h"
+#include "DXGICaptureFrameBuffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// the reader closed the pipe (HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE))
+#define DXGICAPTURE_E_BROKEN_PIPE           ((HRESULT)0x8007006DL)
+// buffer of a pipe created by the stream (Windows named pipe, Linux pipe size)
+#define DXGICAPTURE_STREAM_PIPE_BUFFER      (1024 * 1024)
+// smaller pieces (frame headers) are gathered in the write buffer on Windows
+#define DXGICAPTURE_STREAM_GATHER_MAX       (64 * 1024)
+#define DXGICAPTURE_STREAM_MAX_CHUNKS       8
+
+//
+// enum tagStreamFormat_e
+//
+typedef enum tagStreamFormat_e : UINT
+{
+	tagStreamFormat_Y4M     = 0x0, /* YUV4MPEG2 (I420), stream header and a FRAME header per frame */
+	tagStreamFormat_RawYuv  = 0x1, /* NV12 or I420 planes, rawvideo */
+	tagStreamFormat_RawBgra = 0x2, /* 32bpp BGRA, rawvideo */
+} tagStreamFormat;
+
+//
+// struct tagStreamChunk_s
+//
+typedef struct tagStreamChunk_s
+{
+	const BYTE* Data;
+	UINT        Size;
+} tagStreamChunk;
+
+//
+// struct tagStreamOutputStats_s
+//
+typedef struct tagStreamOutputStats_s
+{
+	UINT64 Frames;
+	UINT64 BytesWritten;
+	UINT64 WriteCalls;         /* system calls, a frame is one gathered write if the reader keeps up */
+	INT64  WriteUsec;          /* time spent in the writes, mostly waiting for the reader */
+	INT64  MaxWriteUsec;       /* longest write of one frame */
+} tagStreamOutputStats;
+
+//
+// class CDXGIStreamOutput
+//
+// A byte stream that stays open for the whole capture: stdout ("-"), a pipe
+// or a file. A frame is written as a list of chunks (header, planes) straight
+// from the frame buffers with one gathered write (writev, on Windows small
+// chunks are gathered in a buffer and the planes are written as they are).
+// Writing to stdout moves the console output of the process to stderr, so
+// only the stream goes to the reader.
+//
+class CDXGIStreamOutput
+{
+private:
+	typedef std::chrono::steady_clock clock_type;
+
+#if defined(_WIN32)
+	HANDLE               m_hFile;
+	BOOL                 m_bNamedPipe;
+	std::vector<BYTE>    m_gather;
+#endif
+	int                  m_fd;      // Windows: duplicated stdout only, owns m_hFile
+	tagStreamOutputStats m_stats;
+
+	// disable copy
+	CDXGIStreamOutput(const CDXGIStreamOutput&);
+	CDXGIStreamOutput& operator=(const CDXGIStreamOutput&);
+
+#if defined(_WIN32)
+	inline
+	HRESULT
+	writeAll(
+		_In_reads_bytes_(uiSize) const BYTE *pData,
+		_In_ UINT uiSize
+		)
+	{
+		while (uiSize > 0)
+		{
+			DWORD dwWritten = 0;
+			if (!WriteFile(m_hFile, pData, uiSize, &dwWritten, NULL))
+			{
+				DWORD dwError = GetLastError();
+				return ((dwError == ERROR_BROKEN_PIPE) || (dwError == ERROR_NO_DATA)) ? DXGICAPTURE_E_BROKEN_PIPE : HRESULT_FROM_WIN32(dwError);
+			}
+			++m_stats.WriteCalls;
+			pData  += dwWritten;
+			uiSize -= dwWritten;
+		}
+		return S_OK;
+	}
+#endif
+
+public:
+	CDXGIStreamOutput()
+#if defined(_WIN32)
+		: m_hFile(INVALID_HANDLE_VALUE)
+		, m_bNamedPipe(FALSE)
+		, m_fd(-1)
+#else
+		: m_fd(-1)
+#endif
+	{
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
+	~CDXGIStreamOutput()
+	{
+		Close();
+	}
+
+#if defined(_WIN32)
+	inline BOOL IsOpen() const { return (INVALID_HANDLE_VALUE != m_hFile); }
+#else
+	inline BOOL IsOpen() const { return (m_fd >= 0); }
+#endif
+
+	//
+	// "-": stdout, "\\.\pipe\<name>" (Windows): creates the named pipe and waits
+	// for the reader, a fifo (POSIX): waits for the reader, otherwise the file
+	// is created
+	//
+	inline
+	HRESULT
+	Open(
+		_In_ const char *pszPath
+		)
+	{
+		CHECK_POINTER_EX(pszPath, E_INVALIDARG);
+		if (IsOpen()) {
+			return E_UNEXPECTED;
+		}
+		memset(&m_stats, 0, sizeof(m_stats));
+
+		BOOL bStdout = (strcmp(pszPath, "-") == 0);
+#if defined(_WIN32)
+		if (bStdout)
+		{
+			fflush(stdout);
+			m_fd = _dup(_fileno(stdout));
+			if (m_fd < 0) {
+				return E_FAIL;
+			}
+			_setmode(m_fd, _O_BINARY);
+			m_hFile = (HANDLE)_get_osfhandle(m_fd);
+			_dup2(_fileno(stderr), _fileno(stdout));
+		}
+		else if (_strnicmp(pszPath, "\\\\.\\pipe\\", 9) == 0)
+		{
+			m_hFile = CreateNamedPipeA(pszPath, PIPE_ACCESS_OUTBOUND, PIPE_TYPE_BYTE | PIPE_WAIT, 1,
+				DXGICAPTURE_STREAM_PIPE_BUFFER, 0, 0, NULL);
+			if (INVALID_HANDLE_VALUE == m_hFile) {
+				return HRESULT_FROM_WIN32(GetLastError());
+			}
+			if (!ConnectNamedPipe(m_hFile, NULL) && (GetLastError() != ERROR_PIPE_CONNECTED))
+			{
+				HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+				CloseHandle(m_hFile);
+				m_hFile = INVALID_HANDLE_VALUE;
+				return hr;
+			}
+			m_bNamedPipe = TRUE;
+		}
+		else
+		{
+			m_hFile = CreateFileA(pszPath, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (INVALID_HANDLE_VALUE == m_hFile) {
+				return HRESULT_FROM_WIN32(GetLastError());
+			}
+		}
+#else
+		// a closed reader is reported by the write (EPIPE), not by a signal
+		signal(SIGPIPE, SIG_IGN);
+		if (bStdout)
+		{
+			fflush(stdout);
+			m_fd = dup(STDOUT_FILENO);
+			if (m_fd < 0) {
+				return E_FAIL;
+			}
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		}
+		else
+		{
+			struct stat st;
+			BOOL bFifo = (stat(pszPath, &st) == 0) && S_ISFIFO(st.st_mode);
+			m_fd = bFifo ? open(pszPath, O_WRONLY) : open(pszPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (m_fd < 0) {
+				return E_FAIL;
+			}
+		}
+#if defined(F_SETPIPE_SZ)
+		fcntl(m_fd, F_SETPIPE_SZ, DXGICAPTURE_STREAM_PIPE_BUFFER); // not a pipe or above the limit: keeps its size
+#endif
+#endif
+		return S_OK;
+	} // Open
+
+	inline
+	void
+	Close()
+	{
+#if defined(_WIN32)
+		if (m_bNamedPipe)
+		{
+			FlushFileBuffers(m_hFile);
+			DisconnectNamedPipe(m_hFile);
+		}
+		if (m_fd >= 0) {
+			_close(m_fd); // closes the handle of the duplicated stdout
+		}
+		else if (INVALID_HANDLE_VALUE != m_hFile) {
+			CloseHandle(m_hFile);
+		}
+		m_hFile      = INVALID_HANDLE_VALUE;
+		m_bNamedPipe = FALSE;
+#else
+		if (m_fd >= 0) {
+			close(m_fd);
+		}
+#endif
+		m_fd = -1;
+	} // Close
+
+	//
+	// Writes the chunks of one frame in order, blocks while the reader is behind
+	//
+	inline
+	HRESULT
+	WriteFrame(
+		_In_ const tagStreamChunk *pChunks,
+		_In_ UINT uiCount
+		)
+	{
+		CHECK_POINTER_EX(pChunks, E_INVALIDARG);
+		if (!IsOpen()) {
+			return E_UNEXPECTED;
+		}
+
+		clock_type::time_point start = clock_type::now();
+		UINT64 ullBytes = 0;
+		HRESULT hr = S_OK;
+
+#if defined(_WIN32)
+		// no gathered write for pipes, the small chunks go with the next plane
+		m_gather.clear();
+		for (UINT i = 0; SUCCEEDED(hr) && (i < uiCount); ++i)
+		{
+			ullBytes += pChunks[i].Size;
+			if (pChunks[i].Size < DXGICAPTURE_STREAM_GATHER_MAX)
+			{
+				m_gather.insert(m_gather.end(), pChunks[i].Data, pChunks[i].Data + pChunks[i].Size);
+				continue;
+			}
+			if (!m_gather.empty())
+			{
+				hr = writeAll(&m_gather[0], (UINT)m_gather.size());
+				m_gather.clear();
+			}
+			if (SUCCEEDED(hr)) {
+				hr = writeAll(pChunks[i].Data, pChunks[i].Size);
+			}
+		}
+		if (SUCCEEDED(hr) && !m_gather.empty()) {
+			hr = writeAll(&m_gather[0], (UINT)m_gather.size());
+		}
+#else
+		struct iovec iov[DXGICAPTURE_STREAM_MAX_CHUNKS];
+		int nCount = 0;
+		for (UINT i = 0; i < uiCount; ++i)
+		{
+			if (pChunks[i].Size == 0) {
+				continue;
+			}
+			if (nCount == DXGICAPTURE_STREAM_MAX_CHUNKS) {
+				return E_INVALIDARG;
+			}
+			iov[nCount].iov_base = (void*)pChunks[i].Data;
+			iov[nCount].iov_len  = pChunks[i].Size;
+			ullBytes += pChunks[i].Size;
+			++nCount;
+		}
+
+		// a pipe takes a part of the frame per call, continue behind the written bytes
+		struct iovec *pIov = iov;
+		while (nCount > 0)
+		{
+			ssize_t nWritten = writev(m_fd, pIov, nCount);
+			if (nWritten < 0)
+			{
+				if (errno == EINTR) {
+					continue;
+				}
+				hr = (errno == EPIPE) ? DXGICAPTURE_E_BROKEN_PIPE : E_FAIL;
+				break;
+			}
+			++m_stats.WriteCalls;
+			while ((nCount > 0) && ((size_t)nWritten >= pIov->iov_len))
+			{
+				nWritten -= (ssize_t)pIov->iov_len;
+				++pIov;
+				--nCount;
+			}
+			if (nCount > 0)
+			{
+				pIov->iov_base = (BYTE*)pIov->iov_base + nWritten;
+				pIov->iov_len -= (size_t)nWritten;
+			}
+		}
+#endif
+
+		INT64 llUsec = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count();
+		m_stats.WriteUsec += llUsec;
+		if (m_stats.MaxWriteUsec < llUsec) {
+			m_stats.MaxWriteUsec = llUsec;
+		}
+		if (SUCCEEDED(hr))
+		{
+			m_stats.Frames++;
+			m_stats.BytesWritten += ullBytes;
+		}
+		return hr;
+	} // WriteFrame
+
+	inline void GetStats(_Out_ tagStreamOutputStats *pStats) const
+	{
+		*pStats = m_stats;
+	}
+
+}; // end class CDXGIStreamOutput
+
+//
+// class CDXGIStreamEncoder
+//
+// Encoder of the encoder pool that streams the frames to a CDXGIStreamOutput.
+// Nothing is encoded: Encode only checks the frame and builds its header,
+// Write gathers the header and the planes of the frame (its YUV image, or the
+// BGRA buffer) into one write. A reader that is behind fills the queue of the
+// pool, its backpressure decides which frames are dropped.
+//
+class CDXGIStreamEncoder : public IDXGICaptureEncoder
+{
+private:
+	CDXGIStreamOutput* m_pOutput;
+	tagStreamFormat    m_format;
+	UINT               m_uiFrameRate;
+	INT                m_nWidth;    // of the stream header, 0 before the first frame
+	INT                m_nHeight;
+	char               m_szHeader[256];
+
+	// disable copy
+	CDXGIStreamEncoder(const CDXGIStreamEncoder&);
+	CDXGIStreamEncoder& operator=(const CDXGIStreamEncoder&);
+
+public:
+	CDXGIStreamEncoder(
+		_In_ CDXGIStreamOutput *pOutput,
+		_In_ tagStreamFormat format,
+		_In_ UINT uiFrameRate
+		)
+		: m_pOutput(pOutput)
+		, m_format(format)
+		, m_uiFrameRate((uiFrameRate > 0) ? uiFrameRate : 60)
+		, m_nWidth(0)
+		, m_nHeight(0)
+	{
+		m_szHeader[0] = '\0';
+	}
+
+	// YUV format the frames must carry (CDXGICaptureFrame::ConvertToYuv), None: BGRA
+	static
+	inline
+	tagYuvFormat
+	GetRequiredYuvFormat(
+		_In_ tagStreamFormat format,
+		_In_ tagYuvFormat rawFormat
+		)
+	{
+		switch (format)
+		{
+		case tagStreamFormat_Y4M:
+			return tagYuvFormat_I420; // the 4:2:0 layout of y4m
+		case tagStreamFormat_RawYuv:
+			return (rawFormat == tagYuvFormat_None) ? tagYuvFormat_I420 : rawFormat;
+		default:
+			return tagYuvFormat_None;
+		}
+	} // GetRequiredYuvFormat
+
+	virtual HRESULT Encode(_In_ const CDXGICaptureFrame *pFrame, _Inout_ tagFrameBufferInfo *pOutput, _Out_ UINT *pRetSize)
+	{
+		CHECK_POINTER_EX(pFrame, E_INVALIDARG);
+		CHECK_POINTER_EX(pRetSize, E_INVALIDARG);
+		*pRetSize = 0;
+
+		const tagYuvImage *pYuv = pFrame->GetYuvImage();
+		if ((m_format == tagStreamFormat_Y4M) && (pYuv->Format != tagYuvFormat_I420)) {
+			return E_INVALIDARG;
+		}
+		if ((m_format == tagStreamFormat_RawYuv) && (pYuv->Format == tagYuvFormat_None)) {
+			return E_INVALIDARG;
+		}
+		if (m_format != tagStreamFormat_Y4M) {
+			return S_OK; // rawvideo has no headers
+		}
+
+		static const char s_szFrame[] = "FRAME\n";
+		HRESULT hr = DXGICaptureFrameBuffer::Resize(pOutput, sizeof(s_szFrame) - 1);
+		CHECK_HR_RETURN(hr);
+		memcpy(pOutput->Buffer, s_szFrame, sizeof(s_szFrame) - 1);
+		*pRetSize = sizeof(s_szFrame) - 1;
+		return S_OK;
+	}
+
+	virtual HRESULT Write(_In_ const CDXGICaptureFrame *pFrame, _In_ UINT64 ullSequence, _In_reads_bytes_(uiSize) const BYTE *pData, _In_ UINT uiSize)
+	{
+		(void)ullSequence;
+		CHECK_POINTER_EX(m_pOutput, E_UNEXPECTED);
+
+		// the size of a stream is fixed by its first frame
+		const INT nWidth  = pFrame->GetWidth();
+		const INT nHeight = pFrame->GetHeight();
+		if (m_nWidth == 0)
+		{
+			m_nWidth  = nWidth;
+			m_nHeight = nHeight;
+		}
+		else if ((m_nWidth != nWidth) || (m_nHeight != nHeight)) {
+			return E_UNEXPECTED;
+		}
+
+		tagStreamChunk chunks[DXGICAPTURE_STREAM_MAX_CHUNKS];
+		UINT uiCount = 0;
+		if ((m_format == tagStreamFormat_Y4M) && (m_szHeader[0] == '\0'))
+		{
+			const tagYuvImage *pYuv = pFrame->GetYuvImage();
+			sprintf(m_szHeader, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=%s\n",
+				nWidth, nHeight, m_uiFrameRate, (pYuv->Range == tagYuvRange_Full) ? "FULL" : "LIMITED");
+			chunks[uiCount].Data = (const BYTE*)m_szHeader;
+			chunks[uiCount].Size = (UINT)strlen(m_szHeader);
+			++uiCount;
+		}
+		if (uiSize > 0)
+		{
+			chunks[uiCount].Data = pData;
+			chunks[uiCount].Size = uiSize;
+			++uiCount;
+		}
+
+		if (m_format == tagStreamFormat_RawBgra)
+		{
+			if (pFrame->GetPitch() != nWidth * 4) {
+				return E_INVALIDARG;
+			}
+			chunks[uiCount].Data = pFrame->GetBuffer();
+			chunks[uiCount].Size = (UINT)(nWidth * 4 * nHeight);
+			++uiCount;
+		}
+		else
+		{
+			// the planes of CDXGICaptureFrame::ConvertToYuv are packed
+			const tagYuvImage *pYuv = pFrame->GetYuvImage();
+			const INT nChromaHeight = (nHeight + 1) / 2;
+			chunks[uiCount].Data = pYuv->Planes[0];
+			chunks[uiCount].Size = (UINT)(pYuv->Pitches[0] * nHeight);
+			++uiCount;
+			for (INT i = 1; (i < 3) && (nullptr != pYuv->Planes[i]); ++i)
+			{
+				chunks[uiCount].Data = pYuv->Planes[i];
+				chunks[uiCount].Size = (UINT)(pYuv->Pitches[i] * nChromaHeight);
+				++uiCount;
+			}
+		}
+
+		return m_pOutput->WriteFrame(chunks, uiCount);
+	}
+
+}; // end class CDXGIStreamEncoder
+
+#endif // __DXGICAPTURESTREAM_H__
@@ -0,0 +1,541 @@
+/*****************************************************************************
+* DXGICaptureStripEncoder.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESTRIPENCODER_H__
+#define __DXGICAPTURESTRIPENCODER_H__
+
+#include "DXGICaptureDeflate.h"
+#include "DXGICaptureFrameBuffer.h"
+#include "DXGICaptureJpeg.h"
+#include "DXGICaptureParallel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <vector>
+
+#define DXGICAPTURE_STRIP_ROWS              64 /* rows per strip, fixed so the output does not depend on the thread count */
+
+//
+// enum tagStripImageFormat_e
+//
+typedef enum tagStripImageFormat_e : UINT
+{
+	tagStripImageFormat_Png  = 0x0, /* RGB, one IDAT chunk per strip */
+	tagStripImageFormat_Jpeg = 0x1, /* baseline 4:2:0, one restart interval per strip */
+	tagStripImageFormat_Tiff = 0x2, /* RGB, deflate + horizontal predictor, one TIFF strip per strip */
+} tagStripImageFormat;
+
+//
+// class DXGICaptureStripEncoder
+//
+// Encodes large 32bpp BGRA frames on several threads: the image is cut into
+// horizontal strips of DXGICAPTURE_STRIP_ROWS rows that are compressed
+// independently and joined in order by the container of the format.
+//
+class DXGICaptureStripEncoder
+{
+private:
+	static
+	inline
+	void
+	putBE32(
+		_Inout_ std::vector<BYTE> *pOutput,
+		_In_ UINT uiValue
+		)
+	{
+		pOutput->push_back((BYTE)(uiValue >> 24));
+		pOutput->push_back((BYTE)(uiValue >> 16));
+		pOutput->push_back((BYTE)(uiValue >> 8));
+		pOutput->push_back((BYTE)uiValue);
+	} // putBE32
+
+	static
+	inline
+	void
+	putLE16(
+		_Inout_ std::vector<BYTE> *pOutput,
+		_In_ UINT uiValue
+		)
+	{
+		pOutput->push_back((BYTE)uiValue);
+		pOutput->push_back((BYTE)(uiValue >> 8));
+	} // putLE16
+
+	static
+	inline
+	void
+	putLE32(
+		_Inout_ std::vector<BYTE> *pOutput,
+		_In_ UINT uiValue
+		)
+	{
+		putLE16(pOutput, uiValue & 0xFFFF);
+		putLE16(pOutput, uiValue >> 16);
+	} // putLE32
+
+	//
+	// Fills in the length of the PNG chunk opened at nLengthOffset and appends its CRC
+	//
+	static
+	inline
+	void
+	closeChunk(
+		_Inout_ std::vector<BYTE> *pOutput,
+		_In_ size_t nLengthOffset
+		)
+	{
+		const size_t nDataSize = pOutput->size() - nLengthOffset - 8;
+		BYTE *pLength = pOutput->data() + nLengthOffset;
+		pLength[0] = (BYTE)(nDataSize >> 24);
+		pLength[1] = (BYTE)(nDataSize >> 16);
+		pLength[2] = (BYTE)(nDataSize >> 8);
+		pLength[3] = (BYTE)nDataSize;
+		putBE32(pOutput, DXGICaptureDeflate::Crc32(0, pOutput->data() + nLengthOffset + 4, nDataSize + 4));
+	} // closeChunk
+
+	static
+	inline
+	size_t
+	openChunk(
+		_Inout_ std::vector<BYTE> *pOutput,
+		_In_ const char *pszType
+		)
+	{
+		size_t nOffset = pOutput->size();
+		putBE32(pOutput, 0);
+		pOutput->insert(pOutput->end(), (const BYTE*)pszType, (const BYTE*)pszType + 4);
+		return nOffset;
+	} // openChunk
+
+	static
+	inline
+	void
+	toRGB(
+		_In_ const BYTE *pSrc,
+		_In_ INT nWidth,
+		_Out_ BYTE *pDst
+		)
+	{
+		for (INT x = 0; x < nWidth; ++x, pSrc += 4, pDst += 3)
+		{
+			pDst[0] = pSrc[2];
+			pDst[1] = pSrc[1];
+			pDst[2] = pSrc[0];
+		}
+	} // toRGB
+
+	//
+	// PNG filtered row (filter type byte + uiSize bytes), the filter with the smallest sum of absolute values wins
+	//
+	static
+	inline
+	void
+	filterRow(
+		_In_ const BYTE *pRow,
+		_In_opt_ const BYTE *pPrev,
+		_In_ UINT uiSize,
+		_Inout_ std::vector<BYTE> &scratch,
+		_Inout_ std::vector<BYTE> *pOutput
+		)
+	{
+		const UINT BPP = 3;
+		const UINT uiFilters = (nullptr != pPrev) ? 5 : 2;
+		scratch.resize(uiSize * 5);
+
+		BYTE *pNone  = scratch.data();
+		BYTE *pSub   = pNone + uiSize;
+		BYTE *pUp    = pSub + uiSize;
+		BYTE *pAvg   = pUp + uiSize;
+		BYTE *pPaeth = pAvg + uiSize;
+
+		memcpy(pNone, pRow, uiSize);
+		for (UINT i = 0; i < uiSize; ++i) {
+			pSub[i] = (BYTE)(pRow[i] - ((i >= BPP) ? pRow[i - BPP] : 0));
+		}
+		if (nullptr != pPrev)
+		{
+			for (UINT i = 0; i < uiSize; ++i) {
+				pUp[i] = (BYTE)(pRow[i] - pPrev[i]);
+			}
+			for (UINT i = 0; i < uiSize; ++i) {
+				pAvg[i] = (BYTE)(pRow[i] - ((((i >= BPP) ? pRow[i - BPP] : 0) + pPrev[i]) >> 1));
+			}
+			for (UINT i = 0; i < uiSize; ++i)
+			{
+				INT a = (i >= BPP) ? pRow[i - BPP] : 0;
+				INT b = pPrev[i];
+				INT c = (i >= BPP) ? pPrev[i - BPP] : 0;
+				INT pa = abs(b - c);
+				INT pb = abs(a - c);
+				INT pc = abs(a + b - 2 * c);
+				INT nPredictor = ((pa <= pb) && (pa <= pc)) ? a : ((pb <= pc) ? b : c);
+				pPaeth[i] = (BYTE)(pRow[i] - nPredictor);
+			}
+		}
+
+		UINT uiBestSum = 0xFFFFFFFF;
+		UINT uiBest = 0;
+		for (UINT f = 0; f < uiFilters; ++f)
+		{
+			const signed char *pOut = (const signed char*)(scratch.data() + f * uiSize);
+			UINT uiSum = 0;
+			for (UINT i = 0; i < uiSize; ++i) {
+				uiSum += (UINT)abs((INT)pOut[i]);
+			}
+			if (uiSum < uiBestSum)
+			{
+				uiBestSum = uiSum;
+				uiBest = f;
+			}
+		}
+
+		pOutput->push_back((BYTE)uiBest);
+		const BYTE *pBest = scratch.data() + uiBest * uiSize;
+		pOutput->insert(pOutput->end(), pBest, pBest + uiSize);
+	} // filterRow
+
+	static
+	inline
+	HRESULT
+	copyOutput(
+		_In_ const std::vector<BYTE> &head,
+		_In_ const std::vector< std::vector<BYTE> > &strips,
+		_In_ const std::vector<BYTE> &tail,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize
+		)
+	{
+		UINT64 ullSize = head.size() + tail.size();
+		for (size_t i = 0; i < strips.size(); ++i) {
+			ullSize += strips[i].size();
+		}
+		if (ullSize > 0xFFFFFFFF) {
+			return E_OUTOFMEMORY;
+		}
+
+		HRESULT hr = DXGICaptureFrameBuffer::Resize(pOutput, (UINT)ullSize);
+		CHECK_HR_RETURN(hr);
+
+		BYTE *pDst = pOutput->Buffer;
+		if (!head.empty()) {
+			memcpy(pDst, head.data(), head.size());
+			pDst += head.size();
+		}
+		for (size_t i = 0; i < strips.size(); ++i)
+		{
+			if (!strips[i].empty()) {
+				memcpy(pDst, strips[i].data(), strips[i].size());
+				pDst += strips[i].size();
+			}
+		}
+		if (!tail.empty()) {
+			memcpy(pDst, tail.data(), tail.size());
+		}
+		*pRetSize = (UINT)ullSize;
+		return S_OK;
+	} // copyOutput
+
+	static
+	inline
+	HRESULT
+	encodePng(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ UINT uiThreads,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize
+		)
+	{
+		static const BYTE s_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+		const UINT uiRowSize = (UINT)nWidth * 3;
+		const UINT uiStrips = ((UINT)nHeight + DXGICAPTURE_STRIP_ROWS - 1) / DXGICAPTURE_STRIP_ROWS;
+		std::vector< std::vector<BYTE> > strips(uiStrips);
+		std::vector<UINT> adler(uiStrips);
+		std::vector<UINT64> sizes(uiStrips);
+
+		auto fn = [&](UINT uiStrip) {
+			const INT nBegin = (INT)(uiStrip * DXGICAPTURE_STRIP_ROWS);
+			const INT nEnd = ((nBegin + DXGICAPTURE_STRIP_ROWS) < nHeight) ? (nBegin + DXGICAPTURE_STRIP_ROWS) : nHeight;
+
+			std::vector<BYTE> filtered;
+			std::vector<BYTE> scratch;
+			std::vector<BYTE> row(uiRowSize);
+			std::vector<BYTE> prev(uiRowSize);
+			filtered.reserve((size_t)(uiRowSize + 1) * (nEnd - nBegin));
+			if (nBegin > 0) {
+				toRGB(pSrc + (ptrdiff_t)(nBegin - 1) * nSrcPitch, nWidth, prev.data());
+			}
+			for (INT y = nBegin; y < nEnd; ++y)
+			{
+				toRGB(pSrc + (ptrdiff_t)y * nSrcPitch, nWidth, row.data());
+				filterRow(row.data(), (y > 0) ? prev.data() : nullptr, uiRowSize, scratch, &filtered);
+				row.swap(prev);
+			}
+
+			std::vector<BYTE> &chunk = strips[uiStrip];
+			chunk.reserve(filtered.size() / 2 + 64);
+			size_t nChunk = openChunk(&chunk, "IDAT");
+			if (uiStrip == 0) {
+				chunk.push_back(0x78);
+				chunk.push_back(0x01);
+			}
+			DXGICaptureDeflate::CompressRun(filtered.data(), filtered.size(), (uiStrip + 1 == uiStrips), &chunk);
+			closeChunk(&chunk, nChunk);
+			adler[uiStrip] = DXGICaptureDeflate::Adler32(1, filtered.data(), filtered.size());
+			sizes[uiStrip] = filtered.size();
+		};
+		DXGICaptureParallel::For(uiStrips, uiThreads, fn);
+
+		std::vector<BYTE> head(s_signature, s_signature + 8);
+		size_t nChunk = openChunk(&head, "IHDR");
+		putBE32(&head, (UINT)nWidth);
+		putBE32(&head, (UINT)nHeight);
+		head.push_back(8); // bit depth
+		head.push_back(2); // truecolor
+		head.push_back(0);
+		head.push_back(0);
+		head.push_back(0);
+		closeChunk(&head, nChunk);
+
+		UINT uiAdler = 1;
+		for (UINT i = 0; i < uiStrips; ++i) {
+			uiAdler = DXGICaptureDeflate::Adler32Combine(uiAdler, adler[i], sizes[i]);
+		}
+		std::vector<BYTE> tail;
+		nChunk = openChunk(&tail, "IDAT");
+		putBE32(&tail, uiAdler);
+		closeChunk(&tail, nChunk);
+		nChunk = openChunk(&tail, "IEND");
+		closeChunk(&tail, nChunk);
+
+		return copyOutput(head, strips, tail, pOutput, pRetSize);
+	} // encodePng
+
+	static
+	inline
+	HRESULT
+	encodeJpeg(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ UINT uiThreads,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize
+		)
+	{
+		if ((nWidth > 0xFFFF) || (nHeight > 0xFFFF)) {
+			return E_INVALIDARG;
+		}
+
+		tagJpegTables tables;
+		DXGICaptureJpeg::InitTables(DXGICAPTURE_JPEG_DEFAULT_QUALITY, &tables);
+
+		const UINT uiMcuColumns = ((UINT)nWidth + 15) / 16;
+		const UINT uiMcuRows = ((UINT)nHeight + 15) / 16;
+		const UINT uiRowsPerStrip = DXGICAPTURE_STRIP_ROWS / 16;
+		const UINT uiStrips = (uiMcuRows + uiRowsPerStrip - 1) / uiRowsPerStrip;
+		std::vector< std::vector<BYTE> > strips(uiStrips);
+
+		auto fn = [&](UINT uiStrip) {
+			const UINT uiBegin = uiStrip * uiRowsPerStrip;
+			const UINT uiEnd = ((uiBegin + uiRowsPerStrip) < uiMcuRows) ? (uiBegin + uiRowsPerStrip) : uiMcuRows;
+			std::vector<BYTE> &data = strips[uiStrip];
+			data.reserve((size_t)uiMcuColumns * (uiEnd - uiBegin) * 256);
+			DXGICaptureJpeg::EncodeInterval(pSrc, nSrcPitch, nWidth, nHeight, &tables, uiBegin, uiEnd, &data);
+			if (uiStrip + 1 < uiStrips)
+			{
+				data.push_back(0xFF);
+				data.push_back((BYTE)(0xD0 + (uiStrip & 7)));
+			}
+		};
+		DXGICaptureParallel::For(uiStrips, uiThreads, fn);
+
+		std::vector<BYTE> head;
+		DXGICaptureJpeg::WriteHeaders(nWidth, nHeight, &tables, (uiStrips > 1) ? (uiMcuColumns * uiRowsPerStrip) : 0, &head);
+		std::vector<BYTE> tail;
+		tail.push_back(0xFF);
+		tail.push_back(0xD9);
+
+		return copyOutput(head, strips, tail, pOutput, pRetSize);
+	} // encodeJpeg
+
+	static
+	inline
+	HRESULT
+	encodeTiff(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ UINT uiThreads,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize
+		)
+	{
+		const UINT uiRowSize = (UINT)nWidth * 3;
+		const UINT uiStrips = ((UINT)nHeight + DXGICAPTURE_STRIP_ROWS - 1) / DXGICAPTURE_STRIP_ROWS;
+		std::vector< std::vector<BYTE> > strips(uiStrips);
+
+		auto fn = [&](UINT uiStrip) {
+			const INT nBegin = (INT)(uiStrip * DXGICAPTURE_STRIP_ROWS);
+			const INT nEnd = ((nBegin + DXGICAPTURE_STRIP_ROWS) < nHeight) ? (nBegin + DXGICAPTURE_STRIP_ROWS) : nHeight;
+
+			// horizontal differencing (predictor 2)
+			std::vector<BYTE> raw((size_t)uiRowSize * (nEnd - nBegin));
+			BYTE *pDst = raw.data();
+			for (INT y = nBegin; y < nEnd; ++y, pDst += uiRowSize)
+			{
+				toRGB(pSrc + (ptrdiff_t)y * nSrcPitch, nWidth, pDst);
+				for (UINT i = uiRowSize - 1; i >= 3; --i) {
+					pDst[i] = (BYTE)(pDst[i] - pDst[i - 3]);
+				}
+			}
+
+			strips[uiStrip].reserve(raw.size() / 2 + 64);
+			DXGICaptureDeflate::Compress(raw.data(), raw.size(), &strips[uiStrip]);
+		};
+		DXGICaptureParallel::For(uiStrips, uiThreads, fn);
+
+		// header, IFD, out of line values, strips
+		const UINT TAG_COUNT = 14;
+		const UINT uiIfdSize = 2 + TAG_COUNT * 12 + 4;
+		const UINT uiBitsOffset = 8 + uiIfdSize;
+		const UINT uiXResOffset = uiBitsOffset + 6;
+		const UINT uiYResOffset = uiXResOffset + 8;
+		const UINT uiOffsetsOffset = uiYResOffset + 8;
+		const UINT uiCountsOffset = uiOffsetsOffset + uiStrips * 4;
+		const UINT uiDataOffset = uiCountsOffset + uiStrips * 4;
+
+		std::vector<BYTE> head;
+		head.reserve(uiDataOffset);
+		head.push_back('I');
+		head.push_back('I');
+		putLE16(&head, 42);
+		putLE32(&head, 8);
+
+		putLE16(&head, TAG_COUNT);
+		auto putTag = [&](UINT uiTag, UINT uiType, UINT uiCount, UINT uiValue) {
+			putLE16(&head, uiTag);
+			putLE16(&head, uiType);
+			putLE32(&head, uiCount);
+			if ((uiType == 3) && (uiCount == 1))
+			{
+				putLE16(&head, uiValue);
+				putLE16(&head, 0);
+			}
+			else {
+				putLE32(&head, uiValue);
+			}
+		};
+		const UINT SHORT_TYPE = 3;
+		const UINT LONG_TYPE = 4;
+		const UINT RATIONAL_TYPE = 5;
+		putTag(256, LONG_TYPE, 1, (UINT)nWidth);
+		putTag(257, LONG_TYPE, 1, (UINT)nHeight);
+		putTag(258, SHORT_TYPE, 3, uiBitsOffset);
+		putTag(259, SHORT_TYPE, 1, 8);                              // Adobe deflate
+		putTag(262, SHORT_TYPE, 1, 2);                              // RGB
+		putTag(273, LONG_TYPE, uiStrips, (uiStrips == 1) ? uiDataOffset : uiOffsetsOffset);
+		putTag(277, SHORT_TYPE, 1, 3);
+		putTag(278, LONG_TYPE, 1, DXGICAPTURE_STRIP_ROWS);
+		putTag(279, LONG_TYPE, uiStrips, (uiStrips == 1) ? (UINT)strips[0].size() : uiCountsOffset);
+		putTag(282, RATIONAL_TYPE, 1, uiXResOffset);
+		putTag(283, RATIONAL_TYPE, 1, uiYResOffset);
+		putTag(284, SHORT_TYPE, 1, 1);                              // chunky
+		putTag(296, SHORT_TYPE, 1, 2);                              // inch
+		putTag(317, SHORT_TYPE, 1, 2);                              // horizontal differencing
+		putLE32(&head, 0);
+
+		putLE16(&head, 8);
+		putLE16(&head, 8);
+		putLE16(&head, 8);
+		putLE32(&head, 96);
+		putLE32(&head, 1);
+		putLE32(&head, 96);
+		putLE32(&head, 1);
+
+		UINT64 ullOffset = uiDataOffset;
+		for (UINT i = 0; i < uiStrips; ++i)
+		{
+			putLE32(&head, (UINT)ullOffset);
+			ullOffset += strips[i].size();
+		}
+		if (ullOffset > 0xFFFFFFFF) {
+			return E_OUTOFMEMORY;
+		}
+		for (UINT i = 0; i < uiStrips; ++i) {
+			putLE32(&head, (UINT)strips[i].size());
+		}
+
+		return copyOutput(head, strips, std::vector<BYTE>(), pOutput, pRetSize);
+	} // encodeTiff
+
+public:
+	//
+	// Encodes the 32bpp BGRA buffer to pOutput on up to uiThreads threads (0: all hardware threads).
+	// The output is identical for every thread count.
+	//
+	static
+	inline
+	HRESULT
+	Encode(
+		_In_ tagStripImageFormat format,
+		_In_reads_bytes_(nSrcPitch * nHeight) const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ UINT uiThreads,
+		_Inout_ tagFrameBufferInfo *pOutput,
+		_Out_ UINT *pRetSize
+		)
+	{
+		CHECK_POINTER(pRetSize);
+		*pRetSize = 0;
+		CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+		CHECK_POINTER_EX(pOutput, E_INVALIDARG);
+		if ((nWidth <= 0) || (nHeight <= 0) || (nSrcPitch < nWidth * 4)) {
+			return E_INVALIDARG;
+		}
+
+		try
+		{
+			switch (format)
+			{
+			case tagStripImageFormat_Png:
+				return encodePng(pSrc, nSrcPitch, nWidth, nHeight, uiThreads, pOutput, pRetSize);
+			case tagStripImageFormat_Jpeg:
+				return encodeJpeg(pSrc, nSrcPitch, nWidth, nHeight, uiThreads, pOutput, pRetSize);
+			case tagStripImageFormat_Tiff:
+				return encodeTiff(pSrc, nSrcPitch, nWidth, nHeight, uiThreads, pOutput, pRetSize);
+			}
+		}
+		catch (const std::bad_alloc&)
+		{
+			return E_OUTOFMEMORY;
+		}
+		return E_INVALIDARG;
+	} // Encode
+
+}; // end class DXGICaptureStripEncoder
+
+#endif // __DXGICAPTURESTRIPENCODER_H__
@@ -0,0 +1,503 @@
+/*****************************************************************************
+* DXGICaptureSyntheticSource.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURESYNTHETICSOURCE_H__
+#define __DXGICAPTURESYNTHETICSOURCE_H__
+
+#include "DXGICaptureSource.h"
+#include "DXGICaptureCursorCache.h"
+#include "DXGICaptureFrameBuffer.h"
+
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//
+// enum tagSyntheticWorkload_e
+//
+typedef enum tagSyntheticWorkload_e : UINT
+{
+	tagSyntheticWorkload_Static = 0x0, /* only the pointer moves */
+	tagSyntheticWorkload_Typing = 0x1, /* small glyph rects along text lines */
+	tagSyntheticWorkload_Scroll = 0x2, /* the image scrolls up: one move rect + the new strip */
+	tagSyntheticWorkload_Video  = 0x3, /* a centered rect is redrawn every frame */
+} tagSyntheticWorkload;
+
+//
+// struct tagSyntheticSourceConfig_s
+//
+typedef struct tagSyntheticSourceConfig_s
+{
+	INT                     Width;           /* desktop image size */
+	INT                     Height;
+	INT                     RotationDegrees; /* display rotation: 0, 90, 180, 270 */
+	tagSyntheticWorkload    Workload;
+	INT                     ChangePercent;   /* changed area per frame, percent of the image (1..100) */
+	INT                     FrameRate;       /* timestamps advance by 1/FrameRate seconds */
+	UINT                    Seed;
+	INT                     ShowPointer;
+	INT                     PointerShapeInterval; /* frames between pointer shape changes, 0: never */
+	INT                     Paced;           /* frames are delivered at FrameRate in real time (AcquireFrame waits) */
+} tagSyntheticSourceConfig;
+
+#define DXGICAPTURE_SYNTHETIC_POINTER_SIZE  32
+#define DXGICAPTURE_SYNTHETIC_GLYPH_WIDTH   16
+#define DXGICAPTURE_SYNTHETIC_GLYPH_HEIGHT  24
+
+//
+// class CDXGISyntheticSource
+//
+// Capture source without any display: generates deterministic desktop images
+// (same config and seed, same frames), their move/dirty rects and a moving
+// pointer that cycles through color, monochrome and masked color shapes.
+// Frames are delivered without waiting and the timestamps are virtual, unless
+// the source is Paced: then AcquireFrame waits for the time of the frame.
+//
+class CDXGISyntheticSource : public IDXGICaptureSource
+{
+private:
+	tagSyntheticSourceConfig        m_config;
+	tagCaptureSourceDesc            m_desc;
+	tagFrameBufferInfo              m_image;
+	INT                             m_nPitch;
+	UINT64                          m_ullFrameNumber;
+	UINT                            m_uiRandom;
+	BOOL                            m_bAcquired;
+	std::chrono::steady_clock::time_point m_startTick;
+
+	// typing: position of the next glyph
+	INT                             m_nTextX;
+	INT                             m_nTextY;
+
+	std::vector<tagFrameMoveRect>   m_moveRects;
+	std::vector<tagFrameRect>       m_dirtyRects;
+
+	// pointer shapes: color, monochrome, masked color
+	std::vector<BYTE>               m_shapes[3];
+	tagCapturePointer               m_shapeInfo[3];
+	tagCapturePointer               m_pointer;
+
+	// disable copy
+	CDXGISyntheticSource(const CDXGISyntheticSource&);
+	CDXGISyntheticSource& operator=(const CDXGISyntheticSource&);
+
+	inline UINT nextRandom()
+	{
+		// xorshift32
+		UINT x = m_uiRandom;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		m_uiRandom = x;
+		return x;
+	}
+
+	//
+	// Fills the rect with a deterministic noise pattern of the seed
+	//
+	inline void fillRect(_In_ const tagFrameRect &rc, _In_ UINT uiSeed)
+	{
+		UINT uiBase = uiSeed * 0x9E3779B1u;
+		for (LONG y = rc.Top; y < rc.Bottom; ++y)
+		{
+			UINT *pRow = (UINT*)(m_image.Buffer + (size_t)y * m_nPitch);
+			UINT uiRow = uiBase ^ ((UINT)y * 0x85EBCA6Bu);
+			for (LONG x = rc.Left; x < rc.Right; ++x)
+			{
+				UINT v = uiRow + (UINT)x * 0xC2B2AE35u;
+				v ^= v >> 15;
+				pRow[x] = 0xFF000000u | (v & 0x00FFFFFFu);
+			}
+		}
+	}
+
+	inline void addDirtyRect(_In_ LONG left, _In_ LONG top, _In_ LONG right, _In_ LONG bottom)
+	{
+		tagFrameRect rc = { left, top, right, bottom };
+		if (DXGICaptureDirtyRects::ClipRect(&rc, m_config.Width, m_config.Height)) {
+			m_dirtyRects.push_back(rc);
+		}
+	}
+
+	inline void updateTyping(_In_ INT64 llArea)
+	{
+		const INT gw = DXGICAPTURE_SYNTHETIC_GLYPH_WIDTH;
+		const INT gh = DXGICAPTURE_SYNTHETIC_GLYPH_HEIGHT;
+		INT64 llGlyphs = llArea / (gw * gh);
+		if (llGlyphs < 1) {
+			llGlyphs = 1;
+		}
+
+		for (INT64 i = 0; i < llGlyphs; ++i)
+		{
+			if (m_nTextX + gw > m_config.Width)
+			{
+				m_nTextX = 0;
+				m_nTextY += gh;
+			}
+			if (m_nTextY + gh > m_config.Height) {
+				m_nTextY = 0;
+			}
+
+			tagFrameRect rc = { m_nTextX, m_nTextY, m_nTextX + gw, m_nTextY + gh };
+			if (DXGICaptureDirtyRects::ClipRect(&rc, m_config.Width, m_config.Height))
+			{
+				fillRect(rc, nextRandom());
+				// consecutive glyphs of a line are reported as one rect
+				if (!m_dirtyRects.empty() && (m_dirtyRects.back().Right == rc.Left) && (m_dirtyRects.back().Top == rc.Top)) {
+					m_dirtyRects.back().Right = rc.Right;
+				}
+				else {
+					m_dirtyRects.push_back(rc);
+				}
+			}
+			m_nTextX += gw;
+		}
+	}
+
+	inline void updateScroll(_In_ INT64 llArea)
+	{
+		INT nRows = (INT)(llArea / m_config.Width);
+		if (nRows < 1) {
+			nRows = 1;
+		}
+		if (nRows >= m_config.Height)
+		{
+			// everything is new
+			addDirtyRect(0, 0, m_config.Width, m_config.Height);
+			fillRect(m_dirtyRects.back(), nextRandom());
+			return;
+		}
+
+		memmove(m_image.Buffer, m_image.Buffer + (size_t)nRows * m_nPitch, (size_t)(m_config.Height - nRows) * m_nPitch);
+
+		tagFrameMoveRect move;
+		move.SrcX       = 0;
+		move.SrcY       = nRows;
+		move.Dst.Left   = 0;
+		move.Dst.Top    = 0;
+		move.Dst.Right  = m_config.Width;
+		move.Dst.Bottom = m_config.Height - nRows;
+		m_moveRects.push_back(move);
+
+		addDirtyRect(0, m_config.Height - nRows, m_config.Width, m_config.Height);
+		fillRect(m_dirtyRects.back(), nextRandom());
+	}
+
+	inline void updateVideo(_In_ INT64 llArea)
+	{
+		// same aspect as the image
+		double dScale = (double)llArea / ((INT64)m_config.Width * m_config.Height);
+		INT w = m_config.Width, h = m_config.Height;
+		if (dScale < 1.0)
+		{
+			double dSide = sqrt(dScale);
+			w = (INT)(m_config.Width * dSide);
+			h = (INT)(m_config.Height * dSide);
+			if (w < 1) { w = 1; }
+			if (h < 1) { h = 1; }
+		}
+
+		INT x = (m_config.Width - w) >> 1;
+		INT y = (m_config.Height - h) >> 1;
+		addDirtyRect(x, y, x + w, y + h);
+		fillRect(m_dirtyRects.back(), nextRandom());
+	}
+
+	inline void updatePointer()
+	{
+		if (!m_config.ShowPointer) {
+			return;
+		}
+
+		UINT uiShape = 0;
+		if (m_config.PointerShapeInterval > 0) {
+			uiShape = (UINT)((m_ullFrameNumber / (UINT64)m_config.PointerShapeInterval) % 3);
+		}
+		m_pointer = m_shapeInfo[uiShape];
+
+		// deterministic path over the desktop, partially off screen at the edges
+		const INT nPeriodX = 240, nPeriodY = 170;
+		INT fx = (INT)(m_ullFrameNumber % (UINT64)(2 * nPeriodX));
+		INT fy = (INT)(m_ullFrameNumber % (UINT64)(2 * nPeriodY));
+		if (fx >= nPeriodX) { fx = 2 * nPeriodX - fx; }
+		if (fy >= nPeriodY) { fy = 2 * nPeriodY - fy; }
+		INT nRangeX = m_desc.DesktopWidth + DXGICAPTURE_SYNTHETIC_POINTER_SIZE;
+		INT nRangeY = m_desc.DesktopHeight + DXGICAPTURE_SYNTHETIC_POINTER_SIZE;
+		m_pointer.X = (LONG)((INT64)nRangeX * fx / nPeriodX) - (DXGICAPTURE_SYNTHETIC_POINTER_SIZE / 2);
+		m_pointer.Y = (LONG)((INT64)nRangeY * fy / nPeriodY) - (DXGICAPTURE_SYNTHETIC_POINTER_SIZE / 2);
+		m_pointer.Visible = TRUE;
+	}
+
+	//
+	// 32x32 arrow shapes of all three pointer types
+	//
+	inline void createPointerShapes()
+	{
+		const INT n = DXGICAPTURE_SYNTHETIC_POINTER_SIZE;
+
+		for (INT i = 0; i < 3; ++i) {
+			memset(&m_shapeInfo[i], 0, sizeof(m_shapeInfo[i]));
+		}
+
+		// color: opaque arrow with a soft edge
+		m_shapes[0].assign((size_t)n * n * 4, 0);
+		for (INT y = 0; y < n; ++y)
+		{
+			for (INT x = 0; x < n; ++x)
+			{
+				UINT *p = (UINT*)(&m_shapes[0][0] + ((size_t)y * n + x) * 4);
+				if (x <= y / 2) {
+					*p = 0xFF000000u | ((UINT)(y * 8) << 8) | (UINT)(x * 8);
+				}
+				else if (x == y / 2 + 1) {
+					*p = 0x80000000u;
+				}
+			}
+		}
+
+		// monochrome: AND mask then XOR mask, 1 bpp
+		INT nMonoPitch = n / 8;
+		m_shapes[1].assign((size_t)nMonoPitch * n * 2, 0);
+		for (INT y = 0; y < n; ++y)
+		{
+			for (INT x = 0; x < n; ++x)
+			{
+				BYTE bit = (BYTE)(0x80 >> (x & 7));
+				BYTE *pAnd = &m_shapes[1][0] + (size_t)y * nMonoPitch + (x >> 3);
+				BYTE *pXor = &m_shapes[1][0] + (size_t)(y + n) * nMonoPitch + (x >> 3);
+				if (x > y / 2) {
+					*pAnd |= bit;       // transparent
+				}
+				else if ((x == 0) || (x == y / 2) || (y == n - 1)) {
+					*pXor |= bit;       // white outline, black fill
+				}
+				if ((x > y / 2) && (x < y / 2 + 3) && (y > n / 2)) {
+					*pXor |= bit;       // inverted tail
+				}
+			}
+		}
+
+		// masked color: replace the arrow, xor the band next to it
+		m_shapes[2].assign((size_t)n * n * 4, 0);
+		for (INT y = 0; y < n; ++y)
+		{
+			for (INT x = 0; x < n; ++x)
+			{
+				UINT *p = (UINT*)(&m_shapes[2][0] + ((size_t)y * n + x) * 4);
+				if (x <= y / 2) {
+					*p = 0x00FFFFFFu & (0x00204080u + (UINT)(x + y));
+				}
+				else if (x < y / 2 + 4) {
+					*p = 0xFF00FFFFu;
+				}
+			}
+		}
+
+		static const UINT s_type[3] = {
+			DXGICAPTURE_POINTER_SHAPE_TYPE_COLOR,
+			DXGICAPTURE_POINTER_SHAPE_TYPE_MONOCHROME,
+			DXGICAPTURE_POINTER_SHAPE_TYPE_MASKED_COLOR
+		};
+		for (INT i = 0; i < 3; ++i)
+		{
+			m_shapeInfo[i].Type      = s_type[i];
+			m_shapeInfo[i].Width     = n;
+			m_shapeInfo[i].Height    = (i == 1) ? (UINT)(n * 2) : (UINT)n;
+			m_shapeInfo[i].Pitch     = (i == 1) ? (UINT)nMonoPitch : (UINT)(n * 4);
+			m_shapeInfo[i].ShapeSize = (UINT)m_shapes[i].size();
+			m_shapeInfo[i].Shape     = &m_shapes[i][0];
+			m_shapeInfo[i].ShapeHash = CDXGICursorCache::HashBytes(m_shapeInfo[i].Shape, m_shapeInfo[i].ShapeSize, 0);
+		}
+	}
+
+public:
+	CDXGISyntheticSource()
+		: m_nPitch(0)
+		, m_ullFrameNumber(0)
+		, m_uiRandom(1)
+		, m_bAcquired(FALSE)
+		, m_nTextX(0)
+		, m_nTextY(0)
+	{
+		memset(&m_config, 0, sizeof(m_config));
+		memset(&m_image, 0, sizeof(m_image));
+		memset(&m_desc, 0, sizeof(m_desc));
+		memset(&m_shapeInfo, 0, sizeof(m_shapeInfo));
+		memset(&m_pointer, 0, sizeof(m_pointer));
+	}
+
+	virtual ~CDXGISyntheticSource()
+	{
+		DXGICaptureFrameBuffer::Free(&m_image);
+	}
+
+	inline
+	HRESULT
+	Initialize(
+		_In_ const tagSyntheticSourceConfig *pConfig
+		)
+	{
+		CHECK_POINTER_EX(pConfig, E_INVALIDARG);
+		if ((pConfig->Width <= 0) || (pConfig->Height <= 0) ||
+			(pConfig->ChangePercent < 0) || (pConfig->ChangePercent > 100) ||
+			(pConfig->FrameRate <= 0) || ((pConfig->RotationDegrees % 90) != 0))
+		{
+			return E_INVALIDARG;
+		}
+
+		m_config = *pConfig;
+		m_config.RotationDegrees = ((m_config.RotationDegrees % 360) + 360) % 360;
+
+		m_desc.Width           = m_config.Width;
+		m_desc.Height          = m_config.Height;
+		m_desc.RotationDegrees = m_config.RotationDegrees;
+		if ((m_desc.RotationDegrees == 90) || (m_desc.RotationDegrees == 270))
+		{
+			m_desc.DesktopWidth  = m_config.Height;
+			m_desc.DesktopHeight = m_config.Width;
+		}
+		else
+		{
+			m_desc.DesktopWidth  = m_config.Width;
+			m_desc.DesktopHeight = m_config.Height;
+		}
+
+		m_nPitch = m_config.Width * 4;
+		HRESULT hr = DXGICaptureFrameBuffer::Resize(&m_image, (UINT)(m_nPitch * m_config.Height));
+		CHECK_HR_RETURN(hr);
+		m_image.BytesPerPixel = 4;
+		m_image.Pitch         = m_nPitch;
+		m_image.Bounds.Width  = m_config.Width;
+		m_image.Bounds.Height = m_config.Height;
+
+		m_ullFrameNumber = 0;
+		m_uiRandom       = (m_config.Seed != 0) ? m_config.Seed : 0x2545F491u;
+		m_bAcquired      = FALSE;
+		m_nTextX         = 0;
+		m_nTextY         = 0;
+		m_moveRects.clear();
+		m_dirtyRects.clear();
+
+		// the desktop background
+		tagFrameRect rc = { 0, 0, m_config.Width, m_config.Height };
+		fillRect(rc, m_uiRandom);
+
+		createPointerShapes();
+		memset(&m_pointer, 0, sizeof(m_pointer));
+		return S_OK;
+	}
+
+	inline const BYTE* GetImage() const { return m_image.Buffer; }
+	inline INT GetPitch() const { return m_nPitch; }
+
+	// IDXGICaptureSource
+	virtual HRESULT GetDesc(_Out_ tagCaptureSourceDesc *pDesc)
+	{
+		CHECK_POINTER(pDesc);
+		*pDesc = m_desc;
+		return S_OK;
+	}
+
+	virtual HRESULT AcquireFrame(_In_ UINT uiTimeoutMsec, _Out_ tagCaptureSourceFrame *pFrame)
+	{
+		CHECK_POINTER(pFrame);
+		memset(pFrame, 0, sizeof(*pFrame));
+		if ((nullptr == m_image.Buffer) || m_bAcquired) {
+			return E_UNEXPECTED;
+		}
+
+		if (m_config.Paced)
+		{
+			// the clock starts with the first frame
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (m_ullFrameNumber == 0) {
+				m_startTick = now;
+			}
+			std::chrono::steady_clock::time_point due = m_startTick +
+				std::chrono::microseconds((INT64)(m_ullFrameNumber * 1000000ULL / (UINT64)m_config.FrameRate));
+			if (due > now)
+			{
+				if (due - now > std::chrono::milliseconds(uiTimeoutMsec))
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(uiTimeoutMsec));
+					return S_FALSE;
+				}
+				std::this_thread::sleep_until(due);
+			}
+		}
+
+		m_moveRects.clear();
+		m_dirtyRects.clear();
+
+		// the first frame is the whole desktop
+		if (m_ullFrameNumber > 0)
+		{
+			INT64 llArea = (INT64)m_config.Width * m_config.Height * m_config.ChangePercent / 100;
+			if ((llArea > 0) && (m_config.Workload != tagSyntheticWorkload_Static))
+			{
+				switch (m_config.Workload)
+				{
+				case tagSyntheticWorkload_Typing:
+					updateTyping(llArea);
+					break;
+				case tagSyntheticWorkload_Scroll:
+					updateScroll(llArea);
+					break;
+				default:
+					updateVideo(llArea);
+					break;
+				}
+			}
+		}
+		else
+		{
+			addDirtyRect(0, 0, m_config.Width, m_config.Height);
+		}
+
+		updatePointer();
+
+		pFrame->Data           = m_image.Buffer;
+		pFrame->Pitch          = m_nPitch;
+		pFrame->FrameNumber    = m_ullFrameNumber;
+		pFrame->Timestamp      = (INT64)(m_ullFrameNumber * 1000000ULL / (UINT64)m_config.FrameRate);
+		pFrame->AccumulatedFrames = 1;
+		pFrame->MoveRects      = m_moveRects.empty() ? nullptr : &m_moveRects[0];
+		pFrame->MoveRectCount  = (UINT)m_moveRects.size();
+		pFrame->DirtyRects     = m_dirtyRects.empty() ? nullptr : &m_dirtyRects[0];
+		pFrame->DirtyRectCount = (UINT)m_dirtyRects.size();
+		pFrame->Pointer        = m_config.ShowPointer ? &m_pointer : nullptr;
+
+		m_ullFrameNumber++;
+		m_bAcquired = TRUE;
+		return S_OK;
+	}
+
+	virtual HRESULT ReleaseFrame()
+	{
+		if (!m_bAcquired) {
+			return E_UNEXPECTED;
+		}
+		m_bAcquired = FALSE;
+		return S_OK;
+	}
+
+}; // end class CDXGISyntheticSource
+
+#endif // __DXGICAPTURESYNTHETICSOURCE_H__
@@ -0,0 +1,694 @@
+/*****************************************************************************
+* DXGICaptureTileHash.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTURETILEHASH_H__
+#define __DXGICAPTURETILEHASH_H__
+
+#include "DXGICaptureTypes.h"
+
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#define DXGICAPTURE_TILE_SIZE               64
+#define DXGICAPTURE_TILE_HASH_STRIPES       (DXGICAPTURE_TILE_SIZE / 8) /* 8 pixels (32 bytes) per stripe */
+
+//
+// struct tagTileHashStats_s
+//
+typedef struct tagTileHashStats_s
+{
+	UINT64 Frames;
+	UINT64 UnchangedFrames;     /* no tile changed */
+	UINT64 TilesHashed;
+	UINT64 TilesChanged;
+	UINT64 BytesHashed;
+	INT64  HashUsec;
+} tagTileHashStats;
+
+//
+// struct tagTileChangeInfo_s
+//
+typedef struct tagTileChangeInfo_s
+{
+	UINT   TileSize;
+	UINT   TilesX;
+	UINT   TilesY;
+	UINT   ChangedTiles;
+	UINT   BitmapWords;         /* UINT64 words of the changed tile bitmap */
+	UINT64 FrameHash;
+} tagTileChangeInfo;
+
+//
+// class DXGICaptureTileHash
+//
+// 64 bit hash of a 32bpp tile of up to 64x64 pixels. Every tile row is
+// consumed in stripes of 32 bytes by four 64 bit accumulators (multiply of
+// the keyed 32 bit halves, the plain input goes into the neighbour lane),
+// the accumulators are scrambled after every row. An image row is hashed
+// across all tiles it crosses, so a band of tiles is read in memory order.
+// The SIMD variants compute the same value as the scalar code; a partial
+// last stripe is zero padded.
+//
+class DXGICaptureTileHash
+{
+private:
+	enum
+	{
+		PRIME32 = 0x9E3779B1U
+	};
+
+	static
+	inline
+	const UINT64*
+	getKeys()
+	{
+		// 4 lanes per stripe, then the row scramble keys
+		static const UINT64 s_keys[DXGICAPTURE_TILE_HASH_STRIPES * 4 + 4] =
+		{
+			0x2CB0F69F4ABEA221ULL, 0x9417034723148989ULL, 0xDD555950609DFE03ULL, 0xDBAFB150DEB12800ULL,
+			0x7E789B2E6C442CB6ULL, 0xF41E5636C7E4F8C4ULL, 0x0959D150F8FBA7E4ULL, 0xA97316F13CDB9EEAULL,
+			0x74CD8258F9520068ULL, 0x55C74A62E116868BULL, 0xD2F4C799A2023CBDULL, 0xDF98CB79A37B51B9ULL,
+			0x396F5885524F3905ULL, 0xAF1D56386CA3B276ULL, 0xA9FFBE6B5104E85AULL, 0x6BD0C51B9FD533B3ULL,
+			0x980CE91C50AB4B56ULL, 0x28AC395780FE62C5ULL, 0x768912E3A6BCEDC7ULL, 0x50B3E8C9332C7C88ULL,
+			0xCE3BBFE520BD47DAULL, 0xCBA6C8E8E0BB7C4FULL, 0xBF194DB8434A346DULL, 0x7D8F2A7B60416D7FULL,
+			0x0849D1F6E0E10A5EULL, 0x7654B590D064E22FULL, 0x16D1DA9507DF3AF2ULL, 0xF63AEF1089EA30E4ULL,
+			0x9ADE6673CC6C522BULL, 0x4C75BC274E37087CULL, 0xD35E12B49F51F27BULL, 0x22DDF2FFCEE481EAULL,
+			0x06007FB13C59A1F1ULL, 0x8966A38C651EA4DAULL, 0x25242F018FC01AC6ULL, 0xA73EC74FA31B717CULL,
+		};
+		return s_keys;
+	}
+
+	static
+	inline
+	UINT64
+	rotl64(
+		_In_ UINT64 v,
+		_In_ UINT r
+		)
+	{
+		return (v << r) | (v >> (64 - r));
+	}
+
+	//
+	// Copies the last (nPixels < 8) pixels of a tile row into a zero padded stripe
+	//
+	static
+	inline
+	void
+	padStripe(
+		_In_ const BYTE *pRow,
+		_In_ INT nPixels,
+		_Out_writes_bytes_(32) BYTE *pStripe
+		)
+	{
+		memset(pStripe, 0, 32);
+		memcpy(pStripe, pRow, (size_t)nPixels * 4);
+	}
+
+	static
+	inline
+	void
+	accumulateScalar(
+		_Inout_ UINT64 *pAcc,
+		_In_reads_bytes_(32) const BYTE *pStripe,
+		_In_ const UINT64 *pKey
+		)
+	{
+		for (INT i = 0; i < 4; ++i)
+		{
+			UINT64 d;
+			memcpy(&d, pStripe + i * 8, 8);
+			UINT64 dk = d ^ pKey[i];
+			pAcc[i ^ 1] += d;
+			pAcc[i] += (dk & 0xFFFFFFFFULL) * (dk >> 32);
+		}
+	}
+
+public:
+	//
+	// Sets the 4 accumulators of uiTiles tiles to the start value
+	//
+	static
+	inline
+	void
+	InitAccumulators(
+		_Out_ UINT64 *pAcc,
+		_In_ UINT uiTiles
+		)
+	{
+		for (UINT t = 0; t < uiTiles; ++t, pAcc += 4)
+		{
+			pAcc[0] = 0x9E3779B185EBCA87ULL;
+			pAcc[1] = 0xC2B2AE3D27D4EB4FULL;
+			pAcc[2] = 0x165667B19E3779F9ULL;
+			pAcc[3] = 0x85EBCA77C2B2AE63ULL;
+		}
+	} // InitAccumulators
+
+	//
+	// Hash of a tile from its accumulators and its size
+	//
+	static
+	inline
+	UINT64
+	Finalize(
+		_In_ const UINT64 *pAcc,
+		_In_ INT nWidth,
+		_In_ INT nHeight
+		)
+	{
+		const UINT64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+		const UINT64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+		const UINT64 PRIME64_3 = 0x165667B19E3779F9ULL;
+		const UINT64 PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+
+		UINT64 h = ((UINT64)(UINT)nWidth << 32) ^ (UINT64)(UINT)nHeight ^ PRIME64_3;
+		for (INT i = 0; i < 4; ++i)
+		{
+			h ^= rotl64(pAcc[i] * PRIME64_2, 31) * PRIME64_1;
+			h = h * PRIME64_1 + PRIME64_4;
+		}
+
+		// avalanche
+		h ^= h >> 33;
+		h *= PRIME64_2;
+		h ^= h >> 29;
+		h *= PRIME64_3;
+		h ^= h >> 32;
+		return h;
+	} // Finalize
+
+	//
+	// Adds an image row of nWidth pixels to the accumulators of the tiles it
+	// crosses (4 per tile)
+	//
+	static
+	inline
+	void
+	AccumulateRowScalar(
+		_In_ const BYTE *pRow,
+		_In_ INT nWidth,
+		_Inout_ UINT64 *pAcc
+		)
+	{
+		const UINT64 *pKeys = getKeys();
+		const UINT64 *pScramble = pKeys + DXGICAPTURE_TILE_HASH_STRIPES * 4;
+
+		BYTE stripe[32];
+		for (INT x = 0; x < nWidth; x += DXGICAPTURE_TILE_SIZE, pAcc += 4)
+		{
+			const BYTE *pTile = pRow + (size_t)x * 4;
+			const INT w = (nWidth - x < DXGICAPTURE_TILE_SIZE) ? (nWidth - x) : DXGICAPTURE_TILE_SIZE;
+			const INT nStripes = w / 8;
+			const INT nTail = w % 8;
+
+			for (INT s = 0; s < nStripes; ++s) {
+				accumulateScalar(pAcc, pTile + s * 32, pKeys + s * 4);
+			}
+			if (nTail > 0)
+			{
+				padStripe(pTile + nStripes * 32, nTail, stripe);
+				accumulateScalar(pAcc, stripe, pKeys + nStripes * 4);
+			}
+
+			// scramble
+			for (INT i = 0; i < 4; ++i)
+			{
+				UINT64 a = pAcc[i];
+				a ^= a >> 47;
+				a ^= pScramble[i];
+				pAcc[i] = a * PRIME32;
+			}
+		}
+	} // AccumulateRowScalar
+
+#if defined(DXGICAPTURE_HAVE_X86)
+	//
+	// 2 lanes per register
+	//
+	static
+	inline
+	void
+	AccumulateRowSSE2(
+		_In_ const BYTE *pRow,
+		_In_ INT nWidth,
+		_Inout_ UINT64 *pAcc
+		)
+	{
+		const UINT64 *pKeys = getKeys();
+		const __m128i prime = _mm_set1_epi32((int)PRIME32);
+		const __m128i scramble0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pKeys + DXGICAPTURE_TILE_HASH_STRIPES * 4));
+		const __m128i scramble1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pKeys + DXGICAPTURE_TILE_HASH_STRIPES * 4 + 2));
+
+#define DXGICAPTURE_TILE_HASH_SSE2_STRIPE(p, k) \
+		{ \
+			__m128i d0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); \
+			__m128i d1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p) + 1); \
+			__m128i dk0 = _mm_xor_si128(d0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(k))); \
+			__m128i dk1 = _mm_xor_si128(d1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(k) + 1)); \
+			acc0 = _mm_add_epi64(acc0, _mm_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))); \
+			acc1 = _mm_add_epi64(acc1, _mm_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))); \
+			acc0 = _mm_add_epi64(acc0, _mm_mul_epu32(dk0, _mm_srli_epi64(dk0, 32))); \
+			acc1 = _mm_add_epi64(acc1, _mm_mul_epu32(dk1, _mm_srli_epi64(dk1, 32))); \
+		}
+
+		BYTE stripe[32];
+		for (INT x = 0; x < nWidth; x += DXGICAPTURE_TILE_SIZE, pAcc += 4)
+		{
+			const BYTE *pTile = pRow + (size_t)x * 4;
+			const INT w = (nWidth - x < DXGICAPTURE_TILE_SIZE) ? (nWidth - x) : DXGICAPTURE_TILE_SIZE;
+			const INT nStripes = w / 8;
+			const INT nTail = w % 8;
+
+			__m128i acc0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAcc));
+			__m128i acc1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pAcc + 2));
+			for (INT s = 0; s < nStripes; ++s) {
+				DXGICAPTURE_TILE_HASH_SSE2_STRIPE(pTile + s * 32, pKeys + s * 4);
+			}
+			if (nTail > 0)
+			{
+				padStripe(pTile + nStripes * 32, nTail, stripe);
+				DXGICAPTURE_TILE_HASH_SSE2_STRIPE(stripe, pKeys + nStripes * 4);
+			}
+
+			// scramble, 64x32 bit multiply from two 32x32 bit multiplies
+			acc0 = _mm_xor_si128(_mm_xor_si128(acc0, _mm_srli_epi64(acc0, 47)), scramble0);
+			acc1 = _mm_xor_si128(_mm_xor_si128(acc1, _mm_srli_epi64(acc1, 47)), scramble1);
+			acc0 = _mm_add_epi64(_mm_mul_epu32(acc0, prime), _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(acc0, 32), prime), 32));
+			acc1 = _mm_add_epi64(_mm_mul_epu32(acc1, prime), _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(acc1, 32), prime), 32));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pAcc), acc0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pAcc + 2), acc1);
+		}
+
+#undef DXGICAPTURE_TILE_HASH_SSE2_STRIPE
+	} // AccumulateRowSSE2
+
+	//
+	// 4 lanes per register, one stripe per step
+	//
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	void
+	AccumulateRowAVX2(
+		_In_ const BYTE *pRow,
+		_In_ INT nWidth,
+		_Inout_ UINT64 *pAcc
+		)
+	{
+		const UINT64 *pKeys = getKeys();
+		const __m256i prime = _mm256_set1_epi32((int)PRIME32);
+		const __m256i scramble = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pKeys + DXGICAPTURE_TILE_HASH_STRIPES * 4));
+
+#define DXGICAPTURE_TILE_HASH_AVX2_STRIPE(p, k) \
+		{ \
+			__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); \
+			__m256i dk = _mm256_xor_si256(d, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(k))); \
+			acc = _mm256_add_epi64(acc, _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2))); \
+			acc = _mm256_add_epi64(acc, _mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32))); \
+		}
+
+		BYTE stripe[32];
+		for (INT x = 0; x < nWidth; x += DXGICAPTURE_TILE_SIZE, pAcc += 4)
+		{
+			const BYTE *pTile = pRow + (size_t)x * 4;
+			const INT w = (nWidth - x < DXGICAPTURE_TILE_SIZE) ? (nWidth - x) : DXGICAPTURE_TILE_SIZE;
+			const INT nStripes = w / 8;
+			const INT nTail = w % 8;
+
+			__m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pAcc));
+			for (INT s = 0; s < nStripes; ++s) {
+				DXGICAPTURE_TILE_HASH_AVX2_STRIPE(pTile + s * 32, pKeys + s * 4);
+			}
+			if (nTail > 0)
+			{
+				padStripe(pTile + nStripes * 32, nTail, stripe);
+				DXGICAPTURE_TILE_HASH_AVX2_STRIPE(stripe, pKeys + nStripes * 4);
+			}
+
+			acc = _mm256_xor_si256(_mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47)), scramble);
+			acc = _mm256_add_epi64(_mm256_mul_epu32(acc, prime), _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(acc, 32), prime), 32));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pAcc), acc);
+		}
+
+#undef DXGICAPTURE_TILE_HASH_AVX2_STRIPE
+	} // AccumulateRowAVX2
+#endif // DXGICAPTURE_HAVE_X86
+
+#if defined(DXGICAPTURE_HAVE_NEON)
+	//
+	// 2 lanes per register
+	//
+	static
+	inline
+	void
+	AccumulateRowNEON(
+		_In_ const BYTE *pRow,
+		_In_ INT nWidth,
+		_Inout_ UINT64 *pAcc
+		)
+	{
+		const UINT64 *pKeys = getKeys();
+		const uint64x2_t scramble0 = vld1q_u64(reinterpret_cast<const uint64_t*>(pKeys + DXGICAPTURE_TILE_HASH_STRIPES * 4));
+		const uint64x2_t scramble1 = vld1q_u64(reinterpret_cast<const uint64_t*>(pKeys + DXGICAPTURE_TILE_HASH_STRIPES * 4 + 2));
+
+#define DXGICAPTURE_TILE_HASH_NEON_STRIPE(p, k) \
+		{ \
+			uint64x2_t d0 = vreinterpretq_u64_u8(vld1q_u8(p)); \
+			uint64x2_t d1 = vreinterpretq_u64_u8(vld1q_u8((p) + 16)); \
+			uint64x2_t dk0 = veorq_u64(d0, vld1q_u64(reinterpret_cast<const uint64_t*>(k))); \
+			uint64x2_t dk1 = veorq_u64(d1, vld1q_u64(reinterpret_cast<const uint64_t*>((k) + 2))); \
+			acc0 = vaddq_u64(acc0, vextq_u64(d0, d0, 1)); \
+			acc1 = vaddq_u64(acc1, vextq_u64(d1, d1, 1)); \
+			acc0 = vaddq_u64(acc0, vmull_u32(vmovn_u64(dk0), vshrn_n_u64(dk0, 32))); \
+			acc1 = vaddq_u64(acc1, vmull_u32(vmovn_u64(dk1), vshrn_n_u64(dk1, 32))); \
+		}
+
+		BYTE stripe[32];
+		for (INT x = 0; x < nWidth; x += DXGICAPTURE_TILE_SIZE, pAcc += 4)
+		{
+			const BYTE *pTile = pRow + (size_t)x * 4;
+			const INT w = (nWidth - x < DXGICAPTURE_TILE_SIZE) ? (nWidth - x) : DXGICAPTURE_TILE_SIZE;
+			const INT nStripes = w / 8;
+			const INT nTail = w % 8;
+
+			uint64x2_t acc0 = vld1q_u64(reinterpret_cast<const uint64_t*>(pAcc));
+			uint64x2_t acc1 = vld1q_u64(reinterpret_cast<const uint64_t*>(pAcc + 2));
+			for (INT s = 0; s < nStripes; ++s) {
+				DXGICAPTURE_TILE_HASH_NEON_STRIPE(pTile + s * 32, pKeys + s * 4);
+			}
+			if (nTail > 0)
+			{
+				padStripe(pTile + nStripes * 32, nTail, stripe);
+				DXGICAPTURE_TILE_HASH_NEON_STRIPE(stripe, pKeys + nStripes * 4);
+			}
+
+			acc0 = veorq_u64(veorq_u64(acc0, vshrq_n_u64(acc0, 47)), scramble0);
+			acc1 = veorq_u64(veorq_u64(acc1, vshrq_n_u64(acc1, 47)), scramble1);
+			acc0 = vaddq_u64(vmull_n_u32(vmovn_u64(acc0), PRIME32), vshlq_n_u64(vmull_n_u32(vshrn_n_u64(acc0, 32), PRIME32), 32));
+			acc1 = vaddq_u64(vmull_n_u32(vmovn_u64(acc1), PRIME32), vshlq_n_u64(vmull_n_u32(vshrn_n_u64(acc1, 32), PRIME32), 32));
+			vst1q_u64(reinterpret_cast<uint64_t*>(pAcc), acc0);
+			vst1q_u64(reinterpret_cast<uint64_t*>(pAcc + 2), acc1);
+		}
+
+#undef DXGICAPTURE_TILE_HASH_NEON_STRIPE
+	} // AccumulateRowNEON
+#endif // DXGICAPTURE_HAVE_NEON
+
+	static
+	inline
+	void
+	AccumulateRow(
+		_In_ const BYTE *pRow,
+		_In_ INT nWidth,
+		_Inout_ UINT64 *pAcc,
+		_In_ tagSimdLevel level
+		)
+	{
+		switch (level)
+		{
+#if defined(DXGICAPTURE_HAVE_X86)
+		case tagSimdLevel_AVX2:
+			AccumulateRowAVX2(pRow, nWidth, pAcc);
+			break;
+		case tagSimdLevel_SSE2:
+			AccumulateRowSSE2(pRow, nWidth, pAcc);
+			break;
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+		case tagSimdLevel_NEON:
+			AccumulateRowNEON(pRow, nWidth, pAcc);
+			break;
+#endif
+		default:
+			AccumulateRowScalar(pRow, nWidth, pAcc);
+			break;
+		}
+	} // AccumulateRow
+
+	//
+	// Hash of a single tile of up to 64x64 pixels
+	//
+	static
+	inline
+	UINT64
+	HashTile(
+		_In_ const BYTE *pData,
+		_In_ INT nPitch,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		if (nWidth > DXGICAPTURE_TILE_SIZE) {
+			nWidth = DXGICAPTURE_TILE_SIZE;
+		}
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		UINT64 acc[4];
+		InitAccumulators(acc, 1);
+		for (INT y = 0; y < nHeight; ++y) {
+			AccumulateRow(pData + (size_t)y * nPitch, nWidth, acc, level);
+		}
+		return Finalize(acc, nWidth, nHeight);
+	} // HashTile
+
+	//
+	// Combines the tile hashes (row order) into the hash of the frame
+	//
+	static
+	inline
+	UINT64
+	CombineHashes(
+		_In_ const UINT64 *pHashes,
+		_In_ UINT uiCount
+		)
+	{
+		const UINT64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+		const UINT64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+		const UINT64 PRIME64_3 = 0x165667B19E3779F9ULL;
+
+		UINT64 h = PRIME64_3 ^ (UINT64)uiCount;
+		for (UINT i = 0; i < uiCount; ++i)
+		{
+			h ^= rotl64(pHashes[i] * PRIME64_2, 31) * PRIME64_1;
+			h = rotl64(h, 27) * PRIME64_1;
+		}
+		h ^= h >> 33;
+		h *= PRIME64_2;
+		h ^= h >> 29;
+		return h;
+	} // CombineHashes
+
+}; // end class DXGICaptureTileHash
+
+//
+// class CDXGITileHasher
+//
+// Splits the frames of a fixed size into 64x64 tiles (the last column/row
+// may be smaller), hashes every tile and compares the hashes with the ones
+// of the previous frame. The changed tiles are kept in a bitmap, bit
+// (y * TilesX + x) of the UINT64 words; every tile of the first frame is
+// changed.
+//
+class CDXGITileHasher
+{
+private:
+	INT                     m_nWidth;
+	INT                     m_nHeight;
+	UINT                    m_uiTilesX;
+	UINT                    m_uiTilesY;
+	std::vector<UINT64>     m_hashes;
+	std::vector<UINT64>     m_changed;
+	std::vector<UINT64>     m_accumulators;  // 4 per tile of a band
+	UINT                    m_uiChangedCount;
+	UINT64                  m_ullFrameHash;
+	BOOL                    m_bValid;  // m_hashes belong to a frame
+	tagTileHashStats        m_stats;
+
+	// disable copy
+	CDXGITileHasher(const CDXGITileHasher&);
+	CDXGITileHasher& operator=(const CDXGITileHasher&);
+
+public:
+	CDXGITileHasher()
+		: m_nWidth(0)
+		, m_nHeight(0)
+		, m_uiTilesX(0)
+		, m_uiTilesY(0)
+		, m_uiChangedCount(0)
+		, m_ullFrameHash(0)
+		, m_bValid(FALSE)
+	{
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
+	//
+	// Sets the frame size, forgets the last frame and clears the statistics
+	//
+	inline
+	HRESULT
+	Initialize(
+		_In_ INT nWidth,
+		_In_ INT nHeight
+		)
+	{
+		Reset();
+		memset(&m_stats, 0, sizeof(m_stats));
+		if ((nWidth <= 0) || (nHeight <= 0) || (nWidth > 0xFFFF) || (nHeight > 0xFFFF)) {
+			return E_INVALIDARG;
+		}
+
+		UINT uiTilesX = (UINT)(nWidth + DXGICAPTURE_TILE_SIZE - 1) / DXGICAPTURE_TILE_SIZE;
+		UINT uiTilesY = (UINT)(nHeight + DXGICAPTURE_TILE_SIZE - 1) / DXGICAPTURE_TILE_SIZE;
+		UINT uiTiles = uiTilesX * uiTilesY;
+		try
+		{
+			m_hashes.assign(uiTiles, 0);
+			m_changed.assign((uiTiles + 63) / 64, 0);
+			m_accumulators.assign((size_t)uiTilesX * 4, 0);
+		}
+		catch (const std::bad_alloc&)
+		{
+			m_hashes.clear();
+			m_changed.clear();
+			m_accumulators.clear();
+			return E_OUTOFMEMORY;
+		}
+
+		m_nWidth   = nWidth;
+		m_nHeight  = nHeight;
+		m_uiTilesX = uiTilesX;
+		m_uiTilesY = uiTilesY;
+		return S_OK;
+	}
+
+	//
+	// Forgets the last frame, every tile of the next frame is changed
+	//
+	inline void Reset()
+	{
+		m_bValid         = FALSE;
+		m_uiChangedCount = 0;
+		m_ullFrameHash   = 0;
+		if (!m_changed.empty()) {
+			memset(&m_changed[0], 0, m_changed.size() * sizeof(UINT64));
+		}
+	}
+
+	//
+	// Hashes the tiles of the frame. Returns S_FALSE if no tile changed since
+	// the last frame.
+	//
+	inline
+	HRESULT
+	Update(
+		_In_ const BYTE *pData,
+		_In_ INT nPitch,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		CHECK_POINTER_EX(pData, E_INVALIDARG);
+		if (m_hashes.empty()) {
+			return E_UNEXPECTED;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		memset(&m_changed[0], 0, m_changed.size() * sizeof(UINT64));
+		UINT uiChanged = 0;
+		for (UINT ty = 0; ty < m_uiTilesY; ++ty)
+		{
+			// a band of tiles, hashed row by row
+			INT y = (INT)ty * DXGICAPTURE_TILE_SIZE;
+			INT h = (m_nHeight - y < DXGICAPTURE_TILE_SIZE) ? (m_nHeight - y) : DXGICAPTURE_TILE_SIZE;
+			DXGICaptureTileHash::InitAccumulators(&m_accumulators[0], m_uiTilesX);
+			for (INT r = 0; r < h; ++r) {
+				DXGICaptureTileHash::AccumulateRow(pData + (size_t)(y + r) * nPitch, m_nWidth, &m_accumulators[0], level);
+			}
+
+			for (UINT tx = 0; tx < m_uiTilesX; ++tx)
+			{
+				INT x = (INT)tx * DXGICAPTURE_TILE_SIZE;
+				INT w = (m_nWidth - x < DXGICAPTURE_TILE_SIZE) ? (m_nWidth - x) : DXGICAPTURE_TILE_SIZE;
+				UINT uiTile = ty * m_uiTilesX + tx;
+
+				UINT64 ullHash = DXGICaptureTileHash::Finalize(&m_accumulators[(size_t)tx * 4], w, h);
+				if (!m_bValid || (ullHash != m_hashes[uiTile]))
+				{
+					m_hashes[uiTile] = ullHash;
+					m_changed[uiTile >> 6] |= 1ULL << (uiTile & 63);
+					++uiChanged;
+				}
+			}
+		}
+
+		m_bValid         = TRUE;
+		m_uiChangedCount = uiChanged;
+		m_ullFrameHash   = DXGICaptureTileHash::CombineHashes(&m_hashes[0], (UINT)m_hashes.size());
+
+		m_stats.Frames++;
+		m_stats.TilesHashed  += m_hashes.size();
+		m_stats.TilesChanged += uiChanged;
+		m_stats.BytesHashed  += (UINT64)m_nWidth * m_nHeight * 4;
+		m_stats.HashUsec     += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		if (uiChanged == 0) {
+			m_stats.UnchangedFrames++;
+		}
+		return (uiChanged > 0) ? S_OK : S_FALSE;
+	}
+
+	inline BOOL IsValid() const { return m_bValid; }
+	inline INT GetWidth() const { return m_nWidth; }
+	inline INT GetHeight() const { return m_nHeight; }
+	inline UINT GetTilesX() const { return m_uiTilesX; }
+	inline UINT GetTilesY() const { return m_uiTilesY; }
+	inline UINT GetChangedTileCount() const { return m_uiChangedCount; }
+	// combined hash of all tiles of the last frame, 0 before the first frame
+	inline UINT64 GetFrameHash() const { return m_ullFrameHash; }
+	inline UINT64 GetTileHash(UINT x, UINT y) const { return m_hashes[y * m_uiTilesX + x]; }
+
+	inline const UINT64* GetChangedBitmap() const { return m_changed.empty() ? nullptr : &m_changed[0]; }
+	inline UINT GetChangedBitmapWords() const { return (UINT)m_changed.size(); }
+
+	inline BOOL IsTileChanged(UINT x, UINT y) const
+	{
+		UINT uiTile = y * m_uiTilesX + x;
+		return (m_changed[uiTile >> 6] >> (uiTile & 63)) & 1 ? TRUE : FALSE;
+	}
+
+	inline void GetChangeInfo(_Out_ tagTileChangeInfo *pInfo) const
+	{
+		pInfo->TileSize     = DXGICAPTURE_TILE_SIZE;
+		pInfo->TilesX       = m_uiTilesX;
+		pInfo->TilesY       = m_uiTilesY;
+		pInfo->ChangedTiles = m_uiChangedCount;
+		pInfo->BitmapWords  = (UINT)m_changed.size();
+		pInfo->FrameHash    = m_ullFrameHash;
+	}
+
+	inline void GetStats(_Out_ tagTileHashStats *pStats) const
+	{
+		*pStats = m_stats;
+	}
+
+}; // end class CDXGITileHasher
+
+#endif // __DXGICAPTURETILEHASH_H__
@@ -18,9 +18,13 @@
 #ifndef __DXGICAPTURETYPES_H__
 #define __DXGICAPTURETYPES_H__
 
+#include "DXGICapturePlatform.h"
+
+#if defined(_WIN32)
 #include <dxgi1_2.h>
 #include <windef.h>
 #include <sal.h>
+#endif
 #include <vector>
 
 //
@@ -48,19 +52,43 @@ typedef enum tagFrameRotationMode_e : UINT
 } tagFrameRotationMode;
 
 //
-// Holds info about the pointer/cursor
-// struct tagMouseInfo_s
+// enum tagFrameScaleFilter_e
 //
-typedef struct tagMouseInfo_s
+typedef enum tagFrameScaleFilter_e : UINT
 {
-	UINT ShapeBufferSize;
-	_Field_size_bytes_(ShapeBufferSize) BYTE* PtrShapeBuffer;
-	DXGI_OUTDUPL_POINTER_SHAPE_INFO ShapeInfo;
-	POINT Position;
-	bool Visible;
-	UINT WhoUpdatedPositionLast;
-	LARGE_INTEGER LastTimeStamp;
-} tagMouseInfo;
+	tagFrameScaleFilter_Default   = 0x0, /* D2D1 renderer */
+	tagFrameScaleFilter_Nearest   = 0x1,
+	tagFrameScaleFilter_Bilinear  = 0x2,
+	tagFrameScaleFilter_Box       = 0x3, /* area average */
+} tagFrameScaleFilter;
+
+//
+// enum tagYuvFormat_e
+//
+typedef enum tagYuvFormat_e : UINT
+{
+	tagYuvFormat_None      = 0x0, /* 32bpp BGRA only */
+	tagYuvFormat_NV12      = 0x1, /* Y plane, interleaved UV plane */
+	tagYuvFormat_I420      = 0x2, /* Y, U and V planes */
+} tagYuvFormat;
+
+//
+// enum tagYuvMatrix_e
+//
+typedef enum tagYuvMatrix_e : UINT
+{
+	tagYuvMatrix_BT601     = 0x0,
+	tagYuvMatrix_BT709     = 0x1,
+} tagYuvMatrix;
+
+//
+// enum tagYuvRange_e
+//
+typedef enum tagYuvRange_e : UINT
+{
+	tagYuvRange_Limited    = 0x0, /* Y 16..235, UV 16..240 */
+	tagYuvRange_Full       = 0x1, /* 0..255 */
+} tagYuvRange;
 
 //
 // struct tagFrameSize_s
@@ -94,18 +122,7 @@ typedef struct tagFrameBufferInfo_s
 	INT                                  Pitch;
 } tagFrameBufferInfo;
 
-//
-// struct tagDublicatorMonitorInfo_s
-//
-typedef struct tagDublicatorMonitorInfo_s
-{
-	INT            Idx;
-	WCHAR          DisplayName[64];
-	INT            RotationDegrees;
-	tagFrameBounds Bounds;
-} tagDublicatorMonitorInfo;
-
-typedef std::vector<tagDublicatorMonitorInfo*> DublicatorMonitorInfoVec;
+#define DXGICAPTURE_MAX_REGIONS     8
 
 //
 // struct tagScreenCaptureFilterConfig_s
@@ -118,8 +135,49 @@ public:
 	tagFrameRotationMode    RotationMode;
 	tagFrameSizeMode        SizeMode;
 	tagFrameSize            OutputSize; /* Discard for tagFrameSizeMode_AutoSize */
+	INT                     Incremental; /* Update the frame from the move/dirty rects */
+	INT                     StagingDepth; /* Readback ring depth of the continuous capture (1..4), 0: default */
+	tagFrameScaleFilter     ScaleFilter; /* Cpu scaler of the non rotated output, Default: D2D1 */
+	INT                     EncodeThreads; /* Strip encoder threads of png/jpg/tif output, 0: WIC encoder */
+	INT                     SkipUnchanged; /* Hash the output in 64x64 tiles, an unchanged image is not encoded again */
+	tagYuvFormat            YuvFormat; /* Planar YUV copy of the output image for video encoders, None: BGRA only */
+	tagYuvMatrix            YuvMatrix;
+	tagYuvRange             YuvRange;
+	INT                     RegionCount; /* Source crop rectangles, 0: the whole desktop */
+	tagFrameBounds          Regions[DXGICAPTURE_MAX_REGIONS]; /* Desktop coordinates of the monitor, every region is rendered like a desktop of its size */
 } tagScreenCaptureFilterConfig;
 
+#if defined(_WIN32)
+
+//
+// Holds info about the pointer/cursor
+// struct tagMouseInfo_s
+//
+typedef struct tagMouseInfo_s
+{
+	UINT ShapeBufferSize;
+	_Field_size_bytes_(ShapeBufferSize) BYTE* PtrShapeBuffer;
+	UINT64 ShapeHash;
+	DXGI_OUTDUPL_POINTER_SHAPE_INFO ShapeInfo;
+	POINT Position;
+	bool Visible;
+	UINT WhoUpdatedPositionLast;
+	LARGE_INTEGER LastTimeStamp;
+} tagMouseInfo;
+
+//
+// struct tagDublicatorMonitorInfo_s
+//
+typedef struct tagDublicatorMonitorInfo_s
+{
+	INT            Idx;
+	WCHAR          DisplayName[64];
+	INT            RotationDegrees;
+	tagFrameBounds Bounds;
+} tagDublicatorMonitorInfo;
+
+typedef std::vector<tagDublicatorMonitorInfo*> DublicatorMonitorInfoVec;
+
 //
 // struct tagRendererInfo_s
 //
@@ -130,6 +188,15 @@ typedef struct tagRendererInfo_s
 	tagFrameRotationMode    RotationMode;
 	tagFrameSizeMode        SizeMode;
 	tagFrameSize            OutputSize;
+	INT                     Incremental;
+	INT                     StagingDepth;
+	tagFrameScaleFilter     ScaleFilter;
+	INT                     EncodeThreads;
+	INT                     SkipUnchanged;
+	tagYuvFormat            YuvFormat;
+	tagYuvMatrix            YuvMatrix;
+	tagYuvRange             YuvRange;
+	tagFrameBounds          Region; /* First region of the config, empty: the whole desktop */
 
 	FLOAT                   RotationDegrees;
 	FLOAT                   ScaleX;
@@ -137,8 +204,11 @@ typedef struct tagRendererInfo_s
 	DXGI_FORMAT             SrcFormat;
 	tagFrameBounds          SrcBounds;
 	tagFrameBounds          DstBounds;
+	tagFrameBounds          CopyBounds; /* Copied part of the acquired image (the region, not rotated) */
 } tagRendererInfo;
 
+#endif // _WIN32
+
 // macros
 #define RESET_POINTER_EX(p, v)      if (nullptr != (p)) { *(p) = (v); }
 #define RESET_POINTER(p)            RESET_POINTER_EX(p, nullptr)
@@ -0,0 +1,610 @@
+/*****************************************************************************
+* DXGICaptureYuv.h
+*
+* Copyright (C) 2020 Gokhan Erdogdu <gokhan_erdogdu - at - yahoo - dot - com>
+*
+* DXGICapture is free software; you can redistribute it and/or modify it under
+* the terms of the GNU Lesser General Public License as published by the Free
+* Software Foundation; either version 2.1 of the License, or (at your option)
+* any later version.
+*
+* DXGICapture is distributed in the hope that it will be useful, but WITHOUT
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+* FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+* details.
+*
+******************************************************************************/
+#pragma once
+#ifndef __DXGICAPTUREYUV_H__
+#define __DXGICAPTUREYUV_H__
+
+#include "DXGICaptureTypes.h"
+
+#include <string.h>
+
+//
+// struct tagYuvCoefficients_s
+//
+// Fixed point (14 bit fraction) conversion of 8 bit BGR. The chroma rows take
+// the sum of a 2x2 block, so their result is shifted by 16.
+//
+typedef struct tagYuvCoefficients_s
+{
+	INT YB, YG, YR;
+	INT UB, UG, UR;
+	INT VB, VG, VR;
+	INT YBias;                  /* offset and rounding of Y, << 14 */
+	INT CBias;                  /* offset and rounding of U and V, << 16 */
+} tagYuvCoefficients;
+
+//
+// struct tagYuvImage_s
+//
+// NV12: Planes[1] holds the interleaved UV samples, Planes[2] is not used.
+// I420: Planes[1] holds U, Planes[2] holds V. The chroma planes have
+// (Width + 1) / 2 x (Height + 1) / 2 samples.
+//
+typedef struct tagYuvImage_s
+{
+	tagYuvFormat Format;
+	tagYuvMatrix Matrix;
+	tagYuvRange  Range;
+	INT          Width;
+	INT          Height;
+	BYTE*        Planes[3];
+	INT          Pitches[3];
+} tagYuvImage;
+
+//
+// struct tagYuvConvertStats_s
+//
+typedef struct tagYuvConvertStats_s
+{
+	UINT64 Frames;
+	INT64  ConvertUsec;
+} tagYuvConvertStats;
+
+//
+// class DXGICaptureYuv
+//
+// Converts 32bpp BGRA images to NV12 or I420 (BT.601/BT.709, limited/full
+// range). Two image rows are converted in one pass: the Y samples of both
+// rows and the U/V samples of their 2x2 blocks (average of the 4 pixels, a
+// missing last column or row repeats the edge). The SIMD variants compute
+// the same values as the scalar code.
+//
+class DXGICaptureYuv
+{
+private:
+	static
+	inline
+	BYTE
+	clampByte(
+		_In_ INT nValue
+		)
+	{
+		return (BYTE)((nValue < 0) ? 0 : ((nValue > 255) ? 255 : nValue));
+	} // clampByte
+
+public:
+	//
+	// Coefficients of the matrix and range (Kr/Kb of BT.601 and BT.709). The
+	// rows are rounded so that gray stays gray: Y of white is exactly 255 (235
+	// limited), U and V of every gray are exactly 128.
+	//
+	static
+	inline
+	void
+	GetCoefficients(
+		_In_ tagYuvMatrix matrix,
+		_In_ tagYuvRange range,
+		_Out_ tagYuvCoefficients *pCoeffs
+		)
+	{
+		const double dKr = (matrix == tagYuvMatrix_BT709) ? 0.2126 : 0.299;
+		const double dKb = (matrix == tagYuvMatrix_BT709) ? 0.0722 : 0.114;
+		const BOOL bFull = (range == tagYuvRange_Full);
+		const double dYScale = (bFull ? 255.0 : 219.0) / 255.0 * 16384.0;
+		const double dCScale = (bFull ? 255.0 : 224.0) / 255.0 * 16384.0 * 0.5;
+
+		INT nYTotal = (INT)(dYScale + 0.5);
+		pCoeffs->YR = (INT)(dKr * dYScale + 0.5);
+		pCoeffs->YB = (INT)(dKb * dYScale + 0.5);
+		pCoeffs->YG = nYTotal - pCoeffs->YR - pCoeffs->YB;
+
+		pCoeffs->UB = (INT)(dCScale + 0.5);
+		pCoeffs->UR = -(INT)(dKr / (1.0 - dKb) * dCScale + 0.5);
+		pCoeffs->UG = -pCoeffs->UB - pCoeffs->UR;
+
+		pCoeffs->VR = (INT)(dCScale + 0.5);
+		pCoeffs->VB = -(INT)(dKb / (1.0 - dKr) * dCScale + 0.5);
+		pCoeffs->VG = -pCoeffs->VR - pCoeffs->VB;
+
+		pCoeffs->YBias = ((bFull ? 0 : 16) << 14) + (1 << 13);
+		pCoeffs->CBias = (128 << 16) + (1 << 15);
+	} // GetCoefficients
+
+	//
+	// Bytes of a packed image (Y plane followed by the chroma planes)
+	//
+	static
+	inline
+	UINT
+	GetImageSize(
+		_In_ tagYuvFormat format,
+		_In_ INT nWidth,
+		_In_ INT nHeight
+		)
+	{
+		if ((format == tagYuvFormat_None) || (nWidth <= 0) || (nHeight <= 0)) {
+			return 0;
+		}
+		UINT uiChroma = (UINT)((nWidth + 1) / 2) * (UINT)((nHeight + 1) / 2);
+		return (UINT)nWidth * (UINT)nHeight + 2 * uiChroma;
+	} // GetImageSize
+
+	//
+	// Lays out a packed image in pBuffer (GetImageSize bytes)
+	//
+	static
+	inline
+	HRESULT
+	SetupImage(
+		_In_ tagYuvFormat format,
+		_In_ tagYuvMatrix matrix,
+		_In_ tagYuvRange range,
+		_In_ INT nWidth,
+		_In_ INT nHeight,
+		_In_ BYTE *pBuffer,
+		_In_ UINT uiBufferSize,
+		_Out_ tagYuvImage *pImage
+		)
+	{
+		CHECK_POINTER_EX(pImage, E_INVALIDARG);
+		memset(pImage, 0, sizeof(*pImage));
+		CHECK_POINTER_EX(pBuffer, E_INVALIDARG);
+
+		UINT uiSize = GetImageSize(format, nWidth, nHeight);
+		if ((uiSize == 0) || (uiBufferSize < uiSize)) {
+			return E_INVALIDARG;
+		}
+
+		const INT nChromaWidth  = (nWidth + 1) / 2;
+		const INT nChromaHeight = (nHeight + 1) / 2;
+
+		pImage->Format     = format;
+		pImage->Matrix     = matrix;
+		pImage->Range      = range;
+		pImage->Width      = nWidth;
+		pImage->Height     = nHeight;
+		pImage->Planes[0]  = pBuffer;
+		pImage->Pitches[0] = nWidth;
+		pImage->Planes[1]  = pBuffer + (size_t)nWidth * nHeight;
+		if (format == tagYuvFormat_NV12)
+		{
+			pImage->Pitches[1] = nChromaWidth * 2;
+		}
+		else
+		{
+			pImage->Pitches[1] = nChromaWidth;
+			pImage->Planes[2]  = pImage->Planes[1] + (size_t)nChromaWidth * nChromaHeight;
+			pImage->Pitches[2] = nChromaWidth;
+		}
+		return S_OK;
+	} // SetupImage
+
+	//
+	// Converts two rows. nUVStep is 2 for interleaved (NV12) chroma, otherwise 1.
+	// pRow1/pY1 may be the same as pRow0/pY0 (last row of an odd height).
+	//
+	static
+	inline
+	void
+	ConvertRowsScalar(
+		_In_ const BYTE *pRow0,
+		_In_ const BYTE *pRow1,
+		_In_ INT nWidth,
+		_Out_ BYTE *pY0,
+		_Out_ BYTE *pY1,
+		_Out_ BYTE *pU,
+		_Out_ BYTE *pV,
+		_In_ INT nUVStep,
+		_In_ const tagYuvCoefficients *pCoeffs
+		)
+	{
+		const tagYuvCoefficients &c = *pCoeffs;
+		for (INT x = 0; x < nWidth; x += 2)
+		{
+			const BYTE *p00 = pRow0 + (size_t)x * 4;
+			const BYTE *p10 = pRow1 + (size_t)x * 4;
+			const BYTE *p01 = (x + 1 < nWidth) ? (p00 + 4) : p00;
+			const BYTE *p11 = (x + 1 < nWidth) ? (p10 + 4) : p10;
+
+			pY0[x] = clampByte((c.YB * p00[0] + c.YG * p00[1] + c.YR * p00[2] + c.YBias) >> 14);
+			pY1[x] = clampByte((c.YB * p10[0] + c.YG * p10[1] + c.YR * p10[2] + c.YBias) >> 14);
+			if (x + 1 < nWidth)
+			{
+				pY0[x + 1] = clampByte((c.YB * p01[0] + c.YG * p01[1] + c.YR * p01[2] + c.YBias) >> 14);
+				pY1[x + 1] = clampByte((c.YB * p11[0] + c.YG * p11[1] + c.YR * p11[2] + c.YBias) >> 14);
+			}
+
+			INT nB = p00[0] + p01[0] + p10[0] + p11[0];
+			INT nG = p00[1] + p01[1] + p10[1] + p11[1];
+			INT nR = p00[2] + p01[2] + p10[2] + p11[2];
+			pU[(x >> 1) * nUVStep] = clampByte((c.UB * nB + c.UG * nG + c.UR * nR + c.CBias) >> 16);
+			pV[(x >> 1) * nUVStep] = clampByte((c.VB * nB + c.VG * nG + c.VR * nR + c.CBias) >> 16);
+		}
+	} // ConvertRowsScalar
+
+#if defined(DXGICAPTURE_HAVE_X86)
+	//
+	// 8 pixels per step: the Y rows are multiply-added per pixel, the chroma
+	// takes the even and the odd pixels of both rows summed in 16 bits
+	//
+	static
+	inline
+	void
+	ConvertRowsSSE2(
+		_In_ const BYTE *pRow0,
+		_In_ const BYTE *pRow1,
+		_In_ INT nWidth,
+		_Out_ BYTE *pY0,
+		_Out_ BYTE *pY1,
+		_Out_ BYTE *pU,
+		_Out_ BYTE *pV,
+		_In_ INT nUVStep,
+		_In_ const tagYuvCoefficients *pCoeffs
+		)
+	{
+		const tagYuvCoefficients &c = *pCoeffs;
+		const __m128i zero  = _mm_setzero_si128();
+		const __m128i yCoef = _mm_setr_epi16((short)c.YB, (short)c.YG, (short)c.YR, 0, (short)c.YB, (short)c.YG, (short)c.YR, 0);
+		const __m128i uCoef = _mm_setr_epi16((short)c.UB, (short)c.UG, (short)c.UR, 0, (short)c.UB, (short)c.UG, (short)c.UR, 0);
+		const __m128i vCoef = _mm_setr_epi16((short)c.VB, (short)c.VG, (short)c.VR, 0, (short)c.VB, (short)c.VG, (short)c.VR, 0);
+		const __m128i yBias = _mm_set1_epi32(c.YBias);
+		const __m128i cBias = _mm_set1_epi32(c.CBias);
+
+		// sum of the two 32 bit products of each pixel (or block) pair: [p0, p1] [p2, p3] -> [p0 p1 p2 p3]
+#define DXGICAPTURE_YUV_SSE2_PAIRS(lo, hi) _mm_add_epi32( \
+			_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0))), \
+			_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1))))
+#define DXGICAPTURE_YUV_SSE2_LUMA(px) _mm_srai_epi32(_mm_add_epi32(DXGICAPTURE_YUV_SSE2_PAIRS( \
+			_mm_madd_epi16(_mm_unpacklo_epi8(px, zero), yCoef), \
+			_mm_madd_epi16(_mm_unpackhi_epi8(px, zero), yCoef)), yBias), 14)
+
+		INT x = 0;
+		for (; x + 8 <= nWidth; x += 8)
+		{
+			__m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + (size_t)x * 4));
+			__m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + (size_t)x * 4 + 16));
+			__m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + (size_t)x * 4));
+			__m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + (size_t)x * 4 + 16));
+
+			__m128i y0 = _mm_packs_epi32(DXGICAPTURE_YUV_SSE2_LUMA(a0), DXGICAPTURE_YUV_SSE2_LUMA(b0));
+			__m128i y1 = _mm_packs_epi32(DXGICAPTURE_YUV_SSE2_LUMA(a1), DXGICAPTURE_YUV_SSE2_LUMA(b1));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(pY0 + x), _mm_packus_epi16(y0, y0));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(pY1 + x), _mm_packus_epi16(y1, y1));
+
+			// even [p0 p2 p4 p6] and odd [p1 p3 p5 p7] pixels, block k = p2k + p2k+1 of both rows
+			__m128i e0 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a0), _mm_castsi128_ps(b0), _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i o0 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a0), _mm_castsi128_ps(b0), _MM_SHUFFLE(3, 1, 3, 1)));
+			__m128i e1 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a1), _mm_castsi128_ps(b1), _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i o1 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a1), _mm_castsi128_ps(b1), _MM_SHUFFLE(3, 1, 3, 1)));
+			__m128i sumLo = _mm_add_epi16(
+				_mm_add_epi16(_mm_unpacklo_epi8(e0, zero), _mm_unpacklo_epi8(o0, zero)),
+				_mm_add_epi16(_mm_unpacklo_epi8(e1, zero), _mm_unpacklo_epi8(o1, zero)));
+			__m128i sumHi = _mm_add_epi16(
+				_mm_add_epi16(_mm_unpackhi_epi8(e0, zero), _mm_unpackhi_epi8(o0, zero)),
+				_mm_add_epi16(_mm_unpackhi_epi8(e1, zero), _mm_unpackhi_epi8(o1, zero)));
+
+			__m128i u = _mm_srai_epi32(_mm_add_epi32(DXGICAPTURE_YUV_SSE2_PAIRS(_mm_madd_epi16(sumLo, uCoef), _mm_madd_epi16(sumHi, uCoef)), cBias), 16);
+			__m128i v = _mm_srai_epi32(_mm_add_epi32(DXGICAPTURE_YUV_SSE2_PAIRS(_mm_madd_epi16(sumLo, vCoef), _mm_madd_epi16(sumHi, vCoef)), cBias), 16);
+
+			BYTE *pDstU = pU + (size_t)(x >> 1) * nUVStep;
+			if (nUVStep == 2)
+			{
+				// u0 v0 u1 v1 u2 v2 u3 v3
+				__m128i uv = _mm_unpacklo_epi16(_mm_packs_epi32(u, u), _mm_packs_epi32(v, v));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pDstU), _mm_packus_epi16(uv, uv));
+			}
+			else
+			{
+				__m128i uv = _mm_packs_epi32(u, v);
+				uv = _mm_packus_epi16(uv, uv);
+				INT nU = _mm_cvtsi128_si32(uv);
+				INT nV = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+				memcpy(pDstU, &nU, 4);
+				memcpy(pV + (x >> 1), &nV, 4);
+			}
+		}
+
+#undef DXGICAPTURE_YUV_SSE2_LUMA
+#undef DXGICAPTURE_YUV_SSE2_PAIRS
+
+		if (x < nWidth) {
+			ConvertRowsScalar(pRow0 + (size_t)x * 4, pRow1 + (size_t)x * 4, nWidth - x, pY0 + x, pY1 + x,
+				pU + (size_t)(x >> 1) * nUVStep, pV + (size_t)(x >> 1) * nUVStep, nUVStep, pCoeffs);
+		}
+	} // ConvertRowsSSE2
+
+	//
+	// 16 pixels per step, same arithmetic as SSE2; the in-lane horizontal adds
+	// leave the chroma blocks in the order 0 1 4 5 | 2 3 6 7
+	//
+	static
+	inline
+	DXGICAPTURE_TARGET_AVX2
+	void
+	ConvertRowsAVX2(
+		_In_ const BYTE *pRow0,
+		_In_ const BYTE *pRow1,
+		_In_ INT nWidth,
+		_Out_ BYTE *pY0,
+		_Out_ BYTE *pY1,
+		_Out_ BYTE *pU,
+		_Out_ BYTE *pV,
+		_In_ INT nUVStep,
+		_In_ const tagYuvCoefficients *pCoeffs
+		)
+	{
+		const tagYuvCoefficients &c = *pCoeffs;
+		const __m256i zero  = _mm256_setzero_si256();
+		const __m256i yCoef = _mm256_setr_epi16(
+			(short)c.YB, (short)c.YG, (short)c.YR, 0, (short)c.YB, (short)c.YG, (short)c.YR, 0,
+			(short)c.YB, (short)c.YG, (short)c.YR, 0, (short)c.YB, (short)c.YG, (short)c.YR, 0);
+		const __m256i uCoef = _mm256_setr_epi16(
+			(short)c.UB, (short)c.UG, (short)c.UR, 0, (short)c.UB, (short)c.UG, (short)c.UR, 0,
+			(short)c.UB, (short)c.UG, (short)c.UR, 0, (short)c.UB, (short)c.UG, (short)c.UR, 0);
+		const __m256i vCoef = _mm256_setr_epi16(
+			(short)c.VB, (short)c.VG, (short)c.VR, 0, (short)c.VB, (short)c.VG, (short)c.VR, 0,
+			(short)c.VB, (short)c.VG, (short)c.VR, 0, (short)c.VB, (short)c.VG, (short)c.VR, 0);
+		const __m256i yBias = _mm256_set1_epi32(c.YBias);
+		const __m256i cBias = _mm256_set1_epi32(c.CBias);
+		const __m256i yOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+		const __m256i cOrder = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+
+		// [p0 p1 | p4 p5] [p2 p3 | p6 p7] -> [p0 p1 p2 p3 | p4 p5 p6 p7]
+#define DXGICAPTURE_YUV_AVX2_LUMA(px) _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32( \
+			_mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), yCoef), \
+			_mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), yCoef)), yBias), 14)
+
+		INT x = 0;
+		for (; x + 16 <= nWidth; x += 16)
+		{
+			__m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow0 + (size_t)x * 4));
+			__m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow0 + (size_t)x * 4 + 32));
+			__m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow1 + (size_t)x * 4));
+			__m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pRow1 + (size_t)x * 4 + 32));
+
+			// packs: [0-3 8-11 | 4-7 12-15], packus doubles it, the dwords 0 4 1 5 are pixels 0-15
+			__m256i y0 = _mm256_packs_epi32(DXGICAPTURE_YUV_AVX2_LUMA(a0), DXGICAPTURE_YUV_AVX2_LUMA(b0));
+			__m256i y1 = _mm256_packs_epi32(DXGICAPTURE_YUV_AVX2_LUMA(a1), DXGICAPTURE_YUV_AVX2_LUMA(b1));
+			y0 = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(y0, y0), yOrder);
+			y1 = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(y1, y1), yOrder);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pY0 + x), _mm256_castsi256_si128(y0));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(pY1 + x), _mm256_castsi256_si128(y1));
+
+			// even [p0 p2 p8 p10 | p4 p6 p12 p14] and odd pixels of both rows
+			__m256i e0 = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a0), _mm256_castsi256_ps(b0), _MM_SHUFFLE(2, 0, 2, 0)));
+			__m256i o0 = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a0), _mm256_castsi256_ps(b0), _MM_SHUFFLE(3, 1, 3, 1)));
+			__m256i e1 = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a1), _mm256_castsi256_ps(b1), _MM_SHUFFLE(2, 0, 2, 0)));
+			__m256i o1 = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a1), _mm256_castsi256_ps(b1), _MM_SHUFFLE(3, 1, 3, 1)));
+			__m256i sumLo = _mm256_add_epi16(
+				_mm256_add_epi16(_mm256_unpacklo_epi8(e0, zero), _mm256_unpacklo_epi8(o0, zero)),
+				_mm256_add_epi16(_mm256_unpacklo_epi8(e1, zero), _mm256_unpacklo_epi8(o1, zero)));
+			__m256i sumHi = _mm256_add_epi16(
+				_mm256_add_epi16(_mm256_unpackhi_epi8(e0, zero), _mm256_unpackhi_epi8(o0, zero)),
+				_mm256_add_epi16(_mm256_unpackhi_epi8(e1, zero), _mm256_unpackhi_epi8(o1, zero)));
+
+			__m256i u = _mm256_hadd_epi32(_mm256_madd_epi16(sumLo, uCoef), _mm256_madd_epi16(sumHi, uCoef));
+			__m256i v = _mm256_hadd_epi32(_mm256_madd_epi16(sumLo, vCoef), _mm256_madd_epi16(sumHi, vCoef));
+			u = _mm256_permutevar8x32_epi32(_mm256_srai_epi32(_mm256_add_epi32(u, cBias), 16), cOrder);
+			v = _mm256_permutevar8x32_epi32(_mm256_srai_epi32(_mm256_add_epi32(v, cBias), 16), cOrder);
+
+			BYTE *pDstU = pU + (size_t)(x >> 1) * nUVStep;
+			if (nUVStep == 2)
+			{
+				// [u0 v0 .. u3 v3 | u4 v4 .. u7 v7]
+				__m256i uv = _mm256_unpacklo_epi16(_mm256_packs_epi32(u, u), _mm256_packs_epi32(v, v));
+				uv = _mm256_permute4x64_epi64(_mm256_packus_epi16(uv, uv), _MM_SHUFFLE(3, 1, 2, 0));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pDstU), _mm256_castsi256_si128(uv));
+			}
+			else
+			{
+				// dwords [u0-3 v0-3 .. | u4-7 v4-7 ..] -> u0-7 v0-7
+				__m256i uv = _mm256_packs_epi32(u, v);
+				uv = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(uv, uv), yOrder);
+				__m128i uv128 = _mm256_castsi256_si128(uv);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pDstU), uv128);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(pV + (x >> 1)), _mm_srli_si128(uv128, 8));
+			}
+		}
+
+#undef DXGICAPTURE_YUV_AVX2_LUMA
+
+		if (x < nWidth) {
+			ConvertRowsSSE2(pRow0 + (size_t)x * 4, pRow1 + (size_t)x * 4, nWidth - x, pY0 + x, pY1 + x,
+				pU + (size_t)(x >> 1) * nUVStep, pV + (size_t)(x >> 1) * nUVStep, nUVStep, pCoeffs);
+		}
+	} // ConvertRowsAVX2
+#endif // DXGICAPTURE_HAVE_X86
+
+#if defined(DXGICAPTURE_HAVE_NEON)
+	//
+	// 16 pixels per step, the channels are deinterleaved by vld4; the chroma
+	// blocks are pairwise adds of both rows
+	//
+	static
+	inline
+	void
+	ConvertRowsNEON(
+		_In_ const BYTE *pRow0,
+		_In_ const BYTE *pRow1,
+		_In_ INT nWidth,
+		_Out_ BYTE *pY0,
+		_Out_ BYTE *pY1,
+		_Out_ BYTE *pU,
+		_Out_ BYTE *pV,
+		_In_ INT nUVStep,
+		_In_ const tagYuvCoefficients *pCoeffs
+		)
+	{
+		const tagYuvCoefficients &c = *pCoeffs;
+		const uint32x4_t yBias = vdupq_n_u32((uint32_t)c.YBias);
+		const int32x4_t  cBias = vdupq_n_s32(c.CBias);
+
+#define DXGICAPTURE_YUV_NEON_LUMA(half, px) \
+		vshrn_n_u32(vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(yBias, \
+			vget_##half##_u16(vmovl_u8(px.val[0])), (uint16_t)c.YB), \
+			vget_##half##_u16(vmovl_u8(px.val[1])), (uint16_t)c.YG), \
+			vget_##half##_u16(vmovl_u8(px.val[2])), (uint16_t)c.YR), 14)
+#define DXGICAPTURE_YUV_NEON_CHROMA(half, b, g, r, cb, cg, cr) \
+		vqmovn_s32(vshrq_n_s32(vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(cBias, \
+			vget_##half##_s16(b), (int16_t)(cb)), \
+			vget_##half##_s16(g), (int16_t)(cg)), \
+			vget_##half##_s16(r), (int16_t)(cr)), 16))
+
+		INT x = 0;
+		for (; x + 16 <= nWidth; x += 16)
+		{
+			uint8x16x4_t p0 = vld4q_u8(reinterpret_cast<const uint8_t*>(pRow0 + (size_t)x * 4));
+			uint8x16x4_t p1 = vld4q_u8(reinterpret_cast<const uint8_t*>(pRow1 + (size_t)x * 4));
+
+			uint8x8x4_t l0 = { { vget_low_u8(p0.val[0]), vget_low_u8(p0.val[1]), vget_low_u8(p0.val[2]), vget_low_u8(p0.val[3]) } };
+			uint8x8x4_t h0 = { { vget_high_u8(p0.val[0]), vget_high_u8(p0.val[1]), vget_high_u8(p0.val[2]), vget_high_u8(p0.val[3]) } };
+			uint8x8x4_t l1 = { { vget_low_u8(p1.val[0]), vget_low_u8(p1.val[1]), vget_low_u8(p1.val[2]), vget_low_u8(p1.val[3]) } };
+			uint8x8x4_t h1 = { { vget_high_u8(p1.val[0]), vget_high_u8(p1.val[1]), vget_high_u8(p1.val[2]), vget_high_u8(p1.val[3]) } };
+
+			uint16x8_t y0l = vcombine_u16(DXGICAPTURE_YUV_NEON_LUMA(low, l0), DXGICAPTURE_YUV_NEON_LUMA(high, l0));
+			uint16x8_t y0h = vcombine_u16(DXGICAPTURE_YUV_NEON_LUMA(low, h0), DXGICAPTURE_YUV_NEON_LUMA(high, h0));
+			uint16x8_t y1l = vcombine_u16(DXGICAPTURE_YUV_NEON_LUMA(low, l1), DXGICAPTURE_YUV_NEON_LUMA(high, l1));
+			uint16x8_t y1h = vcombine_u16(DXGICAPTURE_YUV_NEON_LUMA(low, h1), DXGICAPTURE_YUV_NEON_LUMA(high, h1));
+			vst1q_u8(reinterpret_cast<uint8_t*>(pY0 + x), vcombine_u8(vqmovn_u16(y0l), vqmovn_u16(y0h)));
+			vst1q_u8(reinterpret_cast<uint8_t*>(pY1 + x), vcombine_u8(vqmovn_u16(y1l), vqmovn_u16(y1h)));
+
+			// 2x2 block sums of the 8 blocks
+			int16x8_t sB = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]));
+			int16x8_t sG = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]));
+			int16x8_t sR = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]));
+
+			uint8x8_t u = vqmovun_s16(vcombine_s16(
+				DXGICAPTURE_YUV_NEON_CHROMA(low, sB, sG, sR, c.UB, c.UG, c.UR),
+				DXGICAPTURE_YUV_NEON_CHROMA(high, sB, sG, sR, c.UB, c.UG, c.UR)));
+			uint8x8_t v = vqmovun_s16(vcombine_s16(
+				DXGICAPTURE_YUV_NEON_CHROMA(low, sB, sG, sR, c.VB, c.VG, c.VR),
+				DXGICAPTURE_YUV_NEON_CHROMA(high, sB, sG, sR, c.VB, c.VG, c.VR)));
+
+			if (nUVStep == 2)
+			{
+				uint8x8x2_t uv = { { u, v } };
+				vst2_u8(reinterpret_cast<uint8_t*>(pU + (size_t)x), uv);
+			}
+			else
+			{
+				vst1_u8(reinterpret_cast<uint8_t*>(pU + (x >> 1)), u);
+				vst1_u8(reinterpret_cast<uint8_t*>(pV + (x >> 1)), v);
+			}
+		}
+
+#undef DXGICAPTURE_YUV_NEON_CHROMA
+#undef DXGICAPTURE_YUV_NEON_LUMA
+
+		if (x < nWidth) {
+			ConvertRowsScalar(pRow0 + (size_t)x * 4, pRow1 + (size_t)x * 4, nWidth - x, pY0 + x, pY1 + x,
+				pU + (size_t)(x >> 1) * nUVStep, pV + (size_t)(x >> 1) * nUVStep, nUVStep, pCoeffs);
+		}
+	} // ConvertRowsNEON
+#endif // DXGICAPTURE_HAVE_NEON
+
+	static
+	inline
+	void
+	ConvertRows(
+		_In_ const BYTE *pRow0,
+		_In_ const BYTE *pRow1,
+		_In_ INT nWidth,
+		_Out_ BYTE *pY0,
+		_Out_ BYTE *pY1,
+		_Out_ BYTE *pU,
+		_Out_ BYTE *pV,
+		_In_ INT nUVStep,
+		_In_ const tagYuvCoefficients *pCoeffs,
+		_In_ tagSimdLevel level
+		)
+	{
+		switch (level)
+		{
+#if defined(DXGICAPTURE_HAVE_X86)
+		case tagSimdLevel_AVX2:
+			ConvertRowsAVX2(pRow0, pRow1, nWidth, pY0, pY1, pU, pV, nUVStep, pCoeffs);
+			break;
+		case tagSimdLevel_SSE2:
+			ConvertRowsSSE2(pRow0, pRow1, nWidth, pY0, pY1, pU, pV, nUVStep, pCoeffs);
+			break;
+#endif
+#if defined(DXGICAPTURE_HAVE_NEON)
+		case tagSimdLevel_NEON:
+			ConvertRowsNEON(pRow0, pRow1, nWidth, pY0, pY1, pU, pV, nUVStep, pCoeffs);
+			break;
+#endif
+		default:
+			ConvertRowsScalar(pRow0, pRow1, nWidth, pY0, pY1, pU, pV, nUVStep, pCoeffs);
+			break;
+		}
+	} // ConvertRows
+
+	//
+	// Converts a 32bpp BGRA image of pImage->Width x pImage->Height pixels into
+	// the planes of pImage (format, matrix and range of pImage)
+	//
+	static
+	inline
+	HRESULT
+	Convert(
+		_In_ const BYTE *pSrc,
+		_In_ INT nSrcPitch,
+		_Inout_ tagYuvImage *pImage,
+		_In_ tagSimdLevel level = tagSimdLevel_Auto
+		)
+	{
+		CHECK_POINTER_EX(pSrc, E_INVALIDARG);
+		CHECK_POINTER_EX(pImage, E_INVALIDARG);
+		if ((pImage->Width <= 0) || (pImage->Height <= 0) || (nullptr == pImage->Planes[0]) || (nullptr == pImage->Planes[1])) {
+			return E_INVALIDARG;
+		}
+
+		BOOL bInterleaved = (pImage->Format == tagYuvFormat_NV12);
+		if (!bInterleaved && ((pImage->Format != tagYuvFormat_I420) || (nullptr == pImage->Planes[2]))) {
+			return E_INVALIDARG;
+		}
+
+		tagYuvCoefficients coeffs;
+		GetCoefficients(pImage->Matrix, pImage->Range, &coeffs);
+		level = DXGICaptureCpu::ResolveSimdLevel(level);
+
+		const INT nWidth  = pImage->Width;
+		const INT nHeight = pImage->Height;
+		for (INT y = 0; y < nHeight; y += 2)
+		{
+			// an odd last row is its own pair
+			INT y1 = (y + 1 < nHeight) ? (y + 1) : y;
+			BYTE *pU = pImage->Planes[1] + (size_t)(y >> 1) * pImage->Pitches[1];
+			BYTE *pV = bInterleaved ? (pU + 1) : (pImage->Planes[2] + (size_t)(y >> 1) * pImage->Pitches[2]);
+			ConvertRows(
+				pSrc + (size_t)y * nSrcPitch,
+				pSrc + (size_t)y1 * nSrcPitch,
+				nWidth,
+				pImage->Planes[0] + (size_t)y * pImage->Pitches[0],
+				pImage->Planes[0] + (size_t)y1 * pImage->Pitches[0],
+				pU,
+				pV,
+				bInterleaved ? 2 : 1,
+				&coeffs,
+				level);
+		}
+		return S_OK;
+	} // Convert
+
+}; // end class DXGICaptureYuv
+
+#endif // __DXGICAPTUREYUV_H__
@@ -19,16 +19,48 @@
 #include <tchar.h>
 #include <shlobj.h>
 
+#include <string>
+
 #include "DXGICapture.h"
+#include "DXGICaptureCanvas.h"
+#include "DXGICaptureDuplicationSource.h"
+#include "DXGICaptureEncoderPool.h"
+#include "DXGICaptureHelper.h"
+#include "DXGICapturePipeline.h"
+#include "DXGICaptureStream.h"
 #include "CmdParser.h"
 
+//
+// struct tagEncoderOptions_s
+//
+typedef struct tagEncoderOptions_s
+{
+	int workers;      /* 0: encode on the capture thread */
+	int queueDepth;
+	int backpressure; /* tagEncodeBackpressure */
+	int stream;       /* the output is a stream (stdout, pipe or *.y4m) */
+	int streamFormat; /* tagStreamFormat */
+} tagEncoderOptions;
+
 int show_help(const void *optsctx, const void *optctx);
 int show_monitors(const void *optsctx, const void *optctx);
+int is_stream_output(const char *pszOutputFileName);
+int capture_frames(CDXGICapture *pCapture, const char *pszOutputFileName, int frameCount, int targetFps, const tagEncoderOptions *pEncoderOptions);
+int capture_canvas(CDXGICapture *pCapture, const char *pszOutputFileName, int frameCount, int showCursor);
+int parse_regions(const char *pszRegions, tagScreenCaptureFilterConfig *pConfig);
+int capture_regions(CDXGICapture *pCapture, const char *pszOutputFileName, int frameCount, const tagScreenCaptureFilterConfig *pConfig);
+int write_metrics(CDXGICapture *pCapture, const char *pszMetricsFileName);
 
 int main(int argc, char* argv[])
 {
 	char *pszOutputFileName = nullptr;
+	char *pszRegions = nullptr;
+	char *pszMetricsFileName = nullptr;
 	int showResultImage = 0;
+	int frameCount = 1;
+	int targetFps = 0;
+	int allMonitors = 0;
+	tagEncoderOptions encoderOptions = { 2, DXGICAPTURE_ENCODER_DEFAULT_QUEUE_DEPTH, (int)tagEncodeBackpressure_Block, 0, (int)tagStreamFormat_Y4M };
 	tagScreenCaptureFilterConfig config;
 
 	// set default config
@@ -86,6 +118,24 @@ int main(int argc, char* argv[])
 			"The index of the monitor. Default is '0'",
 			"monitor_idx"
 		},
+		{
+			"all",
+			OPT_BOOL,
+			0,
+			1,
+			{ (void*)&allMonitors },
+			"capture all monitors into one image of the virtual desktop, each monitor on its own thread. Default is '0' (0:false, 1:true)",
+			nullptr
+		},
+		{
+			"roi",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszRegions },
+			"capture regions of the monitor 'x,y,w,h[;x,y,w,h...]' in desktop coordinates, up to 8. More regions are written to one file per region",
+			"regions"
+		},
 		{
 			"c",
 			OPT_BOOL,
@@ -131,15 +181,150 @@ int main(int argc, char* argv[])
 			"force output image height",
 			"image_height"
 		},
+		{
+			"sf",
+			OPT_INT,
+			(int)tagFrameScaleFilter_Default,
+			(int)tagFrameScaleFilter_Box,
+			{ (void*)&(config.ScaleFilter) },
+			"cpu scale filter of the output. Default is '0' (0:D2D1, 1:Nearest, 2:Bilinear, 3:Box)",
+			"filter"
+		},
+		{
+			"pe",
+			OPT_INT,
+			0,
+			DXGICAPTURE_PARALLEL_MAX_THREADS,
+			{ (void*)&(config.EncodeThreads) },
+			"encode png/jpg/tif output in strips on the given number of threads. Default is '0' (0: WIC encoder)",
+			"threads"
+		},
+		{
+			"skip",
+			OPT_BOOL,
+			0,
+			1,
+			{ (void*)&(config.SkipUnchanged) },
+			"do not write frames that equal the last written frame (64x64 tile hashes). Default is '0' (0:false, 1:true)",
+			nullptr
+		},
 		{
 			"o",
 			OPT_STRING,
 			0,
 			0,
 			{ (void*)&pszOutputFileName },
-			"set output image file name (supports: *.bmp; *.png; *.tif)",
+			"set output image file name (supports: *.bmp; *.png; *.tif; *.jpg; *.qoi), or a stream ('-': stdout, \\\\.\\pipe\\<name>, *.y4m)",
 			"outfile"
 		},
+		{
+			"of",
+			OPT_INT,
+			(int)tagStreamFormat_Y4M,
+			(int)tagStreamFormat_RawBgra,
+			{ (void*)&(encoderOptions.streamFormat) },
+			"format of a stream output. Default is '0' (0:y4m, 1:rawvideo yuv (-yuv), 2:rawvideo bgra)",
+			"format"
+		},
+		{
+			"yuv",
+			OPT_INT,
+			(int)tagYuvFormat_None,
+			(int)tagYuvFormat_I420,
+			{ (void*)&(config.YuvFormat) },
+			"planar YUV of the frames (rawvideo yuv stream). Default is '0' (0:none, 1:NV12, 2:I420)",
+			"format"
+		},
+		{
+			"ym",
+			OPT_INT,
+			(int)tagYuvMatrix_BT601,
+			(int)tagYuvMatrix_BT709,
+			{ (void*)&(config.YuvMatrix) },
+			"YUV matrix. Default is '0' (0:BT.601, 1:BT.709)",
+			"matrix"
+		},
+		{
+			"yr",
+			OPT_INT,
+			(int)tagYuvRange_Limited,
+			(int)tagYuvRange_Full,
+			{ (void*)&(config.YuvRange) },
+			"YUV range. Default is '0' (0:limited, 1:full)",
+			"range"
+		},
+		{
+			"n",
+			OPT_INT,
+			1,
+			(int)0xFFFFFF,
+			{ (void*)&frameCount },
+			"number of frames to capture. Default is '1' (more than 1: continuous capture, frame number is appended to outfile)",
+			"frames"
+		},
+		{
+			"fps",
+			OPT_INT,
+			0,
+			240,
+			{ (void*)&targetFps },
+			"frame rate of the continuous capture. Default is '0' (0: every new desktop image)",
+			"rate"
+		},
+		{
+			"inc",
+			OPT_BOOL,
+			0,
+			1,
+			{ (void*)&(config.Incremental) },
+			"update frames from the dirty/move rects. Default is '0' (0:false, 1:true)",
+			nullptr
+		},
+		{
+			"ring",
+			OPT_INT,
+			0,
+			DXGICAPTURE_STAGING_MAX_DEPTH,
+			{ (void*)&(config.StagingDepth) },
+			"staging readback ring depth of the continuous capture. Default is '0' (0:default (3), 1:synchronous readback)",
+			"depth"
+		},
+		{
+			"ew",
+			OPT_INT,
+			0,
+			DXGICAPTURE_ENCODER_MAX_WORKERS,
+			{ (void*)&(encoderOptions.workers) },
+			"encoder workers of the continuous capture. Default is '2' (0: encode on the capture thread)",
+			"workers"
+		},
+		{
+			"eq",
+			OPT_INT,
+			1,
+			DXGICAPTURE_ENCODER_MAX_QUEUE_DEPTH,
+			{ (void*)&(encoderOptions.queueDepth) },
+			"frames queued for the encoder workers. Default is '8'",
+			"depth"
+		},
+		{
+			"bp",
+			OPT_INT,
+			(int)tagEncodeBackpressure_Block,
+			(int)tagEncodeBackpressure_DropNewest,
+			{ (void*)&(encoderOptions.backpressure) },
+			"backpressure of a full encoder queue. Default is '0' (0:Block, 1:DropOldest, 2:DropNewest)",
+			"policy"
+		},
+		{
+			"metrics",
+			OPT_STRING,
+			0,
+			0,
+			{ (void*)&pszMetricsFileName },
+			"write the stage latency histograms and the frame counters of the capture as json (single and continuous capture)",
+			"file"
+		},
 		{
 			"show",
 			OPT_BOOL,
@@ -164,6 +349,23 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
+	if ((nullptr != pszRegions) && !parse_regions(pszRegions, &config))
+	{
+		printf("Error: Invalid regions '%s'.\n", pszRegions);
+		return -1;
+	}
+
+	// streams are written continuously, the frames carry the planes of the stream format
+	encoderOptions.stream = is_stream_output(pszOutputFileName);
+	if (encoderOptions.stream)
+	{
+		size_t nLength = strlen(pszOutputFileName);
+		if ((nLength > 4) && (_stricmp(pszOutputFileName + nLength - 4, ".y4m") == 0)) {
+			encoderOptions.streamFormat = (int)tagStreamFormat_Y4M;
+		}
+		config.YuvFormat = CDXGIStreamEncoder::GetRequiredYuvFormat((tagStreamFormat)encoderOptions.streamFormat, config.YuvFormat);
+	}
+
 	HRESULT hr = S_OK;
 	CDXGICapture dxgiCapture;
 
@@ -184,14 +386,19 @@ int main(int argc, char* argv[])
 	}
 
 	// select monitor by id
-	const tagDublicatorMonitorInfo *pMonitorInfo = dxgiCapture.FindDublicatorMonitorInfo(config.MonitorIdx);
-	if (nullptr == pMonitorInfo)
+	tagDublicatorMonitorInfo monitorInfo;
+	if (S_OK != dxgiCapture.FindDublicatorMonitorInfo(config.MonitorIdx, &monitorInfo))
 	{
 		printf("Error: Monitor '%d' was not found.", config.MonitorIdx);
 		return -1;
 	}
 
-	hr = dxgiCapture.SetConfig(config);
+	// a batch of regions is rendered by the pipeline, the capture only encodes
+	tagScreenCaptureFilterConfig captureConfig = config;
+	if (config.RegionCount > 1) {
+		captureConfig.RegionCount = 0;
+	}
+	hr = dxgiCapture.SetConfig(captureConfig);
 	if (FAILED(hr))
 	{
 		printf("Error[0x%08X]: CDXGICapture::SetConfig failed.\n", hr);
@@ -212,6 +419,49 @@ int main(int argc, char* argv[])
 		pszOutputFileName = szFileName;
 	}
 
+	if (allMonitors || (config.RegionCount > 1))
+	{
+		// the duplication sources duplicate the outputs, the capture only encodes
+		hr = dxgiCapture.ReleaseDuplication();
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGICapture::ReleaseDuplication failed.\n", hr);
+			return -1;
+		}
+	}
+
+	if (allMonitors)
+	{
+		if (encoderOptions.stream)
+		{
+			printf("Error: All monitors can not be captured to a stream.\n");
+			return -1;
+		}
+		return capture_canvas(&dxgiCapture, pszOutputFileName, frameCount, config.ShowCursor);
+	}
+
+	if (config.RegionCount > 1)
+	{
+		if (encoderOptions.stream)
+		{
+			printf("Error: More than one region can not be captured to a stream.\n");
+			return -1;
+		}
+		return capture_regions(&dxgiCapture, pszOutputFileName, frameCount, &config);
+	}
+
+	// the metrics count from the first frame
+	dxgiCapture.GetMetrics()->Reset();
+
+	if ((frameCount > 1) || encoderOptions.stream)
+	{
+		int result = capture_frames(&dxgiCapture, pszOutputFileName, frameCount, targetFps, &encoderOptions);
+		if ((result == 0) && !write_metrics(&dxgiCapture, pszMetricsFileName)) {
+			result = -1;
+		}
+		return result;
+	}
+
 	UINT uiDuration = 0x0;
 	hr = dxgiCapture.CaptureToFile((LPCTSTR)CA2WEX<>(pszOutputFileName), NULL, &uiDuration);
 	if (FAILED(hr))
@@ -222,6 +472,18 @@ int main(int argc, char* argv[])
 
 	printf("Total render duration: %u msec\n", uiDuration);
 
+	tagFrameCopyStats copyStats;
+	if (SUCCEEDED(dxgiCapture.GetFrameCopyStats(&copyStats)))
+	{
+		printf("Frame copies: %u, %.2f MB (%.2f MB streamed)%s\n",
+			copyStats.Copies, copyStats.BytesCopied / (1024.0 * 1024.0), copyStats.BytesStreamed / (1024.0 * 1024.0),
+			copyStats.Passthrough ? ", passthrough" : "");
+	}
+
+	if (!write_metrics(&dxgiCapture, pszMetricsFileName)) {
+		return -1;
+	}
+
 	if (showResultImage) {
 		ShellExecuteA(0, 0, pszOutputFileName, 0, 0, SW_SHOW);
 	}
@@ -229,6 +491,646 @@ int main(int argc, char* argv[])
 	return 0;
 }
 
+//
+// Writes the metrics of the capture as json, nothing without a file name
+//
+int write_metrics(CDXGICapture *pCapture, const char *pszMetricsFileName)
+{
+	if (nullptr == pszMetricsFileName) {
+		return 1;
+	}
+
+	HRESULT hr = pCapture->GetMetrics()->SaveJson(pszMetricsFileName);
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: Could not write the metrics '%s'.\n", hr, pszMetricsFileName);
+		return 0;
+	}
+	return 1;
+}
+
+//
+// class CFileEncoder
+//
+// Encodes the frames of the encoder pool with WIC, the ordered writes go to
+// <name>_NNNNNN.<ext>.
+//
+class CFileEncoder : public IDXGICaptureEncoder
+{
+private:
+	CDXGICapture *m_pCapture;
+	GUID          m_guidContainerFormat;
+	std::wstring  m_baseName;
+	std::wstring  m_extension;
+
+public:
+	CFileEncoder(CDXGICapture *pCapture, REFGUID guidContainerFormat, const std::wstring &baseName, const std::wstring &extension)
+		: m_pCapture(pCapture)
+		, m_guidContainerFormat(guidContainerFormat)
+		, m_baseName(baseName)
+		, m_extension(extension)
+	{
+	}
+
+	virtual HRESULT BeginThread()
+	{
+		return CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	}
+
+	virtual void EndThread()
+	{
+		CoUninitialize();
+	}
+
+	virtual HRESULT Encode(_In_ const CDXGICaptureFrame *pFrame, _Inout_ tagFrameBufferInfo *pOutput, _Out_ UINT *pRetSize)
+	{
+		return m_pCapture->EncodeFrame(pFrame, m_guidContainerFormat, pOutput, pRetSize);
+	}
+
+	virtual HRESULT Write(_In_ const CDXGICaptureFrame *pFrame, _In_ UINT64 ullSequence, _In_reads_bytes_(uiSize) const BYTE *pData, _In_ UINT uiSize)
+	{
+		UNREFERENCED_PARAMETER(pFrame);
+
+		WCHAR wszFileName[1024];
+		swprintf_s(wszFileName, L"%s_%06d%s", m_baseName.c_str(), (int)ullSequence + 1, m_extension.c_str());
+
+		CDXGICaptureMetrics::clock_type::time_point tick = CDXGICaptureMetrics::clock_type::now();
+		FILE *fp = nullptr;
+		if ((_wfopen_s(&fp, wszFileName, L"wb") != 0) || (nullptr == fp)) {
+			return HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
+		}
+		size_t written = fwrite(pData, 1, uiSize, fp);
+		fclose(fp);
+		m_pCapture->GetMetrics()->RecordWrite(CDXGICaptureMetrics::Lap(&tick), written);
+		return (written == uiSize) ? S_OK : HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+	}
+};
+
+//
+// struct tagCaptureFramesContext_s
+//
+typedef struct tagCaptureFramesContext_s
+{
+	CDXGICapture *pCapture;
+	CDXGICaptureEncoderPool *pEncoderPool;
+	std::wstring  baseName;
+	std::wstring  extension;
+	int           frameCount;
+	int           framesWritten;
+	int           framesSkipped;
+	UINT64        lastContentHash;
+	HRESULT       hrResult;
+	HANDLE        hDoneEvent;
+	UINT64        lastFrameNumber;
+	UINT64        updatedFrames;
+	UINT64        bytesTouched;
+	UINT64        bytesTotal;
+	UINT64        frameCopies;
+	UINT64        bytesCopied;
+	UINT64        bytesStreamed;
+	BOOL          passthrough;
+} tagCaptureFramesContext;
+
+static HRESULT on_capture_frame(CDXGICaptureFrame *pFrame, void *pContext)
+{
+	tagCaptureFramesContext *pCtx = (tagCaptureFramesContext*)pContext;
+
+	// update statistics of new desktop images (a repeated frame keeps its number)
+	if (pFrame->GetFrameNumber() != pCtx->lastFrameNumber)
+	{
+		tagFrameUpdateStats stats;
+		if (SUCCEEDED(pCtx->pCapture->GetFrameUpdateStats(&stats)))
+		{
+			pCtx->updatedFrames++;
+			pCtx->bytesTouched += stats.BytesTouched;
+			pCtx->bytesTotal   += stats.BytesTotal;
+		}
+		tagFrameCopyStats copyStats;
+		if (SUCCEEDED(pCtx->pCapture->GetFrameCopyStats(&copyStats)))
+		{
+			pCtx->frameCopies   += copyStats.Copies;
+			pCtx->bytesCopied   += copyStats.BytesCopied;
+			pCtx->bytesStreamed += copyStats.BytesStreamed;
+			pCtx->passthrough    = copyStats.Passthrough;
+		}
+		pCtx->lastFrameNumber = pFrame->GetFrameNumber();
+	}
+
+	// an unchanged image (SkipUnchanged) is not written again
+	HRESULT hr = S_OK;
+	if ((pFrame->GetContentHash() != 0) && (pFrame->GetContentHash() == pCtx->lastContentHash))
+	{
+		if (++(pCtx->framesSkipped) + pCtx->framesWritten >= pCtx->frameCount)
+		{
+			SetEvent(pCtx->hDoneEvent);
+			return S_FALSE; // done
+		}
+		return S_OK;
+	}
+	pCtx->lastContentHash = pFrame->GetContentHash();
+
+	// the pool takes its own reference, the frame is written in order by a worker
+	if (nullptr != pCtx->pEncoderPool)
+	{
+		hr = pCtx->pEncoderPool->Submit(pFrame);
+	}
+	else
+	{
+		WCHAR wszFileName[1024];
+		swprintf_s(wszFileName, L"%s_%06d%s", pCtx->baseName.c_str(), pCtx->framesWritten + 1, pCtx->extension.c_str());
+		hr = pCtx->pCapture->SaveFrameToFile(pFrame, wszFileName);
+	}
+	if (FAILED(hr))
+	{
+		pCtx->hrResult = hr;
+		SetEvent(pCtx->hDoneEvent);
+		return hr;
+	}
+
+	if (++(pCtx->framesWritten) + pCtx->framesSkipped >= pCtx->frameCount)
+	{
+		SetEvent(pCtx->hDoneEvent);
+		return S_FALSE; // done
+	}
+
+	return S_OK;
+}
+
+int capture_frames(CDXGICapture *pCapture, const char *pszOutputFileName, int frameCount, int targetFps, const tagEncoderOptions *pEncoderOptions)
+{
+	tagCaptureFramesContext ctx;
+	ctx.pCapture        = pCapture;
+	ctx.pEncoderPool    = nullptr;
+	ctx.baseName        = (LPCWSTR)CA2WEX<>(pszOutputFileName);
+	ctx.frameCount      = frameCount;
+	ctx.framesWritten   = 0;
+	ctx.framesSkipped   = 0;
+	ctx.lastContentHash = 0;
+	ctx.hrResult        = S_OK;
+	ctx.lastFrameNumber = 0;
+	ctx.updatedFrames   = 0;
+	ctx.bytesTouched    = 0;
+	ctx.bytesTotal      = 0;
+	ctx.frameCopies     = 0;
+	ctx.bytesCopied     = 0;
+	ctx.bytesStreamed   = 0;
+	ctx.passthrough     = FALSE;
+	ctx.hDoneEvent      = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (NULL == ctx.hDoneEvent)
+	{
+		printf("Error[0x%08X]: CreateEvent failed.\n", HRESULT_FROM_WIN32(GetLastError()));
+		return -1;
+	}
+
+	// "name.ext" -> "name_000001.ext", ...
+	size_t nDot = ctx.baseName.find_last_of(L'.');
+	size_t nSep = ctx.baseName.find_last_of(L"\\/");
+	if ((nDot != std::wstring::npos) && ((nSep == std::wstring::npos) || (nDot > nSep)))
+	{
+		ctx.extension = ctx.baseName.substr(nDot);
+		ctx.baseName.erase(nDot);
+	}
+
+	HRESULT hr = S_OK;
+	GUID guidContainerFormat = GUID_NULL;
+	if (!pEncoderOptions->stream && (pEncoderOptions->workers > 0))
+	{
+		hr = DXGICaptureHelper::GetContainerFormatByFileName((LPCWSTR)CA2WEX<>(pszOutputFileName), &guidContainerFormat);
+		if (FAILED(hr))
+		{
+			CloseHandle(ctx.hDoneEvent);
+			printf("Error[0x%08X]: Unsupported output file format.\n", hr);
+			return -1;
+		}
+	}
+
+	// the pool is stopped before the encoder goes away
+	CFileEncoder fileEncoder(pCapture, guidContainerFormat, ctx.baseName, ctx.extension);
+	CDXGIStreamOutput streamOutput;
+	CDXGIStreamEncoder streamEncoder(&streamOutput, (tagStreamFormat)pEncoderOptions->streamFormat, (UINT)targetFps);
+	CDXGICaptureEncoderPool encoderPool;
+	if (pEncoderOptions->stream)
+	{
+		// waits for the reader of a pipe
+		hr = streamOutput.Open(pszOutputFileName);
+		if (FAILED(hr))
+		{
+			CloseHandle(ctx.hDoneEvent);
+			printf("Error[0x%08X]: Could not open the output stream '%s'.\n", hr, pszOutputFileName);
+			return -1;
+		}
+		// a single writer, the queue takes the frames while the reader is behind (-bp drops them)
+		hr = encoderPool.Initialize(&streamEncoder, 1, (UINT)pEncoderOptions->queueDepth, (tagEncodeBackpressure)pEncoderOptions->backpressure);
+		if (FAILED(hr))
+		{
+			CloseHandle(ctx.hDoneEvent);
+			printf("Error[0x%08X]: CDXGICaptureEncoderPool::Initialize failed.\n", hr);
+			return -1;
+		}
+		ctx.pEncoderPool = &encoderPool;
+	}
+	else if (pEncoderOptions->workers > 0)
+	{
+		hr = encoderPool.Initialize(&fileEncoder, (UINT)pEncoderOptions->workers, (UINT)pEncoderOptions->queueDepth, (tagEncodeBackpressure)pEncoderOptions->backpressure);
+		if (FAILED(hr))
+		{
+			CloseHandle(ctx.hDoneEvent);
+			printf("Error[0x%08X]: CDXGICaptureEncoderPool::Initialize failed.\n", hr);
+			return -1;
+		}
+		ctx.pEncoderPool = &encoderPool;
+	}
+
+	ULONGLONG ullStartTick = GetTickCount64();
+
+	hr = pCapture->StartCapture(on_capture_frame, &ctx, (UINT)targetFps);
+	if (FAILED(hr))
+	{
+		CloseHandle(ctx.hDoneEvent);
+		printf("Error[0x%08X]: CDXGICapture::StartCapture failed.\n", hr);
+		return -1;
+	}
+
+	// the capture thread also ends by itself on a capture error
+	while ((WaitForSingleObject(ctx.hDoneEvent, 100) == WAIT_TIMEOUT) && pCapture->IsCapturing()) {
+	}
+	hr = pCapture->StopCapture();
+	CloseHandle(ctx.hDoneEvent);
+
+	// the queued frames are still encoded and written
+	if (nullptr != ctx.pEncoderPool)
+	{
+		HRESULT hrPool = encoderPool.Terminate();
+		if (SUCCEEDED(ctx.hrResult) && FAILED(hrPool)) {
+			ctx.hrResult = hrPool;
+		}
+	}
+	streamOutput.Close();
+
+	ULONGLONG ullDuration = GetTickCount64() - ullStartTick;
+
+	// a stream ends when its reader goes away
+	if (ctx.hrResult == DXGICAPTURE_E_BROKEN_PIPE)
+	{
+		printf("The reader closed the output stream.\n");
+		ctx.hrResult = S_OK;
+	}
+
+	if (FAILED(ctx.hrResult) || FAILED(hr))
+	{
+		printf("Error[0x%08X]: continuous capture failed.\n", FAILED(ctx.hrResult) ? ctx.hrResult : hr);
+		return -1;
+	}
+
+	printf("Captured %d frames in %llu msec (%.2f fps)\n",
+		ctx.framesWritten + ctx.framesSkipped, ullDuration,
+		(ullDuration > 0) ? ((ctx.framesWritten + ctx.framesSkipped) * 1000.0 / (double)ullDuration) : 0.0);
+
+	tagTileHashStats hashStats;
+	if (SUCCEEDED(pCapture->GetTileHashStats(&hashStats)) && (hashStats.Frames > 0))
+	{
+		printf("Unchanged frames: %d skipped, %d written, tile hash %.2f msec per frame, %.2f%% of the tiles changed\n",
+			ctx.framesSkipped, ctx.framesWritten, hashStats.HashUsec / 1000.0 / (double)hashStats.Frames,
+			(hashStats.TilesHashed > 0) ? (hashStats.TilesChanged * 100.0 / (double)hashStats.TilesHashed) : 0.0);
+	}
+
+	if (ctx.updatedFrames > 0)
+	{
+		printf("Desktop updates: %llu, bytes touched per update: %llu (%.2f%% of the frame)\n",
+			ctx.updatedFrames, ctx.bytesTouched / ctx.updatedFrames,
+			(ctx.bytesTotal > 0) ? (ctx.bytesTouched * 100.0 / (double)ctx.bytesTotal) : 0.0);
+		printf("Frame copies: %.2f per update, %.2f MB per update (%.1f%% streamed)%s\n",
+			ctx.frameCopies / (double)ctx.updatedFrames, ctx.bytesCopied / (double)ctx.updatedFrames / (1024.0 * 1024.0),
+			(ctx.bytesCopied > 0) ? (ctx.bytesStreamed * 100.0 / (double)ctx.bytesCopied) : 0.0,
+			ctx.passthrough ? ", passthrough" : "");
+	}
+
+	if (nullptr != ctx.pEncoderPool)
+	{
+		tagEncoderPoolStats poolStats;
+		encoderPool.GetStats(&poolStats);
+		printf("Encoder pool: %u workers, %u slots, max queued %u, written %llu, dropped oldest %llu, dropped newest %llu, blocked %llu (%.2f msec)\n",
+			poolStats.Workers, poolStats.Slots, poolStats.MaxQueueDepth, poolStats.Written,
+			poolStats.DroppedOldest, poolStats.DroppedNewest, poolStats.Blocked, poolStats.BlockedUsec / 1000.0);
+		for (UINT i = 0; i < poolStats.Workers; ++i)
+		{
+			tagEncoderWorkerStats workerStats;
+			if (SUCCEEDED(encoderPool.GetWorkerStats(i, &workerStats)))
+			{
+				printf("Encoder worker %u: %llu frames, encode %.2f msec, write %.2f msec, utilisation %.1f%%\n",
+					i, workerStats.Frames, workerStats.EncodeUsec / 1000.0, workerStats.WriteUsec / 1000.0,
+					(workerStats.ElapsedUsec > 0) ? (100.0 * (workerStats.EncodeUsec + workerStats.WriteUsec) / workerStats.ElapsedUsec) : 0.0);
+			}
+		}
+	}
+
+	if (pEncoderOptions->stream)
+	{
+		tagStreamOutputStats streamStats;
+		streamOutput.GetStats(&streamStats);
+		printf("Stream: %llu frames, %.2f MB (%.2f MB/s), %.2f writes per frame, write %.2f msec per frame (max %.2f msec)\n",
+			streamStats.Frames, streamStats.BytesWritten / (1024.0 * 1024.0),
+			(ullDuration > 0) ? (streamStats.BytesWritten * 1000.0 / (1024.0 * 1024.0) / (double)ullDuration) : 0.0,
+			(streamStats.Frames > 0) ? (streamStats.WriteCalls / (double)streamStats.Frames) : 0.0,
+			(streamStats.Frames > 0) ? (streamStats.WriteUsec / 1000.0 / (double)streamStats.Frames) : 0.0,
+			streamStats.MaxWriteUsec / 1000.0);
+	}
+
+	tagStagingRingStats ringStats;
+	if (SUCCEEDED(pCapture->GetStagingRingStats(&ringStats)) && (ringStats.Retrieved > 0))
+	{
+		printf("Staging ring: depth %u, retrieved %llu, stalls %llu, latency %.2f frames / %.2f msec (max %.2f msec)\n",
+			ringStats.Depth, ringStats.Retrieved, ringStats.Stalls,
+			ringStats.TotalLatencyFrames / (double)ringStats.Retrieved,
+			ringStats.TotalLatencyUsec / (double)ringStats.Retrieved / 1000.0,
+			ringStats.MaxLatencyUsec / 1000.0);
+	}
+
+	return 0;
+}
+
+int capture_canvas(CDXGICapture *pCapture, const char *pszOutputFileName, int frameCount, int showCursor)
+{
+	// one duplication (and device) per monitor, laid out by the desktop coordinates
+	CDXGIDuplicationSource sources[DXGICAPTURE_CANVAS_MAX_MONITORS];
+	tagCanvasMonitor monitors[DXGICAPTURE_CANVAS_MAX_MONITORS];
+	UINT uiCount = 0;
+	int nMonitorCount = pCapture->GetDublicatorMonitorInfoCount();
+	for (int i = 0; (i < nMonitorCount) && (uiCount < DXGICAPTURE_CANVAS_MAX_MONITORS); ++i)
+	{
+		tagDublicatorMonitorInfo info;
+		if (S_OK != pCapture->GetDublicatorMonitorInfo(i, &info)) {
+			continue;
+		}
+		const tagDublicatorMonitorInfo *pInfo = &info;
+		HRESULT hr = sources[uiCount].Initialize((UINT)pInfo->Idx);
+		if (FAILED(hr))
+		{
+			printf("Error[0x%08X]: CDXGIDuplicationSource::Initialize of monitor '%d' failed.\n", hr, pInfo->Idx);
+			return -1;
+		}
+		tagCaptureSourceDesc desc;
+		sources[uiCount].GetDesc(&desc);
+		monitors[uiCount].Source        = &sources[uiCount];
+		monitors[uiCount].Bounds.X      = pInfo->Bounds.X;
+		monitors[uiCount].Bounds.Y      = pInfo->Bounds.Y;
+		monitors[uiCount].Bounds.Width  = desc.DesktopWidth;
+		monitors[uiCount].Bounds.Height = desc.DesktopHeight;
+		uiCount++;
+	}
+
+	tagCanvasConfig canvasConfig;
+	canvasConfig.SyncWindowUsec  = DXGICAPTURE_CANVAS_DEFAULT_SYNC_WINDOW;
+	canvasConfig.ShowPointer     = showCursor;
+	canvasConfig.BackgroundColor = 0xFF000000;
+
+	CDXGICaptureCanvas canvas;
+	HRESULT hr = canvas.Initialize(monitors, uiCount, &canvasConfig);
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGICaptureCanvas::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	CDXGICaptureFramePool *pFramePool = CDXGICaptureFramePool::Create(1);
+	if (nullptr == pFramePool)
+	{
+		printf("Error: Out of memory.\n");
+		return -1;
+	}
+
+	// "name.ext" -> "name_000001.ext", ...
+	std::wstring baseName = (LPCWSTR)CA2WEX<>(pszOutputFileName);
+	std::wstring extension;
+	size_t nDot = baseName.find_last_of(L'.');
+	size_t nSep = baseName.find_last_of(L"\\/");
+	if ((nDot != std::wstring::npos) && ((nSep == std::wstring::npos) || (nDot > nSep)))
+	{
+		extension = baseName.substr(nDot);
+		baseName.erase(nDot);
+	}
+
+	const tagFrameBounds *pDesktop = canvas.GetDesktopBounds();
+	printf("Virtual desktop: %dx%d at (%d, %d), %u monitors\n", pDesktop->Width, pDesktop->Height, pDesktop->X, pDesktop->Y, uiCount);
+
+	ULONGLONG ullStartTick = GetTickCount64();
+	hr = canvas.Start();
+
+	// the frames are written once every monitor delivered its first image
+	BOOL bSeen[DXGICAPTURE_CANVAS_MAX_MONITORS] = { FALSE };
+	UINT uiSeen = 0;
+	int framesWritten = 0;
+	int timeouts = 0;
+	while (SUCCEEDED(hr) && (framesWritten < frameCount))
+	{
+		BOOL bTimeout = FALSE;
+		hr = canvas.ProcessFrame(1000, &bTimeout);
+		CHECK_HR_BREAK(hr);
+		if (bTimeout)
+		{
+			if (++timeouts >= 5)
+			{
+				hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+				break;
+			}
+			continue;
+		}
+		for (UINT i = 0; i < uiCount; ++i)
+		{
+			if (!bSeen[i] && canvas.IsMonitorUpdated(i))
+			{
+				bSeen[i] = TRUE;
+				uiSeen++;
+			}
+		}
+		if (uiSeen < uiCount) {
+			continue;
+		}
+
+		const tagFrameBufferInfo *pCanvas = canvas.GetCanvas();
+		CDXGICaptureFrame *pFrame = pFramePool->AcquireFrame(pCanvas->Bounds.Width, pCanvas->Bounds.Height, pCanvas->Pitch);
+		if (nullptr == pFrame)
+		{
+			hr = E_OUTOFMEMORY;
+			break;
+		}
+		DXGICaptureCopy::CopyPixels(pCanvas->Buffer, pCanvas->Pitch, pFrame->GetBuffer(), pCanvas->Pitch,
+			pCanvas->Bounds.Width, pCanvas->Bounds.Height, FALSE, tagSimdLevel_Auto, nullptr);
+		pFrame->SetFrameInfo(canvas.GetFrameNumber(), canvas.GetTimestamp());
+
+		framesWritten++;
+		if (frameCount > 1)
+		{
+			WCHAR wszFileName[1024];
+			swprintf_s(wszFileName, L"%s_%06d%s", baseName.c_str(), framesWritten, extension.c_str());
+			hr = pCapture->SaveFrameToFile(pFrame, wszFileName);
+		}
+		else {
+			hr = pCapture->SaveFrameToFile(pFrame, (LPCWSTR)CA2WEX<>(pszOutputFileName));
+		}
+		pFrame->Release();
+	}
+	canvas.Stop();
+	pFramePool->Release();
+
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: Capture of all monitors failed.\n", hr);
+		return -1;
+	}
+
+	ULONGLONG ullDuration = GetTickCount64() - ullStartTick;
+	tagCanvasStats stats;
+	canvas.GetStats(&stats);
+	printf("Frames written: %d, composed: %llu (%llu partial) in %llu msec\n",
+		framesWritten, stats.Frames, stats.PartialFrames, ullDuration);
+	printf("Monitor skew: avg %.2f msec, max %.2f msec\n",
+		(stats.SkewFrames > 0) ? (stats.TotalSkewUsec / 1000.0 / (double)stats.SkewFrames) : 0.0, stats.MaxSkewUsec / 1000.0);
+	printf("Canvas copies: %.2f MB per frame (%.1f%% of the canvas)\n",
+		(stats.Frames > 0) ? (stats.BytesCopied / (1024.0 * 1024.0) / (double)stats.Frames) : 0.0,
+		(stats.BytesTotal > 0) ? (100.0 * stats.BytesCopied / stats.BytesTotal) : 0.0);
+
+	return 0;
+}
+
+int parse_regions(const char *pszRegions, tagScreenCaptureFilterConfig *pConfig)
+{
+	pConfig->RegionCount = 0;
+	const char *psz = pszRegions;
+	while ((nullptr != psz) && (*psz != '\0'))
+	{
+		if (pConfig->RegionCount >= DXGICAPTURE_MAX_REGIONS) {
+			return 0;
+		}
+		tagFrameBounds &region = pConfig->Regions[pConfig->RegionCount];
+		if (sscanf_s(psz, "%ld,%ld,%ld,%ld", &region.X, &region.Y, &region.Width, &region.Height) != 4) {
+			return 0;
+		}
+		pConfig->RegionCount++;
+
+		psz = strchr(psz, ';');
+		if (nullptr != psz) {
+			psz++;
+		}
+	}
+	return (pConfig->RegionCount > 0) ? 1 : 0;
+}
+
+int capture_regions(CDXGICapture *pCapture, const char *pszOutputFileName, int frameCount, const tagScreenCaptureFilterConfig *pConfig)
+{
+	// the source copies only the region rects of the desktop image
+	CDXGIDuplicationSource source;
+	HRESULT hr = source.Initialize((UINT)pConfig->MonitorIdx);
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGIDuplicationSource::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	CDXGICapturePipeline pipeline;
+	hr = pipeline.Initialize(&source, pConfig);
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: CDXGICapturePipeline::Initialize failed.\n", hr);
+		return -1;
+	}
+
+	const UINT uiRegionCount = pipeline.GetRegionCount();
+	CDXGICaptureFramePool *pFramePool = CDXGICaptureFramePool::Create(uiRegionCount);
+	if (nullptr == pFramePool)
+	{
+		printf("Error: Out of memory.\n");
+		return -1;
+	}
+
+	// "name.ext" -> "name_r1.ext", "name_r1_000001.ext", ...
+	std::wstring baseName = (LPCWSTR)CA2WEX<>(pszOutputFileName);
+	std::wstring extension;
+	size_t nDot = baseName.find_last_of(L'.');
+	size_t nSep = baseName.find_last_of(L"\\/");
+	if ((nDot != std::wstring::npos) && ((nSep == std::wstring::npos) || (nDot > nSep)))
+	{
+		extension = baseName.substr(nDot);
+		baseName.erase(nDot);
+	}
+
+	ULONGLONG ullStartTick = GetTickCount64();
+	UINT64 ullBytesCopied = 0;
+	UINT64 ullBytesTotal  = 0;
+	int framesWritten = 0;
+	int timeouts = 0;
+	while (SUCCEEDED(hr) && (framesWritten < frameCount))
+	{
+		BOOL bTimeout = FALSE;
+		hr = pipeline.ProcessFrame(1000, &bTimeout);
+		CHECK_HR_BREAK(hr);
+		if (bTimeout)
+		{
+			if (++timeouts >= 5)
+			{
+				hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+				break;
+			}
+			continue;
+		}
+
+		tagFrameUpdateStats updateStats;
+		pipeline.GetFrameUpdateStats(&updateStats);
+		ullBytesCopied += updateStats.BytesCopied;
+		ullBytesTotal  += updateStats.BytesTotal;
+
+		framesWritten++;
+		for (UINT i = 0; SUCCEEDED(hr) && (i < uiRegionCount); ++i)
+		{
+			const tagFrameBufferInfo *pOutput = pipeline.GetRegionOutput(i);
+			CDXGICaptureFrame *pFrame = pFramePool->AcquireFrame(pOutput->Bounds.Width, pOutput->Bounds.Height, pOutput->Bounds.Width * 4);
+			if (nullptr == pFrame)
+			{
+				hr = E_OUTOFMEMORY;
+				break;
+			}
+			DXGICaptureCopy::CopyPixels(pOutput->Buffer, pOutput->Pitch, pFrame->GetBuffer(), pOutput->Bounds.Width * 4,
+				pOutput->Bounds.Width, pOutput->Bounds.Height, TRUE, tagSimdLevel_Auto, nullptr);
+			pFrame->SetFrameInfo(pipeline.GetFrameNumber(), pipeline.GetTimestamp());
+
+			WCHAR wszFileName[1024];
+			if (frameCount > 1) {
+				swprintf_s(wszFileName, L"%s_r%u_%06d%s", baseName.c_str(), i + 1, framesWritten, extension.c_str());
+			}
+			else {
+				swprintf_s(wszFileName, L"%s_r%u%s", baseName.c_str(), i + 1, extension.c_str());
+			}
+			hr = pCapture->SaveFrameToFile(pFrame, wszFileName);
+			pFrame->Release();
+		}
+	}
+	pipeline.Terminate();
+	pFramePool->Release();
+
+	if (FAILED(hr))
+	{
+		printf("Error[0x%08X]: Capture of the regions failed.\n", hr);
+		return -1;
+	}
+
+	tagCaptureSourceDesc desc;
+	source.GetDesc(&desc);
+	printf("Frames written: %d x %u regions in %llu msec\n", framesWritten, uiRegionCount, GetTickCount64() - ullStartTick);
+	printf("Region copies: %.2f MB per frame, the regions cover %.1f%% of the desktop\n",
+		(framesWritten > 0) ? (ullBytesCopied / (1024.0 * 1024.0) / (double)framesWritten) : 0.0,
+		(framesWritten > 0) ? (100.0 * ullBytesTotal / framesWritten / ((double)desc.Width * desc.Height * 4)) : 0.0);
+
+	return 0;
+}
+
+int is_stream_output(const char *pszOutputFileName)
+{
+	size_t nLength = strlen(pszOutputFileName);
+	return (strcmp(pszOutputFileName, "-") == 0) ||
+		(_strnicmp(pszOutputFileName, "\\\\.\\pipe\\", 9) == 0) ||
+		((nLength > 4) && (_stricmp(pszOutputFileName + nLength - 4, ".y4m") == 0));
+}
+
 int show_help(const void *optsctx, const void *optctx)
 {
 	const tagOption *options = (const tagOption*)optsctx;
@@ -271,8 +1173,9 @@ int show_monitors(const void *optsctx, const void *optctx)
 		printf("  \"count\" : %u,\n", nMonitorCount);
 		printf("  \"monitors\" : [\n");
 		for (int i = 0; i < nMonitorCount; ++i) {
-			const tagDublicatorMonitorInfo *pInfo = dxgiCapture.GetDublicatorMonitorInfo(i);
-			if (nullptr != pInfo) {
+			tagDublicatorMonitorInfo info;
+			if (S_OK == dxgiCapture.GetDublicatorMonitorInfo(i, &info)) {
+				const tagDublicatorMonitorInfo *pInfo = &info;
 				printf("    {\n");
 				printf("      \"idx\" : %u,\n", pInfo->Idx);
 				printf("      \"name\" : \"%S\",\n", pInfo->DisplayName);